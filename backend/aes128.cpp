@@ -0,0 +1,142 @@
+// aes128.cpp - AES-128 encryption: AES-NI with a T-table fallback
+#include "aes128.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BLACKBOX_HAVE_AESNI 1
+#endif
+
+namespace {
+
+const uint8_t SBOX[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16};
+
+inline uint8_t xtime(uint8_t x) { return (uint8_t)((x << 1) ^ ((x & 0x80) ? 0x1b : 0x00)); }
+inline uint32_t rotr8(uint32_t x) { return (x >> 8) | (x << 24); }
+
+struct TTables {
+    uint32_t te[4][256];
+    TTables() {
+        for (int x = 0; x < 256; x++) {
+            uint8_t s = SBOX[x], s2 = xtime(s), s3 = s2 ^ s;
+            te[0][x] = (uint32_t)s2 << 24 | (uint32_t)s << 16 | (uint32_t)s << 8 | s3;
+            te[1][x] = rotr8(te[0][x]);
+            te[2][x] = rotr8(te[1][x]);
+            te[3][x] = rotr8(te[2][x]);
+        }
+    }
+};
+const TTables T;
+
+inline uint32_t loadBE(const uint8_t* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+inline void storeBE(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24); p[1] = (uint8_t)(v >> 16); p[2] = (uint8_t)(v >> 8); p[3] = (uint8_t)v;
+}
+
+void encryptPortable(const uint32_t* rk, const uint8_t* in, uint8_t* out) {
+    uint32_t s0 = loadBE(in) ^ rk[0], s1 = loadBE(in + 4) ^ rk[1];
+    uint32_t s2 = loadBE(in + 8) ^ rk[2], s3 = loadBE(in + 12) ^ rk[3];
+    const auto& te = T.te;
+    for (int r = 1; r < 10; r++) {
+        const uint32_t* k = rk + 4 * r;
+        uint32_t t0 = te[0][s0 >> 24] ^ te[1][(s1 >> 16) & 0xff] ^ te[2][(s2 >> 8) & 0xff] ^ te[3][s3 & 0xff] ^ k[0];
+        uint32_t t1 = te[0][s1 >> 24] ^ te[1][(s2 >> 16) & 0xff] ^ te[2][(s3 >> 8) & 0xff] ^ te[3][s0 & 0xff] ^ k[1];
+        uint32_t t2 = te[0][s2 >> 24] ^ te[1][(s3 >> 16) & 0xff] ^ te[2][(s0 >> 8) & 0xff] ^ te[3][s1 & 0xff] ^ k[2];
+        uint32_t t3 = te[0][s3 >> 24] ^ te[1][(s0 >> 16) & 0xff] ^ te[2][(s1 >> 8) & 0xff] ^ te[3][s2 & 0xff] ^ k[3];
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+    const uint32_t* k = rk + 40;
+    auto last = [](uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+        return (uint32_t)SBOX[a >> 24] << 24 | (uint32_t)SBOX[(b >> 16) & 0xff] << 16 |
+               (uint32_t)SBOX[(c >> 8) & 0xff] << 8 | SBOX[d & 0xff];
+    };
+    storeBE(out, last(s0, s1, s2, s3) ^ k[0]);
+    storeBE(out + 4, last(s1, s2, s3, s0) ^ k[1]);
+    storeBE(out + 8, last(s2, s3, s0, s1) ^ k[2]);
+    storeBE(out + 12, last(s3, s0, s1, s2) ^ k[3]);
+}
+
+#ifdef BLACKBOX_HAVE_AESNI
+// Eight blocks in flight hide the aesenc latency
+__attribute__((target("aes,sse2")))
+void encryptAesni(const uint8_t* roundKeys, const uint8_t* in, uint8_t* out, size_t n) {
+    __m128i rk[11];
+    for (int i = 0; i < 11; i++) rk[i] = _mm_load_si128((const __m128i*)(roundKeys + 16 * i));
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i b[8];
+        for (int j = 0; j < 8; j++) b[j] = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + 16 * (i + j))), rk[0]);
+        for (int r = 1; r < 10; r++) {
+            for (int j = 0; j < 8; j++) b[j] = _mm_aesenc_si128(b[j], rk[r]);
+        }
+        for (int j = 0; j < 8; j++) {
+            _mm_storeu_si128((__m128i*)(out + 16 * (i + j)), _mm_aesenclast_si128(b[j], rk[10]));
+        }
+    }
+    for (; i < n; i++) {
+        __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + 16 * i)), rk[0]);
+        for (int r = 1; r < 10; r++) b = _mm_aesenc_si128(b, rk[r]);
+        _mm_storeu_si128((__m128i*)(out + 16 * i), _mm_aesenclast_si128(b, rk[10]));
+    }
+}
+
+bool detectAesni() { return __builtin_cpu_supports("aes"); }
+#else
+bool detectAesni() { return false; }
+#endif
+
+bool usePortable = !detectAesni();
+
+}  // namespace
+
+void Aes128::setKey(const uint8_t* key) {
+    memcpy(roundKeys, key, 16);
+    uint8_t rcon = 0x01;
+    for (int i = 16; i < 176; i += 4) {
+        uint8_t t[4] = {roundKeys[i - 4], roundKeys[i - 3], roundKeys[i - 2], roundKeys[i - 1]};
+        if (i % 16 == 0) {
+            uint8_t first = t[0];
+            t[0] = (uint8_t)(SBOX[t[1]] ^ rcon);
+            t[1] = SBOX[t[2]];
+            t[2] = SBOX[t[3]];
+            t[3] = SBOX[first];
+            rcon = xtime(rcon);
+        }
+        for (int j = 0; j < 4; j++) roundKeys[i + j] = roundKeys[i - 16 + j] ^ t[j];
+    }
+    for (int i = 0; i < 44; i++) roundWords[i] = loadBE(roundKeys + 4 * i);
+}
+
+void Aes128::encryptBlocks(const uint8_t* in, uint8_t* out, size_t n) const {
+#ifdef BLACKBOX_HAVE_AESNI
+    if (!usePortable) {
+        encryptAesni(roundKeys, in, out, n);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < n; i++) encryptPortable(roundWords, in + 16 * i, out + 16 * i);
+}
+
+bool Aes128::hardwareAccelerated() { return !usePortable; }
+
+void Aes128::forcePortable(bool portable) { usePortable = portable || !detectAesni(); }
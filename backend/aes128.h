@@ -0,0 +1,31 @@
+// aes128.h - AES-128 block encryption for bulk CTR keystream generation
+//
+// Uses AES-NI when the CPU has it (checked once at runtime) and a T-table
+// implementation otherwise. Only the encrypt direction is needed for CTR.
+#ifndef BACKEND_AES128_H
+#define BACKEND_AES128_H
+
+#include <cstddef>
+#include <cstdint>
+
+class Aes128 {
+public:
+    Aes128() = default;
+    explicit Aes128(const uint8_t* key) { setKey(key); }
+
+    // Expands the key schedule; do it once per daily key, not per frame
+    void setKey(const uint8_t* key);
+
+    // out[i] = AES(in[i]) for n consecutive 16-byte blocks (in may equal out)
+    void encryptBlocks(const uint8_t* in, uint8_t* out, size_t n) const;
+
+    static bool hardwareAccelerated();
+    // Forces the portable path (tests, benchmarks)
+    static void forcePortable(bool portable);
+
+private:
+    alignas(16) uint8_t roundKeys[176];
+    uint32_t roundWords[44];
+};
+
+#endif
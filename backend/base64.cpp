@@ -0,0 +1,111 @@
+// base64.cpp - Base64 decoding: SSSE3 blocks with a table-driven scalar path
+#include "base64.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BLACKBOX_HAVE_SSSE3 1
+#endif
+
+namespace {
+
+struct DecodeTable {
+    int8_t value[256];
+    DecodeTable() {
+        for (int c = 0; c < 256; c++) value[c] = -1;
+        const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        for (int i = 0; i < 64; i++) value[(uint8_t)alphabet[i]] = (int8_t)i;
+    }
+};
+const DecodeTable TABLE;
+
+// Four characters without padding into three bytes
+inline bool decodeQuad(const char* in, uint8_t* out) {
+    int a = TABLE.value[(uint8_t)in[0]], b = TABLE.value[(uint8_t)in[1]];
+    int c = TABLE.value[(uint8_t)in[2]], d = TABLE.value[(uint8_t)in[3]];
+    if ((a | b | c | d) < 0) return false;
+    uint32_t v = (uint32_t)a << 18 | (uint32_t)b << 12 | (uint32_t)c << 6 | (uint32_t)d;
+    out[0] = (uint8_t)(v >> 16);
+    out[1] = (uint8_t)(v >> 8);
+    out[2] = (uint8_t)v;
+    return true;
+}
+
+#ifdef BLACKBOX_HAVE_SSSE3
+// 16 characters to 12 bytes per step: the character classes come from two
+// nibble lookups, which also flag anything outside the alphabet, and one
+// more lookup gives the offset to add. Stops 8 characters short of the end,
+// so the 16-byte stores stay inside the output and the padding is left to
+// the scalar path. Returns the characters decoded.
+__attribute__((target("ssse3")))
+size_t decodeSsse3(const char* in, size_t len, uint8_t* out) {
+    const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A,
+                                        0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+                                        0x10, 0x10, 0x10, 0x10);
+    const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask2F = _mm_set1_epi8(0x2F);
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    size_t done = 0;
+    for (; done + 24 <= len; done += 16, out += 12) {
+        __m128i chars = _mm_loadu_si128((const __m128i*)(in + done));
+        __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(chars, 4), mask2F);
+        __m128i loNibbles = _mm_and_si128(chars, mask2F);
+        __m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+        __m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+        if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0) break;
+        __m128i isSlash = _mm_cmpeq_epi8(chars, mask2F);
+        __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(isSlash, hiNibbles));
+        __m128i values = _mm_add_epi8(chars, roll);
+        // 00aaaaaa 00bbbbbb 00cccccc 00dddddd -> 24 bits per lane, then packed
+        __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+        __m128i lanes = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+        _mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(lanes, pack));
+    }
+    return done;
+}
+
+bool detectSsse3() { return __builtin_cpu_supports("ssse3"); }
+#else
+bool detectSsse3() { return false; }
+#endif
+
+bool usePortable = !detectSsse3();
+
+}  // namespace
+
+namespace base64 {
+
+bool decode(const char* text, size_t len, std::vector<uint8_t>& out) {
+    if (len % 4) return false;
+    if (len == 0) {
+        out.clear();
+        return true;
+    }
+    size_t padding = text[len - 1] == '=' ? (text[len - 2] == '=' ? 2 : 1) : 0;
+    out.resize(len / 4 * 3 - padding);
+    uint8_t* o = out.data();
+
+    size_t done = 0;
+#ifdef BLACKBOX_HAVE_SSSE3
+    if (!usePortable) done = decodeSsse3(text, len, o);
+#endif
+    o += done / 4 * 3;
+    for (; done + 4 < len; done += 4, o += 3) {
+        if (!decodeQuad(text + done, o)) return false;
+    }
+
+    // The last quad holds the padding
+    char last[4] = {text[done], text[done + 1], padding < 2 ? text[done + 2] : 'A',
+                    padding < 1 ? text[done + 3] : 'A'};
+    uint8_t tail[3];
+    if (!decodeQuad(last, tail)) return false;
+    for (size_t i = 0; i < 3 - padding; i++) o[i] = tail[i];
+    return true;
+}
+
+bool hardwareAccelerated() { return !usePortable; }
+
+void forcePortable(bool portable) { usePortable = portable || !detectSsse3(); }
+
+}  // namespace base64
@@ -0,0 +1,26 @@
+// base64.h - Strict base64 decoding of uplink payloads (frm_payload)
+//
+// Standard alphabet, padded input only. Blocks of 16 characters are decoded
+// with SSSE3 shuffles when the CPU has them (checked once at runtime); the
+// last block and anything the vector check rejects go through the scalar
+// decoder, which has the final say on validity.
+#ifndef BACKEND_BASE64_H
+#define BACKEND_BASE64_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace base64 {
+
+// Replaces out with the decoded bytes; false (out unspecified) if text is
+// not padded base64
+bool decode(const char* text, size_t len, std::vector<uint8_t>& out);
+
+bool hardwareAccelerated();
+// Forces the scalar path (tests, benchmarks)
+void forcePortable(bool portable);
+
+}  // namespace base64
+
+#endif
@@ -0,0 +1,87 @@
+// bench_frame_decoder.cpp - Batch decode vs one key lookup + AES setup per frame
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include "aes128.h"
+#include "frame_decoder.h"
+
+namespace {
+
+constexpr uint64_t START = 1742860800;
+constexpr int VEHICLES = 100;
+constexpr int DAYS = 7;
+const uint8_t MASTER[32] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
+                            17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32};
+
+std::string vehicleName(int v) { return "bench-" + std::to_string(v); }
+
+// n frames spread over VEHICLES vehicles and DAYS days, a year into the chain
+struct Fleet {
+    KeyCheckpointIndex index{32};
+    FrameBatch batch;
+
+    explicit Fleet(size_t n) {
+        for (int v = 0; v < VEHICLES; v++) index.addVehicle(vehicleName(v), MASTER, sizeof(MASTER), START);
+        std::vector<KeyCheckpointIndex::Key> keys(VEHICLES * DAYS);
+        for (int v = 0; v < VEHICLES; v++) {
+            for (int d = 0; d < DAYS; d++) {
+                index.keyFor(vehicleName(v), START + (365 + d) * (uint64_t)SECONDS_PER_DAY, keys[v * DAYS + d]);
+            }
+        }
+        for (size_t i = 0; i < n; i++) {
+            int v = (int)(i % VEHICLES), d = (int)(i / VEHICLES % DAYS);
+            SensorReading r{20, {1, 2, 3}, 981, 454600000, 91900000, 900, 10};
+            uint8_t f[PAYLOAD_SIZE];
+            TelemetryFrame::write(r, f);
+            f[0] = (uint8_t)i;
+            f[1] = (uint8_t)(i >> 8);
+            uint8_t iv[16];
+            frameCounterBlock((uint32_t)i, iv);
+            hal::aes128Ctr(keys[v * DAYS + d].data(), iv, f + FRAME_ENCRYPTED_OFFSET, ENCRYPTED_BLOCK_LEN);
+            batch.add(vehicleName(v), START + (365 + d) * (uint64_t)SECONDS_PER_DAY + i % 80000, f, sizeof(f));
+        }
+    }
+};
+
+Fleet& fleet() {
+    static Fleet f(100000);
+    return f;
+}
+
+// Args: worker threads, portable AES (0/1)
+void BM_BatchDecode(benchmark::State& state) {
+    Fleet& f = fleet();
+    Aes128::forcePortable(state.range(1) != 0);
+    FrameDecoder decoder(f.index, (unsigned)state.range(0));
+    std::vector<DecodedFrame> out;
+    for (auto _ : state) {
+        size_t ok = decoder.decode(f.batch, out);
+        if (ok != f.batch.size()) state.SkipWithError("decode failed");
+        benchmark::DoNotOptimize(out.data());
+    }
+    Aes128::forcePortable(false);
+    state.SetItemsProcessed(state.iterations() * f.batch.size());
+}
+BENCHMARK(BM_BatchDecode)->Args({1, 0})->Args({1, 1})->Args({4, 0})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// What a per-message decoder does: key lookup and a fresh AES context per frame
+void BM_PerFrameDecode(benchmark::State& state) {
+    Fleet& f = fleet();
+    const std::vector<std::string>& ids = f.batch.vehicleIds();
+    const size_t n = 10000;
+    std::vector<uint8_t> frame(PAYLOAD_SIZE);
+    for (auto _ : state) {
+        for (size_t i = 0; i < n; i++) {
+            KeyCheckpointIndex::Key key;
+            uint64_t ts = START + (365 + i / VEHICLES % DAYS) * (uint64_t)SECONDS_PER_DAY;
+            f.index.keyFor(ids[i % VEHICLES], ts, key);
+            uint8_t block[ENCRYPTED_BLOCK_LEN];
+            uint8_t iv[16] = {(uint8_t)i, (uint8_t)(i >> 8)};
+            hal::aes128Ctr(key.data(), iv, block, sizeof(block));
+            benchmark::DoNotOptimize(block);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_PerFrameDecode)->Unit(benchmark::kMillisecond);
+
+}  // namespace
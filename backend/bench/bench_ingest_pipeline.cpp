@@ -0,0 +1,112 @@
+// bench_ingest_pipeline.cpp - base64, TTN JSON parsing and sustained pipeline throughput
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "base64.h"
+#include "fleet_sim.h"
+#include "ingest_pipeline.h"
+
+namespace {
+
+std::vector<uint8_t> fromHex(const std::string& hex) {
+    std::vector<uint8_t> out;
+    for (size_t i = 0; i + 1 < hex.size(); i += 2) out.push_back((uint8_t)std::stoul(hex.substr(i, 2), nullptr, 16));
+    return out;
+}
+
+// A replayed file: one day of a fleet's uplinks as TTN JSON, and its keys
+struct Replay {
+    std::vector<std::string> lines;
+    KeyCheckpointIndex index;
+    size_t frames = 0;
+};
+
+const Replay& replay() {
+    static std::unique_ptr<Replay> r;
+    if (r) return *r;
+    r.reset(new Replay);
+    FleetConfig cfg;
+    cfg.vehicles = 200;
+    cfg.durationS = 86400;
+    FleetSimulator fleet(cfg);
+    for (const FleetVehicle& v : fleet.vehicles()) {
+        std::vector<uint8_t> master = fromHex(v.masterKeyHex);
+        r->index.addVehicle(v.id, master.data(), master.size(), v.startEpoch);
+    }
+    fleet.run([&](const SimUplink& up) { r->lines.push_back(UplinkWriter::toTtnJson(up)); });
+    r->frames = fleet.stats().frames;
+    return *r;
+}
+
+// An aggregate uplink's frm_payload (8 frames), vector path vs scalar
+void BM_Base64Decode(benchmark::State& state) {
+    base64::forcePortable(state.range(0) == 0);
+    TtnUplink up;
+    const std::string& line = replay().lines[0];
+    parseTtnUplink(line.data(), line.size(), up);
+    std::string text = up.payload;
+    while (text.size() < 280) text += up.payload;
+    text.resize(text.size() / 4 * 4);
+    std::vector<uint8_t> out;
+    for (auto _ : state) {
+        base64::decode(text.data(), text.size(), out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(state.iterations() * text.size());
+    state.SetLabel(base64::hardwareAccelerated() ? "ssse3" : "scalar");
+    base64::forcePortable(false);
+}
+BENCHMARK(BM_Base64Decode)->Arg(0)->Arg(1);
+
+void BM_ParseTtnUplink(benchmark::State& state) {
+    const std::vector<std::string>& lines = replay().lines;
+    TtnUplink up;
+    size_t i = 0, bytes = 0;
+    for (auto _ : state) {
+        const std::string& line = lines[i++ % lines.size()];
+        benchmark::DoNotOptimize(parseTtnUplink(line.data(), line.size(), up));
+        bytes += line.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_ParseTtnUplink);
+
+// The whole replay through every stage, submit to callback; range(0) parse
+// workers. Reports the stage latencies of the last run.
+void BM_IngestSustained(benchmark::State& state) {
+    const Replay& r = replay();
+    IngestPipeline::Stats stats;
+    uint64_t p50 = 0, p99 = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        KeyCheckpointIndex index = r.index;
+        IngestConfig cfg;
+        cfg.parseThreads = (unsigned)state.range(0);
+        std::unique_ptr<IngestPipeline> pipeline(
+            new IngestPipeline(index, cfg, [](const FrameBatch&, const std::vector<DecodedFrame>& frames) {
+                benchmark::DoNotOptimize(frames.data());
+            }));
+        state.ResumeTiming();
+        for (const std::string& line : r.lines) pipeline->submit(line);
+        pipeline->finish();
+        state.PauseTiming();
+        stats = pipeline->stats();
+        p50 = pipeline->latency(IngestStage::EndToEnd).percentile(0.5);
+        p99 = pipeline->latency(IngestStage::EndToEnd).percentile(0.99);
+        pipeline.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * r.frames);
+    state.counters["uplinks/s"] = benchmark::Counter((double)(state.iterations() * r.lines.size()),
+                                                     benchmark::Counter::kIsRate);
+    state.counters["ok"] = (double)stats.decodedOk;
+    state.counters["batches"] = (double)stats.batches;
+    state.counters["submit_blocked_ms"] = stats.queueBlockedNanos[(size_t)IngestStage::Parse] / 1e6;
+    state.counters["e2e_p50_us"] = p50 / 1e3;
+    state.counters["e2e_p99_us"] = p99 / 1e3;
+}
+BENCHMARK(BM_IngestSustained)->Arg(1)->Arg(2)->Arg(4)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+}  // namespace
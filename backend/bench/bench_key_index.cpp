@@ -0,0 +1,50 @@
+// bench_key_index.cpp - Daily key lookup: naive chain walk vs checkpoint index
+#include <benchmark/benchmark.h>
+#include "key_index.h"
+
+namespace {
+
+constexpr uint64_t START = 1742860800;
+const uint8_t MASTER[32] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
+                            17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32};
+
+// Fleet age in days
+void BM_NaiveChainWalk(benchmark::State& state) {
+    const std::string vid = "bench-vehicle";
+    uint64_t day = START + state.range(0) * SECONDS_PER_DAY;
+    uint8_t key[DAILY_KEY_SIZE];
+    for (auto _ : state) {
+        keychain::deriveInitial(MASTER, sizeof(MASTER), (const uint8_t*)vid.data(), vid.size(), START, key);
+        keychain::advance(key, (const uint8_t*)vid.data(), vid.size(), START, day);
+        benchmark::DoNotOptimize(key);
+    }
+}
+BENCHMARK(BM_NaiveChainWalk)->Arg(30)->Arg(365)->Arg(3 * 365);
+
+void BM_CheckpointLookup(benchmark::State& state) {
+    KeyCheckpointIndex index(32);
+    index.addVehicle("bench-vehicle", MASTER, sizeof(MASTER), START);
+    uint64_t age = state.range(0);
+    index.extendAll(START + age * SECONDS_PER_DAY);
+    KeyCheckpointIndex::Key key;
+    uint64_t i = 0;
+    for (auto _ : state) {
+        index.keyFor("bench-vehicle", START + (i++ % (age + 1)) * SECONDS_PER_DAY, key);
+        benchmark::DoNotOptimize(key);
+    }
+}
+BENCHMARK(BM_CheckpointLookup)->Arg(30)->Arg(365)->Arg(3 * 365);
+
+void BM_RangeOneYear(benchmark::State& state) {
+    KeyCheckpointIndex index(32);
+    index.addVehicle("bench-vehicle", MASTER, sizeof(MASTER), START);
+    std::vector<KeyCheckpointIndex::Key> keys;
+    for (auto _ : state) {
+        index.keysForRange("bench-vehicle", START + 365 * SECONDS_PER_DAY, START + 730 * SECONDS_PER_DAY, keys);
+        benchmark::DoNotOptimize(keys.data());
+    }
+    state.SetItemsProcessed(state.iterations() * 366);
+}
+BENCHMARK(BM_RangeOneYear);
+
+}  // namespace
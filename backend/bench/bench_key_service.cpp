@@ -0,0 +1,109 @@
+// bench_key_service.cpp - Fleet key service: midnight precompute and lookups at 100k+ vehicles
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "key_service.h"
+
+namespace {
+
+constexpr uint64_t START = 1742860800;
+// Two months in: warming a 400k fleet up stays quick
+constexpr uint64_t TODAY = START + 60 * (uint64_t)SECONDS_PER_DAY;
+const uint8_t MASTER[32] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
+                            17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32};
+
+std::vector<std::string> fleetIds(size_t n) {
+    std::vector<std::string> ids;
+    for (size_t i = 0; i < n; i++) ids.push_back("veh-" + std::to_string(100000 + i));
+    return ids;
+}
+
+// One service per fleet size, warmed up to TODAY, shared by the lookup benchmarks
+DailyKeyService& warmFleet(size_t vehicles) {
+    static std::mutex lock;
+    static std::vector<std::pair<size_t, std::unique_ptr<DailyKeyService>>> fleets;
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto& f : fleets) {
+        if (f.first == vehicles) return *f.second;
+    }
+    auto service = std::make_unique<DailyKeyService>();
+    for (const std::string& id : fleetIds(vehicles)) service->addVehicle(id, MASTER, sizeof(MASTER), START);
+    service->precompute(TODAY);
+    fleets.emplace_back(vehicles, std::move(service));
+    return *fleets.back().second;
+}
+
+// Midnight: the next day's key for every vehicle, on every hardware thread
+void BM_PrecomputeMidnight(benchmark::State& state) {
+    KeyServiceConfig cfg;
+    DailyKeyService service(cfg);
+    for (const std::string& id : fleetIds(state.range(0))) service.addVehicle(id, MASTER, sizeof(MASTER), START);
+    uint64_t day = TODAY;
+    service.precompute(day);
+    for (auto _ : state) {
+        day += SECONDS_PER_DAY;
+        benchmark::DoNotOptimize(service.precompute(day));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.counters["threads"] = service.threads();
+}
+BENCHMARK(BM_PrecomputeMidnight)->Arg(100000)->Arg(400000)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Cached (vehicle, day) lookups from several threads at once
+void BM_LookupHit(benchmark::State& state) {
+    const size_t vehicles = state.range(0);
+    DailyKeyService& service = warmFleet(vehicles);
+    static const std::vector<std::string> ids = fleetIds(400000);
+    DailyKeyService::Key key;
+    uint64_t i = state.thread_index() * 7919;
+    for (auto _ : state) {
+        i = i * 6364136223846793005ull + 1442695040888963407ull;
+        benchmark::DoNotOptimize(service.keyFor(ids[(i >> 33) % vehicles], TODAY - (i >> 20 & 1) * SECONDS_PER_DAY, key));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LookupHit)->Arg(100000)->Arg(400000)->ThreadRange(1, 8)->UseRealTime();
+
+// A day outside the window: walked from the nearest checkpoint
+void BM_LookupDerived(benchmark::State& state) {
+    DailyKeyService& service = warmFleet(100000);
+    static const std::vector<std::string> ids = fleetIds(100000);
+    DailyKeyService::Key key;
+    uint64_t i = 0;
+    for (auto _ : state) {
+        i = i * 6364136223846793005ull + 1442695040888963407ull;
+        benchmark::DoNotOptimize(service.keyFor(ids[(i >> 33) % ids.size()], START + (i >> 24) % 57 * SECONDS_PER_DAY, key));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LookupDerived);
+
+// Per-lookup latency percentiles while other threads hammer the same service
+void BM_LookupLatency(benchmark::State& state) {
+    DailyKeyService& service = warmFleet(100000);
+    static const std::vector<std::string> ids = fleetIds(100000);
+    std::vector<uint32_t> samples;
+    samples.reserve(1 << 20);
+    DailyKeyService::Key key;
+    uint64_t i = state.thread_index() * 104729;
+    for (auto _ : state) {
+        i = i * 6364136223846793005ull + 1442695040888963407ull;
+        const std::string& id = ids[(i >> 33) % ids.size()];
+        auto t0 = std::chrono::steady_clock::now();
+        service.keyFor(id, TODAY, key);
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+        if (samples.size() < samples.capacity()) samples.push_back((uint32_t)ns);
+    }
+    if (state.thread_index() == 0 && !samples.empty()) {
+        std::sort(samples.begin(), samples.end());
+        state.counters["p50_ns"] = samples[samples.size() / 2];
+        state.counters["p99_ns"] = samples[samples.size() * 99 / 100];
+        state.counters["p999_ns"] = samples[samples.size() * 999 / 1000];
+    }
+}
+BENCHMARK(BM_LookupLatency)->Threads(1)->Threads(4)->UseRealTime();
+
+}  // namespace
@@ -0,0 +1,100 @@
+// bench_merkle_batcher.cpp - Merkle tree build, inclusion proofs and batching throughput
+#include <benchmark/benchmark.h>
+#include <vector>
+#include "merkle_batcher.h"
+
+namespace {
+
+constexpr uint64_t START = 1742860800;
+
+std::vector<MerkleHash> benchLeaves(size_t n) {
+    std::vector<MerkleHash> out(n);
+    uint8_t frame[26] = {0};
+    for (size_t i = 0; i < n; i++) {
+        for (int b = 0; b < 4; b++) frame[b] = (uint8_t)(i >> (8 * b));
+        out[i] = merkleLeaf(START + i / 10, frame, sizeof(frame));
+    }
+    return out;
+}
+
+// Hashing 26-byte frames into leaves
+void BM_MerkleLeaf(benchmark::State& state) {
+    uint8_t frame[26] = {0};
+    uint64_t i = 0;
+    for (auto _ : state) {
+        frame[0] = (uint8_t)i;
+        benchmark::DoNotOptimize(merkleLeaf(START + i++, frame, sizeof(frame)));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MerkleLeaf);
+
+// The tree over a sealed batch's leaves
+void BM_MerkleBuild(benchmark::State& state) {
+    const std::vector<MerkleHash> leaves = benchLeaves(state.range(0));
+    for (auto _ : state) {
+        MerkleTree tree(leaves);
+        benchmark::DoNotOptimize(tree.root());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_MerkleBuild)->Arg(1 << 10)->Arg(1 << 16)->Unit(benchmark::kMicrosecond);
+
+// An auditor's request: the proof of one frame, then checking it
+void BM_MerkleProof(benchmark::State& state) {
+    const size_t n = state.range(0);
+    MerkleTree tree(benchLeaves(n));
+    size_t i = 0;
+    for (auto _ : state) {
+        std::vector<MerkleHash> proof = tree.proof(i);
+        benchmark::DoNotOptimize(proof.data());
+        i = (i + 7919) % n;
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["proof_hashes"] = (double)tree.proof(n / 3).size();
+}
+BENCHMARK(BM_MerkleProof)->Arg(1 << 10)->Arg(1 << 16);
+
+void BM_MerkleVerify(benchmark::State& state) {
+    const size_t n = state.range(0);
+    MerkleTree tree(benchLeaves(n));
+    std::vector<std::vector<MerkleHash>> proofs;
+    for (size_t i = 0; i < 64; i++) proofs.push_back(tree.proof(i * (n / 64)));
+    size_t i = 0;
+    for (auto _ : state) {
+        size_t index = i * (n / 64);
+        benchmark::DoNotOptimize(MerkleTree::verify(tree.leaf(index), index, n, proofs[i], tree.root()));
+        i = (i + 1) % 64;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MerkleVerify)->Arg(1 << 10)->Arg(1 << 16);
+
+// 1000 vehicles at one frame per second each through 5-minute windows,
+// anchored to the in-memory ledger: frames in, one root per vehicle and window out
+void BM_MerkleBatcherIngest(benchmark::State& state) {
+    constexpr int VEHICLES = 1000;
+    std::vector<std::string> ids;
+    for (int v = 0; v < VEHICLES; v++) ids.push_back("veh-" + std::to_string(v));
+    uint8_t frame[26] = {0};
+    uint64_t frames = 0, anchors = 0;
+    for (auto _ : state) {
+        LocalLedger ledger;
+        MerkleBatcher batcher(ledger);
+        for (uint64_t s = 0; s < 3600; s++) {
+            for (int v = 0; v < VEHICLES; v++) {
+                frame[0] = (uint8_t)s;
+                frame[1] = (uint8_t)v;
+                batcher.add(ids[v], START + s, frame, sizeof(frame));
+            }
+        }
+        batcher.sealAll();
+        frames += 3600 * VEHICLES;
+        anchors += ledger.records().size();
+    }
+    state.SetItemsProcessed(frames);
+    state.counters["frames_per_anchor"] = anchors ? (double)frames / anchors : 0.0;
+}
+BENCHMARK(BM_MerkleBatcherIngest)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+}  // namespace
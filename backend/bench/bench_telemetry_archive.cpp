@@ -0,0 +1,138 @@
+// bench_telemetry_archive.cpp - Appends and range queries over a large archive
+//
+// The archive holds BB_ARCHIVE_ROWS rows (default 1e7, about 260 MB) over
+// VEHICLES vehicles and DAYS days; BB_ARCHIVE_ROWS=1000000000 is the 1e9-row
+// run (26 GB of disk). It is built once under the temp directory and reused
+// while its row count matches.
+#include <benchmark/benchmark.h>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <unistd.h>
+#include "telemetry_archive.h"
+
+namespace {
+
+constexpr uint64_t START = 1742860800;
+constexpr int VEHICLES = 100;
+constexpr int DAYS = 10;
+// Accel is the quiet band 900..1099 except one pothole in every POTHOLE_EVERY rows
+constexpr uint64_t POTHOLE_EVERY = 1000000;
+constexpr uint16_t POTHOLE = 4000;
+
+std::string vehicleName(int v) { return "bench-" + std::to_string(v); }
+
+uint64_t archiveRows() {
+    const char* env = getenv("BB_ARCHIVE_ROWS");
+    return env ? strtoull(env, nullptr, 10) : 10000000;
+}
+
+ArchivedFrame benchRow(uint64_t i, uint64_t timestamp) {
+    ArchivedFrame f;
+    uint32_t h = (uint32_t)(i * 2654435761u);
+    f.timestamp = timestamp;
+    f.counter = (uint32_t)i;
+    f.temperature = (int8_t)(15 + (h >> 28));
+    f.gyro[0] = (int8_t)(h >> 8);
+    f.gyro[1] = (int8_t)(h >> 16);
+    f.gyro[2] = (int8_t)(h >> 24);
+    f.accel = i % POTHOLE_EVERY == POTHOLE_EVERY / 2 ? POTHOLE : (uint16_t)(900 + h % 200);
+    f.accelRms = (uint16_t)(f.accel - 50);
+    f.jerk = (uint16_t)(h % 500);
+    f.lat = 454600000 + (int32_t)(h % 100000);
+    f.lon = 91900000 + (int32_t)(h % 77777);
+    return f;
+}
+
+// Every (vehicle, day) partition gets rows/(VEHICLES * DAYS) rows spread over the day
+struct Archive {
+    std::string root;
+    uint64_t rows;
+    uint64_t perPartition;
+
+    Archive() : rows(archiveRows()) {
+        perPartition = std::max<uint64_t>(1, rows / (VEHICLES * DAYS));
+        rows = perPartition * VEHICLES * DAYS;
+        root = (std::filesystem::temp_directory_path() / ("bbx-archive-bench-" + std::to_string(rows))).string();
+        std::string done = root + "/.complete";
+        if (std::filesystem::exists(done)) return;
+        std::filesystem::remove_all(root);
+        TelemetryArchive archive(root);
+        uint64_t i = 0;
+        for (int v = 0; v < VEHICLES; v++) {
+            for (int d = 0; d < DAYS; d++) {
+                uint64_t day = START + (uint64_t)d * SECONDS_PER_DAY;
+                for (uint64_t r = 0; r < perPartition; r++, i++) {
+                    archive.append(vehicleName(v), benchRow(i, day + r * SECONDS_PER_DAY / perPartition));
+                }
+            }
+        }
+        archive.flush();
+        std::ofstream(done) << rows << "\n";
+    }
+};
+
+Archive& archive() {
+    static Archive a;
+    return a;
+}
+
+void report(benchmark::State& state, const ArchiveScanStats& s) {
+    state.counters["rows_matched"] = (double)s.rowsMatched;
+    state.counters["rows_scanned"] = (double)s.rowsScanned;
+    state.counters["blocks"] = (double)s.blocks;
+    state.counters["blocks_skipped"] = (double)s.blocksSkipped;
+}
+
+// Appending frames as bbdecode hands them over: columns buffered a block at a time
+void BM_ArchiveAppend(benchmark::State& state) {
+    std::string root = (std::filesystem::temp_directory_path() /
+                        ("bbx-archive-append-" + std::to_string(getpid()))).string();
+    uint64_t i = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::filesystem::remove_all(root);
+        state.ResumeTiming();
+        TelemetryArchive a(root);
+        for (uint64_t r = 0; r < 1000000; r++, i++) a.append(vehicleName((int)(r / 100000)), benchRow(i, START + r));
+        a.flush();
+    }
+    std::filesystem::remove_all(root);
+    state.SetItemsProcessed(state.iterations() * 1000000);
+}
+BENCHMARK(BM_ArchiveAppend)->Unit(benchmark::kMillisecond);
+
+// "vehicle X, 14:00-15:00", every column of the matching rows read back
+void BM_ArchiveTimeRange(benchmark::State& state) {
+    Archive& a = archive();
+    TelemetryArchive reader(a.root);
+    ArchiveQuery q;
+    q.vehicles = {vehicleName(42)};
+    q.from = START + 3 * SECONDS_PER_DAY + 14 * 3600;
+    q.to = q.from + 3600;
+    ArchiveScanStats s;
+    uint64_t rows = 0;
+    for (auto _ : state) {
+        s = reader.scan(q, [&](const std::string&, const ArchivedFrame& f) { rows += f.accel != 0; });
+    }
+    benchmark::DoNotOptimize(rows);
+    report(state, s);
+}
+BENCHMARK(BM_ArchiveTimeRange)->Unit(benchmark::kMicrosecond);
+
+// "all frames with accel > N" over the whole archive. Arg 0: N above the
+// quiet band, so the block stats skip all but the pothole blocks. Arg 1: N
+// inside it, so every block is scanned.
+void BM_ArchiveAccelFilter(benchmark::State& state) {
+    Archive& a = archive();
+    TelemetryArchive reader(a.root);
+    ArchiveQuery q;
+    q.filters = {{ArchiveColumn::Accel, state.range(0) ? 1050 : 3000, INT64_MAX}};
+    ArchiveScanStats s;
+    for (auto _ : state) s = reader.count(q);
+    report(state, s);
+    state.SetItemsProcessed(state.iterations() * a.rows);
+}
+BENCHMARK(BM_ArchiveAccelFilter)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+}  // namespace
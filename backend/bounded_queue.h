@@ -0,0 +1,203 @@
+// bounded_queue.h - Fixed-capacity lock-free MPMC queue with blocking ends
+//
+// The ring is Vyukov's bounded MPMC queue: every slot carries a sequence
+// number that says whose turn it is, so tryPush/tryPop are one CAS on the
+// shared index and never take a lock. push() and pop() add blocking on top
+// for the pipeline stages: a full queue parks the producer (backpressure)
+// instead of growing, an empty one parks the consumer. Sleepers announce
+// themselves in a counter that the other side reads after a full fence, so
+// the fast path only touches the mutex when someone is actually asleep.
+//
+// close() wakes everyone: further pushes fail, pops drain what is left and
+// then fail.
+#ifndef BACKEND_BOUNDED_QUEUE_H
+#define BACKEND_BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+template <typename T>
+class BoundedQueue {
+public:
+    // The capacity is rounded up to a power of two
+    explicit BoundedQueue(size_t capacity) {
+        size_t n = 2;
+        while (n < capacity) n <<= 1;
+        mask = n - 1;
+        cells.reset(new Cell[n]);
+        for (size_t i = 0; i < n; i++) cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // Moves v in if there is room
+    bool tryPush(T& v) {
+        if (!enqueue(v)) return false;
+        wake(popWaiters, notEmpty);
+        return true;
+    }
+
+    bool tryPop(T& v) {
+        if (!dequeue(v)) return false;
+        wake(pushWaiters, notFull);
+        return true;
+    }
+
+    // Blocks while the queue is full; false (v untouched) once closed
+    bool push(T& v) {
+        if (isClosed()) return false;
+        if (tryPush(v)) return true;
+        fullWaitCount.fetch_add(1, std::memory_order_relaxed);
+        auto t0 = std::chrono::steady_clock::now();
+        bool pushed;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            pushWaiters.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            while (!(pushed = enqueue(v)) && !isClosed()) notFull.wait_for(lock, WAIT_SLICE);
+            pushWaiters.fetch_sub(1, std::memory_order_relaxed);
+        }
+        if (pushed) wake(popWaiters, notEmpty);
+        blockedTime.fetch_add((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  std::chrono::steady_clock::now() - t0).count(),
+                              std::memory_order_relaxed);
+        return pushed;
+    }
+    bool push(T&& v) { return push(v); }
+
+    // Blocks while the queue is empty; false once closed and drained
+    bool pop(T& v) {
+        if (tryPop(v)) return true;
+        bool popped;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            popWaiters.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            while (!(popped = dequeue(v)) && !isClosed()) notEmpty.wait_for(lock, WAIT_SLICE);
+            popWaiters.fetch_sub(1, std::memory_order_relaxed);
+        }
+        if (popped) wake(pushWaiters, notFull);
+        return popped;
+    }
+
+    // As pop(), giving up after timeout; tell the two apart with drained()
+    bool popFor(T& v, std::chrono::nanoseconds timeout) {
+        if (tryPop(v)) return true;
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        bool popped;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            popWaiters.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            while (!(popped = dequeue(v)) && !isClosed()) {
+                if (notEmpty.wait_until(lock, deadline) == std::cv_status::timeout) {
+                    popped = dequeue(v);
+                    break;
+                }
+            }
+            popWaiters.fetch_sub(1, std::memory_order_relaxed);
+        }
+        if (popped) wake(pushWaiters, notFull);
+        return popped;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closedFlag.store(true, std::memory_order_seq_cst);
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+    bool isClosed() const { return closedFlag.load(std::memory_order_acquire); }
+    // Closed and empty: pop() will not return anything any more
+    bool drained() const { return isClosed() && size() == 0; }
+
+    // A snapshot that may be stale by the time it is used
+    size_t size() const {
+        size_t t = tail.load(std::memory_order_acquire), h = head.load(std::memory_order_acquire);
+        return t > h ? t - h : 0;
+    }
+    size_t capacity() const { return mask + 1; }
+    // Pushes that found the queue full, and the time they spent blocked
+    uint64_t fullWaits() const { return fullWaitCount.load(std::memory_order_relaxed); }
+    uint64_t blockedNanos() const { return blockedTime.load(std::memory_order_relaxed); }
+
+private:
+    // Sleepers wake at least this often to re-check the ring, which bounds
+    // what a lost wakeup can cost
+    static constexpr std::chrono::milliseconds WAIT_SLICE{100};
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    // The lock-free ring proper
+    bool enqueue(T& v) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(v);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // full
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool dequeue(T& v) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    v = std::move(cell.value);
+                    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // empty
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // After a successful push or pop: wake the other side if it sleeps. The
+    // fence pairs with the one a sleeper issues after announcing itself, so
+    // either the sleeper sees the change or this sees the sleeper.
+    void wake(std::atomic<uint32_t>& waiters, std::condition_variable& cv) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_relaxed) == 0) return;
+        { std::lock_guard<std::mutex> lock(mutex); }
+        cv.notify_all();
+    }
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<uint32_t> pushWaiters{0};
+    std::atomic<uint32_t> popWaiters{0};
+    std::atomic<bool> closedFlag{false};
+    std::atomic<uint64_t> fullWaitCount{0};
+    std::atomic<uint64_t> blockedTime{0};
+    std::mutex mutex;
+    std::condition_variable notFull, notEmpty;
+};
+
+#endif
@@ -0,0 +1,212 @@
+// event_decoder.cpp - Crash event decryption and chunk reassembly
+#include "event_decoder.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+uint16_t get16(const uint8_t* p) { return (uint16_t)(p[0] | p[1] << 8); }
+uint32_t get32(const uint8_t* p) { return get16(p) | (uint32_t)get16(p + 2) << 16; }
+
+size_t chunksOf(size_t n) { return (n + CRASH_CHUNK_SAMPLES - 1) / CRASH_CHUNK_SAMPLES; }
+
+}  // namespace
+
+void EventDecoder::decrypt(const Aes128& aes, uint32_t counter, uint8_t* body, size_t len) {
+    constexpr size_t BLOCKS = 16;
+    alignas(16) uint8_t blocks[BLOCKS * 16], stream[BLOCKS * 16];
+    for (size_t off = 0; off < len; off += sizeof(blocks)) {
+        const size_t n = std::min(BLOCKS, (len - off + 15) / 16);
+        for (size_t k = 0; k < n; k++) {
+            // Bytes 4..15 of the counter block start at zero: no carry into the counter
+            const size_t block = off / 16 + k;
+            frameCounterBlock(counter, blocks + 16 * k);
+            blocks[16 * k + 14] = (uint8_t)(block >> 8);
+            blocks[16 * k + 15] = (uint8_t)block;
+        }
+        aes.encryptBlocks(blocks, stream, n);
+        const size_t m = std::min(len - off, n * 16);
+        for (size_t i = 0; i < m; i++) body[off + i] ^= stream[i];
+    }
+}
+
+bool EventDecoder::parseSummary(const uint8_t* body, size_t len, uint8_t chunks, CrashEvent& out) {
+    if (len != CRASH_SUMMARY_BYTES) return false;
+    const int32_t lat = (int32_t)get32(body + 4), lon = (int32_t)get32(body + 8);
+    const uint16_t rateHz = get16(body + 16), accelLsbPerG = get16(body + 18), gyroLsb = get16(body + 20);
+    const uint16_t pre = get16(body + 22), post = get16(body + 24);
+    const uint8_t gpsPoints = body[26];
+    if (rateHz == 0 || gyroLsb == 0 || post == 0) return false;
+    // The MPU6050 ranges: 2048..16384 LSB per g
+    if (accelLsbPerG < 2048 || accelLsbPerG > 16384 || (accelLsbPerG & (accelLsbPerG - 1)) != 0) return false;
+    if (lat < -900000000 || lat > 900000000 || lon < -1800000000 || lon > 1800000000) return false;
+    if (1 + chunksOf(gpsPoints) + chunksOf(pre) + chunksOf(post) != chunks) return false;
+
+    out.epoch = get32(body);
+    out.lat = lat;
+    out.lon = lon;
+    out.peakAccel = get16(body + 12);
+    out.jerk = get16(body + 14);
+    out.rateHz = rateHz;
+    out.accelLsbPerG = accelLsbPerG;
+    out.gyroLsbPerDps10 = gyroLsb;
+    out.preSamples = pre;
+    out.postSamples = post;
+    out.chunks = chunks;
+    out.track.assign(gpsPoints, CrashGpsPoint{});
+    out.samples.assign((size_t)pre + post, CrashSample{});
+    return true;
+}
+
+FrameStatus EventDecoder::add(const std::string& vehicleId, uint64_t timestamp, const uint8_t* data, size_t len,
+                              std::vector<CrashEvent>& done) {
+    if (len < EVENT_HEADER_LEN) return FrameStatus::Truncated;
+    if (data[FRAME_FORMAT_OFFSET] != EVENT_FORMAT) return FrameStatus::BadLayout;
+    const uint8_t id = data[FRAME_FORMAT_OFFSET + 1], chunk = data[FRAME_FORMAT_OFFSET + 2],
+                  chunks = data[FRAME_FORMAT_OFFSET + 3];
+    if (chunk >= chunks) return FrameStatus::BadLayout;
+
+    const auto key = std::make_pair(vehicleId, id);
+    if (chunk == 0) {
+        Open ev;
+        FrameStatus status = decodeSummary(vehicleId, timestamp, data, len, ev);
+        if (status != FrameStatus::Ok) return status;
+        // The id wraps: a new summary replaces whatever was left of an old event
+        Open& placed = open[key] = std::move(ev);
+
+        // Chunks that overtook their summary
+        auto w = waiting.find(vehicleId);
+        if (w != waiting.end()) {
+            auto& queue = w->second;
+            for (auto it = queue.begin(); it != queue.end();) {
+                const uint8_t* f = it->data();
+                if (f[FRAME_FORMAT_OFFSET + 1] == id && f[FRAME_FORMAT_OFFSET + 3] == chunks) {
+                    place(placed, f, it->size());
+                    it = queue.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            if (queue.empty()) waiting.erase(w);
+        }
+        finishIfComplete(vehicleId, id, done);
+        return FrameStatus::Ok;
+    }
+
+    auto it = open.find(key);
+    if (it == open.end() || it->second.event.chunks != chunks) {
+        auto& queue = waiting[vehicleId];
+        if (queue.size() == MAX_WAITING) queue.pop_front();
+        queue.emplace_back(data, data + len);
+        return FrameStatus::MissingReference;
+    }
+    FrameStatus status = place(it->second, data, len);
+    if (status == FrameStatus::Ok) finishIfComplete(vehicleId, id, done);
+    return status;
+}
+
+size_t EventDecoder::waitingChunks() const {
+    size_t n = 0;
+    for (const auto& [id, queue] : waiting) n += queue.size();
+    return n;
+}
+
+FrameStatus EventDecoder::decodeSummary(const std::string& vehicleId, uint64_t timestamp, const uint8_t* data,
+                                        size_t len, Open& out) {
+    if (len != EVENT_HEADER_LEN + CRASH_SUMMARY_BYTES) return FrameStatus::BadLayout;
+    const uint16_t low = get16(data);
+    const uint8_t chunks = data[FRAME_FORMAT_OFFSET + 3];
+    const auto hint = last.find(vehicleId);
+    const int64_t receiveDay = (int64_t)(timestamp / SECONDS_PER_DAY);
+    bool haveKey = false;
+    for (int64_t day = receiveDay; day >= 0 && day >= receiveDay - 1; day--) {
+        KeyCheckpointIndex::Key key;
+        if (!keys.keyFor(vehicleId, (uint64_t)day * SECONDS_PER_DAY, key)) continue;
+        haveKey = true;
+        Aes128 aes(key.data());
+        auto decodes = [&](uint32_t counter) {
+            uint8_t body[CRASH_SUMMARY_BYTES];
+            memcpy(body, data + EVENT_HEADER_LEN, sizeof(body));
+            decrypt(aes, counter, body, sizeof(body));
+            if (!parseSummary(body, sizeof(body), chunks, out.event)) return false;
+            out.day = (int32_t)day;
+            out.key = key;
+            out.counter = counter;
+            return true;
+        };
+
+        bool found = hint != last.end() && hint->second.day == (int32_t)day &&
+                     decodes(FrameDecoder::unwrapCounter(hint->second.counter, low));
+        // Any high half the device can have counted to since the day began
+        const uint64_t dayStart = (uint64_t)day * SECONDS_PER_DAY;
+        const uint64_t elapsed = timestamp > dayStart ? timestamp - dayStart : 0;
+        const uint64_t wraps = std::min<uint64_t>(elapsed * FrameDecoder::MAX_FRAME_RATE / 0x10000 + 1, 0xFFFF);
+        for (uint64_t k = 0; k <= wraps && !found; k++) found = decodes((uint32_t)(k << 16 | low));
+        if (!found) continue;
+
+        CrashEvent& e = out.event;
+        e.vehicleId = vehicleId;
+        e.id = data[FRAME_FORMAT_OFFSET + 1];
+        e.timestamp = timestamp;
+        e.counter = out.counter;
+        out.have.assign(chunks, false);
+        out.have[0] = true;
+        out.missing = chunks - 1u;
+        last[vehicleId] = {out.day, out.counter};
+        return FrameStatus::Ok;
+    }
+    return haveKey ? FrameStatus::WrongKey : FrameStatus::NoKey;
+}
+
+FrameStatus EventDecoder::place(Open& ev, const uint8_t* data, size_t len) {
+    const uint8_t chunk = data[FRAME_FORMAT_OFFSET + 2];
+    if (ev.have[chunk]) return FrameStatus::Ok;
+
+    // Where the chunk goes: GPS points, then pre-trigger and post-trigger samples
+    CrashEvent& e = ev.event;
+    const size_t gpsChunks = chunksOf(e.track.size()), preChunks = chunksOf(e.preSamples);
+    bool gps = chunk <= gpsChunks;
+    size_t first, end;
+    if (gps) {
+        first = (size_t)(chunk - 1) * CRASH_CHUNK_SAMPLES;
+        end = std::min(e.track.size(), first + CRASH_CHUNK_SAMPLES);
+    } else if (chunk <= gpsChunks + preChunks) {
+        first = (chunk - 1 - gpsChunks) * CRASH_CHUNK_SAMPLES;
+        end = std::min<size_t>(e.preSamples, first + CRASH_CHUNK_SAMPLES);
+    } else {
+        first = e.preSamples + (chunk - 1 - gpsChunks - preChunks) * CRASH_CHUNK_SAMPLES;
+        end = std::min(e.samples.size(), first + CRASH_CHUNK_SAMPLES);
+    }
+    const size_t bodyLen = len - EVENT_HEADER_LEN;
+    if (bodyLen != (end - first) * (gps ? CRASH_GPS_POINT_BYTES : CRASH_SAMPLE_BYTES)) return FrameStatus::BadLayout;
+
+    const uint32_t counter = FrameDecoder::unwrapCounter(ev.counter, get16(data));
+    uint8_t body[255];
+    memcpy(body, data + EVENT_HEADER_LEN, bodyLen);
+    decrypt(Aes128(ev.key.data()), counter, body, bodyLen);
+    const uint8_t* p = body;
+    for (size_t i = first; i < end; i++) {
+        if (gps) {
+            e.track[i] = {(int32_t)get32(p), (int32_t)get32(p + 4), (int32_t)get32(p + 8)};
+            p += CRASH_GPS_POINT_BYTES;
+            continue;
+        }
+        CrashSample& s = e.samples[i];
+        for (int k = 0; k < 3; k++) s.accel[k] = (int16_t)get16(p + 2 * k);
+        for (int k = 0; k < 3; k++) s.gyro[k] = (int16_t)get16(p + 6 + 2 * k);
+        p += CRASH_SAMPLE_BYTES;
+    }
+    ev.have[chunk] = true;
+    ev.missing--;
+    ev.counter = counter;
+    last[e.vehicleId] = {ev.day, counter};
+    return FrameStatus::Ok;
+}
+
+void EventDecoder::finishIfComplete(const std::string& vehicleId, uint8_t id, std::vector<CrashEvent>& done) {
+    auto it = open.find(std::make_pair(vehicleId, id));
+    if (it == open.end() || it->second.missing > 0) return;
+    done.push_back(std::move(it->second.event));
+    open.erase(it);
+}
@@ -0,0 +1,112 @@
+// event_decoder.h - Reassembles crash events from their FPORT_EVENT uplinks
+//
+// A crash window (crash_recorder.h) goes out as one event frame per uplink
+// (frame_layout.h): chunk 0 is the summary, then the GPS track, then the IMU
+// samples before and after the trigger. Every chunk takes its own message
+// counter from the stream the telemetry frames use, and its body is AES-CTR
+// encrypted over as many keystream blocks as it needs (the counter block of
+// frameCounterBlock, incremented big-endian).
+//
+// Event frames carry no marker bytes, so the summary is checked instead: its
+// chunk count must follow from its GPS, pre and post counts, and its scales
+// and position must be ones the recorder writes. It is tried under the
+// receive day's key and the day before, first with the counter nearest the
+// vehicle's last event frame, then with every high half the device can have
+// reached since that day began (FrameDecoder::MAX_FRAME_RATE). Later chunks
+// take the summary's day and the counter nearest the chunk before them; a
+// chunk that arrives before its summary waits for it. An event is handed out
+// once every chunk is in. Not thread-safe.
+#ifndef BACKEND_EVENT_DECODER_H
+#define BACKEND_EVENT_DECODER_H
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "aes128.h"
+#include "frame_decoder.h"
+#include "key_index.h"
+
+struct CrashGpsPoint {
+    int32_t millis;  // relative to the trigger (negative: before it)
+    int32_t lat;     // degrees * 1e7
+    int32_t lon;
+};
+
+// One raw IMU sample at the summary's scales
+struct CrashSample {
+    int16_t accel[3];
+    int16_t gyro[3];
+};
+
+struct CrashEvent {
+    std::string vehicleId;
+    uint8_t id = 0;                // wraps at 256
+    uint64_t timestamp = 0;        // receive time of the summary, epoch seconds
+    uint32_t counter = 0;          // of the summary
+    uint32_t epoch = 0;            // of the trigger, 0 without GPS time
+    int32_t lat = 0, lon = 0;      // last fix before the trigger, degrees * 1e7
+    uint16_t peakAccel = 0;        // |a| of the triggering sample, m/s^2 * 100
+    uint16_t jerk = 0;             // (m/s^2 per ms) * 100
+    uint16_t rateHz = 0;           // of the stored samples
+    uint16_t accelLsbPerG = 0;
+    uint16_t gyroLsbPerDps10 = 0;  // LSB per deg/s, * 10
+    uint16_t preSamples = 0;       // samples[preSamples] is the slot of the trigger
+    uint16_t postSamples = 0;
+    uint8_t chunks = 0;
+    std::vector<CrashGpsPoint> track;  // oldest first
+    std::vector<CrashSample> samples;  // preSamples + postSamples
+};
+
+class EventDecoder {
+public:
+    explicit EventDecoder(KeyCheckpointIndex& keys) : keys(keys) {}
+
+    // One FPORT_EVENT uplink received at timestamp (epoch seconds). Events it
+    // completes are appended to done. Ok also for a chunk already received;
+    // MissingReference while the chunk waits for its summary.
+    FrameStatus add(const std::string& vehicleId, uint64_t timestamp, const uint8_t* data, size_t len,
+                    std::vector<CrashEvent>& done);
+
+    // Events with chunks still missing, and chunks waiting for a summary
+    size_t openEvents() const { return open.size(); }
+    size_t waitingChunks() const;
+
+    // Checks a decrypted summary body against the chunk count of its header
+    // and fills the summary fields of out
+    static bool parseSummary(const uint8_t* body, size_t len, uint8_t chunks, CrashEvent& out);
+    // Decrypts an event body in place with the keystream of counter
+    static void decrypt(const Aes128& aes, uint32_t counter, uint8_t* body, size_t len);
+
+    // Chunks kept per vehicle while their summary is missing
+    static constexpr size_t MAX_WAITING = 256;
+
+private:
+    struct Open {
+        CrashEvent event;
+        int32_t day;
+        KeyCheckpointIndex::Key key;
+        uint32_t counter;  // of the last chunk placed
+        std::vector<bool> have;
+        size_t missing;
+    };
+    struct LastCounter {
+        int32_t day = -1;
+        uint32_t counter = 0;
+    };
+
+    FrameStatus decodeSummary(const std::string& vehicleId, uint64_t timestamp, const uint8_t* data, size_t len,
+                              Open& out);
+    FrameStatus place(Open& ev, const uint8_t* data, size_t len);
+    void finishIfComplete(const std::string& vehicleId, uint8_t id, std::vector<CrashEvent>& done);
+
+    KeyCheckpointIndex& keys;
+    // Keyed by vehicle id and event id
+    std::map<std::pair<std::string, uint8_t>, Open> open;
+    std::unordered_map<std::string, std::deque<std::vector<uint8_t>>> waiting;
+    std::unordered_map<std::string, LastCounter> last;
+};
+
+#endif
@@ -0,0 +1,469 @@
+// frame_decoder.cpp - Grouped, multithreaded frame decryption
+#include "frame_decoder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include "aes128.h"
+
+namespace {
+
+// Frames per bulk AES call, and the most frames one worker takes at a time
+constexpr size_t CHUNK_FRAMES = 64;
+constexpr uint32_t MAX_GROUP_FRAMES = 4096;
+// Daily keys kept between decode() calls; the whole cache is dropped when full
+constexpr size_t KEY_CACHE_MAX = 1 << 16;
+
+uint16_t lowCounter(const uint8_t* data) { return (uint16_t)(data[0] | data[1] << 8); }
+
+// Compact frames: the fields go to a side table until resolveChains(). Returns
+// the offset of the encrypted part, 0 if malformed.
+size_t parseCompactClear(const uint8_t* data, size_t len, compact::Fields& fields, DecodedFrame& out) {
+    size_t encrypted = compact::decodeClear(data, len, fields);
+    // No longer than a keyframe, so the encrypted part fits one keystream block
+    if (encrypted == 0 || len > COMPACT_KEYFRAME_SIZE) return 0;
+    out.counter = lowCounter(data);
+    out.format = fields.keyframe ? FrameFormat::Keyframe : FrameFormat::Delta;
+    return encrypted;
+}
+
+FrameStatus parseCompactEncrypted(const uint8_t* cipher, size_t len, const uint8_t* keystream,
+                                  compact::Fields& fields) {
+    uint8_t plain[16];
+    for (size_t i = 0; i < len; i++) plain[i] = cipher[i] ^ keystream[i];
+    return compact::decodeEncrypted(plain, len, fields) ? FrameStatus::Ok : FrameStatus::WrongKey;
+}
+
+// One frame under one candidate counter, outside the bulk path (resync)
+FrameStatus decodeAt(const Aes128& aes, uint32_t counter, const uint8_t* data, size_t len,
+                     compact::Fields& fields, DecodedFrame& out) {
+    alignas(16) uint8_t block[16], keystream[16];
+    frameCounterBlock(counter, block);
+    aes.encryptBlocks(block, keystream, 1);
+    if (out.format == FrameFormat::Legacy) return FrameDecoder::parseEncrypted(data, keystream, out);
+    size_t encrypted = parseCompactClear(data, len, fields, out);
+    return parseCompactEncrypted(data + encrypted, len - encrypted, keystream, fields);
+}
+
+// The frame after i that resync still has to place for the same vehicle; -1 if none
+int64_t nextToPlace(const FrameBatch& batch, const std::vector<DecodedFrame>& out, uint32_t i) {
+    for (uint32_t j = i + 1; j < out.size(); j++) {
+        if (out[j].vehicle == out[i].vehicle && out[j].status == FrameStatus::WrongKey &&
+            batch.frameLength(j) >= FRAME_IV_LEN) {
+            return j;
+        }
+    }
+    return -1;
+}
+
+// Whether frame j decodes as the counter nearest counter, leaving out[j] alone
+bool decodesNear(const FrameBatch& batch, const Aes128& aes, const std::vector<DecodedFrame>& out, uint32_t j,
+                 uint32_t counter) {
+    const uint8_t* data = batch.frame(j);
+    DecodedFrame probe = out[j];
+    compact::Fields fields;
+    return decodeAt(aes, FrameDecoder::unwrapCounter(counter, lowCounter(data)), data, batch.frameLength(j), fields, probe) ==
+           FrameStatus::Ok;
+}
+
+}  // namespace
+
+const char* frameStatusName(FrameStatus status) {
+    switch (status) {
+        case FrameStatus::Ok: return "ok";
+        case FrameStatus::Truncated: return "truncated";
+        case FrameStatus::BadLayout: return "bad_layout";
+        case FrameStatus::NoKey: return "no_key";
+        case FrameStatus::WrongKey: return "wrong_key";
+        case FrameStatus::MissingReference: return "missing_reference";
+    }
+    return "unknown";
+}
+
+const char* frameFormatName(FrameFormat format) {
+    switch (format) {
+        case FrameFormat::Legacy: return "legacy";
+        case FrameFormat::Keyframe: return "keyframe";
+        case FrameFormat::Delta: return "delta";
+    }
+    return "unknown";
+}
+
+uint32_t FrameBatch::vehicle(const std::string& vehicleId) {
+    auto it = idIndex.find(vehicleId);
+    if (it != idIndex.end()) return it->second;
+    uint32_t index = (uint32_t)ids.size();
+    ids.push_back(vehicleId);
+    idIndex.emplace(vehicleId, index);
+    return index;
+}
+
+void FrameBatch::add(uint32_t vehicle, uint64_t timestamp, const uint8_t* data, size_t len) {
+    entries.push_back({timestamp, bytes.size(), vehicle, (uint32_t)len});
+    bytes.insert(bytes.end(), data, data + len);
+}
+
+size_t FrameBatch::addUplink(const std::string& vehicleId, uint64_t timestamp, uint8_t port,
+                             const uint8_t* data, size_t len) {
+    uint32_t v = vehicle(vehicleId);
+    return forEachUplinkFrame(port, data, len,
+                              [&](const uint8_t* frame, size_t frameLen) { add(v, timestamp, frame, frameLen); });
+}
+
+void FrameBatch::clear() {
+    ids.clear();
+    idIndex.clear();
+    entries.clear();
+    bytes.clear();
+}
+
+FrameDecoder::FrameDecoder(KeyCheckpointIndex& keys, unsigned threads) : keys(keys) {
+    workerCount = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+uint32_t FrameDecoder::unwrapCounter(uint32_t ref, uint16_t low) {
+    uint16_t ahead = (uint16_t)(low - (uint16_t)ref);
+    int16_t diff = (int16_t)ahead;
+    if (diff < 0 && (uint32_t)-diff > ref) return ref + ahead;
+    return ref + (uint32_t)(int32_t)diff;
+}
+
+FrameStatus FrameDecoder::parseClear(const uint8_t* data, size_t len, DecodedFrame& out) {
+    if (len < PAYLOAD_SIZE) return FrameStatus::Truncated;
+    if (!TelemetryFrame::readClear(data, out)) return FrameStatus::BadLayout;
+    out.counter = lowCounter(data);
+    return FrameStatus::Ok;
+}
+
+FrameStatus FrameDecoder::parseEncrypted(const uint8_t* data, const uint8_t* keystream, DecodedFrame& out) {
+    uint8_t plain[ENCRYPTED_BLOCK_LEN];
+    const uint8_t* cipher = data + FRAME_ENCRYPTED_OFFSET;
+    for (size_t i = 0; i < ENCRYPTED_BLOCK_LEN; i++) plain[i] = cipher[i] ^ keystream[i];
+    return TelemetryFrame::readEncrypted(plain, out) ? FrameStatus::Ok : FrameStatus::WrongKey;
+}
+
+size_t FrameDecoder::decode(const FrameBatch& batch, std::vector<DecodedFrame>& out) {
+    out.assign(batch.size(), DecodedFrame{});
+    states.resize(batch.size());
+    std::vector<uint32_t> frames(batch.size());
+    for (uint32_t i = 0; i < frames.size(); i++) {
+        frames[i] = i;
+        out[i].timestamp = batch.entries[i].timestamp;
+        out[i].vehicle = batch.entries[i].vehicle;
+    }
+    runPass(batch, frames, 0, out);
+
+    // Second chance for frames that crossed midnight between sending and receiving
+    std::vector<uint32_t> retry;
+    for (uint32_t i = 0; i < out.size(); i++) {
+        if (out[i].status == FrameStatus::WrongKey) retry.push_back(i);
+    }
+    if (!retry.empty()) {
+        runPass(batch, retry, -1, out);
+        resync(batch, out);
+    }
+    noteCounters(batch, out);
+    resolveChains(batch, out);
+
+    size_t ok = 0;
+    for (const DecodedFrame& f : out) ok += f.status == FrameStatus::Ok;
+    return ok;
+}
+
+void FrameDecoder::runPass(const FrameBatch& batch, std::vector<uint32_t>& frames, int dayShift,
+                           std::vector<DecodedFrame>& out) {
+    // Bucket the frames by (vehicle, day): one hash lookup per frame, then a counting scatter
+    std::unordered_map<uint64_t, uint32_t> slotOf;
+    std::vector<uint64_t> slotKeys;
+    std::vector<uint32_t> slotStart;
+    std::vector<uint32_t> frameSlot(frames.size());
+    for (size_t k = 0; k < frames.size(); k++) {
+        const auto& e = batch.entries[frames[k]];
+        int64_t day = (int64_t)(e.timestamp / SECONDS_PER_DAY) + dayShift;
+        uint64_t key = (uint64_t)e.vehicle << 32 | (uint32_t)std::max<int64_t>(day, -1);
+        auto it = slotOf.emplace(key, (uint32_t)slotKeys.size()).first;
+        if (it->second == slotKeys.size()) {
+            slotKeys.push_back(key);
+            slotStart.push_back(0);
+        }
+        frameSlot[k] = it->second;
+        slotStart[it->second]++;
+    }
+    uint32_t total = 0;
+    for (uint32_t& start : slotStart) {
+        uint32_t count = start;
+        start = total;
+        total += count;
+    }
+    slotStart.push_back(total);
+    std::vector<uint32_t> sorted(frames.size());
+    std::vector<uint32_t> fill(slotStart.begin(), slotStart.end() - 1);
+    for (size_t k = 0; k < frames.size(); k++) sorted[fill[frameSlot[k]]++] = frames[k];
+    frames.swap(sorted);
+
+    // Full counters: the first frame of a slot continues from the last one
+    // decoded of that day, every other one from the frame before it
+    for (size_t slot = 0; slot < slotKeys.size(); slot++) {
+        int32_t day = (int32_t)(uint32_t)slotKeys[slot];
+        const CounterRef* ref = findCounter(batch.ids[slotKeys[slot] >> 32], day);
+        bool known = ref != nullptr;
+        uint32_t counter = known ? ref->counter : 0;
+        for (uint32_t pos = slotStart[slot]; pos < slotStart[slot + 1]; pos++) {
+            const auto& e = batch.entries[frames[pos]];
+            FrameState& state = states[frames[pos]];
+            state.day = day;
+            if (e.length < FRAME_IV_LEN) continue;
+            uint16_t low = lowCounter(batch.bytes.data() + e.offset);
+            counter = known ? unwrapCounter(counter, low) : low;
+            known = true;
+            state.counter = counter;
+        }
+    }
+
+    // One key per (vehicle, day); big groups are split so workers stay balanced
+    std::vector<Group> groups;
+    for (size_t slot = 0; slot < slotKeys.size(); slot++) {
+        int32_t day = (int32_t)(uint32_t)slotKeys[slot];
+        Group group{0, 0, day, {}, false};
+        group.haveKey = day >= 0 && lookupKey(batch.ids[slotKeys[slot] >> 32], (uint64_t)day, group.key);
+        for (uint32_t b = slotStart[slot]; b < slotStart[slot + 1]; b += MAX_GROUP_FRAMES) {
+            group.begin = b;
+            group.end = std::min(slotStart[slot + 1], b + MAX_GROUP_FRAMES);
+            groups.push_back(group);
+        }
+    }
+
+    // On a retry the frame already failed under its receive-day key
+    const FrameStatus noKey = dayShift == 0 ? FrameStatus::NoKey : FrameStatus::WrongKey;
+    unsigned workers = (unsigned)std::min<size_t>(workerCount, groups.size());
+    if (workers <= 1) {
+        for (const Group& group : groups) decodeGroup(batch, frames, group, noKey, states.data(), out);
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    auto work = [&]() {
+        for (size_t g; (g = next.fetch_add(1, std::memory_order_relaxed)) < groups.size();) {
+            decodeGroup(batch, frames, groups[g], noKey, states.data(), out);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < workers; t++) pool.emplace_back(work);
+    work();
+    for (std::thread& t : pool) t.join();
+}
+
+bool FrameDecoder::lookupKey(const std::string& vehicleId, uint64_t day, KeyCheckpointIndex::Key& key) {
+    auto cached = keyCache.find(vehicleId);
+    if (cached != keyCache.end()) {
+        auto it = cached->second.find(day);
+        if (it != cached->second.end()) {
+            key = it->second;
+            return true;
+        }
+    }
+    if (!keys.keyFor(vehicleId, day * SECONDS_PER_DAY, key)) return false;
+    if (cachedKeys >= KEY_CACHE_MAX) clearKeyCache();
+    keyCache[vehicleId][day] = key;
+    cachedKeys++;
+    return true;
+}
+
+void FrameDecoder::clearKeyCache() {
+    keyCache.clear();
+    cachedKeys = 0;
+}
+
+void FrameDecoder::decodeGroup(const FrameBatch& batch, const std::vector<uint32_t>& frames,
+                               const Group& group, FrameStatus noKey, FrameState* states,
+                               std::vector<DecodedFrame>& out) const {
+    Aes128 aes;
+    if (group.haveKey) aes.setKey(group.key.data());
+
+    alignas(16) uint8_t counters[CHUNK_FRAMES * 16];
+    alignas(16) uint8_t keystream[CHUNK_FRAMES * 16];
+    uint32_t pending[CHUNK_FRAMES];
+    uint8_t encOffset[CHUNK_FRAMES];
+
+    for (uint32_t pos = group.begin; pos < group.end;) {
+        size_t n = 0;
+        for (; pos < group.end && n < CHUNK_FRAMES; pos++) {
+            uint32_t i = frames[pos];
+            const auto& e = batch.entries[i];
+            const uint8_t* data = batch.bytes.data() + e.offset;
+            DecodedFrame& f = out[i];
+            size_t encrypted = FRAME_ENCRYPTED_OFFSET;
+            if (compact::isCompact(data, e.length)) {
+                encrypted = parseCompactClear(data, e.length, states[i].fields, f);
+                f.status = encrypted ? FrameStatus::Ok : FrameStatus::BadLayout;
+            } else {
+                f.format = FrameFormat::Legacy;
+                f.status = parseClear(data, e.length, f);
+            }
+            if (f.status != FrameStatus::Ok) continue;
+            if (!group.haveKey) {
+                f.status = noKey;
+                continue;
+            }
+            frameCounterBlock(states[i].counter, counters + 16 * n);
+            encOffset[n] = (uint8_t)encrypted;
+            pending[n++] = i;
+        }
+        if (n == 0) continue;
+
+        aes.encryptBlocks(counters, keystream, n);
+        for (size_t k = 0; k < n; k++) {
+            const auto& e = batch.entries[pending[k]];
+            const uint8_t* data = batch.bytes.data() + e.offset;
+            DecodedFrame& f = out[pending[k]];
+            if (f.format == FrameFormat::Legacy) {
+                f.status = parseEncrypted(data, keystream + 16 * k, f);
+            } else {
+                f.status = parseCompactEncrypted(data + encOffset[k], e.length - encOffset[k],
+                                                 keystream + 16 * k, states[pending[k]].fields);
+            }
+            if (f.status == FrameStatus::Ok) f.counter = states[pending[k]].counter;
+        }
+    }
+}
+
+const FrameDecoder::CounterRef* FrameDecoder::findCounter(const std::string& vehicleId, int32_t day) const {
+    auto it = counters.find(vehicleId);
+    if (it == counters.end()) return nullptr;
+    for (const CounterRef& ref : it->second) {
+        if (ref.day == day) return &ref;
+    }
+    return nullptr;
+}
+
+void FrameDecoder::resync(const FrameBatch& batch, std::vector<DecodedFrame>& out) {
+    // In batch order, so every frame starts from the last one decoded before
+    // it under the same key
+    std::unordered_map<uint64_t, CounterRef> last;
+    Aes128 aes;
+    for (uint32_t i = 0; i < out.size(); i++) {
+        DecodedFrame& f = out[i];
+        FrameState& state = states[i];
+        if (f.status == FrameStatus::Ok) {
+            last[(uint64_t)f.vehicle << 32 | (uint32_t)state.day] = {state.day, f.counter, f.timestamp};
+            continue;
+        }
+        if (f.status != FrameStatus::WrongKey) continue;
+
+        const auto& e = batch.entries[i];
+        const uint8_t* data = batch.bytes.data() + e.offset;
+        const std::string& vehicleId = batch.ids[f.vehicle];
+        const uint16_t low = lowCounter(data);
+        const int64_t receiveDay = (int64_t)(e.timestamp / SECONDS_PER_DAY);
+        for (int64_t day = receiveDay; day >= 0 && day >= receiveDay - 1; day--) {
+            KeyCheckpointIndex::Key key;
+            if (!lookupKey(vehicleId, (uint64_t)day, key)) continue;
+            const uint64_t slot = (uint64_t)f.vehicle << 32 | (uint32_t)day;
+            auto it = last.find(slot);
+            const CounterRef* ref = it != last.end() ? &it->second : findCounter(vehicleId, (int32_t)day);
+
+            // How many wraps the device can have counted since the reference,
+            // or since the day began
+            uint64_t from = ref ? ref->timestamp : (uint64_t)day * SECONDS_PER_DAY;
+            uint64_t elapsed = e.timestamp > from ? e.timestamp - from : from - e.timestamp;
+            uint64_t wraps = std::min<uint64_t>(elapsed * MAX_FRAME_RATE / 0x10000 + 1, 0xFFFF);
+            uint64_t base = ref ? unwrapCounter(ref->counter, low) : low;
+
+            aes.setKey(key.data());
+            auto decodes = [&](uint64_t counter) {
+                return counter <= UINT32_MAX &&
+                       decodeAt(aes, (uint32_t)counter, data, e.length, state.fields, f) == FrameStatus::Ok;
+            };
+            auto accept = [&](uint64_t counter) {
+                f.status = FrameStatus::Ok;
+                f.counter = state.counter = (uint32_t)counter;
+                state.day = (int32_t)day;
+                last[slot] = {state.day, f.counter, f.timestamp};
+            };
+
+            // A new high half held over from an earlier batch: this frame is its second
+            auto held = tentative.find(vehicleId);
+            if (held != tentative.end() && held->second.day == (int32_t)day) {
+                const uint32_t counter = unwrapCounter(held->second.counter, low);
+                tentative.erase(held);
+                if (decodes(counter)) {
+                    accept(counter);
+                    break;
+                }
+            }
+
+            // The nearest counter is as good as the regular pass. Any other high
+            // half passes the markers by chance once in 65536 tries, so it is
+            // taken only once the next frame to place decodes under it too.
+            const int64_t next = nextToPlace(batch, out, i);
+            bool found = false, holding = false;
+            for (uint64_t k = 0; k <= wraps && !found && !holding; k++) {
+                for (int sign = 1; sign >= -1 && !found && !holding; sign -= 2) {
+                    if (sign < 0 && (k == 0 || base < (k << 16))) break;
+                    const uint64_t counter = sign > 0 ? base + (k << 16) : base - (k << 16);
+                    if (!decodes(counter)) continue;
+                    if (k == 0 || (next >= 0 && decodesNear(batch, aes, out, (uint32_t)next, (uint32_t)counter))) {
+                        accept(counter);
+                        found = true;
+                    } else if (next < 0) {
+                        // Nothing to check it against yet: the next batch will
+                        tentative[vehicleId] = {(int32_t)day, (uint32_t)counter, f.timestamp};
+                        holding = true;
+                    }
+                }
+            }
+            if (found || holding) break;
+        }
+        if (f.status != FrameStatus::Ok) f.status = FrameStatus::WrongKey;
+    }
+}
+
+void FrameDecoder::noteCounters(const FrameBatch& batch, const std::vector<DecodedFrame>& out) {
+    std::vector<CounterRefs*> refsOf(batch.ids.size(), nullptr);
+    for (uint32_t i = 0; i < out.size(); i++) {
+        const DecodedFrame& f = out[i];
+        if (f.status != FrameStatus::Ok) continue;
+        if (!refsOf[f.vehicle]) refsOf[f.vehicle] = &counters[batch.ids[f.vehicle]];
+        // The entry of the frame's day, else that of the oldest day kept
+        const int32_t day = states[i].day;
+        CounterRef* ref = &(*refsOf[f.vehicle])[0];
+        for (CounterRef& r : *refsOf[f.vehicle]) {
+            if (r.day == day) {
+                ref = &r;
+                break;
+            }
+            if (r.day < ref->day) ref = &r;
+        }
+        if (ref->day > day) continue;
+        if (ref->day != day) {
+            *ref = {day, f.counter, f.timestamp};
+        } else if (f.counter >= ref->counter) {
+            ref->counter = f.counter;
+            ref->timestamp = f.timestamp;
+        }
+    }
+}
+
+void FrameDecoder::resolveChains(const FrameBatch& batch, std::vector<DecodedFrame>& out) {
+    for (size_t i = 0; i < out.size(); i++) {
+        DecodedFrame& f = out[i];
+        if (f.format == FrameFormat::Legacy || f.status != FrameStatus::Ok) continue;
+        auto& chain = chains[batch.ids[f.vehicle]];
+        const FrameState& c = states[i];
+        SensorReading r;
+        if (f.format == FrameFormat::Keyframe) {
+            r = compact::apply(nullptr, c.fields);
+        } else {
+            uint32_t prevCounter = f.counter - 1;
+            const ChainEntry& prev = chain[prevCounter % CHAIN_HISTORY];
+            if (!prev.valid || prev.counter != prevCounter || prev.day != c.day) {
+                f.status = FrameStatus::MissingReference;
+                continue;
+            }
+            r = compact::apply(&prev.reading, c.fields);
+        }
+        chain[f.counter % CHAIN_HISTORY] = {true, f.counter, c.day, r};
+        static_cast<SensorReading&>(f) = r;
+    }
+}
@@ -0,0 +1,216 @@
+// frame_decoder.h - Batch decoder/decryptor for uplinked telemetry frames
+//
+// Frames are grouped by (vehicle, day) so every daily key is looked up and
+// expanded once per batch, and the CTR keystream of a whole group comes out of
+// one bulk AES call (one block per frame, see frame_layout.h). Groups are
+// spread over worker threads; the key index is only used from the calling
+// thread. A frame sent just before midnight and received after it fails the
+// marker check under the receive day's key and is retried with the day before.
+//
+// Compact frames (compact_codec.h) decrypt the same way; their deltas are then
+// resolved in batch order against the frame with counter - 1 under the same
+// daily key. The last CHAIN_HISTORY readings of every vehicle are kept across
+// decode() calls, so a retransmitted batch still resolves.
+//
+// Only the low 16 bits of the message counter are on air (frame_layout.h).
+// The high half is carried forward per (vehicle, day), across decode() calls:
+// each frame is taken to be the counter nearest the one before it. A frame
+// that still fails after the midnight retry is resynchronised: the decoder
+// tries the other high halves the device could have reached since the last
+// frame it decoded of that day, at most MAX_FRAME_RATE frames a second of
+// receive time, and the frames after it follow the new counter. Two
+// decrypted marker bytes pass by chance once in 65536 tries, so a new high
+// half is only taken once the vehicle's next undecoded frame decodes under
+// it too. If that frame is not in the batch yet, the high half waits for the
+// next decode() call and the frame it was found on stays WrongKey.
+#ifndef BACKEND_FRAME_DECODER_H
+#define BACKEND_FRAME_DECODER_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "compact_codec.h"
+#include "frame_layout.h"
+#include "key_index.h"
+
+enum class FrameStatus : uint8_t {
+    Ok,
+    Truncated,     // shorter than PAYLOAD_SIZE
+    BadLayout,     // clear block lengths or markers do not match
+    NoKey,         // unknown vehicle or day before its chain starts
+    WrongKey,      // decrypted markers do not match under the day key (or the day before)
+    MissingReference,  // compact delta whose previous frame was not decoded
+};
+
+enum class FrameFormat : uint8_t {
+    Legacy,    // fixed PAYLOAD_SIZE frame
+    Keyframe,  // compact frame with absolute values
+    Delta,     // compact frame relative to counter - 1
+};
+
+const char* frameStatusName(FrameStatus status);
+const char* frameFormatName(FrameFormat format);
+
+// Sensor fields come from SensorReading (frame_layout.h)
+struct DecodedFrame : SensorReading {
+    uint64_t timestamp;   // receive time, epoch seconds
+    uint32_t vehicle;     // index into FrameBatch::vehicleIds()
+    uint32_t counter;     // device message counter, high half recovered
+    FrameStatus status;
+    FrameFormat format;
+};
+
+// Calls frame(data, len) for every frame of one uplink, splitting
+// FPORT_AGGREGATE batches once the whole batch is validated. Returns the
+// number of frames, 0 for a malformed batch.
+template <typename F>
+size_t forEachUplinkFrame(uint8_t port, const uint8_t* data, size_t len, F&& frame) {
+    if (port != FPORT_AGGREGATE) {
+        frame(data, len);
+        return 1;
+    }
+    if (len < AGGREGATE_HEADER_LEN) return 0;
+    size_t offset = AGGREGATE_HEADER_LEN;
+    for (int i = 0; i < data[0]; i++) {
+        if (offset + AGGREGATE_ENTRY_OVERHEAD > len) return 0;
+        offset += AGGREGATE_ENTRY_OVERHEAD + data[offset];
+    }
+    if (offset != len) return 0;
+
+    offset = AGGREGATE_HEADER_LEN;
+    for (int i = 0; i < data[0]; i++) {
+        frame(data + offset + AGGREGATE_ENTRY_OVERHEAD, (size_t)data[offset]);
+        offset += AGGREGATE_ENTRY_OVERHEAD + data[offset];
+    }
+    return data[0];
+}
+
+// Frames of one decode call, stored back to back in a single buffer
+class FrameBatch {
+public:
+    uint32_t vehicle(const std::string& vehicleId);
+    void add(uint32_t vehicle, uint64_t timestamp, const uint8_t* data, size_t len);
+    void add(const std::string& vehicleId, uint64_t timestamp, const uint8_t* data, size_t len) {
+        add(vehicle(vehicleId), timestamp, data, len);
+    }
+    // Adds the frames of one uplink, splitting FPORT_AGGREGATE batches.
+    // Returns the number of frames added, 0 for a malformed batch.
+    size_t addUplink(const std::string& vehicleId, uint64_t timestamp, uint8_t port, const uint8_t* data,
+                     size_t len);
+    void clear();
+
+    size_t size() const { return entries.size(); }
+    const uint8_t* frame(size_t i) const { return bytes.data() + entries[i].offset; }
+    size_t frameLength(size_t i) const { return entries[i].length; }
+    uint32_t frameVehicle(size_t i) const { return entries[i].vehicle; }
+    uint64_t frameTimestamp(size_t i) const { return entries[i].timestamp; }
+    const std::vector<std::string>& vehicleIds() const { return ids; }
+
+private:
+    friend class FrameDecoder;
+    struct Entry {
+        uint64_t timestamp;
+        uint64_t offset;
+        uint32_t vehicle;
+        uint32_t length;
+    };
+
+    std::vector<std::string> ids;
+    std::unordered_map<std::string, uint32_t> idIndex;
+    std::vector<Entry> entries;
+    std::vector<uint8_t> bytes;
+};
+
+class FrameDecoder {
+public:
+    // threads == 0 uses every hardware thread
+    explicit FrameDecoder(KeyCheckpointIndex& keys, unsigned threads = 0);
+
+    // out[i] is batch frame i. Returns the number of frames decoded Ok.
+    size_t decode(const FrameBatch& batch, std::vector<DecodedFrame>& out);
+
+    unsigned threads() const { return workerCount; }
+
+    // Daily keys are cached across decode() calls; drop them after replacing
+    // a vehicle in the index
+    void clearKeyCache();
+
+    // Forgets the last compact frame and the counters of every vehicle, e.g.
+    // before decoding an unrelated stream
+    void clearChains() {
+        chains.clear();
+        counters.clear();
+        tentative.clear();
+    }
+
+    // Highest frame rate of a device, which bounds the resync search
+    static constexpr uint32_t MAX_FRAME_RATE = 128;
+
+    // The counter ending in low that is nearest ref; counters are never negative
+    static uint32_t unwrapCounter(uint32_t ref, uint16_t low);
+    // Checks the clear part of a frame and fills everything but the encrypted
+    // fields; counter gets the low 16 bits
+    static FrameStatus parseClear(const uint8_t* data, size_t len, DecodedFrame& out);
+    // Decrypts the encrypted block with its keystream block and checks the markers
+    static FrameStatus parseEncrypted(const uint8_t* data, const uint8_t* keystream, DecodedFrame& out);
+
+private:
+    struct Group {
+        uint32_t begin, end;  // range in the pass's frame order
+        int32_t day;
+        KeyCheckpointIndex::Key key;
+        bool haveKey;
+    };
+
+    struct FrameState {
+        compact::Fields fields;  // compact frames, until resolveChains()
+        int32_t day;             // of the key it was last tried under
+        uint32_t counter;        // full counter it was last tried with
+    };
+
+    // Highest counter decoded of a vehicle's latest COUNTER_DAYS days, and
+    // when it was received
+    static constexpr size_t COUNTER_DAYS = 4;
+    struct CounterRef {
+        int32_t day = -1;
+        uint32_t counter = 0;
+        uint64_t timestamp = 0;
+    };
+    using CounterRefs = std::array<CounterRef, COUNTER_DAYS>;
+
+    // Recent compact readings of a vehicle, slot = counter % CHAIN_HISTORY
+    static constexpr size_t CHAIN_HISTORY = 64;
+    struct ChainEntry {
+        bool valid;
+        uint32_t counter;
+        int32_t day;
+        SensorReading reading;
+    };
+
+    bool lookupKey(const std::string& vehicleId, uint64_t day, KeyCheckpointIndex::Key& key);
+    void runPass(const FrameBatch& batch, std::vector<uint32_t>& frames, int dayShift,
+                 std::vector<DecodedFrame>& out);
+    void decodeGroup(const FrameBatch& batch, const std::vector<uint32_t>& frames, const Group& group,
+                     FrameStatus noKey, FrameState* states, std::vector<DecodedFrame>& out) const;
+    void resync(const FrameBatch& batch, std::vector<DecodedFrame>& out);
+    void noteCounters(const FrameBatch& batch, const std::vector<DecodedFrame>& out);
+    const CounterRef* findCounter(const std::string& vehicleId, int32_t day) const;
+    void resolveChains(const FrameBatch& batch, std::vector<DecodedFrame>& out);
+
+    KeyCheckpointIndex& keys;
+    unsigned workerCount;
+    std::unordered_map<std::string, std::unordered_map<uint64_t, KeyCheckpointIndex::Key>> keyCache;
+    size_t cachedKeys = 0;
+    // Side table of the current decode() call, indexed like the batch
+    std::vector<FrameState> states;
+    std::unordered_map<std::string, CounterRefs> counters;
+    // A new high half found on the last frame of a batch, still waiting for
+    // a second frame to confirm it
+    std::unordered_map<std::string, CounterRef> tentative;
+    // Last compact frames decoded for a vehicle
+    std::unordered_map<std::string, std::array<ChainEntry, CHAIN_HISTORY>> chains;
+};
+
+#endif
@@ -0,0 +1,494 @@
+// ingest_pipeline.cpp - TTN uplink parsing and the staged ingestion pipeline
+#include "ingest_pipeline.h"
+
+#include <chrono>
+#include <cstring>
+#include <map>
+#include "base64.h"
+
+namespace {
+
+uint64_t nowNanos() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// ----- JSON fields -----
+
+const char* skipSpace(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+    return p;
+}
+
+// p is at an opening quote; returns the position past the closing one, or
+// nullptr if the string is not terminated
+const char* scanString(const char* p, const char* end, bool& escaped) {
+    escaped = false;
+    for (p++; p < end; p++) {
+        if (*p == '"') return p + 1;
+        if (*p == '\\') {
+            escaped = true;
+            if (++p == end) return nullptr;
+        }
+    }
+    return nullptr;
+}
+
+// A string value without escapes, as [begin, end)
+bool stringValue(const char*& p, const char* end, const char*& begin, size_t& len) {
+    if (p == end || *p != '"') return false;
+    bool escaped;
+    const char* close = scanString(p, end, escaped);
+    if (!close || escaped) return false;
+    begin = p + 1;
+    len = (size_t)(close - begin - 1);
+    p = close;
+    return true;
+}
+
+bool numberValue(const char*& p, const char* end, uint64_t& value) {
+    const char* start = p;
+    value = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        if (value > (UINT64_MAX - 9) / 10) return false;
+        value = value * 10 + (uint64_t)(*p - '0');
+    }
+    return p != start;
+}
+
+bool digits(const char* s, int n, int& value) {
+    value = 0;
+    for (int i = 0; i < n; i++) {
+        if (s[i] < '0' || s[i] > '9') return false;
+        value = value * 10 + (s[i] - '0');
+    }
+    return true;
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date
+int64_t daysFromCivil(int y, int m, int d) {
+    y -= m <= 2;
+    const int era = (y >= 0 ? y : y - 399) / 400;
+    const int yoe = y - era * 400;
+    const int doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return (int64_t)era * 146097 + doe - 719468;
+}
+
+// RFC 3339: YYYY-MM-DDTHH:MM:SS, any fraction, then Z or +HH:MM / -HH:MM.
+// The fraction is dropped; receive times are kept in whole seconds.
+bool parseIsoTime(const char* s, size_t len, uint64_t& epoch) {
+    int y, mo, d, h, mi, sec;
+    if (len < 20 || !digits(s, 4, y) || s[4] != '-' || !digits(s + 5, 2, mo) || s[7] != '-' ||
+        !digits(s + 8, 2, d) || (s[10] != 'T' && s[10] != 't' && s[10] != ' ') || !digits(s + 11, 2, h) ||
+        s[13] != ':' || !digits(s + 14, 2, mi) || s[16] != ':' || !digits(s + 17, 2, sec)) {
+        return false;
+    }
+    if (mo < 1 || mo > 12 || d < 1 || d > 31 || h > 23 || mi > 59 || sec > 60) return false;
+    size_t i = 19;
+    if (s[i] == '.') {
+        for (i++; i < len && s[i] >= '0' && s[i] <= '9'; i++) {}
+    }
+    int64_t offset = 0;
+    if (i + 1 == len && (s[i] == 'Z' || s[i] == 'z')) {
+        offset = 0;
+    } else if (i + 6 == len && (s[i] == '+' || s[i] == '-') && s[i + 3] == ':') {
+        int oh, om;
+        if (!digits(s + i + 1, 2, oh) || !digits(s + i + 4, 2, om)) return false;
+        offset = (s[i] == '+' ? 1 : -1) * (int64_t)(oh * 3600 + om * 60);
+    } else {
+        return false;
+    }
+    int64_t t = daysFromCivil(y, mo, d) * 86400 + h * 3600 + mi * 60 + sec - offset;
+    if (t < 0) return false;
+    epoch = (uint64_t)t;
+    return true;
+}
+
+enum class Field : uint8_t { None, DeviceId, ReceivedAt, FPort, FCnt, FrmPayload };
+
+Field matchField(const char* key, size_t len) {
+    auto is = [&](const char* name) { return memcmp(key, name, len) == 0; };
+    switch (len) {
+        case 5: return is("f_cnt") ? Field::FCnt : Field::None;
+        case 6: return is("f_port") ? Field::FPort : Field::None;
+        case 9: return is("device_id") ? Field::DeviceId : Field::None;
+        case 11: return is("received_at") ? Field::ReceivedAt : is("frm_payload") ? Field::FrmPayload : Field::None;
+        default: return Field::None;
+    }
+}
+
+// ----- Dedupe -----
+
+// The low 16 counter bits that are on air, and 48 bits of FNV-1a over the frame
+uint64_t frameKey(const uint8_t* data, size_t len) {
+    uint64_t h = 1469598103934665603ull;
+    for (size_t i = 0; i < len; i++) h = (h ^ data[i]) * 1099511628211ull;
+    uint64_t counter = len >= 2 ? (uint64_t)(data[0] | data[1] << 8) : 0;
+    return counter << 48 | (h & 0xFFFFFFFFFFFFull);
+}
+
+}  // namespace
+
+bool parseTtnUplink(const char* json, size_t len, TtnUplink& out) {
+    const char* p = skipSpace(json, json + len);
+    const char* end = json + len;
+    if (p == end || *p != '{') return false;
+    out.deviceId.clear();
+    out.payload.clear();
+    out.receiveEpoch = 0;
+    out.port = 0;
+    out.fCnt = 0;
+
+    bool haveDevice = false, haveTime = false, havePort = false, haveCnt = false, havePayload = false;
+    // Every quote outside a string opens one, so jumping from string to
+    // string keeps the scan in step with the text
+    while ((p = (const char*)memchr(p, '"', (size_t)(end - p))) != nullptr) {
+        bool escaped;
+        const char* keyEnd = scanString(p, end, escaped);
+        if (!keyEnd) return false;
+        const char* q = skipSpace(keyEnd, end);
+        if (q == end || *q != ':' || escaped) {
+            p = keyEnd;  // a string value, or a key of no interest
+            continue;
+        }
+        Field field = matchField(p + 1, (size_t)(keyEnd - p - 2));
+        p = skipSpace(q + 1, end);
+        const char* s;
+        size_t n;
+        uint64_t v;
+        switch (field) {
+            case Field::None: break;
+            case Field::DeviceId:
+                if (!stringValue(p, end, s, n) || n == 0) return false;
+                if (!haveDevice) out.deviceId.assign(s, n);
+                haveDevice = true;
+                break;
+            case Field::ReceivedAt:
+                if (!stringValue(p, end, s, n)) return false;
+                if (!haveTime && !parseIsoTime(s, n, out.receiveEpoch)) return false;
+                haveTime = true;
+                break;
+            case Field::FPort:
+                if (!numberValue(p, end, v) || v > 255) return false;
+                if (!havePort) out.port = (uint8_t)v;
+                havePort = true;
+                break;
+            case Field::FCnt:
+                if (!numberValue(p, end, v) || v > UINT32_MAX) return false;
+                if (!haveCnt) out.fCnt = (uint32_t)v;
+                haveCnt = true;
+                break;
+            case Field::FrmPayload:
+                if (!stringValue(p, end, s, n)) return false;
+                if (!havePayload) out.payload.assign(s, n);
+                havePayload = true;
+                break;
+        }
+    }
+    return haveDevice && haveTime;
+}
+
+// ----- LatencyHistogram -----
+
+size_t LatencyHistogram::bucketOf(uint64_t nanos) {
+    if (nanos < 4) return (size_t)nanos;
+    int msb = 63 - __builtin_clzll(nanos);
+    return (size_t)(4 * (msb - 1)) + (size_t)((nanos >> (msb - 2)) & 3);
+}
+
+uint64_t LatencyHistogram::bucketLow(size_t bucket) {
+    if (bucket < 4) return bucket;
+    int msb = (int)(bucket / 4) + 1;
+    return (uint64_t)(4 + bucket % 4) << (msb - 2);
+}
+
+void LatencyHistogram::record(uint64_t nanos) {
+    counts[bucketOf(nanos)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(nanos, std::memory_order_relaxed);
+    uint64_t seen = maxNanos.load(std::memory_order_relaxed);
+    while (nanos > seen && !maxNanos.compare_exchange_weak(seen, nanos, std::memory_order_relaxed)) {}
+}
+
+void LatencyHistogram::reset() {
+    for (auto& c : counts) c.store(0, std::memory_order_relaxed);
+    total.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    maxNanos.store(0, std::memory_order_relaxed);
+}
+
+double LatencyHistogram::mean() const {
+    uint64_t n = count();
+    return n ? (double)sum.load(std::memory_order_relaxed) / (double)n : 0.0;
+}
+
+uint64_t LatencyHistogram::percentile(double q) const {
+    uint64_t n = count();
+    if (n == 0) return 0;
+    uint64_t rank = (uint64_t)(q * (double)n + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > n) rank = n;
+    uint64_t seen = 0;
+    for (size_t b = 0; b < BUCKETS; b++) {
+        seen += counts[b].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t upper = b + 1 < BUCKETS ? bucketLow(b + 1) - 1 : UINT64_MAX;
+            return upper < max() ? upper : max();
+        }
+    }
+    return max();
+}
+
+// ----- IngestPipeline -----
+
+const char* ingestStageName(IngestStage stage) {
+    switch (stage) {
+        case IngestStage::Parse: return "parse";
+        case IngestStage::Batch: return "batch";
+        case IngestStage::Decode: return "decode";
+        case IngestStage::Emit: return "emit";
+        case IngestStage::EndToEnd: return "end_to_end";
+    }
+    return "unknown";
+}
+
+IngestPipeline::IngestPipeline(KeyCheckpointIndex& keys, const IngestConfig& config, EmitFn emit, EventFn emitEvent)
+    : keys(keys),
+      cfg(config),
+      emit(std::move(emit)),
+      emitEvent(std::move(emitEvent)),
+      lineQueue(config.queueDepth),
+      parsedQueue(config.queueDepth),
+      decodeQueue(config.batchQueueDepth),
+      emitQueue(config.batchQueueDepth) {
+    if (cfg.parseThreads == 0) cfg.parseThreads = 1;
+    if (cfg.batchFrames == 0) cfg.batchFrames = 1;
+    parseWorkersLeft.store(cfg.parseThreads);
+    for (unsigned i = 0; i < cfg.parseThreads; i++) parseWorkers.emplace_back(&IngestPipeline::parseLoop, this);
+    batchThread = std::thread(&IngestPipeline::batchLoop, this);
+    decodeThread = std::thread(&IngestPipeline::decodeLoop, this);
+    emitThread = std::thread(&IngestPipeline::emitLoop, this);
+}
+
+IngestPipeline::~IngestPipeline() { finish(); }
+
+bool IngestPipeline::submit(std::string text) {
+    if (finished) return false;
+    Line line;
+    line.seq = nextSeq;
+    line.submitNanos = nowNanos();
+    line.text = std::move(text);
+    bool queued = cfg.backpressure == Backpressure::Drop ? lineQueue.tryPush(line) : lineQueue.push(line);
+    if (!queued) {
+        droppedCount.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    nextSeq++;
+    lineCount.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void IngestPipeline::finish() {
+    if (finished) return;
+    finished = true;
+    // Each stage closes the queue behind it once its input is drained
+    lineQueue.close();
+    for (std::thread& t : parseWorkers) t.join();
+    batchThread.join();
+    decodeThread.join();
+    emitThread.join();
+}
+
+IngestPipeline::Stats IngestPipeline::stats() const {
+    Stats s;
+    s.lines = lineCount.load(std::memory_order_relaxed);
+    s.dropped = droppedCount.load(std::memory_order_relaxed);
+    s.malformed = malformedCount.load(std::memory_order_relaxed);
+    s.ignored = ignoredCount.load(std::memory_order_relaxed);
+    s.uplinks = uplinkCount.load(std::memory_order_relaxed);
+    s.frames = frameCount.load(std::memory_order_relaxed);
+    s.duplicates = duplicateCount.load(std::memory_order_relaxed);
+    s.decodedOk = okCount.load(std::memory_order_relaxed);
+    s.eventChunks = eventChunkCount.load(std::memory_order_relaxed);
+    s.events = eventCount.load(std::memory_order_relaxed);
+    s.batches = batchCount.load(std::memory_order_relaxed);
+    s.queueFullWaits[(size_t)IngestStage::Parse] = lineQueue.fullWaits();
+    s.queueFullWaits[(size_t)IngestStage::Batch] = parsedQueue.fullWaits();
+    s.queueFullWaits[(size_t)IngestStage::Decode] = decodeQueue.fullWaits();
+    s.queueFullWaits[(size_t)IngestStage::Emit] = emitQueue.fullWaits();
+    s.queueBlockedNanos[(size_t)IngestStage::Parse] = lineQueue.blockedNanos();
+    s.queueBlockedNanos[(size_t)IngestStage::Batch] = parsedQueue.blockedNanos();
+    s.queueBlockedNanos[(size_t)IngestStage::Decode] = decodeQueue.blockedNanos();
+    s.queueBlockedNanos[(size_t)IngestStage::Emit] = emitQueue.blockedNanos();
+    return s;
+}
+
+void IngestPipeline::parseLoop() {
+    Line line;
+    TtnUplink up;
+    while (lineQueue.pop(line)) {
+        const uint64_t t0 = nowNanos();
+        Parsed out;
+        out.seq = line.seq;
+        out.submitNanos = line.submitNanos;
+        if (!parseTtnUplink(line.text.data(), line.text.size(), up)) {
+            out.kind = Parsed::Malformed;
+        } else if (up.payload.empty() ||
+                   (up.port != FPORT_FRAME && up.port != FPORT_AGGREGATE && up.port != FPORT_EVENT)) {
+            out.kind = Parsed::Ignored;
+        } else if (!base64::decode(up.payload.data(), up.payload.size(), out.payload) ||
+                   (up.port == FPORT_EVENT &&
+                    (out.payload.size() < EVENT_HEADER_LEN || out.payload[FRAME_FORMAT_OFFSET] != EVENT_FORMAT))) {
+            out.kind = Parsed::Malformed;
+        } else {
+            out.kind = up.port == FPORT_EVENT ? Parsed::Event : Parsed::Frames;
+            out.port = up.port;
+            out.receiveEpoch = up.receiveEpoch;
+            out.deviceId = std::move(up.deviceId);
+        }
+        histograms[(size_t)IngestStage::Parse].record(nowNanos() - t0);
+        parsedQueue.push(out);
+    }
+    if (parseWorkersLeft.fetch_sub(1) == 1) parsedQueue.close();
+}
+
+bool IngestPipeline::firstSeen(DedupeWindow* window, const uint8_t* frame, size_t len) {
+    if (!window) return true;
+    uint64_t key = frameKey(frame, len);
+    if (!window->seen.insert(key).second) {
+        duplicateCount.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    if (window->ring.size() < cfg.dedupeWindow) {
+        window->ring.push_back(key);
+    } else {
+        window->seen.erase(window->ring[window->next]);
+        window->ring[window->next] = key;
+        window->next = (window->next + 1) % cfg.dedupeWindow;
+    }
+    return true;
+}
+
+void IngestPipeline::addFrames(const Parsed& up, Batch& batch) {
+    DedupeWindow* window = cfg.dedupeWindow ? &windows[up.deviceId] : nullptr;
+    bool haveVehicle = false;
+    uint32_t vehicle = 0;
+    size_t n = forEachUplinkFrame(up.port, up.payload.data(), up.payload.size(),
+                                  [&](const uint8_t* frame, size_t len) {
+        if (!firstSeen(window, frame, len)) return;
+        if (!haveVehicle) {
+            vehicle = batch.frames.vehicle(up.deviceId);
+            haveVehicle = true;
+        }
+        batch.frames.add(vehicle, up.receiveEpoch, frame, len);
+        batch.submitNanos.push_back(up.submitNanos);
+        frameCount.fetch_add(1, std::memory_order_relaxed);
+    });
+    if (n == 0) malformedCount.fetch_add(1, std::memory_order_relaxed);
+    else uplinkCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void IngestPipeline::addEventChunk(Parsed& up, Batch& batch) {
+    uplinkCount.fetch_add(1, std::memory_order_relaxed);
+    DedupeWindow* window = cfg.dedupeWindow ? &windows[up.deviceId] : nullptr;
+    if (!firstSeen(window, up.payload.data(), up.payload.size())) return;
+    EventChunk chunk;
+    chunk.deviceId = std::move(up.deviceId);
+    chunk.receiveEpoch = up.receiveEpoch;
+    chunk.submitNanos = up.submitNanos;
+    chunk.data = std::move(up.payload);
+    batch.chunks.push_back(std::move(chunk));
+    eventChunkCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void IngestPipeline::flushBatch(std::unique_ptr<Batch>& batch) {
+    if (!batch || batch->size() == 0) return;
+    batchCount.fetch_add(1, std::memory_order_relaxed);
+    decodeQueue.push(batch);
+    batch.reset();
+}
+
+void IngestPipeline::batchLoop() {
+    // Uplinks that overtook an earlier one, by sequence number
+    std::map<uint64_t, Parsed> pending;
+    uint64_t expected = 0;
+    std::unique_ptr<Batch> batch;
+    uint64_t deadline = 0;
+    const uint64_t maxAge = (uint64_t)cfg.batchMillis * 1000000;
+
+    for (;;) {
+        Parsed up;
+        bool got;
+        if (batch && batch->size() > 0) {
+            uint64_t now = nowNanos();
+            if (now >= deadline) {
+                flushBatch(batch);
+                continue;
+            }
+            got = parsedQueue.popFor(up, std::chrono::nanoseconds(deadline - now));
+        } else {
+            got = parsedQueue.pop(up);
+        }
+        if (!got) {
+            if (parsedQueue.drained()) break;
+            continue;  // timed out: the batch is flushed above
+        }
+
+        pending.emplace(up.seq, std::move(up));
+        while (!pending.empty() && pending.begin()->first == expected) {
+            const uint64_t t0 = nowNanos();
+            Parsed& next = pending.begin()->second;
+            if (next.kind == Parsed::Frames || next.kind == Parsed::Event) {
+                if (!batch) batch.reset(new Batch);
+                if (batch->size() == 0) deadline = t0 + maxAge;
+                if (next.kind == Parsed::Frames) addFrames(next, *batch);
+                else addEventChunk(next, *batch);
+            } else if (next.kind == Parsed::Malformed) {
+                malformedCount.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                ignoredCount.fetch_add(1, std::memory_order_relaxed);
+            }
+            pending.erase(pending.begin());
+            expected++;
+            if (batch && batch->size() >= cfg.batchFrames) flushBatch(batch);
+            histograms[(size_t)IngestStage::Batch].record(nowNanos() - t0);
+        }
+    }
+    flushBatch(batch);
+    decodeQueue.close();
+}
+
+void IngestPipeline::decodeLoop() {
+    FrameDecoder decoder(keys, cfg.decodeThreads);
+    EventDecoder events(keys);
+    std::unique_ptr<Batch> batch;
+    while (decodeQueue.pop(batch)) {
+        const uint64_t t0 = nowNanos();
+        okCount.fetch_add(decoder.decode(batch->frames, batch->decoded), std::memory_order_relaxed);
+        for (const EventChunk& c : batch->chunks) {
+            events.add(c.deviceId, c.receiveEpoch, c.data.data(), c.data.size(), batch->events);
+        }
+        eventCount.fetch_add(batch->events.size(), std::memory_order_relaxed);
+        histograms[(size_t)IngestStage::Decode].record(nowNanos() - t0);
+        emitQueue.push(batch);
+    }
+    emitQueue.close();
+}
+
+void IngestPipeline::emitLoop() {
+    std::unique_ptr<Batch> batch;
+    while (emitQueue.pop(batch)) {
+        const uint64_t t0 = nowNanos();
+        if (emit) emit(batch->frames, batch->decoded);
+        if (emitEvent) {
+            for (const CrashEvent& e : batch->events) emitEvent(e);
+        }
+        const uint64_t t1 = nowNanos();
+        histograms[(size_t)IngestStage::Emit].record(t1 - t0);
+        for (uint64_t submitted : batch->submitNanos) histograms[(size_t)IngestStage::EndToEnd].record(t1 - submitted);
+        for (const EventChunk& c : batch->chunks) histograms[(size_t)IngestStage::EndToEnd].record(t1 - c.submitNanos);
+        batch.reset();
+    }
+}
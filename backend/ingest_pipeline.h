@@ -0,0 +1,223 @@
+// ingest_pipeline.h - Staged, multithreaded ingestion of TTN uplink messages
+//
+// Takes The Things Stack v3 uplink JSON, one message per line (from the MQTT
+// bridge, a socket or a replayed file), and turns it into decoded frames and
+// crash events:
+//
+//   submit -> parse + base64 (parseThreads workers)
+//          -> reorder, dedupe, batch (one thread)
+//          -> decode (one thread, FrameDecoder with decodeThreads workers,
+//             EventDecoder for the FPORT_EVENT chunks)
+//          -> emit (one thread, the callbacks)
+//
+// The stages are joined by BoundedQueue, so a slow stage fills the queue in
+// front of it and the stages before it block in turn, back to submit(). With
+// Backpressure::Drop, submit() instead refuses the line (counted in
+// Stats::dropped) when the first queue is full; nothing is dropped past it.
+//
+// The parse workers finish out of order; the batch stage puts the uplinks
+// back in submit order, so the frames reach the decoder, and the callback,
+// as they arrived. Duplicates (an uplink heard by several gateways, a
+// replayed message, a retransmitted frame) are dropped per vehicle on the
+// frame's counter and contents: the low 16 bits of the counter that are on
+// air (frame_layout.h) plus a digest of the frame, so a counter that wraps
+// does not hide new frames. Event chunks take counters from the same stream
+// and share the window. A batch goes to the decoder once it holds
+// batchFrames frames and event chunks, or its first one is batchMillis old.
+//
+// Every stage records its service time per item, and every frame and event
+// chunk the time from submit() to the end of its callbacks, in a
+// LatencyHistogram.
+#ifndef BACKEND_INGEST_PIPELINE_H
+#define BACKEND_INGEST_PIPELINE_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "bounded_queue.h"
+#include "event_decoder.h"
+#include "frame_decoder.h"
+
+// The fields of an uplink message the pipeline reads
+struct TtnUplink {
+    std::string deviceId;       // end_device_ids.device_id
+    uint64_t receiveEpoch = 0;  // received_at, whole seconds
+    uint8_t port = 0;           // uplink_message.f_port, 0 if absent
+    uint32_t fCnt = 0;          // uplink_message.f_cnt
+    std::string payload;        // uplink_message.frm_payload, still base64
+};
+
+// Picks the fields out of one JSON message without building a tree: keys
+// are matched wherever they are nested and the first occurrence wins; the
+// rest of the message is only scanned for string boundaries. False if the
+// text is not an object, or device_id or received_at is missing or
+// malformed.
+bool parseTtnUplink(const char* json, size_t len, TtnUplink& out);
+
+// Log-linear histogram of nanosecond latencies: four buckets per power of
+// two, so a percentile is within 25% of the true value. Safe to record from
+// several threads.
+class LatencyHistogram {
+public:
+    static constexpr size_t BUCKETS = 256;
+
+    void record(uint64_t nanos);
+    void reset();
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+    uint64_t max() const { return maxNanos.load(std::memory_order_relaxed); }
+    double mean() const;
+    // Upper bound of the bucket holding quantile q (0..1); 0 when empty
+    uint64_t percentile(double q) const;
+
+    static size_t bucketOf(uint64_t nanos);
+    static uint64_t bucketLow(size_t bucket);
+
+private:
+    std::atomic<uint64_t> counts[BUCKETS] = {};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> maxNanos{0};
+};
+
+enum class Backpressure : uint8_t {
+    Block,  // submit() waits for room
+    Drop,   // submit() refuses the line
+};
+
+struct IngestConfig {
+    unsigned parseThreads = 2;
+    unsigned decodeThreads = 1;     // FrameDecoder workers; 0: every hardware thread
+    size_t queueDepth = 4096;       // lines between submit, parse and batch
+    size_t batchQueueDepth = 4;     // batches between batch, decode and emit
+    size_t batchFrames = 4096;
+    uint32_t batchMillis = 50;
+    size_t dedupeWindow = 4096;     // frames remembered per vehicle
+    Backpressure backpressure = Backpressure::Block;
+};
+
+enum class IngestStage : uint8_t { Parse, Batch, Decode, Emit, EndToEnd };
+constexpr size_t INGEST_STAGES = 5;
+const char* ingestStageName(IngestStage stage);
+
+class IngestPipeline {
+public:
+    // Called on the emit thread, once per batch, in submit order; frames[i]
+    // is batch frame i
+    using EmitFn = std::function<void(const FrameBatch& batch, const std::vector<DecodedFrame>& frames)>;
+    // Called on the emit thread for each crash event whose last chunk came
+    // in, after the batch callback of that chunk's batch
+    using EventFn = std::function<void(const CrashEvent& event)>;
+
+    struct Stats {
+        uint64_t lines = 0;       // accepted by submit()
+        uint64_t dropped = 0;     // refused by submit() (Backpressure::Drop)
+        uint64_t malformed = 0;   // bad JSON, base64, aggregate batch or event header
+        uint64_t ignored = 0;     // no payload, or not a frame or event port
+        uint64_t uplinks = 0;
+        uint64_t frames = 0;      // after dedupe
+        uint64_t duplicates = 0;  // frames and event chunks
+        uint64_t decodedOk = 0;
+        uint64_t eventChunks = 0;  // after dedupe
+        uint64_t events = 0;       // complete crash events
+        uint64_t batches = 0;
+        // Pushes that found the queue in front of a stage full, and how long
+        // they blocked; index IngestStage (EndToEnd unused)
+        uint64_t queueFullWaits[INGEST_STAGES] = {};
+        uint64_t queueBlockedNanos[INGEST_STAGES] = {};
+    };
+
+    // keys is only used from the decode thread until finish()
+    IngestPipeline(KeyCheckpointIndex& keys, const IngestConfig& config, EmitFn emit, EventFn emitEvent = nullptr);
+    ~IngestPipeline();
+    IngestPipeline(const IngestPipeline&) = delete;
+    IngestPipeline& operator=(const IngestPipeline&) = delete;
+
+    // One message; from a single producer thread. False if the line was
+    // dropped (Backpressure::Drop) or the pipeline is finished.
+    bool submit(std::string line);
+    bool submit(const char* json, size_t len) { return submit(std::string(json, len)); }
+
+    // Flushes everything submitted through the callback and stops the stages
+    void finish();
+
+    Stats stats() const;
+    const LatencyHistogram& latency(IngestStage stage) const { return histograms[(size_t)stage]; }
+    const IngestConfig& config() const { return cfg; }
+
+private:
+    struct Line {
+        uint64_t seq = 0;
+        uint64_t submitNanos = 0;
+        std::string text;
+    };
+    struct Parsed {
+        uint64_t seq = 0;
+        uint64_t submitNanos = 0;
+        enum Kind : uint8_t { Frames, Event, Malformed, Ignored } kind = Malformed;
+        uint8_t port = 0;
+        uint64_t receiveEpoch = 0;
+        std::string deviceId;
+        std::vector<uint8_t> payload;
+    };
+    struct EventChunk {
+        std::string deviceId;
+        uint64_t receiveEpoch = 0;
+        uint64_t submitNanos = 0;
+        std::vector<uint8_t> data;
+    };
+    struct Batch {
+        FrameBatch frames;
+        std::vector<uint64_t> submitNanos;  // per frame
+        std::vector<DecodedFrame> decoded;
+        std::vector<EventChunk> chunks;
+        std::vector<CrashEvent> events;     // completed by chunks
+
+        size_t size() const { return frames.size() + chunks.size(); }
+    };
+    // Keys of a vehicle's last dedupeWindow frames; ring holds them in
+    // arrival order for eviction
+    struct DedupeWindow {
+        std::unordered_set<uint64_t> seen;
+        std::vector<uint64_t> ring;
+        size_t next = 0;
+    };
+
+    void parseLoop();
+    void batchLoop();
+    void decodeLoop();
+    void emitLoop();
+    bool firstSeen(DedupeWindow* window, const uint8_t* frame, size_t len);
+    void addFrames(const Parsed& up, Batch& batch);
+    void addEventChunk(Parsed& up, Batch& batch);
+    void flushBatch(std::unique_ptr<Batch>& batch);
+
+    KeyCheckpointIndex& keys;
+    IngestConfig cfg;
+    EmitFn emit;
+    EventFn emitEvent;
+
+    BoundedQueue<Line> lineQueue;
+    BoundedQueue<Parsed> parsedQueue;
+    BoundedQueue<std::unique_ptr<Batch>> decodeQueue;
+    BoundedQueue<std::unique_ptr<Batch>> emitQueue;
+    std::vector<std::thread> parseWorkers;
+    std::thread batchThread, decodeThread, emitThread;
+    std::atomic<unsigned> parseWorkersLeft{0};
+    uint64_t nextSeq = 0;
+    bool finished = false;
+    // Batch thread only
+    std::unordered_map<std::string, DedupeWindow> windows;
+
+    std::atomic<uint64_t> lineCount{0}, droppedCount{0}, malformedCount{0}, ignoredCount{0}, uplinkCount{0},
+        frameCount{0}, duplicateCount{0}, okCount{0}, eventChunkCount{0}, eventCount{0}, batchCount{0};
+    LatencyHistogram histograms[INGEST_STAGES];
+};
+
+#endif
@@ -0,0 +1,158 @@
+// key_index.cpp - Checkpointed daily key chains
+#include "key_index.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace {
+
+constexpr char MAGIC[4] = {'B', 'B', 'K', 'I'};
+constexpr uint32_t VERSION = 1;
+
+template <typename T>
+void writePod(std::ostream& out, const T& v) { out.write(reinterpret_cast<const char*>(&v), sizeof(v)); }
+
+template <typename T>
+bool readPod(std::istream& in, T& v) { return (bool)in.read(reinterpret_cast<char*>(&v), sizeof(v)); }
+
+}  // namespace
+
+KeyCheckpointIndex::KeyCheckpointIndex(uint32_t interval) : checkpointInterval(interval ? interval : 1) {}
+
+void KeyCheckpointIndex::addVehicle(const std::string& vehicleId, const uint8_t* masterKey,
+                                    size_t masterKeyLen, uint64_t startEpoch) {
+    Chain chain{vehicleId, keychain::dayOf(startEpoch), {}};
+    Key first;
+    // Day 0 hashes the registered start epoch as-is, like the device does
+    keychain::deriveInitial(masterKey, masterKeyLen, (const uint8_t*)vehicleId.data(), vehicleId.size(),
+                            startEpoch, first.data());
+    hashes++;
+    chain.checkpoints.push_back(first);
+    chains[vehicleId] = std::move(chain);
+}
+
+bool KeyCheckpointIndex::dayIndexOf(const Chain& chain, uint64_t epoch, uint64_t& dayIndex) const {
+    uint64_t day = keychain::dayOf(epoch);
+    if (day < chain.startDay) return false;
+    dayIndex = (day - chain.startDay) / SECONDS_PER_DAY;
+    return true;
+}
+
+void KeyCheckpointIndex::walk(const Chain& chain, Key& key, uint64_t fromIndex, uint64_t toIndex) {
+    const uint8_t* vid = (const uint8_t*)chain.vehicleId.data();
+    for (uint64_t d = fromIndex + 1; d <= toIndex; d++) {
+        keychain::deriveNext(key.data(), vid, chain.vehicleId.size(), chain.startDay + d * SECONDS_PER_DAY,
+                             key.data());
+    }
+    hashes += toIndex - fromIndex;
+}
+
+void KeyCheckpointIndex::extendTo(Chain& chain, uint64_t dayIndex) {
+    uint64_t wanted = dayIndex / checkpointInterval;
+    while (chain.checkpoints.size() <= wanted) {
+        uint64_t from = (chain.checkpoints.size() - 1) * (uint64_t)checkpointInterval;
+        Key key = chain.checkpoints.back();
+        walk(chain, key, from, from + checkpointInterval);
+        chain.checkpoints.push_back(key);
+    }
+}
+
+bool KeyCheckpointIndex::keyFor(const std::string& vehicleId, uint64_t dayEpoch, Key& out) {
+    auto it = chains.find(vehicleId);
+    if (it == chains.end()) return false;
+    Chain& chain = it->second;
+    uint64_t dayIndex;
+    if (!dayIndexOf(chain, dayEpoch, dayIndex)) return false;
+
+    extendTo(chain, dayIndex);
+    uint64_t base = dayIndex / checkpointInterval;
+    out = chain.checkpoints[base];
+    walk(chain, out, base * checkpointInterval, dayIndex);
+    return true;
+}
+
+bool KeyCheckpointIndex::keysForRange(const std::string& vehicleId, uint64_t fromEpoch, uint64_t toEpoch,
+                                      std::vector<Key>& out) {
+    out.clear();
+    auto it = chains.find(vehicleId);
+    if (it == chains.end() || toEpoch < fromEpoch) return false;
+    Chain& chain = it->second;
+    uint64_t first, last;
+    // out[i] must be the key of day from + i: no silent clamp to the chain start
+    if (!dayIndexOf(chain, fromEpoch, first) || !dayIndexOf(chain, toEpoch, last)) return false;
+
+    extendTo(chain, first);
+    uint64_t base = first / checkpointInterval;
+    Key key = chain.checkpoints[base];
+    walk(chain, key, base * checkpointInterval, first);
+
+    out.reserve(last - first + 1);
+    out.push_back(key);
+    for (uint64_t d = first + 1; d <= last; d++) {
+        walk(chain, key, d - 1, d);
+        out.push_back(key);
+        // Keep the index growing for free while we pass checkpoint days
+        if (d % checkpointInterval == 0 && d / checkpointInterval == chain.checkpoints.size()) {
+            chain.checkpoints.push_back(key);
+        }
+    }
+    return true;
+}
+
+void KeyCheckpointIndex::extendAll(uint64_t dayEpoch) {
+    for (auto& entry : chains) {
+        uint64_t dayIndex;
+        if (dayIndexOf(entry.second, dayEpoch, dayIndex)) extendTo(entry.second, dayIndex);
+    }
+}
+
+bool KeyCheckpointIndex::save(const std::string& path) const {
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        out.write(MAGIC, sizeof(MAGIC));
+        writePod(out, VERSION);
+        writePod(out, checkpointInterval);
+        writePod(out, (uint32_t)chains.size());
+        for (const auto& entry : chains) {
+            const Chain& chain = entry.second;
+            writePod(out, (uint16_t)chain.vehicleId.size());
+            out.write(chain.vehicleId.data(), chain.vehicleId.size());
+            writePod(out, chain.startDay);
+            writePod(out, (uint32_t)chain.checkpoints.size());
+            for (const Key& key : chain.checkpoints) out.write((const char*)key.data(), key.size());
+        }
+        if (!out) return false;
+    }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+bool KeyCheckpointIndex::load(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[4];
+    uint32_t version, interval, count;
+    if (!in.read(magic, sizeof(magic)) || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) return false;
+    if (!readPod(in, version) || version != VERSION) return false;
+    if (!readPod(in, interval) || interval == 0 || !readPod(in, count)) return false;
+
+    std::unordered_map<std::string, Chain> loaded;
+    for (uint32_t i = 0; i < count; i++) {
+        uint16_t idLen;
+        uint32_t n;
+        Chain chain;
+        if (!readPod(in, idLen)) return false;
+        chain.vehicleId.resize(idLen);
+        if (!in.read(&chain.vehicleId[0], idLen)) return false;
+        if (!readPod(in, chain.startDay) || !readPod(in, n) || n == 0) return false;
+        chain.checkpoints.resize(n);
+        for (Key& key : chain.checkpoints) {
+            if (!in.read((char*)key.data(), key.size())) return false;
+        }
+        loaded[chain.vehicleId] = std::move(chain);
+    }
+    chains = std::move(loaded);
+    checkpointInterval = interval;
+    return true;
+}
@@ -0,0 +1,66 @@
+// key_index.h - Sparse checkpoint index over the per-vehicle daily key chains
+//
+// The chain only runs forward (key[d] needs key[d-1]), so without help the
+// key of day d costs d hashes. The index keeps key[0], key[K], key[2K], ...
+// for every vehicle; once the checkpoints cover a day, its key costs at most
+// K-1 hashes. Checkpoints are persisted so a restart does not re-walk history.
+//
+// A saved index holds derived keys and can decrypt everything from its first
+// checkpoint onwards: protect it like the master keys. Not thread-safe.
+#ifndef BACKEND_KEY_INDEX_H
+#define BACKEND_KEY_INDEX_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "key_chain.h"
+
+class KeyCheckpointIndex {
+public:
+    using Key = std::array<uint8_t, DAILY_KEY_SIZE>;
+
+    explicit KeyCheckpointIndex(uint32_t interval = 32);
+
+    // Registers (or replaces) a vehicle; day 0 is the day holding startEpoch
+    void addVehicle(const std::string& vehicleId, const uint8_t* masterKey, size_t masterKeyLen,
+                    uint64_t startEpoch);
+    bool hasVehicle(const std::string& vehicleId) const { return chains.count(vehicleId) != 0; }
+    size_t vehicleCount() const { return chains.size(); }
+
+    // Key of the day holding dayEpoch; false for unknown vehicles or days before the start
+    bool keyFor(const std::string& vehicleId, uint64_t dayEpoch, Key& out);
+
+    // Keys of every day in [fromEpoch, toEpoch] from a single chain walk;
+    // false if the range starts before the chain does
+    bool keysForRange(const std::string& vehicleId, uint64_t fromEpoch, uint64_t toEpoch,
+                      std::vector<Key>& out);
+
+    // Precomputes checkpoints up to dayEpoch for every vehicle (e.g. nightly)
+    void extendAll(uint64_t dayEpoch);
+
+    bool save(const std::string& path) const;
+    // Replaces the index contents with a saved one; no master keys needed
+    bool load(const std::string& path);
+
+    uint32_t interval() const { return checkpointInterval; }
+    uint64_t hashCount() const { return hashes; }
+
+private:
+    struct Chain {
+        std::string vehicleId;
+        uint64_t startDay;
+        std::vector<Key> checkpoints;  // checkpoints[i] = key of day i * interval
+    };
+
+    void extendTo(Chain& chain, uint64_t dayIndex);
+    bool dayIndexOf(const Chain& chain, uint64_t epoch, uint64_t& dayIndex) const;
+    void walk(const Chain& chain, Key& key, uint64_t fromIndex, uint64_t toIndex);
+
+    std::unordered_map<std::string, Chain> chains;
+    uint32_t checkpointInterval;
+    uint64_t hashes = 0;
+};
+
+#endif
@@ -0,0 +1,396 @@
+// key_service.cpp - Sharded daily key cache over the fleet's key chains
+#include "key_service.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <shared_mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+constexpr uint32_t EMPTY = UINT32_MAX;
+constexpr uint64_t DEFAULT_START_EPOCH = 1742860800;  // 2025-03-25 00:00:00 UTC, as in bbdecode
+
+uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// FNV-1a, finalized so the low bits (the shard) and the rest (the slot) are independent
+uint64_t hashId(const std::string& id) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (unsigned char c : id) h = (h ^ c) * 0x100000001b3ull;
+    return mix(h);
+}
+
+bool parseHex(const std::string& hex, std::vector<uint8_t>& out) {
+    out.clear();
+    if (hex.size() % 2) return false;
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        unsigned v;
+        if (sscanf(hex.c_str() + i, "%2x", &v) != 1) return false;
+        out.push_back((uint8_t)v);
+    }
+    return true;
+}
+
+// key: day fromIndex of the chain in, day toIndex out
+void walkChain(const std::string& id, uint32_t startDay, uint64_t fromIndex, uint64_t toIndex,
+               DailyKeyService::Key& key) {
+    for (uint64_t i = fromIndex + 1; i <= toIndex; i++) {
+        keychain::deriveNext(key.data(), (const uint8_t*)id.data(), id.size(), (startDay + i) * SECONDS_PER_DAY,
+                             key.data());
+    }
+}
+
+}  // namespace
+
+const char* keyLookupName(KeyLookup result) {
+    switch (result) {
+        case KeyLookup::Hit: return "hit";
+        case KeyLookup::Derived: return "derived";
+        case KeyLookup::UnknownVehicle: return "unknown_vehicle";
+        case KeyLookup::BeforeStart: return "before_start";
+    }
+    return "unknown";
+}
+
+struct DailyKeyService::Record {
+    std::string id;
+    uint64_t idHash;
+    uint32_t startDay;             // day number (epoch / SECONDS_PER_DAY)
+    std::vector<Key> checkpoints;  // checkpoints[i] = key of day startDay + i * interval
+};
+
+// Two per cache line
+struct alignas(32) DailyKeyService::Slot {
+    uint64_t idHash;
+    uint32_t record = EMPTY;  // index into Shard::records
+    uint32_t day;
+    Key key;
+};
+static_assert(sizeof(DailyKeyService::Key) == 16, "a slot is 32 bytes");
+
+// Open addressing, linear probing, at most half full
+struct DailyKeyService::Table {
+    explicit Table(size_t entries) {
+        size_t cap = 16;
+        while (cap < entries * 2) cap <<= 1;
+        slots.resize(cap);
+    }
+
+    static size_t home(uint64_t idHash, uint32_t day) { return (size_t)mix(idHash ^ (day * 0x9E3779B97F4A7C15ull)); }
+
+    // match(record) confirms the id behind a matching hash
+    template <typename Match>
+    const Slot* find(uint64_t idHash, uint32_t day, Match match) const {
+        const size_t mask = slots.size() - 1;
+        for (size_t i = home(idHash, day) & mask;; i = (i + 1) & mask) {
+            const Slot& s = slots[i];
+            if (s.record == EMPTY) return nullptr;
+            if (s.idHash == idHash && s.day == day && match(s.record)) return &s;
+        }
+    }
+
+    void insert(uint64_t idHash, uint32_t record, uint32_t day, const Key& key) {
+        if ((count + 1) * 2 > slots.size()) {
+            Table bigger(slots.size());
+            for (const Slot& s : slots) {
+                if (s.record != EMPTY) bigger.insert(s.idHash, s.record, s.day, s.key);
+            }
+            slots.swap(bigger.slots);
+        }
+        const size_t mask = slots.size() - 1;
+        size_t i = home(idHash, day) & mask;
+        while (slots[i].record != EMPTY) i = (i + 1) & mask;
+        slots[i].idHash = idHash;
+        slots[i].record = record;
+        slots[i].day = day;
+        slots[i].key = key;
+        count++;
+    }
+
+    std::vector<Slot> slots;
+    size_t count = 0;
+};
+
+struct alignas(64) DailyKeyService::Shard {
+    // A steady stream of readers would starve a writer of a plain
+    // shared_mutex: readers hold back while one waits
+    std::shared_lock<std::shared_mutex> reading() const {
+        while (writerWaiting.load(std::memory_order_acquire)) std::this_thread::yield();
+        return std::shared_lock<std::shared_mutex>(lock);
+    }
+    // Writers are serialized by precomputeLock
+    std::unique_lock<std::shared_mutex> writing() {
+        writerWaiting.store(true, std::memory_order_release);
+        std::unique_lock<std::shared_mutex> w(lock);
+        writerWaiting.store(false, std::memory_order_release);
+        return w;
+    }
+
+    mutable std::shared_mutex lock;
+    std::atomic<bool> writerWaiting{false};
+    std::unique_ptr<Table> table = std::make_unique<Table>(0);
+    std::vector<Record> records;
+    std::unordered_map<std::string, uint32_t> byId;
+    mutable std::atomic<uint64_t> hits{0}, derived{0}, misses{0};
+};
+
+DailyKeyService::DailyKeyService(const KeyServiceConfig& config) : cfg(config) {
+    if (cfg.retainDays == 0) cfg.retainDays = 1;
+    if (cfg.checkpointInterval == 0) cfg.checkpointInterval = 1;
+    unsigned n = 1;
+    while (n < cfg.shards) n <<= 1;
+    for (unsigned i = 0; i < n; i++) shards.push_back(std::make_unique<Shard>());
+    workerCount = cfg.threads ? cfg.threads : std::max(1u, std::thread::hardware_concurrency());
+    workerCount = std::min(workerCount, n);
+}
+
+DailyKeyService::~DailyKeyService() = default;
+
+DailyKeyService::Shard& DailyKeyService::shardOf(uint64_t idHash) const {
+    return *shards[idHash & (shards.size() - 1)];
+}
+
+// Walks to day from the nearest checkpoint, in r.checkpoints or grown
+uint64_t DailyKeyService::walk(const Record& r, uint32_t day, Key& out, std::vector<Key>& grown) const {
+    const uint32_t interval = cfg.checkpointInterval;
+    const uint64_t dayIndex = day - r.startDay;
+    size_t have = r.checkpoints.size() + grown.size();
+    uint64_t base = std::min<uint64_t>(dayIndex / interval, have - 1);
+    out = base < r.checkpoints.size() ? r.checkpoints[base] : grown[base - r.checkpoints.size()];
+    // Checkpoints passed on the way are kept, so the next walk is short
+    uint64_t from = base * interval;
+    for (uint64_t cp = have * (uint64_t)interval; cp <= dayIndex; cp += interval, have++) {
+        walkChain(r.id, r.startDay, from, cp, out);
+        grown.push_back(out);
+        from = cp;
+    }
+    walkChain(r.id, r.startDay, from, dayIndex, out);
+    return dayIndex - base * interval;
+}
+
+// A new table for [first, last]: keys already in the shard's table are
+// copied, the rest derived from the day before or walked to. The slots of
+// record `fresh` are derived again. grown[record] gets the checkpoints passed.
+std::unique_ptr<DailyKeyService::Table> DailyKeyService::build(const Shard& shard, uint32_t first, uint32_t last,
+                                                               uint32_t fresh, uint64_t& hashed,
+                                                               std::vector<std::vector<Key>>& grown) const {
+    size_t entries = 0;
+    for (const Record& r : shard.records) {
+        if (r.startDay <= last) entries += last - std::max(first, r.startDay) + 1;
+    }
+    auto table = std::make_unique<Table>(entries);
+    grown.assign(shard.records.size(), {});
+    const Table& old = *shard.table;
+    for (uint32_t idx = 0; idx < shard.records.size(); idx++) {
+        const Record& r = shard.records[idx];
+        Key key;
+        bool have = false;
+        for (uint32_t day = std::max(first, r.startDay); day <= last && r.startDay <= last; day++) {
+            const Slot* s = idx == fresh ? nullptr : old.find(r.idHash, day, [idx](uint32_t rec) { return rec == idx; });
+            if (s) {
+                key = s->key;
+            } else if (have && day > r.startDay) {
+                keychain::deriveNext(key.data(), (const uint8_t*)r.id.data(), r.id.size(), (uint64_t)day * SECONDS_PER_DAY,
+                                     key.data());
+                hashed++;
+                const uint64_t i = day - r.startDay;
+                if (i % cfg.checkpointInterval == 0 &&
+                    i / cfg.checkpointInterval == r.checkpoints.size() + grown[idx].size()) {
+                    grown[idx].push_back(key);
+                }
+            } else {
+                hashed += walk(r, day, key, grown[idx]);
+            }
+            have = true;
+            table->insert(r.idHash, idx, day, key);
+        }
+    }
+    return table;
+}
+
+// Rebuilds one shard while lookups go on, then swaps the table in
+uint64_t DailyKeyService::refill(Shard& shard, uint32_t first, uint32_t last) {
+    uint64_t hashed = 0;
+    std::vector<std::vector<Key>> grown;
+    std::unique_ptr<Table> table;
+    {
+        auto read = shard.reading();
+        table = build(shard, first, last, EMPTY, hashed, grown);
+    }
+    auto write = shard.writing();
+    shard.table.swap(table);
+    for (size_t i = 0; i < grown.size(); i++) {
+        auto& cps = shard.records[i].checkpoints;
+        cps.insert(cps.end(), grown[i].begin(), grown[i].end());
+    }
+    return hashed;
+}
+
+void DailyKeyService::addVehicle(const std::string& vehicleId, const uint8_t* masterKey, size_t masterKeyLen,
+                                 uint64_t startEpoch) {
+    Record r{vehicleId, hashId(vehicleId), (uint32_t)(startEpoch / SECONDS_PER_DAY), {Key{}}};
+    // Day 0 hashes the registered start epoch as-is, like the device does
+    keychain::deriveInitial(masterKey, masterKeyLen, (const uint8_t*)vehicleId.data(), vehicleId.size(),
+                            startEpoch, r.checkpoints[0].data());
+
+    // Not while precompute() is between reading a shard and swapping it
+    std::lock_guard<std::mutex> serial(precomputeLock);
+    Shard& shard = shardOf(r.idHash);
+    auto write = shard.writing();
+    auto it = shard.byId.find(vehicleId);
+    const bool replaced = it != shard.byId.end();
+    uint32_t idx = replaced ? it->second : (uint32_t)shard.records.size();
+    if (replaced) {
+        shard.records[idx] = std::move(r);
+    } else {
+        shard.records.push_back(std::move(r));
+        shard.byId.emplace(vehicleId, idx);
+    }
+
+    const uint32_t last = lastDay.load(), first = firstDay.load();
+    if (last == 0) return;
+    Record& rec = shard.records[idx];
+    uint64_t hashed = 0;
+    if (replaced) {
+        // Its old keys are somewhere in the table: rebuild without them
+        std::vector<std::vector<Key>> grown;
+        shard.table = build(shard, first, last, idx, hashed, grown);
+        rec.checkpoints.insert(rec.checkpoints.end(), grown[idx].begin(), grown[idx].end());
+    } else {
+        std::vector<Key> grown;
+        for (uint32_t day = std::max(first, rec.startDay); day <= last && rec.startDay <= last; day++) {
+            Key key;
+            hashed += walk(rec, day, key, grown);
+            shard.table->insert(rec.idHash, idx, day, key);
+        }
+        rec.checkpoints.insert(rec.checkpoints.end(), grown.begin(), grown.end());
+    }
+    precomputeHashes += hashed;
+}
+
+KeyLookup DailyKeyService::keyFor(const std::string& vehicleId, uint64_t epoch, Key& out) const {
+    const uint64_t h = hashId(vehicleId);
+    const uint32_t day = (uint32_t)(epoch / SECONDS_PER_DAY);
+    Shard& shard = shardOf(h);
+    auto read = shard.reading();
+    const Slot* s = shard.table->find(h, day, [&](uint32_t rec) { return shard.records[rec].id == vehicleId; });
+    if (s) {
+        out = s->key;
+        shard.hits.fetch_add(1, std::memory_order_relaxed);
+        return KeyLookup::Hit;
+    }
+    auto it = shard.byId.find(vehicleId);
+    if (it == shard.byId.end() || day < shard.records[it->second].startDay) {
+        shard.misses.fetch_add(1, std::memory_order_relaxed);
+        return it == shard.byId.end() ? KeyLookup::UnknownVehicle : KeyLookup::BeforeStart;
+    }
+    // Hash outside the lock, from a copy of the nearest checkpoint
+    const Record& r = shard.records[it->second];
+    const uint64_t dayIndex = day - r.startDay;
+    const uint64_t base = std::min<uint64_t>(dayIndex / cfg.checkpointInterval, r.checkpoints.size() - 1);
+    const uint32_t startDay = r.startDay;
+    out = r.checkpoints[base];
+    read.unlock();
+    shard.derived.fetch_add(1, std::memory_order_relaxed);
+    walkChain(vehicleId, startDay, base * cfg.checkpointInterval, dayIndex, out);
+    return KeyLookup::Derived;
+}
+
+uint64_t DailyKeyService::precompute(uint64_t todayEpoch) {
+    std::lock_guard<std::mutex> serial(precomputeLock);
+    const auto t0 = std::chrono::steady_clock::now();
+    const uint32_t today = (uint32_t)(todayEpoch / SECONDS_PER_DAY);
+    const uint32_t first = today >= cfg.retainDays - 1 ? today - (cfg.retainDays - 1) : 0;
+    const uint32_t last = today + cfg.aheadDays;
+
+    // Worker w takes shards w, w + workers, ...: no two workers share a shard
+    std::atomic<uint64_t> hashed{0};
+    auto work = [&](unsigned w) {
+        uint64_t n = 0;
+        for (size_t s = w; s < shards.size(); s += workerCount) n += refill(*shards[s], first, last);
+        hashed += n;
+    };
+    std::vector<std::thread> workers;
+    for (unsigned w = 1; w < workerCount; w++) workers.emplace_back(work, w);
+    work(0);
+    for (auto& t : workers) t.join();
+
+    firstDay = first;
+    lastDay = last;
+    precomputeHashes += hashed;
+    lastPrecomputeNanos = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::steady_clock::now() - t0)
+                              .count();
+    return hashed;
+}
+
+DailyKeyService::Stats DailyKeyService::stats() const {
+    Stats st{};
+    for (const auto& shard : shards) {
+        auto read = shard->reading();
+        st.vehicles += shard->records.size();
+        st.residentKeys += shard->table->count;
+        st.hits += shard->hits.load(std::memory_order_relaxed);
+        st.derived += shard->derived.load(std::memory_order_relaxed);
+        st.misses += shard->misses.load(std::memory_order_relaxed);
+    }
+    st.precomputeHashes = precomputeHashes.load();
+    if (lastDay.load() != 0) {
+        st.windowFirstDay = (uint64_t)firstDay.load() * SECONDS_PER_DAY;
+        st.windowLastDay = (uint64_t)lastDay.load() * SECONDS_PER_DAY;
+    }
+    st.lastPrecomputeSeconds = lastPrecomputeNanos.load() / 1e9;
+    return st;
+}
+
+std::string keyServiceRequest(DailyKeyService& service, const std::string& line) {
+    std::istringstream in(line);
+    std::string cmd;
+    in >> cmd;
+    if (cmd == "KEY") {
+        std::string id;
+        uint64_t epoch;
+        if (!(in >> id >> epoch)) return "ERR bad_request";
+        DailyKeyService::Key key;
+        KeyLookup result = service.keyFor(id, epoch, key);
+        if (result != KeyLookup::Hit && result != KeyLookup::Derived) return std::string("ERR ") + keyLookupName(result);
+        std::string out = "OK ";
+        char hex[3];
+        for (uint8_t b : key) {
+            snprintf(hex, sizeof(hex), "%02x", b);
+            out += hex;
+        }
+        return out + " " + keyLookupName(result);
+    }
+    if (cmd == "ADD") {
+        std::string id, masterHex;
+        uint64_t start = DEFAULT_START_EPOCH;
+        if (!(in >> id >> masterHex)) return "ERR bad_request";
+        in >> start;
+        std::vector<uint8_t> master;
+        if (!parseHex(masterHex, master)) return "ERR bad_vehicle";
+        service.addVehicle(id, master.data(), master.size(), start);
+        return "OK";
+    }
+    if (cmd == "STATS") {
+        DailyKeyService::Stats st = service.stats();
+        char buf[256];
+        snprintf(buf, sizeof(buf),
+                 "OK vehicles=%zu resident=%zu hits=%llu derived=%llu misses=%llu window=%llu..%llu "
+                 "precompute_ms=%.1f",
+                 st.vehicles, st.residentKeys, (unsigned long long)st.hits, (unsigned long long)st.derived,
+                 (unsigned long long)st.misses, (unsigned long long)st.windowFirstDay,
+                 (unsigned long long)st.windowLastDay, st.lastPrecomputeSeconds * 1000);
+        return buf;
+    }
+    return "ERR bad_request";
+}
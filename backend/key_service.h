@@ -0,0 +1,113 @@
+// key_service.h - Fleet-wide daily key service with a precomputed key cache
+//
+// Holds every vehicle's master key record and serves the key of any
+// (vehicle, day). The keys of a window of days around today are precomputed
+// for the whole fleet and kept in a hash table keyed by (vehicle id, day),
+// split into shards: a vehicle, its record and its cached days all live in
+// the shard picked by the hash of its id. Every shard starts on its own
+// cache line and has its own reader-writer lock, so lookups on different
+// shards share nothing; the 32-byte slots never straddle a line, so a hit
+// reads one line of the table (and the vehicle's id, to confirm it).
+//
+// precompute(day) is meant to run at midnight UTC (bbkeyd does): worker
+// threads rebuild the shards for the new window, one hash per vehicle for
+// the new day (from the key of the day before), and swap each in under its
+// lock, so lookups only wait for a pointer swap. Days outside the window are
+// still served, walking the chain from the vehicle's nearest checkpoint
+// (one every checkpointInterval days, like KeyCheckpointIndex).
+//
+// All public methods are thread-safe; precompute() calls are serialized.
+#ifndef BACKEND_KEY_SERVICE_H
+#define BACKEND_KEY_SERVICE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "key_index.h"
+
+struct KeyServiceConfig {
+    unsigned shards = 64;             // rounded up to a power of two
+    unsigned threads = 0;             // precompute workers; 0: every hardware thread
+    uint32_t retainDays = 3;          // today and the days before it kept resident
+    uint32_t aheadDays = 1;           // days after today kept resident
+    uint32_t checkpointInterval = 32;
+};
+
+enum class KeyLookup : uint8_t {
+    Hit,            // from the precomputed window
+    Derived,        // outside the window, walked from a checkpoint
+    UnknownVehicle,
+    BeforeStart,    // a day before the vehicle's chain starts
+};
+
+const char* keyLookupName(KeyLookup result);
+
+class DailyKeyService {
+public:
+    using Key = KeyCheckpointIndex::Key;
+
+    struct Stats {
+        size_t vehicles;
+        size_t residentKeys;
+        uint64_t hits;
+        uint64_t derived;
+        uint64_t misses;           // unknown vehicle or before the start
+        uint64_t precomputeHashes; // keys hashed by precompute() so far
+        uint64_t windowFirstDay;   // epoch of the first resident day; 0 before any precompute
+        uint64_t windowLastDay;
+        double lastPrecomputeSeconds;
+    };
+
+    explicit DailyKeyService(const KeyServiceConfig& config = {});
+    ~DailyKeyService();
+    DailyKeyService(const DailyKeyService&) = delete;
+    DailyKeyService& operator=(const DailyKeyService&) = delete;
+
+    // Registers (or replaces) a vehicle; day 0 is the day holding startEpoch.
+    // Its keys of the current window are derived straight away.
+    void addVehicle(const std::string& vehicleId, const uint8_t* masterKey, size_t masterKeyLen,
+                    uint64_t startEpoch);
+
+    // Key of the day holding epoch
+    KeyLookup keyFor(const std::string& vehicleId, uint64_t epoch, Key& out) const;
+
+    // Makes the window around the day holding todayEpoch resident for the
+    // whole fleet and drops the days before it. Returns the keys hashed.
+    uint64_t precompute(uint64_t todayEpoch);
+
+    Stats stats() const;
+    unsigned threads() const { return workerCount; }
+    unsigned shardCount() const { return (unsigned)shards.size(); }
+
+private:
+    struct Record;
+    struct Slot;
+    struct Table;
+    struct Shard;
+
+    Shard& shardOf(uint64_t idHash) const;
+    std::unique_ptr<Table> build(const Shard& shard, uint32_t first, uint32_t last, uint32_t fresh, uint64_t& hashed,
+                                 std::vector<std::vector<Key>>& grown) const;
+    uint64_t refill(Shard& shard, uint32_t first, uint32_t last);
+    uint64_t walk(const Record& record, uint32_t day, Key& out, std::vector<Key>& grown) const;
+
+    KeyServiceConfig cfg;
+    unsigned workerCount;
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::mutex precomputeLock;
+    std::atomic<uint32_t> firstDay{0}, lastDay{0};  // resident window, day numbers; lastDay 0: none
+    std::atomic<uint64_t> precomputeHashes{0};
+    std::atomic<uint64_t> lastPrecomputeNanos{0};
+};
+
+// One request of the bbkeyd line protocol, without the newline:
+//   KEY <vehicleId> <epoch>               -> OK <keyHex> hit|derived | ERR unknown_vehicle|before_start
+//   ADD <vehicleId> <masterHex> [<start>] -> OK | ERR bad_vehicle
+//   STATS                                 -> OK vehicles=<n> resident=<n> hits=<n> ...
+// Anything else -> ERR bad_request
+std::string keyServiceRequest(DailyKeyService& service, const std::string& line);
+
+#endif
@@ -0,0 +1,230 @@
+// merkle_batcher.cpp - Merkle trees, receipts and per-vehicle batching
+#include "merkle_batcher.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "key_chain.h"
+#include "sha256.h"
+
+namespace {
+
+constexpr uint8_t LEAF_PREFIX = 0x00;
+constexpr uint8_t NODE_PREFIX = 0x01;
+constexpr uint8_t PAYLOAD_MAGIC = 'M';
+constexpr uint8_t PAYLOAD_VERSION = 1;
+
+void putBE32(uint8_t* out, uint32_t v) {
+    for (int i = 0; i < 4; i++) out[i] = (uint8_t)(v >> (24 - 8 * i));
+}
+
+}  // namespace
+
+MerkleHash merkleLeaf(uint64_t receiveEpoch, const uint8_t* frame, size_t len) {
+    // Uplinked frames fit the stack buffer; anything longer is copied once
+    uint8_t small[1 + 8 + 256];
+    std::vector<uint8_t> large;
+    uint8_t* message = small;
+    if (len > sizeof(small) - 9) {
+        large.resize(9 + len);
+        message = large.data();
+    }
+    message[0] = LEAF_PREFIX;
+    keychain::epochToBytesBE(receiveEpoch, message + 1);
+    if (len) memcpy(message + 9, frame, len);
+    MerkleHash out;
+    sha256::digest(message, 9 + len, out.data());
+    return out;
+}
+
+MerkleHash merkleNode(const MerkleHash& left, const MerkleHash& right) {
+    uint8_t message[65];
+    message[0] = NODE_PREFIX;
+    memcpy(message + 1, left.data(), 32);
+    memcpy(message + 33, right.data(), 32);
+    MerkleHash out;
+    sha256::digest(message, sizeof(message), out.data());
+    return out;
+}
+
+std::string merkleHex(const MerkleHash& hash) {
+    static const char digits[] = "0123456789abcdef";
+    std::string out;
+    out.reserve(64);
+    for (uint8_t b : hash) {
+        out += digits[b >> 4];
+        out += digits[b & 15];
+    }
+    return out;
+}
+
+MerkleTree::MerkleTree(std::vector<MerkleHash> leaves) : leafCount(leaves.size()), nodes(std::move(leaves)) {
+    if (leafCount == 0) {
+        nodes.resize(1);
+        sha256::digest(nullptr, 0, nodes[0].data());
+        return;
+    }
+    // Fewer than 2n nodes in all; reserved so the reads below stay valid
+    nodes.reserve(2 * leafCount);
+    for (size_t start = 0, n = leafCount; n > 1; start += n, n = (n + 1) / 2) {
+        for (size_t i = 0; i + 1 < n; i += 2) nodes.push_back(merkleNode(nodes[start + i], nodes[start + i + 1]));
+        if (n & 1) nodes.push_back(nodes[start + n - 1]);
+    }
+}
+
+std::vector<MerkleHash> MerkleTree::proof(size_t index) const {
+    std::vector<MerkleHash> out;
+    if (index >= leafCount) return out;
+    for (size_t start = 0, n = leafCount; n > 1; start += n, n = (n + 1) / 2, index >>= 1) {
+        size_t sibling = index ^ 1;
+        if (sibling < n) out.push_back(nodes[start + sibling]);
+    }
+    return out;
+}
+
+bool MerkleTree::verify(const MerkleHash& leaf, size_t index, size_t count, const std::vector<MerkleHash>& proof,
+                        const MerkleHash& root) {
+    if (index >= count) return false;
+    MerkleHash hash = leaf;
+    size_t used = 0;
+    for (size_t n = count; n > 1; n = (n + 1) / 2, index >>= 1) {
+        if ((index ^ 1) >= n) continue;
+        if (used == proof.size()) return false;
+        hash = index & 1 ? merkleNode(proof[used], hash) : merkleNode(hash, proof[used]);
+        used++;
+    }
+    return used == proof.size() && hash == root;
+}
+
+std::array<uint8_t, MerkleAnchor::RECORD_SIZE> MerkleAnchor::payload() const {
+    std::array<uint8_t, RECORD_SIZE> out;
+    out[0] = PAYLOAD_MAGIC;
+    out[1] = PAYLOAD_VERSION;
+    memcpy(&out[2], root.data(), 32);
+    putBE32(&out[34], leaves);
+    keychain::epochToBytesBE(sequence, &out[38]);
+    keychain::epochToBytesBE(firstEpoch, &out[46]);
+    keychain::epochToBytesBE(lastEpoch, &out[54]);
+    return out;
+}
+
+bool MerkleReceipt::verify(uint64_t receiveEpoch, const uint8_t* frame, size_t len) const {
+    return MerkleTree::verify(merkleLeaf(receiveEpoch, frame, len), index, anchor.leaves, proof, anchor.root);
+}
+
+LocalLedger::LocalLedger(const std::string& logPath) : log(logPath) {}
+
+bool LocalLedger::anchor(const MerkleAnchor& record, std::string& reference) {
+    if (failures > 0) {
+        failures--;
+        return false;
+    }
+    reference = "local:" + std::to_string(anchored.size());
+    if (!log.empty()) {
+        FILE* f = fopen(log.c_str(), "a");
+        if (!f) return false;
+        fprintf(f, "%s,%s,%llu,%llu,%llu,%u,%s\n", reference.c_str(), record.vehicleId.c_str(),
+                (unsigned long long)record.sequence, (unsigned long long)record.firstEpoch,
+                (unsigned long long)record.lastEpoch, record.leaves, merkleHex(record.root).c_str());
+        bool ok = fclose(f) == 0;
+        if (!ok) return false;
+    }
+    byRoot[record.root] = anchored.size();
+    anchored.push_back(record);
+    return true;
+}
+
+bool LocalLedger::find(const MerkleHash& root, std::string& reference) const {
+    auto it = byRoot.find(root);
+    if (it == byRoot.end()) return false;
+    reference = "local:" + std::to_string(it->second);
+    return true;
+}
+
+MerkleReceipt MerkleBatch::receipt(size_t index) const {
+    MerkleReceipt out;
+    out.anchor = anchor;
+    out.reference = reference;
+    out.index = (uint32_t)index;
+    out.proof = tree.proof(index);
+    return out;
+}
+
+MerkleBatcher::MerkleBatcher(AnchorSink& sink, const MerkleBatcherConfig& config, SealedCallback onSealed)
+    : sink(sink), cfg(config), sealed(std::move(onSealed)) {
+    if (cfg.maxLeaves == 0) cfg.maxLeaves = 1;
+}
+
+void MerkleBatcher::add(const std::string& vehicleId, uint64_t receiveEpoch, const uint8_t* frame, size_t len) {
+    Open& open = batches[vehicleId];
+    if (!open.leaves.empty() && receiveEpoch >= open.opened + cfg.windowSeconds) {
+        seal(vehicleId, open);
+        anchorPending();
+    }
+    if (open.leaves.empty()) {
+        open.opened = receiveEpoch;
+        open.firstEpoch = open.lastEpoch = receiveEpoch;
+    }
+    open.firstEpoch = std::min(open.firstEpoch, receiveEpoch);
+    open.lastEpoch = std::max(open.lastEpoch, receiveEpoch);
+    open.leaves.push_back(merkleLeaf(receiveEpoch, frame, len));
+    open.receiveEpochs.push_back(receiveEpoch);
+    buffered++;
+    if (open.leaves.size() >= cfg.maxLeaves) {
+        seal(vehicleId, open);
+        anchorPending();
+    }
+}
+
+void MerkleBatcher::add(const FrameBatch& batch) {
+    for (size_t i = 0; i < batch.size(); i++) {
+        add(batch.vehicleIds()[batch.frameVehicle(i)], batch.frameTimestamp(i), batch.frame(i),
+            batch.frameLength(i));
+    }
+}
+
+size_t MerkleBatcher::sealDue(uint64_t now) {
+    for (auto& entry : batches) {
+        Open& open = entry.second;
+        if (!open.leaves.empty() && now >= open.opened + cfg.windowSeconds) seal(entry.first, open);
+    }
+    return anchorPending();
+}
+
+size_t MerkleBatcher::sealAll() {
+    for (auto& entry : batches) {
+        if (!entry.second.leaves.empty()) seal(entry.first, entry.second);
+    }
+    return anchorPending();
+}
+
+void MerkleBatcher::seal(const std::string& vehicleId, Open& open) {
+    MerkleBatch batch;
+    batch.anchor.vehicleId = vehicleId;
+    batch.anchor.sequence = open.sequence++;
+    batch.anchor.firstEpoch = open.firstEpoch;
+    batch.anchor.lastEpoch = open.lastEpoch;
+    batch.anchor.leaves = (uint32_t)open.leaves.size();
+    buffered -= open.leaves.size();
+    batch.tree = MerkleTree(std::move(open.leaves));
+    batch.anchor.root = batch.tree.root();
+    batch.receiveEpochs = std::move(open.receiveEpochs);
+    open.leaves.clear();
+    open.receiveEpochs.clear();
+    pending.push_back(std::move(batch));
+}
+
+// In seal order, stopping at the first failure so a vehicle's batches are
+// anchored in sequence
+size_t MerkleBatcher::anchorPending() {
+    size_t done = 0;
+    while (!pending.empty()) {
+        MerkleBatch& batch = pending.front();
+        if (!sink.anchor(batch.anchor, batch.reference)) break;
+        if (sealed) sealed(batch);
+        pending.pop_front();
+        anchored++;
+        done++;
+    }
+    return done;
+}
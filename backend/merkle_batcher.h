@@ -0,0 +1,176 @@
+// merkle_batcher.h - Per-vehicle Merkle batches of uplinked frames for anchoring
+//
+// Instead of one chain transaction per frame, the frames a vehicle sends
+// within a window are collected into a batch and only the batch's SHA-256
+// Merkle root goes on chain, with a compact record of what it covers
+// (MerkleAnchor::payload()). Any single frame is later shown to be part of
+// an anchored batch with a receipt holding its O(log n) inclusion proof.
+//
+//   leaf = SHA256(0x00 || BE64(receiveEpoch) || frame)
+//   node = SHA256(0x01 || left || right)
+//
+// The prefixes keep a leaf from passing as a node. A level with an odd
+// number of nodes promotes its last node unchanged instead of pairing it
+// with itself, so no two leaf lists share a root and a proof of a batch of n
+// frames has at most ceil(log2 n) hashes.
+//
+// The chain is behind AnchorSink; LocalLedger stands in for it in tests, in
+// benchmarks and in bbanchor.
+#ifndef BACKEND_MERKLE_BATCHER_H
+#define BACKEND_MERKLE_BATCHER_H
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "frame_decoder.h"
+
+using MerkleHash = std::array<uint8_t, 32>;
+
+MerkleHash merkleLeaf(uint64_t receiveEpoch, const uint8_t* frame, size_t len);
+MerkleHash merkleNode(const MerkleHash& left, const MerkleHash& right);
+std::string merkleHex(const MerkleHash& hash);
+
+class MerkleTree {
+public:
+    // An empty tree's root is SHA256 of nothing
+    explicit MerkleTree(std::vector<MerkleHash> leaves = {});
+
+    size_t size() const { return leafCount; }
+    const MerkleHash& leaf(size_t index) const { return nodes[index]; }
+    const MerkleHash& root() const { return nodes.back(); }
+
+    // Sibling hashes from the leaf up; levels where the node is promoted
+    // have none
+    std::vector<MerkleHash> proof(size_t index) const;
+    static bool verify(const MerkleHash& leaf, size_t index, size_t count, const std::vector<MerkleHash>& proof,
+                       const MerkleHash& root);
+
+private:
+    size_t leafCount;
+    std::vector<MerkleHash> nodes;  // every level, leaves first, root last
+};
+
+// What gets anchored for one batch
+struct MerkleAnchor {
+    std::string vehicleId;
+    uint64_t sequence;    // per vehicle, from 0
+    uint64_t firstEpoch;  // receive time of the oldest frame
+    uint64_t lastEpoch;   // and of the newest
+    uint32_t leaves;
+    MerkleHash root;
+
+    // The record sent on chain, without the vehicle id (the transaction
+    // carries it): 'M' | version 1 | root | BE32 leaves | BE64 sequence |
+    // BE64 firstEpoch | BE64 lastEpoch
+    static constexpr size_t RECORD_SIZE = 62;
+    std::array<uint8_t, RECORD_SIZE> payload() const;
+};
+
+// Everything an auditor needs to check one frame against the chain
+struct MerkleReceipt {
+    MerkleAnchor anchor;
+    std::string reference;  // returned by the sink, e.g. the transaction hash
+    uint32_t index;
+    std::vector<MerkleHash> proof;
+
+    bool verify(uint64_t receiveEpoch, const uint8_t* frame, size_t len) const;
+};
+
+// The chain side. anchor() returns false when the record did not make it;
+// the batch is then retried on the next seal.
+class AnchorSink {
+public:
+    virtual ~AnchorSink() = default;
+    virtual bool anchor(const MerkleAnchor& record, std::string& reference) = 0;
+};
+
+// In-memory stand-in for the chain, optionally appending every record to a
+// text file (one "reference,vehicleId,sequence,first,last,leaves,rootHex"
+// line each). References are "local:<n>".
+class LocalLedger : public AnchorSink {
+public:
+    explicit LocalLedger(const std::string& logPath = "");
+
+    bool anchor(const MerkleAnchor& record, std::string& reference) override;
+
+    // The reference a root was anchored under; false if it never was
+    bool find(const MerkleHash& root, std::string& reference) const;
+    const std::vector<MerkleAnchor>& records() const { return anchored; }
+
+    // The next `count` anchor() calls fail, like an unreachable node
+    void failNext(size_t count) { failures = count; }
+
+private:
+    std::string log;
+    std::vector<MerkleAnchor> anchored;
+    std::map<MerkleHash, size_t> byRoot;
+    size_t failures = 0;
+};
+
+struct MerkleBatcherConfig {
+    uint32_t windowSeconds = 300;  // a batch is sealed this long after its first frame
+    uint32_t maxLeaves = 1 << 16;  // or when it holds this many frames
+};
+
+// A sealed and anchored batch, handed to the onSealed callback
+struct MerkleBatch {
+    MerkleAnchor anchor;
+    std::string reference;
+    MerkleTree tree;
+    std::vector<uint64_t> receiveEpochs;  // per leaf
+
+    MerkleReceipt receipt(size_t index) const;
+};
+
+// Collects frames per vehicle and anchors one root per window. Windows are
+// in receive time: a vehicle's batch opens at its first frame and is sealed
+// by the first later frame (or sealDue() call) at least windowSeconds on.
+// Not thread-safe.
+class MerkleBatcher {
+public:
+    using SealedCallback = std::function<void(const MerkleBatch& batch)>;
+
+    explicit MerkleBatcher(AnchorSink& sink, const MerkleBatcherConfig& config = {},
+                           SealedCallback onSealed = nullptr);
+
+    void add(const std::string& vehicleId, uint64_t receiveEpoch, const uint8_t* frame, size_t len);
+    // Every frame of a batch, as bbdecode reads them
+    void add(const FrameBatch& batch);
+
+    // Seals the batches whose window has ended by now, then anchors every
+    // sealed batch not anchored yet. Returns the batches anchored.
+    size_t sealDue(uint64_t now);
+    // The same for every open batch, e.g. at shutdown
+    size_t sealAll();
+
+    size_t openFrames() const { return buffered; }
+    size_t pendingBatches() const { return pending.size(); }  // sealed, not yet anchored
+    uint64_t anchoredBatches() const { return anchored; }
+
+private:
+    struct Open {
+        uint64_t sequence = 0;
+        uint64_t opened = 0;
+        uint64_t firstEpoch = 0, lastEpoch = 0;
+        std::vector<MerkleHash> leaves;
+        std::vector<uint64_t> receiveEpochs;
+    };
+
+    void seal(const std::string& vehicleId, Open& open);
+    size_t anchorPending();
+
+    AnchorSink& sink;
+    MerkleBatcherConfig cfg;
+    SealedCallback sealed;
+    std::unordered_map<std::string, Open> batches;
+    std::deque<MerkleBatch> pending;
+    size_t buffered = 0;
+    uint64_t anchored = 0;
+};
+
+#endif
@@ -0,0 +1,142 @@
+// sha256.cpp - SHA-256: SHA extensions with a portable fallback
+#include "sha256.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BLACKBOX_HAVE_SHANI 1
+#endif
+
+namespace {
+
+alignas(16) const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+const uint32_t IV[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+inline uint32_t loadBE(const uint8_t* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+void compressPortable(uint32_t h[8], const uint8_t* data, size_t blocks) {
+    for (; blocks > 0; blocks--, data += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) w[i] = loadBE(data + 4 * i);
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = k + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K256[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            k = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+        h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+    }
+}
+
+#ifdef BLACKBOX_HAVE_SHANI
+// The state is kept as ABEF/CDGH pairs, the layout sha256rnds2 works on;
+// each group of four rounds extends the message schedule by four words
+__attribute__((target("sha,sse4.1")))
+void compressShaNi(uint32_t h[8], const uint8_t* data, size_t blocks) {
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i cdab = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&h[0]), 0xB1);
+    __m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&h[4]), 0x1B);
+    __m128i abef = _mm_alignr_epi8(cdab, efgh, 8);
+    __m128i cdgh = _mm_blend_epi16(efgh, cdab, 0xF0);
+
+    for (; blocks > 0; blocks--, data += 64) {
+        const __m128i abefSaved = abef, cdghSaved = cdgh;
+        __m128i w[4];
+#pragma GCC unroll 16
+        for (int i = 0; i < 16; i++) {
+            __m128i& wi = w[i & 3];
+            if (i < 4) {
+                wi = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16 * i)), byteSwap);
+            } else {
+                // w[i & 3] still holds the words of group i - 4
+                __m128i prev = w[(i + 3) & 3];
+                wi = _mm_add_epi32(_mm_sha256msg1_epu32(wi, w[(i + 1) & 3]),
+                                   _mm_alignr_epi8(prev, w[(i + 2) & 3], 4));
+                wi = _mm_sha256msg2_epu32(wi, prev);
+            }
+            __m128i msg = _mm_add_epi32(wi, _mm_load_si128((const __m128i*)&K256[4 * i]));
+            cdgh = _mm_sha256rnds2_epu32(cdgh, abef, msg);
+            abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(msg, 0x0E));
+        }
+        abef = _mm_add_epi32(abef, abefSaved);
+        cdgh = _mm_add_epi32(cdgh, cdghSaved);
+    }
+
+    __m128i feba = _mm_shuffle_epi32(abef, 0x1B);
+    __m128i dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+    _mm_storeu_si128((__m128i*)&h[0], _mm_blend_epi16(feba, dchg, 0xF0));
+    _mm_storeu_si128((__m128i*)&h[4], _mm_alignr_epi8(dchg, feba, 8));
+}
+
+bool detectShaNi() { return __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1"); }
+#else
+bool detectShaNi() { return false; }
+#endif
+
+bool usePortable = !detectShaNi();
+
+void compress(uint32_t h[8], const uint8_t* data, size_t blocks) {
+#ifdef BLACKBOX_HAVE_SHANI
+    if (!usePortable) {
+        compressShaNi(h, data, blocks);
+        return;
+    }
+#endif
+    compressPortable(h, data, blocks);
+}
+
+}  // namespace
+
+namespace sha256 {
+
+void digest(const uint8_t* data, size_t len, uint8_t* out32) {
+    uint32_t h[8];
+    memcpy(h, IV, sizeof(h));
+    size_t whole = len / 64;
+    if (whole) compress(h, data, whole);
+
+    // The rest, 0x80, zeros and the bit length fill one or two blocks
+    uint8_t tail[128] = {0};
+    size_t rest = len - whole * 64;
+    if (rest) memcpy(tail, data + whole * 64, rest);
+    tail[rest] = 0x80;
+    size_t tailBlocks = rest < 56 ? 1 : 2;
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 0; i < 8; i++) tail[tailBlocks * 64 - 1 - i] = (uint8_t)(bits >> (8 * i));
+    compress(h, tail, tailBlocks);
+
+    for (int i = 0; i < 8; i++) {
+        out32[4 * i] = (uint8_t)(h[i] >> 24);
+        out32[4 * i + 1] = (uint8_t)(h[i] >> 16);
+        out32[4 * i + 2] = (uint8_t)(h[i] >> 8);
+        out32[4 * i + 3] = (uint8_t)h[i];
+    }
+}
+
+bool hardwareAccelerated() { return !usePortable; }
+
+void forcePortable(bool portable) { usePortable = portable || !detectShaNi(); }
+
+}  // namespace sha256
@@ -0,0 +1,23 @@
+// sha256.h - One-shot SHA-256 for bulk hashing of short messages
+//
+// Uses the SHA extensions when the CPU has them (checked once at runtime)
+// and a portable implementation otherwise. The digests are those of
+// hal::sha256; this is the fast path for the Merkle trees, where every node
+// is a 65-byte message.
+#ifndef BACKEND_SHA256_H
+#define BACKEND_SHA256_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sha256 {
+
+void digest(const uint8_t* data, size_t len, uint8_t* out32);
+
+bool hardwareAccelerated();
+// Forces the portable path (tests, benchmarks)
+void forcePortable(bool portable);
+
+}  // namespace sha256
+
+#endif
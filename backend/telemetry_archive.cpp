@@ -0,0 +1,605 @@
+// telemetry_archive.cpp - Column files, block stats and vectorised range scans
+#include "telemetry_archive.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+namespace fs = std::filesystem;
+
+enum class Type : uint8_t { I8, U16, I32, U32 };
+
+struct ColumnInfo {
+    const char* name;  // as in the bbdecode CSV header
+    const char* file;
+    Type type;
+    uint8_t width;
+};
+
+const ColumnInfo COLUMNS[ARCHIVE_COLUMNS] = {
+    {"timestamp", "ts.u32", Type::U32, 4},      {"counter", "counter.u32", Type::U32, 4},
+    {"temperature", "temp.i8", Type::I8, 1},    {"gyro_x", "gyro_x.i8", Type::I8, 1},
+    {"gyro_y", "gyro_y.i8", Type::I8, 1},       {"gyro_z", "gyro_z.i8", Type::I8, 1},
+    {"accel_peak", "accel.u16", Type::U16, 2},  {"accel_rms", "accel_rms.u16", Type::U16, 2},
+    {"jerk", "jerk.u16", Type::U16, 2},         {"lat", "lat.i32", Type::I32, 4},
+    {"lon", "lon.i32", Type::I32, 4},
+};
+constexpr size_t TS = (size_t)ArchiveColumn::Timestamp;
+
+constexpr char INDEX_FILE[] = "blocks.idx";
+constexpr char MAGIC[4] = {'B', 'B', 'T', 'A'};
+constexpr uint32_t VERSION = 1;
+// Writers keep a descriptor per column; past this many partitions they are all closed
+constexpr size_t MAX_OPEN_WRITERS = 64;
+
+struct IndexHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t blockRows;
+    uint32_t columns;
+};
+
+struct BlockStats {
+    int64_t min[ARCHIVE_COLUMNS];
+    int64_t max[ARCHIVE_COLUMNS];
+};
+
+bool validVehicleId(const std::string& id) {
+    return !id.empty() && id != "." && id != ".." && id.find('/') == std::string::npos &&
+           id.find('\0') == std::string::npos;
+}
+
+std::string partitionPath(const std::string& root, const std::string& vehicleId, uint64_t dayEpoch) {
+    return root + "/" + vehicleId + "/" + std::to_string(dayEpoch);
+}
+
+// v - d without wrapping past the int64_t limits, for d >= 0
+int64_t minusSaturating(int64_t v, int64_t d) {
+    return v < std::numeric_limits<int64_t>::min() + d ? std::numeric_limits<int64_t>::min() : v - d;
+}
+
+int64_t valueOf(const ArchivedFrame& f, uint64_t dayEpoch, size_t column) {
+    switch ((ArchiveColumn)column) {
+        case ArchiveColumn::Timestamp: return (int64_t)(f.timestamp - dayEpoch);
+        case ArchiveColumn::Counter: return f.counter;
+        case ArchiveColumn::Temperature: return f.temperature;
+        case ArchiveColumn::GyroX: return f.gyro[0];
+        case ArchiveColumn::GyroY: return f.gyro[1];
+        case ArchiveColumn::GyroZ: return f.gyro[2];
+        case ArchiveColumn::Accel: return f.accel;
+        case ArchiveColumn::AccelRms: return f.accelRms;
+        case ArchiveColumn::Jerk: return f.jerk;
+        case ArchiveColumn::Lat: return f.lat;
+        case ArchiveColumn::Lon: return f.lon;
+    }
+    return 0;
+}
+
+void setValue(ArchivedFrame& f, uint64_t dayEpoch, size_t column, int64_t v) {
+    switch ((ArchiveColumn)column) {
+        case ArchiveColumn::Timestamp: f.timestamp = dayEpoch + (uint64_t)v; break;
+        case ArchiveColumn::Counter: f.counter = (uint32_t)v; break;
+        case ArchiveColumn::Temperature: f.temperature = (int8_t)v; break;
+        case ArchiveColumn::GyroX: f.gyro[0] = (int8_t)v; break;
+        case ArchiveColumn::GyroY: f.gyro[1] = (int8_t)v; break;
+        case ArchiveColumn::GyroZ: f.gyro[2] = (int8_t)v; break;
+        case ArchiveColumn::Accel: f.accel = (uint16_t)v; break;
+        case ArchiveColumn::AccelRms: f.accelRms = (uint16_t)v; break;
+        case ArchiveColumn::Jerk: f.jerk = (uint16_t)v; break;
+        case ArchiveColumn::Lat: f.lat = (int32_t)v; break;
+        case ArchiveColumn::Lon: f.lon = (int32_t)v; break;
+    }
+}
+
+template <typename T>
+void storeAs(uint8_t* p, int64_t v) {
+    T t = (T)v;
+    memcpy(p, &t, sizeof(T));
+}
+
+void store(uint8_t* p, Type type, int64_t v) {
+    switch (type) {
+        case Type::I8: storeAs<int8_t>(p, v); break;
+        case Type::U16: storeAs<uint16_t>(p, v); break;
+        case Type::I32: storeAs<int32_t>(p, v); break;
+        case Type::U32: storeAs<uint32_t>(p, v); break;
+    }
+}
+
+template <typename T>
+int64_t loadAs(const uint8_t* p) {
+    T t;
+    memcpy(&t, p, sizeof(T));
+    return t;
+}
+
+int64_t load(const uint8_t* p, Type type) {
+    switch (type) {
+        case Type::I8: return loadAs<int8_t>(p);
+        case Type::U16: return loadAs<uint16_t>(p);
+        case Type::I32: return loadAs<int32_t>(p);
+        case Type::U32: return loadAs<uint32_t>(p);
+    }
+    return 0;
+}
+
+template <typename T>
+void minMaxAs(const uint8_t* values, size_t n, int64_t& lo, int64_t& hi) {
+    const T* v = reinterpret_cast<const T*>(values);
+    T l = v[0], h = v[0];
+    for (size_t i = 1; i < n; i++) {
+        l = std::min(l, v[i]);
+        h = std::max(h, v[i]);
+    }
+    lo = l;
+    hi = h;
+}
+
+void minMax(const uint8_t* values, Type type, size_t n, int64_t& lo, int64_t& hi) {
+    switch (type) {
+        case Type::I8: minMaxAs<int8_t>(values, n, lo, hi); break;
+        case Type::U16: minMaxAs<uint16_t>(values, n, lo, hi); break;
+        case Type::I32: minMaxAs<int32_t>(values, n, lo, hi); break;
+        case Type::U32: minMaxAs<uint32_t>(values, n, lo, hi); break;
+    }
+}
+
+// mask[i] stays 1 only where lo <= values[i] <= hi. No branches in the loop,
+// so it runs a vector register of rows at a time.
+template <typename T>
+void keepRangeAs(const uint8_t* values, size_t n, int64_t lo, int64_t hi, uint8_t* mask) {
+    constexpr int64_t tmin = std::numeric_limits<T>::min(), tmax = std::numeric_limits<T>::max();
+    if (lo > tmax || hi < tmin || lo > hi) {
+        memset(mask, 0, n);
+        return;
+    }
+    const T* v = reinterpret_cast<const T*>(values);
+    const T l = (T)std::max(lo, tmin), h = (T)std::min(hi, tmax);
+    for (size_t i = 0; i < n; i++) mask[i] &= (uint8_t)((v[i] >= l) & (v[i] <= h));
+}
+
+void keepRange(const uint8_t* values, Type type, size_t n, int64_t lo, int64_t hi, uint8_t* mask) {
+    switch (type) {
+        case Type::I8: keepRangeAs<int8_t>(values, n, lo, hi, mask); break;
+        case Type::U16: keepRangeAs<uint16_t>(values, n, lo, hi, mask); break;
+        case Type::I32: keepRangeAs<int32_t>(values, n, lo, hi, mask); break;
+        case Type::U32: keepRangeAs<uint32_t>(values, n, lo, hi, mask); break;
+    }
+}
+
+size_t countMask(const uint8_t* mask, size_t n) {
+    uint32_t count = 0;
+    for (size_t i = 0; i < n; i++) count += mask[i];
+    return count;
+}
+
+bool writeAll(int fd, const void* data, size_t len) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    while (len > 0) {
+        ssize_t n = ::write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+bool readAll(int fd, void* data, size_t len, uint64_t offset) {
+    uint8_t* p = static_cast<uint8_t*>(data);
+    while (len > 0) {
+        ssize_t n = ::pread(fd, p, len, (off_t)offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return true;
+}
+
+uint64_t fileSize(const std::string& path) {
+    struct stat st;
+    return ::stat(path.c_str(), &st) == 0 ? (uint64_t)st.st_size : 0;
+}
+
+// Read-only mapping of a whole file; an empty or missing file maps to nothing
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile() {
+        if (base) munmap(base, length);
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool map(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0;
+        if (ok && st.st_size > 0) {
+            void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            ok = p != MAP_FAILED;
+            if (ok) {
+                base = p;
+                length = (size_t)st.st_size;
+                // Scans read a column front to back
+                madvise(base, length, MADV_SEQUENTIAL);
+            }
+        }
+        ::close(fd);
+        return ok;
+    }
+
+    const uint8_t* data() const { return static_cast<const uint8_t*>(base); }
+    size_t size() const { return length; }
+
+private:
+    void* base = nullptr;
+    size_t length = 0;
+};
+
+}  // namespace
+
+const char* archiveColumnName(ArchiveColumn column) {
+    return (size_t)column < ARCHIVE_COLUMNS ? COLUMNS[(size_t)column].name : "unknown";
+}
+
+bool archiveColumnByName(const std::string& name, ArchiveColumn& column) {
+    for (size_t c = 0; c < ARCHIVE_COLUMNS; c++) {
+        if (name == COLUMNS[c].name) {
+            column = (ArchiveColumn)c;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Appends to one partition; the rows of the unfinished block stay in memory
+// too, for its stats
+struct TelemetryArchive::Writer {
+    std::string path;
+    uint64_t dayEpoch;
+    int fds[ARCHIVE_COLUMNS];
+    int indexFd = -1;
+    std::vector<uint8_t> block[ARCHIVE_COLUMNS];
+    uint32_t buffered = 0;  // rows of the current block
+    uint32_t flushed = 0;   // of which already in the column files
+    bool wrote = false;     // since the archive last dropped the partition's mapping
+
+    Writer(std::string path, uint64_t dayEpoch) : path(std::move(path)), dayEpoch(dayEpoch) {
+        std::fill(std::begin(fds), std::end(fds), -1);
+        for (size_t c = 0; c < ARCHIVE_COLUMNS; c++) block[c].resize((size_t)BLOCK_ROWS * COLUMNS[c].width);
+    }
+
+    ~Writer() {
+        for (int fd : fds) {
+            if (fd >= 0) ::close(fd);
+        }
+        if (indexFd >= 0) ::close(indexFd);
+    }
+
+    // Opens (or creates) the partition and picks up where the files end
+    bool open() {
+        std::error_code ec;
+        fs::create_directories(path, ec);
+        if (ec) return false;
+        uint64_t rows = UINT64_MAX;
+        for (size_t c = 0; c < ARCHIVE_COLUMNS; c++) {
+            fds[c] = ::open((path + "/" + COLUMNS[c].file).c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (fds[c] < 0) return false;
+            struct stat st;
+            if (fstat(fds[c], &st) != 0) return false;
+            rows = std::min(rows, (uint64_t)st.st_size / COLUMNS[c].width);
+        }
+        // A torn append leaves some columns longer than others
+        for (size_t c = 0; c < ARCHIVE_COLUMNS; c++) {
+            if (ftruncate(fds[c], (off_t)(rows * COLUMNS[c].width)) != 0) return false;
+        }
+
+        indexFd = ::open((path + "/" + INDEX_FILE).c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (indexFd < 0) return false;
+        struct stat st;
+        if (fstat(indexFd, &st) != 0) return false;
+        uint64_t blocks = 0;
+        if ((uint64_t)st.st_size < sizeof(IndexHeader)) {
+            IndexHeader header{{MAGIC[0], MAGIC[1], MAGIC[2], MAGIC[3]}, VERSION, BLOCK_ROWS, ARCHIVE_COLUMNS};
+            if (ftruncate(indexFd, 0) != 0 || !writeAll(indexFd, &header, sizeof(header))) return false;
+        } else {
+            IndexHeader header;
+            if (!readAll(indexFd, &header, sizeof(header), 0) || memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+                header.version != VERSION || header.blockRows != BLOCK_ROWS || header.columns != ARCHIVE_COLUMNS) {
+                return false;
+            }
+            blocks = std::min(((uint64_t)st.st_size - sizeof(IndexHeader)) / sizeof(BlockStats), rows / BLOCK_ROWS);
+            if (ftruncate(indexFd, (off_t)(sizeof(IndexHeader) + blocks * sizeof(BlockStats))) != 0) return false;
+        }
+
+        // Stats of complete blocks written before a crash, then the open block
+        for (uint64_t first = blocks * BLOCK_ROWS; first < rows; first += BLOCK_ROWS) {
+            uint32_t n = (uint32_t)std::min<uint64_t>(BLOCK_ROWS, rows - first);
+            for (size_t c = 0; c < ARCHIVE_COLUMNS; c++) {
+                if (!readAll(fds[c], block[c].data(), (size_t)n * COLUMNS[c].width, first * COLUMNS[c].width)) {
+                    return false;
+                }
+            }
+            buffered = flushed = n;
+            if (n == BLOCK_ROWS && !finishBlock()) return false;
+        }
+        return true;
+    }
+
+    bool add(const ArchivedFrame& f) {
+        for (size_t c = 0; c < ARCHIVE_COLUMNS; c++) {
+            store(block[c].data() + (size_t)buffered * COLUMNS[c].width, COLUMNS[c].type, valueOf(f, dayEpoch, c));
+        }
+        return ++buffered < BLOCK_ROWS || (flush() && finishBlock());
+    }
+
+    bool flush() {
+        if (flushed == buffered) return true;
+        for (size_t c = 0; c < ARCHIVE_COLUMNS; c++) {
+            const size_t w = COLUMNS[c].width;
+            if (!writeAll(fds[c], block[c].data() + flushed * w, (buffered - flushed) * w)) return false;
+        }
+        flushed = buffered;
+        wrote = true;
+        return true;
+    }
+
+    // The block is in the column files: its stats make it visible to the index
+    bool finishBlock() {
+        BlockStats stats;
+        for (size_t c = 0; c < ARCHIVE_COLUMNS; c++) {
+            minMax(block[c].data(), COLUMNS[c].type, BLOCK_ROWS, stats.min[c], stats.max[c]);
+        }
+        buffered = flushed = 0;
+        wrote = true;
+        return writeAll(indexFd, &stats, sizeof(stats));
+    }
+};
+
+// A partition mapped for queries; columns are mapped when first needed
+struct TelemetryArchive::Partition {
+    std::string path;
+    uint64_t dayEpoch = 0;
+    uint64_t rows = 0;
+    MappedFile index;
+    const BlockStats* blocks = nullptr;
+    uint64_t blockCount = 0;
+    bool sorted = true;  // blocks in time order: the time index can binary search
+    MappedFile columns[ARCHIVE_COLUMNS];
+    bool mapped[ARCHIVE_COLUMNS] = {};
+
+    bool load() {
+        rows = UINT64_MAX;
+        for (size_t c = 0; c < ARCHIVE_COLUMNS; c++) {
+            rows = std::min(rows, fileSize(path + "/" + COLUMNS[c].file) / COLUMNS[c].width);
+        }
+        if (!index.map(path + "/" + INDEX_FILE) || index.size() < sizeof(IndexHeader)) return false;
+        IndexHeader header;
+        memcpy(&header, index.data(), sizeof(header));
+        if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+            header.blockRows != BLOCK_ROWS || header.columns != ARCHIVE_COLUMNS) {
+            return false;
+        }
+        blocks = reinterpret_cast<const BlockStats*>(index.data() + sizeof(IndexHeader));
+        blockCount = std::min((index.size() - sizeof(IndexHeader)) / sizeof(BlockStats), rows / BLOCK_ROWS);
+        for (uint64_t b = 1; b < blockCount && sorted; b++) sorted = blocks[b].min[TS] >= blocks[b - 1].max[TS];
+        return true;
+    }
+
+    const uint8_t* column(size_t c) {
+        if (!mapped[c]) {
+            if (!columns[c].map(path + "/" + COLUMNS[c].file)) return nullptr;
+            mapped[c] = true;
+        }
+        return columns[c].size() >= rows * COLUMNS[c].width ? columns[c].data() : nullptr;
+    }
+};
+
+TelemetryArchive::TelemetryArchive(const std::string& root) : dir(root) {}
+
+TelemetryArchive::~TelemetryArchive() { flush(); }
+
+TelemetryArchive::Writer* TelemetryArchive::writerFor(const std::string& vehicleId, uint64_t dayEpoch) {
+    std::string path = partitionPath(dir, vehicleId, dayEpoch);
+    auto it = writers.find(path);
+    if (it != writers.end()) return it->second.get();
+    if (writers.size() >= MAX_OPEN_WRITERS) {
+        flush();
+        writers.clear();
+    }
+    auto writer = std::make_unique<Writer>(path, dayEpoch);
+    if (!writer->open()) return nullptr;
+    partitions.erase(path);
+    return writers.emplace(path, std::move(writer)).first->second.get();
+}
+
+bool TelemetryArchive::append(const std::string& vehicleId, const ArchivedFrame& frame) {
+    if (!validVehicleId(vehicleId)) return false;
+    Writer* writer = writerFor(vehicleId, frame.timestamp / SECONDS_PER_DAY * SECONDS_PER_DAY);
+    return writer && writer->add(frame);
+}
+
+size_t TelemetryArchive::append(const FrameBatch& batch, const std::vector<DecodedFrame>& frames) {
+    size_t added = 0;
+    for (const DecodedFrame& f : frames) {
+        if (f.status != FrameStatus::Ok) continue;
+        ArchivedFrame row;
+        static_cast<SensorReading&>(row) = f;
+        row.timestamp = f.timestamp;
+        row.counter = f.counter;
+        added += append(batch.vehicleIds()[f.vehicle], row);
+    }
+    return added;
+}
+
+bool TelemetryArchive::flush() {
+    bool ok = true;
+    for (auto& entry : writers) {
+        Writer& writer = *entry.second;
+        ok &= writer.flush();
+        if (writer.wrote) {
+            partitions.erase(entry.first);
+            writer.wrote = false;
+        }
+    }
+    return ok;
+}
+
+std::vector<std::string> TelemetryArchive::vehicles() const {
+    std::vector<std::string> ids;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(dir, ec)) {
+        if (entry.is_directory(ec)) ids.push_back(entry.path().filename().string());
+    }
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+TelemetryArchive::Partition* TelemetryArchive::partition(const std::string& vehicleId, uint64_t dayEpoch) {
+    std::string path = partitionPath(dir, vehicleId, dayEpoch);
+    auto it = partitions.find(path);
+    if (it != partitions.end()) return it->second.get();
+    auto p = std::make_unique<Partition>();
+    p->path = path;
+    p->dayEpoch = dayEpoch;
+    if (!p->load()) return nullptr;
+    return partitions.emplace(path, std::move(p)).first->second.get();
+}
+
+ArchiveScanStats TelemetryArchive::scan(const ArchiveQuery& query, const ArchiveVisitor& visit) {
+    return run(query, &visit);
+}
+
+ArchiveScanStats TelemetryArchive::count(const ArchiveQuery& query) { return run(query, nullptr); }
+
+ArchiveScanStats TelemetryArchive::run(const ArchiveQuery& query, const ArchiveVisitor* visit) {
+    flush();
+    ArchiveScanStats stats;
+    if (query.from >= query.to) return stats;
+    const uint64_t firstDay = query.from / SECONDS_PER_DAY * SECONDS_PER_DAY;
+    const uint64_t lastDay = (query.to - 1) / SECONDS_PER_DAY * SECONDS_PER_DAY;
+
+    alignas(64) uint8_t mask[BLOCK_ROWS];
+    for (const std::string& vehicleId : query.vehicles.empty() ? vehicles() : query.vehicles) {
+        if (!validVehicleId(vehicleId)) continue;
+        std::vector<uint64_t> days;
+        std::error_code ec;
+        for (const auto& entry : fs::directory_iterator(dir + "/" + vehicleId, ec)) {
+            std::string name = entry.path().filename().string();
+            char* end;
+            uint64_t day = strtoull(name.c_str(), &end, 10);
+            if (*end == '\0' && !name.empty() && day >= firstDay && day <= lastDay) days.push_back(day);
+        }
+        std::sort(days.begin(), days.end());
+
+        for (uint64_t day : days) {
+            Partition* p = partition(vehicleId, day);
+            if (!p) continue;
+            stats.partitions++;
+            stats.blocks += p->blockCount;
+
+            // The query in the partition's terms: ts counts from the day
+            int64_t lo[ARCHIVE_COLUMNS], hi[ARCHIVE_COLUMNS];
+            bool constrained[ARCHIVE_COLUMNS] = {};
+            std::fill(std::begin(lo), std::end(lo), std::numeric_limits<int64_t>::min());
+            std::fill(std::begin(hi), std::end(hi), std::numeric_limits<int64_t>::max());
+            lo[TS] = query.from > day ? (int64_t)(query.from - day) : 0;
+            hi[TS] = (int64_t)std::min<uint64_t>(query.to - 1 - day, SECONDS_PER_DAY);
+            constrained[TS] = lo[TS] > 0 || hi[TS] < (int64_t)SECONDS_PER_DAY - 1;
+            for (const ArchiveFilter& f : query.filters) {
+                size_t c = (size_t)f.column;
+                if (c >= ARCHIVE_COLUMNS) continue;
+                // Timestamps filter in epoch seconds
+                const int64_t shift = c == TS ? (int64_t)day : 0;
+                lo[c] = std::max(lo[c], minusSaturating(f.min, shift));
+                hi[c] = std::min(hi[c], minusSaturating(f.max, shift));
+                constrained[c] = true;
+            }
+            bool empty = false;
+            for (size_t c = 0; c < ARCHIVE_COLUMNS; c++) empty |= lo[c] > hi[c];
+            if (empty) {
+                stats.blocksSkipped += p->blockCount;
+                continue;
+            }
+
+            // Every column the query reads, and every column a visit reads
+            const uint8_t* cols[ARCHIVE_COLUMNS] = {};
+            bool usable = true;
+            for (size_t c = 0; c < ARCHIVE_COLUMNS; c++) {
+                if (constrained[c] || visit) usable &= (cols[c] = p->column(c)) != nullptr;
+            }
+            if (!usable) continue;
+
+            auto visitRows = [&](uint64_t first, size_t n) {
+                if (!visit) return;
+                ArchivedFrame frame;
+                for (size_t i = 0; i < n; i++) {
+                    if (!mask[i]) continue;
+                    for (size_t c = 0; c < ARCHIVE_COLUMNS; c++) {
+                        const size_t w = COLUMNS[c].width;
+                        setValue(frame, day, c, load(cols[c] + (first + i) * w, COLUMNS[c].type));
+                    }
+                    (*visit)(vehicleId, frame);
+                }
+            };
+            auto scanRows = [&](uint64_t first, size_t n) {
+                memset(mask, 1, n);
+                for (size_t c = 0; c < ARCHIVE_COLUMNS; c++) {
+                    if (!constrained[c]) continue;
+                    keepRange(cols[c] + first * COLUMNS[c].width, COLUMNS[c].type, n, lo[c], hi[c], mask);
+                }
+                stats.rowsScanned += n;
+                stats.rowsMatched += countMask(mask, n);
+                visitRows(first, n);
+            };
+
+            // Time index: in a time-ordered partition the blocks of the range are contiguous
+            uint64_t begin = 0, end = p->blockCount;
+            if (p->sorted && constrained[TS]) {
+                const BlockStats* b = p->blocks;
+                begin = std::partition_point(b, b + end, [&](const BlockStats& s) { return s.max[TS] < lo[TS]; }) - b;
+                end = std::partition_point(b + begin, b + end, [&](const BlockStats& s) { return s.min[TS] <= hi[TS]; }) - b;
+                stats.blocksSkipped += begin + (p->blockCount - end);
+            }
+            for (uint64_t b = begin; b < end; b++) {
+                const BlockStats& s = p->blocks[b];
+                bool skip = false, whole = true;
+                for (size_t c = 0; c < ARCHIVE_COLUMNS; c++) {
+                    if (!constrained[c]) continue;
+                    skip |= s.max[c] < lo[c] || s.min[c] > hi[c];
+                    whole &= s.min[c] >= lo[c] && s.max[c] <= hi[c];
+                }
+                if (skip) {
+                    stats.blocksSkipped++;
+                } else if (whole) {
+                    stats.blocksWhole++;
+                    stats.rowsMatched += BLOCK_ROWS;
+                    if (visit) {
+                        memset(mask, 1, BLOCK_ROWS);
+                        visitRows(b * BLOCK_ROWS, BLOCK_ROWS);
+                    }
+                } else {
+                    scanRows(b * BLOCK_ROWS, BLOCK_ROWS);
+                }
+            }
+            // Rows after the last complete block have no stats
+            for (uint64_t first = p->blockCount * BLOCK_ROWS; first < p->rows; first += BLOCK_ROWS) {
+                scanRows(first, (size_t)std::min<uint64_t>(BLOCK_ROWS, p->rows - first));
+            }
+        }
+    }
+    return stats;
+}
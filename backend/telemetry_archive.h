@@ -0,0 +1,126 @@
+// telemetry_archive.h - Columnar, memory-mapped archive of decoded frames
+//
+// Frames are stored per (vehicle, receive day) in a partition directory
+//
+//   <root>/<vehicleId>/<dayEpoch>/ts.u32 counter.u32 temp.i8 ... lon.i32 blocks.idx
+//
+// with one file per column: a bare little-endian array, one value per row,
+// rows in append order (ts is seconds since dayEpoch). Rows are grouped in
+// blocks of BLOCK_ROWS; blocks.idx holds the min and max of every column of
+// every complete block. The min/max of ts form the sparse time index: when
+// the blocks of a partition are in time order a time range is found by binary
+// search, otherwise block by block. The rows after the last complete block
+// have no stats yet and are always scanned.
+//
+// Queries map the column files read-only and visit the partitions of the
+// requested vehicles and days. A block whose stats are outside the query is
+// skipped without touching its rows; one entirely inside it counts without
+// reading them. Only the other blocks are scanned, a column at a time, with
+// branch-free range checks over the whole block that the compiler vectorises.
+//
+// Appending only ever adds to the end of the files. A row is in the column
+// files once flush() ran or its block completed; reopening after a crash
+// truncates every column to the shortest and rebuilds missing block stats.
+// Not thread-safe.
+#ifndef BACKEND_TELEMETRY_ARCHIVE_H
+#define BACKEND_TELEMETRY_ARCHIVE_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "frame_decoder.h"
+
+enum class ArchiveColumn : uint8_t {
+    Timestamp,  // receive time, epoch seconds
+    Counter,
+    Temperature,
+    GyroX,
+    GyroY,
+    GyroZ,
+    Accel,
+    AccelRms,
+    Jerk,
+    Lat,
+    Lon,
+};
+constexpr size_t ARCHIVE_COLUMNS = 11;
+
+const char* archiveColumnName(ArchiveColumn column);
+// By name as in archiveColumnName(); false if there is none
+bool archiveColumnByName(const std::string& name, ArchiveColumn& column);
+
+// Sensor fields come from SensorReading (frame_layout.h)
+struct ArchivedFrame : SensorReading {
+    uint64_t timestamp;
+    uint32_t counter;
+};
+
+// min <= column <= max, in the column's on-air units
+struct ArchiveFilter {
+    ArchiveColumn column;
+    int64_t min;
+    int64_t max;
+};
+
+struct ArchiveQuery {
+    std::vector<std::string> vehicles;  // empty: every vehicle
+    uint64_t from = 0;                  // receive time, [from, to)
+    uint64_t to = UINT64_MAX;
+    std::vector<ArchiveFilter> filters;  // all must hold
+};
+
+struct ArchiveScanStats {
+    uint64_t partitions = 0;
+    uint64_t blocks = 0;         // complete blocks in the partitions visited
+    uint64_t blocksSkipped = 0;  // by the time index or the block stats
+    uint64_t blocksWhole = 0;    // inside the query: counted from the stats
+    uint64_t rowsScanned = 0;    // checked row by row
+    uint64_t rowsMatched = 0;
+};
+
+using ArchiveVisitor = std::function<void(const std::string& vehicleId, const ArchivedFrame& frame)>;
+
+class TelemetryArchive {
+public:
+    static constexpr uint32_t BLOCK_ROWS = 4096;
+
+    explicit TelemetryArchive(const std::string& root);
+    ~TelemetryArchive();
+    TelemetryArchive(const TelemetryArchive&) = delete;
+    TelemetryArchive& operator=(const TelemetryArchive&) = delete;
+
+    // One row; false for a vehicle id that cannot be a directory name or on
+    // an I/O error
+    bool append(const std::string& vehicleId, const ArchivedFrame& frame);
+    // The Ok frames of a decode() call; returns the rows added
+    size_t append(const FrameBatch& batch, const std::vector<DecodedFrame>& frames);
+
+    // Writes the buffered rows of every partition to its column files
+    bool flush();
+
+    // Calls visit for every matching row, partition by partition in append
+    // order. Flushes first.
+    ArchiveScanStats scan(const ArchiveQuery& query, const ArchiveVisitor& visit);
+    // Like scan() without materialising rows: the count is rowsMatched
+    ArchiveScanStats count(const ArchiveQuery& query);
+
+    std::vector<std::string> vehicles() const;
+    const std::string& root() const { return dir; }
+
+private:
+    struct Writer;
+    struct Partition;
+
+    Writer* writerFor(const std::string& vehicleId, uint64_t dayEpoch);
+    Partition* partition(const std::string& vehicleId, uint64_t dayEpoch);
+    ArchiveScanStats run(const ArchiveQuery& query, const ArchiveVisitor* visit);
+
+    std::string dir;
+    std::map<std::string, std::unique_ptr<Writer>> writers;        // by partition path
+    std::map<std::string, std::unique_ptr<Partition>> partitions;  // mapped, by partition path
+};
+
+#endif
@@ -0,0 +1,222 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include "crash_recorder.h"
+#include "event_decoder.h"
+#include "ingest_pipeline.h"
+#include "key_index.h"
+#include "message_counter.h"
+#include "uplink_writer.h"
+
+namespace {
+
+using Recorder = CrashRecorder<16, 16, 4>;
+
+constexpr uint64_t START = 1742860800;        // 2025-03-25 00:00:00 UTC
+constexpr uint64_t NOON = START + 12 * 3600;
+constexpr const char* VEHICLE = "veh-crash";
+constexpr uint32_t TRIGGER = 220;             // sample index, at 50 Hz
+constexpr uint32_t FIRST_COUNTER = 70000;     // past the first wrap of the 16 bits on air
+
+const uint8_t MASTER[32] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb,
+                            0xcc, 0xdd, 0xee, 0xff, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                            0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x20};
+
+// What the IMU delivers as sample i: 1 g and a slow drift, 6 g at the trigger
+CrashSample fed(uint32_t i) {
+    if (i == TRIGGER) return {{0, 0, 6 * 4096}, {300, -300, 90}};
+    return {{(int16_t)i, (int16_t)-i, (int16_t)(4096 + i)}, {(int16_t)(2 * i), (int16_t)(3 * i), (int16_t)-i}};
+}
+
+int32_t fixLat(uint32_t second) { return 454642035 + (int32_t)second * 100; }
+int32_t fixLon(uint32_t second) { return 91899820 - (int32_t)second * 50; }
+
+// The event frames a recorder sends for one crash, on a device of its own,
+// encrypted with the daily key of NOON
+std::vector<std::vector<uint8_t>> capture(KeyCheckpointIndex& index) {
+    hal::host::Device device("");
+    hal::host::DeviceScope scope(device);
+    hal::host::setLogEnabled(false);
+    hal::Preferences p;
+    p.begin("payload", false);
+    p.putUInt("counter", FIRST_COUNTER);
+    p.end();
+
+    KeyCheckpointIndex::Key key;
+    EXPECT_TRUE(index.keyFor(VEHICLE, NOON, key));
+    MessageCounter counter;
+    GpsFix gps;
+    PayloadManager pm(nullptr, nullptr, &gps, key.data(), &counter, false);
+    Recorder rec;
+    EXPECT_TRUE(rec.begin({50, 4096, 655}));
+    rec.setEncoder(&pm);
+
+    for (uint32_t i = 0; i < TRIGGER + 40; i++) {
+        hal::host::advanceMillis(20);
+        if (i % 50 == 0) {
+            // One fix a second, with the time of day
+            const uint32_t second = i / 50;
+            gps.locationValid = gps.timeValid = true;
+            gps.lat = fixLat(second);
+            gps.lon = fixLon(second);
+            gps.locationMillis = gps.timeMillis = hal::millis();
+            gps.year = 2025;
+            gps.month = 3;
+            gps.day = 25;
+            gps.hour = 12;
+            gps.second = (uint8_t)second;
+            rec.observeGps(gps);
+        }
+        ImuBlock b;
+        CrashSample s = fed(i);
+        b.ax[0] = s.accel[0];
+        b.ay[0] = s.accel[1];
+        b.az[0] = s.accel[2];
+        b.gx[0] = s.gyro[0];
+        b.gy[0] = s.gyro[1];
+        b.gz[0] = s.gyro[2];
+        b.n = 1;
+        rec.observe(b, hal::micros());
+    }
+    EXPECT_EQ(rec.events(), 1u);
+
+    std::vector<std::vector<uint8_t>> frames;
+    uint8_t out[LORAWAN_MAX_UPLINK];
+    for (rec.service(); rec.pending(); rec.service()) {
+        size_t len = rec.next(out, sizeof(out));
+        if (len == 0) break;
+        frames.emplace_back(out, out + len);
+        rec.delivered();
+    }
+    return frames;
+}
+
+class EventDecoderTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        index.addVehicle(VEHICLE, MASTER, sizeof(MASTER), START);
+        frames = capture(index);
+    }
+
+    KeyCheckpointIndex index;
+    std::vector<std::vector<uint8_t>> frames;
+};
+
+void expectRecording(const CrashEvent& e) {
+    EXPECT_EQ(e.vehicleId, VEHICLE);
+    EXPECT_GE(e.counter, FIRST_COUNTER);
+    // The trigger came 0.4 s after the fix of second 4
+    EXPECT_EQ(e.epoch, NOON + TRIGGER / 50);
+    EXPECT_EQ(e.lat, fixLat(4));
+    EXPECT_EQ(e.lon, fixLon(4));
+    EXPECT_NEAR(e.peakAccel, 5884, 1);  // 6 g
+    EXPECT_EQ(e.rateHz, 50);
+    EXPECT_EQ(e.accelLsbPerG, 4096);
+    EXPECT_EQ(e.gyroLsbPerDps10, 655);
+    EXPECT_EQ(e.preSamples, 16);
+    EXPECT_EQ(e.postSamples, 16);
+
+    // The last four fixes, oldest first, relative to the trigger
+    ASSERT_EQ(e.track.size(), 4u);
+    for (uint32_t k = 0; k < 4; k++) {
+        EXPECT_EQ(e.track[k].lat, fixLat(k + 1)) << k;
+        EXPECT_EQ(e.track[k].lon, fixLon(k + 1)) << k;
+        EXPECT_EQ(e.track[k].millis, (int32_t)(k + 1) * 1000 - (int32_t)TRIGGER * 20) << k;
+    }
+
+    // The 16 samples before the trigger, the trigger, then what followed
+    ASSERT_EQ(e.samples.size(), 32u);
+    for (uint32_t k = 0; k < 32; k++) {
+        CrashSample want = fed(TRIGGER - 16 + k);
+        EXPECT_TRUE(std::equal(want.accel, want.accel + 3, e.samples[k].accel)) << k;
+        EXPECT_TRUE(std::equal(want.gyro, want.gyro + 3, e.samples[k].gyro)) << k;
+    }
+}
+
+}  // namespace
+
+TEST_F(EventDecoderTest, CaptureDecodesToSummaryTrackAndSamples) {
+    // Summary, one GPS chunk, two of pre and two of post-trigger samples
+    ASSERT_EQ(frames.size(), 6u);
+    EventDecoder decoder(index);
+    std::vector<CrashEvent> done;
+    for (size_t i = 0; i < frames.size(); i++) {
+        EXPECT_EQ(decoder.add(VEHICLE, NOON + i, frames[i].data(), frames[i].size(), done), FrameStatus::Ok) << i;
+        EXPECT_EQ(done.size(), i + 1 == frames.size() ? 1u : 0u) << i;
+    }
+    ASSERT_EQ(done.size(), 1u);
+    expectRecording(done[0]);
+    EXPECT_EQ(decoder.openEvents(), 0u);
+
+    // A chunk retransmitted after a lost ACK opens nothing
+    EXPECT_EQ(decoder.add(VEHICLE, NOON + 9, frames[3].data(), frames[3].size(), done),
+              FrameStatus::MissingReference);
+    EXPECT_EQ(done.size(), 1u);
+}
+
+TEST_F(EventDecoderTest, ChunksWaitForALateSummaryAcrossMidnight) {
+    ASSERT_EQ(frames.size(), 6u);
+    EventDecoder decoder(index);
+    std::vector<CrashEvent> done;
+    // Received after midnight, under the key of the day before; the summary last
+    const uint64_t late = START + 86400 + 60;
+    for (size_t i = frames.size() - 1; i > 0; i--) {
+        EXPECT_EQ(decoder.add(VEHICLE, late, frames[i].data(), frames[i].size(), done),
+                  FrameStatus::MissingReference);
+    }
+    EXPECT_EQ(decoder.waitingChunks(), 5u);
+    EXPECT_EQ(decoder.add(VEHICLE, late, frames[0].data(), frames[0].size(), done), FrameStatus::Ok);
+    ASSERT_EQ(done.size(), 1u);
+    expectRecording(done[0]);
+    EXPECT_EQ(decoder.waitingChunks(), 0u);
+}
+
+TEST_F(EventDecoderTest, RejectsForeignAndDamagedFrames) {
+    EventDecoder decoder(index);
+    std::vector<CrashEvent> done;
+    const std::vector<uint8_t>& summary = frames.at(0);
+    EXPECT_EQ(decoder.add(VEHICLE, NOON, summary.data(), EVENT_HEADER_LEN - 1, done), FrameStatus::Truncated);
+    EXPECT_EQ(decoder.add("veh-unknown", NOON, summary.data(), summary.size(), done), FrameStatus::NoKey);
+
+    uint8_t other[32];
+    for (size_t i = 0; i < sizeof(other); i++) other[i] = (uint8_t)(0xa0 + i);
+    index.addVehicle("veh-other", other, sizeof(other), START);
+    EXPECT_EQ(decoder.add("veh-other", NOON, summary.data(), summary.size(), done), FrameStatus::WrongKey);
+
+    std::vector<uint8_t> bad = summary;
+    bad[FRAME_FORMAT_OFFSET + 3]++;  // the chunk count no longer follows from the summary
+    EXPECT_EQ(decoder.add(VEHICLE, NOON, bad.data(), bad.size(), done), FrameStatus::WrongKey);
+    bad = summary;
+    bad[FRAME_FORMAT_OFFSET] = CLEAR_BLOCK_LEN;
+    EXPECT_EQ(decoder.add(VEHICLE, NOON, bad.data(), bad.size(), done), FrameStatus::BadLayout);
+    EXPECT_TRUE(done.empty());
+    EXPECT_EQ(decoder.openEvents(), 0u);
+}
+
+TEST_F(EventDecoderTest, IngestPipelineEmitsTheEvent) {
+    ASSERT_EQ(frames.size(), 6u);
+    IngestConfig cfg;
+    cfg.batchFrames = 2;  // the chunks of one event across batches
+    std::vector<CrashEvent> events;
+    size_t frameRows = 0;
+    IngestPipeline pipeline(
+        index, cfg, [&](const FrameBatch& batch, const std::vector<DecodedFrame>&) { frameRows += batch.size(); },
+        [&](const CrashEvent& e) { events.push_back(e); });
+    for (size_t i = 0; i < frames.size(); i++) {
+        SimUplink up{(NOON + i) * 1000, VEHICLE, (uint32_t)i, FPORT_EVENT, 3, frames[i]};
+        ASSERT_TRUE(pipeline.submit(UplinkWriter::toTtnJson(up)));
+        if (i == 2) {
+            ASSERT_TRUE(pipeline.submit(UplinkWriter::toTtnJson(up)));  // heard by a second gateway
+        }
+    }
+    pipeline.finish();
+
+    ASSERT_EQ(events.size(), 1u);
+    expectRecording(events[0]);
+    IngestPipeline::Stats s = pipeline.stats();
+    EXPECT_EQ(s.uplinks, frames.size() + 1);
+    EXPECT_EQ(s.duplicates, 1u);
+    EXPECT_EQ(s.eventChunks, frames.size());
+    EXPECT_EQ(s.events, 1u);
+    EXPECT_EQ(s.frames, 0u);
+    EXPECT_EQ(frameRows, 0u);
+}
@@ -0,0 +1,345 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <filesystem>
+#include <unistd.h>
+#include "aes128.h"
+#include "frame_decoder.h"
+#include "payload_manager.h"
+
+namespace {
+
+constexpr uint64_t START = 1742860800;  // 2025-03-25 00:00:00 UTC
+const uint8_t MASTER[32] = {0xe1, 0x7c, 0x9d, 0x5c, 0x6c, 0x7b, 0xc8, 0x41, 0x23, 0xc0, 0xa4,
+                            0xca, 0xee, 0xf5, 0x3d, 0x4f, 0x24, 0x6f, 0xb8, 0xce, 0x22, 0xf3,
+                            0x9a, 0xad, 0x71, 0xbc, 0x5d, 0xde, 0x2e, 0x98, 0x29, 0x21};
+
+KeyCheckpointIndex::Key dayKey(const std::string& vid, uint64_t day) {
+    KeyCheckpointIndex::Key key;
+    keychain::deriveInitial(MASTER, sizeof(MASTER), (const uint8_t*)vid.data(), vid.size(), START, key.data());
+    keychain::advance(key.data(), (const uint8_t*)vid.data(), vid.size(), START, START + day * SECONDS_PER_DAY);
+    return key;
+}
+
+// Reference encoder written straight from frame_layout.h
+std::vector<uint8_t> encodeFrame(const KeyCheckpointIndex::Key& key, uint32_t counter, int8_t temp,
+                                 int32_t lat, int32_t lon) {
+    std::vector<uint8_t> f(PAYLOAD_SIZE, 0);
+    f[0] = counter & 0xFF;
+    f[1] = (counter >> 8) & 0xFF;
+    f[FRAME_CLEAR_LEN_OFFSET] = CLEAR_BLOCK_LEN;
+    f[FRAME_CLEAR_LEN_OFFSET + 1] = MARKER_TEMPERATURE;
+    f[FRAME_CLEAR_LEN_OFFSET + 2] = (uint8_t)temp;
+    f[FRAME_CLEAR_LEN_OFFSET + 3] = MARKER_GYRO;
+    f[FRAME_CLEAR_LEN_OFFSET + 4] = (uint8_t)-7;
+    f[FRAME_ENCRYPTED_LEN_OFFSET] = ENCRYPTED_BLOCK_LEN;
+    uint8_t* enc = f.data() + FRAME_ENCRYPTED_OFFSET;
+    const uint16_t accel[3] = {1000, 981, 25};  // peak, RMS, jerk
+    enc[0] = MARKER_ACCEL;
+    memcpy(enc + 1, accel, sizeof(accel));
+    enc[7] = MARKER_GPS;
+    memcpy(enc + 8, &lat, 4);
+    memcpy(enc + 12, &lon, 4);
+    uint8_t iv[16];
+    frameCounterBlock(counter, iv);
+    hal::aes128Ctr(key.data(), iv, enc, ENCRYPTED_BLOCK_LEN);
+    return f;
+}
+
+class FrameDecoderTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        index.addVehicle("veh-a", MASTER, sizeof(MASTER), START);
+        index.addVehicle("veh-b", MASTER, sizeof(MASTER), START);
+    }
+    void TearDown() override { Aes128::forcePortable(false); }
+
+    KeyCheckpointIndex index{8};
+};
+
+}  // namespace
+
+TEST(Aes128Test, Fips197VectorOnBothPaths) {
+    const uint8_t key[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+    const uint8_t plain[16] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+                               0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff};
+    const uint8_t expected[16] = {0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+                                  0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a};
+    for (bool portable : {false, true}) {
+        Aes128::forcePortable(portable);
+        Aes128 aes(key);
+        // 11 blocks covers the 8-wide AES-NI loop and its tail
+        uint8_t in[11 * 16], out[11 * 16];
+        for (int b = 0; b < 11; b++) memcpy(in + 16 * b, plain, 16);
+        aes.encryptBlocks(in, out, 11);
+        for (int b = 0; b < 11; b++) EXPECT_EQ(memcmp(out + 16 * b, expected, 16), 0) << "portable=" << portable;
+    }
+    Aes128::forcePortable(false);
+}
+
+TEST_F(FrameDecoderTest, DecodesAcrossVehiclesDaysAndThreads) {
+    FrameBatch batch;
+    struct Sent { std::string vid; uint64_t day; uint16_t counter; int32_t lat; };
+    std::vector<Sent> sent;
+    for (int i = 0; i < 3000; i++) {
+        Sent s{i % 3 ? "veh-a" : "veh-b", (uint64_t)(i % 20), (uint16_t)(i * 7), 450000000 + i};
+        auto frame = encodeFrame(dayKey(s.vid, s.day), s.counter, (int8_t)(i % 50 - 10), s.lat, -s.lat);
+        batch.add(s.vid, START + s.day * SECONDS_PER_DAY + 3600 + i, frame.data(), frame.size());
+        sent.push_back(s);
+    }
+
+    for (unsigned threads : {1u, 4u}) {
+        FrameDecoder decoder(index, threads);
+        std::vector<DecodedFrame> out;
+        ASSERT_EQ(decoder.decode(batch, out), sent.size());
+        for (size_t i = 0; i < sent.size(); i++) {
+            ASSERT_EQ(out[i].status, FrameStatus::Ok) << i;
+            EXPECT_EQ(batch.vehicleIds()[out[i].vehicle], sent[i].vid);
+            EXPECT_EQ(out[i].counter, sent[i].counter);
+            EXPECT_EQ(out[i].temperature, (int8_t)(i % 50 - 10));
+            EXPECT_EQ(out[i].gyro[0], -7);
+            EXPECT_EQ(out[i].accel, 1000);
+            EXPECT_EQ(out[i].accelRms, 981);
+            EXPECT_EQ(out[i].jerk, 25);
+            EXPECT_EQ(out[i].lat, sent[i].lat);
+            EXPECT_EQ(out[i].lon, -sent[i].lat);
+        }
+    }
+}
+
+TEST_F(FrameDecoderTest, ReportsBadFrames) {
+    FrameBatch batch;
+    auto good = encodeFrame(dayKey("veh-a", 2), 5, 20, 1, 2);
+    batch.add("veh-a", START + 2 * SECONDS_PER_DAY, good.data(), good.size() - 1);
+    auto bad = good;
+    bad[FRAME_CLEAR_LEN_OFFSET] = 7;
+    batch.add("veh-a", START + 2 * SECONDS_PER_DAY, bad.data(), bad.size());
+    batch.add("unknown", START + 2 * SECONDS_PER_DAY, good.data(), good.size());
+    batch.add("veh-a", START + 9 * SECONDS_PER_DAY, good.data(), good.size());
+
+    FrameDecoder decoder(index, 1);
+    std::vector<DecodedFrame> out;
+    EXPECT_EQ(decoder.decode(batch, out), 0u);
+    EXPECT_EQ(out[0].status, FrameStatus::Truncated);
+    EXPECT_EQ(out[1].status, FrameStatus::BadLayout);
+    EXPECT_EQ(out[2].status, FrameStatus::NoKey);
+    EXPECT_EQ(out[3].status, FrameStatus::WrongKey);
+    EXPECT_EQ(out[2].counter, 5);  // clear fields survive a missing key
+}
+
+TEST_F(FrameDecoderTest, FrameSentBeforeMidnightUsesPreviousDayKey) {
+    FrameBatch batch;
+    auto frame = encodeFrame(dayKey("veh-b", 4), 99, 15, 123, 456);
+    batch.add("veh-b", START + 5 * SECONDS_PER_DAY + 20, frame.data(), frame.size());
+
+    FrameDecoder decoder(index, 1);
+    std::vector<DecodedFrame> out;
+    ASSERT_EQ(decoder.decode(batch, out), 1u);
+    EXPECT_EQ(out[0].lat, 123);
+}
+
+TEST_F(FrameDecoderTest, RecoversTheCounterAcrossGaps) {
+    auto key = dayKey("veh-a", 2);
+    const uint64_t ts = START + 2 * SECONDS_PER_DAY + 3600;
+    FrameDecoder decoder(index, 1);
+    std::vector<DecodedFrame> out;
+
+    // Past the first wrap in one batch: every frame continues from the one before
+    FrameBatch first;
+    const uint32_t sent[] = {65000, 65535, 65536, 70000, 100000};
+    for (uint32_t c : sent) {
+        auto frame = encodeFrame(key, c, 20, (int32_t)c, 0);
+        first.add("veh-a", ts, frame.data(), frame.size());
+    }
+    ASSERT_EQ(decoder.decode(first, out), 5u);
+    for (size_t i = 0; i < 5; i++) {
+        EXPECT_EQ(out[i].counter, sent[i]);
+        EXPECT_EQ(out[i].lat, (int32_t)sent[i]);
+    }
+
+    // An hour later, three wraps on: the first frame resynchronises, the rest follow it
+    FrameBatch second;
+    for (uint32_t c = 300000; c < 300004; c++) {
+        auto frame = encodeFrame(key, c, 20, (int32_t)c, 0);
+        second.add("veh-a", ts + 3600, frame.data(), frame.size());
+    }
+    ASSERT_EQ(decoder.decode(second, out), 4u);
+    EXPECT_EQ(out[0].counter, 300000u);
+    EXPECT_EQ(out[3].counter, 300003u);
+
+    // More frames than MAX_FRAME_RATE allows since then is not a resync
+    FrameBatch third;
+    auto far = encodeFrame(key, 300004 + 5 * 65536, 20, 0, 0);
+    third.add("veh-a", ts + 3601, far.data(), far.size());
+    EXPECT_EQ(decoder.decode(third, out), 0u);
+    EXPECT_EQ(out[0].status, FrameStatus::WrongKey);
+
+    // A decoder without history searches from the start of the day
+    FrameDecoder fresh(index, 1);
+    ASSERT_EQ(fresh.decode(second, out), 4u);
+    EXPECT_EQ(out[0].counter, 300000u);
+}
+
+TEST_F(FrameDecoderTest, ResyncNeedsASecondFrame) {
+    auto key = dayKey("veh-a", 2);
+    const uint64_t ts = START + 2 * SECONDS_PER_DAY + 3600;
+    FrameDecoder decoder(index, 1);
+    std::vector<DecodedFrame> out;
+    FrameBatch first;
+    auto frame = encodeFrame(key, 1000, 20, 0, 0);
+    first.add("veh-a", ts, frame.data(), frame.size());
+    ASSERT_EQ(decoder.decode(first, out), 1u);
+
+    // A frame whose markers pass under one high half (as a wrong candidate
+    // does by chance) while the frames after it carry another one
+    FrameBatch second;
+    auto stray = encodeFrame(key, 1000 + 2 * 65536, 20, 0, 0);
+    second.add("veh-a", ts + 3600, stray.data(), stray.size());
+    for (uint32_t c = 1000 + 5 * 65536; c < 1000 + 5 * 65536 + 3; c++) {
+        auto f = encodeFrame(key, c, 20, (int32_t)c, 0);
+        second.add("veh-a", ts + 3600, f.data(), f.size());
+    }
+    EXPECT_EQ(decoder.decode(second, out), 3u);
+    EXPECT_EQ(out[0].status, FrameStatus::WrongKey);
+    EXPECT_EQ(out[1].counter, 1000u + 5 * 65536);
+    EXPECT_EQ(out[3].counter, 1000u + 5 * 65536 + 2);
+
+    // A lone frame on a new high half waits for the next batch to confirm it
+    FrameBatch third, fourth;
+    auto lone = encodeFrame(key, 1000 + 8 * 65536, 20, 0, 0);
+    third.add("veh-a", ts + 7200, lone.data(), lone.size());
+    EXPECT_EQ(decoder.decode(third, out), 0u);
+    EXPECT_EQ(out[0].status, FrameStatus::WrongKey);
+    auto after = encodeFrame(key, 1001 + 8 * 65536, 20, 7, 0);
+    fourth.add("veh-a", ts + 7260, after.data(), after.size());
+    ASSERT_EQ(decoder.decode(fourth, out), 1u);
+    EXPECT_EQ(out[0].counter, 1001u + 8 * 65536);
+    EXPECT_EQ(out[0].lat, 7);
+}
+
+TEST_F(FrameDecoderTest, DecodesFirmwareFrames) {
+    std::string storage = (std::filesystem::temp_directory_path() /
+                           ("bbx-decoder-" + std::to_string(getpid()))).string();
+    hal::host::setStorageDir(storage);
+    hal::host::wipeStorage();
+    hal::host::setLogEnabled(false);
+
+    KeyCheckpointIndex::Key key = dayKey("veh-a", 3);
+    DHT11 dht(7);
+    Adafruit_MPU6050 mpu;
+    GpsFix gps;
+    MessageCounter counter;
+    dht.hostTemperature = 23;
+    mpu.hostGyro = {0.5f, -0.25f, 0.0f};
+    mpu.hostAccel = {0.0f, 6.0f, 8.0f};
+    gps.locationValid = true;
+    gps.lat = 454642035;
+    gps.lon = 91899820;
+    PayloadManager pm(&dht, &mpu, &gps, key.data(), &counter, true);
+
+    FrameBatch batch;
+    for (int i = 0; i < 3; i++) {
+        uint8_t frame[PAYLOAD_SIZE];
+        ASSERT_EQ(pm.createPayload(frame, sizeof(frame)), (size_t)PAYLOAD_SIZE);
+        batch.add("veh-a", START + 3 * SECONDS_PER_DAY + 60 * i, frame, sizeof(frame));
+    }
+    hal::host::wipeStorage();
+
+    FrameDecoder decoder(index, 1);
+    std::vector<DecodedFrame> out;
+    ASSERT_EQ(decoder.decode(batch, out), 3u);
+    EXPECT_EQ(out[2].counter, 2);
+    EXPECT_EQ(out[2].temperature, 23);
+    EXPECT_EQ(out[2].gyro[0], 5);
+    EXPECT_EQ(out[2].gyro[1], -3);  // -2.5 rounds away from zero
+    EXPECT_EQ(out[2].accel, 1000);
+    EXPECT_EQ(out[2].lat, 454642035);
+    EXPECT_EQ(out[2].lon, 91899820);
+}
+
+TEST_F(FrameDecoderTest, SplitsAggregatedUplinks) {
+    auto key = dayKey("veh-a", 1);
+    std::vector<uint8_t> uplink = {3};
+    for (uint16_t c = 10; c < 13; c++) {
+        auto frame = encodeFrame(key, c, 18, c * 100, 0);
+        uplink.push_back((uint8_t)frame.size());
+        uplink.insert(uplink.end(), frame.begin(), frame.end());
+    }
+
+    FrameBatch batch;
+    uint64_t ts = START + SECONDS_PER_DAY + 500;
+    EXPECT_EQ(batch.addUplink("veh-a", ts, FPORT_AGGREGATE, uplink.data(), uplink.size()), 3u);
+    EXPECT_EQ(batch.addUplink("veh-a", ts, FPORT_AGGREGATE, uplink.data(), uplink.size() - 1), 0u);
+    EXPECT_EQ(batch.addUplink("veh-a", ts, FPORT_FRAME, uplink.data() + 2, PAYLOAD_SIZE), 1u);
+    ASSERT_EQ(batch.size(), 4u);
+
+    FrameDecoder decoder(index, 1);
+    std::vector<DecodedFrame> out;
+    ASSERT_EQ(decoder.decode(batch, out), 4u);
+    EXPECT_EQ(out[2].counter, 12);
+    EXPECT_EQ(out[2].lat, 1200);
+    EXPECT_EQ(out[3].counter, 10);
+}
+
+TEST_F(FrameDecoderTest, ResolvesCompactDeltaChains) {
+    std::string storage = (std::filesystem::temp_directory_path() /
+                           ("bbx-decoder-compact-" + std::to_string(getpid()))).string();
+    hal::host::setStorageDir(storage);
+    hal::host::wipeStorage();
+    hal::host::setLogEnabled(false);
+
+    KeyCheckpointIndex::Key key = dayKey("veh-a", 3);
+    DHT11 dht(7);
+    Adafruit_MPU6050 mpu;
+    GpsFix gps;
+    MessageCounter counter;
+    PayloadManager pm(&dht, &mpu, &gps, key.data(), &counter, true);
+    pm.setCodec(PayloadCodec::Compact);
+
+    // 25 frames while driving north: keyframes at 0, 10, 20
+    std::vector<std::vector<uint8_t>> frames;
+    for (int i = 0; i < 25; i++) {
+        dht.hostTemperature = 20 + i / 5;
+        pm.sampleEnvironment();
+        gps.locationValid = true;
+        gps.lat = 450000000 + i * 1000;
+        gps.lon = 90000000;
+        uint8_t frame[COMPACT_KEYFRAME_SIZE];
+        size_t len = pm.createPayload(frame, sizeof(frame));
+        ASSERT_GT(len, 0u);
+        frames.emplace_back(frame, frame + len);
+    }
+    hal::host::wipeStorage();
+    uint64_t ts = START + 3 * SECONDS_PER_DAY + 100;
+
+    FrameDecoder decoder(index, 1);
+    std::vector<DecodedFrame> out;
+
+    // Frames 0..11 with 5 lost: 6..9 have no reference until keyframe 10
+    FrameBatch first;
+    for (int i = 0; i < 12; i++) {
+        if (i != 5) first.add("veh-a", ts + i, frames[i].data(), frames[i].size());
+    }
+    EXPECT_EQ(decoder.decode(first, out), 7u);
+    EXPECT_EQ(out[0].format, FrameFormat::Keyframe);
+    EXPECT_EQ(out[4].format, FrameFormat::Delta);
+    EXPECT_EQ(out[4].status, FrameStatus::Ok);
+    EXPECT_EQ(out[4].temperature, 20);
+    EXPECT_EQ(out[4].lat, 450004000);
+    for (int k = 5; k < 9; k++) EXPECT_EQ(out[k].status, FrameStatus::MissingReference) << k;
+    EXPECT_EQ(out[10].counter, 11);
+    EXPECT_EQ(out[10].status, FrameStatus::Ok);
+
+    // Next call: a retransmitted frame 11 and the rest still chain on frame 11
+    FrameBatch second;
+    for (int i = 11; i < 25; i++) second.add("veh-a", ts + i, frames[i].data(), frames[i].size());
+    ASSERT_EQ(decoder.decode(second, out), 14u);
+    EXPECT_EQ(out.back().counter, 24);
+    EXPECT_EQ(out.back().temperature, 24);
+    EXPECT_EQ(out.back().lat, 450024000);
+
+    decoder.clearChains();
+    FrameBatch orphan;
+    orphan.add("veh-a", ts, frames[24].data(), frames[24].size());
+    decoder.decode(orphan, out);
+    EXPECT_EQ(out[0].status, FrameStatus::MissingReference);
+}
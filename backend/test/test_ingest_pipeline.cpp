@@ -0,0 +1,340 @@
+// Uplink ingestion: base64, TTN JSON fields, the queues and the staged pipeline
+#include <gtest/gtest.h>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+#include "base64.h"
+#include "fleet_sim.h"
+#include "ingest_pipeline.h"
+
+namespace {
+
+constexpr uint64_t START = 1742860800;  // 2025-03-25 00:00:00 UTC
+
+std::string toBase64(const std::vector<uint8_t>& data) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (size_t i = 0; i < data.size(); i += 3) {
+        uint32_t v = (uint32_t)data[i] << 16;
+        if (i + 1 < data.size()) v |= (uint32_t)data[i + 1] << 8;
+        if (i + 2 < data.size()) v |= data[i + 2];
+        out += alphabet[v >> 18 & 63];
+        out += alphabet[v >> 12 & 63];
+        out += i + 1 < data.size() ? alphabet[v >> 6 & 63] : '=';
+        out += i + 2 < data.size() ? alphabet[v & 63] : '=';
+    }
+    return out;
+}
+
+std::vector<uint8_t> fromHex(const std::string& hex) {
+    std::vector<uint8_t> out;
+    for (size_t i = 0; i + 1 < hex.size(); i += 2) out.push_back((uint8_t)std::stoul(hex.substr(i, 2), nullptr, 16));
+    return out;
+}
+
+std::string uplinkJson(const std::string& device, uint64_t epoch, uint8_t port, const std::vector<uint8_t>& payload) {
+    SimUplink up{epoch * 1000, device, 0, port, 3, payload};
+    return UplinkWriter::toTtnJson(up);
+}
+
+std::string row(const FrameBatch& batch, const DecodedFrame& f) {
+    char buf[160];
+    snprintf(buf, sizeof(buf), ",%llu,%u,%s,%s,%d,%d,%d,%d,%d", (unsigned long long)f.timestamp, f.counter,
+             frameStatusName(f.status), frameFormatName(f.format), f.temperature, f.accel, f.jerk, f.lat, f.lon);
+    return batch.vehicleIds()[f.vehicle] + buf;
+}
+
+}  // namespace
+
+TEST(IngestParseTest, Base64BothPathsMatch) {
+    std::mt19937 rng(7);
+    std::vector<uint8_t> got;
+    for (bool portable : {true, false}) {
+        base64::forcePortable(portable);
+        for (size_t len = 0; len < 200; len++) {
+            std::vector<uint8_t> data(len);
+            for (uint8_t& b : data) b = (uint8_t)rng();
+            std::string text = toBase64(data);
+            ASSERT_TRUE(base64::decode(text.data(), text.size(), got)) << len;
+            ASSERT_EQ(got, data) << "len " << len << " portable " << portable;
+
+            // A bad character anywhere, in a vector block or the tail, is refused
+            if (text.size() >= 4) {
+                std::string bad = text;
+                bad[rng() % (text.size() - 2)] = '*';
+                EXPECT_FALSE(base64::decode(bad.data(), bad.size(), got)) << bad;
+            }
+        }
+        EXPECT_FALSE(base64::decode("QUJD", 3, got));
+        EXPECT_FALSE(base64::decode("QQ==QUJD", 8, got));
+        EXPECT_FALSE(base64::decode("Q===", 4, got));
+        const std::string longPadded = std::string(40, 'A') + "=" + std::string(23, 'A');
+        EXPECT_FALSE(base64::decode(longPadded.data(), longPadded.size(), got));
+    }
+    base64::forcePortable(false);
+}
+
+TEST(IngestParseTest, TtnUplinkFields) {
+    SimUplink up{(START + 3661) * 1000 + 250, "veh-007", 4242, FPORT_AGGREGATE, 5, {1, 2, 3, 4, 5}};
+    std::string json = UplinkWriter::toTtnJson(up);
+    TtnUplink out;
+    ASSERT_TRUE(parseTtnUplink(json.data(), json.size(), out)) << json;
+    EXPECT_EQ(out.deviceId, "veh-007");
+    EXPECT_EQ(out.receiveEpoch, START + 3661);
+    EXPECT_EQ(out.port, FPORT_AGGREGATE);
+    EXPECT_EQ(out.fCnt, 4242u);
+    EXPECT_EQ(out.payload, "AQIDBAU=");
+
+    // Any order, whitespace, escaped strings elsewhere, an offset time, keys
+    // of the same name nested further in ignored
+    const std::string other =
+        " { \"uplink_message\" : { \"frm_payload\" : \"AQI=\", \"f_cnt\": 9 , \"note\": \"a \\\"device_id\\\": x\","
+        " \"f_port\":1 },\n \"received_at\": \"2025-03-25T02:00:00.123456789+02:00\","
+        " \"end_device_ids\": {\"device_id\": \"veh-1\", \"x\": {\"device_id\": \"other\"}}}";
+    ASSERT_TRUE(parseTtnUplink(other.data(), other.size(), out));
+    EXPECT_EQ(out.deviceId, "veh-1");
+    EXPECT_EQ(out.receiveEpoch, START);
+    EXPECT_EQ(out.port, 1);
+    EXPECT_EQ(out.fCnt, 9u);
+    EXPECT_EQ(out.payload, "AQI=");
+
+    for (const char* bad : {
+             "",
+             "[\"device_id\", \"received_at\"]",
+             "{\"device_id\": \"a\"}",
+             "{\"received_at\": \"2025-03-25T00:00:00Z\"}",
+             "{\"device_id\": \"a\", \"received_at\": \"2025-03-25 00:00:00\"}",
+             "{\"device_id\": \"a\", \"received_at\": \"2025-13-25T00:00:00Z\"}",
+             "{\"device_id\": \"a\", \"received_at\": \"2025-03-25T00:00:00Z\", \"f_port\": 256}",
+             "{\"device_id\": \"a\", \"received_at\": \"2025-03-25T00:00:00Z\", \"frm_payload\": \"AQI=",
+             "{\"device_id\": 5, \"received_at\": \"2025-03-25T00:00:00Z\"}",
+         }) {
+        EXPECT_FALSE(parseTtnUplink(bad, strlen(bad), out)) << bad;
+    }
+}
+
+TEST(LatencyHistogramTest, PercentilesWithinABucket) {
+    for (size_t b = 0; b < 252; b++) {
+        ASSERT_EQ(LatencyHistogram::bucketOf(LatencyHistogram::bucketLow(b)), b);
+        ASSERT_EQ(LatencyHistogram::bucketOf(LatencyHistogram::bucketLow(b + 1) - 1), b);
+    }
+    LatencyHistogram h;
+    EXPECT_EQ(h.percentile(0.5), 0u);
+    for (uint64_t ns = 1; ns <= 10000; ns++) h.record(ns);
+    EXPECT_EQ(h.count(), 10000u);
+    EXPECT_DOUBLE_EQ(h.mean(), 5000.5);
+    EXPECT_GE(h.percentile(0.5), 5000u);
+    EXPECT_LE(h.percentile(0.5), 6250u);
+    EXPECT_GE(h.percentile(0.99), 9900u);
+    EXPECT_EQ(h.percentile(1.0), 10000u);
+    EXPECT_EQ(h.max(), 10000u);
+}
+
+TEST(BoundedQueueTest, FullQueueBlocksUntilPopped) {
+    BoundedQueue<int> q(3);  // rounded up to 4
+    EXPECT_EQ(q.capacity(), 4u);
+    for (int i = 0; i < 4; i++) {
+        int v = i;
+        ASSERT_TRUE(q.tryPush(v));
+    }
+    int v = 4;
+    EXPECT_FALSE(q.tryPush(v));
+
+    std::thread producer([&] { EXPECT_TRUE(q.push(5)); });
+    int got;
+    while (q.fullWaits() == 0) std::this_thread::yield();
+    ASSERT_TRUE(q.pop(got));
+    EXPECT_EQ(got, 0);
+    producer.join();
+    EXPECT_EQ(q.fullWaits(), 1u);
+
+    q.close();
+    EXPECT_FALSE(q.push(6));
+    std::vector<int> rest;
+    while (q.pop(got)) rest.push_back(got);
+    EXPECT_EQ(rest, (std::vector<int>{1, 2, 3, 5}));
+    EXPECT_TRUE(q.drained());
+    EXPECT_FALSE(q.popFor(got, std::chrono::milliseconds(1)));
+}
+
+TEST(BoundedQueueTest, ManyProducersAndConsumers) {
+    BoundedQueue<uint64_t> q(64);
+    constexpr uint64_t PER_PRODUCER = 20000;
+    std::atomic<uint64_t> sum{0}, count{0};
+    std::vector<std::thread> consumers, producers;
+    for (int c = 0; c < 2; c++) {
+        consumers.emplace_back([&] {
+            uint64_t v;
+            while (q.pop(v)) {
+                sum += v;
+                count++;
+            }
+        });
+    }
+    for (uint64_t p = 0; p < 3; p++) {
+        producers.emplace_back([&, p] {
+            for (uint64_t i = 1; i <= PER_PRODUCER; i++) q.push(p * PER_PRODUCER + i);
+        });
+    }
+    for (std::thread& t : producers) t.join();
+    q.close();
+    for (std::thread& t : consumers) t.join();
+    const uint64_t n = 3 * PER_PRODUCER;
+    EXPECT_EQ(count.load(), n);
+    EXPECT_EQ(sum.load(), n * (n + 1) / 2);
+}
+
+TEST(IngestPipelineTest, MatchesSequentialDecodeWithDuplicates) {
+    FleetConfig fc;
+    fc.vehicles = 6;
+    fc.threads = 1;
+    fc.durationS = 4 * 3600;
+    fc.startEpoch = START + 22 * 3600;  // across midnight
+    for (bool compact : {false, true}) {
+        fc.compact = compact;
+        FleetSimulator fleet(fc);
+        KeyCheckpointIndex index;
+        for (const FleetVehicle& v : fleet.vehicles()) {
+            std::vector<uint8_t> master = fromHex(v.masterKeyHex);
+            index.addVehicle(v.id, master.data(), master.size(), v.startEpoch);
+        }
+        std::vector<SimUplink> uplinks;
+        fleet.run([&](const SimUplink& up) { uplinks.push_back(up); });
+        ASSERT_GT(uplinks.size(), 100u);
+
+        // The reference: every uplink once, in order, in one batch
+        FrameBatch all;
+        for (const SimUplink& up : uplinks) {
+            all.addUplink(up.deviceId, up.atMillis / 1000, up.port, up.payload.data(), up.payload.size());
+        }
+        std::vector<DecodedFrame> decoded;
+        FrameDecoder reference(index, 1);
+        reference.decode(all, decoded);
+        std::vector<std::string> expected;
+        for (const DecodedFrame& f : decoded) expected.push_back(row(all, f));
+
+        // Every seventh uplink heard again a few messages later, plus noise
+        std::vector<std::string> lines;
+        size_t extra = 0;
+        for (size_t i = 0; i < uplinks.size(); i++) {
+            lines.push_back(UplinkWriter::toTtnJson(uplinks[i]));
+            if (i % 7 == 3 && i >= 5) {
+                SimUplink again = uplinks[i - 5];
+                again.atMillis = uplinks[i].atMillis;  // a late copy from another gateway
+                lines.push_back(UplinkWriter::toTtnJson(again));
+                extra++;
+            }
+            if (i % 50 == 0) lines.push_back("{\"end_device_ids\": {\"device_id\": \"veh-x\"}");
+            if (i % 60 == 0) lines.push_back(uplinkJson("veh-x", START, FPORT_EVENT, {1, 2, 3}));
+        }
+
+        IngestConfig cfg;
+        cfg.parseThreads = 3;
+        cfg.queueDepth = 16;
+        cfg.batchQueueDepth = 2;
+        cfg.batchFrames = 64;
+        std::vector<std::string> got;
+        size_t emitted = 0;
+        IngestPipeline pipeline(index, cfg, [&](const FrameBatch& batch, const std::vector<DecodedFrame>& frames) {
+            ASSERT_EQ(frames.size(), batch.size());
+            for (const DecodedFrame& f : frames) got.push_back(row(batch, f));
+            emitted++;
+        });
+        for (const std::string& line : lines) ASSERT_TRUE(pipeline.submit(line));
+        pipeline.finish();
+
+        EXPECT_EQ(got, expected) << "compact=" << compact;
+        IngestPipeline::Stats s = pipeline.stats();
+        EXPECT_EQ(s.lines, lines.size());
+        EXPECT_EQ(s.dropped, 0u);
+        EXPECT_EQ(s.uplinks, uplinks.size() + extra);
+        EXPECT_EQ(s.frames, all.size());
+        EXPECT_GE(s.duplicates, extra);
+        EXPECT_EQ(s.malformed + s.ignored + s.uplinks, s.lines);
+        EXPECT_EQ(s.decodedOk, all.size());
+        EXPECT_EQ(s.batches, emitted);
+        EXPECT_GT(s.batches, all.size() / 64);
+        EXPECT_EQ(pipeline.latency(IngestStage::Parse).count(), lines.size());
+        EXPECT_EQ(pipeline.latency(IngestStage::EndToEnd).count(), all.size());
+    }
+}
+
+TEST(IngestPipelineTest, BackpressureBlocksOrDrops) {
+    KeyCheckpointIndex index;  // no keys: nothing decodes, but every frame is emitted
+    for (Backpressure policy : {Backpressure::Block, Backpressure::Drop}) {
+        IngestConfig cfg;
+        cfg.parseThreads = 2;
+        cfg.queueDepth = 4;
+        cfg.batchQueueDepth = 2;
+        cfg.batchFrames = 1;
+        cfg.backpressure = policy;
+
+        // The emit stage stalls until everything is submitted (Drop) or a
+        // while after the first batch (Block)
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool released = false;
+        size_t frames = 0;
+        IngestPipeline pipeline(index, cfg, [&](const FrameBatch& batch, const std::vector<DecodedFrame>&) {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!released) cv.wait_for(lock, std::chrono::milliseconds(10));
+            frames += batch.size();
+        });
+        std::thread releaser;
+        if (policy == Backpressure::Block) {
+            releaser = std::thread([&] {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                std::lock_guard<std::mutex> lock(mutex);
+                released = true;
+                cv.notify_all();
+            });
+        }
+        size_t accepted = 0;
+        const size_t N = 300;
+        for (size_t i = 0; i < N; i++) {
+            std::vector<uint8_t> frame(PAYLOAD_SIZE, (uint8_t)(i >> 8));
+            frame[0] = (uint8_t)i;
+            frame[1] = (uint8_t)(i >> 8);
+            accepted += pipeline.submit(uplinkJson("veh-a", START + i, FPORT_FRAME, frame));
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            released = true;
+            cv.notify_all();
+        }
+        if (releaser.joinable()) releaser.join();
+        pipeline.finish();
+        IngestPipeline::Stats s = pipeline.stats();
+        EXPECT_EQ(s.lines, accepted);
+        EXPECT_EQ(s.lines + s.dropped, N);
+        EXPECT_EQ(frames, s.lines);
+        if (policy == Backpressure::Block) {
+            // The stall reached back from the emit queue to submit()
+            EXPECT_EQ(s.dropped, 0u);
+            EXPECT_GT(s.queueFullWaits[(size_t)IngestStage::Emit], 0u);
+            EXPECT_GT(s.queueFullWaits[(size_t)IngestStage::Parse], 0u);
+        } else {
+            EXPECT_GT(s.dropped, 0u);
+        }
+    }
+}
+
+TEST(IngestPipelineTest, PartialBatchFlushesAfterBatchMillis) {
+    KeyCheckpointIndex index;
+    IngestConfig cfg;
+    cfg.batchMillis = 20;
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t frames = 0;
+    IngestPipeline pipeline(index, cfg, [&](const FrameBatch& batch, const std::vector<DecodedFrame>& out) {
+        std::lock_guard<std::mutex> lock(mutex);
+        frames += batch.size();
+        EXPECT_NE(out[0].status, FrameStatus::Ok);
+        cv.notify_all();
+    });
+    ASSERT_TRUE(pipeline.submit(uplinkJson("veh-a", START, FPORT_FRAME, std::vector<uint8_t>(PAYLOAD_SIZE, 7))));
+    std::unique_lock<std::mutex> lock(mutex);
+    EXPECT_TRUE(cv.wait_for(lock, std::chrono::seconds(5), [&] { return frames == 1; }));
+}
@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <unistd.h>
+#include "key_index.h"
+
+namespace {
+
+constexpr uint64_t START = 1742860800;  // 2025-03-25 00:00:00 UTC
+const uint8_t MASTER[32] = {0xe1, 0x7c, 0x9d, 0x5c, 0x6c, 0x7b, 0xc8, 0x41, 0x23, 0xc0, 0xa4,
+                            0xca, 0xee, 0xf5, 0x3d, 0x4f, 0x24, 0x6f, 0xb8, 0xce, 0x22, 0xf3,
+                            0x9a, 0xad, 0x71, 0xbc, 0x5d, 0xde, 0x2e, 0x98, 0x29, 0x21};
+
+// Straight walk from day 0, the way the frontend does it
+KeyCheckpointIndex::Key naiveKey(const std::string& vid, uint64_t day) {
+    KeyCheckpointIndex::Key key;
+    keychain::deriveInitial(MASTER, sizeof(MASTER), (const uint8_t*)vid.data(), vid.size(), START, key.data());
+    keychain::advance(key.data(), (const uint8_t*)vid.data(), vid.size(), START, START + day * SECONDS_PER_DAY);
+    return key;
+}
+
+}  // namespace
+
+TEST(KeyCheckpointIndexTest, MatchesNaiveChain) {
+    KeyCheckpointIndex index(7);
+    index.addVehicle("veh-1", MASTER, sizeof(MASTER), START);
+    for (uint64_t day : {0, 1, 6, 7, 8, 30, 100}) {
+        KeyCheckpointIndex::Key key;
+        ASSERT_TRUE(index.keyFor("veh-1", START + day * SECONDS_PER_DAY + 4000, key));
+        EXPECT_EQ(key, naiveKey("veh-1", day)) << "day " << day;
+    }
+}
+
+TEST(KeyCheckpointIndexTest, LookupCostIsBoundedByInterval) {
+    KeyCheckpointIndex index(16);
+    index.addVehicle("veh-1", MASTER, sizeof(MASTER), START);
+    index.extendAll(START + 3 * 365 * (uint64_t)SECONDS_PER_DAY);
+
+    for (uint64_t day = 500; day < 600; day++) {
+        uint64_t before = index.hashCount();
+        KeyCheckpointIndex::Key key;
+        ASSERT_TRUE(index.keyFor("veh-1", START + day * SECONDS_PER_DAY, key));
+        EXPECT_LT(index.hashCount() - before, 16u);
+    }
+}
+
+TEST(KeyCheckpointIndexTest, RangeMatchesSingleLookups) {
+    KeyCheckpointIndex index(10);
+    index.addVehicle("veh-2", MASTER, sizeof(MASTER), START);
+    std::vector<KeyCheckpointIndex::Key> keys;
+    ASSERT_TRUE(index.keysForRange("veh-2", START + 25 * SECONDS_PER_DAY, START + 44 * SECONDS_PER_DAY, keys));
+    ASSERT_EQ(keys.size(), 20u);
+    EXPECT_EQ(keys.front(), naiveKey("veh-2", 25));
+    EXPECT_EQ(keys.back(), naiveKey("veh-2", 44));
+}
+
+TEST(KeyCheckpointIndexTest, RejectsUnknownVehicleAndDaysBeforeStart) {
+    KeyCheckpointIndex index;
+    index.addVehicle("veh-1", MASTER, sizeof(MASTER), START);
+    KeyCheckpointIndex::Key key;
+    EXPECT_FALSE(index.keyFor("nope", START, key));
+    EXPECT_FALSE(index.keyFor("veh-1", START - 1, key));
+
+    std::vector<KeyCheckpointIndex::Key> keys;
+    EXPECT_FALSE(index.keysForRange("veh-1", START - SECONDS_PER_DAY, START + SECONDS_PER_DAY, keys));
+    EXPECT_TRUE(keys.empty());
+}
+
+TEST(KeyCheckpointIndexTest, SaveAndLoadWithoutMasterKeys) {
+    std::string path = (std::filesystem::temp_directory_path() / ("bbx-keyindex-" + std::to_string(getpid()))).string();
+    {
+        KeyCheckpointIndex index(8);
+        index.addVehicle("veh-1", MASTER, sizeof(MASTER), START);
+        index.extendAll(START + 200 * SECONDS_PER_DAY);
+        ASSERT_TRUE(index.save(path));
+    }
+    KeyCheckpointIndex loaded;
+    ASSERT_TRUE(loaded.load(path));
+    EXPECT_EQ(loaded.interval(), 8u);
+    KeyCheckpointIndex::Key key;
+    ASSERT_TRUE(loaded.keyFor("veh-1", START + 150 * SECONDS_PER_DAY, key));
+    EXPECT_EQ(key, naiveKey("veh-1", 150));
+    EXPECT_LT(loaded.hashCount(), 8u);
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include "key_service.h"
+
+namespace {
+
+constexpr uint64_t START = 1742860800;  // 2025-03-25 00:00:00 UTC
+const uint8_t MASTER[32] = {0xe1, 0x7c, 0x9d, 0x5c, 0x6c, 0x7b, 0xc8, 0x41, 0x23, 0xc0, 0xa4,
+                            0xca, 0xee, 0xf5, 0x3d, 0x4f, 0x24, 0x6f, 0xb8, 0xce, 0x22, 0xf3,
+                            0x9a, 0xad, 0x71, 0xbc, 0x5d, 0xde, 0x2e, 0x98, 0x29, 0x21};
+
+DailyKeyService::Key naiveKey(const std::string& vid, uint64_t day, uint64_t start = START) {
+    DailyKeyService::Key key;
+    keychain::deriveInitial(MASTER, sizeof(MASTER), (const uint8_t*)vid.data(), vid.size(), start, key.data());
+    keychain::advance(key.data(), (const uint8_t*)vid.data(), vid.size(), start, START + day * SECONDS_PER_DAY);
+    return key;
+}
+
+std::string vid(int i) { return "veh-" + std::to_string(i); }
+
+}  // namespace
+
+TEST(DailyKeyServiceTest, ServesWindowFromCacheAndTheRestByWalking) {
+    KeyServiceConfig cfg;
+    cfg.shards = 4;
+    cfg.threads = 3;
+    cfg.checkpointInterval = 8;
+    DailyKeyService service(cfg);
+    for (int i = 0; i < 50; i++) service.addVehicle(vid(i), MASTER, sizeof(MASTER), START);
+
+    DailyKeyService::Key key;
+    EXPECT_EQ(service.keyFor(vid(3), START + 40000, key), KeyLookup::Derived);  // nothing precomputed yet
+    EXPECT_EQ(key, naiveKey(vid(3), 0));
+
+    // Day 100: days 98..101 resident, everything else still right
+    EXPECT_EQ(service.precompute(START + 100 * SECONDS_PER_DAY + 5000), 50u * 101);
+    DailyKeyService::Stats st = service.stats();
+    EXPECT_EQ(st.residentKeys, 50u * 4);
+    EXPECT_EQ(st.windowFirstDay, START + 98 * SECONDS_PER_DAY);
+    EXPECT_EQ(st.windowLastDay, START + 101 * SECONDS_PER_DAY);
+    for (int i = 0; i < 50; i += 7) {
+        for (uint64_t day : {98, 100, 101}) {
+            ASSERT_EQ(service.keyFor(vid(i), START + day * SECONDS_PER_DAY + 86399, key), KeyLookup::Hit);
+            EXPECT_EQ(key, naiveKey(vid(i), day)) << i << " day " << day;
+        }
+        for (uint64_t day : {0, 9, 97, 140}) {
+            ASSERT_EQ(service.keyFor(vid(i), START + day * SECONDS_PER_DAY, key), KeyLookup::Derived);
+            EXPECT_EQ(key, naiveKey(vid(i), day)) << i << " day " << day;
+        }
+    }
+
+    // Midnight: one hash per vehicle, the oldest day leaves the cache
+    EXPECT_EQ(service.precompute(START + 101 * SECONDS_PER_DAY), 50u);
+    EXPECT_EQ(service.keyFor(vid(8), START + 98 * SECONDS_PER_DAY, key), KeyLookup::Derived);
+    ASSERT_EQ(service.keyFor(vid(8), START + 102 * SECONDS_PER_DAY, key), KeyLookup::Hit);
+    EXPECT_EQ(key, naiveKey(vid(8), 102));
+    EXPECT_EQ(service.stats().residentKeys, 50u * 4);
+
+    EXPECT_EQ(service.keyFor("nope", START, key), KeyLookup::UnknownVehicle);
+    EXPECT_EQ(service.keyFor(vid(1), START - 1, key), KeyLookup::BeforeStart);
+}
+
+TEST(DailyKeyServiceTest, VehiclesAddedOrReplacedLaterJoinTheWindow) {
+    KeyServiceConfig cfg;
+    cfg.shards = 2;
+    DailyKeyService service(cfg);
+    service.addVehicle("veh-a", MASTER, sizeof(MASTER), START);
+    service.precompute(START + 10 * SECONDS_PER_DAY);
+
+    // A vehicle registered today with today's start: only its own days are there
+    const uint64_t late = START + 10 * SECONDS_PER_DAY + 3600;
+    service.addVehicle("veh-b", MASTER, sizeof(MASTER), late);
+    DailyKeyService::Key key;
+    ASSERT_EQ(service.keyFor("veh-b", late, key), KeyLookup::Hit);
+    EXPECT_EQ(key, naiveKey("veh-b", 10, late));
+    EXPECT_EQ(service.keyFor("veh-b", late - SECONDS_PER_DAY, key), KeyLookup::BeforeStart);
+    EXPECT_EQ(service.stats().residentKeys, 4u + 2u);
+
+    // New master key: the old keys are gone
+    uint8_t other[32] = {9};
+    service.addVehicle("veh-a", other, sizeof(other), START);
+    ASSERT_EQ(service.keyFor("veh-a", START + 10 * SECONDS_PER_DAY, key), KeyLookup::Hit);
+    EXPECT_NE(key, naiveKey("veh-a", 10));
+    EXPECT_EQ(service.stats().residentKeys, 4u + 2u);
+    EXPECT_EQ(service.stats().vehicles, 2u);
+}
+
+TEST(DailyKeyServiceTest, LookupsDuringPrecomputeStayCorrect) {
+    KeyServiceConfig cfg;
+    cfg.shards = 8;
+    cfg.threads = 2;
+    DailyKeyService service(cfg);
+    for (int i = 0; i < 200; i++) service.addVehicle(vid(i), MASTER, sizeof(MASTER), START);
+    service.precompute(START + 20 * SECONDS_PER_DAY);
+    std::vector<DailyKeyService::Key> expected;
+    for (uint64_t day = 0; day < 30; day++) expected.push_back(naiveKey(vid(7), day));
+
+    std::atomic<bool> stop{false};
+    std::atomic<int> wrong{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; t++) {
+        readers.emplace_back([&, t] {
+            DailyKeyService::Key key;
+            for (uint64_t n = t; !stop; n++) {
+                uint64_t day = 15 + n % 15;
+                service.keyFor(vid(7), START + day * SECONDS_PER_DAY, key);
+                if (key != expected[day]) wrong++;
+            }
+        });
+    }
+    for (uint64_t day = 21; day < 28; day++) service.precompute(START + day * SECONDS_PER_DAY);
+    stop = true;
+    for (auto& t : readers) t.join();
+    EXPECT_EQ(wrong, 0);
+    EXPECT_GT(service.stats().hits, 0u);
+}
+
+TEST(DailyKeyServiceTest, LineProtocol) {
+    DailyKeyService service;
+    std::string masterHex = "e17c9d5c6c7bc84123c0a4caeef53d4f246fb8ce22f39aad71bc5dde2e982921";
+    EXPECT_EQ(keyServiceRequest(service, "ADD veh-1 " + masterHex + " 1742860800"), "OK");
+    EXPECT_EQ(keyServiceRequest(service, "ADD veh-2 abc"), "ERR bad_vehicle");
+    service.precompute(START + 2 * SECONDS_PER_DAY);
+
+    DailyKeyService::Key k = naiveKey("veh-1", 2);
+    char hex[33];
+    for (int i = 0; i < 16; i++) snprintf(hex + 2 * i, 3, "%02x", k[i]);
+    EXPECT_EQ(keyServiceRequest(service, "KEY veh-1 " + std::to_string(START + 2 * SECONDS_PER_DAY + 60)),
+              "OK " + std::string(hex) + " hit");
+    EXPECT_EQ(keyServiceRequest(service, "KEY veh-9 1742860800"), "ERR unknown_vehicle");
+    EXPECT_EQ(keyServiceRequest(service, "KEY veh-1"), "ERR bad_request");
+    EXPECT_EQ(keyServiceRequest(service, "HELLO"), "ERR bad_request");
+    std::string stats = keyServiceRequest(service, "STATS");
+    EXPECT_EQ(stats.compare(0, 14, "OK vehicles=1 "), 0) << stats;
+    EXPECT_NE(stats.find("hits=1 "), std::string::npos) << stats;
+}
@@ -0,0 +1,203 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <unistd.h>
+#include "merkle_batcher.h"
+#include "sha256.h"
+
+namespace {
+
+constexpr uint64_t START = 1742860800;  // 2025-03-25 00:00:00 UTC
+
+std::vector<MerkleHash> leaves(size_t n) {
+    std::vector<MerkleHash> out(n);
+    for (size_t i = 0; i < n; i++) {
+        uint8_t frame[4] = {(uint8_t)i, (uint8_t)(i >> 8), 0xAB, 0xCD};
+        out[i] = merkleLeaf(START + i, frame, sizeof(frame));
+    }
+    return out;
+}
+
+std::vector<uint8_t> frameOf(uint32_t counter) {
+    std::vector<uint8_t> frame(26, 0x5A);
+    for (int i = 0; i < 4; i++) frame[i] = (uint8_t)(counter >> (8 * i));
+    return frame;
+}
+
+}  // namespace
+
+TEST(MerkleTreeTest, BothHashPathsMatchTheReference) {
+    std::vector<uint8_t> data(300);
+    for (size_t i = 0; i < data.size(); i++) data[i] = (uint8_t)(i * 131 + 7);
+    const MerkleHash root = MerkleTree(leaves(37)).root();
+    for (bool portable : {false, true}) {
+        sha256::forcePortable(portable);
+        for (size_t len = 0; len <= data.size(); len++) {
+            uint8_t expected[32], got[32];
+            hal::sha256(data.data(), len, expected);
+            sha256::digest(data.data(), len, got);
+            ASSERT_EQ(memcmp(expected, got, 32), 0) << "portable " << portable << " len " << len;
+        }
+        EXPECT_EQ(MerkleTree(leaves(37)).root(), root);
+    }
+    sha256::forcePortable(false);
+}
+
+TEST(MerkleTreeTest, HashesAreDomainSeparated) {
+    uint8_t frame[3] = {1, 2, 3};
+    uint8_t buffer[12] = {0x00, 0, 0, 0, 0, 0x67, 0xE1, 0xF2, 0x00, 1, 2, 3};
+    MerkleHash expected;
+    hal::sha256(buffer, sizeof(buffer), expected.data());
+    EXPECT_EQ(merkleLeaf(START, frame, sizeof(frame)), expected);
+
+    // Three leaves: the third is promoted, not paired with itself
+    std::vector<MerkleHash> l = leaves(3);
+    MerkleTree tree(l);
+    EXPECT_EQ(tree.root(), merkleNode(merkleNode(l[0], l[1]), l[2]));
+    EXPECT_NE(tree.root(), MerkleTree(leaves(4)).root());
+    EXPECT_EQ(MerkleTree({l[0]}).root(), l[0]);
+    EXPECT_EQ(merkleHex(MerkleTree().root()), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+}
+
+TEST(MerkleTreeTest, EveryLeafProvesInLogSteps) {
+    for (size_t n : {1, 2, 3, 5, 7, 8, 9, 31, 32, 33, 1000}) {
+        MerkleTree tree(leaves(n));
+        size_t depth = 0;
+        while ((size_t)1 << depth < n) depth++;
+        for (size_t i = 0; i < n; i++) {
+            std::vector<MerkleHash> proof = tree.proof(i);
+            ASSERT_LE(proof.size(), depth) << n << " " << i;
+            ASSERT_TRUE(MerkleTree::verify(tree.leaf(i), i, n, proof, tree.root())) << n << " " << i;
+        }
+    }
+}
+
+TEST(MerkleTreeTest, ProofsDoNotTransfer) {
+    MerkleTree tree(leaves(13));
+    std::vector<MerkleHash> proof = tree.proof(6);
+    ASSERT_TRUE(MerkleTree::verify(tree.leaf(6), 6, 13, proof, tree.root()));
+    EXPECT_FALSE(MerkleTree::verify(tree.leaf(7), 6, 13, proof, tree.root()));
+    EXPECT_FALSE(MerkleTree::verify(tree.leaf(6), 7, 13, proof, tree.root()));
+    EXPECT_FALSE(MerkleTree::verify(tree.leaf(6), 6, 7, proof, tree.root()));
+    EXPECT_FALSE(MerkleTree::verify(tree.leaf(6), 13, 13, proof, tree.root()));
+    EXPECT_FALSE(MerkleTree::verify(tree.leaf(6), 6, 13, proof, tree.leaf(0)));
+    proof[1][5] ^= 1;
+    EXPECT_FALSE(MerkleTree::verify(tree.leaf(6), 6, 13, proof, tree.root()));
+    proof = tree.proof(6);
+    proof.pop_back();
+    EXPECT_FALSE(MerkleTree::verify(tree.leaf(6), 6, 13, proof, tree.root()));
+    proof = tree.proof(6);
+    proof.push_back(tree.root());
+    EXPECT_FALSE(MerkleTree::verify(tree.leaf(6), 6, 13, proof, tree.root()));
+}
+
+TEST(MerkleBatcherTest, BatchesCloseOnTheWindowOrTheSize) {
+    LocalLedger ledger;
+    std::vector<MerkleBatch> sealed;
+    MerkleBatcherConfig cfg;
+    cfg.windowSeconds = 60;
+    cfg.maxLeaves = 50;
+    MerkleBatcher batcher(ledger, cfg, [&](const MerkleBatch& b) { sealed.push_back(b); });
+
+    // veh-a: a frame every 10 s for 100 s; veh-b: 120 frames in one second, later
+    for (uint32_t i = 0; i < 10; i++) {
+        std::vector<uint8_t> f = frameOf(i);
+        batcher.add("veh-a", START + 10 * i, f.data(), f.size());
+    }
+    for (uint32_t i = 0; i < 120; i++) {
+        std::vector<uint8_t> f = frameOf(i);
+        batcher.add("veh-b", START + 100, f.data(), f.size());
+    }
+    // veh-a's first minute closed on its 7th frame, veh-b filled two batches
+    ASSERT_EQ(ledger.records().size(), 3u);
+    EXPECT_EQ(batcher.openFrames(), 4u + 20u);
+    EXPECT_EQ(batcher.sealDue(START + 89), 0u);
+    EXPECT_EQ(batcher.sealDue(START + 120), 1u);  // veh-a's second minute
+    EXPECT_EQ(batcher.sealAll(), 1u);
+    EXPECT_EQ(batcher.openFrames(), 0u);
+    ASSERT_EQ(sealed.size(), 5u);
+
+    const MerkleAnchor& a0 = ledger.records()[0];
+    EXPECT_EQ(a0.vehicleId, "veh-a");
+    EXPECT_EQ(a0.sequence, 0u);
+    EXPECT_EQ(a0.leaves, 6u);
+    EXPECT_EQ(a0.firstEpoch, START);
+    EXPECT_EQ(a0.lastEpoch, START + 50);
+    EXPECT_EQ(ledger.records()[1].vehicleId, "veh-b");
+    EXPECT_EQ(ledger.records()[1].leaves, 50u);
+    EXPECT_EQ(ledger.records()[2].sequence, 1u);
+    EXPECT_EQ(ledger.records()[3].sequence, 1u);
+    EXPECT_EQ(ledger.records()[3].leaves, 4u);
+    EXPECT_EQ(ledger.records()[4].leaves, 20u);
+
+    // Every frame has a receipt that checks against its anchored root
+    size_t checked = 0;
+    for (const MerkleBatch& b : sealed) {
+        std::string reference;
+        ASSERT_TRUE(ledger.find(b.anchor.root, reference));
+        EXPECT_EQ(reference, b.reference);
+        uint32_t first = b.anchor.vehicleId == "veh-a" ? (uint32_t)b.anchor.sequence * 6
+                                                       : (uint32_t)b.anchor.sequence * 50;
+        for (size_t i = 0; i < b.anchor.leaves; i++, checked++) {
+            MerkleReceipt r = b.receipt(i);
+            std::vector<uint8_t> f = frameOf(first + (uint32_t)i);
+            ASSERT_TRUE(r.verify(b.receiveEpochs[i], f.data(), f.size()));
+            EXPECT_FALSE(r.verify(b.receiveEpochs[i] + 1, f.data(), f.size()));
+        }
+    }
+    EXPECT_EQ(checked, 130u);
+}
+
+TEST(MerkleBatcherTest, FailedAnchorsAreRetriedInOrder) {
+    LocalLedger ledger;
+    MerkleBatcherConfig cfg;
+    cfg.windowSeconds = 10;
+    MerkleBatcher batcher(ledger, cfg);
+    std::vector<uint8_t> f = frameOf(1);
+    ledger.failNext(3);
+    for (uint32_t s = 0; s < 40; s++) batcher.add("veh-a", START + s, f.data(), f.size());
+    // Every attempt so far failed: the batches of 0-9, 10-19 and 20-29 wait in order
+    EXPECT_EQ(ledger.records().size(), 0u);
+    EXPECT_EQ(batcher.pendingBatches(), 3u);
+
+    EXPECT_EQ(batcher.sealDue(START + 50), 4u);
+    EXPECT_EQ(batcher.pendingBatches(), 0u);
+    EXPECT_EQ(batcher.anchoredBatches(), 4u);
+    ASSERT_EQ(ledger.records().size(), 4u);
+    for (uint64_t i = 0; i < 4; i++) {
+        EXPECT_EQ(ledger.records()[i].sequence, i);
+        EXPECT_EQ(ledger.records()[i].firstEpoch, START + 10 * i);
+    }
+}
+
+TEST(MerkleBatcherTest, AnchorPayloadAndLedgerLog) {
+    std::string log = (std::filesystem::temp_directory_path() / ("bbx-ledger-" + std::to_string(getpid()))).string();
+    std::filesystem::remove(log);
+    {
+        LocalLedger ledger(log);
+        MerkleBatcher batcher(ledger);
+        FrameBatch batch;
+        std::vector<uint8_t> f = frameOf(7);
+        batch.add("veh-a", START + 3, f.data(), f.size());
+        batch.add("veh-a", START + 4, f.data(), f.size());
+        batcher.add(batch);
+        ASSERT_EQ(batcher.sealAll(), 1u);
+
+        const MerkleAnchor& a = ledger.records()[0];
+        auto p = a.payload();
+        EXPECT_EQ(p[0], 'M');
+        EXPECT_EQ(p[1], 1);
+        EXPECT_TRUE(std::equal(a.root.begin(), a.root.end(), p.begin() + 2));
+        EXPECT_EQ(p[37], 2);     // leaves, BE32
+        EXPECT_EQ(p[45], 0);     // sequence, BE64
+        EXPECT_EQ(p[52], 0xF2);  // first epoch 0x67E1F203, BE64
+        EXPECT_EQ(p[53], 0x03);
+        EXPECT_EQ(p[61], 0x04);  // last epoch
+    }
+    std::ifstream in(log);
+    std::string line;
+    ASSERT_TRUE(std::getline(in, line));
+    EXPECT_EQ(line.rfind("local:0,veh-a,0,1742860803,1742860804,2,", 0), 0u);
+    EXPECT_EQ(line.size(), std::string("local:0,veh-a,0,1742860803,1742860804,2,").size() + 64);
+    std::filesystem::remove(log);
+}
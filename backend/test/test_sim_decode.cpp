@@ -0,0 +1,175 @@
+// The simulators' output through the backend: every frame must decrypt
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <unistd.h>
+#include "aes128.h"
+#include "fleet_sim.h"
+#include "frame_decoder.h"
+
+namespace {
+
+std::vector<uint8_t> fromHex(const std::string& hex) {
+    std::vector<uint8_t> out;
+    for (size_t i = 0; i + 1 < hex.size(); i += 2) out.push_back((uint8_t)std::stoul(hex.substr(i, 2), nullptr, 16));
+    return out;
+}
+
+}  // namespace
+
+TEST(SimDecodeTest, FleetDecodesAcrossRebootsAndDays) {
+    FleetConfig cfg;
+    cfg.vehicles = 16;
+    cfg.threads = 2;
+    cfg.durationS = 3 * 86400;
+    cfg.rebootsPerDay = 3;
+    cfg.startEpoch = 1742860800 + 20 * 3600;  // the first midnight comes early
+    for (bool compact : {false, true}) {
+        cfg.compact = compact;
+        FleetSimulator fleet(cfg);
+        KeyCheckpointIndex index;
+        for (const FleetVehicle& v : fleet.vehicles()) {
+            std::vector<uint8_t> master = fromHex(v.masterKeyHex);
+            index.addVehicle(v.id, master.data(), master.size(), v.startEpoch);
+        }
+        FrameBatch batch;
+        fleet.run([&](const SimUplink& up) {
+            batch.addUplink(up.deviceId, up.atMillis / 1000, up.port, up.payload.data(), up.payload.size());
+        });
+
+        FleetStats st = fleet.stats();
+        EXPECT_GT(st.reboots, 16u);
+        EXPECT_EQ(st.keyRollovers, 3u * 16);
+        std::vector<DecodedFrame> out;
+        FrameDecoder decoder(index, 2);
+        size_t ok = decoder.decode(batch, out);
+        EXPECT_GT(out.size(), st.frames - 16 * 8);  // at most a batch per vehicle still pending
+        EXPECT_EQ(ok, out.size()) << "compact=" << compact;
+    }
+}
+
+TEST(SimDecodeTest, HighRateCountersNeverRepeatAKeystreamBlock) {
+    // 100 Hz from 23:40 to 00:20: 120,000 frames before midnight, a reboot
+    // every few minutes, and vehicle 0 out of coverage for 80,000 frames
+    FleetConfig cfg;
+    cfg.vehicles = 2;
+    cfg.threads = 2;
+    cfg.readingIntervalMs = 10;
+    cfg.bypassRadio = true;
+    cfg.startEpoch = 1742860800 + 23 * 3600 + 40 * 60;
+    cfg.durationS = 40 * 60;
+    cfg.rebootsPerDay = 500;
+    cfg.maxOffS = 20;
+    cfg.sliceS = 60;
+    FleetSimulator fleet(cfg);
+    KeyCheckpointIndex index;
+    for (const FleetVehicle& v : fleet.vehicles()) {
+        std::vector<uint8_t> master = fromHex(v.masterKeyHex);
+        index.addVehicle(v.id, master.data(), master.size(), v.startEpoch);
+    }
+
+    // Decoded in batches, so the counters carry across decode() calls
+    FrameDecoder decoder(index, 2);
+    FrameBatch batch;
+    std::vector<DecodedFrame> out;
+    std::vector<std::array<uint8_t, 16>> keystream;
+    std::map<std::string, std::set<uint32_t>> oldIVs;  // vehicle:day -> IVs of the 2-byte scheme
+    size_t frames = 0, oldRepeats = 0;
+    auto decodeBatch = [&]() {
+        size_t ok = decoder.decode(batch, out);
+        EXPECT_EQ(ok, out.size());
+        for (size_t i = 0; i < out.size(); i++) {
+            const DecodedFrame& f = out[i];
+            // The counter must rebuild the keystream the frame was encrypted with
+            bool found = false;
+            for (uint64_t day = f.timestamp / SECONDS_PER_DAY; !found && day + 1 >= f.timestamp / SECONDS_PER_DAY;
+                 day--) {
+                KeyCheckpointIndex::Key key;
+                if (!index.keyFor(batch.vehicleIds()[f.vehicle], day * SECONDS_PER_DAY, key)) continue;
+                alignas(16) uint8_t block[16];
+                std::array<uint8_t, 16> ks;
+                frameCounterBlock(f.counter, block);
+                Aes128(key.data()).encryptBlocks(block, ks.data(), 1);
+                uint8_t plain[ENCRYPTED_BLOCK_LEN];
+                for (size_t b = 0; b < ENCRYPTED_BLOCK_LEN; b++) {
+                    plain[b] = batch.frame(i)[FRAME_ENCRYPTED_OFFSET + b] ^ ks[b];
+                }
+                if (plain[0] != MARKER_ACCEL || plain[7] != MARKER_GPS || memcmp(plain + 8, &f.lat, 4) != 0) continue;
+                found = true;
+                keystream.push_back(ks);
+                auto& ivs = oldIVs[batch.vehicleIds()[f.vehicle] + ":" + std::to_string(day)];
+                oldRepeats += !ivs.insert(f.counter & 0xFFFF).second;
+            }
+            EXPECT_TRUE(found) << "frame " << frames + i << " counter " << f.counter;
+        }
+        frames += out.size();
+        batch.clear();
+    };
+    const std::string& unreachable = fleet.vehicles()[0].id;
+    const uint64_t gapFrom = cfg.startEpoch * 1000 + 300000, gapTo = gapFrom + 800000;
+    fleet.run([&](const SimUplink& up) {
+        if (up.deviceId == unreachable && up.atMillis >= gapFrom && up.atMillis < gapTo) return;
+        batch.addUplink(up.deviceId, up.atMillis / 1000, up.port, up.payload.data(), up.payload.size());
+        if (batch.size() >= 50000) decodeBatch();
+    });
+    decodeBatch();
+
+    FleetStats st = fleet.stats();
+    EXPECT_GT(st.reboots, 2u * cfg.vehicles);
+    EXPECT_EQ(st.keyRollovers, cfg.vehicles);
+    EXPECT_GT(frames, 300000u);
+    ASSERT_EQ(keystream.size(), frames);
+    std::sort(keystream.begin(), keystream.end());
+    EXPECT_EQ(std::adjacent_find(keystream.begin(), keystream.end()), keystream.end());
+    // The 2-byte IV would have reused keystream blocks many times over
+    EXPECT_GT(oldRepeats, 100000u);
+}
+
+#ifdef BBSIM_PATH
+TEST(SimDecodeTest, SketchRunDecodes) {
+    std::string dir = (std::filesystem::temp_directory_path() / ("bbx-bbsim-" + std::to_string(getpid()))).string();
+    std::string csv = dir + ".csv";
+    std::string cmd = std::string(BBSIM_PATH) + " -s " + dir + " -f csv -o " + csv + " " + BBSIM_SCENARIO + " 2>&1";
+    FILE* p = popen(cmd.c_str(), "r");
+    ASSERT_NE(p, nullptr);
+    char summary[256] = {0};
+    while (fgets(summary, sizeof(summary), p)) {
+    }
+    ASSERT_EQ(pclose(p), 0) << summary;
+    EXPECT_NE(std::string(summary).find("3 boot(s)"), std::string::npos) << summary;
+
+    const uint8_t master[32] = {0xe1, 0x7c, 0x9d, 0x5c, 0x6c, 0x7b, 0xc8, 0x41, 0x23, 0xc0, 0xa4,
+                                0xca, 0xee, 0xf5, 0x3d, 0x4f, 0x24, 0x6f, 0xb8, 0xce, 0x22, 0xf3,
+                                0x9a, 0xad, 0x71, 0xbc, 0x5d, 0xde, 0x2e, 0x98, 0x29, 0x21};
+    KeyCheckpointIndex index;
+    index.addVehicle("veh-sim-01", master, sizeof(master), 1742860800);
+    FrameBatch batch;
+    std::ifstream in(csv);
+    std::string line;
+    std::map<uint64_t, int> days;
+    while (std::getline(in, line)) {
+        std::stringstream ss(line);
+        std::string id, ts, hex, port;
+        std::getline(ss, id, ',');
+        std::getline(ss, ts, ',');
+        std::getline(ss, hex, ',');
+        std::getline(ss, port, ',');
+        std::vector<uint8_t> data = fromHex(hex);
+        batch.addUplink(id, std::stoull(ts), (uint8_t)std::stoi(port), data.data(), data.size());
+        days[std::stoull(ts) / 86400]++;
+    }
+    std::filesystem::remove_all(dir);
+    std::filesystem::remove(csv);
+
+    std::vector<DecodedFrame> out;
+    FrameDecoder decoder(index, 1);
+    size_t ok = decoder.decode(batch, out);
+    EXPECT_EQ(days.size(), 2u);  // the scenario crosses midnight
+    EXPECT_GT(out.size(), 100u);
+    EXPECT_EQ(ok, out.size());
+}
+#endif
@@ -0,0 +1,193 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <unistd.h>
+#include "telemetry_archive.h"
+
+namespace {
+
+constexpr uint64_t DAY = 1742860800;  // 2025-03-25 00:00:00 UTC
+constexpr uint32_t BLOCK = TelemetryArchive::BLOCK_ROWS;
+
+ArchivedFrame row(uint64_t timestamp, uint32_t counter, uint16_t accel) {
+    ArchivedFrame f;
+    f.timestamp = timestamp;
+    f.counter = counter;
+    f.temperature = (int8_t)(counter % 60 - 20);
+    f.gyro[0] = (int8_t)(counter % 7);
+    f.gyro[1] = -(int8_t)(counter % 5);
+    f.gyro[2] = 3;
+    f.accel = accel;
+    f.accelRms = accel / 2;
+    f.jerk = (uint16_t)(counter % 300);
+    f.lat = 454600000 + (int32_t)counter;
+    f.lon = -91900000 - (int32_t)counter;
+    return f;
+}
+
+class TelemetryArchiveTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        root = (std::filesystem::temp_directory_path() / ("bbx-archive-" + std::to_string(getpid()))).string();
+        std::filesystem::remove_all(root);
+    }
+    void TearDown() override { std::filesystem::remove_all(root); }
+
+    static std::vector<ArchivedFrame> collect(TelemetryArchive& archive, const ArchiveQuery& query,
+                                              ArchiveScanStats* stats = nullptr) {
+        std::vector<ArchivedFrame> rows;
+        ArchiveScanStats s = archive.scan(query, [&](const std::string&, const ArchivedFrame& f) { rows.push_back(f); });
+        if (stats) *stats = s;
+        return rows;
+    }
+
+    std::string root;
+};
+
+}  // namespace
+
+TEST_F(TelemetryArchiveTest, RowsComeBackAcrossVehiclesDaysAndReopens) {
+    const uint32_t n = 2 * BLOCK + 100;
+    {
+        TelemetryArchive archive(root);
+        for (uint32_t i = 0; i < n; i++) {
+            ASSERT_TRUE(archive.append("veh-a", row(DAY + i * 5, i, (uint16_t)(900 + i % 200))));
+            ASSERT_TRUE(archive.append("veh-b", row(DAY + SECONDS_PER_DAY + i, i, 1000)));
+        }
+    }
+    EXPECT_TRUE(std::filesystem::exists(root + "/veh-a/" + std::to_string(DAY) + "/ts.u32"));
+
+    // A new archive picks up the unfinished block and completes it
+    TelemetryArchive archive(root);
+    EXPECT_EQ(archive.vehicles(), (std::vector<std::string>{"veh-a", "veh-b"}));
+    for (uint32_t i = n; i < 3 * BLOCK; i++) {
+        ASSERT_TRUE(archive.append("veh-a", row(DAY + i * 5, i, (uint16_t)(900 + i % 200))));
+    }
+    ArchiveQuery a;
+    a.vehicles = {"veh-a"};
+    ArchiveScanStats stats;
+    std::vector<ArchivedFrame> rows = collect(archive, a, &stats);
+    ASSERT_EQ(rows.size(), 3u * BLOCK);
+    EXPECT_EQ(stats.blocks, 3u);
+    for (uint32_t i = 0; i < rows.size(); i++) {
+        ArchivedFrame want = row(DAY + i * 5, i, (uint16_t)(900 + i % 200));
+        ASSERT_EQ(rows[i].timestamp, want.timestamp);
+        ASSERT_EQ(rows[i].counter, i);
+        ASSERT_EQ(rows[i].temperature, want.temperature);
+        ASSERT_EQ(rows[i].gyro[1], want.gyro[1]);
+        ASSERT_EQ(rows[i].accel, want.accel);
+        ASSERT_EQ(rows[i].accelRms, want.accelRms);
+        ASSERT_EQ(rows[i].jerk, want.jerk);
+        ASSERT_EQ(rows[i].lat, want.lat);
+        ASSERT_EQ(rows[i].lon, want.lon);
+    }
+    EXPECT_EQ(archive.count(ArchiveQuery()).rowsMatched, 3u * BLOCK + n);
+}
+
+TEST_F(TelemetryArchiveTest, TimeRangeReadsOnlyItsBlocks) {
+    // One frame a second for a whole day: 21 complete blocks and a tail
+    TelemetryArchive archive(root);
+    for (uint32_t s = 0; s < SECONDS_PER_DAY; s++) ASSERT_TRUE(archive.append("veh-a", row(DAY + s, s, 1000)));
+
+    ArchiveQuery q;
+    q.vehicles = {"veh-a"};
+    q.from = DAY + 14 * 3600;
+    q.to = DAY + 15 * 3600;
+    ArchiveScanStats stats;
+    std::vector<ArchivedFrame> rows = collect(archive, q, &stats);
+    ASSERT_EQ(rows.size(), 3600u);
+    EXPECT_EQ(rows.front().timestamp, q.from);
+    EXPECT_EQ(rows.back().timestamp, q.to - 1);
+    EXPECT_EQ(stats.blocks, SECONDS_PER_DAY / BLOCK);
+    // The blocks either side of the hour are cut by the index; the tail is always scanned
+    EXPECT_LE(stats.rowsScanned, 2u * BLOCK + SECONDS_PER_DAY % BLOCK);
+    EXPECT_GE(stats.blocksSkipped, stats.blocks - 2);
+
+    // Other days and other vehicles are not opened
+    q.from = DAY + SECONDS_PER_DAY;
+    q.to = DAY + 2 * SECONDS_PER_DAY;
+    EXPECT_EQ(archive.count(q).partitions, 0u);
+    q.vehicles = {"veh-z"};
+    ArchiveQuery all;
+    all.vehicles = q.vehicles;
+    EXPECT_EQ(archive.count(all).rowsMatched, 0u);
+}
+
+TEST_F(TelemetryArchiveTest, FiltersUseTheBlockStats) {
+    // Quiet driving, one pothole in block 5 and frames still in the tail
+    TelemetryArchive archive(root);
+    const uint32_t n = 10 * BLOCK + 50;
+    for (uint32_t i = 0; i < n; i++) {
+        uint16_t accel = (uint16_t)(950 + i % 100);
+        if (i >= 5 * BLOCK + 10 && i < 5 * BLOCK + 13) accel = 4000;
+        if (i == n - 1) accel = 3500;
+        ASSERT_TRUE(archive.append("veh-a", row(DAY + i, i, accel)));
+    }
+
+    ArchiveQuery q;
+    q.filters = {{ArchiveColumn::Accel, 3000, INT64_MAX}};
+    ArchiveScanStats stats;
+    std::vector<ArchivedFrame> rows = collect(archive, q, &stats);
+    ASSERT_EQ(rows.size(), 4u);
+    EXPECT_EQ(rows[0].counter, 5 * BLOCK + 10);
+    EXPECT_EQ(rows[3].counter, n - 1);
+    EXPECT_EQ(stats.blocksSkipped, 9u);
+    EXPECT_EQ(stats.rowsScanned, BLOCK + 50u);
+
+    // A range holding whole blocks counts them from the stats
+    q.filters = {{ArchiveColumn::Accel, 900, 1100}, {ArchiveColumn::Temperature, -128, 127}};
+    stats = archive.count(q);
+    EXPECT_EQ(stats.rowsMatched, n - 4u);
+    EXPECT_EQ(stats.blocksWhole, 9u);
+
+    // Filters combine with each other and with the time range, in epoch seconds
+    q.filters = {{ArchiveColumn::Accel, 1000, 1049}, {ArchiveColumn::Timestamp, 0, (int64_t)DAY + 999}};
+    q.from = DAY + 500;
+    size_t expected = 0;
+    for (uint32_t i = 500; i < 1000; i++) expected += i % 100 >= 50;
+    EXPECT_EQ(archive.count(q).rowsMatched, expected);
+}
+
+TEST_F(TelemetryArchiveTest, ReopenRepairsATornAppend) {
+    {
+        TelemetryArchive archive(root);
+        for (uint32_t i = 0; i < BLOCK + 10; i++) ASSERT_TRUE(archive.append("veh-a", row(DAY + i, i, 1000)));
+    }
+    // A crash after some columns of the last rows were written
+    std::string dir = root + "/veh-a/" + std::to_string(DAY);
+    std::filesystem::resize_file(dir + "/lat.i32", (BLOCK + 7) * 4);
+    std::filesystem::resize_file(dir + "/blocks.idx", std::filesystem::file_size(dir + "/blocks.idx") - 1);
+
+    TelemetryArchive archive(root);
+    ArchiveScanStats stats = archive.count(ArchiveQuery());
+    EXPECT_EQ(stats.rowsMatched, BLOCK + 7u);
+    EXPECT_EQ(stats.blocks, 0u);  // the stats record is incomplete
+
+    // Appending truncates the other columns to match and rebuilds the stats
+    ASSERT_TRUE(archive.append("veh-a", row(DAY + BLOCK + 7, BLOCK + 7, 1000)));
+    std::vector<ArchivedFrame> rows = collect(archive, ArchiveQuery(), &stats);
+    ASSERT_EQ(rows.size(), BLOCK + 8u);
+    EXPECT_EQ(stats.blocks, 1u);
+    EXPECT_EQ(rows.back().counter, BLOCK + 7);
+    EXPECT_EQ(rows.back().lat, 454600000 + (int32_t)BLOCK + 7);
+}
+
+TEST_F(TelemetryArchiveTest, KeepsDecodedFramesOnly) {
+    TelemetryArchive archive(root);
+    EXPECT_FALSE(archive.append("../escape", row(DAY, 1, 1000)));
+    EXPECT_FALSE(archive.append("", row(DAY, 1, 1000)));
+
+    FrameBatch batch;
+    batch.vehicle("veh-a");
+    std::vector<DecodedFrame> frames(3);
+    for (uint32_t i = 0; i < frames.size(); i++) {
+        static_cast<SensorReading&>(frames[i]) = row(DAY + i, i, 1000);
+        frames[i].timestamp = DAY + i;
+        frames[i].vehicle = 0;
+        frames[i].counter = 70000 + i;
+        frames[i].status = i == 1 ? FrameStatus::WrongKey : FrameStatus::Ok;
+    }
+    EXPECT_EQ(archive.append(batch, frames), 2u);
+    std::vector<ArchivedFrame> rows = collect(archive, ArchiveQuery());
+    ASSERT_EQ(rows.size(), 2u);
+    EXPECT_EQ(rows[1].counter, 70002u);
+}
@@ -0,0 +1,160 @@
+// bbanchor - Batches uplinked frames into per-vehicle Merkle roots
+//
+//   bbanchor [-w windowSeconds] [-n maxFrames] [-l ledger.csv] [-p proofs.csv] [frames.csv]
+//
+// frames.csv: vehicleId,receiveEpoch,payloadHex[,fPort]  (as for bbdecode; stdin when
+//             no file is given; fPort 2 uplinks are split into their frames)
+//
+// Frames are batched per vehicle in windows of receive time (default 300 s)
+// and each batch's root is anchored to the local ledger (merkle_batcher.h),
+// which stands in for the chain. Prints one line per anchored batch:
+//   reference,vehicle_id,sequence,first_epoch,last_epoch,frames,root,record
+// where record is the hex of the on-chain record (MerkleAnchor::payload()).
+// -l appends the ledger to a file; -p writes every frame's receipt:
+//   vehicle_id,receive_epoch,frame,reference,sequence,index,frames,root,proof
+// with the proof's hashes joined by ':'.
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include "merkle_batcher.h"
+#include "sha256.h"
+
+namespace {
+
+int hexNibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool parseHex(const std::string& hex, std::vector<uint8_t>& out) {
+    out.clear();
+    if (hex.size() % 2) return false;
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        int hi = hexNibble(hex[i]), lo = hexNibble(hex[i + 1]);
+        if (hi < 0 || lo < 0) return false;
+        out.push_back((uint8_t)(hi << 4 | lo));
+    }
+    return true;
+}
+
+std::string toHex(const uint8_t* data, size_t len) {
+    static const char digits[] = "0123456789abcdef";
+    std::string out;
+    for (size_t i = 0; i < len; i++) {
+        out += digits[data[i] >> 4];
+        out += digits[data[i] & 15];
+    }
+    return out;
+}
+
+std::vector<std::string> splitCsv(const std::string& line) {
+    std::vector<std::string> fields;
+    std::stringstream ss(line);
+    std::string field;
+    while (std::getline(ss, field, ',')) {
+        while (!field.empty() && (field.back() == '\r' || field.back() == ' ')) field.pop_back();
+        while (!field.empty() && field.front() == ' ') field.erase(0, 1);
+        fields.push_back(field);
+    }
+    return fields;
+}
+
+void usage() {
+    fprintf(stderr,
+            "usage: bbanchor [-w windowSeconds] [-n maxFrames] [-l ledger.csv] [-p proofs.csv] [frames.csv]\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    MerkleBatcherConfig cfg;
+    std::string ledgerPath, proofsPath;
+    int opt;
+    while ((opt = getopt(argc, argv, "w:n:l:p:h")) != -1) {
+        switch (opt) {
+            case 'w': cfg.windowSeconds = (uint32_t)strtoul(optarg, nullptr, 10); break;
+            case 'n': cfg.maxLeaves = (uint32_t)strtoul(optarg, nullptr, 10); break;
+            case 'l': ledgerPath = optarg; break;
+            case 'p': proofsPath = optarg; break;
+            default: usage(); return 2;
+        }
+    }
+
+    std::ifstream file;
+    if (optind < argc) {
+        file.open(argv[optind]);
+        if (!file) {
+            fprintf(stderr, "bbanchor: cannot open %s\n", argv[optind]);
+            return 1;
+        }
+    }
+    std::istream& in = optind < argc ? file : std::cin;
+
+    FILE* proofs = nullptr;
+    if (!proofsPath.empty() && !(proofs = fopen(proofsPath.c_str(), "w"))) {
+        fprintf(stderr, "bbanchor: cannot open %s\n", proofsPath.c_str());
+        return 1;
+    }
+
+    // Frames are kept until their batch is anchored, for the receipts
+    FrameBatch batch;
+    std::string line;
+    std::vector<uint8_t> payload;
+    size_t skipped = 0;
+    while (std::getline(in, line)) {
+        std::vector<std::string> f = splitCsv(line);
+        if (f.size() < 3 || f[0].empty() || f[0][0] == '#') continue;
+        char* end;
+        uint64_t ts = strtoull(f[1].c_str(), &end, 10);
+        uint8_t port = f.size() > 3 ? (uint8_t)atoi(f[3].c_str()) : FPORT_FRAME;
+        if (*end != '\0' || !parseHex(f[2], payload) ||
+            batch.addUplink(f[0], ts, port, payload.data(), payload.size()) == 0) {
+            skipped++;
+        }
+    }
+
+    // Frame indexes of every vehicle in arrival order, matched to the leaves
+    // of its batches as they are sealed
+    std::vector<std::vector<size_t>> byVehicle(batch.vehicleIds().size());
+    std::vector<size_t> nextFrame(batch.vehicleIds().size(), 0);
+    for (size_t i = 0; i < batch.size(); i++) byVehicle[batch.frameVehicle(i)].push_back(i);
+
+    printf("reference,vehicle_id,sequence,first_epoch,last_epoch,frames,root,record\n");
+    if (proofs) fprintf(proofs, "vehicle_id,receive_epoch,frame,reference,sequence,index,frames,root,proof\n");
+    LocalLedger ledger(ledgerPath);
+    MerkleBatcher batcher(ledger, cfg, [&](const MerkleBatch& b) {
+        auto record = b.anchor.payload();
+        printf("%s,%s,%llu,%llu,%llu,%u,%s,%s\n", b.reference.c_str(), b.anchor.vehicleId.c_str(),
+               (unsigned long long)b.anchor.sequence, (unsigned long long)b.anchor.firstEpoch,
+               (unsigned long long)b.anchor.lastEpoch, b.anchor.leaves, merkleHex(b.anchor.root).c_str(),
+               toHex(record.data(), record.size()).c_str());
+        if (!proofs) return;
+        uint32_t v = batch.vehicle(b.anchor.vehicleId);
+        for (size_t leaf = 0; leaf < b.anchor.leaves; leaf++) {
+            size_t i = byVehicle[v][nextFrame[v]++];
+            std::string path;
+            for (const MerkleHash& h : b.tree.proof(leaf)) path += (path.empty() ? "" : ":") + merkleHex(h);
+            fprintf(proofs, "%s,%llu,%s,%s,%llu,%zu,%u,%s,%s\n", b.anchor.vehicleId.c_str(),
+                    (unsigned long long)batch.frameTimestamp(i), toHex(batch.frame(i), batch.frameLength(i)).c_str(),
+                    b.reference.c_str(), (unsigned long long)b.anchor.sequence, leaf, b.anchor.leaves,
+                    merkleHex(b.anchor.root).c_str(), path.c_str());
+        }
+    });
+    batcher.add(batch);
+    batcher.sealAll();
+
+    fprintf(stderr, "bbanchor: %zu frames, %llu anchors, %zu unparsable lines, %zu batches not anchored (%s)\n",
+            batch.size(), (unsigned long long)batcher.anchoredBatches(), skipped, batcher.pendingBatches(),
+            sha256::hardwareAccelerated() ? "SHA-NI" : "portable SHA-256");
+    if (proofs && fclose(proofs) != 0) {
+        fprintf(stderr, "bbanchor: cannot write %s\n", proofsPath.c_str());
+        return 1;
+    }
+    return batcher.pendingBatches() ? 1 : 0;
+}
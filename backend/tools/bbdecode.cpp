@@ -0,0 +1,170 @@
+// bbdecode - Decrypts a batch of uplinked frames to CSV
+//
+//   bbdecode -k vehicles.csv [-i index.bbki] [-t threads] [-a archiveDir] [frames.csv]
+//
+// vehicles.csv: vehicleId,masterKeyHex[,startEpoch]   (start defaults to 2025-03-25)
+// frames.csv:   vehicleId,receiveEpoch,payloadHex[,fPort]  (stdin when no file is given;
+//               fPort 2 uplinks are split into their frames)
+//
+// With -i the checkpoint index is loaded from (and saved back to) the given
+// file, so only new days are hashed; -k may then be omitted. With -a the
+// decoded frames are also appended to a TelemetryArchive (query it with bbquery).
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include "aes128.h"
+#include "frame_decoder.h"
+#include "telemetry_archive.h"
+
+namespace {
+
+constexpr uint64_t DEFAULT_START_EPOCH = 1742860800;  // 2025-03-25 00:00:00 UTC
+
+int hexNibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool parseHex(const std::string& hex, std::vector<uint8_t>& out) {
+    out.clear();
+    if (hex.size() % 2) return false;
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        int hi = hexNibble(hex[i]), lo = hexNibble(hex[i + 1]);
+        if (hi < 0 || lo < 0) return false;
+        out.push_back((uint8_t)(hi << 4 | lo));
+    }
+    return true;
+}
+
+std::vector<std::string> splitCsv(const std::string& line) {
+    std::vector<std::string> fields;
+    std::stringstream ss(line);
+    std::string field;
+    while (std::getline(ss, field, ',')) {
+        while (!field.empty() && (field.back() == '\r' || field.back() == ' ')) field.pop_back();
+        while (!field.empty() && field.front() == ' ') field.erase(0, 1);
+        fields.push_back(field);
+    }
+    return fields;
+}
+
+bool loadVehicles(const std::string& path, KeyCheckpointIndex& index) {
+    std::ifstream in(path);
+    if (!in) {
+        fprintf(stderr, "bbdecode: cannot open %s\n", path.c_str());
+        return false;
+    }
+    std::string line;
+    std::vector<uint8_t> master;
+    for (size_t lineNo = 1; std::getline(in, line); lineNo++) {
+        std::vector<std::string> f = splitCsv(line);
+        if (f.empty() || f[0].empty() || f[0][0] == '#') continue;
+        if (f.size() < 2 || !parseHex(f[1], master)) {
+            fprintf(stderr, "bbdecode: %s:%zu: expected vehicleId,masterKeyHex[,startEpoch]\n", path.c_str(), lineNo);
+            return false;
+        }
+        uint64_t start = f.size() > 2 ? strtoull(f[2].c_str(), nullptr, 10) : DEFAULT_START_EPOCH;
+        index.addVehicle(f[0], master.data(), master.size(), start);
+    }
+    return true;
+}
+
+void usage() {
+    fprintf(stderr, "usage: bbdecode -k vehicles.csv [-i index.bbki] [-t threads] [-a archiveDir] [frames.csv]\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string vehiclesPath, indexPath, archivePath;
+    unsigned threads = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "k:i:t:a:h")) != -1) {
+        switch (opt) {
+            case 'k': vehiclesPath = optarg; break;
+            case 'i': indexPath = optarg; break;
+            case 't': threads = (unsigned)atoi(optarg); break;
+            case 'a': archivePath = optarg; break;
+            default: usage(); return 2;
+        }
+    }
+    if (vehiclesPath.empty() && indexPath.empty()) {
+        usage();
+        return 2;
+    }
+
+    KeyCheckpointIndex index;
+    if (!indexPath.empty()) index.load(indexPath);
+    if (!vehiclesPath.empty() && !loadVehicles(vehiclesPath, index)) return 1;
+
+    std::ifstream file;
+    if (optind < argc) {
+        file.open(argv[optind]);
+        if (!file) {
+            fprintf(stderr, "bbdecode: cannot open %s\n", argv[optind]);
+            return 1;
+        }
+    }
+    std::istream& in = optind < argc ? file : std::cin;
+
+    FrameBatch batch;
+    std::string line;
+    std::vector<uint8_t> payload;
+    size_t skipped = 0;
+    while (std::getline(in, line)) {
+        std::vector<std::string> f = splitCsv(line);
+        if (f.size() < 3 || f[0].empty() || f[0][0] == '#') continue;
+        char* end;
+        uint64_t ts = strtoull(f[1].c_str(), &end, 10);
+        uint8_t port = f.size() > 3 ? (uint8_t)atoi(f[3].c_str()) : FPORT_FRAME;
+        if (*end != '\0' || !parseHex(f[2], payload) ||
+            batch.addUplink(f[0], ts, port, payload.data(), payload.size()) == 0) {
+            skipped++;
+        }
+    }
+
+    FrameDecoder decoder(index, threads);
+    std::vector<DecodedFrame> out;
+    auto t0 = std::chrono::steady_clock::now();
+    size_t ok = decoder.decode(batch, out);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    printf("vehicle_id,timestamp,counter,status,format,temperature,gyro_x,gyro_y,gyro_z,accel_peak,accel_rms,jerk,"
+           "lat,lon\n");
+    for (const DecodedFrame& f : out) {
+        printf("%s,%llu,%u,%s,%s,%d,%.1f,%.1f,%.1f,%.2f,%.2f,%.2f,%.7f,%.7f\n", batch.vehicleIds()[f.vehicle].c_str(),
+               (unsigned long long)f.timestamp, f.counter, frameStatusName(f.status), frameFormatName(f.format),
+               f.temperature,
+               f.gyro[0] / (double)GyroField::scale, f.gyro[1] / (double)GyroField::scale,
+               f.gyro[2] / (double)GyroField::scale, f.accel / (double)AccelField::scale,
+               f.accelRms / (double)AccelField::scale, f.jerk / (double)AccelField::scale,
+               f.lat / (double)GpsField::scale, f.lon / (double)GpsField::scale);
+    }
+
+    fprintf(stderr, "bbdecode: %zu frames, %zu ok, %zu unparsable lines, %.3f s (%.0f frames/s, %u threads, %s)\n",
+            out.size(), ok, skipped, secs, secs > 0 ? out.size() / secs : 0.0, decoder.threads(),
+            Aes128::hardwareAccelerated() ? "AES-NI" : "portable AES");
+
+    if (!archivePath.empty()) {
+        TelemetryArchive archive(archivePath);
+        size_t added = archive.append(batch, out);
+        if (added != ok || !archive.flush()) {
+            fprintf(stderr, "bbdecode: cannot append to archive %s\n", archivePath.c_str());
+            return 1;
+        }
+        fprintf(stderr, "bbdecode: %zu frames archived in %s\n", added, archivePath.c_str());
+    }
+
+    if (!indexPath.empty() && !index.save(indexPath)) {
+        fprintf(stderr, "bbdecode: cannot save index to %s\n", indexPath.c_str());
+        return 1;
+    }
+    return 0;
+}
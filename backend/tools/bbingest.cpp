@@ -0,0 +1,322 @@
+// bbingest - Ingests TTN uplink JSON through the staged pipeline to CSV
+//
+//   bbingest -k vehicles.csv [-i index.bbki] [-l unix:path|tcp:port] [-c connections]
+//            [-p parseThreads] [-t decodeThreads] [-q queueDepth] [-b batchFrames]
+//            [-m batchMillis] [-d] [-a archiveDir] [uplinks.jsonl ...]
+//
+// vehicles.csv: vehicleId,masterKeyHex[,startEpoch]   (as for bbdecode)
+// uplinks:      one The Things Stack uplink message per line, as the MQTT
+//               integration publishes it (bbfleet -f json writes the same)
+//
+// The messages are replayed from the files (stdin when neither files nor -l
+// are given) or read from clients of a local socket, the stand-in for the
+// MQTT bridge: bbfleet -o unix:path connects to -l unix:path. The server
+// runs until SIGINT/SIGTERM, or with -c until that many clients have
+// disconnected. Lines go through IngestPipeline (ingest_pipeline.h); a full
+// pipeline stops the reads, so a socket client is slowed down by the kernel's
+// flow control, unless -d drops the lines instead.
+//
+// Prints the decoded frames as bbdecode does, in arrival order, and the
+// counters and stage latencies on stderr. -i and -a as for bbdecode.
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include "aes128.h"
+#include "base64.h"
+#include "ingest_pipeline.h"
+#include "telemetry_archive.h"
+
+namespace {
+
+constexpr uint64_t DEFAULT_START_EPOCH = 1742860800;  // 2025-03-25 00:00:00 UTC
+
+volatile sig_atomic_t stopRequested = 0;
+
+void onSignal(int) { stopRequested = 1; }
+
+int hexNibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool parseHex(const std::string& hex, std::vector<uint8_t>& out) {
+    out.clear();
+    if (hex.size() % 2) return false;
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        int hi = hexNibble(hex[i]), lo = hexNibble(hex[i + 1]);
+        if (hi < 0 || lo < 0) return false;
+        out.push_back((uint8_t)(hi << 4 | lo));
+    }
+    return true;
+}
+
+std::vector<std::string> splitCsv(const std::string& line) {
+    std::vector<std::string> fields;
+    std::stringstream ss(line);
+    std::string field;
+    while (std::getline(ss, field, ',')) {
+        while (!field.empty() && (field.back() == '\r' || field.back() == ' ')) field.pop_back();
+        while (!field.empty() && field.front() == ' ') field.erase(0, 1);
+        fields.push_back(field);
+    }
+    return fields;
+}
+
+bool loadVehicles(const std::string& path, KeyCheckpointIndex& index) {
+    std::ifstream in(path);
+    if (!in) {
+        fprintf(stderr, "bbingest: cannot open %s\n", path.c_str());
+        return false;
+    }
+    std::string line;
+    std::vector<uint8_t> master;
+    for (size_t lineNo = 1; std::getline(in, line); lineNo++) {
+        std::vector<std::string> f = splitCsv(line);
+        if (f.empty() || f[0].empty() || f[0][0] == '#') continue;
+        if (f.size() < 2 || !parseHex(f[1], master)) {
+            fprintf(stderr, "bbingest: %s:%zu: expected vehicleId,masterKeyHex[,startEpoch]\n", path.c_str(), lineNo);
+            return false;
+        }
+        uint64_t start = f.size() > 2 ? strtoull(f[2].c_str(), nullptr, 10) : DEFAULT_START_EPOCH;
+        index.addVehicle(f[0], master.data(), master.size(), start);
+    }
+    return true;
+}
+
+// A listening socket for "unix:<path>" or "tcp:<port>" (all interfaces)
+int listenOn(const std::string& target) {
+    int fd = -1;
+    if (target.compare(0, 5, "unix:") == 0) {
+        std::string path = target.substr(5);
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) return -1;
+        strcpy(addr.sun_path, path.c_str());
+        unlink(path.c_str());
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+            close(fd);
+            return -1;
+        }
+    } else if (target.compare(0, 4, "tcp:") == 0) {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons((uint16_t)atoi(target.c_str() + 4));
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        if (fd >= 0) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (fd >= 0 && bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    if (fd >= 0 && listen(fd, 64) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Splits what a client sends into lines
+struct Client {
+    int fd;
+    std::string pending;
+};
+
+void submitLines(IngestPipeline& pipeline, std::string& pending, bool flushAll) {
+    size_t start = 0, nl;
+    while ((nl = pending.find('\n', start)) != std::string::npos) {
+        if (nl > start) pipeline.submit(pending.data() + start, nl - start);
+        start = nl + 1;
+    }
+    pending.erase(0, start);
+    if (flushAll && !pending.empty()) {
+        pipeline.submit(pending.data(), pending.size());
+        pending.clear();
+    }
+}
+
+// Serves clients until a signal, or until maxClients have disconnected
+void serve(IngestPipeline& pipeline, int listener, size_t maxClients) {
+    std::vector<Client> clients;
+    size_t closed = 0;
+    char buf[1 << 16];
+    while (!stopRequested && (maxClients == 0 || closed < maxClients)) {
+        std::vector<pollfd> fds{{listener, POLLIN, 0}};
+        for (const Client& c : clients) fds.push_back({c.fd, POLLIN, 0});
+        if (poll(fds.data(), fds.size(), 200) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listener, nullptr, nullptr);
+            if (fd >= 0) clients.push_back({fd, std::string()});
+        }
+        for (size_t i = fds.size() - 1; i >= 1; i--) {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            Client& c = clients[i - 1];
+            ssize_t n = read(c.fd, buf, sizeof(buf));
+            if (n > 0) {
+                c.pending.append(buf, (size_t)n);
+                submitLines(pipeline, c.pending, false);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            submitLines(pipeline, c.pending, true);
+            close(c.fd);
+            clients.erase(clients.begin() + (long)(i - 1));
+            closed++;
+        }
+    }
+    for (Client& c : clients) {
+        submitLines(pipeline, c.pending, true);
+        close(c.fd);
+    }
+}
+
+void usage() {
+    fprintf(stderr,
+            "usage: bbingest -k vehicles.csv [-i index.bbki] [-l unix:path|tcp:port] [-c connections]\n"
+            "                [-p parseThreads] [-t decodeThreads] [-q queueDepth] [-b batchFrames]\n"
+            "                [-m batchMillis] [-d] [-a archiveDir] [uplinks.jsonl ...]\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string vehiclesPath, indexPath, archivePath, listenTarget;
+    size_t maxClients = 0;
+    IngestConfig cfg;
+    int opt;
+    while ((opt = getopt(argc, argv, "k:i:l:c:p:t:q:b:m:da:h")) != -1) {
+        switch (opt) {
+            case 'k': vehiclesPath = optarg; break;
+            case 'i': indexPath = optarg; break;
+            case 'l': listenTarget = optarg; break;
+            case 'c': maxClients = strtoul(optarg, nullptr, 10); break;
+            case 'p': cfg.parseThreads = (unsigned)atoi(optarg); break;
+            case 't': cfg.decodeThreads = (unsigned)atoi(optarg); break;
+            case 'q': cfg.queueDepth = strtoul(optarg, nullptr, 10); break;
+            case 'b': cfg.batchFrames = strtoul(optarg, nullptr, 10); break;
+            case 'm': cfg.batchMillis = (uint32_t)strtoul(optarg, nullptr, 10); break;
+            case 'd': cfg.backpressure = Backpressure::Drop; break;
+            case 'a': archivePath = optarg; break;
+            default: usage(); return 2;
+        }
+    }
+    if (vehiclesPath.empty() && indexPath.empty()) {
+        usage();
+        return 2;
+    }
+
+    KeyCheckpointIndex index;
+    if (!indexPath.empty()) index.load(indexPath);
+    if (!vehiclesPath.empty() && !loadVehicles(vehiclesPath, index)) return 1;
+
+    int listener = -1;
+    if (!listenTarget.empty() && (listener = listenOn(listenTarget)) < 0) {
+        fprintf(stderr, "bbingest: cannot listen on %s: %s\n", listenTarget.c_str(), strerror(errno));
+        return 1;
+    }
+
+    std::unique_ptr<TelemetryArchive> archive;
+    if (!archivePath.empty()) archive.reset(new TelemetryArchive(archivePath));
+    size_t archived = 0;
+
+    printf("vehicle_id,timestamp,counter,status,format,temperature,gyro_x,gyro_y,gyro_z,accel_peak,accel_rms,jerk,"
+           "lat,lon\n");
+    IngestPipeline pipeline(index, cfg, [&](const FrameBatch& batch, const std::vector<DecodedFrame>& out) {
+        for (const DecodedFrame& f : out) {
+            printf("%s,%llu,%u,%s,%s,%d,%.1f,%.1f,%.1f,%.2f,%.2f,%.2f,%.7f,%.7f\n",
+                   batch.vehicleIds()[f.vehicle].c_str(), (unsigned long long)f.timestamp, f.counter,
+                   frameStatusName(f.status), frameFormatName(f.format), f.temperature,
+                   f.gyro[0] / (double)GyroField::scale, f.gyro[1] / (double)GyroField::scale,
+                   f.gyro[2] / (double)GyroField::scale, f.accel / (double)AccelField::scale,
+                   f.accelRms / (double)AccelField::scale, f.jerk / (double)AccelField::scale,
+                   f.lat / (double)GpsField::scale, f.lon / (double)GpsField::scale);
+        }
+        if (archive) archived += archive->append(batch, out);
+    }, [](const CrashEvent& e) {
+        // Crash events stay off the CSV on stdout
+        fprintf(stderr, "bbingest: crash %s #%u at %u, %.7f %.7f, peak %.2f, %zu GPS points, %zu samples at %u Hz\n",
+                e.vehicleId.c_str(), e.id, e.epoch, e.lat / (double)GpsField::scale, e.lon / (double)GpsField::scale,
+                e.peakAccel / (double)AccelField::scale, e.track.size(), e.samples.size(), e.rateHz);
+    });
+
+    auto t0 = std::chrono::steady_clock::now();
+    if (listener >= 0) {
+        signal(SIGINT, onSignal);
+        signal(SIGTERM, onSignal);
+        fprintf(stderr, "bbingest: listening on %s\n", listenTarget.c_str());
+        serve(pipeline, listener, maxClients);
+        close(listener);
+        if (listenTarget.compare(0, 5, "unix:") == 0) unlink(listenTarget.c_str() + 5);
+    }
+    for (int i = optind; i < argc; i++) {
+        std::ifstream file(argv[i]);
+        if (!file) {
+            fprintf(stderr, "bbingest: cannot open %s\n", argv[i]);
+            return 1;
+        }
+        for (std::string line; std::getline(file, line);) pipeline.submit(std::move(line));
+    }
+    if (listener < 0 && optind >= argc) {
+        for (std::string line; std::getline(std::cin, line);) pipeline.submit(std::move(line));
+    }
+    pipeline.finish();
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    IngestPipeline::Stats s = pipeline.stats();
+    fprintf(stderr,
+            "bbingest: %llu lines (%llu dropped, %llu malformed, %llu ignored), %llu uplinks, %llu frames "
+            "(%llu duplicates), %llu ok, %llu event chunks, %llu events, %llu batches, %.3f s (%.0f frames/s, %s, %s)\n",
+            (unsigned long long)s.lines, (unsigned long long)s.dropped, (unsigned long long)s.malformed,
+            (unsigned long long)s.ignored, (unsigned long long)s.uplinks, (unsigned long long)s.frames,
+            (unsigned long long)s.duplicates, (unsigned long long)s.decodedOk, (unsigned long long)s.eventChunks,
+            (unsigned long long)s.events, (unsigned long long)s.batches, secs,
+            secs > 0 ? s.frames / secs : 0.0, base64::hardwareAccelerated() ? "SSSE3 base64" : "scalar base64",
+            Aes128::hardwareAccelerated() ? "AES-NI" : "portable AES");
+    for (size_t i = 0; i < INGEST_STAGES; i++) {
+        const LatencyHistogram& h = pipeline.latency((IngestStage)i);
+        fprintf(stderr, "bbingest:   %-10s n=%-9llu mean=%.1fus p50=%.1fus p99=%.1fus max=%.1fus",
+                ingestStageName((IngestStage)i), (unsigned long long)h.count(), h.mean() / 1e3, h.percentile(0.5) / 1e3, h.percentile(0.99) / 1e3,
+                h.max() / 1e3);
+        if (i < (size_t)IngestStage::EndToEnd) {
+            fprintf(stderr, " queue_full=%llu blocked=%.1fms", (unsigned long long)s.queueFullWaits[i],
+                    s.queueBlockedNanos[i] / 1e6);
+        }
+        fprintf(stderr, "\n");
+    }
+
+    int status = 0;
+    if (archive) {
+        if (archived != s.decodedOk || !archive->flush()) {
+            fprintf(stderr, "bbingest: cannot append to archive %s\n", archivePath.c_str());
+            status = 1;
+        } else {
+            fprintf(stderr, "bbingest: %zu frames archived in %s\n", archived, archivePath.c_str());
+        }
+    }
+    if (!indexPath.empty() && !index.save(indexPath)) {
+        fprintf(stderr, "bbingest: cannot save index to %s\n", indexPath.c_str());
+        status = 1;
+    }
+    return status;
+}
@@ -0,0 +1,162 @@
+// bbkeyd - Serves the fleet's daily keys over a local socket
+//
+//   bbkeyd -k vehicles.csv [-s socket] [-t threads] [-r retainDays] [-q vehicleId epoch]
+//
+// vehicles.csv: vehicleId,masterKeyHex[,startEpoch]   (start defaults to 2025-03-25)
+//
+// Loads the vehicles into a DailyKeyService (key_service.h), precomputes the
+// keys of the current window and then recomputes it every midnight UTC. It
+// answers the line protocol of keyServiceRequest() on the unix socket
+// (default bbkeyd.sock), one request per line, e.g.
+//   echo "KEY veh-00042 1742947230" | nc -U bbkeyd.sock
+// With -q it prints the one key asked for and exits.
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "key_service.h"
+
+namespace {
+
+constexpr uint64_t DEFAULT_START_EPOCH = 1742860800;  // 2025-03-25 00:00:00 UTC
+
+std::vector<std::string> splitCsv(const std::string& line) {
+    std::vector<std::string> fields;
+    std::stringstream ss(line);
+    std::string field;
+    while (std::getline(ss, field, ',')) {
+        while (!field.empty() && (field.back() == '\r' || field.back() == ' ')) field.pop_back();
+        while (!field.empty() && field.front() == ' ') field.erase(0, 1);
+        fields.push_back(field);
+    }
+    return fields;
+}
+
+bool loadVehicles(const std::string& path, DailyKeyService& service) {
+    std::ifstream in(path);
+    if (!in) {
+        fprintf(stderr, "bbkeyd: cannot open %s\n", path.c_str());
+        return false;
+    }
+    std::string line;
+    for (size_t lineNo = 1; std::getline(in, line); lineNo++) {
+        std::vector<std::string> f = splitCsv(line);
+        if (f.empty() || f[0].empty() || f[0][0] == '#') continue;
+        std::string request = "ADD " + f[0] + " " + (f.size() > 1 ? f[1] : "") + " " +
+                              (f.size() > 2 ? f[2] : std::to_string(DEFAULT_START_EPOCH));
+        if (f.size() < 2 || keyServiceRequest(service, request) != "OK") {
+            fprintf(stderr, "bbkeyd: %s:%zu: expected vehicleId,masterKeyHex[,startEpoch]\n", path.c_str(), lineNo);
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t nowEpoch() { return (uint64_t)time(nullptr); }
+
+// Recomputes the window as each UTC day begins
+void midnightLoop(DailyKeyService& service) {
+    for (;;) {
+        uint64_t next = (nowEpoch() / SECONDS_PER_DAY + 1) * SECONDS_PER_DAY;
+        std::this_thread::sleep_until(std::chrono::system_clock::from_time_t((time_t)next));
+        if (nowEpoch() < next) continue;
+        uint64_t hashed = service.precompute(nowEpoch());
+        DailyKeyService::Stats st = service.stats();
+        fprintf(stderr, "bbkeyd: day %llu: %llu keys in %.3f s\n", (unsigned long long)(nowEpoch() / SECONDS_PER_DAY),
+                (unsigned long long)hashed, st.lastPrecomputeSeconds);
+    }
+}
+
+void serveClient(DailyKeyService& service, int fd) {
+    FILE* in = fdopen(fd, "r");
+    if (!in) {
+        close(fd);
+        return;
+    }
+    char buf[512];
+    while (fgets(buf, sizeof(buf), in)) {
+        buf[strcspn(buf, "\r\n")] = '\0';
+        std::string reply = keyServiceRequest(service, buf) + "\n";
+        if (send(fd, reply.data(), reply.size(), MSG_NOSIGNAL) != (ssize_t)reply.size()) break;
+    }
+    fclose(in);
+}
+
+void usage() {
+    fprintf(stderr, "usage: bbkeyd -k vehicles.csv [-s socket] [-t threads] [-r retainDays] [-q vehicleId epoch]\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string vehiclesPath, socketPath = "bbkeyd.sock", queryId;
+    KeyServiceConfig cfg;
+    bool query = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "k:s:t:r:q:h")) != -1) {
+        switch (opt) {
+            case 'k': vehiclesPath = optarg; break;
+            case 's': socketPath = optarg; break;
+            case 't': cfg.threads = (unsigned)atoi(optarg); break;
+            case 'r': cfg.retainDays = (uint32_t)atoi(optarg); break;
+            case 'q':
+                query = true;
+                queryId = optarg;
+                break;
+            default: usage(); return 2;
+        }
+    }
+    if (vehiclesPath.empty() || (query && optind >= argc)) {
+        usage();
+        return 2;
+    }
+
+    DailyKeyService service(cfg);
+    auto t0 = std::chrono::steady_clock::now();
+    if (!loadVehicles(vehiclesPath, service)) return 1;
+    if (query) {
+        std::string reply = keyServiceRequest(service, "KEY " + queryId + " " + argv[optind]);
+        printf("%s\n", reply.c_str());
+        return reply.compare(0, 2, "OK") == 0 ? 0 : 1;
+    }
+    uint64_t hashed = service.precompute(nowEpoch());
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    DailyKeyService::Stats st = service.stats();
+    fprintf(stderr, "bbkeyd: %zu vehicles, %zu keys resident (%llu hashed) in %.3f s, %u threads, %u shards\n",
+            st.vehicles, st.residentKeys, (unsigned long long)hashed, secs, service.threads(), service.shardCount());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (listener < 0 || socketPath.size() >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "bbkeyd: bad socket %s\n", socketPath.c_str());
+        return 1;
+    }
+    strcpy(addr.sun_path, socketPath.c_str());
+    unlink(socketPath.c_str());
+    if (bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 64) != 0) {
+        fprintf(stderr, "bbkeyd: cannot listen on %s: %s\n", socketPath.c_str(), strerror(errno));
+        return 1;
+    }
+    std::thread(midnightLoop, std::ref(service)).detach();
+    fprintf(stderr, "bbkeyd: listening on %s\n", socketPath.c_str());
+    for (;;) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        std::thread(serveClient, std::ref(service), fd).detach();
+    }
+    close(listener);
+    return 1;
+}
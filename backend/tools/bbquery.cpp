@@ -0,0 +1,100 @@
+// bbquery - Reads decoded frames back from a telemetry archive as CSV
+//
+//   bbquery -a archiveDir [-v vehicleId]... [-f fromEpoch] [-t toEpoch] [-w column:min:max]... [-c]
+//
+// -f/-t select receive times in [from, to). -w keeps rows whose column is in
+// [min, max], in on-air units (accel_peak in m/s^2 * 100, lat/lon in
+// degrees * 1e7); min or max may be left empty. Columns are named as in the
+// bbdecode CSV. -c prints only the number of matching rows.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include "telemetry_archive.h"
+
+namespace {
+
+bool parseBound(const std::string& text, int64_t empty, int64_t& out) {
+    if (text.empty()) {
+        out = empty;
+        return true;
+    }
+    char* end;
+    out = strtoll(text.c_str(), &end, 10);
+    return *end == '\0';
+}
+
+// column:min:max
+bool parseFilter(const std::string& text, ArchiveFilter& filter) {
+    size_t a = text.find(':');
+    size_t b = a == std::string::npos ? a : text.find(':', a + 1);
+    if (b == std::string::npos) return false;
+    return archiveColumnByName(text.substr(0, a), filter.column) &&
+           parseBound(text.substr(a + 1, b - a - 1), INT64_MIN, filter.min) &&
+           parseBound(text.substr(b + 1), INT64_MAX, filter.max);
+}
+
+void usage() {
+    fprintf(stderr,
+            "usage: bbquery -a archiveDir [-v vehicleId]... [-f fromEpoch] [-t toEpoch] [-w column:min:max]... "
+            "[-c]\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string archivePath;
+    ArchiveQuery query;
+    bool countOnly = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "a:v:f:t:w:ch")) != -1) {
+        switch (opt) {
+            case 'a': archivePath = optarg; break;
+            case 'v': query.vehicles.push_back(optarg); break;
+            case 'f': query.from = strtoull(optarg, nullptr, 10); break;
+            case 't': query.to = strtoull(optarg, nullptr, 10); break;
+            case 'w': {
+                ArchiveFilter filter;
+                if (!parseFilter(optarg, filter)) {
+                    fprintf(stderr, "bbquery: bad filter %s, expected column:min:max\n", optarg);
+                    return 2;
+                }
+                query.filters.push_back(filter);
+                break;
+            }
+            case 'c': countOnly = true; break;
+            default: usage(); return 2;
+        }
+    }
+    if (archivePath.empty()) {
+        usage();
+        return 2;
+    }
+
+    TelemetryArchive archive(archivePath);
+    auto t0 = std::chrono::steady_clock::now();
+    ArchiveScanStats stats;
+    if (countOnly) {
+        stats = archive.count(query);
+        printf("%llu\n", (unsigned long long)stats.rowsMatched);
+    } else {
+        printf("vehicle_id,timestamp,counter,temperature,gyro_x,gyro_y,gyro_z,accel_peak,accel_rms,jerk,lat,lon\n");
+        stats = archive.scan(query, [](const std::string& vehicleId, const ArchivedFrame& f) {
+            printf("%s,%llu,%u,%d,%.1f,%.1f,%.1f,%.2f,%.2f,%.2f,%.7f,%.7f\n", vehicleId.c_str(),
+                   (unsigned long long)f.timestamp, f.counter, f.temperature, f.gyro[0] / (double)GyroField::scale,
+                   f.gyro[1] / (double)GyroField::scale, f.gyro[2] / (double)GyroField::scale,
+                   f.accel / (double)AccelField::scale, f.accelRms / (double)AccelField::scale,
+                   f.jerk / (double)AccelField::scale, f.lat / (double)GpsField::scale,
+                   f.lon / (double)GpsField::scale);
+        });
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    fprintf(stderr,
+            "bbquery: %llu rows matched, %llu partitions, %llu of %llu blocks skipped, %llu rows scanned, %.3f s\n",
+            (unsigned long long)stats.rowsMatched, (unsigned long long)stats.partitions,
+            (unsigned long long)stats.blocksSkipped, (unsigned long long)stats.blocks,
+            (unsigned long long)stats.rowsScanned, secs);
+    return 0;
+}
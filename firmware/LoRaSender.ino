@@ -2,101 +2,264 @@
 #include "gps_manager.h"
 #include "daily_key_manager.h"
 #include "payload_manager.h"
+#include "message_counter.h"
+#include "mpu6050_fifo.h"
+#include "crash_recorder.h"
 #include "lora_manager.h"
+#include "report_policy.h"
+#include "sample_pipeline.h"
+#include "task_scheduler.h"
+#include "trace_manager.h"
+#include "hal/hal.h"
+#include "log_manager.h"
 #include <Wire.h>
 #include <Adafruit_MPU6050.h>
+#include <driver/gpio.h>
+#include <driver/uart.h>
 
 #define BUTTON_PIN 0
 #define DHT11_PIN 7
+#define LOG_STATS_INTERVAL_MS 600000
+// The GPS UART callback fills a ~1 s ring; drain it well before that
+#define GPS_DRAIN_INTERVAL_MS 200
+// Stay out of light sleep (no UART clock) while an NMEA burst is arriving
+#define GPS_BURST_AWAKE_MS 300
+// The transmit stage wakes at least this often to drain a flash backlog
+#define RADIO_POLL_INTERVAL_MS 1000
+// Transmit stage: core 0, the Arduino loop (sampling stage) has core 1
+#define TX_TASK_CORE 0
+#define TX_TASK_STACK 8192
+#define TX_TASK_PRIORITY 2
+// Keeps the cached DHT11 reading well inside DHT_MAX_AGE_MS
+#define DHT_REFRESH_INTERVAL_MS 15000
+// Well inside the 85 ms the MPU6050 FIFO holds at IMU_SAMPLE_RATE_HZ
+#define IMU_DRAIN_INTERVAL_MS 40
+#define BUTTON_POLL_MS 50
+#define BUTTON_HOLD_MS 3000
+// Console commands (with TRACE_SPANS: "trace" dumps the span ring as Chrome trace JSON)
+#define CONSOLE_POLL_MS 500
 
 DHT11 dht(DHT11_PIN);
 Adafruit_MPU6050 mpu;
+Mpu6050Fifo mpuFifo(Wire);
+ImuWindow motion;
+// 2.56 s either side of the trigger at 50 Hz, with the last 16 s of GPS
+using Crash = CrashRecorder<128, 128, 16>;
+Crash crash;
 DailyKeyManager keyManager;
+MessageCounter messageCounter;
 HardwareSerial GPSserial(2);
 GPSMonitor gpsMonitor(GPSserial);
 
 bool mpuFound = false;
+bool imuFifo = false;
 PayloadManager* payloadManager;
+TaskScheduler scheduler;
+TaskId buttonTask = TASK_INVALID;
+bool buttonActive = false;
+SamplePipeline pipeline;
+// Paces the "sample" task and decides which readings go on air
+ReportPolicy reportPolicy;
+TaskId sampleTask = TASK_INVALID;
+TaskHandle_t txTask = nullptr;
 
 void setup() {
   Serial.begin(115200);
   pinMode(BUTTON_PIN, INPUT_PULLUP);
 
-  Serial.println("\n=== 🚀 ESP32 Daily Key Generator ===");
+  LOG_INFO("=== 🚀 ESP32 Daily Key Generator ===");
   Wire.begin();
+  Wire.setClock(400000);  // a 120-byte FIFO burst in ~3 ms
 
-  mpuFound = mpu.begin();
-  Serial.println(mpuFound ? "✅ MPU6050 found." : "❌ MPU6050 not found! Using default values.");
+  imuFifo = mpuFifo.begin(IMU_SAMPLE_RATE_HZ);
+  mpuFound = imuFifo || mpu.begin();
+  LOG_INFO("%s", imuFifo    ? "✅ MPU6050 found, FIFO sampling."
+                 : mpuFound ? "✅ MPU6050 found, single readings."
+                            : "❌ MPU6050 not found! Using default values.");
 
   gpsMonitor.begin(9600, 46, 45);
-  Serial.println("✅ GPS Initialized.");
+  LOG_INFO("✅ GPS Initialized.");
 
 
+  keyManager.setMessageCounter(&messageCounter);
   keyManager.init();
   keyManager.loadDailyKey();
-  payloadManager = new PayloadManager(&dht, &mpu, &gpsMonitor.getGPS(), keyManager.getDailyKey(), mpuFound);
+  payloadManager = new PayloadManager(&dht, &mpu, &gpsMonitor.getFix(), keyManager.getDailyKey(), &messageCounter, mpuFound);
+  if (imuFifo) {
+    payloadManager->setMotionSource(&mpuFifo, &motion);
+    crash.begin(mpuFifo.scale());
+    crash.setEncoder(payloadManager);
+    mpuFifo.setTap(Crash::tap, &crash);
+    LoRaWAN_setEventSource(&crash);
+  }
 
   LoRaWAN_setup();
-  Serial.println("✅ LoRaWAN Initialized.");
+  LOG_INFO("✅ LoRaWAN Initialized.");
+
+  // Light sleep ends on the next task release, a button press or GPS UART activity
+  gpio_wakeup_enable((gpio_num_t)BUTTON_PIN, GPIO_INTR_LOW_LEVEL);
+  esp_sleep_enable_gpio_wakeup();
+  uart_set_wakeup_threshold(UART_NUM_2, 3);
+  esp_sleep_enable_uart_wakeup(UART_NUM_2);
+
+  // Never light-sleep while the transmit stage is on air or in an RX window
+  scheduler.setSleepGate([](void*, bool entering) {
+    if (!entering) {
+      pipeline.leaveSleep();
+      return true;
+    }
+    return pipeline.enterSleep();
+  });
+
+  // From here on the counter, the daily key and the radio belong to the transmit stage
+  xTaskCreatePinnedToCore(transmitStage, "tx", TX_TASK_STACK, nullptr, TX_TASK_PRIORITY, &txTask, TX_TASK_CORE);
+
+  // Sampling stage. Higher priority runs first when several tasks are due together
+  if (imuFifo) scheduler.add("imu", IMU_DRAIN_INTERVAL_MS, 6, [](void*) { drainImu(); });
+  // Re-armed by every run with the policy's interval: seconds while moving, half a minute parked
+  sampleTask = scheduler.add("sample", 0, 5, [](void*) { sampleReading(); }, nullptr,
+                             reportPolicy.config().movingEvalMs);
+  scheduler.trigger(sampleTask, reportPolicy.evalIntervalMs());
+  buttonTask = scheduler.add("button", 0, 4, [](void*) { handleButtonReset(); }, nullptr, BUTTON_POLL_MS);
+  scheduler.add("gps", GPS_DRAIN_INTERVAL_MS, 3, [](void*) { drainGPS(); });
+  scheduler.add("dht", DHT_REFRESH_INTERVAL_MS, 0, [](void*) { payloadManager->sampleEnvironment(); });
+  if (TRACE_SPANS) scheduler.add("console", CONSOLE_POLL_MS, 0, [](void*) { handleConsole(); });
+  if (logEnabled(LogLevel::Debug)) {
+    scheduler.add("stats", LOG_STATS_INTERVAL_MS, 0, [](void*) { printStats(); }, nullptr, 0, LOG_STATS_INTERVAL_MS);
+  }
+  logFlush();
 }
 
-void loop() { 
-  static unsigned long lastPayloadTime = 0;
-  static bool buttonPressed = false;
-  static unsigned long buttonPressTime = 0;
+void loop() {
+  // Level check: also catches a press that woke the chip from light sleep
+  if (!buttonActive && digitalRead(BUTTON_PIN) == LOW) scheduler.trigger(buttonTask);
 
-  gpsMonitor.update();
-  //gpsMonitor.printNMEAEvery(20000);
-  gpsMonitor.monitorGPS();
+  scheduler.runDue();
 
+  // Write out what both stages logged before the CPU idles
+  logDrain();
+  // Light sleep stops both cores: stay up while the transmit stage has work.
+  // The sleep gate set in setup() makes the final decision atomically with it.
+  if (pipeline.pending() || crash.pending()) scheduler.keepAwake(RADIO_POLL_INTERVAL_MS);
+  scheduler.idle();
+}
 
-  // Aggiorna la Daily Key leggendo la data dal GPS anche senza fix
-  time_t gpsEpoch = gpsMonitor.getGPSEpoch();
-  if (gpsEpoch > 0 && keyManager.checkAndUpdateDailyKey(gpsEpoch)) {
-    Serial.println("✅ Daily Key updated from GPS date");
+// Sampling stage: a reading per evaluation interval; the ones the report
+// policy passes go into the pipeline
+void sampleReading() {
+  SensorReading reading = payloadManager->sample();
+  ReportReason reason = reportPolicy.evaluate(reading, gpsMonitor.getFix(), hal::millis());
+  // After the evaluation: it may have changed the motion state
+  scheduler.trigger(sampleTask, reportPolicy.evalIntervalMs());
+  if (reason == ReportReason::None) return;
+  LOG_DEBUG("📍 Reporting (%s)", reportReasonName(reason));
+
+  SampleRecord rec;
+  rec.reading = reportPolicy.report();
+  rec.epoch = (uint32_t)gpsMonitor.getGPSEpoch();
+  rec.sampledAt = hal::millis();
+  rec.urgent = reportUrgent(reason);
+  if (!pipeline.submit(rec)) {
+    LOG_WARN("⚠️ Transmit stage %u readings behind, reading dropped", (unsigned)PIPELINE_DEPTH);
+    return;
   }
+  xTaskNotifyGive(txTask);
+}
+
+// Transmit stage: encodes, encrypts and sends what the sampler queued, and
+// drains the flash backlog, however long the radio blocks
+void transmitStage(void*) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(RADIO_POLL_INTERVAL_MS));
+    pipeline.beginTransmit();
+    pipeline.drain([](const SampleRecord& rec) { sendEncryptedPayload(rec); });
+    // Backlog left by an outage drains in full batches between readings
+    LoRaWAN_poll();
+    pipeline.endTransmit();
+  }
+}
 
-  if (millis() - lastPayloadTime >= 30000) {
-    lastPayloadTime = millis();
-    sendEncryptedPayload();
+// Sampling stage: the crash recorder sees every block; a frozen capture goes
+// from flash to the transmit stage, which sends it ahead of the readings
+void drainImu() {
+  mpuFifo.drain(motion);
+  bool wasPending = crash.pending();
+  crash.service();
+  if (!wasPending && crash.pending()) xTaskNotifyGive(txTask);
+}
+
+void drainGPS() {
+  if (gpsMonitor.update() > 0) scheduler.keepAwake(GPS_BURST_AWAKE_MS);
+  gpsMonitor.monitorGPS();
+  crash.observeGps(gpsMonitor.getFix());
+}
+
+// Aggiorna la Daily Key leggendo la data dal GPS anche senza fix
+void checkDailyKey(time_t gpsEpoch) {
+  if (gpsEpoch > 0 && keyManager.checkAndUpdateDailyKey(gpsEpoch)) {
+    LOG_INFO("✅ Daily Key updated from GPS date");
   }
+}
 
-  handleButtonReset(buttonPressed, buttonPressTime);
+void printStats() {
+  logPrintStats();
+  gpsMonitor.logStats();
+  scheduler.logStats();
+  pipeline.logStats();
+  reportPolicy.logStats();
+  lorawan().txScheduler.logStats(hal::millis());
+  if (imuFifo) {
+    LOG_DEBUG("📈 imu: %llu samples, %u FIFO overflows", (unsigned long long)mpuFifo.samples(), (unsigned)mpuFifo.overflows());
+    crash.logStats();
+  }
 }
 
-void sendEncryptedPayload() {
+void handleConsole() {
+  String command;
+  if (!hal::pollLine(command)) return;
+  if (command == "trace") {
+    logFlush();
+    traceDump();
+  } else {
+    LOG_WARN("⚠️ Unknown command: %s", command.c_str());
+  }
+}
 
+void sendEncryptedPayload(const SampleRecord& rec) {
+  // The key of the day the reading was taken, rolled over here, on the core that uses it
+  checkDailyKey((time_t)rec.epoch);
 
-  String hexPayload = payloadManager->createPayload();
-  uint8_t payload[20];
-  size_t payload_len = 0;
-  hexStringToByteArray(hexPayload, payload, payload_len);
+  // Build the frame in the staging slot; it is queued in flash and goes out with the next batch
+  size_t cap = 0;
+  uint8_t* frame = LoRaWAN_txSlot(cap);
+  size_t payload_len = payloadManager->encodePayload(rec.reading, frame, cap);
+  if (payload_len == 0) return;
 
-  if (LoRaWAN_send(payload, payload_len)) Serial.println("✅ Payload sent.");
+  if (LoRaWAN_send(frame, payload_len, rec.urgent)) LOG_INFO("✅ Batch acknowledged.");
 }
 
-void handleButtonReset(bool& buttonPressed, unsigned long& pressTime) {
+// Polls the button every BUTTON_POLL_MS while it is held; holding it for
+// BUTTON_HOLD_MS resets the keys and the counter
+void handleButtonReset() {
+  static uint32_t pressTime = 0;
+  static bool resetDone = false;
   if (digitalRead(BUTTON_PIN) == LOW) {
-    if (!buttonPressed) {
-      pressTime = millis();
-      buttonPressed = true;
-      Serial.println("🔘 Button pressed, hold for 3 sec to reset...");
-    }
-    if (buttonPressed && millis() - pressTime > 3000) {
-      Serial.println("⏱️ Resetting keys and message counter...");
+    if (!buttonActive) {
+      pressTime = hal::millis();
+      buttonActive = true;
+      resetDone = false;
+      LOG_INFO("🔘 Button pressed, hold for 3 sec to reset...");
+    } else if (!resetDone && hal::millis() - pressTime > BUTTON_HOLD_MS) {
+      LOG_WARN("⏱️ Resetting keys and message counter...");
+      // The key and the counter belong to the transmit stage: stop it first
+      vTaskSuspend(txTask);
       keyManager.resetMasterKey();
       payloadManager->resetMessageCounter();
+      resetDone = true;
     }
+    scheduler.trigger(buttonTask, BUTTON_POLL_MS);
+    scheduler.keepAwake(2 * BUTTON_POLL_MS);
   } else {
-    buttonPressed = false;
-  }
-}
-
-void hexStringToByteArray(String hexString, uint8_t* byteArray, size_t &len) {
-  hexString.replace(" ", "");
-  len = hexString.length() / 2;
-  for (size_t i = 0; i < len; i++) {  
-    String byteStr = hexString.substring(i * 2, i * 2 + 2);
-    byteArray[i] = (uint8_t)strtol(byteStr.c_str(), NULL, 16);
+    buttonActive = false;
   }
 }
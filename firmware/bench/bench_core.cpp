@@ -0,0 +1,143 @@
+// bench_core.cpp - Host microbenchmarks for the per-frame and daily-key paths
+#include <benchmark/benchmark.h>
+#include <filesystem>
+#include "daily_key_manager.h"
+#include "flash_queue.h"
+#include "imu_features.h"
+#include "nmea_parser.h"
+#include "payload_manager.h"
+
+namespace {
+
+void useScratchStorage() {
+    hal::host::setStorageDir((std::filesystem::temp_directory_path() / "bbx-bench").string());
+    hal::host::wipeStorage();
+    hal::host::setLogEnabled(false);
+}
+
+void BM_Sha256_40B(benchmark::State& state) {
+    uint8_t data[40] = {0}, out[32];
+    for (auto _ : state) {
+        hal::sha256(data, sizeof(data), out);
+        benchmark::DoNotOptimize(out);
+    }
+}
+BENCHMARK(BM_Sha256_40B);
+
+void BM_Aes128Ctr_11B(benchmark::State& state) {
+    uint8_t key[16] = {0}, iv[16] = {0}, data[11] = {0};
+    for (auto _ : state) {
+        hal::aes128Ctr(key, iv, data, sizeof(data));
+        benchmark::DoNotOptimize(data);
+    }
+}
+BENCHMARK(BM_Aes128Ctr_11B);
+
+// The per-frame path: key schedule expanded once per daily key
+void BM_Aes128CtrScheduled_11B(benchmark::State& state) {
+    uint8_t key[16] = {0}, iv[16] = {0}, data[11] = {0};
+    hal::Aes128Ctr ctr;
+    ctr.setKey(key);
+    for (auto _ : state) {
+        ctr.crypt(iv, data, sizeof(data));
+        benchmark::DoNotOptimize(data);
+    }
+}
+BENCHMARK(BM_Aes128CtrScheduled_11B);
+
+void BM_CreatePayload(benchmark::State& state) {
+    useScratchStorage();
+    uint8_t key[16] = {0};
+    DHT11 dht(7);
+    Adafruit_MPU6050 mpu;
+    GpsFix gps;
+    gps.locationValid = true;
+    gps.lat = 454600000;
+    gps.lon = 91900000;
+    MessageCounter counter;
+    PayloadManager pm(&dht, &mpu, &gps, key, &counter, true);
+    uint8_t frame[PAYLOAD_SIZE];
+    hal::host::resetNvsWriteCount();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(pm.createPayload(frame, sizeof(frame)));
+        benchmark::ClobberMemory();
+    }
+    state.counters["nvs_writes/frame"] =
+        benchmark::Counter((double)hal::host::nvsWriteCount() / state.iterations());
+}
+BENCHMARK(BM_CreatePayload);
+
+void BM_DailyKeyRollover(benchmark::State& state) {
+    useScratchStorage();
+    hal::Preferences p;
+    p.begin("dailykeys", false);
+    p.putString("master_key", "e17c9d5c6c7bc84123c0a4caeef53d4f246fb8ce22f39aad71bc5dde2e982921");
+    p.putString("vehicle_id", "bench");
+    p.end();
+
+    DailyKeyManager km;
+    km.init();
+    time_t epoch = 1742860800;
+    for (auto _ : state) {
+        epoch += SECONDS_PER_DAY;
+        benchmark::DoNotOptimize(km.checkAndUpdateDailyKey(epoch));
+    }
+}
+BENCHMARK(BM_DailyKeyRollover);
+
+// Steady state of an offline period: append, and once a batch is acked, consume
+void BM_FlashQueueAppendConsume(benchmark::State& state) {
+    useScratchStorage();
+    hal::host::resetFlashStats();
+    FlashQueue queue;
+    queue.begin();
+    uint8_t frame[PAYLOAD_SIZE] = {0};
+    uint64_t n = 0;
+    for (auto _ : state) {
+        queue.append(frame, sizeof(frame));
+        if (++n % 5 == 0) queue.consume(5);
+    }
+    state.counters["erases/frame"] = benchmark::Counter((double)queue.erases() / state.iterations());
+}
+BENCHMARK(BM_FlashQueueAppendConsume);
+
+void BM_NmeaParse(benchmark::State& state) {
+    // One second of a typical receiver: RMC + GGA + GSA + GSV (ignored ones too)
+    const char* second =
+        "$GPRMC,101530.00,A,4527.85221,N,00911.39892,E,0.02,,170326,,,A*6F\r\n"
+        "$GNGGA,101530.00,4527.85221,N,00911.39892,E,1,09,0.9,120.0,M,47.0,M,,*49\r\n"
+        "$GNGSA,A,3,10,12,15,18,23,24,25,32,,,,,1.6,0.9,1.3*2A\r\n"
+        "$GPGSV,3,1,10,10,45,072,31,12,30,180,29,15,60,300,35,18,12,040,22*7A\r\n";
+    size_t len = strlen(second);
+    NmeaParser parser;
+    for (auto _ : state) {
+        for (size_t i = 0; i < len; i++) parser.encode(second[i]);
+        benchmark::DoNotOptimize(parser.fix());
+    }
+    state.SetBytesProcessed((int64_t)(state.iterations() * len));
+}
+BENCHMARK(BM_NmeaParse);
+
+}  // namespace
+
+void BM_ImuFeatureKernel(benchmark::State& state) {
+    // One full block of the recorded pothole trace, as drain() hands it over
+    auto trace = hal::host::loadImuTrace(std::string(IMU_TRACE_DIR) + "/imu_pothole_1khz.csv");
+    ImuBlock block;
+    for (; block.n < IMU_BLOCK_MAX; block.n++) {
+        const auto& s = trace[(400 + block.n) % trace.size()];
+        block.ax[block.n] = s[0];
+        block.ay[block.n] = s[1];
+        block.az[block.n] = s[2];
+        block.gx[block.n] = s[3];
+        block.gy[block.n] = s[4];
+        block.gz[block.n] = s[5];
+    }
+    ImuWindow window;
+    for (auto _ : state) {
+        window.add(block);
+        benchmark::DoNotOptimize(window);
+    }
+    state.SetItemsProcessed((int64_t)(state.iterations() * IMU_BLOCK_MAX));
+}
+BENCHMARK(BM_ImuFeatureKernel);
@@ -0,0 +1,167 @@
+// bench_stages.cpp - Host microbenchmarks of the stages trace_manager.h spans
+//
+// One benchmark per TRACE_SPAN name, plus the cost of a span and of a dump.
+// baseline.json holds a reference run (see README); with BLACKBOX_TRACE on
+// (the default) every stage includes its own span.
+#include <benchmark/benchmark.h>
+#include <filesystem>
+#include "daily_key_manager.h"
+#include "lora_manager.h"
+#include "payload_manager.h"
+#include "trace_manager.h"
+
+namespace {
+
+const uint8_t VEHICLE[] = "bench";
+
+void useScratchStorage() {
+    hal::host::setStorageDir((std::filesystem::temp_directory_path() / "bbx-bench-stages").string());
+    hal::host::wipeStorage();
+    hal::host::setLogEnabled(false);
+}
+
+GpsFix benchFix() {
+    GpsFix gps;
+    gps.locationValid = true;
+    gps.lat = 454600000;
+    gps.lon = 91900000;
+    return gps;
+}
+
+// "sample": DHT11 cache, MPU6050 and GPS fix into one reading
+void BM_Stage_Sample(benchmark::State& state) {
+    useScratchStorage();
+    uint8_t key[16] = {0};
+    DHT11 dht(7);
+    Adafruit_MPU6050 mpu;
+    GpsFix gps = benchFix();
+    MessageCounter counter;
+    PayloadManager pm(&dht, &mpu, &gps, key, &counter, true);
+    for (auto _ : state) benchmark::DoNotOptimize(pm.sample());
+}
+BENCHMARK(BM_Stage_Sample);
+
+// "encodePayload": IV, frame layout and encryption of one reading
+void BM_Stage_EncodePayload(benchmark::State& state) {
+    useScratchStorage();
+    uint8_t key[16] = {0};
+    GpsFix gps = benchFix();
+    MessageCounter counter;
+    PayloadManager pm(nullptr, nullptr, &gps, key, &counter, false);
+    SensorReading r;
+    r.lat = gps.lat;
+    r.lon = gps.lon;
+    uint8_t frame[MAX_PAYLOAD_SIZE];
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(pm.encodePayload(r, frame, sizeof(frame)));
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_Stage_EncodePayload);
+
+// "createPayload": sample() and encodePayload() back to back
+void BM_Stage_CreatePayload(benchmark::State& state) {
+    useScratchStorage();
+    uint8_t key[16] = {0};
+    DHT11 dht(7);
+    Adafruit_MPU6050 mpu;
+    GpsFix gps = benchFix();
+    MessageCounter counter;
+    PayloadManager pm(&dht, &mpu, &gps, key, &counter, true);
+    uint8_t frame[MAX_PAYLOAD_SIZE];
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(pm.createPayload(frame, sizeof(frame)));
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_Stage_CreatePayload);
+
+// "encryptAESCTR": the encrypted part of a legacy frame
+void BM_Stage_EncryptAESCTR(benchmark::State& state) {
+    uint8_t key[16] = {0}, iv[16] = {0}, data[PAYLOAD_SIZE - FRAME_ENCRYPTED_OFFSET] = {0};
+    EncryptionManager enc(key);
+    for (auto _ : state) {
+        enc.encryptAESCTR(data, sizeof(data), iv);
+        benchmark::DoNotOptimize(data);
+    }
+}
+BENCHMARK(BM_Stage_EncryptAESCTR);
+
+// "nvs.counter": a block size of 1 commits the counter for every frame
+void BM_Stage_CounterCommit(benchmark::State& state) {
+    useScratchStorage();
+    MessageCounter counter(1);
+    counter.begin();
+    for (auto _ : state) benchmark::DoNotOptimize(counter.next());
+}
+BENCHMARK(BM_Stage_CounterCommit);
+
+// "nvs.dailyKey": the key and the epoch written on a rollover
+void BM_Stage_DailyKeyCommit(benchmark::State& state) {
+    useScratchStorage();
+    hal::Preferences p;
+    p.begin("dailykeys", false);
+    uint8_t key[DAILY_KEY_SIZE] = {0};
+    uint64_t epoch = 1742860800;
+    for (auto _ : state) {
+        key[0]++;
+        p.putBytes("last_daily_key", key, sizeof(key));
+        p.putULong64("last_epoch", epoch += SECONDS_PER_DAY);
+    }
+    p.end();
+}
+BENCHMARK(BM_Stage_DailyKeyCommit);
+
+// "keyDerivation": the key chain walked forward state.range(0) days
+void BM_Stage_KeyDerivation(benchmark::State& state) {
+    uint8_t key[DAILY_KEY_SIZE] = {0};
+    const uint64_t from = 1742860800, to = from + (uint64_t)state.range(0) * SECONDS_PER_DAY;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(keychain::advance(key, VEHICLE, sizeof(VEHICLE) - 1, from, to));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Stage_KeyDerivation)->Arg(1)->Arg(30);
+
+// "sendReceive" and "nvs.session": only the host double's bookkeeping. On the
+// board both are dominated by time on air and the RX windows; the trace shows those.
+void BM_Stage_SendReceive(benchmark::State& state) {
+    useScratchStorage();
+    hal::host::radioSink().reset();
+    LoRaWAN_setup();
+    uint8_t frame[PAYLOAD_SIZE] = {0};
+    auto& uplinks = hal::host::radioSink().uplinks;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(LoRaWAN_sendReceive(frame, sizeof(frame), FPORT_FRAME));
+        LoRaWAN_saveSession();
+        if (uplinks.size() >= 4096) uplinks.clear();
+    }
+    lorawan().uplinkQueue.end();
+}
+BENCHMARK(BM_Stage_SendReceive);
+
+// One empty span: the overhead every instrumented stage pays
+void BM_TraceSpan(benchmark::State& state) {
+    traceRing.clear();
+    for (auto _ : state) TraceScope span("bench");
+    traceRing.clear();
+}
+BENCHMARK(BM_TraceSpan);
+
+// A full ring written out as Chrome trace JSON
+void BM_TraceDump(benchmark::State& state) {
+    traceRing.clear();
+    for (uint32_t i = 0; i < TRACE_RING_SLOTS; i++) traceRing.record("bench", i * 1000, 500);
+    size_t bytes = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(traceDump([](const char* text, void* ctx) {
+            *static_cast<size_t*>(ctx) += strlen(text);
+        }, &bytes));
+    }
+    state.SetItemsProcessed(state.iterations() * TRACE_RING_SLOTS);
+    state.SetBytesProcessed((int64_t)bytes);
+    traceRing.clear();
+}
+BENCHMARK(BM_TraceDump);
+
+}  // namespace
@@ -0,0 +1,206 @@
+// compact_codec.h - Keyframe + delta encoding of a reading (optional codec)
+//
+//   keyframe | IV lo | IV hi | 0x81 | T gx gy gz | AES-CTR(0xA5 | Apk Arms J | lat(4) | lon(4)) |
+//   delta    | IV lo | IV hi | 0x80 | zz(dT) zz(dgx) zz(dgy) zz(dgz) |
+//              AES-CTR(0xA5 | zz(dApk) zz(dArms) zz(dJ) zz(dlat) zz(dlon)) |
+//
+// The values and their split into clear and encrypted part follow
+// TelemetryFrame (frame_layout.h), without the markers. zz() is a zigzag
+// varint of the difference to the previous frame, which is always the frame
+// with counter - 1: after a reboot, a counter reset or a gap the encoder
+// falls back to a keyframe, and it sends one every COMPACT_KEYFRAME_INTERVAL
+// frames anyway so a lost uplink only breaks the chain until the next one. A
+// delta that would not be smaller than a keyframe is sent as a keyframe, so a
+// compact frame is at most COMPACT_KEYFRAME_SIZE.
+// 0xA5 lets the decoder tell a wrong daily key, like the markers of the
+// legacy frame. Integer deltas wrap, so decoding is exact for every value.
+#ifndef COMPACT_CODEC_H
+#define COMPACT_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "frame_layout.h"
+
+#ifndef COMPACT_KEYFRAME_INTERVAL
+#define COMPACT_KEYFRAME_INTERVAL 10
+#endif
+
+#define COMPACT_CHECK 0xA5
+#define COMPACT_HEADER_LEN (FRAME_IV_LEN + 1)
+#define COMPACT_KEYFRAME_SIZE                                                                         \
+    (COMPACT_HEADER_LEN + TelemetryFrame::blockValueBytes<schema::Block::Clear> + 1 +                  \
+     TelemetryFrame::blockValueBytes<schema::Block::Encrypted>)
+
+static_assert(COMPACT_KEYFRAME_SIZE <= PAYLOAD_SIZE, "a compact frame must fit the legacy frame slot");
+static_assert(1 + TelemetryFrame::blockValueBytes<schema::Block::Encrypted> <= 16, "encrypted part exceeds one AES block");
+
+namespace compact {
+
+// Field values in frame order: T gx gy gz | A lat lon. Absolute in a
+// keyframe, differences to the previous frame otherwise.
+constexpr int CLEAR_FIELDS = TelemetryFrame::clearValues;
+constexpr int FIELDS = TelemetryFrame::values;
+
+struct Fields {
+    bool keyframe;
+    int32_t v[FIELDS];
+};
+
+inline uint32_t zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+inline int32_t unzigzag(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+inline size_t putVarint(uint8_t* out, uint32_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+// Returns the bytes used, 0 if the varint runs past end or is too long
+inline size_t getVarint(const uint8_t* in, const uint8_t* end, uint32_t& v) {
+    v = 0;
+    for (size_t n = 0; n < 5 && in + n < end; n++) {
+        v |= (uint32_t)(in[n] & 0x7F) << (7 * n);
+        if (!(in[n] & 0x80)) return n + 1;
+    }
+    return 0;
+}
+
+inline void toFields(const SensorReading& r, int32_t v[FIELDS]) { TelemetryFrame::toValues(r, v); }
+
+inline bool isCompact(const uint8_t* frame, size_t len) {
+    return len > FRAME_FORMAT_OFFSET && (frame[FRAME_FORMAT_OFFSET] & COMPACT_FORMAT);
+}
+
+// Parses the clear part; returns the offset of the encrypted part, 0 if malformed
+inline size_t decodeClear(const uint8_t* frame, size_t len, Fields& f) {
+    if (len < COMPACT_HEADER_LEN || !isCompact(frame, len)) return 0;
+    f.keyframe = frame[FRAME_FORMAT_OFFSET] & COMPACT_KEYFRAME;
+    const uint8_t* p = frame + COMPACT_HEADER_LEN;
+    const uint8_t* end = frame + len;
+    if (f.keyframe) {
+        constexpr size_t bytes = TelemetryFrame::blockValueBytes<schema::Block::Clear>;
+        if ((size_t)(end - p) <= bytes) return 0;
+        SensorReading r;
+        TelemetryFrame::loadValues<schema::Block::Clear>(p, r);
+        TelemetryFrame::toValues<schema::Block::Clear>(r, f.v);
+        return COMPACT_HEADER_LEN + bytes;
+    }
+    for (int i = 0; i < CLEAR_FIELDS; i++) {
+        uint32_t z;
+        size_t n = getVarint(p, end, z);
+        if (n == 0) return 0;
+        f.v[i] = unzigzag(z);
+        p += n;
+    }
+    return p < end ? (size_t)(p - frame) : 0;
+}
+
+// Parses the decrypted part; false on a wrong key or malformed data
+inline bool decodeEncrypted(const uint8_t* plain, size_t len, Fields& f) {
+    const uint8_t* end = plain + len;
+    if (len == 0 || plain[0] != COMPACT_CHECK) return false;
+    const uint8_t* p = plain + 1;
+    if (f.keyframe) {
+        if (len != 1 + TelemetryFrame::blockValueBytes<schema::Block::Encrypted>) return false;
+        SensorReading r;
+        TelemetryFrame::loadValues<schema::Block::Encrypted>(p, r);
+        TelemetryFrame::toValues<schema::Block::Encrypted>(r, f.v + CLEAR_FIELDS);
+        return true;
+    }
+    for (int i = CLEAR_FIELDS; i < FIELDS; i++) {
+        uint32_t z;
+        size_t n = getVarint(p, end, z);
+        if (n == 0) return false;
+        f.v[i] = unzigzag(z);
+        p += n;
+    }
+    return p == end;
+}
+
+// Absolute reading from a keyframe, or from prev plus the deltas (prev may be
+// null for a keyframe)
+inline SensorReading apply(const SensorReading* prev, const Fields& f) {
+    int32_t v[FIELDS];
+    if (f.keyframe || !prev) {
+        memcpy(v, f.v, sizeof(v));
+    } else {
+        toFields(*prev, v);
+        for (int i = 0; i < FIELDS; i++) v[i] = (int32_t)((uint32_t)v[i] + (uint32_t)f.v[i]);
+    }
+    SensorReading r;
+    TelemetryFrame::fromValues(v, r);
+    return r;
+}
+
+}  // namespace compact
+
+class CompactEncoder {
+public:
+    explicit CompactEncoder(uint32_t keyframeInterval = COMPACT_KEYFRAME_INTERVAL)
+        : keyframeInterval(keyframeInterval ? keyframeInterval : 1) {}
+
+    // Writes the clear frame for reading r (the IV bytes are the caller's) and
+    // returns its length, or 0 if cap < COMPACT_KEYFRAME_SIZE. The caller
+    // encrypts [encOffset, length) in place.
+    size_t encode(const SensorReading& r, uint32_t counter, uint8_t* out, size_t cap, size_t& encOffset) {
+        if (cap < COMPACT_KEYFRAME_SIZE) return 0;
+        bool chained = havePrev && counter == prevCounter + 1 && sinceKeyframe + 1 < keyframeInterval;
+        size_t len = chained ? encodeDelta(r, out, encOffset) : 0;
+        if (len == 0) {
+            len = encodeKeyframe(r, out, encOffset);
+            sinceKeyframe = 0;
+        } else {
+            sinceKeyframe++;
+        }
+        prev = r;
+        prevCounter = counter;
+        havePrev = true;
+        return len;
+    }
+
+    // Next frame is a keyframe (e.g. after a daily key change)
+    void reset() { havePrev = false; }
+
+private:
+    size_t encodeKeyframe(const SensorReading& r, uint8_t* out, size_t& encOffset) {
+        out[FRAME_IV_LEN] = COMPACT_FORMAT | COMPACT_KEYFRAME;
+        TelemetryFrame::storeValues<schema::Block::Clear>(r, out + COMPACT_HEADER_LEN);
+        encOffset = COMPACT_HEADER_LEN + TelemetryFrame::blockValueBytes<schema::Block::Clear>;
+        out[encOffset] = COMPACT_CHECK;
+        TelemetryFrame::storeValues<schema::Block::Encrypted>(r, out + encOffset + 1);
+        return COMPACT_KEYFRAME_SIZE;
+    }
+
+    // 0 when the delta frame would not beat a keyframe
+    size_t encodeDelta(const SensorReading& r, uint8_t* out, size_t& encOffset) {
+        int32_t cur[compact::FIELDS], old[compact::FIELDS];
+        compact::toFields(r, cur);
+        compact::toFields(prev, old);
+        uint8_t buf[COMPACT_HEADER_LEN + 1 + compact::FIELDS * 5];
+        size_t i = FRAME_IV_LEN;
+        buf[i++] = COMPACT_FORMAT;
+        for (int f = 0; f < compact::FIELDS; f++) {
+            if (f == compact::CLEAR_FIELDS) {
+                encOffset = i;
+                buf[i++] = COMPACT_CHECK;
+            }
+            i += compact::putVarint(buf + i, compact::zigzag((int32_t)((uint32_t)cur[f] - (uint32_t)old[f])));
+        }
+        if (i >= COMPACT_KEYFRAME_SIZE) return 0;
+        memcpy(out + FRAME_IV_LEN, buf + FRAME_IV_LEN, i - FRAME_IV_LEN);
+        return i;
+    }
+
+    uint32_t keyframeInterval;
+    uint32_t sinceKeyframe = 0;
+    uint32_t prevCounter = 0;
+    bool havePrev = false;
+    SensorReading prev{};
+};
+
+#endif
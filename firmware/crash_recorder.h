@@ -0,0 +1,361 @@
+// crash_recorder.h - Pre-trigger crash capture and its priority upload
+//
+// The sampling stage feeds every IMU block (Mpu6050Fifo::setTap) and GPS fix
+// into rings whose size is fixed by the template parameters: PreSamples IMU
+// samples at CRASH_SAMPLE_HZ and GpsPoints positions, one per
+// CRASH_GPS_INTERVAL_MS. Each stored IMU sample is the raw sample with the
+// largest |a| of its 1/CRASH_SAMPLE_HZ slot, so a spike survives decimation.
+//
+// A raw sample whose |a| or jerk crosses the thresholds triggers an event.
+// The summary, the GPS track and the pre-trigger samples are written to the
+// CRASH_PARTITION flash partition at once (frozen: neither a reboot nor a dead
+// radio loses them); the next PostSamples samples follow chunk by chunk. The
+// time from the triggering sample to the frozen snapshot is measured for every
+// event and reported by logStats().
+//
+// Records (| event | chunk | chunks | body |, little-endian):
+//   chunk 0      epoch u32, lat i32, lon i32, peak |a| u16, jerk u16 (units of
+//                SensorReading), rate Hz u16, accel LSB/g u16, gyro LSB per
+//                deg/s * 10 u16, pre u16, post u16, GPS points u8
+//   GPS chunks   up to CRASH_CHUNK_SAMPLES x (ms to the trigger i32, lat, lon)
+//   IMU chunks   up to CRASH_CHUNK_SAMPLES x raw ax ay az gx gy gz (i16);
+//                sample pre is the slot holding the triggering sample
+//
+// The transmit stage uploads the records as event frames (frame_layout.h)
+// through LoRaWAN_setEventSource(): ahead of any reading, paced only by the
+// duty cycle. A record leaves flash once its uplink is delivered. The stages
+// share only a small SpscRing outbox and an atomic delivery count, so all
+// flash access stays on the sampling side.
+#ifndef CRASH_RECORDER_H
+#define CRASH_RECORDER_H
+
+#include <atomic>
+#include "flash_queue.h"
+#include "imu_features.h"
+#include "log_manager.h"
+#include "lora_manager.h"
+#include "nmea_parser.h"
+#include "payload_manager.h"
+#include "spsc_ring.h"
+
+#ifndef CRASH_SAMPLE_HZ
+#define CRASH_SAMPLE_HZ 50
+#endif
+// Trigger thresholds in SensorReading units: 4 g, 10 m/s^2 per ms
+#ifndef CRASH_TRIGGER_ACCEL
+#define CRASH_TRIGGER_ACCEL 3923
+#endif
+#ifndef CRASH_TRIGGER_JERK
+#define CRASH_TRIGGER_JERK 1000
+#endif
+#define CRASH_GPS_INTERVAL_MS 1000
+#define CRASH_PARTITION "crash"
+// Chunks of CRASH_CHUNK_SAMPLES (frame_layout.h): 99-byte records fit DR3 uplinks
+#define CRASH_RECORD_MAX (EVENT_CLEAR_LEN + CRASH_CHUNK_SAMPLES * CRASH_SAMPLE_BYTES)
+static_assert(CRASH_GPS_POINT_BYTES <= CRASH_SAMPLE_BYTES, "GPS chunk exceeds the record");
+// Records handed to the transmit stage ahead of delivery (power of two)
+#define CRASH_OUTBOX 4
+
+struct CrashThresholds {
+    uint16_t accel;  // |a| in m/s^2 * 100
+    uint16_t jerk;   // (m/s^2 per ms) * 100
+};
+
+template <size_t PreSamples, size_t PostSamples, size_t GpsPoints = 16>
+class CrashRecorder : public UplinkSource {
+    static constexpr size_t chunksOf(size_t n) { return (n + CRASH_CHUNK_SAMPLES - 1) / CRASH_CHUNK_SAMPLES; }
+    static_assert(PreSamples > 0 && PostSamples > 0 && GpsPoints > 0, "empty crash window");
+    static_assert(1 + chunksOf(GpsPoints) + chunksOf(PreSamples) + chunksOf(PostSamples) <= 255,
+                  "crash window needs more than 255 records");
+    static_assert(PostSamples <= UINT16_MAX && PreSamples <= UINT16_MAX, "crash window too long");
+
+public:
+    explicit CrashRecorder(CrashThresholds t = {CRASH_TRIGGER_ACCEL, CRASH_TRIGGER_JERK}) : thresholds(t) {}
+
+    // Sampling stage. Opens the flash store (records left from before a
+    // reboot are sent again) and converts the thresholds to raw LSBs.
+    bool begin(const ImuScale& s, const char* partition = CRASH_PARTITION) {
+        scale = s;
+        decimation = s.rateHz > CRASH_SAMPLE_HZ ? s.rateHz / CRASH_SAMPLE_HZ : 1;
+        // m/s^2 * 100 -> LSB: lsbPerG / 980.665
+        uint64_t a = imu::mulDiv(thresholds.accel, (uint64_t)s.accelLsbPerG * 1000, 980665);
+        uint64_t j = imu::mulDiv(thresholds.jerk, (uint64_t)s.accelLsbPerG * 1000 * 1000, 980665ull * s.rateHz);
+        accelThresholdSq = a * a > UINT32_MAX ? UINT32_MAX : (uint32_t)(a * a);
+        jerkThresholdSq = j * j > UINT32_MAX ? UINT32_MAX : (uint32_t)(j * j);
+
+        hal::Preferences prefs;
+        prefs.begin("crash", true);
+        nextId = (uint8_t)prefs.getUShort("next_id", 0);
+        prefs.end();
+        if (!store.begin(partition)) return false;
+        if (store.size() > 0) LOG_WARN("💥 %u crash records from before the reboot to send", (unsigned)store.size());
+        return true;
+    }
+
+    // Mpu6050Fifo tap: Mpu6050Fifo::setTap(CrashRecorder::tap, &recorder)
+    static void tap(const ImuBlock& b, uint32_t lastSampleMicros, void* self) {
+        static_cast<CrashRecorder*>(self)->observe(b, lastSampleMicros);
+    }
+
+    void observe(const ImuBlock& b, uint32_t lastSampleMicros) {
+        const uint32_t periodUs = 1000000u / scale.rateHz;
+        for (size_t i = 0; i < b.n; i++) {
+            uint32_t m = imu::magSq(b.ax[i], b.ay[i], b.az[i]);
+            uint32_t d = haveLast ? imu::magSq(imu::clampDiff(b.ax[i] - last[0]), imu::clampDiff(b.ay[i] - last[1]),
+                                               imu::clampDiff(b.az[i] - last[2]))
+                                  : 0;
+            last[0] = b.ax[i];
+            last[1] = b.ay[i];
+            last[2] = b.az[i];
+            haveLast = true;
+
+            if (slotFill == 0 || m > slotPeak) {
+                slotPeak = m;
+                slotSample = {{b.ax[i], b.ay[i], b.az[i]}, {b.gx[i], b.gy[i], b.gz[i]}};
+            }
+            if (!capture && (m > accelThresholdSq || d > jerkThresholdSq)) {
+                trigger(m, d, lastSampleMicros - (uint32_t)(b.n - 1 - i) * periodUs);
+            }
+            if (++slotFill == decimation) {
+                push(slotSample);
+                slotFill = 0;
+            }
+        }
+    }
+
+    // Sampling stage, with every GPS update
+    void observeGps(const GpsFix& fix) {
+        if (fix.timeValid) {
+            epochAt = (uint32_t)fix.epoch();
+            epochMillis = fix.timeMillis;
+        }
+        if (!fix.locationValid || (gpsCount > 0 && fix.locationMillis - gpsLastMillis < CRASH_GPS_INTERVAL_MS)) return;
+        gps[(gpsHead + gpsCount) % GpsPoints] = {fix.locationMillis, fix.lat, fix.lon};
+        if (gpsCount < GpsPoints) {
+            gpsCount++;
+        } else {
+            gpsHead = (gpsHead + 1) % GpsPoints;
+        }
+        gpsLastMillis = fix.locationMillis;
+    }
+
+    // Sampling stage, periodically: retires delivered records from flash and
+    // hands the next ones to the transmit stage
+    void service() {
+        uint32_t acked = deliveredCount.exchange(0, std::memory_order_acquire);
+        if (acked > 0) {
+            store.consume(acked);
+            inflight = acked < inflight ? inflight - acked : 0;
+        }
+        if (inflight >= store.size() || outbox.size() == CRASH_OUTBOX) return;
+
+        FlashQueue::Cursor c = store.front();
+        Chunk chunk;
+        size_t len;
+        for (size_t skip = 0; skip < inflight; skip++) {
+            if (!store.read(c, chunk.data, sizeof(chunk.data), len)) return;
+        }
+        while (outbox.size() < CRASH_OUTBOX && store.read(c, chunk.data, sizeof(chunk.data), len)) {
+            chunk.len = (uint8_t)len;
+            if (!outbox.push(chunk)) break;
+            inflight++;
+        }
+    }
+
+    // Transmit stage: frames are encrypted with the daily key and counter
+    void setEncoder(PayloadManager* pm) { encoder = pm; }
+
+    bool pending() override { return haveCurrent || outbox.size() > 0; }
+
+    size_t nextLen() override { return loadCurrent() ? EVENT_HEADER_LEN + current.len - EVENT_CLEAR_LEN : 0; }
+
+    size_t next(uint8_t* out, size_t cap) override {
+        if (!loadCurrent()) return 0;
+        return encoder ? encoder->encodeEvent(current.data, current.len, out, cap) : 0;
+    }
+
+    void delivered() override {
+        haveCurrent = false;
+        deliveredCount.fetch_add(1, std::memory_order_release);
+    }
+
+    // Sampling stage
+    bool capturing() const { return capture; }
+    uint32_t events() const { return eventCount; }
+    uint32_t lastLatencyUs() const { return latencyLast; }
+    uint32_t maxLatencyUs() const { return latencyMax; }
+    size_t storedRecords() const { return store.size(); }
+    uint32_t lostRecords() const { return lostCount; }
+
+    void logStats() const {
+        LOG_DEBUG("💥 crash: %u events, freeze latency %u us (max %u), %u records stored, %u lost",
+                  (unsigned)eventCount, (unsigned)latencyLast, (unsigned)latencyMax, (unsigned)store.size(),
+                  (unsigned)lostCount);
+    }
+
+private:
+    struct Sample {
+        int16_t a[3];
+        int16_t g[3];
+    };
+    struct GpsPoint {
+        uint32_t millis;
+        int32_t lat, lon;
+    };
+    struct Chunk {
+        uint8_t len;
+        uint8_t data[CRASH_RECORD_MAX];
+    };
+
+    // The record next() sends until it is delivered
+    bool loadCurrent() {
+        if (!haveCurrent && !outbox.pop(current)) return false;
+        haveCurrent = true;
+        return true;
+    }
+
+    static void put16(uint8_t*& p, uint16_t v) {
+        *p++ = (uint8_t)v;
+        *p++ = (uint8_t)(v >> 8);
+    }
+    static void put32(uint8_t*& p, uint32_t v) {
+        put16(p, (uint16_t)v);
+        put16(p, (uint16_t)(v >> 16));
+    }
+
+    void push(const Sample& s) {
+        if (!capture) {
+            ring[(ringHead + ringCount) % PreSamples] = s;
+            if (ringCount < PreSamples) {
+                ringCount++;
+            } else {
+                ringHead = (ringHead + 1) % PreSamples;
+            }
+            return;
+        }
+        pendingSamples[pendingCount++] = s;
+        postCount++;
+        if (pendingCount == CRASH_CHUNK_SAMPLES || postCount == PostSamples) writeSamples();
+        if (postCount == PostSamples) {
+            capture = false;
+            LOG_INFO("💥 Crash event %u captured (%u records)", (unsigned)eventId, (unsigned)chunkCount);
+        }
+    }
+
+    void trigger(uint32_t magSq, uint32_t diffSq, uint32_t sampleMicros) {
+        capture = true;
+        eventId = nextId++;
+        chunkIndex = 0;
+        postCount = 0;
+        pendingCount = 0;
+        const uint32_t triggerMillis = hal::millis() - (hal::micros() - sampleMicros) / 1000;
+        chunkCount = (uint8_t)(1 + chunksOf(gpsCount) + chunksOf(ringCount) + chunksOf(PostSamples));
+
+        // Summary, in the on-air units of SensorReading
+        uint8_t body[CRASH_SUMMARY_BYTES];
+        uint8_t* p = body;
+        uint32_t epoch = epochAt ? epochAt + (triggerMillis - epochMillis) / 1000 : 0;
+        const GpsPoint* fix = gpsCount ? &gps[(gpsHead + gpsCount - 1) % GpsPoints] : nullptr;
+        put32(p, epoch);
+        put32(p, fix ? (uint32_t)fix->lat : 0);
+        put32(p, fix ? (uint32_t)fix->lon : 0);
+        put16(p, imu::saturate16(imu::mulDiv(imu::isqrt(magSq), 980665, (uint64_t)scale.accelLsbPerG * 1000)));
+        put16(p, imu::saturate16(imu::mulDiv((uint64_t)imu::isqrt(diffSq) * scale.rateHz, 980665,
+                                             (uint64_t)scale.accelLsbPerG * 1000 * 1000)));
+        put16(p, (uint16_t)(scale.rateHz / decimation));
+        put16(p, (uint16_t)scale.accelLsbPerG);
+        put16(p, (uint16_t)scale.gyroLsbPerDps10);
+        put16(p, (uint16_t)ringCount);
+        put16(p, (uint16_t)PostSamples);
+        *p++ = (uint8_t)gpsCount;
+        writeRecord(body, (size_t)(p - body));
+
+        // GPS track, oldest first, relative to the trigger
+        for (size_t i = 0; i < gpsCount; i += CRASH_CHUNK_SAMPLES) {
+            uint8_t chunk[CRASH_CHUNK_SAMPLES * CRASH_GPS_POINT_BYTES];
+            p = chunk;
+            for (size_t k = i; k < gpsCount && k < i + CRASH_CHUNK_SAMPLES; k++) {
+                const GpsPoint& g = gps[(gpsHead + k) % GpsPoints];
+                put32(p, (uint32_t)(int32_t)(g.millis - triggerMillis));
+                put32(p, (uint32_t)g.lat);
+                put32(p, (uint32_t)g.lon);
+            }
+            writeRecord(chunk, (size_t)(p - chunk));
+        }
+
+        // Pre-trigger samples; the ring restarts empty for the next event
+        for (size_t i = 0; i < ringCount; i++) {
+            pendingSamples[pendingCount++] = ring[(ringHead + i) % PreSamples];
+            if (pendingCount == CRASH_CHUNK_SAMPLES || i + 1 == ringCount) writeSamples();
+        }
+        ringHead = ringCount = 0;
+
+        latencyLast = hal::micros() - sampleMicros;
+        latencyMax = latencyLast > latencyMax ? latencyLast : latencyMax;
+        eventCount++;
+        LOG_WARN("💥 Crash trigger: event %u frozen %u us after the sample", (unsigned)eventId, (unsigned)latencyLast);
+
+        hal::Preferences prefs;
+        prefs.begin("crash", false);
+        prefs.putUShort("next_id", nextId);
+        prefs.end();
+    }
+
+    void writeSamples() {
+        uint8_t chunk[CRASH_CHUNK_SAMPLES * CRASH_SAMPLE_BYTES];
+        uint8_t* p = chunk;
+        for (size_t i = 0; i < pendingCount; i++) {
+            for (int k = 0; k < 3; k++) put16(p, (uint16_t)pendingSamples[i].a[k]);
+            for (int k = 0; k < 3; k++) put16(p, (uint16_t)pendingSamples[i].g[k]);
+        }
+        pendingCount = 0;
+        writeRecord(chunk, (size_t)(p - chunk));
+    }
+
+    void writeRecord(const uint8_t* body, size_t len) {
+        uint8_t record[CRASH_RECORD_MAX];
+        record[0] = eventId;
+        record[1] = chunkIndex++;
+        record[2] = chunkCount;
+        memcpy(record + EVENT_CLEAR_LEN, body, len);
+        if (!store.append(record, EVENT_CLEAR_LEN + len)) lostCount++;
+    }
+
+    CrashThresholds thresholds;
+    ImuScale scale = {IMU_SAMPLE_RATE_HZ, 4096, 655};
+    uint32_t decimation = 1;
+    uint32_t accelThresholdSq = UINT32_MAX, jerkThresholdSq = UINT32_MAX;
+
+    // Sampling stage
+    Sample ring[PreSamples];
+    size_t ringHead = 0, ringCount = 0;
+    GpsPoint gps[GpsPoints];
+    size_t gpsHead = 0, gpsCount = 0;
+    uint32_t gpsLastMillis = 0;
+    uint32_t epochAt = 0, epochMillis = 0;
+    int16_t last[3] = {0, 0, 0};
+    bool haveLast = false;
+    Sample slotSample = {};
+    uint32_t slotPeak = 0, slotFill = 0;
+
+    bool capture = false;
+    uint8_t nextId = 0, eventId = 0, chunkIndex = 0, chunkCount = 0;
+    size_t postCount = 0;
+    Sample pendingSamples[CRASH_CHUNK_SAMPLES];
+    size_t pendingCount = 0;
+
+    FlashQueue store;
+    size_t inflight = 0;
+    uint32_t eventCount = 0, latencyLast = 0, latencyMax = 0, lostCount = 0;
+
+    // Shared between the stages
+    SpscRing<Chunk, CRASH_OUTBOX> outbox;
+    std::atomic<uint32_t> deliveredCount{0};
+
+    // Transmit stage
+    PayloadManager* encoder = nullptr;
+    Chunk current;
+    std::atomic<bool> haveCurrent{false};  // pending() is also asked by the sampling stage
+};
+
+#endif
@@ -1,19 +1,19 @@
 #ifndef DAILY_KEY_MANAGER_H
 #define DAILY_KEY_MANAGER_H
 
-#include <Arduino.h>
-#include <Preferences.h>
-#include <Crypto.h>
-#include <mbedtls/md.h>
-#include <TimeLib.h>
-
-#define DAILY_KEY_SIZE 16
-#define SECONDS_PER_DAY 86400
+#include "hal/hal.h"
+#include "log_manager.h"
+#include "message_counter.h"
+#include "key_chain.h"
+#include "trace_manager.h"
 
 class DailyKeyManager {
 public:
     DailyKeyManager() {}
 
+    // Counter restarted on day rollover; without one the stored value is reset
+    void setMessageCounter(MessageCounter* counter) { messageCounter = counter; }
+
     void init() {
         preferences.begin("dailykeys", false);
 
@@ -24,63 +24,58 @@ public:
         time_t lastEpoch = preferences.getULong64("last_epoch", startEpoch);
         preferences.putULong64("last_epoch", lastEpoch);
 
-        Serial.println("✅ DailyKeyManager Initialized");
-        printEpochAsDate(startEpoch, "📅 Start Epoch");
-        printEpochAsDate(lastEpoch, "📅 Last Epoch");
+        LOG_INFO("✅ DailyKeyManager Initialized");
+        logEpoch<LogLevel::Info>(startEpoch, "📅 Start Epoch");
+        logEpoch<LogLevel::Info>(lastEpoch, "📅 Last Epoch");
 
         if (!loadDailyKey()) {
-            Serial.println("⚠️ No Daily Key found. Generating from start_epoch...");
+            LOG_WARN("⚠️ No Daily Key found. Generating from start_epoch...");
             generateDailyKey(false);
         }
     }
 
     bool checkAndUpdateDailyKey(time_t gpsEpoch) {
-        static bool debugPrinted = false;
         time_t lastEpoch = preferences.getULong64("last_epoch", 0);
 
         time_t currentDay = normalizeToDay(gpsEpoch);
         time_t lastDay = normalizeToDay(lastEpoch);
 
         if (!debugPrinted) {
-            printEpochAsDate(gpsEpoch, "🛰️ GPS Current Time");
-            printEpochAsDate(lastEpoch, "📅 Stored Last Epoch");
-            printEpochAsDate(currentDay, "📅 Normalized GPS Day");
-            printEpochAsDate(lastDay, "📅 Normalized Last Day");
+            logEpoch<LogLevel::Debug>(gpsEpoch, "🛰️ GPS Current Time");
+            logEpoch<LogLevel::Debug>(lastEpoch, "📅 Stored Last Epoch");
+            logEpoch<LogLevel::Debug>(currentDay, "📅 Normalized GPS Day");
+            logEpoch<LogLevel::Debug>(lastDay, "📅 Normalized Last Day");
         }
 
         if (currentDay > lastDay) {
-            Serial.println("🔄 Day changed, generating new Daily Key...");
+            // After days switched off this walks every missed day, not just one step
+            LOG_INFO("🔄 Day changed, generating new Daily Key...");
             generateDailyKey(true, gpsEpoch);
-            Preferences counterPrefs;
-            counterPrefs.begin("payload", false);
-            counterPrefs.putUInt("counter", 0);
-            counterPrefs.end();
-            Serial.println("✅ Payload Counter reset for new day");
+            resetMessageCounter();
+            LOG_INFO("✅ Payload Counter reset for new day");
             debugPrinted = false;
             return true;
         }
 
         if (!debugPrinted) {
-            Serial.println("✅ Same day, no need to generate new Daily Key.");
+            LOG_DEBUG("✅ Same day, no need to generate new Daily Key.");
             debugPrinted = true;
         }
         return false;
     }
 
     void resetMasterKey() {
-        Serial.println("🚨 Resetting keys and storage...");
+        LOG_WARN("🚨 Resetting keys and storage...");
         preferences.clear();
         preferences.putULong64("last_epoch", getInitialEpoch());
         preferences.end();
 
-        Preferences counterPrefs;
-        counterPrefs.begin("payload", false);
-        counterPrefs.putUInt("counter", 0);
-        counterPrefs.end();
+        resetMessageCounter();
 
-        Serial.println("✅ Reset complete. Restarting...");
-        delay(1000);
-        ESP.restart();
+        LOG_WARN("✅ Reset complete. Restarting...");
+        logFlush();
+        hal::delay(1000);
+        hal::restart();
     }
 
     uint8_t* getDailyKey() { return daily_key; }
@@ -90,13 +85,11 @@ public:
     bool loadDailyKey() {
         uint8_t storedKey[DAILY_KEY_SIZE];
         if (preferences.getBytes("last_daily_key", daily_key, DAILY_KEY_SIZE) == DAILY_KEY_SIZE) {
-            Serial.print("🔄 Loaded Daily Key: ");
-            Serial.println(bytesToHex(daily_key, DAILY_KEY_SIZE));
+            LOG_DEBUG("🔄 Loaded Daily Key: %s", bytesToHex(daily_key, DAILY_KEY_SIZE).c_str());
 
             // 🔥 QUI devi leggere la stored key SEPARATAMENTE (o è identica a daily_key se vuoi confrontare)
             preferences.getBytes("last_daily_key", storedKey, DAILY_KEY_SIZE);
-            Serial.print("📌 Stored key: ");
-            Serial.println(bytesToHex(storedKey, DAILY_KEY_SIZE));
+            LOG_DEBUG("📌 Stored key: %s", bytesToHex(storedKey, DAILY_KEY_SIZE).c_str());
             return true;
         }
 
@@ -105,7 +98,7 @@ public:
 
   void setManualDailyKey(const String& hexKey) {
         if (hexKey.length() != DAILY_KEY_SIZE * 2) {
-            Serial.println("❌ Lunghezza chiave non valida!");
+            LOG_ERROR("❌ Lunghezza chiave non valida!");
             return;
         }
 
@@ -114,61 +107,66 @@ public:
         hexStringToBytes(hexKey, manualKey, DAILY_KEY_SIZE);
 
         preferences.putBytes("last_daily_key", manualKey, DAILY_KEY_SIZE);
-        Serial.print("✅ Nuova Daily Key inserita manualmente: ");
-        Serial.println(hexKey);
+        LOG_INFO("✅ Nuova Daily Key inserita manualmente: %s", hexKey.c_str());
     }
 
 
 
 
 private:
-    Preferences preferences;
+    hal::Preferences preferences;
+    MessageCounter* messageCounter = nullptr;
+    bool debugPrinted = false;  // per instance: simulated fleets run many side by side
     uint8_t daily_key[DAILY_KEY_SIZE];  // <-- aggiungi nuovamente questa linea!
 
 
 
     time_t getInitialEpoch() {
-        struct tm timeinfo = {0};
+        struct tm timeinfo = {};
         timeinfo.tm_year = 2025 - 1900;
         timeinfo.tm_mon  = 2;
         timeinfo.tm_mday = 25;
         return mktime(&timeinfo);
     }
 
+    void resetMessageCounter() {
+        if (messageCounter) messageCounter->reset();
+        else MessageCounter::resetPersisted();
+    }
+
     time_t normalizeToDay(time_t epoch) {
         return (epoch / SECONDS_PER_DAY) * SECONDS_PER_DAY;
     }
 
     void generateDailyKey(bool newDay, time_t gpsEpoch = 0) {
-        Serial.println("\n### 🔑 Generating Daily Key...");
+        LOG_INFO("### 🔑 Generating Daily Key...");
         uint8_t previousKey[DAILY_KEY_SIZE] = {0};
         bool hasPreviousKey = loadDailyKey();
 
         if (!hasPreviousKey || newDay) {
             if (!hasPreviousKey) {
                 generateInitialDailyKey(daily_key);
-                Serial.println("🚀 First Daily Key generated from Master Key!");
+                LOG_INFO("🚀 First Daily Key generated from Master Key!");
             } else {
                 preferences.getBytes("last_daily_key", previousKey, DAILY_KEY_SIZE);
-                Serial.println("");
-                generateDailyKeyFromPrevious(previousKey, daily_key, gpsEpoch);
-                Serial.println("🔁 New Daily Key generated from Previous Key!");
+                time_t lastEpoch = preferences.getULong64("last_epoch", gpsEpoch);
+                uint32_t days = generateDailyKeyFromPrevious(previousKey, daily_key, lastEpoch, gpsEpoch);
+                LOG_INFO("🔁 New Daily Key generated from Previous Key (%u day(s))!", (unsigned)days);
             }
 
-            Serial.print("🔑 New Daily Key: ");
-            Serial.println(bytesToHex(daily_key, DAILY_KEY_SIZE));
+            LOG_DEBUG("🔑 New Daily Key: %s", bytesToHex(daily_key, DAILY_KEY_SIZE).c_str());
+            TRACE_SPAN("nvs.dailyKey");
             preferences.putBytes("last_daily_key", daily_key, DAILY_KEY_SIZE);
-
             updateStoredEpoch(newDay, gpsEpoch);
         } else {
-            Serial.println("🟢 Existing Daily Key in use.");
+            LOG_INFO("🟢 Existing Daily Key in use.");
         }
     }
 
     void updateStoredEpoch(bool newDay, time_t gpsEpoch) {
         if (newDay && gpsEpoch != 0) {
             preferences.putULong64("last_epoch", gpsEpoch);
-            printEpochAsDate(gpsEpoch, "📅 last_epoch updated with GPS");
+            logEpoch<LogLevel::Info>(gpsEpoch, "📅 last_epoch updated with GPS");
         } else if (newDay) {
             time_t lastEpoch = preferences.getULong64("last_epoch", 0);
             preferences.putULong64("last_epoch", lastEpoch + SECONDS_PER_DAY);
@@ -182,67 +180,34 @@ private:
 
         validateMasterKeyLength(masterKeyStr);
 
-        uint8_t masterKeyBytes[32];
-        hexStringToBytes(masterKeyStr, masterKeyBytes, masterKeyStr.length() / 2);
+        uint8_t masterKeyBytes[32] = {0};
+        size_t masterKeyLen = masterKeyStr.length() / 2;
+        if (masterKeyLen > sizeof(masterKeyBytes)) masterKeyLen = sizeof(masterKeyBytes);
+        hexStringToBytes(masterKeyStr, masterKeyBytes, masterKeyLen);
 
-        uint8_t epochBytes[8];
-        uint64ToByteArray(startEpoch, epochBytes);
-
-        size_t dataLen = (masterKeyStr.length() / 2) + vehicleId.length() + 8;
-        uint8_t* data = new uint8_t[dataLen];
-
-        memcpy(data, masterKeyBytes, masterKeyStr.length() / 2);
-        memcpy(data + (masterKeyStr.length() / 2), vehicleId.c_str(), vehicleId.length());
-        memcpy(data + (masterKeyStr.length() / 2) + vehicleId.length(), epochBytes, 8);
-
-        sha256(data, dataLen, outDailyKey);
-        delete[] data;
+        TRACE_SPAN("keyDerivation");
+        keychain::deriveInitial(masterKeyBytes, masterKeyLen,
+                                (const uint8_t*)vehicleId.c_str(), vehicleId.length(),
+                                startEpoch, outDailyKey);
     }
 
     void validateMasterKeyLength(const String& masterKeyStr) {
         size_t len = masterKeyStr.length();
         if (len != 32 && len != 64) {
-            Serial.println("❌ Invalid Master Key length! Must be 32 or 64 hex characters.");
+            LOG_ERROR("❌ Invalid Master Key length! Must be 32 or 64 hex characters.");
         }
     }
 
-    void generateDailyKeyFromPrevious(uint8_t* prevKey, uint8_t* outDailyKey, time_t epochToUse) {
-        time_t nextEpoch = normalizeToDay(epochToUse);
-        printEpochAsDate(nextEpoch, "📅 Generating Key for Epoch");
+    // Chains prevKey (the key of fromEpoch's day) forward to toEpoch's day
+    uint32_t generateDailyKeyFromPrevious(const uint8_t* prevKey, uint8_t* outDailyKey,
+                                          time_t fromEpoch, time_t toEpoch) {
+        logEpoch<LogLevel::Debug>(keychain::dayOf(toEpoch), "📅 Generating Key for Epoch");
 
         String vehicleId = preferences.getString("vehicle_id");
-        uint8_t epochBytes[8];
-        uint64ToByteArray(nextEpoch, epochBytes);
-
-        size_t totalLen = DAILY_KEY_SIZE + vehicleId.length() + 8;
-        uint8_t* data = new uint8_t[totalLen];
-
-        memcpy(data, prevKey, DAILY_KEY_SIZE);
-        memcpy(data + DAILY_KEY_SIZE, vehicleId.c_str(), vehicleId.length());
-        memcpy(data + DAILY_KEY_SIZE + vehicleId.length(), epochBytes, 8);
-
-        sha256(data, totalLen, outDailyKey);
-        delete[] data;
-    }
-
-    void uint64ToByteArray(uint64_t num, uint8_t* bytes) {
-        for (int i = 0; i < 8; i++) {
-            bytes[7 - i] = num & 0xFF;
-            num >>= 8;
-        }
-    }
-
-
-    void sha256(const uint8_t* data, size_t dataLen, uint8_t* output) {
-        uint8_t hash[32];
-        mbedtls_md_context_t ctx;
-        mbedtls_md_init(&ctx);
-        mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 0);
-        mbedtls_md_starts(&ctx);
-        mbedtls_md_update(&ctx, data, dataLen);
-        mbedtls_md_finish(&ctx, hash);
-        mbedtls_md_free(&ctx);
-        memcpy(output, hash, DAILY_KEY_SIZE);
+        memcpy(outDailyKey, prevKey, DAILY_KEY_SIZE);
+        TRACE_SPAN("keyDerivation");
+        return keychain::advance(outDailyKey, (const uint8_t*)vehicleId.c_str(), vehicleId.length(),
+                                 fromEpoch, toEpoch);
     }
 
     String bytesToHex(const uint8_t* bytes, size_t len) {
@@ -263,21 +228,24 @@ private:
     String getOrAsk(const char* key, const char* prompt) {
         String value = preferences.getString(key);
         if (value.isEmpty()) {
-            Serial.print(prompt);
-            while (!Serial.available());
-            value = Serial.readStringUntil('\n');
-            value.trim();
+            logFlush();
+            hal::log(prompt);  // interactive: bypasses the deferred log
+            value = hal::readLine();
             preferences.putString(key, value);
         }
         return value;
     }
 
-    void printEpochAsDate(time_t epoch, const String& label = "📅 Date") {
-        struct tm* timeinfo = gmtime(&epoch);
-        Serial.printf("%s: %02d-%02d-%04d %02d:%02d:%02d UTC\n",
-                      label.c_str(),
-                      timeinfo->tm_mday, timeinfo->tm_mon + 1, timeinfo->tm_year + 1900,
-                      timeinfo->tm_hour, timeinfo->tm_min, timeinfo->tm_sec);
+    template <LogLevel L>
+    void logEpoch(time_t epoch, const char* label) {
+        if constexpr (logEnabled(L)) {
+            struct tm timeinfo;
+            gmtime_r(&epoch, &timeinfo);
+            logWrite(L, "%s: %02d-%02d-%04d %02d:%02d:%02d UTC",
+                     label,
+                     timeinfo.tm_mday, timeinfo.tm_mon + 1, timeinfo.tm_year + 1900,
+                     timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
+        }
     }
 };
 
@@ -0,0 +1,64 @@
+// dht_cache.h - Last DHT11 reading, refreshed off the transmit path
+//
+// The DHT11 driver busy-waits through the one-wire exchange (tens of ms), and
+// the sensor cannot be read more than about once a second anyway. A scheduler
+// task calls refresh() at low priority; the payload path takes the cached
+// value with get(), which only falls back to a blocking read when the cache is
+// older than its staleness bound (or was never filled), so a frame never
+// carries a temperature older than that.
+#ifndef DHT_CACHE_H
+#define DHT_CACHE_H
+
+#include "hal/hal.h"
+#include "hal/hal_sensors.h"
+
+// Oldest cached reading get() returns without reading the sensor again
+#define DHT_MAX_AGE_MS 60000
+
+class DhtCache {
+public:
+    explicit DhtCache(DHT11* dht, uint32_t maxAgeMs = DHT_MAX_AGE_MS) : dht(dht), maxAge(maxAgeMs) {}
+
+    // Blocking read into the cache; a failed read keeps the previous value
+    bool refresh() {
+        int t = 0, h = 0;
+        if (dht->readTemperatureHumidity(t, h) != 0) {
+            failures++;
+            return false;
+        }
+        temperature = t;
+        humidity = h;
+        readAt = hal::millis();
+        valid = true;
+        return true;
+    }
+
+    // Cached reading, read through when stale; false if no reading at all
+    bool get(int& t, int& h) {
+        if (!fresh()) {
+            staleReads++;
+            refresh();
+        }
+        if (!valid) return false;
+        t = temperature;
+        h = humidity;
+        return true;
+    }
+
+    bool fresh() const { return valid && hal::millis() - readAt <= maxAge; }
+    uint32_t age() const { return valid ? hal::millis() - readAt : UINT32_MAX; }
+    uint32_t failedReads() const { return failures; }
+    uint32_t blockingReads() const { return staleReads; }
+
+private:
+    DHT11* dht;
+    uint32_t maxAge;
+    int temperature = 0;
+    int humidity = 0;
+    uint32_t readAt = 0;
+    bool valid = false;
+    uint32_t failures = 0;
+    uint32_t staleReads = 0;
+};
+
+#endif
@@ -1,56 +1,52 @@
 #ifndef ENCRYPTION_MANAGER_H
 #define ENCRYPTION_MANAGER_H
 
-#include <Arduino.h>
-#include <Crypto.h>
-#include <AES.h>
-#include <CTR.h>
-
+#include "hal/hal.h"
+#include "log_manager.h"
+#include "trace_manager.h"
+
+// The AES key schedule is expanded once per daily key: key points at the
+// daily key the DailyKeyManager rolls over in place, so every frame compares
+// it with the key the schedule was built from and re-keys only when it changed.
+// Nothing on the per-frame path allocates.
 class EncryptionManager {
 public:
     EncryptionManager(uint8_t* key) {
         this->key = key;
-        Serial.print("🛡️ AES-128 Daily Key: ");
-        for (int i = 0; i < 16; i++){
-            Serial.printf("%02X", key[i]);
-        }
-        Serial.println();
+        LOG_HEX(LogLevel::Debug, "🛡️ AES-128 Daily Key: ", key, 16);
     }
 
     // Funzione che cifra in modalità AES-128 CTR usando l'IV passato come parametro.
     void encryptAESCTR(uint8_t* data, size_t length, uint8_t* effectiveIV) {
-        // Visualizza l'IV effective
-        Serial.print("🟢 Effective IV: ");
-        for (int i = 0; i < 16; i++) {
-            Serial.printf("%02X ", effectiveIV[i]);
-        }
-        Serial.println();
-
-        // Inizializza AES-128 in modalità CTR con l'IV effective
-        AES128 aes;
-        CTR<AES128> aesCtr;
-        aesCtr.setKey(key, 16);        
-        aesCtr.setIV(effectiveIV, 16); 
-
-        // Visualizza i dati prima della cifratura
-        Serial.print("🔄 Data Before Encryption: ");
-        for (size_t i = 0; i < length; i++) {
-            Serial.printf("%02X ", data[i]);
-        }
-        Serial.println();
-
-        // Cifra in-place
-        aesCtr.encrypt(data, data, length);
+        TRACE_SPAN("encryptAESCTR");
+        // Visualizza l'IV effective e i dati prima della cifratura (solo trace: è il plaintext)
+        LOG_HEX(LogLevel::Trace, "🟢 Effective IV: ", effectiveIV, 16);
+        LOG_HEX(LogLevel::Trace, "🔄 Data Before Encryption: ", data, length);
+
+        // Cifra in-place con AES-128 CTR e l'IV effective
+        if (!keyed || memcmp(scheduled, key, sizeof(scheduled)) != 0) rekey();
+        cipher.crypt(effectiveIV, data, length);
 
         // Visualizza i dati cifrati
-        Serial.print("🔒 Data After Encryption: ");
-        for (size_t i = 0; i < length; i++) {
-            Serial.printf("%02X ", data[i]);
-        }
-        Serial.println();
+        LOG_HEX(LogLevel::Trace, "🔒 Data After Encryption: ", data, length);
+    }
+    // Expands the schedule for the current daily key
+    void rekey() {
+        TRACE_SPAN("aesKeySchedule");
+        memcpy(scheduled, key, sizeof(scheduled));
+        cipher.setKey(scheduled);
+        keyed = true;
+        rekeys++;
     }
+
+    uint32_t getRekeys() const { return rekeys; }
+
 private:
     uint8_t* key;
+    hal::Aes128Ctr cipher;
+    uint8_t scheduled[16];
+    bool keyed = false;
+    uint32_t rekeys = 0;
 };
 
 #endif
@@ -0,0 +1,282 @@
+// flash_queue.h - Store-and-forward queue of readings on a flash partition
+//
+// Log-structured ring of 4 KiB sectors. A sector starts with a header
+// (magic, sequence number, erase count, "all consumed" flag) followed by
+// records | state | len | crc8 | data | that are appended with one write.
+// Delivered records are marked by clearing bits of their state byte, so
+// neither append nor consume erases anything: a sector is erased only when
+// the writer laps around to it, which spreads wear evenly over the partition.
+// Head and tail are rebuilt from flash by begin(); RAM use does not depend on
+// the size of the backlog.
+//
+// When the partition is full the oldest sector is reused and its readings are
+// dropped: for a blackbox the newest data matters most. A record torn by a
+// power cut fails its CRC and the rest of its sector is skipped.
+#ifndef FLASH_QUEUE_H
+#define FLASH_QUEUE_H
+
+#include "hal/hal.h"
+#include "hal/hal_flash.h"
+#include "log_manager.h"
+
+#define FLASH_QUEUE_PARTITION "blackbox"
+#define FLASH_QUEUE_MAX_RECORD 255
+
+class FlashQueue {
+public:
+    struct Cursor {
+        uint32_t sector;
+        uint32_t offset;
+    };
+
+    bool begin(const char* label = FLASH_QUEUE_PARTITION) {
+        if (started) return true;
+        if (!flash.begin(label) || flash.size() / SECTOR < 2) {
+            LOG_ERROR("❌ Flash queue: partition '%s' missing or too small", label);
+            return false;
+        }
+        sectors = flash.size() / SECTOR;
+        started = true;
+
+        // The newest formatted sector holds the tail
+        bool found = false;
+        for (uint32_t s = 0; s < sectors; s++) {
+            SectorHeader h;
+            if (readHeader(s, h) && (!found || h.seq > writeSeq)) {
+                writeSector = s;
+                writeSeq = h.seq;
+                found = true;
+            }
+        }
+        if (!found) {
+            writeSector = sectors - 1;
+            writeSeq = 0;
+            if (!openNextSector()) return fail();
+            LOG_INFO("💾 Flash queue formatted: %u sectors", (unsigned)sectors);
+            return true;
+        }
+        writeOffset = findTail(writeSector);
+
+        // Head and backlog: walk the live sectors from the oldest one
+        pending = 0;
+        head = {writeSector, writeOffset};
+        bool haveHead = false;
+        for (uint32_t i = 1; i <= sectors; i++) {
+            uint32_t s = (writeSector + i) % sectors;
+            SectorHeader h;
+            if (!readHeader(s, h) || writeSeq - h.seq >= sectors || h.consumed != SECTOR_LIVE) continue;
+            uint8_t data[FLASH_QUEUE_MAX_RECORD];
+            size_t len;
+            for (Cursor c{s, HEADER_SIZE}; step(c, data, len) && c.sector == s; c.offset += RECORD_HEADER + len) {
+                if (!haveHead) head = c;
+                haveHead = true;
+                pending++;
+            }
+        }
+        LOG_INFO("💾 Flash queue: %u readings pending", (unsigned)pending);
+        return true;
+    }
+
+    void end() {
+        flash.end();
+        started = false;
+        pending = 0;
+    }
+
+    bool ready() const { return started; }
+
+    bool append(const uint8_t* data, size_t len) {
+        if (!started || len == 0 || len > FLASH_QUEUE_MAX_RECORD) return false;
+        size_t need = RECORD_HEADER + len;
+        if (writeOffset + need > SECTOR && !openNextSector()) return false;
+
+        uint8_t record[RECORD_HEADER + FLASH_QUEUE_MAX_RECORD];
+        record[0] = RECORD_VALID;
+        record[1] = (uint8_t)len;
+        record[2] = crc8(record[1], data, len);
+        memcpy(record + RECORD_HEADER, data, len);
+        if (!flash.write(base(writeSector) + writeOffset, record, need)) {
+            LOG_ERROR("❌ Flash queue: write failed");
+            writeOffset = SECTOR;  // never write behind a bad record
+            return false;
+        }
+        if (pending == 0) head = {writeSector, writeOffset};
+        writeOffset += need;
+        pending++;
+        return true;
+    }
+
+    // Oldest pending reading; iterate with read()
+    Cursor front() const { return head; }
+
+    // Copies the reading at c and moves c past it. False at the end of the
+    // queue, or when it is longer than cap (len = its length, c unchanged).
+    bool read(Cursor& c, uint8_t* out, size_t cap, size_t& len) {
+        uint8_t data[FLASH_QUEUE_MAX_RECORD];
+        Cursor at = c;
+        if (!started || !step(at, data, len) || len > cap) return false;
+        memcpy(out, data, len);
+        c = {at.sector, at.offset + RECORD_HEADER + (uint32_t)len};
+        return true;
+    }
+
+    // Marks the n oldest readings delivered; returns how many were pending
+    size_t consume(size_t n) {
+        uint8_t data[FLASH_QUEUE_MAX_RECORD];
+        size_t len, done = 0;
+        Cursor c = head;
+        while (done < n && started && step(c, data, len)) {
+            uint8_t state = RECORD_CONSUMED;
+            flash.write(base(c.sector) + c.offset, &state, 1);
+            markConsumed(head.sector, c.sector);
+            head = {c.sector, c.offset + RECORD_HEADER + (uint32_t)len};
+            c = head;
+            done++;
+        }
+        pending -= done;
+        // Park the head on the next pending reading (or the tail)
+        Cursor next = head;
+        if (!started || !step(next, data, len)) next = {writeSector, writeOffset};
+        markConsumed(head.sector, next.sector);
+        head = next;
+        return done;
+    }
+
+    size_t size() const { return pending; }
+    uint32_t sectorCount() const { return sectors; }
+    // Readings lost to a full partition and sector erases since begin()
+    uint32_t dropped() const { return droppedCount; }
+    uint32_t erases() const { return eraseCount; }
+
+private:
+    static constexpr uint32_t SECTOR = hal::FlashPartition::SECTOR_SIZE;
+    static constexpr uint32_t MAGIC = 0x31514242;  // "BBQ1"
+    static constexpr uint32_t HEADER_SIZE = 16;
+    static constexpr uint32_t RECORD_HEADER = 3;
+    static constexpr uint8_t RECORD_FREE = 0xFF;
+    static constexpr uint8_t RECORD_VALID = 0x7F;
+    static constexpr uint8_t RECORD_CONSUMED = 0x3F;
+    static constexpr uint8_t SECTOR_LIVE = 0xFF;
+    static constexpr uint8_t SECTOR_CONSUMED = 0x00;
+
+    struct SectorHeader {
+        uint32_t magic;
+        uint32_t seq;
+        uint32_t eraseCount;
+        uint8_t consumed;
+        uint8_t reserved[3];
+    };
+    static_assert(sizeof(SectorHeader) == HEADER_SIZE, "sector header layout");
+
+    static uint8_t crc8(uint8_t len, const uint8_t* data, size_t n) {
+        uint8_t crc = 0;
+        auto feed = [&crc](uint8_t b) {
+            crc ^= b;
+            for (int i = 0; i < 8; i++) crc = (uint8_t)((crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1);
+        };
+        feed(len);
+        for (size_t i = 0; i < n; i++) feed(data[i]);
+        return crc;
+    }
+
+    size_t base(uint32_t sector) const { return (size_t)sector * SECTOR; }
+
+    bool readHeader(uint32_t sector, SectorHeader& h) {
+        return flash.read(base(sector), &h, sizeof(h)) && h.magic == MAGIC;
+    }
+
+    // Reads the record at offset; false for free space or a damaged record
+    bool readRecord(uint32_t sector, uint32_t offset, uint8_t& state, uint8_t* data, size_t& len) {
+        uint8_t hdr[RECORD_HEADER];
+        if (offset + RECORD_HEADER > SECTOR || !flash.read(base(sector) + offset, hdr, sizeof(hdr))) return false;
+        state = hdr[0];
+        len = hdr[1];
+        if (state == RECORD_FREE || offset + RECORD_HEADER + len > SECTOR) return false;
+        if (!flash.read(base(sector) + offset + RECORD_HEADER, data, len)) return false;
+        return crc8(hdr[1], data, len) == hdr[2] && (state == RECORD_VALID || state == RECORD_CONSUMED);
+    }
+
+    // First free byte of a sector; a damaged record closes the sector
+    uint32_t findTail(uint32_t sector) {
+        uint8_t data[FLASH_QUEUE_MAX_RECORD], state;
+        size_t len;
+        uint32_t offset = HEADER_SIZE;
+        while (readRecord(sector, offset, state, data, len)) offset += RECORD_HEADER + len;
+        if (offset + 1 <= SECTOR && flash.read(base(sector) + offset, &state, 1) && state != RECORD_FREE) {
+            return SECTOR;
+        }
+        return offset;
+    }
+
+    // Moves c to the next pending record at or after it (data/len filled in)
+    bool step(Cursor& c, uint8_t* data, size_t& len) {
+        while (true) {
+            if (c.sector == writeSector && c.offset >= writeOffset) return false;
+            uint8_t state;
+            bool ok;
+            while ((ok = readRecord(c.sector, c.offset, state, data, len)) && state == RECORD_CONSUMED) {
+                c.offset += RECORD_HEADER + len;
+                if (c.sector == writeSector && c.offset >= writeOffset) return false;
+            }
+            if (ok) return true;
+            if (c.sector == writeSector) return false;
+            c = {(c.sector + 1) % sectors, HEADER_SIZE};
+        }
+    }
+
+    // Flags the sectors in [from, to) as fully delivered so begin() skips them
+    void markConsumed(uint32_t from, uint32_t to) {
+        uint8_t flag = SECTOR_CONSUMED;
+        for (uint32_t s = from; s != to; s = (s + 1) % sectors) {
+            flash.write(base(s) + offsetof(SectorHeader, consumed), &flag, 1);
+        }
+    }
+
+    bool openNextSector() {
+        uint32_t next = (writeSector + 1) % sectors;
+
+        // Lapping onto readings that were never delivered: they are lost
+        if (pending > 0 && head.sector == next) {
+            uint8_t data[FLASH_QUEUE_MAX_RECORD];
+            size_t len, lost = 0;
+            for (Cursor c = head; step(c, data, len) && c.sector == next; c.offset += RECORD_HEADER + len) lost++;
+            pending -= lost;
+            droppedCount += lost;
+            LOG_WARN("⚠️ Flash queue full: %u oldest readings dropped", (unsigned)lost);
+            Cursor c{(next + 1) % sectors, HEADER_SIZE};
+            head = step(c, data, len) ? c : Cursor{writeSector, writeOffset};
+        }
+
+        SectorHeader old;
+        uint32_t erased = readHeader(next, old) ? old.eraseCount + 1 : 1;
+        SectorHeader h{MAGIC, writeSeq + 1, erased, SECTOR_LIVE, {0xFF, 0xFF, 0xFF}};
+        if (!flash.eraseSector(base(next)) || !flash.write(base(next), &h, sizeof(h))) {
+            LOG_ERROR("❌ Flash queue: cannot open sector %u", (unsigned)next);
+            return false;
+        }
+        eraseCount++;
+        writeSector = next;
+        writeSeq++;
+        writeOffset = HEADER_SIZE;
+        if (pending == 0) head = {writeSector, writeOffset};
+        return true;
+    }
+
+    bool fail() {
+        end();
+        return false;
+    }
+
+    hal::FlashPartition flash;
+    bool started = false;
+    uint32_t sectors = 0;
+    uint32_t writeSector = 0;
+    uint32_t writeSeq = 0;
+    uint32_t writeOffset = 0;
+    Cursor head{0, 0};
+    size_t pending = 0;
+    uint32_t droppedCount = 0;
+    uint32_t eraseCount = 0;
+};
+
+#endif
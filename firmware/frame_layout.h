@@ -0,0 +1,113 @@
+// frame_layout.h - On-air layout of a telemetry frame, shared by the device
+// encoder (PayloadManager) and the backend decoder
+//
+// | IV lo | IV hi | 6 | 0x01 T | 0x03 gx gy gz | 16 | AES-CTR(0x04 Apk Arms J | 0x05 lat lon) |
+//
+// The CTR counter block is the device's 32-bit message counter, little endian,
+// followed by 12 zero bytes (frameCounterBlock). Only its low 16 bits go on air
+// as the IV; the backend recovers the high half from the frames of the same
+// day it decoded before (frame_decoder.h). The day is implicit in the daily
+// key, and MessageCounter never hands out a value twice under one key, reboots
+// included, so no keystream block repeats until 2^32 frames in a day. Below
+// 65,536 frames the block is the one older firmware used. The 16-byte
+// encrypted block uses exactly one keystream block.
+//
+// With the IMU FIFO running (imu_features.h) the motion values describe the
+// whole window since the previous frame: peak and RMS of |a|, peak jerk and
+// the per-axis gyro rate of largest magnitude. Without it they come from one
+// instantaneous reading (RMS = peak, jerk 0).
+//
+// The fields are declared once in TelemetryFrame (frame_schema.h); block
+// lengths and offsets below are derived from it. A new channel is one more
+// Field line, plus a member of SensorReading.
+#ifndef FRAME_LAYOUT_H
+#define FRAME_LAYOUT_H
+
+#include "frame_schema.h"
+
+#define FRAME_IV_LEN 2
+
+// CTR counter block of the frame with message counter counter. Bytes 4..15 are
+// zero; CTR counts the blocks of a longer body (event frames) in the last ones.
+inline void frameCounterBlock(uint32_t counter, uint8_t block[16]) {
+    block[0] = (uint8_t)counter;
+    block[1] = (uint8_t)(counter >> 8);
+    block[2] = (uint8_t)(counter >> 16);
+    block[3] = (uint8_t)(counter >> 24);
+    memset(block + 4, 0, 12);
+}
+
+#define MARKER_TEMPERATURE 0x01
+#define MARKER_GYRO 0x03
+#define MARKER_ACCEL 0x04
+#define MARKER_GPS 0x05
+
+// One sample in the units that go on air
+struct SensorReading {
+    int8_t temperature;  // deg C
+    int8_t gyro[3];      // rad/s * 10, per-axis extreme of the window
+    uint16_t accel;      // peak |a| in m/s^2 * 100
+    int32_t lat;         // degrees * 1e7
+    int32_t lon;
+    uint16_t accelRms;   // RMS of |a| in m/s^2 * 100
+    uint16_t jerk;       // peak |da/dt| in (m/s^2 per ms) * 100
+};
+
+using TemperatureField = schema::Field<MARKER_TEMPERATURE, schema::Block::Clear, 1, &SensorReading::temperature>;
+using GyroField = schema::Field<MARKER_GYRO, schema::Block::Clear, 10, &SensorReading::gyro>;
+using AccelField = schema::Field<MARKER_ACCEL, schema::Block::Encrypted, 100, &SensorReading::accel,
+                                 &SensorReading::accelRms, &SensorReading::jerk>;
+using GpsField = schema::Field<MARKER_GPS, schema::Block::Encrypted, 10000000, &SensorReading::lat,
+                               &SensorReading::lon>;
+
+using TelemetryFrame = schema::Frame<FRAME_IV_LEN, TemperatureField, GyroField, AccelField, GpsField>;
+
+#define CLEAR_BLOCK_LEN TelemetryFrame::clearLen
+#define ENCRYPTED_BLOCK_LEN TelemetryFrame::encryptedLen
+#define PAYLOAD_SIZE TelemetryFrame::size
+
+// Offsets of the two block-length bytes and of the encrypted block
+#define FRAME_CLEAR_LEN_OFFSET TelemetryFrame::clearLenOffset
+#define FRAME_ENCRYPTED_LEN_OFFSET TelemetryFrame::encryptedLenOffset
+#define FRAME_ENCRYPTED_OFFSET TelemetryFrame::encryptedOffset
+
+// The backend decrypts a frame with a single keystream block
+static_assert(ENCRYPTED_BLOCK_LEN <= 16, "encrypted block exceeds one AES block");
+// The web and MQTT decoders still hard-code this layout
+static_assert(CLEAR_BLOCK_LEN == 6 && ENCRYPTED_BLOCK_LEN == 16 && PAYLOAD_SIZE == 26,
+              "frame layout changed: update frontend/src and scripts/mqtt, then this check");
+
+// The byte after the IV tells the formats apart: CLEAR_BLOCK_LEN for the frame
+// above, COMPACT_FORMAT | flags for a compact frame (compact_codec.h)
+#define FRAME_FORMAT_OFFSET FRAME_CLEAR_LEN_OFFSET
+#define COMPACT_FORMAT 0x80
+#define COMPACT_KEYFRAME 0x01
+static_assert(CLEAR_BLOCK_LEN < COMPACT_FORMAT, "clear block length collides with the compact format flag");
+
+// Crash windows (crash_recorder.h) go out one chunk per uplink on FPORT_EVENT:
+//
+//   | IV lo | IV hi | EVENT_FORMAT | event | chunk | chunks | AES-CTR(body) |
+//
+// with the same counter block and daily key as a telemetry frame. Chunk 0 is the
+// summary, then the GPS track, then the IMU samples (record layout in
+// crash_recorder.h, decoded by backend/event_decoder.h).
+#define EVENT_FORMAT 0x40
+#define EVENT_CLEAR_LEN 3
+#define EVENT_HEADER_LEN (FRAME_IV_LEN + 1 + EVENT_CLEAR_LEN)
+// Samples (or GPS points) per chunk, and the bytes of one of each and of the summary
+#define CRASH_CHUNK_SAMPLES 8
+#define CRASH_SAMPLE_BYTES 12
+#define CRASH_GPS_POINT_BYTES 12
+#define CRASH_SUMMARY_BYTES 27
+static_assert(CLEAR_BLOCK_LEN < EVENT_FORMAT, "clear block length collides with the event format");
+
+// LoRaWAN ports: a single frame as above, or several frames in one uplink
+//
+//   | count | len0 | frame0 | len1 | frame1 | ... |
+#define FPORT_FRAME 1
+#define FPORT_AGGREGATE 2
+#define FPORT_EVENT 3
+#define AGGREGATE_HEADER_LEN 1
+#define AGGREGATE_ENTRY_OVERHEAD 1
+
+#endif
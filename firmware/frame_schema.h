@@ -0,0 +1,196 @@
+// frame_schema.h - Compile-time description of a marker-tagged telemetry frame
+//
+// A frame is a list of Fields. A field has:
+//   - a marker byte
+//   - the block it travels in (clear or encrypted)
+//   - its fixed-point scale
+//   - the members of the reading struct it carries: scalars or arrays, all of
+//     one integer type
+// Frame<> works out the block lengths and the offset of every field at
+// compile time. Its write() therefore expands to stores at constant offsets,
+// with no loop over the schema at run time. The same description gives the
+// host its parser (readClear/readEncrypted) and the compact codec its list
+// of values.
+//
+// Values are copied in memory order, i.e. little-endian on both the ESP32 and
+// the hosts the backend runs on.
+#ifndef FRAME_SCHEMA_H
+#define FRAME_SCHEMA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace schema {
+
+enum class Block : uint8_t { Clear, Encrypted };
+
+namespace detail {
+
+template <typename> struct MemberTraits;
+template <typename C, typename T> struct MemberTraits<T C::*> {
+    using Class = C;
+    using Type = T;
+};
+template <auto M> using Class = typename MemberTraits<decltype(M)>::Class;
+template <auto M> using Member = typename MemberTraits<decltype(M)>::Type;
+template <auto M> using Element = std::remove_all_extents_t<Member<M>>;
+
+template <auto M, auto...> struct FirstOf {
+    static constexpr auto value = M;
+};
+
+template <typename T> void toInts(const T& m, int32_t*& v) {
+    if constexpr (std::is_array_v<T>) {
+        for (const auto& e : m) *v++ = e;
+    } else {
+        *v++ = m;
+    }
+}
+
+template <typename T> void fromInts(T& m, const int32_t*& v) {
+    if constexpr (std::is_array_v<T>) {
+        for (auto& e : m) e = (std::remove_all_extents_t<T>)*v++;
+    } else {
+        m = (T)*v++;
+    }
+}
+
+}  // namespace detail
+
+// On air a field is | marker | value ... |; value = physical * Scale
+template <uint8_t Marker, Block Where, int32_t Scale, auto... Members>
+struct Field {
+    static_assert(sizeof...(Members) > 0, "a field carries at least one member");
+    using Reading = detail::Class<detail::FirstOf<Members...>::value>;
+    using Element = detail::Element<detail::FirstOf<Members...>::value>;
+    static_assert(std::is_integral_v<Element> && sizeof(Element) <= 4, "fields are 8..32-bit integers");
+    static_assert((std::is_same_v<Element, detail::Element<Members>> && ...), "one element type per field");
+
+    static constexpr uint8_t marker = Marker;
+    static constexpr Block block = Where;
+    static constexpr int32_t scale = Scale;
+    static constexpr size_t count = (sizeof(detail::Member<Members>) + ...) / sizeof(Element);
+    static constexpr size_t valueBytes = count * sizeof(Element);
+    static constexpr size_t size = 1 + valueBytes;
+
+    static void store(uint8_t* p, const Reading& r) {
+        ((memcpy(p, &(r.*Members), sizeof(r.*Members)), p += sizeof(r.*Members)), ...);
+    }
+    static void load(const uint8_t* p, Reading& r) {
+        ((memcpy(&(r.*Members), p, sizeof(r.*Members)), p += sizeof(r.*Members)), ...);
+    }
+    static void toValues(const Reading& r, int32_t*& v) { (detail::toInts(r.*Members, v), ...); }
+    static void fromValues(const int32_t*& v, Reading& r) { (detail::fromInts(r.*Members, v), ...); }
+};
+
+// | IV (HeaderLen bytes) | clearLen | clear fields | encryptedLen | encrypted fields |
+template <size_t HeaderLen, typename... Fields>
+struct Frame {
+    using Reading = typename std::tuple_element_t<0, std::tuple<Fields...>>::Reading;
+    static_assert((std::is_same_v<Reading, typename Fields::Reading> && ...), "one reading type per frame");
+    template <size_t I> using FieldAt = std::tuple_element_t<I, std::tuple<Fields...>>;
+
+    template <Block B> static constexpr size_t blockLen = ((Fields::block == B ? Fields::size : 0) + ...);
+    template <Block B> static constexpr size_t blockValues = ((Fields::block == B ? Fields::count : 0) + ...);
+    template <Block B>
+    static constexpr size_t blockValueBytes = ((Fields::block == B ? Fields::valueBytes : 0) + ...);
+
+    static constexpr size_t clearLen = blockLen<Block::Clear>;
+    static constexpr size_t encryptedLen = blockLen<Block::Encrypted>;
+    static constexpr size_t clearLenOffset = HeaderLen;
+    static constexpr size_t encryptedLenOffset = clearLenOffset + 1 + clearLen;
+    static constexpr size_t encryptedOffset = encryptedLenOffset + 1;
+    static constexpr size_t size = encryptedOffset + encryptedLen;
+
+    // Every scalar of the reading, clear block first (the compact codec's view)
+    static constexpr size_t clearValues = blockValues<Block::Clear>;
+    static constexpr size_t values = clearValues + blockValues<Block::Encrypted>;
+
+    static_assert(clearLen <= 0xFF && encryptedLen <= 0xFF, "block lengths are one byte");
+
+    static constexpr bool uniqueMarkers() {
+        constexpr uint8_t markers[] = {Fields::marker...};
+        for (size_t i = 0; i < sizeof...(Fields); i++) {
+            for (size_t j = i + 1; j < sizeof...(Fields); j++) {
+                if (markers[i] == markers[j]) return false;
+            }
+        }
+        return true;
+    }
+    static_assert(uniqueMarkers(), "markers must be unique");
+
+    // Offset of field I's marker from the start of the frame
+    template <size_t I> static constexpr size_t offsetOf() {
+        constexpr Block blocks[] = {Fields::block...};
+        constexpr size_t sizes[] = {Fields::size...};
+        size_t offset = blocks[I] == Block::Clear ? clearLenOffset + 1 : encryptedOffset;
+        for (size_t k = 0; k < I; k++) {
+            if (blocks[k] == blocks[I]) offset += sizes[k];
+        }
+        return offset;
+    }
+
+    // Everything after the IV, encrypted block still in plain text
+    static void write(const Reading& r, uint8_t* frame) {
+        frame[clearLenOffset] = (uint8_t)clearLen;
+        frame[encryptedLenOffset] = (uint8_t)encryptedLen;
+        writeFields(r, frame, std::index_sequence_for<Fields...>{});
+    }
+
+    // Checks the block lengths and clear markers of a frame of at least size
+    // bytes and loads the clear fields
+    static bool readClear(const uint8_t* frame, Reading& r) {
+        if (frame[clearLenOffset] != clearLen || frame[encryptedLenOffset] != encryptedLen) return false;
+        return readBlock<Block::Clear>(frame, 0, r, std::index_sequence_for<Fields...>{});
+    }
+
+    // plain: the decrypted block. False if a marker is off, i.e. the wrong key.
+    static bool readEncrypted(const uint8_t* plain, Reading& r) {
+        return readBlock<Block::Encrypted>(plain, encryptedOffset, r, std::index_sequence_for<Fields...>{});
+    }
+
+    // The values of one block back to back, without markers
+    template <Block B> static void storeValues(const Reading& r, uint8_t* p) {
+        ((Fields::block == B ? (Fields::store(p, r), p += Fields::valueBytes, void()) : void()), ...);
+    }
+    template <Block B> static void loadValues(const uint8_t* p, Reading& r) {
+        ((Fields::block == B ? (Fields::load(p, r), p += Fields::valueBytes, void()) : void()), ...);
+    }
+
+    // One block's scalars as int32, in frame order
+    template <Block B> static void toValues(const Reading& r, int32_t* v) {
+        ((Fields::block == B ? Fields::toValues(r, v) : void()), ...);
+    }
+    template <Block B> static void fromValues(const int32_t* v, Reading& r) {
+        ((Fields::block == B ? Fields::fromValues(v, r) : void()), ...);
+    }
+    static void toValues(const Reading& r, int32_t* v) {
+        toValues<Block::Clear>(r, v);
+        toValues<Block::Encrypted>(r, v + clearValues);
+    }
+    static void fromValues(const int32_t* v, Reading& r) {
+        fromValues<Block::Clear>(v, r);
+        fromValues<Block::Encrypted>(v + clearValues, r);
+    }
+
+private:
+    template <size_t... I> static void writeFields(const Reading& r, uint8_t* frame, std::index_sequence<I...>) {
+        ((frame[offsetOf<I>()] = FieldAt<I>::marker, FieldAt<I>::store(frame + offsetOf<I>() + 1, r)), ...);
+    }
+
+    // base points at frame offset origin
+    template <Block B, size_t... I>
+    static bool readBlock(const uint8_t* base, size_t origin, Reading& r, std::index_sequence<I...>) {
+        if (!((FieldAt<I>::block != B || base[offsetOf<I>() - origin] == FieldAt<I>::marker) && ...)) return false;
+        ((FieldAt<I>::block == B ? FieldAt<I>::load(base + offsetOf<I>() - origin + 1, r) : void()), ...);
+        return true;
+    }
+};
+
+}  // namespace schema
+
+#endif
@@ -1,92 +1,101 @@
-// gps_monitor.h - Gestione RAW NMEA e fix GPS con blocco dopo fix
+// gps_manager.h - GPS UART ingestion and the latest fix/time snapshot
+//
+// The UART receive callback copies whatever the driver has into a fixed-size
+// ring (on the ESP32 it runs in the UART event task, woken by the RX
+// interrupt); update() feeds at most GPS_PARSE_BUDGET bytes per call to the
+// incremental NMEA parser. The loop never waits on the UART, memory does not
+// grow with the stream, and parsing goes on after the first fix so position
+// and time stay current. Bytes that do not fit the ring are dropped and the
+// sentence they belonged to fails its checksum.
 #ifndef GPS_MONITOR_H
 #define GPS_MONITOR_H
 
-#include <TinyGPS++.h>
-#include <HardwareSerial.h>
-#include <TimeLib.h>
+#include "hal/hal.h"
+#include "hal/hal_sensors.h"
+#include "log_manager.h"
+#include "nmea_parser.h"
+#include "spsc_ring.h"
 
+// About one second of NMEA at 9600 baud
+#define GPS_RING_SIZE 1024
+#define GPS_UART_RX_BUFFER 256
+#define GPS_PARSE_BUDGET 256
+// getGPSEpoch() extrapolates a time this old at most
+#define GPS_TIME_STALE_MS 10000
 
 class GPSMonitor {
 public:
-    GPSMonitor(HardwareSerial& serial) : gpsSerial(serial) {}
+    explicit GPSMonitor(HardwareSerial& serial) : gpsSerial(serial) {}
 
     void begin(int baudRate, int rxPin, int txPin) {
+        gpsSerial.setRxBufferSize(GPS_UART_RX_BUFFER);
         gpsSerial.begin(baudRate, SERIAL_8N1, rxPin, txPin);
-        Serial.println("✅ GPS Serial initialized");
+        gpsSerial.onReceive([this]() { receive(); });
+        LOG_INFO("✅ GPS Serial initialized");
     }
 
-    void update() {
-        if (fixAcquired) return;  // ❌ Se abbiamo fixato, non serve più leggere
-        while (gpsSerial.available()) {
-            char c = gpsSerial.read();
-            gps.encode(c);
-            rawNMEA += c;
+    // Producer side: called from the UART receive callback only
+    void receive() {
+        uint8_t chunk[64];
+        int avail;
+        while ((avail = gpsSerial.available()) > 0) {
+            size_t n = gpsSerial.read(chunk, (size_t)avail < sizeof(chunk) ? (size_t)avail : sizeof(chunk));
+            if (n == 0) break;
+            rx.push((const char*)chunk, n);
         }
     }
 
-    // Stampa i RAW ogni 'interval' solo se non abbiamo ancora il fix
-    void printNMEAEvery(unsigned long interval) {
-        if (fixAcquired) return;  // ❌ Stop RAW dopo il fix
-        if (millis() - lastNMEAPrint > interval) {
-            if (!rawNMEA.isEmpty()) {
-                Serial.println("\n🔎 NMEA RAW:");
-                Serial.print(rawNMEA);
-                rawNMEA = "";
-            } else {
-                Serial.println("❌ Nessun dato NMEA negli ultimi secondi");
-            }
-            lastNMEAPrint = millis();
+    // Consumer side: parses what arrived since the last call, within the
+    // budget; returns the number of bytes parsed
+    size_t update() {
+        char chunk[64];
+        size_t budget = GPS_PARSE_BUDGET, n;
+        while (budget > 0 && (n = rx.pop(chunk, budget < sizeof(chunk) ? budget : sizeof(chunk))) > 0) {
+            for (size_t i = 0; i < n; i++) parser.encode(chunk[i]);
+            budget -= n;
         }
+        return GPS_PARSE_BUDGET - budget;
     }
 
-    // Controlla se ha fixato la posizione GPS
+    // Logs fix acquired / lost transitions
     void monitorGPS() {
-        if (fixAcquired) return;  // ❌ Stop dopo il fix
-
-        if (gps.location.isValid()) {
-            Serial.println("✅ FIX GPS ACQUISITO");
-            Serial.print("📍 Latitudine: "); Serial.println(gps.location.lat(), 6);
-            Serial.print("📍 Longitudine: "); Serial.println(gps.location.lng(), 6);
-            fixAcquired = true;
+        bool valid = parser.fix().locationValid;
+        if (valid == hadFix) return;
+        hadFix = valid;
+        if (valid) {
+            LOG_INFO("✅ FIX GPS ACQUISITO (%u sats)", (unsigned)parser.fix().satellites);
+            LOG_TRACE("📍 %.7f, %.7f", parser.fix().lat / (double)GPS_COORD_SCALE,
+                      parser.fix().lon / (double)GPS_COORD_SCALE);
+        } else {
+            LOG_WARN("⚠️ GPS fix lost");
         }
     }
 
-    bool isFixAcquired() const {
-        return fixAcquired;
-    }
+    bool isFixAcquired() const { return parser.fix().locationValid; }
 
-    TinyGPSPlus& getGPS() {
-        return gps;
-    }
+    const GpsFix& getFix() const { return parser.fix(); }
 
-time_t getGPSEpoch() {
-    if (getGPS().time.isValid() && getGPS().date.isValid()) {
-        int year = getGPS().date.year();
-        if (year < 2020) {
-            return 0; // Data non valida
-        }
-
-        tmElements_t tm;
-        tm.Year = year - 1970;
-        tm.Month = getGPS().date.month();
-        tm.Day = getGPS().date.day();
-        tm.Hour = getGPS().time.hour();
-        tm.Minute = getGPS().time.minute();
-        tm.Second = getGPS().time.second();
-
-        return makeTime(tm);
+    // Current UTC time from the last RMC sentence plus the time since it was
+    // parsed; 0 before a valid date or when the GPS has gone quiet
+    time_t getGPSEpoch() const {
+        const GpsFix& fix = parser.fix();
+        if (!fix.timeValid || fix.year < 2020) return 0;
+        uint32_t age = hal::millis() - fix.timeMillis;
+        if (age > GPS_TIME_STALE_MS) return 0;
+        return (time_t)(fix.epoch() + age / 1000);
     }
-    return 0;
-  }
 
+    void logStats() const {
+        LOG_DEBUG("🛰️ GPS: %u sentences, %u bad checksums, %u overlong, %u bytes dropped",
+                  (unsigned)parser.sentences(), (unsigned)parser.checksumErrors(),
+                  (unsigned)parser.overlongSentences(), (unsigned)rx.dropped());
+    }
 
 private:
-    TinyGPSPlus gps;
     HardwareSerial& gpsSerial;
-    String rawNMEA = "";
-    unsigned long lastNMEAPrint = 0;
-    bool fixAcquired = false;
+    SpscRing<char, GPS_RING_SIZE> rx;
+    NmeaParser parser;
+    bool hadFix = false;
 };
 
 #endif
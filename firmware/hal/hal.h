@@ -0,0 +1,32 @@
+// hal.h - Hardware abstraction layer shared by the firmware managers
+//
+// On the board (ARDUINO defined) everything maps 1:1 onto the Arduino core,
+// Preferences and mbedtls (on the AES and SHA engines). On Linux the host backend in
+// hal/host/ provides a file-backed Preferences, a virtual clock, stdout
+// logging and portable crypto so the same headers build into blackbox_core.
+#ifndef HAL_H
+#define HAL_H
+
+#ifdef ARDUINO
+#include "hal_esp32.h"
+#else
+#include "host/hal_host.h"
+#endif
+
+namespace hal {
+
+inline void log(const String& s) { log(s.c_str()); }
+inline void logln(const String& s) { logln(s.c_str()); }
+
+// Dump a byte buffer as "<label>AA BB CC ...\n"
+inline void logHex(const char* label, const uint8_t* data, size_t len) {
+    log(label);
+    for (size_t i = 0; i < len; i++) {
+        logf("%02X ", data[i]);
+    }
+    logln();
+}
+
+}  // namespace hal
+
+#endif
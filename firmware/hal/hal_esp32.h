@@ -0,0 +1,146 @@
+// hal_esp32.h - ESP32 backend of the HAL: thin inline wrappers over the Arduino core
+#ifndef HAL_ESP32_H
+#define HAL_ESP32_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <esp_sleep.h>
+#include <mbedtls/aes.h>
+#include <mbedtls/sha256.h>
+#include <stdarg.h>
+
+namespace hal {
+
+using ::Preferences;
+
+inline uint32_t millis() { return ::millis(); }
+// Wraps every ~71 minutes; use differences
+inline uint32_t micros() { return (uint32_t)::micros(); }
+inline void delay(uint32_t ms) { ::delay(ms); }
+
+// Light sleep: clocks gated, RAM and peripherals state kept. Returns after ms
+// or earlier on any wakeup source the sketch enabled (GPIO, UART)
+inline void lightSleep(uint32_t ms) {
+    Serial.flush();
+    esp_sleep_enable_timer_wakeup((uint64_t)ms * 1000);
+    esp_light_sleep_start();
+}
+
+// Gives the CPU to other tasks for a tick, e.g. while spin-waiting on the other core
+inline void yieldTick() { vTaskDelay(1); }
+
+// CPU cycle counter (wraps every ~18 s at 240 MHz; use differences)
+inline uint32_t cycles() { return ESP.getCycleCount(); }
+inline uint32_t cyclesPerMicro() { return ESP.getCpuFreqMHz(); }
+
+// Each core has its own cycle counter; they are not synchronised
+inline uint8_t coreId() { return (uint8_t)xPortGetCoreID(); }
+
+[[noreturn]] inline void restart() {
+    ESP.restart();
+    while (true) {}
+}
+
+// State a firmware module keeps once per board (lora_manager.h); the host
+// keeps one per simulated device
+template <typename T>
+T& deviceLocal() {
+    static T value;
+    return value;
+}
+
+inline void log(const char* s) { Serial.print(s); }
+inline void logln(const char* s = "") { Serial.println(s); }
+
+inline void logf(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+inline void logf(const char* fmt, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    Serial.print(buf);
+}
+
+// Blocking read of one line from the console (used for first-boot provisioning)
+inline String readLine() {
+    while (!Serial.available());
+    String line = Serial.readStringUntil('\n');
+    line.trim();
+    return line;
+}
+
+// Non-blocking: collects what the console has sent so far and returns true
+// once a whole line is in (e.g. a debug command typed while running)
+inline bool pollLine(String& line) {
+    static String pending;
+    while (Serial.available()) {
+        char c = (char)Serial.read();
+        if (c != '\n') {
+            pending += c;
+            continue;
+        }
+        line = pending;
+        line.trim();
+        pending = "";
+        return true;
+    }
+    return false;
+}
+
+// mbedtls with the ESP32's AES and SHA engines behind it (the Arduino core
+// builds it with CONFIG_MBEDTLS_HARDWARE_AES/SHA). Neither context touches the heap.
+
+// Incremental SHA-256: begin(), any number of update(), finish()
+class Sha256 {
+public:
+    Sha256() { mbedtls_sha256_init(&ctx); }
+    ~Sha256() { mbedtls_sha256_free(&ctx); }
+    Sha256(const Sha256&) = delete;
+    Sha256& operator=(const Sha256&) = delete;
+
+    void begin() { mbedtls_sha256_starts(&ctx, 0); }
+    void update(const uint8_t* data, size_t len) { mbedtls_sha256_update(&ctx, data, len); }
+    void finish(uint8_t* out32) { mbedtls_sha256_finish(&ctx, out32); }
+
+private:
+    mbedtls_sha256_context ctx;
+};
+
+inline void sha256(const uint8_t* data, size_t len, uint8_t* out32) {
+    Sha256 sha;
+    sha.begin();
+    sha.update(data, len);
+    sha.finish(out32);
+}
+
+// AES-128 CTR, in place, with the key set up once by setKey(). The counter
+// block is the full 16-byte IV, incremented big-endian.
+class Aes128Ctr {
+public:
+    Aes128Ctr() { mbedtls_aes_init(&ctx); }
+    ~Aes128Ctr() { mbedtls_aes_free(&ctx); }
+    Aes128Ctr(const Aes128Ctr&) = delete;
+    Aes128Ctr& operator=(const Aes128Ctr&) = delete;
+
+    void setKey(const uint8_t* key) { mbedtls_aes_setkey_enc(&ctx, key, 128); }
+    void crypt(const uint8_t* iv, uint8_t* data, size_t len) {
+        uint8_t counter[16], stream[16];
+        size_t offset = 0;
+        memcpy(counter, iv, 16);
+        mbedtls_aes_crypt_ctr(&ctx, len, &offset, counter, stream, data, data);
+    }
+
+private:
+    mbedtls_aes_context ctx;
+};
+
+inline void aes128Ctr(const uint8_t* key, const uint8_t* iv, uint8_t* data, size_t len) {
+    Aes128Ctr ctr;
+    ctr.setKey(key);
+    ctr.crypt(iv, data, len);
+}
+
+}  // namespace hal
+
+#endif
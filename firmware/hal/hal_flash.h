@@ -0,0 +1,44 @@
+// hal_flash.h - Raw access to a data partition of the SPI flash
+//
+// NOR semantics on both backends: erase sets a 4 KiB sector to 0xFF and a
+// write can only clear bits. On the board this wraps esp_partition_*; on
+// Linux the partition is a file in the host storage dir.
+#ifndef HAL_FLASH_H
+#define HAL_FLASH_H
+
+#ifdef ARDUINO
+#include <esp_partition.h>
+
+namespace hal {
+
+class FlashPartition {
+public:
+    static constexpr size_t SECTOR_SIZE = 4096;
+
+    bool begin(const char* label) {
+        part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+        return part != nullptr;
+    }
+    void end() { part = nullptr; }
+    size_t size() const { return part ? part->size : 0; }
+
+    bool read(size_t offset, void* out, size_t len) {
+        return esp_partition_read(part, offset, out, len) == ESP_OK;
+    }
+    bool write(size_t offset, const void* data, size_t len) {
+        return esp_partition_write(part, offset, data, len) == ESP_OK;
+    }
+    bool eraseSector(size_t offset) {
+        return esp_partition_erase_range(part, offset, SECTOR_SIZE) == ESP_OK;
+    }
+
+private:
+    const esp_partition_t* part = nullptr;
+};
+
+}  // namespace hal
+#else
+#include "host/flash_host.h"
+#endif
+
+#endif
@@ -0,0 +1,15 @@
+// hal_radio.h - SX1262 / LoRaWAN stack
+//
+// The board uses RadioLib and LoRaWAN_ESP32; on Linux the host backend
+// provides a fake SX1262 whose uplinks land in hal::host::radioSink().
+#ifndef HAL_RADIO_H
+#define HAL_RADIO_H
+
+#ifdef ARDUINO
+#include <RadioLib.h>
+#include <LoRaWAN_ESP32.h>
+#else
+#include "host/radio_host.h"
+#endif
+
+#endif
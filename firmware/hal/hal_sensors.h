@@ -0,0 +1,18 @@
+// hal_sensors.h - Sensor drivers (DHT11, MPU6050, GPS UART, I2C)
+//
+// The board uses the real Arduino libraries; on Linux the host backend
+// provides drop-in doubles whose readings are set from tests or traces.
+#ifndef HAL_SENSORS_H
+#define HAL_SENSORS_H
+
+#ifdef ARDUINO
+#include <HardwareSerial.h>
+#include <Wire.h>
+#include <DHT11.h>
+#include <Adafruit_MPU6050.h>
+#include <Adafruit_Sensor.h>
+#else
+#include "host/sensors_host.h"
+#endif
+
+#endif
@@ -0,0 +1,82 @@
+// arduino_string.h - Subset of the Arduino String class for host builds
+#ifndef HAL_HOST_ARDUINO_STRING_H
+#define HAL_HOST_ARDUINO_STRING_H
+
+#include <cstdint>
+#include <string>
+
+#define DEC 10
+#define HEX 16
+
+class String {
+public:
+    String() = default;
+    String(const char* s) : s_(s ? s : "") {}
+    String(const std::string& s) : s_(s) {}
+    String(char c) : s_(1, c) {}
+    String(int v, unsigned char base = DEC) : s_(toBase(v < 0 ? -(long long)v : v, base, v < 0)) {}
+    String(unsigned int v, unsigned char base = DEC) : s_(toBase(v, base, false)) {}
+    String(unsigned char v, unsigned char base = DEC) : s_(toBase(v, base, false)) {}
+    String(unsigned long v, unsigned char base = DEC) : s_(toBase(v, base, false)) {}
+
+    unsigned int length() const { return (unsigned int)s_.size(); }
+    bool isEmpty() const { return s_.empty(); }
+    const char* c_str() const { return s_.c_str(); }
+    char operator[](unsigned int i) const { return i < s_.size() ? s_[i] : 0; }
+    char charAt(unsigned int i) const { return (*this)[i]; }
+
+    String substring(unsigned int from) const { return substring(from, length()); }
+    String substring(unsigned int from, unsigned int to) const {
+        if (from > to) { unsigned int t = from; from = to; to = t; }
+        if (from >= s_.size()) return String();
+        if (to > s_.size()) to = (unsigned int)s_.size();
+        return String(s_.substr(from, to - from));
+    }
+
+    int indexOf(char c) const {
+        size_t p = s_.find(c);
+        return p == std::string::npos ? -1 : (int)p;
+    }
+
+    void trim() {
+        const char* ws = " \t\r\n";
+        size_t b = s_.find_first_not_of(ws);
+        if (b == std::string::npos) { s_.clear(); return; }
+        size_t e = s_.find_last_not_of(ws);
+        s_ = s_.substr(b, e - b + 1);
+    }
+
+    void replace(const String& from, const String& to) {
+        if (from.s_.empty()) return;
+        size_t pos = 0;
+        while ((pos = s_.find(from.s_, pos)) != std::string::npos) {
+            s_.replace(pos, from.s_.size(), to.s_);
+            pos += to.s_.size();
+        }
+    }
+
+    String& operator+=(const String& o) { s_ += o.s_; return *this; }
+    String& operator+=(const char* o) { s_ += o; return *this; }
+    String& operator+=(char c) { s_ += c; return *this; }
+    friend String operator+(const String& a, const String& b) { return String(a.s_ + b.s_); }
+    friend String operator+(const char* a, const String& b) { return String(std::string(a) + b.s_); }
+    friend String operator+(const String& a, const char* b) { return String(a.s_ + b); }
+    bool operator==(const String& o) const { return s_ == o.s_; }
+    bool operator==(const char* o) const { return s_ == o; }
+    bool operator!=(const String& o) const { return s_ != o.s_; }
+
+    const std::string& str() const { return s_; }
+
+private:
+    static std::string toBase(unsigned long long v, unsigned char base, bool negative) {
+        const char* digits = "0123456789abcdef";
+        std::string out;
+        do { out.insert(out.begin(), digits[v % base]); v /= base; } while (v);
+        if (negative) out.insert(out.begin(), '-');
+        return out;
+    }
+
+    std::string s_;
+};
+
+#endif
@@ -0,0 +1,103 @@
+// flash_host.cpp - NOR flash emulation on top of a file (or RAM)
+#include "flash_host.h"
+#include "hal_host.h"
+
+#include <fcntl.h>
+#include <filesystem>
+#include <map>
+#include <unistd.h>
+
+namespace hal {
+
+bool FlashPartition::begin(const char* name) {
+    end();
+    host::Device& dev = host::device();
+    label = name;
+    if (dev.storageDir.empty()) {
+        std::vector<uint8_t>& part = dev.flash[label];
+        if (part.empty()) part.assign(dev.flashPartitionSize, 0xFF);
+        ram = &part;
+        bytes = part.size();
+        return bytes >= SECTOR_SIZE;
+    }
+    std::filesystem::create_directories(dev.storageDir);
+    std::string path = (std::filesystem::path(dev.storageDir) / (label + ".flash")).string();
+    bool fresh = !std::filesystem::exists(path);
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return false;
+    if (fresh) {
+        std::vector<uint8_t> erased(dev.flashPartitionSize, 0xFF);
+        if (::pwrite(fd, erased.data(), erased.size(), 0) != (ssize_t)erased.size()) {
+            end();
+            return false;
+        }
+    }
+    bytes = (size_t)::lseek(fd, 0, SEEK_END);
+    return bytes >= SECTOR_SIZE;
+}
+
+void FlashPartition::end() {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    ram = nullptr;
+    bytes = 0;
+}
+
+bool FlashPartition::load(size_t offset, void* out, size_t len) {
+    if (ram) {
+        memcpy(out, ram->data() + offset, len);
+        return true;
+    }
+    return ::pread(fd, out, len, offset) == (ssize_t)len;
+}
+
+bool FlashPartition::store(size_t offset, const void* data, size_t len) {
+    if (ram) {
+        memcpy(ram->data() + offset, data, len);
+        return true;
+    }
+    return ::pwrite(fd, data, len, offset) == (ssize_t)len;
+}
+
+bool FlashPartition::read(size_t offset, void* out, size_t len) {
+    if (bytes == 0 || offset + len > bytes) return false;
+    return load(offset, out, len);
+}
+
+bool FlashPartition::write(size_t offset, const void* data, size_t len) {
+    if (bytes == 0 || offset + len > bytes) return false;
+    size_t& tearAfter = host::device().flashTearAfter;
+    bool torn = tearAfter < len;
+    size_t keep = torn ? tearAfter : len;
+    tearAfter = SIZE_MAX;
+
+    std::vector<uint8_t> cell(keep);
+    if (!read(offset, cell.data(), keep)) return false;
+    const uint8_t* src = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < keep; i++) cell[i] &= src[i];
+    if (!store(offset, cell.data(), keep)) return false;
+    return !torn;
+}
+
+bool FlashPartition::eraseSector(size_t offset) {
+    if (bytes == 0 || offset % SECTOR_SIZE || offset >= bytes) return false;
+    std::vector<uint8_t> erased(SECTOR_SIZE, 0xFF);
+    if (!store(offset, erased.data(), SECTOR_SIZE)) return false;
+    std::vector<uint32_t>& stats = host::device().flashErases[label];
+    stats.resize(bytes / SECTOR_SIZE, 0);
+    stats[offset / SECTOR_SIZE]++;
+    return true;
+}
+
+namespace host {
+
+void setFlashPartitionSize(size_t bytes) { device().flashPartitionSize = bytes; }
+
+const std::vector<uint32_t>& flashSectorErases(const std::string& label) { return device().flashErases[label]; }
+
+void resetFlashStats() { device().flashErases.clear(); }
+
+void tearNextFlashWrite(size_t keepBytes) { device().flashTearAfter = keepBytes; }
+
+}  // namespace host
+}  // namespace hal
@@ -0,0 +1,61 @@
+// flash_host.h - File-backed flash partition for host builds
+//
+// <storage dir>/<label>.flash is created erased (0xFF) on first use; a
+// RAM-only device (no storage dir) keeps the partition in memory instead.
+// Writes AND into the existing bytes like NOR flash, so a missing erase shows
+// up as corrupt data instead of silently working. Sizes, erase counts and torn
+// writes are those of the device bound to the calling thread (hal_host.h).
+#ifndef HAL_HOST_FLASH_H
+#define HAL_HOST_FLASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace hal {
+
+class FlashPartition {
+public:
+    static constexpr size_t SECTOR_SIZE = 4096;
+
+    FlashPartition() = default;
+    ~FlashPartition() { end(); }
+    FlashPartition(const FlashPartition&) = delete;
+    FlashPartition& operator=(const FlashPartition&) = delete;
+
+    bool begin(const char* label);
+    void end();
+    size_t size() const { return bytes; }
+
+    bool read(size_t offset, void* out, size_t len);
+    bool write(size_t offset, const void* data, size_t len);
+    bool eraseSector(size_t offset);
+
+private:
+    bool load(size_t offset, void* out, size_t len);
+    bool store(size_t offset, const void* data, size_t len);
+
+    std::string label;
+    int fd = -1;
+    std::vector<uint8_t>* ram = nullptr;  // RAM-only device
+    size_t bytes = 0;
+};
+
+namespace host {
+
+// Size of partitions the bound device creates from now on (default 256 KiB,
+// like partitions.csv)
+void setFlashPartitionSize(size_t bytes);
+
+// Erases per sector of a partition since the last reset
+const std::vector<uint32_t>& flashSectorErases(const std::string& label);
+void resetFlashStats();
+
+// Power cut: the next write stores only its first keepBytes and fails
+void tearNextFlashWrite(size_t keepBytes);
+
+}  // namespace host
+}  // namespace hal
+
+#endif
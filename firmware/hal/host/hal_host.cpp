@@ -0,0 +1,173 @@
+// hal_host.cpp - Virtual clock, stdout logging and fake radio for host builds
+#include "hal_host.h"
+#include "radio_host.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <iostream>
+#include <string>
+#include <thread>
+
+namespace hal {
+namespace {
+
+bool logEnabled = true;
+FILE* logStream = nullptr;  // stdout
+thread_local host::Device* bound = nullptr;
+
+host::Device& defaultDevice() {
+    static host::Device d = [] {
+        const char* env = getenv("BLACKBOX_NVS_DIR");
+        return host::Device(env && *env ? env : "nvs");
+    }();
+    return d;
+}
+
+}  // namespace
+
+uint32_t millis() { return (uint32_t)(host::device().micros / 1000); }
+uint32_t micros() { return (uint32_t)host::device().micros; }
+
+void delay(uint32_t ms) { host::device().micros += (uint64_t)ms * 1000; }
+
+void lightSleep(uint32_t ms) {
+    host::Device& d = host::device();
+    d.micros += (uint64_t)ms * 1000;
+    d.sleptMillis += ms;
+}
+
+void yieldTick() { std::this_thread::yield(); }
+
+uint32_t cycles() {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint8_t coreId() {
+    static std::atomic<uint8_t> nextId{0};
+    thread_local uint8_t id = nextId.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+void restart() { throw host::RestartRequested(); }
+
+void log(const char* s) {
+    if (logEnabled) fputs(s, logStream ? logStream : stdout);
+}
+
+void logln(const char* s) {
+    if (!logEnabled) return;
+    FILE* out = logStream ? logStream : stdout;
+    fputs(s, out);
+    fputc('\n', out);
+}
+
+void logf(const char* fmt, ...) {
+    if (!logEnabled) return;
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(logStream ? logStream : stdout, fmt, args);
+    va_end(args);
+}
+
+String readLine() {
+    std::string line;
+    std::getline(std::cin, line);
+    String s(line);
+    s.trim();
+    return s;
+}
+
+namespace host {
+
+Device& device() { return bound ? *bound : defaultDevice(); }
+
+Device::~Device() {
+    DeviceScope scope(*this);
+    std::map<std::type_index, std::shared_ptr<void>> dying;
+    dying.swap(locals);
+    dying.clear();
+}
+
+DeviceScope::DeviceScope(Device& d) : previous(bound) { bound = &d; }
+DeviceScope::~DeviceScope() { bound = previous; }
+
+void setMillis(uint32_t ms) {
+    device().micros = (uint64_t)ms * 1000;
+    device().sleptMillis = 0;
+}
+void advanceMillis(uint32_t ms) { device().micros += (uint64_t)ms * 1000; }
+void advanceMicros(uint32_t us) { device().micros += us; }
+uint64_t lightSleptMillis() { return device().sleptMillis; }
+void setLogEnabled(bool enabled) { logEnabled = enabled; }
+void setLogStream(FILE* stream) { logStream = stream; }
+
+RadioSink& radioSink() { return deviceLocal<RadioSink>(); }
+
+uint32_t timeOnAirMillis(uint8_t datarate, size_t len) {
+    const int sf = 12 - (datarate > 5 ? 5 : datarate);
+    const int lowRate = sf >= 11 ? 1 : 0;
+    const double symbolMs = (double)(1 << sf) / 125.0;
+    const int payloadBits = 8 * (int)(len + 13) - 4 * sf + 28 + 16;
+    int symbols = 8;
+    if (payloadBits > 0) symbols += (int)std::ceil((double)payloadBits / (4 * (sf - 2 * lowRate))) * 5;
+    return (uint32_t)std::ceil((8 + 4.25 + symbols) * symbolMs);
+}
+
+}  // namespace host
+}  // namespace hal
+
+// ----- Fake SX1262 / LoRaWAN node -----
+
+LoRaWANPersist persist;
+
+LoRaWANNode* LoRaWANPersist::manage(SX1262* radio) {
+    (void)radio;
+    return &hal::host::radioSink().node;
+}
+
+bool LoRaWANPersist::loadSession(LoRaWANNode* n) {
+    (void)n;
+    ++hal::host::radioSink().sessionLoads;
+    return true;
+}
+
+void LoRaWANPersist::saveSession(LoRaWANNode* n) {
+    (void)n;
+    ++hal::host::radioSink().sessionSaves;
+}
+
+int16_t SX1262::begin() {
+    return hal::host::radioSink().radioPresent ? RADIOLIB_ERR_NONE : RADIOLIB_ERR_TX_TIMEOUT;
+}
+
+bool LoRaWANNode::isActivated() const { return hal::host::radioSink().activated; }
+
+uint32_t LoRaWANNode::timeUntilUplink() const {
+    if (!dutyCycle || lastToA == 0) return 0;
+    uint32_t interval = (uint32_t)((uint64_t)lastToA * 3600000 / dutyCycleMsPerHour);
+    uint32_t elapsed = hal::millis() - lastUplinkMillis;
+    return elapsed >= interval ? 0 : interval - elapsed;
+}
+
+int16_t LoRaWANNode::sendReceive(const uint8_t* dataUp, size_t lenUp, uint8_t fPort, bool isConfirmed) {
+    hal::host::RadioSink& sink = hal::host::radioSink();
+    if (!sink.activated) return RADIOLIB_ERR_NETWORK_NOT_JOINED;
+    if (sink.failNext > 0) {
+        sink.failNext--;
+        return RADIOLIB_ERR_TX_TIMEOUT;
+    }
+    if (lenUp > getMaxPayloadLen()) return RADIOLIB_ERR_PACKET_TOO_LONG;
+    if (timeUntilUplink() > 0) return RADIOLIB_ERR_UPLINK_UNAVAILABLE;
+    lastToA = hal::host::timeOnAirMillis(datarate, lenUp);
+    lastUplinkMillis = hal::millis();
+    sink.uplinks.push_back({hal::millis(), fPort, datarate, isConfirmed,
+                            std::vector<uint8_t>(dataUp, dataUp + lenUp)});
+    if (!isConfirmed) return RADIOLIB_ERR_NONE;
+    if (sink.dropAcks > 0) {
+        sink.dropAcks--;
+        return RADIOLIB_ERR_NONE;
+    }
+    return 1;
+}
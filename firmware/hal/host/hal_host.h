@@ -0,0 +1,174 @@
+// hal_host.h - Linux backend of the HAL
+#ifndef HAL_HOST_H
+#define HAL_HOST_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <typeindex>
+#include <vector>
+#include "arduino_string.h"
+#include "preferences_host.h"
+
+namespace hal {
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+// Host: moves the virtual clock like delay() and counts the sleep
+void lightSleep(uint32_t ms);
+// Host: yields the thread; the virtual clock does not move
+void yieldTick();
+
+// Host stand-in for the CPU cycle counter: steady-clock nanoseconds, wrapping
+uint32_t cycles();
+inline uint32_t cyclesPerMicro() { return 1000; }
+
+// Host: a small id per thread, in the order threads first ask
+uint8_t coreId();
+
+// Throws host::RestartRequested so a simulator can re-run setup()
+[[noreturn]] void restart();
+
+void log(const char* s);
+void logln(const char* s = "");
+void logf(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+
+// Reads one line from stdin (first-boot provisioning prompts)
+String readLine();
+// Host: there is no interactive console, never a line
+inline bool pollLine(String& line) {
+    (void)line;
+    return false;
+}
+
+// Incremental SHA-256: begin(), any number of update(), finish()
+class Sha256 {
+public:
+    void begin();
+    void update(const uint8_t* data, size_t len);
+    void finish(uint8_t* out32);
+
+private:
+    uint32_t h[8];
+    uint8_t block[64];
+    size_t used;     // bytes waiting in block
+    uint64_t total;  // bytes hashed so far
+};
+
+void sha256(const uint8_t* data, size_t len, uint8_t* out32);
+
+// AES-128 CTR, in place, with the key schedule expanded once by setKey().
+// The counter block is the full 16-byte IV, incremented big-endian.
+class Aes128Ctr {
+public:
+    Aes128Ctr() = default;
+    // Not copyable, like the board's mbedtls context
+    Aes128Ctr(const Aes128Ctr&) = delete;
+    Aes128Ctr& operator=(const Aes128Ctr&) = delete;
+
+    void setKey(const uint8_t* key);
+    void crypt(const uint8_t* iv, uint8_t* data, size_t len) const;
+
+private:
+    uint8_t rk[176];
+};
+
+void aes128Ctr(const uint8_t* key, const uint8_t* iv, uint8_t* data, size_t len);
+
+namespace host {
+
+struct RestartRequested : std::runtime_error {
+    RestartRequested() : std::runtime_error("ESP.restart()") {}
+};
+
+// What one simulated device sees through the HAL: its virtual clock, its
+// NVS, its flash and its radio. A thread works on the process-wide default
+// device until a DeviceScope binds another one, so a fleet simulator can step
+// many devices from a few worker threads without them sharing a clock, a
+// Preferences store, a flash queue or a LoRaWAN session.
+struct Device {
+    using Namespace = std::map<std::string, std::vector<uint8_t>>;
+
+    // NVS files go to <storageDir>/<namespace>.nvs and flash partitions to
+    // <storageDir>/<label>.flash; "" keeps both in RAM only
+    explicit Device(std::string storageDir = "") : storageDir(std::move(storageDir)) {}
+    // Destroys the device-local state with the device bound
+    ~Device();
+
+    uint64_t micros = 0;
+    uint64_t sleptMillis = 0;
+    std::string storageDir;
+    std::map<std::string, Namespace> nvs;  // namespaces loaded so far
+    uint32_t nvsWrites = 0;
+
+    // Flash partitions of a RAM-only device by label, and per-sector erase
+    // counts and the pending torn write of any device (flash_host.h)
+    std::map<std::string, std::vector<uint8_t>> flash;
+    std::map<std::string, std::vector<uint32_t>> flashErases;
+    size_t flashPartitionSize = 256 * 1024;
+    size_t flashTearAfter = SIZE_MAX;
+
+    // What deviceLocal<T>() made for this device, by type
+    std::map<std::type_index, std::shared_ptr<void>> locals;
+};
+
+// The device bound to the calling thread
+Device& device();
+
+class DeviceScope {
+public:
+    explicit DeviceScope(Device& d);
+    ~DeviceScope();
+    DeviceScope(const DeviceScope&) = delete;
+    DeviceScope& operator=(const DeviceScope&) = delete;
+
+private:
+    Device* previous;
+};
+
+// Power cut for the RAM state of the bound device: the next deviceLocal<T>()
+// starts from a fresh T
+template <typename T>
+void dropDeviceLocal() {
+    auto it = device().locals.find(std::type_index(typeid(T)));
+    if (it == device().locals.end()) return;
+    std::shared_ptr<void> dead = std::move(it->second);  // destroyed after the erase
+    device().locals.erase(it);
+}
+
+// Virtual clock behind millis()/micros()/delay(); it only moves when told to
+void setMillis(uint32_t ms);
+void advanceMillis(uint32_t ms);
+void advanceMicros(uint32_t us);
+// Total virtual time spent in lightSleep()
+uint64_t lightSleptMillis();
+
+// Route log output to stdout (default) or drop it (benchmarks)
+void setLogEnabled(bool enabled);
+// Where enabled log output goes (default stdout), e.g. stderr when stdout carries data
+void setLogStream(FILE* stream);
+
+}  // namespace host
+
+// State a firmware module keeps once per board (lora_manager.h). Host: one T
+// per device, made on first use, so a fleet simulator runs the same code for
+// every vehicle
+template <typename T>
+T& deviceLocal() {
+    std::shared_ptr<void>& slot = host::device().locals[std::type_index(typeid(T))];
+    if (!slot) slot = std::make_shared<T>();
+    return *static_cast<T*>(slot.get());
+}
+
+}  // namespace hal
+
+#endif
@@ -0,0 +1,127 @@
+// mpu6050_host.h - Register-level MPU6050 that replays a recorded IMU trace
+//
+// Attach it to the host Wire (Wire.hostAttach(0x68, &sim)). Once the FIFO is
+// enabled it produces records at the configured sample rate on the virtual
+// clock, taking them from the trace in a loop, and behaves like the chip when
+// nobody drains it: the oldest bytes are lost and INT_STATUS reports the
+// overflow until read.
+//
+// Traces are CSV with one sample per line, raw LSB at +-8 g / +-500 deg/s:
+//   ax,ay,az,gx,gy,gz
+#ifndef HAL_HOST_MPU6050_H
+#define HAL_HOST_MPU6050_H
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "hal_host.h"
+
+namespace hal {
+namespace host {
+
+using ImuTraceSample = std::array<int16_t, 6>;
+
+// Lines that do not hold six integers (e.g. a header) are skipped
+inline std::vector<ImuTraceSample> loadImuTrace(const std::string& path) {
+    std::vector<ImuTraceSample> trace;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream ss(line);
+        ImuTraceSample s;
+        char comma;
+        bool ok = true;
+        for (int k = 0; k < 6 && ok; k++) {
+            int v;
+            ok = (bool)(ss >> v) && (k == 5 || (ss >> comma && comma == ','));
+            s[k] = (int16_t)v;
+        }
+        if (ok) trace.push_back(s);
+    }
+    return trace;
+}
+
+class Mpu6050Sim : public I2cDevice {
+public:
+    explicit Mpu6050Sim(std::vector<ImuTraceSample> trace = {}) : trace(std::move(trace)) {
+        regs[0x75] = 0x68;  // WHO_AM_I
+        regs[0x6B] = 0x40;  // asleep after power-up
+    }
+
+    void writeRegister(uint8_t reg, uint8_t value) override {
+        sync();
+        if (reg == 0x6A && (value & 0x04)) {  // FIFO_RESET
+            fifo.clear();
+            value &= (uint8_t)~0x04;
+        }
+        if (reg == 0x6A && (value & 0x40) && !(regs[0x6A] & 0x40)) startMillis = hal::millis(), produced = 0;
+        regs[reg & 0x7F] = value;
+    }
+
+    uint8_t readRegister(uint8_t reg) override {
+        sync();
+        switch (reg) {
+            case 0x3A: {  // INT_STATUS, cleared by reading
+                uint8_t v = regs[0x3A];
+                regs[0x3A] = 0;
+                return v;
+            }
+            case 0x72: return (uint8_t)(fifo.size() >> 8);
+            case 0x73: return (uint8_t)(fifo.size() & 0xFF);
+            case 0x74: {
+                if (fifo.empty()) return 0xFF;
+                uint8_t v = fifo.front();
+                fifo.pop_front();
+                return v;
+            }
+            default: return regs[reg & 0x7F];
+        }
+    }
+
+    uint8_t nextRegister(uint8_t reg) override { return reg == 0x74 ? reg : (uint8_t)(reg + 1); }
+
+    uint32_t rateHz() const { return 1000u / (regs[0x19] + 1u); }
+    size_t fifoBytes() const { return fifo.size(); }
+    uint64_t samplesProduced() const { return produced; }
+    uint64_t bytesLost = 0;
+
+private:
+    bool fifoRunning() const { return (regs[0x6A] & 0x40) && regs[0x23] == 0x78 && !(regs[0x6B] & 0x40); }
+
+    // Emits the records due by now
+    void sync() {
+        if (!fifoRunning() || trace.empty()) return;
+        uint64_t due = (uint64_t)(hal::millis() - startMillis) * rateHz() / 1000;
+        for (; produced < due; produced++) {
+            const ImuTraceSample& s = trace[produced % trace.size()];
+            for (int16_t v : s) {
+                push((uint8_t)((uint16_t)v >> 8));
+                push((uint8_t)v);
+            }
+        }
+    }
+
+    void push(uint8_t b) {
+        if (fifo.size() == 1024) {
+            fifo.pop_front();
+            bytesLost++;
+            regs[0x3A] |= 0x10;  // FIFO_OFLOW
+        }
+        fifo.push_back(b);
+    }
+
+    std::vector<ImuTraceSample> trace;
+    uint8_t regs[128] = {0};
+    std::deque<uint8_t> fifo;
+    uint32_t startMillis = 0;
+    uint64_t produced = 0;
+};
+
+}  // namespace host
+}  // namespace hal
+
+#endif
@@ -0,0 +1,186 @@
+// preferences_host.cpp - File-backed NVS emulation
+#include "preferences_host.h"
+#include "hal_host.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <vector>
+
+namespace hal {
+namespace {
+
+using Bytes = std::vector<uint8_t>;
+using Namespace = host::Device::Namespace;
+
+std::map<std::string, Namespace>& namespaces() { return host::device().nvs; }
+
+std::string pathFor(const std::string& name) {
+    return (std::filesystem::path(host::storageDir()) / (name + ".nvs")).string();
+}
+
+// On-disk record: u16 key length, key, u32 value length, value
+Namespace& load(const std::string& name) {
+    auto& all = namespaces();
+    auto it = all.find(name);
+    if (it != all.end()) return it->second;
+
+    Namespace& ns = all[name];
+    if (host::storageDir().empty()) return ns;
+    std::ifstream in(pathFor(name), std::ios::binary);
+    while (in) {
+        uint16_t klen = 0;
+        uint32_t vlen = 0;
+        if (!in.read(reinterpret_cast<char*>(&klen), sizeof(klen))) break;
+        std::string key(klen, '\0');
+        in.read(&key[0], klen);
+        in.read(reinterpret_cast<char*>(&vlen), sizeof(vlen));
+        Bytes value(vlen);
+        if (!in.read(reinterpret_cast<char*>(value.data()), vlen)) break;
+        ns[key] = std::move(value);
+    }
+    return ns;
+}
+
+// Write-then-rename so a crash mid-commit keeps the previous image
+void commit(const std::string& name) {
+    host::device().nvsWrites++;
+    if (host::storageDir().empty()) return;
+    std::filesystem::create_directories(host::storageDir());
+    std::string path = pathFor(name);
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        for (const auto& kv : namespaces()[name]) {
+            uint16_t klen = (uint16_t)kv.first.size();
+            uint32_t vlen = (uint32_t)kv.second.size();
+            out.write(reinterpret_cast<const char*>(&klen), sizeof(klen));
+            out.write(kv.first.data(), klen);
+            out.write(reinterpret_cast<const char*>(&vlen), sizeof(vlen));
+            out.write(reinterpret_cast<const char*>(kv.second.data()), vlen);
+        }
+    }
+    std::filesystem::rename(tmp, path);
+}
+
+}  // namespace
+
+bool Preferences::begin(const char* name, bool readOnly) {
+    if (open_) end();
+    name_ = name;
+    readOnly_ = readOnly;
+    open_ = true;
+    load(name_);
+    return true;
+}
+
+void Preferences::end() { open_ = false; }
+
+bool Preferences::clear() {
+    if (!open_ || readOnly_) return false;
+    load(name_).clear();
+    commit(name_);
+    return true;
+}
+
+bool Preferences::remove(const char* key) {
+    if (!open_ || readOnly_) return false;
+    if (load(name_).erase(key) == 0) return false;
+    commit(name_);
+    return true;
+}
+
+bool Preferences::isKey(const char* key) {
+    return open_ && load(name_).count(key) != 0;
+}
+
+size_t Preferences::put(const char* key, const void* value, size_t len) {
+    if (!open_ || readOnly_) return 0;
+    const uint8_t* p = static_cast<const uint8_t*>(value);
+    load(name_)[key] = Bytes(p, p + len);
+    commit(name_);
+    return len;
+}
+
+bool Preferences::get(const char* key, void* buf, size_t len) {
+    if (!open_) return false;
+    Namespace& ns = load(name_);
+    auto it = ns.find(key);
+    if (it == ns.end() || it->second.size() != len) return false;
+    memcpy(buf, it->second.data(), len);
+    return true;
+}
+
+size_t Preferences::putUShort(const char* key, uint16_t value) { return put(key, &value, sizeof(value)); }
+size_t Preferences::putUInt(const char* key, uint32_t value) { return put(key, &value, sizeof(value)); }
+size_t Preferences::putULong64(const char* key, uint64_t value) { return put(key, &value, sizeof(value)); }
+size_t Preferences::putBytes(const char* key, const void* value, size_t len) { return put(key, value, len); }
+
+size_t Preferences::putString(const char* key, const String& value) {
+    return put(key, value.c_str(), value.length()) ? value.length() : 0;
+}
+
+uint16_t Preferences::getUShort(const char* key, uint16_t defaultValue) {
+    uint16_t v;
+    return get(key, &v, sizeof(v)) ? v : defaultValue;
+}
+
+uint32_t Preferences::getUInt(const char* key, uint32_t defaultValue) {
+    uint32_t v;
+    return get(key, &v, sizeof(v)) ? v : defaultValue;
+}
+
+uint64_t Preferences::getULong64(const char* key, uint64_t defaultValue) {
+    uint64_t v;
+    return get(key, &v, sizeof(v)) ? v : defaultValue;
+}
+
+String Preferences::getString(const char* key, const String& defaultValue) {
+    if (!open_) return defaultValue;
+    Namespace& ns = load(name_);
+    auto it = ns.find(key);
+    if (it == ns.end()) return defaultValue;
+    return String(std::string(it->second.begin(), it->second.end()));
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+    if (!open_) return 0;
+    Namespace& ns = load(name_);
+    auto it = ns.find(key);
+    return it == ns.end() ? 0 : it->second.size();
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t maxLen) {
+    if (!open_) return 0;
+    Namespace& ns = load(name_);
+    auto it = ns.find(key);
+    if (it == ns.end() || it->second.size() > maxLen) return 0;
+    memcpy(buf, it->second.data(), it->second.size());
+    return it->second.size();
+}
+
+namespace host {
+
+void setStorageDir(const std::string& dir) {
+    device().storageDir = dir;
+    namespaces().clear();
+}
+
+const std::string& storageDir() { return device().storageDir; }
+
+void wipeStorage() {
+    namespaces().clear();
+    device().flash.clear();
+    if (storageDir().empty()) return;
+    std::error_code ec;
+    std::filesystem::remove_all(storageDir(), ec);
+}
+
+uint32_t nvsWriteCount() { return device().nvsWrites; }
+void resetNvsWriteCount() { device().nvsWrites = 0; }
+
+}  // namespace host
+}  // namespace hal
@@ -0,0 +1,71 @@
+// preferences_host.h - File-backed stand-in for the ESP32 Preferences (NVS) API
+//
+// Every namespace is kept in memory and written through to
+// <storage dir>/<namespace>.nvs on each put, like an NVS commit. Handles on
+// the same namespace share state, exactly as on the device. The store is the
+// one of the device bound to the calling thread (hal::host::DeviceScope).
+#ifndef HAL_HOST_PREFERENCES_H
+#define HAL_HOST_PREFERENCES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "arduino_string.h"
+
+namespace hal {
+
+class Preferences {
+public:
+    Preferences() = default;
+    ~Preferences() { end(); }
+    Preferences(const Preferences&) = delete;
+    Preferences& operator=(const Preferences&) = delete;
+
+    bool begin(const char* name, bool readOnly = false);
+    void end();
+
+    bool clear();
+    bool remove(const char* key);
+    bool isKey(const char* key);
+
+    size_t putUShort(const char* key, uint16_t value);
+    size_t putUInt(const char* key, uint32_t value);
+    size_t putULong64(const char* key, uint64_t value);
+    size_t putString(const char* key, const String& value);
+    size_t putBytes(const char* key, const void* value, size_t len);
+
+    uint16_t getUShort(const char* key, uint16_t defaultValue = 0);
+    uint32_t getUInt(const char* key, uint32_t defaultValue = 0);
+    uint64_t getULong64(const char* key, uint64_t defaultValue = 0);
+    String getString(const char* key, const String& defaultValue = String());
+    size_t getBytesLength(const char* key);
+    size_t getBytes(const char* key, void* buf, size_t maxLen);
+
+private:
+    size_t put(const char* key, const void* value, size_t len);
+    bool get(const char* key, void* buf, size_t len);
+
+    std::string name_;
+    bool open_ = false;
+    bool readOnly_ = false;
+};
+
+namespace host {
+
+// Directory holding the <namespace>.nvs files of the bound device (default
+// device: $BLACKBOX_NVS_DIR or ./nvs; "" keeps NVS in RAM)
+void setStorageDir(const std::string& dir);
+const std::string& storageDir();
+
+// Drop every namespace and flash partition, in memory and on disk (end any
+// open FlashPartition first)
+void wipeStorage();
+
+// Number of put/clear/remove operations that reached "flash" since the last reset
+uint32_t nvsWriteCount();
+void resetNvsWriteCount();
+
+}  // namespace host
+}  // namespace hal
+
+#endif
@@ -0,0 +1,106 @@
+// radio_host.h - Fake SX1262 / LoRaWAN node for host builds
+//
+// Mirrors the RadioLib + LoRaWAN_ESP32 calls made by lora_manager.h. Every
+// successful sendReceive() is appended to hal::host::radioSink(), the radio
+// of the device bound to the calling thread (hal_host.h), which also keeps
+// the node that persist manages: the session survives the device's RAM.
+#ifndef HAL_HOST_RADIO_H
+#define HAL_HOST_RADIO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define RADIOLIB_ERR_NONE 0
+#define RADIOLIB_ERR_PACKET_TOO_LONG (-4)
+#define RADIOLIB_ERR_TX_TIMEOUT (-5)
+#define RADIOLIB_ERR_NETWORK_NOT_JOINED (-1101)
+#define RADIOLIB_ERR_UPLINK_UNAVAILABLE (-1106)
+
+class Module {
+public:
+    Module(int cs, int irq, int rst, int gpio) { (void)cs; (void)irq; (void)rst; (void)gpio; }
+};
+
+class SX1262 {
+public:
+    SX1262(Module* mod) : mod(mod) {}
+    int16_t begin();
+
+private:
+    Module* mod;
+};
+
+class LoRaWANNode {
+public:
+    void setDatarate(uint8_t dr) { datarate = dr; }
+    void setADR(bool enable) { adr = enable; }
+    bool isActivated() const;
+    // 0: sent, no downlink; 1: sent and acknowledged in RX1 (confirmed uplinks)
+    int16_t sendReceive(const uint8_t* dataUp, size_t lenUp, uint8_t fPort = 1, bool isConfirmed = false);
+    // EU868 application payload limit of the current data rate
+    uint8_t getMaxPayloadLen() const { return datarate <= 2 ? 51 : datarate == 3 ? 115 : 242; }
+
+    // Duty-cycle limit as RadioLib enforces it: after an uplink with time on
+    // air t the next one may start t * 3600000 / msPerHour later (0 = the
+    // EU868 1 %, 36000 ms per hour). Off by default on the host.
+    void setDutyCycle(bool enable = true, uint32_t msPerHour = 0) {
+        dutyCycle = enable;
+        dutyCycleMsPerHour = msPerHour ? msPerHour : 36000;
+    }
+    // Milliseconds until the duty cycle allows the next uplink
+    uint32_t timeUntilUplink() const;
+    uint32_t getLastToA() const { return lastToA; }
+
+    uint8_t datarate = 0;
+    bool adr = true;
+    bool dutyCycle = false;
+    uint32_t dutyCycleMsPerHour = 36000;
+    uint32_t lastToA = 0;
+    uint32_t lastUplinkMillis = 0;
+};
+
+// Stateless: the node and the session counters belong to the bound device
+class LoRaWANPersist {
+public:
+    LoRaWANNode* manage(SX1262* radio);
+    bool loadSession(LoRaWANNode* n);
+    void saveSession(LoRaWANNode* n);
+};
+
+extern LoRaWANPersist persist;
+
+namespace hal {
+namespace host {
+
+struct Uplink {
+    uint32_t atMillis;
+    uint8_t port;
+    uint8_t datarate;
+    bool confirmed;
+    std::vector<uint8_t> data;
+};
+
+struct RadioSink {
+    std::vector<Uplink> uplinks;
+    bool radioPresent = true;
+    bool activated = true;
+    int failNext = 0;  // next N sendReceive() calls fail with RADIOLIB_ERR_TX_TIMEOUT
+    int dropAcks = 0;  // next N confirmed uplinks get through but their ACK is lost
+    LoRaWANNode node;  // what persist.manage() hands out
+    uint32_t sessionLoads = 0, sessionSaves = 0;
+
+    void reset() { *this = RadioSink(); }
+};
+
+// The radio of the bound device
+RadioSink& radioSink();
+
+// EU868 LoRa time on air in ms of an uplink carrying len application bytes
+// (13 bytes of LoRaWAN overhead, 125 kHz, CR 4/5, 8-symbol preamble)
+uint32_t timeOnAirMillis(uint8_t datarate, size_t len);
+
+}  // namespace host
+}  // namespace hal
+
+#endif
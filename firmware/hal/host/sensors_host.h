@@ -0,0 +1,220 @@
+// sensors_host.h - Host doubles for the sensor libraries used by the firmware
+//
+// Same class names and call signatures as the Arduino libraries, so the
+// managers compile unchanged. Readings are injected through the host*
+// setters by tests, benchmarks and the simulator.
+#ifndef HAL_HOST_SENSORS_H
+#define HAL_HOST_SENSORS_H
+
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <string>
+#include "hal_host.h"
+
+#define SERIAL_8N1 0x800001c
+
+// ----- HardwareSerial -----
+// hostInject() plays the UART driver: the bytes land in the RX buffer and the
+// onReceive() callback runs, synchronously, like the event task would
+class HardwareSerial {
+public:
+    explicit HardwareSerial(int uartNum = 0) : uart(uartNum) {}
+    void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int rxPin = -1, int txPin = -1) {
+        (void)config; (void)rxPin; (void)txPin;
+        baudRate = baud;
+    }
+    size_t setRxBufferSize(size_t size) {
+        rxBufferSize = size;
+        return size;
+    }
+    void onReceive(std::function<void()> cb) { receiveCb = std::move(cb); }
+    int available() const { return (int)rx.size(); }
+    int read() {
+        if (rx.empty()) return -1;
+        char c = rx.front();
+        rx.pop_front();
+        return (unsigned char)c;
+    }
+    size_t read(uint8_t* buffer, size_t size) {
+        size_t n = 0;
+        for (; n < size && !rx.empty(); n++) {
+            buffer[n] = (uint8_t)rx.front();
+            rx.pop_front();
+        }
+        return n;
+    }
+    // Bytes beyond the RX buffer size are lost, as in the driver
+    void hostInject(const std::string& bytes) {
+        for (char c : bytes) {
+            if (rx.size() >= rxBufferSize) {
+                hostOverruns++;
+                continue;
+            }
+            rx.push_back(c);
+        }
+        if (receiveCb) receiveCb();
+    }
+
+    int uart;
+    unsigned long baudRate = 0;
+    size_t rxBufferSize = 256;
+    size_t hostOverruns = 0;
+
+private:
+    std::deque<char> rx;
+    std::function<void()> receiveCb;
+};
+
+// ----- TwoWire (I2C) -----
+// Register-level bus: the first byte of a write sets the register pointer,
+// the rest are written from there; requestFrom() reads from the pointer.
+// Devices are attached per address (e.g. hal::host::Mpu6050Sim).
+namespace hal {
+namespace host {
+
+struct I2cDevice {
+    virtual ~I2cDevice() = default;
+    virtual void writeRegister(uint8_t reg, uint8_t value) = 0;
+    virtual uint8_t readRegister(uint8_t reg) = 0;
+    // Register a burst continues with (a FIFO port stays put)
+    virtual uint8_t nextRegister(uint8_t reg) { return (uint8_t)(reg + 1); }
+};
+
+}  // namespace host
+}  // namespace hal
+
+class TwoWire {
+public:
+    bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0) {
+        (void)sda; (void)scl; (void)frequency;
+        return true;
+    }
+    void setClock(uint32_t frequency) { clockHz = frequency; }
+
+    void beginTransmission(uint8_t address) {
+        target = address;
+        txLen = 0;
+    }
+    size_t write(uint8_t b) {
+        if (txLen < sizeof(tx)) tx[txLen++] = b;
+        return 1;
+    }
+    // 0 on success, 2 if nobody acknowledged the address (as in Arduino)
+    uint8_t endTransmission(bool sendStop = true) {
+        (void)sendStop;
+        hal::host::I2cDevice* dev = device(target);
+        if (!dev) return 2;
+        if (txLen > 0) pointer[target] = tx[0];
+        uint8_t reg = pointer[target];
+        for (size_t i = 1; i < txLen; i++) {
+            dev->writeRegister(reg, tx[i]);
+            reg = dev->nextRegister(reg);
+        }
+        hostBytes += txLen + 1;
+        return 0;
+    }
+    size_t requestFrom(uint8_t address, size_t quantity) {
+        rxLen = rxPos = 0;
+        hal::host::I2cDevice* dev = device(address);
+        if (!dev || quantity > sizeof(rx)) return 0;
+        uint8_t reg = pointer[address];
+        for (size_t i = 0; i < quantity; i++) {
+            rx[rxLen++] = dev->readRegister(reg);
+            reg = dev->nextRegister(reg);
+        }
+        hostBytes += quantity + 1;
+        hostReads++;
+        hostLargestRead = quantity > hostLargestRead ? quantity : hostLargestRead;
+        return quantity;
+    }
+    int available() const { return (int)(rxLen - rxPos); }
+    int read() { return rxPos < rxLen ? rx[rxPos++] : -1; }
+
+    void hostAttach(uint8_t address, hal::host::I2cDevice* dev) { devices[address & 0x7F] = dev; }
+
+    uint32_t clockHz = 100000;
+    size_t hostBytes = 0;  // bus bytes incl. address, for throughput estimates
+    size_t hostReads = 0;
+    size_t hostLargestRead = 0;
+
+private:
+    hal::host::I2cDevice* device(uint8_t address) const { return devices[address & 0x7F]; }
+
+    hal::host::I2cDevice* devices[128] = {nullptr};
+    uint8_t pointer[128] = {0};
+    uint8_t target = 0;
+    uint8_t tx[128];
+    size_t txLen = 0;
+    uint8_t rx[128];  // the ESP32 Wire buffer size
+    size_t rxLen = 0, rxPos = 0;
+};
+
+inline TwoWire Wire;
+
+// ----- DHT11 -----
+class DHT11 {
+public:
+    explicit DHT11(int pin) : pin(pin) {}
+    // Returns 0 on success like the real driver, which busy-waits on the
+    // one-wire protocol; hostReadMs moves the virtual clock by that much
+    int readTemperatureHumidity(int& temperature, int& humidity) {
+        hostReads++;
+        hal::delay(hostReadMs);
+        if (hostError) return hostError;
+        temperature = hostTemperature;
+        humidity = hostHumidity;
+        return 0;
+    }
+
+    int pin;
+    int hostTemperature = 22;
+    int hostHumidity = 40;
+    int hostError = 0;
+    uint32_t hostReadMs = 0;
+    uint32_t hostReads = 0;
+};
+
+// ----- Adafruit_Sensor / Adafruit_MPU6050 -----
+typedef struct {
+    float x, y, z;
+} sensors_vec_t;
+
+typedef struct {
+    int32_t version;
+    int32_t sensor_id;
+    int32_t type;
+    int32_t reserved0;
+    int32_t timestamp;
+    union {
+        float data[4];
+        sensors_vec_t acceleration;
+        sensors_vec_t gyro;
+        float temperature;
+    };
+} sensors_event_t;
+
+class Adafruit_MPU6050 {
+public:
+    bool begin() { return hostPresent; }
+    bool getEvent(sensors_event_t* accel, sensors_event_t* gyro, sensors_event_t* temp) {
+        memset(accel, 0, sizeof(*accel));
+        memset(gyro, 0, sizeof(*gyro));
+        memset(temp, 0, sizeof(*temp));
+        accel->acceleration = hostAccel;
+        gyro->gyro = hostGyro;
+        temp->temperature = hostTemperature;
+        return true;
+    }
+
+    bool hostPresent = true;
+    sensors_vec_t hostAccel = {0.0f, 0.0f, 9.81f};
+    sensors_vec_t hostGyro = {0.0f, 0.0f, 0.0f};
+    float hostTemperature = 25.0f;
+};
+
+#include "mpu6050_host.h"
+
+#endif
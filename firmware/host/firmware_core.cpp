@@ -0,0 +1,19 @@
+// firmware_core.cpp - Host translation unit for the header-only firmware managers
+//
+// Pulls every manager into blackbox_core so a broken host build shows up at
+// library build time instead of in the first test that includes it.
+#include "crash_recorder.h"
+#include "daily_key_manager.h"
+#include "encryption_manager.h"
+#include "flash_queue.h"
+#include "gps_manager.h"
+#include "imu_features.h"
+#include "lora_manager.h"
+#include "mpu6050_fifo.h"
+#include "payload_manager.h"
+#include "sample_pipeline.h"
+#include "task_scheduler.h"
+#include "trace_manager.h"
+
+// The sketch's crash window, so template errors show up here too
+template class CrashRecorder<128, 128, 16>;
@@ -0,0 +1,193 @@
+// imu_features.h - Fixed-point motion features over a window of IMU samples
+//
+// The MPU6050 FIFO is drained in bursts (mpu6050_fifo.h) into ImuBlocks: up
+// to IMU_BLOCK_MAX raw samples, one array per axis. ImuWindow::add() runs the
+// kernel over a block and folds the result into the running window; take()
+// converts the window to the on-air units of SensorReading and starts the
+// next one, so every frame describes everything that happened since the
+// previous frame, not one instant:
+//
+//   accel     peak |a|
+//   accelRms  sqrt(mean |a|^2)
+//   jerk      peak |a[i] - a[i-1]| * sample rate
+//   gyro      per axis, the rate with the largest magnitude (sign kept)
+//
+// The kernel works on raw LSBs with 32-bit products and 64-bit sums only,
+// no floats and no data-dependent branches, so the host compiler
+// auto-vectorises it. Per-axis differences are clamped to +-32767 LSB (an
+// 8 g step per sample at +-8 g, far beyond what a frame can carry) so that
+// |d|^2 of three axes fits 32 bits.
+#ifndef IMU_FEATURES_H
+#define IMU_FEATURES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "frame_layout.h"
+
+// Samples per kernel call; 64 * 12 bytes is 768 of the 1024-byte FIFO
+#define IMU_BLOCK_MAX 64
+
+struct ImuBlock {
+    int16_t ax[IMU_BLOCK_MAX], ay[IMU_BLOCK_MAX], az[IMU_BLOCK_MAX];
+    int16_t gx[IMU_BLOCK_MAX], gy[IMU_BLOCK_MAX], gz[IMU_BLOCK_MAX];
+    size_t n = 0;
+};
+
+// Sensor configuration the raw LSBs are relative to
+struct ImuScale {
+    uint32_t rateHz;
+    uint32_t accelLsbPerG;      // 4096 at +-8 g
+    uint32_t gyroLsbPerDps10;   // LSB per deg/s, * 10: 655 at +-500 deg/s
+};
+
+namespace imu {
+
+struct BlockFeatures {
+    uint32_t peakMagSq;
+    uint64_t sumMagSq;
+    uint32_t peakDiffSq;  // between consecutive samples of the block
+    int16_t gyroMin[3];
+    int16_t gyroMax[3];
+};
+
+inline uint32_t magSq(int32_t x, int32_t y, int32_t z) {
+    return (uint32_t)(x * x) + (uint32_t)(y * y) + (uint32_t)(z * z);
+}
+
+inline int32_t clampDiff(int32_t d) { return d > 32767 ? 32767 : (d < -32767 ? -32767 : d); }
+
+inline void minMax(const int16_t* v, size_t n, int16_t& lo, int16_t& hi) {
+    int16_t mn = INT16_MAX, mx = INT16_MIN;
+    for (size_t i = 0; i < n; i++) {
+        mn = v[i] < mn ? v[i] : mn;
+        mx = v[i] > mx ? v[i] : mx;
+    }
+    lo = mn;
+    hi = mx;
+}
+
+// The kernel: features of b.n >= 1 samples
+inline void blockFeatures(const ImuBlock& b, BlockFeatures& out) {
+    const size_t n = b.n;
+    uint32_t peak = 0;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t m = magSq(b.ax[i], b.ay[i], b.az[i]);
+        peak = m > peak ? m : peak;
+        sum += m;
+    }
+    uint32_t peakDiff = 0;
+    for (size_t i = 1; i < n; i++) {
+        uint32_t d = magSq(clampDiff(b.ax[i] - b.ax[i - 1]), clampDiff(b.ay[i] - b.ay[i - 1]),
+                           clampDiff(b.az[i] - b.az[i - 1]));
+        peakDiff = d > peakDiff ? d : peakDiff;
+    }
+    out.peakMagSq = peak;
+    out.sumMagSq = sum;
+    out.peakDiffSq = peakDiff;
+    minMax(b.gx, n, out.gyroMin[0], out.gyroMax[0]);
+    minMax(b.gy, n, out.gyroMin[1], out.gyroMax[1]);
+    minMax(b.gz, n, out.gyroMin[2], out.gyroMax[2]);
+}
+
+inline uint32_t isqrt(uint64_t v) {
+    uint64_t r = 0, bit = (uint64_t)1 << 62;
+    while (bit > v) bit >>= 2;
+    while (bit) {
+        if (v >= r + bit) {
+            v -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)r;
+}
+
+inline uint16_t saturate16(uint64_t v) { return v > UINT16_MAX ? UINT16_MAX : (uint16_t)v; }
+
+inline int8_t saturate8(int64_t v) { return v > INT8_MAX ? INT8_MAX : (v < INT8_MIN ? INT8_MIN : (int8_t)v); }
+
+// Rounded a * b / c for non-negative values
+inline uint64_t mulDiv(uint64_t a, uint64_t b, uint64_t c) { return (a * b + c / 2) / c; }
+
+}  // namespace imu
+
+class ImuWindow {
+public:
+    void add(const ImuBlock& b) {
+        if (b.n == 0) return;
+        imu::BlockFeatures f;
+        imu::blockFeatures(b, f);
+        if (count == 0) {
+            for (int k = 0; k < 3; k++) {
+                gyroMin[k] = f.gyroMin[k];
+                gyroMax[k] = f.gyroMax[k];
+            }
+        }
+        peakMagSq = f.peakMagSq > peakMagSq ? f.peakMagSq : peakMagSq;
+        sumMagSq += f.sumMagSq;
+        peakDiffSq = f.peakDiffSq > peakDiffSq ? f.peakDiffSq : peakDiffSq;
+        for (int k = 0; k < 3; k++) {
+            gyroMin[k] = f.gyroMin[k] < gyroMin[k] ? f.gyroMin[k] : gyroMin[k];
+            gyroMax[k] = f.gyroMax[k] > gyroMax[k] ? f.gyroMax[k] : gyroMax[k];
+        }
+        // The step from the previous block's last sample into this one
+        if (haveLast) {
+            uint32_t d = imu::magSq(imu::clampDiff(b.ax[0] - last[0]), imu::clampDiff(b.ay[0] - last[1]),
+                                    imu::clampDiff(b.az[0] - last[2]));
+            peakDiffSq = d > peakDiffSq ? d : peakDiffSq;
+        }
+        last[0] = b.ax[b.n - 1];
+        last[1] = b.ay[b.n - 1];
+        last[2] = b.az[b.n - 1];
+        haveLast = true;
+        count += (uint32_t)b.n;
+    }
+
+    uint32_t samples() const { return count; }
+
+    // Writes the window's features into r (on-air units) and starts a new
+    // window; the jerk across the boundary still counts in the next one
+    void take(const ImuScale& s, SensorReading& r) {
+        // |a| in LSB -> m/s^2 * 100: 1 g = 980.665 cm/s^2
+        const uint64_t lsbPerG = s.accelLsbPerG;
+        r.accel = imu::saturate16(imu::mulDiv(imu::isqrt(peakMagSq), 980665, lsbPerG * 1000));
+        r.accelRms = count ? imu::saturate16(imu::mulDiv(imu::isqrt(sumMagSq / count), 980665, lsbPerG * 1000)) : 0;
+        // LSB per sample -> (m/s^2 per ms) * 100
+        r.jerk = imu::saturate16(imu::mulDiv((uint64_t)imu::isqrt(peakDiffSq) * s.rateHz, 980665,
+                                             lsbPerG * 1000 * 1000));
+        for (int k = 0; k < 3; k++) {
+            int32_t v = -(int32_t)gyroMin[k] > gyroMax[k] ? gyroMin[k] : gyroMax[k];
+            // LSB -> rad/s * 10 = v * 10 / (lsbPerDps10 / 10) * pi / 180
+            int64_t num = (int64_t)v * 100 * 314159;
+            int64_t den = (int64_t)s.gyroLsbPerDps10 * 180 * 100000;
+            r.gyro[k] = imu::saturate8((num + (num >= 0 ? den / 2 : -den / 2)) / den);
+        }
+        bool keepLast = haveLast;
+        reset();
+        haveLast = keepLast;
+    }
+
+    void reset() {
+        peakMagSq = 0;
+        sumMagSq = 0;
+        peakDiffSq = 0;
+        for (int k = 0; k < 3; k++) gyroMin[k] = gyroMax[k] = 0;
+        count = 0;
+        haveLast = false;
+    }
+
+private:
+    uint32_t peakMagSq = 0;
+    uint64_t sumMagSq = 0;
+    uint32_t peakDiffSq = 0;
+    int16_t gyroMin[3] = {0, 0, 0};
+    int16_t gyroMax[3] = {0, 0, 0};
+    int16_t last[3] = {0, 0, 0};
+    bool haveLast = false;
+    uint32_t count = 0;
+};
+
+#endif
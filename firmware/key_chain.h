@@ -0,0 +1,67 @@
+// key_chain.h - Daily key chain derivation shared by the device and the backend
+//
+//   key[0] = SHA256(masterKey || vehicleId || BE64(startEpoch))[0..16)
+//   key[d] = SHA256(key[d-1]  || vehicleId || BE64(startDay + d * 86400))[0..16)
+//
+// Same derivation as frontend/src/utils/crypto.js generateDailyKeySHA256.
+#ifndef KEY_CHAIN_H
+#define KEY_CHAIN_H
+
+#include "hal/hal.h"
+
+#define DAILY_KEY_SIZE 16
+#define SECONDS_PER_DAY 86400
+
+namespace keychain {
+
+inline uint64_t dayOf(uint64_t epoch) { return (epoch / SECONDS_PER_DAY) * SECONDS_PER_DAY; }
+
+inline void epochToBytesBE(uint64_t epoch, uint8_t* bytes) {
+    for (int i = 0; i < 8; i++) {
+        bytes[7 - i] = epoch & 0xFF;
+        epoch >>= 8;
+    }
+}
+
+// SHA256(prefix || vehicleId || BE64(epoch)) truncated to a daily key, fed
+// to the hash piece by piece instead of concatenated first
+inline void hashStep(const uint8_t* prefix, size_t prefixLen, const uint8_t* vehicleId, size_t vehicleIdLen,
+                     uint64_t epoch, uint8_t* outKey) {
+    uint8_t epochBytes[8];
+    epochToBytesBE(epoch, epochBytes);
+
+    uint8_t hash[32];
+    hal::Sha256 sha;
+    sha.begin();
+    sha.update(prefix, prefixLen);
+    sha.update(vehicleId, vehicleIdLen);
+    sha.update(epochBytes, sizeof(epochBytes));
+    sha.finish(hash);
+    memcpy(outKey, hash, DAILY_KEY_SIZE);
+}
+
+inline void deriveInitial(const uint8_t* masterKey, size_t masterKeyLen, const uint8_t* vehicleId,
+                          size_t vehicleIdLen, uint64_t startEpoch, uint8_t* outKey) {
+    hashStep(masterKey, masterKeyLen, vehicleId, vehicleIdLen, startEpoch, outKey);
+}
+
+inline void deriveNext(const uint8_t* prevKey, const uint8_t* vehicleId, size_t vehicleIdLen,
+                       uint64_t dayEpoch, uint8_t* outKey) {
+    hashStep(prevKey, DAILY_KEY_SIZE, vehicleId, vehicleIdLen, dayOf(dayEpoch), outKey);
+}
+
+// Walks key (in place) from the day holding fromEpoch to the day holding
+// toEpoch, one hash per day. Returns the number of days advanced.
+inline uint32_t advance(uint8_t* key, const uint8_t* vehicleId, size_t vehicleIdLen,
+                        uint64_t fromEpoch, uint64_t toEpoch) {
+    uint32_t steps = 0;
+    for (uint64_t day = dayOf(fromEpoch) + SECONDS_PER_DAY; day <= dayOf(toEpoch); day += SECONDS_PER_DAY) {
+        deriveNext(key, vehicleId, vehicleIdLen, day, key);
+        steps++;
+    }
+    return steps;
+}
+
+}  // namespace keychain
+
+#endif
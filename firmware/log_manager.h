@@ -0,0 +1,205 @@
+// log_manager.h - Compile-time log levels with deferred, non-blocking output
+//
+// LOG_<LEVEL>(fmt, ...) formats into a fixed lock-free ring in RAM instead of
+// blocking on the UART; logDrain() writes the ring out when the loop is idle.
+// Levels above LOG_LEVEL are discarded at compile time, arguments included,
+// so release builds carry neither the cost nor the plaintext/key dumps.
+#ifndef LOG_MANAGER_H
+#define LOG_MANAGER_H
+
+#include <atomic>
+#include <stdarg.h>
+#include <stdio.h>
+#include "hal/hal.h"
+
+enum class LogLevel : uint8_t { Error = 1, Warn, Info, Debug, Trace };
+
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_TRACE 5  // per-frame byte dumps, including plaintext
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#ifndef LOG_RING_SLOTS
+#define LOG_RING_SLOTS 32  // power of two
+#endif
+#ifndef LOG_RECORD_SIZE
+#define LOG_RECORD_SIZE 128
+#endif
+#ifndef LOG_DRAIN_PER_CALL
+#define LOG_DRAIN_PER_CALL 8
+#endif
+
+static_assert((LOG_RING_SLOTS & (LOG_RING_SLOTS - 1)) == 0, "LOG_RING_SLOTS must be a power of two");
+
+constexpr bool logEnabled(LogLevel level) { return (int)level <= LOG_LEVEL; }
+
+// Multi-producer / single-consumer ring of formatted lines. Both cores log
+// (the loop task and the transmit task), so a producer claims its slot with a
+// CAS on head and publishes it through the slot's sequence number; the drain
+// only reads slots whose line is complete. Never blocks: a full ring fails.
+template <size_t Slots, size_t RecordSize>
+class LogRing {
+public:
+    struct Record {
+        LogLevel level;
+        char text[RecordSize - 1];
+    };
+
+    LogRing() {
+        for (size_t i = 0; i < Slots; i++) slots[i].seq.store((uint32_t)i, std::memory_order_relaxed);
+    }
+
+    // Returns the slot to fill, or nullptr if the ring is full
+    Record* reserve() {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& s = slots[h & (Slots - 1)];
+            int32_t diff = (int32_t)(s.seq.load(std::memory_order_acquire) - h);
+            if (diff < 0) return nullptr;
+            if (diff == 0 && head.compare_exchange_weak(h, h + 1, std::memory_order_relaxed)) return &s;
+            if (diff > 0) h = head.load(std::memory_order_relaxed);
+        }
+    }
+    void commit(Record* rec) {
+        Slot* s = static_cast<Slot*>(rec);
+        s->seq.store(s->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    const Record* peek() const {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        const Slot& s = slots[t & (Slots - 1)];
+        if (s.seq.load(std::memory_order_acquire) != t + 1) return nullptr;
+        return &s;
+    }
+    void release() {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        slots[t & (Slots - 1)].seq.store(t + (uint32_t)Slots, std::memory_order_release);
+        tail.store(t + 1, std::memory_order_relaxed);
+    }
+
+    // Reserved lines, including ones still being formatted
+    size_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+private:
+    struct Slot : Record {
+        std::atomic<uint32_t> seq;
+    };
+
+    Slot slots[Slots];
+    std::atomic<uint32_t> head{0};
+    std::atomic<uint32_t> tail{0};
+};
+
+// Cost of logging, in hal::cycles() units, per level. Updated with relaxed
+// atomic adds from both cores; logPrintStats() reads a loose snapshot
+struct LogStats {
+    uint32_t records[6] = {0};
+    uint64_t cycles[6] = {0};
+    uint32_t dropped = 0;
+    uint32_t drained = 0;
+    uint64_t drainCycles = 0;
+};
+
+inline LogRing<LOG_RING_SLOTS, LOG_RECORD_SIZE> logRing;
+inline LogStats logStats;
+
+template <typename T>
+inline void logCount(T& counter, T n) { __atomic_fetch_add(&counter, n, __ATOMIC_RELAXED); }
+template <typename T>
+inline T logLoad(const T& counter) { return __atomic_load_n(&counter, __ATOMIC_RELAXED); }
+
+inline void logWrite(LogLevel level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+inline void logWrite(LogLevel level, const char* fmt, ...) {
+    uint32_t start = hal::cycles();
+    auto* rec = logRing.reserve();
+    if (rec) {
+        rec->level = level;
+        va_list args;
+        va_start(args, fmt);
+        vsnprintf(rec->text, sizeof(rec->text), fmt, args);
+        va_end(args);
+        logRing.commit(rec);
+        logCount(logStats.records[(int)level], 1u);
+    } else {
+        logCount(logStats.dropped, 1u);
+    }
+    logCount(logStats.cycles[(int)level], (uint64_t)(uint32_t)(hal::cycles() - start));
+}
+
+inline void logWriteHex(LogLevel level, const char* label, const uint8_t* data, size_t len) {
+    uint32_t start = hal::cycles();
+    auto* rec = logRing.reserve();
+    if (rec) {
+        static const char digits[] = "0123456789ABCDEF";
+        rec->level = level;
+        size_t n = strlen(label);
+        if (n > sizeof(rec->text) - 1) n = sizeof(rec->text) - 1;
+        memcpy(rec->text, label, n);
+        for (size_t i = 0; i < len && n + 3 < sizeof(rec->text); i++) {
+            rec->text[n++] = digits[data[i] >> 4];
+            rec->text[n++] = digits[data[i] & 0x0F];
+            rec->text[n++] = ' ';
+        }
+        rec->text[n] = '\0';
+        logRing.commit(rec);
+        logCount(logStats.records[(int)level], 1u);
+    } else {
+        logCount(logStats.dropped, 1u);
+    }
+    logCount(logStats.cycles[(int)level], (uint64_t)(uint32_t)(hal::cycles() - start));
+}
+
+// Writes up to maxRecords queued lines to the console; call when the loop is idle
+inline size_t logDrain(size_t maxRecords = LOG_DRAIN_PER_CALL) {
+    uint32_t start = hal::cycles();
+    size_t n = 0;
+    while (n < maxRecords) {
+        const auto* rec = logRing.peek();
+        if (!rec) break;
+        hal::logln(rec->text);
+        logRing.release();
+        n++;
+    }
+    logCount(logStats.drained, (uint32_t)n);
+    logCount(logStats.drainCycles, (uint64_t)(uint32_t)(hal::cycles() - start));
+    return n;
+}
+
+// Drains everything, e.g. before a restart
+inline void logFlush() {
+    while (logDrain(LOG_RING_SLOTS)) {}
+}
+
+inline void logPrintStats() {
+    static const char* names[6] = {"", "ERROR", "WARN", "INFO", "DEBUG", "TRACE"};
+    for (int l = 1; l <= 5; l++) {
+        uint32_t records = logLoad(logStats.records[l]);
+        uint64_t cycles = logLoad(logStats.cycles[l]);
+        if (!records) continue;
+        hal::logf("📊 log %-5s %8lu records %10llu cycles (%llu/record)\n", names[l],
+                  (unsigned long)records, (unsigned long long)cycles, (unsigned long long)(cycles / records));
+    }
+    hal::logf("📊 log drained %lu in %llu cycles, dropped %lu\n", (unsigned long)logLoad(logStats.drained),
+              (unsigned long long)logLoad(logStats.drainCycles), (unsigned long)logLoad(logStats.dropped));
+}
+
+#define LOG_AT(level, ...) \
+    do { if constexpr (logEnabled(level)) logWrite(level, __VA_ARGS__); } while (0)
+#define LOG_HEX(level, label, data, len) \
+    do { if constexpr (logEnabled(level)) logWriteHex(level, label, data, len); } while (0)
+
+#define LOG_ERROR(...) LOG_AT(LogLevel::Error, __VA_ARGS__)
+#define LOG_WARN(...)  LOG_AT(LogLevel::Warn, __VA_ARGS__)
+#define LOG_INFO(...)  LOG_AT(LogLevel::Info, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LogLevel::Debug, __VA_ARGS__)
+#define LOG_TRACE(...) LOG_AT(LogLevel::Trace, __VA_ARGS__)
+
+#endif
@@ -1,119 +1,336 @@
 #ifndef LORA_MANAGER_H
 #define LORA_MANAGER_H
 
-#include <RadioLib.h>
-#include <LoRaWAN_ESP32.h>
-#include <Preferences.h>
+#include "hal/hal.h"
+#include "hal/hal_radio.h"
+#include "flash_queue.h"
+#include "frame_layout.h"
+#include "log_manager.h"
+#include "trace_manager.h"
+#include "tx_scheduler.h"
 
-#define BUFFER_SIZE 4
-#define MAX_PAYLOAD_SIZE 20
+#define MAX_PAYLOAD_SIZE PAYLOAD_SIZE
+// Largest LoRaWAN application payload (EU868 DR4..DR7)
+#define LORAWAN_MAX_UPLINK 242
 
-// LoRa Module Configuration for Heltec ESP32
-SX1262 radio = new Module(8, 14, 12, 13);
-LoRaWANNode* node = nullptr;
-Preferences preferences;
-uint16_t devNonce = 0;
-// Buffer per i payload falliti
-uint8_t payloadBuffer[BUFFER_SIZE][MAX_PAYLOAD_SIZE];
-size_t payloadLengths[BUFFER_SIZE];
-int bufferCount = 0;
+// Send aggregates as confirmed uplinks and drop readings only on the ACK.
+// With 0 a transmitted uplink counts as delivered.
+#ifndef LORAWAN_CONFIRMED_UPLINKS
+#define LORAWAN_CONFIRMED_UPLINKS 1
+#endif
+// A batch that does not fill an uplink goes out once its oldest reading is this old
+#ifndef LORAWAN_MAX_BATCH_DELAY_MS
+#define LORAWAN_MAX_BATCH_DELAY_MS 150000
+#endif
+// While a backlog drains, LoRaWAN_poll() sends at most one full batch per
+// interval, and only while the duty-cycle budget has room (tx_scheduler.h)
+#ifndef LORAWAN_DRAIN_INTERVAL_MS
+#define LORAWAN_DRAIN_INTERVAL_MS 60000
+#endif
+
+// Priority traffic (crash windows, crash_recorder.h). Its frames go out one
+// per uplink on FPORT_EVENT ahead of any queued reading, as fast as the duty
+// cycle allows. Called on the transmit stage only.
+struct UplinkSource {
+    virtual ~UplinkSource() = default;
+    virtual bool pending() = 0;
+    // Length of the frame next() would build, without building it (building
+    // takes a message counter value); 0 if there is none
+    virtual size_t nextLen() = 0;
+    // Builds the next frame into out (cap bytes); 0 if there is none
+    virtual size_t next(uint8_t* out, size_t cap) = 0;
+    // The frame last returned by next() was delivered
+    virtual void delivered() = 0;
+};
+
+// Everything the LoRaWAN layer keeps between calls. The board has one; the
+// host has one per simulated device (hal::deviceLocal), so a fleet simulator
+// runs this file for every vehicle. A reboot starts from a fresh one.
+struct LoRaWANState {
+    // LoRa Module Configuration for Heltec ESP32
+    Module module{8, 14, 12, 13};
+    SX1262 radio{&module};
+    LoRaWANNode* node = nullptr;
+    hal::Preferences preferences;
+    uint16_t devNonce = 0;
+    // Readings waiting for an acknowledged uplink; kept in flash across outages and reboots
+    FlashQueue uplinkQueue;
+    // When the current batch started filling, and when the last uplink was attempted
+    uint32_t pendingSinceMillis = 0;
+    uint32_t lastUplinkMillis = 0;
+    // A queued reading is an exception (report_policy.h): send without waiting for the batch
+    bool urgentPending = false;
+    // Staging slot for the next reading, and the uplink assembly buffer
+    uint8_t frameSlot[MAX_PAYLOAD_SIZE];
+    uint8_t txBuffer[LORAWAN_MAX_UPLINK];
+    UplinkSource* eventSource = nullptr;
+    // Data rate, duty-cycle budget and priority of every uplink; the data rate last set on the node
+    TxScheduler txScheduler{TxSchedulerConfig{SubBand::G1, TX_DEFAULT_DATARATE, 0, TX_DATARATES - 1,
+                                              LORAWAN_CONFIRMED_UPLINKS != 0}};
+    uint8_t nodeDatarate = TX_DEFAULT_DATARATE;
+};
+
+inline LoRaWANState& lorawan() { return hal::deviceLocal<LoRaWANState>(); }
 
-void LoRaWAN_setup() {
-    Serial.println("🔄 Initializing LoRaWAN...");
+// One uplink with its RX windows, and the session commit to NVS after it
+inline int16_t LoRaWAN_sendReceive(const uint8_t* data, size_t len, uint8_t port, bool confirmed = false) {
+    TRACE_SPAN("sendReceive");
+    return lorawan().node->sendReceive(data, len, port, confirmed);
+}
+
+inline void LoRaWAN_saveSession() {
+    TRACE_SPAN("nvs.session");
+    persist.saveSession(lorawan().node);
+}
+
+inline void LoRaWAN_setup() {
+    LoRaWANState& lw = lorawan();
+    LOG_INFO("🔄 Initializing LoRaWAN...");
+
+    // A backlog found at boot is overdue by definition
+    if (!lw.uplinkQueue.ready() && lw.uplinkQueue.begin() && lw.uplinkQueue.size() > 0) {
+        lw.pendingSinceMillis = hal::millis() - LORAWAN_MAX_BATCH_DELAY_MS;
+    }
 
-    preferences.begin("lorawan", false);
+    lw.preferences.begin("lorawan", false);
 
     // ✅ DevNonce ora è incrementale e persistente
-    devNonce = preferences.getUShort("dev_nonce", 0);
-    Serial.printf("📟 Using DevNonce: %u\n", devNonce);
+    lw.devNonce = lw.preferences.getUShort("dev_nonce", 0);
+    LOG_INFO("📟 Using DevNonce: %u", lw.devNonce);
 
-    int16_t state = radio.begin();
+    int16_t state = lw.radio.begin();
     if (state != RADIOLIB_ERR_NONE) {
-        Serial.println("❌ LoRa module failed to initialize.");
-        preferences.end();
+        LOG_ERROR("❌ LoRa module failed to initialize.");
+        lw.preferences.end();
         return;
     }
 
-    node = persist.manage(&radio);
-    node->setDatarate(3);
-    node->setADR(false);
-    persist.loadSession(node);
-    if (persist.loadSession(node) && node->isActivated()) {
-        Serial.println("✅ Device already activated.");
+    lw.node = persist.manage(&lw.radio);
+    lw.nodeDatarate = lw.txScheduler.datarate();
+    lw.node->setDatarate(lw.nodeDatarate);
+    // The duty cycle is kept per sub-band over the hour by txScheduler
+    lw.node->setDutyCycle(false);
+    lw.node->setADR(false);
+    persist.loadSession(lw.node);
+    if (persist.loadSession(lw.node) && lw.node->isActivated()) {
+        LOG_INFO("✅ Device already activated.");
     } else {
-        Serial.println("⚠️ Device not activated! Ensure manual OTAA join is done.");
+        LOG_WARN("⚠️ Device not activated! Ensure manual OTAA join is done.");
     }
 
     // ✅ Incrementa e salva il nuovo devNonce
-    devNonce++;
+    lw.devNonce++;
 
-    preferences.putUShort("dev_nonce", devNonce);
-    preferences.end();
+    lw.preferences.putUShort("dev_nonce", lw.devNonce);
+    lw.preferences.end();
 
-    persist.saveSession(node);
+    LoRaWAN_saveSession();
 }
 
-void addToBuffer(uint8_t* payload, size_t len){
+// Slot for the next reading, so the caller can build it in place (cap = room for one frame)
+inline uint8_t* LoRaWAN_txSlot(size_t& cap) {
+    cap = MAX_PAYLOAD_SIZE;
+    return lorawan().frameSlot;
+}
 
-  if(bufferCount < BUFFER_SIZE){
-    memcpy(payloadBuffer[bufferCount], payload, len);
-    payloadLengths[bufferCount] = len;
-    bufferCount++;
-    Serial.println("Payload salvato");
-  } else {
-    Serial.println("Buffer pieno");
-  }
+inline bool addToBuffer(const uint8_t* payload, size_t len) {
+    LoRaWANState& lw = lorawan();
+    if (!lw.uplinkQueue.ready() && !lw.uplinkQueue.begin()) return false;
+    if (lw.uplinkQueue.size() == 0) lw.pendingSinceMillis = hal::millis();
+    if (!lw.uplinkQueue.append(payload, len)) return false;
+    lw.txScheduler.onQueued(hal::millis());
+    LOG_DEBUG("Payload salvato (%u pending)", (unsigned)lw.uplinkQueue.size());
+    return true;
 }
 
-bool LoRaWAN_send(uint8_t* payload, size_t len) {
-    if (!node->isActivated()) {
-        Serial.println("⚠️ Not activated! Cannot send. Load session or re-join required.");
-        addToBuffer(payload, len);  // ✅ CORRETTO
-        LoRaWAN_setup();
-        return false;
+// Lays out as many pending readings as fit maxLen in txBuffer; returns the
+// uplink length and sets count/port. A lone reading goes out as a plain frame.
+inline size_t LoRaWAN_pack(size_t maxLen, int& count, uint8_t& port) {
+    LoRaWANState& lw = lorawan();
+    FlashQueue::Cursor c = lw.uplinkQueue.front();
+    size_t offset = AGGREGATE_HEADER_LEN, len = 0;
+    count = 0;
+    while (offset + AGGREGATE_ENTRY_OVERHEAD < maxLen &&
+           lw.uplinkQueue.read(c, lw.txBuffer + offset + AGGREGATE_ENTRY_OVERHEAD,
+                               maxLen - offset - AGGREGATE_ENTRY_OVERHEAD, len)) {
+        lw.txBuffer[offset] = (uint8_t)len;
+        offset += AGGREGATE_ENTRY_OVERHEAD + len;
+        count++;
     }
-    
-    size_t totalLen = len;
-    for(int i = 0; i < bufferCount; i++) totalLen += payloadLengths[i];
-    uint8_t combinedPayload[MAX_PAYLOAD_SIZE * (BUFFER_SIZE + 1 )] = {0};
-    size_t offset = 0;
 
+    if (count <= 1) {
+        c = lw.uplinkQueue.front();
+        if (!lw.uplinkQueue.read(c, lw.txBuffer, maxLen, len)) return 0;
+        count = 1;
+        port = FPORT_FRAME;
+        return len;
+    }
+    lw.txBuffer[0] = (uint8_t)count;
+    port = FPORT_AGGREGATE;
+    return offset;
+}
+
+// Application payload limit at the current data rate
+inline size_t LoRaWAN_maxUplink() {
+    size_t maxLen = lorawan().node->getMaxPayloadLen();
+    return maxLen < LORAWAN_MAX_UPLINK ? maxLen : LORAWAN_MAX_UPLINK;
+}
+
+inline void LoRaWAN_useDatarate(uint8_t dr) {
+    LoRaWANState& lw = lorawan();
+    if (dr == lw.nodeDatarate) return;
+    lw.nodeDatarate = dr;
+    lw.node->setDatarate(dr);
+}
+
+inline void LoRaWAN_setEventSource(UplinkSource* src) { lorawan().eventSource = src; }
+
+inline bool LoRaWAN_eventPending() {
+    UplinkSource* src = lorawan().eventSource;
+    return src != nullptr && src->pending();
+}
+
+// Sends the next event frame if the duty cycle allows one now, at a data
+// rate it fits. Returns 1 if it was delivered (acknowledged with
+// LORAWAN_CONFIRMED_UPLINKS).
+inline int LoRaWAN_sendEvent() {
+    LoRaWANState& lw = lorawan();
+    if (lw.node == nullptr || !LoRaWAN_eventPending() || !lw.node->isActivated()) return 0;
+    if (lw.node->timeUntilUplink() > 0) return 0;
+    // Admitted before it is encrypted: a deferred frame takes no counter value
+    size_t len = lw.eventSource->nextLen();
+    if (len == 0 || len > LORAWAN_MAX_UPLINK) return 0;
+    const uint32_t now = hal::millis();
+    const uint8_t dr = lw.txScheduler.eventDatarate(len);
+    if (!lw.txScheduler.admit(TxClass::Event, lorawanAirtimeMs(dr, len), now)) return 0;
+    len = lw.eventSource->next(lw.txBuffer, LORAWAN_MAX_UPLINK);
+    if (len == 0) return 0;
+    LoRaWAN_useDatarate(dr);
 
-    for(int i = 0; i < bufferCount; i++){
-      memcpy(combinedPayload + offset, payloadBuffer[i], payloadLengths[i]);
-      offset += payloadLengths[i];
+    int state = LoRaWAN_sendReceive(lw.txBuffer, len, FPORT_EVENT, LORAWAN_CONFIRMED_UPLINKS != 0);
+    if (state < RADIOLIB_ERR_NONE) {
+        LOG_ERROR("❌ Failed to send event frame (Error: %d)", state);
+        return 0;
+    }
+    LoRaWAN_saveSession();
+    lw.txScheduler.onSent(TxClass::Event, dr, lw.node->getLastToA(), 0,
+                          !LORAWAN_CONFIRMED_UPLINKS || state > RADIOLIB_ERR_NONE, LORAWAN_CONFIRMED_UPLINKS != 0, now);
+    if (LORAWAN_CONFIRMED_UPLINKS && state == RADIOLIB_ERR_NONE) {
+        LOG_WARN("⚠️ Event frame not acknowledged, retrying");
+        return 0;
     }
+    lw.eventSource->delivered();
+    LOG_INFO("🚨 Event frame sent (%u bytes).", (unsigned)len);
+    return 1;
+}
 
-    memcpy(combinedPayload + offset , payload , len);
+// Readings a full uplink carries at the current data rate
+inline size_t LoRaWAN_perUplink() {
+    return (LoRaWAN_maxUplink() - AGGREGATE_HEADER_LEN) / (AGGREGATE_ENTRY_OVERHEAD + MAX_PAYLOAD_SIZE);
+}
+
+inline bool LoRaWAN_batchDue() {
+    LoRaWANState& lw = lorawan();
+    if (lw.uplinkQueue.size() == 0) return false;
+    if (lw.urgentPending) return true;
+    if (hal::millis() - lw.pendingSinceMillis >= LORAWAN_MAX_BATCH_DELAY_MS) return true;
+    return lw.uplinkQueue.size() >= LoRaWAN_perUplink();
+}
 
-    offset += len;
-    Serial.print("📡 Sending Payload to TTN (HEX): ");
-    for (size_t i = 0; i < offset; i++) {
-        Serial.printf("%02X ", combinedPayload[i]);
+// Sends one uplink with the oldest pending readings when the batch is full or
+// due (or always with force) and the duty-cycle budget of its class has room.
+// Returns how many readings were acknowledged. While an event frame is
+// pending the uplink carries that instead. An urgent reading waits for the
+// duty cycle rather than failing the uplink.
+inline int LoRaWAN_flush(bool force) {
+    LoRaWANState& lw = lorawan();
+    if (LoRaWAN_eventPending()) {
+        LoRaWAN_sendEvent();
+        return 0;
     }
-    Serial.println();
-
-    int state = node->sendReceive(combinedPayload, len, 1); 
-    if (state == RADIOLIB_ERR_NONE) {
-        Serial.println("✅ Message sent successfully.");
-        persist.saveSession(node);
-        for (int i = 0; i < BUFFER_SIZE; i++) {
-            memset(payloadBuffer[i], 0, MAX_PAYLOAD_SIZE);
-            payloadLengths[i] = 0;
-        }
-        bufferCount = 0;
-        return true;
-    } else {
-        Serial.printf("❌ Failed to send data (Error: %d)\n", state);
-        addToBuffer(payload,len);
+    if (lw.node == nullptr || lw.uplinkQueue.size() == 0) return 0;
+    if (!lw.node->isActivated()) {
+        LOG_WARN("⚠️ Not activated! Cannot send. Load session or re-join required.");
         LoRaWAN_setup();
-        return false;
+        return 0;
     }
+    if (!force && !LoRaWAN_batchDue()) return 0;
+    if (lw.urgentPending && lw.node->timeUntilUplink() > 0) return 0;
+
+    const uint32_t now = hal::millis();
+    const TxClass cls = force ? TxClass::Periodic
+                              : lw.txScheduler.readingClass(now, LORAWAN_MAX_BATCH_DELAY_MS, lw.urgentPending,
+                                                            LoRaWAN_perUplink());
+    const uint8_t dr = lw.txScheduler.nextDatarate();
+    LoRaWAN_useDatarate(dr);
+
+    int count;
+    uint8_t port;
+    size_t len = LoRaWAN_pack(LoRaWAN_maxUplink(), count, port);
+    if (len == 0) return 0;
+    if (!lw.txScheduler.admit(cls, lorawanAirtimeMs(dr, len), now)) return 0;
 
+    LOG_HEX(LogLevel::Trace, "📡 Sending Payload to TTN (HEX): ", lw.txBuffer, len);
 
+    lw.lastUplinkMillis = now;
+    int state = LoRaWAN_sendReceive(lw.txBuffer, len, port, LORAWAN_CONFIRMED_UPLINKS != 0);
+    if (state < RADIOLIB_ERR_NONE) {
+        LOG_ERROR("❌ Failed to send data (Error: %d)", state);
+        LoRaWAN_setup();
+        return 0;
+    }
+    LoRaWAN_saveSession();
+    lw.txScheduler.onSent(cls, dr, lw.node->getLastToA(), count,
+                          !LORAWAN_CONFIRMED_UPLINKS || state > RADIOLIB_ERR_NONE, LORAWAN_CONFIRMED_UPLINKS != 0, now);
+    // A confirmed uplink is acknowledged in the downlink it triggers
+    if (LORAWAN_CONFIRMED_UPLINKS && state == RADIOLIB_ERR_NONE) {
+        LOG_WARN("⚠️ Uplink with %d readings not acknowledged, keeping them", count);
+        return 0;
+    }
 
-    return (state == RADIOLIB_ERR_NONE);
+    LOG_INFO("✅ Message sent successfully (%d readings, %u bytes).", count, (unsigned)len);
+    lw.uplinkQueue.consume(count);
+    if (lw.uplinkQueue.size() == 0) lw.urgentPending = false;
+    return count;
+}
+
+// Called from loop(): pending event frames and urgent readings go out as fast
+// as the duty cycle allows; after an outage the backlog keeps draining in
+// full batches, one per LORAWAN_DRAIN_INTERVAL_MS, without waiting for new
+// readings, with the airtime the periodic traffic and events leave
+inline int LoRaWAN_poll() {
+    LoRaWANState& lw = lorawan();
+    if (LoRaWAN_eventPending()) {
+        LoRaWAN_sendEvent();
+        return 0;
+    }
+    if (!lw.urgentPending && hal::millis() - lw.lastUplinkMillis < LORAWAN_DRAIN_INTERVAL_MS) return 0;
+    return LoRaWAN_flush(false);
+}
 
+// Queues a reading (built in place with LoRaWAN_txSlot() or not) and sends
+// the batch if it is due; an urgent one sends it now, with whatever is
+// queued ahead of it. Returns true if an uplink was acknowledged.
+inline bool LoRaWAN_send(uint8_t* payload, size_t len, bool urgent = false) {
+    LoRaWANState& lw = lorawan();
+    if (lw.node == nullptr) {
+        addToBuffer(payload, len);
+        return false;
+    }
+    if (!addToBuffer(payload, len)) {
+        // No flash queue: best effort, straight to the radio, within the budget
+        LOG_WARN("⚠️ Flash queue unavailable, sending unbuffered");
+        const uint32_t now = hal::millis();
+        if (!lw.node->isActivated() ||
+            !lw.txScheduler.admit(TxClass::Periodic, lorawanAirtimeMs(lw.nodeDatarate, len), now)) {
+            return false;
+        }
+        if (LoRaWAN_sendReceive(payload, len, FPORT_FRAME) < RADIOLIB_ERR_NONE) return false;
+        lw.txScheduler.onSent(TxClass::Periodic, lw.nodeDatarate, lw.node->getLastToA(), 1, true, false, now);
+        return true;
+    }
+    if (urgent) lw.urgentPending = true;
+    return LoRaWAN_flush(false) > 0;
 }
 
 #endif
@@ -0,0 +1,83 @@
+// message_counter.h - Crash-safe frame counter with block-reserved NVS writes
+//
+// NVS "payload/counter" holds a reservation limit: every value handed out so
+// far is below it. Values come from RAM until the reserved block is used up,
+// then the next limit is committed *before* the first value of the new block
+// is returned. After a reboot counting resumes at the stored limit, skipping
+// whatever was left of the old block, so an IV is never reused while flash is
+// written once every COUNTER_BLOCK_SIZE frames instead of once per frame.
+//
+// A limit written by older firmware (the plain next-counter value) is a valid
+// reservation, so upgrades need no migration.
+#ifndef MESSAGE_COUNTER_H
+#define MESSAGE_COUNTER_H
+
+#include "hal/hal.h"
+#include "log_manager.h"
+#include "trace_manager.h"
+
+#ifndef COUNTER_BLOCK_SIZE
+#define COUNTER_BLOCK_SIZE 64
+#endif
+
+class MessageCounter {
+public:
+    explicit MessageCounter(uint32_t blockSize = COUNTER_BLOCK_SIZE) : blockSize(blockSize ? blockSize : 1) {}
+
+    void begin() {
+        if (started) return;
+        prefs.begin(NAMESPACE, false);
+        nextValue = prefs.getUInt(KEY, 0);
+        reservedUntil = nextValue;  // nothing reserved yet for this boot
+        started = true;
+        LOG_INFO("\U0001F4CA Message Counter resumes at %u (block %u)", (unsigned)nextValue, (unsigned)blockSize);
+    }
+
+    // Next never-used counter value for the current daily key
+    uint32_t next() {
+        begin();
+        if (nextValue == reservedUntil) reserve(nextValue);
+        return nextValue++;
+    }
+
+    uint32_t peek() const { return nextValue; }
+
+    // New daily key (or factory reset): the counter space starts over
+    void reset() {
+        begin();
+        nextValue = 0;
+        reserve(0);
+        LOG_INFO("\U0001F4CA Message Counter reset to 0");
+    }
+
+    // For callers without a live counter (e.g. before setup() built one)
+    static void resetPersisted() {
+        hal::Preferences p;
+        p.begin(NAMESPACE, false);
+        p.putUInt(KEY, 0);
+        p.end();
+    }
+
+    uint32_t getNvsWrites() const { return nvsWrites; }
+
+private:
+    static constexpr const char* NAMESPACE = "payload";
+    static constexpr const char* KEY = "counter";
+
+    void reserve(uint32_t from) {
+        TRACE_SPAN("nvs.counter");
+        reservedUntil = from + blockSize;
+        prefs.putUInt(KEY, reservedUntil);
+        nvsWrites++;
+        LOG_DEBUG("\U0001F4CA Reserved counters %u..%u", (unsigned)from, (unsigned)(reservedUntil - 1));
+    }
+
+    hal::Preferences prefs;
+    uint32_t blockSize;
+    uint32_t nextValue = 0;
+    uint32_t reservedUntil = 0;
+    uint32_t nvsWrites = 0;
+    bool started = false;
+};
+
+#endif
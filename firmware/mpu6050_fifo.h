@@ -0,0 +1,180 @@
+// mpu6050_fifo.h - MPU6050 sampling at a fixed rate through its hardware FIFO
+//
+// The chip samples accelerometer and gyro at IMU_SAMPLE_RATE_HZ on its own
+// clock and queues 12-byte records (ax ay az gx gy gz, big-endian) in its
+// 1024-byte FIFO. drain() reads every whole record in I2C bursts of at most
+// IMU_BURST_BYTES (the Wire buffer) and feeds them to an ImuWindow in blocks,
+// so the CPU only has to come by before the FIFO fills: 85 ms at 1 kHz. A
+// FIFO that did overflow has lost records and may be misaligned; it is reset
+// and the overflow counted.
+//
+// Registers are written directly: Adafruit_MPU6050 has no FIFO support.
+#ifndef MPU6050_FIFO_H
+#define MPU6050_FIFO_H
+
+#include "hal/hal.h"
+#include "hal/hal_sensors.h"
+#include "imu_features.h"
+#include "log_manager.h"
+
+#ifndef IMU_SAMPLE_RATE_HZ
+#define IMU_SAMPLE_RATE_HZ 1000
+#endif
+#define MPU6050_ADDR 0x68
+#define IMU_FIFO_BYTES 1024
+#define IMU_RECORD_BYTES 12
+// Whole records per I2C read, within the 128-byte Wire buffer
+#define IMU_BURST_BYTES (10 * IMU_RECORD_BYTES)
+
+namespace mpu6050 {
+constexpr uint8_t SMPLRT_DIV = 0x19;
+constexpr uint8_t CONFIG = 0x1A;
+constexpr uint8_t GYRO_CONFIG = 0x1B;
+constexpr uint8_t ACCEL_CONFIG = 0x1C;
+constexpr uint8_t FIFO_EN = 0x23;
+constexpr uint8_t INT_STATUS = 0x3A;
+constexpr uint8_t USER_CTRL = 0x6A;
+constexpr uint8_t PWR_MGMT_1 = 0x6B;
+constexpr uint8_t FIFO_COUNT_H = 0x72;
+constexpr uint8_t FIFO_R_W = 0x74;
+constexpr uint8_t WHO_AM_I = 0x75;
+
+constexpr uint8_t FIFO_EN_ACCEL_GYRO = 0x78;  // XG YG ZG ACCEL
+constexpr uint8_t USER_CTRL_FIFO_EN = 0x40;
+constexpr uint8_t USER_CTRL_FIFO_RESET = 0x04;
+constexpr uint8_t INT_FIFO_OFLOW = 0x10;
+constexpr uint8_t DLPF_188HZ = 0x01;  // with the DLPF on, the gyro output rate is 1 kHz
+constexpr uint8_t GYRO_500DPS = 0x08;
+constexpr uint8_t ACCEL_8G = 0x10;
+}  // namespace mpu6050
+
+// Sees every block drain() reads, before the window does; lastSampleMicros is
+// the estimated hal::micros() at which the block's last sample was taken
+using ImuBlockTap = void (*)(const ImuBlock& block, uint32_t lastSampleMicros, void* ctx);
+
+class Mpu6050Fifo {
+public:
+    explicit Mpu6050Fifo(TwoWire& wire, uint8_t addr = MPU6050_ADDR) : wire(wire), addr(addr) {}
+
+    // Configures +-8 g, +-500 deg/s and rateHz (4..1000, rounded to 1 kHz / n)
+    // and starts the FIFO. False if no MPU6050 answers.
+    bool begin(uint32_t rateHz = IMU_SAMPLE_RATE_HZ) {
+        using namespace mpu6050;
+        if (readRegister(WHO_AM_I) != 0x68) return false;
+        if (rateHz < 4) rateHz = 4;
+        if (rateHz > 1000) rateHz = 1000;
+        uint8_t div = (uint8_t)(1000 / rateHz - 1);
+        writeRegister(PWR_MGMT_1, 0x01);  // wake, gyro X PLL as clock
+        writeRegister(CONFIG, DLPF_188HZ);
+        writeRegister(SMPLRT_DIV, div);
+        writeRegister(GYRO_CONFIG, GYRO_500DPS);
+        writeRegister(ACCEL_CONFIG, ACCEL_8G);
+        writeRegister(FIFO_EN, FIFO_EN_ACCEL_GYRO);
+        resetFifo();
+        cfg = {1000u / (div + 1u), 4096, 655};
+        running = true;
+        return true;
+    }
+
+    // Moves every whole record from the FIFO into window; returns how many
+    size_t drain(ImuWindow& window) {
+        using namespace mpu6050;
+        if (!running) return 0;
+        if (readRegister(INT_STATUS) & INT_FIFO_OFLOW) {
+            overflowCount++;
+            LOG_WARN("⚠️ IMU FIFO overflow, records lost");
+            resetFifo();
+            return 0;
+        }
+        uint8_t count[2];
+        readRegisters(FIFO_COUNT_H, count, 2);
+        size_t records = (((size_t)count[0] << 8) | count[1]) / IMU_RECORD_BYTES;
+
+        // The newest record in the FIFO was sampled about now
+        const uint32_t now = hal::micros(), periodUs = 1000000u / cfg.rateHz;
+        ImuBlock block;
+        uint8_t buf[IMU_BURST_BYTES];
+        size_t left = records;
+        while (left > 0) {
+            size_t n = left < IMU_BURST_BYTES / IMU_RECORD_BYTES ? left : IMU_BURST_BYTES / IMU_RECORD_BYTES;
+            if (n > IMU_BLOCK_MAX - block.n) n = IMU_BLOCK_MAX - block.n;
+            if (!readRegisters(FIFO_R_W, buf, n * IMU_RECORD_BYTES)) break;
+            for (size_t i = 0; i < n; i++) append(block, buf + i * IMU_RECORD_BYTES);
+            left -= n;
+            if (block.n == IMU_BLOCK_MAX) {
+                deliver(block, window, now - (uint32_t)left * periodUs);
+                block.n = 0;
+            }
+        }
+        deliver(block, window, now - (uint32_t)left * periodUs);
+        records -= left;
+        sampleCount += records;
+        return records;
+    }
+
+    void setTap(ImuBlockTap fn, void* ctx = nullptr) {
+        tap = fn;
+        tapCtx = ctx;
+    }
+
+    const ImuScale& scale() const { return cfg; }
+    uint32_t overflows() const { return overflowCount; }
+    uint64_t samples() const { return sampleCount; }
+
+private:
+    void deliver(const ImuBlock& block, ImuWindow& window, uint32_t lastSampleMicros) {
+        if (block.n == 0) return;
+        if (tap) tap(block, lastSampleMicros, tapCtx);
+        window.add(block);
+    }
+
+    static int16_t be16(const uint8_t* p) { return (int16_t)((uint16_t)p[0] << 8 | p[1]); }
+
+    static void append(ImuBlock& b, const uint8_t* rec) {
+        size_t i = b.n++;
+        b.ax[i] = be16(rec);
+        b.ay[i] = be16(rec + 2);
+        b.az[i] = be16(rec + 4);
+        b.gx[i] = be16(rec + 6);
+        b.gy[i] = be16(rec + 8);
+        b.gz[i] = be16(rec + 10);
+    }
+
+    void resetFifo() {
+        using namespace mpu6050;
+        writeRegister(USER_CTRL, USER_CTRL_FIFO_RESET);
+        writeRegister(USER_CTRL, USER_CTRL_FIFO_EN);
+    }
+
+    void writeRegister(uint8_t reg, uint8_t value) {
+        wire.beginTransmission(addr);
+        wire.write(reg);
+        wire.write(value);
+        wire.endTransmission();
+    }
+
+    uint8_t readRegister(uint8_t reg) {
+        uint8_t v = 0;
+        return readRegisters(reg, &v, 1) ? v : 0;
+    }
+
+    bool readRegisters(uint8_t reg, uint8_t* out, size_t len) {
+        wire.beginTransmission(addr);
+        wire.write(reg);
+        if (wire.endTransmission(false) != 0) return false;
+        if (wire.requestFrom(addr, (uint8_t)len) != len) return false;
+        for (size_t i = 0; i < len; i++) out[i] = (uint8_t)wire.read();
+        return true;
+    }
+
+    TwoWire& wire;
+    uint8_t addr;
+    ImuScale cfg = {IMU_SAMPLE_RATE_HZ, 4096, 655};
+    bool running = false;
+    ImuBlockTap tap = nullptr;
+    void* tapCtx = nullptr;
+    uint32_t overflowCount = 0;
+    uint64_t sampleCount = 0;
+};
+
+#endif
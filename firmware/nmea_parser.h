@@ -0,0 +1,240 @@
+// nmea_parser.h - Incremental NMEA 0183 parser for the GPS module
+//
+// Bytes go in one at a time and a sentence is checked and parsed as soon as
+// its line ends, so memory is one sentence buffer however long the stream
+// runs. Only $--RMC (time, date, position, speed, course) and $--GGA
+// (position, satellites) are read, from any talker (GP, GN, GL, ...).
+// Sentences with a missing or wrong checksum are dropped. Coordinates are
+// parsed with integer arithmetic straight into the on-air fixed point
+// (degrees * 1e7).
+#ifndef NMEA_PARSER_H
+#define NMEA_PARSER_H
+
+#include "hal/hal.h"
+
+// Longest sentence the standard allows, without '$' and CR LF
+#define NMEA_MAX_SENTENCE 80
+#define NMEA_MAX_FIELDS 20
+#define GPS_COORD_SCALE 10000000
+
+struct GpsFix {
+    bool locationValid = false;
+    int32_t lat = 0;  // degrees * GPS_COORD_SCALE
+    int32_t lon = 0;
+    uint8_t satellites = 0;
+    // Speed and course over ground from the last RMC with a position
+    bool motionValid = false;
+    uint16_t speed = 0;   // cm/s
+    uint16_t course = 0;  // degrees * 100, clockwise from true north
+    bool timeValid = false;
+    uint16_t year = 0;
+    uint8_t month = 0, day = 0, hour = 0, minute = 0, second = 0;
+    uint32_t locationMillis = 0;  // hal::millis() of the last position
+    uint32_t timeMillis = 0;      // and of the last time of day
+
+    // UTC seconds of the last time received, 0 without a valid date
+    uint64_t epoch() const {
+        if (!timeValid) return 0;
+        return (uint64_t)daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+    }
+
+    // Days since 1970-01-01 of a proleptic Gregorian date
+    static int64_t daysFromCivil(int y, unsigned m, unsigned d) {
+        y -= m <= 2;
+        const int era = (y >= 0 ? y : y - 399) / 400;
+        const unsigned yoe = (unsigned)(y - era * 400);
+        const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+        const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return (int64_t)era * 146097 + (int64_t)doe - 719468;
+    }
+};
+
+class NmeaParser {
+public:
+    // Feeds one byte; true when it completed a sentence that updated the fix
+    bool encode(char c) {
+        if (c == '$') {
+            len = 0;
+            inSentence = true;
+            return false;
+        }
+        if (!inSentence) return false;
+        if (c == '\r' || c == '\n') {
+            inSentence = false;
+            return finish();
+        }
+        if (len == NMEA_MAX_SENTENCE) {
+            inSentence = false;  // garbage or a lost line end: wait for the next '$'
+            overlong++;
+            return false;
+        }
+        buf[len++] = c;
+        return false;
+    }
+
+    const GpsFix& fix() const { return current; }
+
+    uint32_t sentences() const { return parsed; }
+    uint32_t checksumErrors() const { return badChecksum; }
+    uint32_t overlongSentences() const { return overlong; }
+
+private:
+    static int hexValue(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        return -1;
+    }
+
+    // Value of the first n digits of s, -1 if any is missing
+    static int32_t digits(const char* s, int n) {
+        int32_t v = 0;
+        for (int i = 0; i < n; i++) {
+            if (s[i] < '0' || s[i] > '9') return -1;
+            v = v * 10 + (s[i] - '0');
+        }
+        return v;
+    }
+
+    // "ddmm.mmmmm" / "dddmm.mmmmm" plus hemisphere -> degrees * GPS_COORD_SCALE
+    static bool parseCoord(const char* s, const char* hemi, int32_t& out) {
+        int64_t whole = 0;
+        int n = 0;
+        for (; s[n] >= '0' && s[n] <= '9'; n++) whole = whole * 10 + (s[n] - '0');
+        if (n < 3) return false;
+        // Minutes as 1e-5 units: 5 fraction digits, padded or truncated
+        int64_t minutes = (whole % 100) * 100000;
+        if (s[n] == '.') {
+            int64_t scale = 10000;
+            for (const char* p = s + n + 1; *p >= '0' && *p <= '9' && scale > 0; p++, scale /= 10) {
+                minutes += (*p - '0') * scale;
+            }
+        }
+        int64_t v = (whole / 100) * GPS_COORD_SCALE + (minutes * (GPS_COORD_SCALE / 100000) + 30) / 60;
+        if (hemi[0] == 'S' || hemi[0] == 'W') v = -v;
+        else if (hemi[0] != 'N' && hemi[0] != 'E') return false;
+        out = (int32_t)v;
+        return true;
+    }
+
+    // "12.345" -> 12345 with frac = 3: fraction digits padded or truncated;
+    // false on an empty or malformed field
+    static bool parseDecimal(const char* s, int frac, int32_t& out) {
+        int64_t v = 0;
+        int n = 0;
+        for (; s[n] >= '0' && s[n] <= '9'; n++) v = v * 10 + (s[n] - '0');
+        const char* p = s + n;
+        if (*p == '.') p++;
+        bool any = n > 0 || (*p >= '0' && *p <= '9');
+        for (int i = 0; i < frac; i++) {
+            v *= 10;
+            if (*p >= '0' && *p <= '9') v += *p++ - '0';
+        }
+        while (*p >= '0' && *p <= '9') p++;
+        if (!any || *p != '\0' || v > INT32_MAX) return false;
+        out = (int32_t)v;
+        return true;
+    }
+
+    bool finish() {
+        // "TTSSS,f1,...,fn*hh"
+        if (len < 9 || buf[len - 3] != '*') return false;
+        int hi = hexValue(buf[len - 2]), lo = hexValue(buf[len - 1]);
+        uint8_t sum = 0;
+        for (size_t i = 0; i < len - 3; i++) sum ^= (uint8_t)buf[i];
+        if (hi < 0 || lo < 0 || sum != (uint8_t)(hi << 4 | lo)) {
+            badChecksum++;
+            return false;
+        }
+        buf[len - 3] = '\0';
+
+        const char* fields[NMEA_MAX_FIELDS];
+        size_t count = 0;
+        fields[count++] = buf;
+        for (size_t i = 0; i < len - 3 && count < NMEA_MAX_FIELDS; i++) {
+            if (buf[i] == ',') {
+                buf[i] = '\0';
+                fields[count++] = buf + i + 1;
+            }
+        }
+        parsed++;
+
+        if (strlen(fields[0]) != 5) return false;
+        const char* type = fields[0] + 2;
+        if (strcmp(type, "RMC") == 0 && count >= 10) return parseRmc(fields);
+        if (strcmp(type, "GGA") == 0 && count >= 8) return parseGga(fields);
+        return false;
+    }
+
+    // RMC: time, status, lat, N/S, lon, E/W, speed, course, date
+    bool parseRmc(const char* const* f) {
+        // Receivers report time from their RTC before they have a position
+        int32_t hh = -1, mm = -1, ss = -1, dd = -1, mo = -1, yy = -1;
+        if (strlen(f[1]) >= 6 && strlen(f[9]) == 6) {
+            hh = digits(f[1], 2);
+            mm = digits(f[1] + 2, 2);
+            ss = digits(f[1] + 4, 2);
+            dd = digits(f[9], 2);
+            mo = digits(f[9] + 2, 2);
+            yy = digits(f[9] + 4, 2);
+        }
+        if (hh >= 0 && mm >= 0 && ss >= 0 && dd > 0 && mo > 0 && yy >= 0) {
+            current.hour = (uint8_t)hh;
+            current.minute = (uint8_t)mm;
+            current.second = (uint8_t)ss;
+            current.day = (uint8_t)dd;
+            current.month = (uint8_t)mo;
+            current.year = (uint16_t)(2000 + yy);
+            current.timeValid = true;
+            current.timeMillis = hal::millis();
+        }
+        int32_t lat, lon;
+        if (f[2][0] == 'A' && parseCoord(f[3], f[4], lat) && parseCoord(f[5], f[6], lon)) {
+            setLocation(lat, lon);
+            // Knots with 3 decimals -> cm/s (1 kn = 51.4444 cm/s); some
+            // receivers leave the course empty while standing still
+            int32_t knots, course;
+            current.motionValid = parseDecimal(f[7], 3, knots);
+            if (current.motionValid) {
+                int64_t cms = ((int64_t)knots * 514444 + 5000000) / 10000000;
+                current.speed = (uint16_t)(cms > UINT16_MAX ? UINT16_MAX : cms);
+            }
+            if (parseDecimal(f[8], 2, course)) current.course = (uint16_t)(course % 36000);
+        } else if (f[2][0] == 'V') {
+            current.locationValid = false;
+            current.motionValid = false;
+        }
+        return true;
+    }
+
+    // GGA: time, lat, N/S, lon, E/W, quality, satellites
+    bool parseGga(const char* const* f) {
+        int32_t sats = digits(f[7], 2);
+        if (sats < 0) sats = digits(f[7], 1);
+        if (sats >= 0) current.satellites = (uint8_t)sats;
+        int32_t lat, lon;
+        if (f[6][0] != '0' && f[6][0] != '\0' && parseCoord(f[2], f[3], lat) && parseCoord(f[4], f[5], lon)) {
+            setLocation(lat, lon);
+        } else if (f[6][0] == '0') {
+            current.locationValid = false;
+        }
+        return true;
+    }
+
+    void setLocation(int32_t lat, int32_t lon) {
+        current.lat = lat;
+        current.lon = lon;
+        current.locationValid = true;
+        current.locationMillis = hal::millis();
+    }
+
+    char buf[NMEA_MAX_SENTENCE + 1];
+    size_t len = 0;
+    bool inSentence = false;
+    GpsFix current;
+    uint32_t parsed = 0;
+    uint32_t badChecksum = 0;
+    uint32_t overlong = 0;
+};
+
+#endif
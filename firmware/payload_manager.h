@@ -1,156 +1,199 @@
 #ifndef PAYLOAD_MANAGER_H
 #define PAYLOAD_MANAGER_H
 
-#include <Arduino.h>
-#include <DHT11.h>
-#include <Adafruit_MPU6050.h>
-#include <Adafruit_Sensor.h>
-#include <TinyGPS++.h>
+#include "hal/hal.h"
+#include "hal/hal_sensors.h"
+#include "compact_codec.h"
+#include "dht_cache.h"
 #include "encryption_manager.h"
-#include <Preferences.h>
+#include "frame_layout.h"
+#include "log_manager.h"
+#include "message_counter.h"
+#include "mpu6050_fifo.h"
+#include "nmea_parser.h"
+#include "trace_manager.h"
 #include <math.h>
 
-#define PAYLOAD_SIZE 20
+// Frame encoding: the fixed PAYLOAD_SIZE frame, or keyframes + deltas (compact_codec.h)
+enum class PayloadCodec : uint8_t { Legacy, Compact };
+
+#ifndef PAYLOAD_CODEC
+#define PAYLOAD_CODEC PayloadCodec::Legacy
+#endif
+
 class PayloadManager {
 public:
-    PayloadManager(DHT11* dht, Adafruit_MPU6050* mpu, TinyGPSPlus* gps, uint8_t* dailyKey, bool mpuAvailable)
-        : encryptor(dailyKey) {
-        this->dht = dht;
+    PayloadManager(DHT11* dht, Adafruit_MPU6050* mpu, const GpsFix* gps, uint8_t* dailyKey,
+                   MessageCounter* counter, bool mpuAvailable)
+        : encryptor(dailyKey), dht(dht) {
         this->mpu = mpu;
         this->gps = gps;
+        this->counter = counter;
         this->mpuAvailable = mpuAvailable;
-        prefs.begin("payload", false);
-        messageCounter = prefs.getUInt("counter", 0);
-        Serial.printf("\U0001F4CA Loaded Message Counter: %u\n", messageCounter);
+        counter->begin();
     }
 
-    // Generate the 2-byte IV and update the counter
-    void getIVForTransmission(uint8_t *iv2Bytes) {
-        Preferences localPrefs;
-        localPrefs.begin("payload", false);
-        messageCounter = localPrefs.getUInt("counter", messageCounter);
+    // Takes the next counter value (RAM only, see MessageCounter), writes its
+    // low 16 bits as the on-air IV and returns it whole for the counter block
+    uint32_t getIVForTransmission(uint8_t *iv2Bytes) {
+        uint32_t messageCounter = counter->next();
 
         iv2Bytes[0] = (uint8_t)(messageCounter & 0xFF);
         iv2Bytes[1] = (uint8_t)((messageCounter >> 8) & 0xFF);
 
-        messageCounter++;
-        localPrefs.putUInt("counter", messageCounter);
-        localPrefs.end();
+        LOG_DEBUG("\U0001F4CA Message Counter: %u", (unsigned)messageCounter);
+        return messageCounter;
+    }
 
-        Serial.printf("\U0001F4CA Updated Message Counter: %u\n", messageCounter);
+    // Samples the sensors and builds the frame straight into out (e.g. the
+    // radio TX buffer); see encodePayload()
+    size_t createPayload(uint8_t* out, size_t cap) {
+        TRACE_SPAN("createPayload");
+        if (cap < maxFrameSize()) return 0;
+        return encodePayload(sample(), out, cap);
     }
 
-    String createPayload() {
-        uint8_t payload[PAYLOAD_SIZE] = {0};
+    // One sample, scaled to the on-air units. Touches only the sensors and the
+    // GPS fix, never the counter or the key, so it may run on another core
+    // than encodePayload() (see sample_pipeline.h)
+    SensorReading sample() {
+        TRACE_SPAN("sample");
         int temperature = 0, humidity = 0;
-        dht->readTemperatureHumidity(temperature, humidity);
+        dht.get(temperature, humidity);
+
+        SensorReading r;
+        r.temperature = (int8_t)(temperature * TemperatureField::scale);
+        if (imuFifo) {
+            // Everything since the previous reading, from the FIFO (imu_features.h)
+            imuFifo->drain(*motion);
+            if (motion->samples() > 0) {
+                motion->take(imuFifo->scale(), r);
+            } else {
+                r.accel = r.accelRms = r.jerk = 0;
+                r.gyro[0] = r.gyro[1] = r.gyro[2] = 0;
+            }
+        } else {
+            sensors_event_t a, g, tempEvent;
+            if (mpuAvailable) {
+                mpu->getEvent(&a, &g, &tempEvent);
+            } else {
+                memset(&a, 0, sizeof(a));
+                memset(&g, 0, sizeof(g));
+                tempEvent.temperature = 0;
+            }
+
+            // A single instant: peak and RMS are the same, no jerk
+            float accel_magnitude = sqrt(a.acceleration.x * a.acceleration.x +
+                                         a.acceleration.y * a.acceleration.y +
+                                         a.acceleration.z * a.acceleration.z);
+            r.gyro[0] = imu::saturate8(lround(g.gyro.x * GyroField::scale));
+            r.gyro[1] = imu::saturate8(lround(g.gyro.y * GyroField::scale));
+            r.gyro[2] = imu::saturate8(lround(g.gyro.z * GyroField::scale));
+            r.accel = imu::saturate16((uint64_t)lround(accel_magnitude * AccelField::scale));
+            r.accelRms = r.accel;
+            r.jerk = 0;
+        }
+        // The parser already works in the on-air fixed point
+        static_assert(GPS_COORD_SCALE == GpsField::scale, "GPS scale mismatch");
+        r.lat = gps->locationValid ? gps->lat : 0;
+        r.lon = gps->locationValid ? gps->lon : 0;
+
+        // Sensor values include the GPS fix that is about to be encrypted: trace only
+        LOG_TRACE("\U0001F321 Temperature: %d\u00B0C, \U0001F4A7 Humidity: %d%%", temperature, humidity);
+        LOG_TRACE("\U0001F300 Gyro X: %d, Y: %d, Z: %d (rad/s x10)", r.gyro[0], r.gyro[1], r.gyro[2]);
+        LOG_TRACE("\U0001F50B Accel peak: %u, RMS: %u, jerk: %u", (unsigned)r.accel, (unsigned)r.accelRms,
+                  (unsigned)r.jerk);
+        LOG_TRACE("\U0001F4CD Latitude: %ld", (long)r.lat);
+        LOG_TRACE("\U0001F4CD Longitude: %ld", (long)r.lon);
+        return r;
+    }
+
+    // Builds the frame for r straight into out and returns its length, or 0 if
+    // out cannot hold the largest frame of the codec. Nothing on this path
+    // touches the heap. Layouts: see frame_layout.h and compact_codec.h
+    size_t encodePayload(const SensorReading& r, uint8_t* out, size_t cap) {
+        TRACE_SPAN("encodePayload");
+        if (cap < maxFrameSize()) return 0;
 
+        // Only the low 2 bytes of the counter go on air
+        uint32_t messageCounter = getIVForTransmission(out);
 
-        sensors_event_t a, g, tempEvent;
-        if (mpuAvailable) {
-            mpu->getEvent(&a, &g, &tempEvent);
+        size_t index, encOffset = 0;
+        if (codec == PayloadCodec::Compact) {
+            index = compactEncoder.encode(r, messageCounter, out, cap, encOffset);
         } else {
-            memset(&a, 0, sizeof(a));
-            memset(&g, 0, sizeof(g));
-            tempEvent.temperature = 0;
+            // Markers, lengths and values at fixed offsets (TelemetryFrame)
+            TelemetryFrame::write(r, out);
+            index = PAYLOAD_SIZE;
+            encOffset = FRAME_ENCRYPTED_OFFSET;
         }
 
-        float accel_magnitude = sqrt(a.acceleration.x * a.acceleration.x +
-                                     a.acceleration.y * a.acceleration.y +
-                                     a.acceleration.z * a.acceleration.z);
-
-        double lat = gps->location.isValid() ? gps->location.lat() : 0.0;
-        double lon = gps->location.isValid() ? gps->location.lng() : 0.0;
-
-        int32_t lat_scaled = (int32_t)(lat * 1e7);
-        int32_t lon_scaled = (int32_t)(lon * 1e7);
-
-        Serial.printf("\n\U0001F321 Temperature: %d\u00B0C\n", temperature);
-        Serial.printf("\U0001F4A7 Humidity: %d%%\n", humidity);
-        Serial.printf("\U0001F300 Gyro X: %.2f, Y: %.2f, Z: %.2f\n", g.gyro.x, g.gyro.y, g.gyro.z);
-        Serial.printf("\U0001F50B Accelerometer Magnitude: %.2f\n", accel_magnitude);
-        Serial.printf("\U0001F4CD Latitude: %.7f -> %ld\n", lat, lat_scaled);
-        Serial.printf("\U0001F4CD Longitude: %.7f -> %ld\n", lon, lon_scaled);
-
-        int index = 0;
-        uint8_t iv2Bytes[2];
-        getIVForTransmission(iv2Bytes);
-
-        // Store only 2-byte IV in payload
-        memcpy(payload + index, iv2Bytes, 2);
-        index += 2;
-
-        // Clear sensor block
-        payload[index++] = 6;            // Block length
-        payload[index++] = 0x01;         // Temp marker
-        payload[index++] = (uint8_t)temperature;
-        payload[index++] = 0x03;         // Gyro marker
-        payload[index++] = (int8_t)round(g.gyro.x * 100);
-        payload[index++] = (int8_t)round(g.gyro.y * 100);
-        payload[index++] = (int8_t)round(g.gyro.z * 100);
-
-        // Encrypted block preparation
-        uint8_t encryptedBlock[11] = {0};
-        int encIdx = 0;
-        encryptedBlock[encIdx++] = 11;  // Block length
-        encryptedBlock[encIdx++] = 0x04;  // Accelerometer marker
-        encryptedBlock[encIdx++] = (uint8_t)round(accel_magnitude);
-        encryptedBlock[encIdx++] = 0x05;  // GPS marker
-        memcpy(encryptedBlock + encIdx, &lat_scaled, 4);
-        encIdx += 4;
-        memcpy(encryptedBlock + encIdx, &lon_scaled, 4);
-
-        // Prepare full 16-byte IV for encryption
-        uint8_t effectiveIV[16] = {0};
-        effectiveIV[0] = iv2Bytes[0];
-        effectiveIV[1] = iv2Bytes[1];
-
-        // Encrypt the block
-        encryptor.encryptAESCTR(encryptedBlock, 11, effectiveIV);
-
-        // Append encrypted block to payload
-        memcpy(payload + index, encryptedBlock, 11);
-        index += 11;
-
-
-
-        // Final log
-        Serial.print("\U0001F539 Final Encrypted Payload: ");
-        for (int i = 0; i < PAYLOAD_SIZE; i++) {
-            Serial.printf("%02X ", payload[i]);
-        }
-        Serial.println();
-
-        // Convert payload to HEX string
-        String payloadHexStr = "";
-        for (int i = 0; i < PAYLOAD_SIZE; i++) {
-            char buf[3];
-            sprintf(buf, "%02X", payload[i]);
-            payloadHexStr += buf;
-            if (i < PAYLOAD_SIZE - 1) payloadHexStr += " ";
-        }
-        return payloadHexStr;
+        // The counter block carries the whole counter (frame_layout.h)
+        uint8_t effectiveIV[16];
+        frameCounterBlock(messageCounter, effectiveIV);
+
+        encryptor.encryptAESCTR(out + encOffset, index - encOffset, effectiveIV);
+
+        LOG_HEX(LogLevel::Debug, "\U0001F539 Final Encrypted Payload: ", out, index);
+        return index;
+    }
+
+    // Wraps one crash-window record (| event | chunk | chunks | body |, see
+    // crash_recorder.h) in an event frame; the body is encrypted like the
+    // GPS block. Returns the frame length, 0 if out is too small.
+    size_t encodeEvent(const uint8_t* record, size_t len, uint8_t* out, size_t cap) {
+        if (len < EVENT_CLEAR_LEN || cap < FRAME_IV_LEN + 1 + len) return 0;
+        uint32_t messageCounter = getIVForTransmission(out);
+        out[FRAME_FORMAT_OFFSET] = EVENT_FORMAT;
+        memcpy(out + FRAME_FORMAT_OFFSET + 1, record, len);
+
+        uint8_t effectiveIV[16];
+        frameCounterBlock(messageCounter, effectiveIV);
+        encryptor.encryptAESCTR(out + EVENT_HEADER_LEN, len - EVENT_CLEAR_LEN, effectiveIV);
+        return FRAME_IV_LEN + 1 + len;
+    }
+
+    // Refreshes the cached DHT11 reading; run from a low-priority task so
+    // createPayload() does not wait on the sensor (see dht_cache.h)
+    bool sampleEnvironment() { return dht.refresh(); }
+
+    const DhtCache& environment() const { return dht; }
+    const EncryptionManager& encryption() const { return encryptor; }
+
+    // Takes the motion fields from the IMU FIFO window instead of one
+    // Adafruit_MPU6050 reading per frame; the owner keeps draining imu into
+    // window between frames (mpu6050_fifo.h)
+    void setMotionSource(Mpu6050Fifo* imu, ImuWindow* window) {
+        imuFifo = window ? imu : nullptr;
+        motion = window;
+    }
+
+    // Largest frame the current codec writes
+    size_t maxFrameSize() const {
+        return codec == PayloadCodec::Compact ? (size_t)COMPACT_KEYFRAME_SIZE : (size_t)PAYLOAD_SIZE;
     }
 
-    void sendPayload(String payload) {
-        Serial.println("\U0001F4E1 Sending Payload...");
-        Serial.println("\U0001F4E6 Payload: " + payload);
+    void setCodec(PayloadCodec c) {
+        codec = c;
+        compactEncoder.reset();
     }
 
     void resetMessageCounter() {
-        messageCounter = 0;
-        prefs.putUInt("counter", messageCounter);
-        Serial.println("\U0001F4CA Message Counter reset to 0");
+        counter->reset();
+        compactEncoder.reset();
     }
 
 private:
-    DHT11* dht;
     Adafruit_MPU6050* mpu;
-    TinyGPSPlus* gps;
+    Mpu6050Fifo* imuFifo = nullptr;
+    ImuWindow* motion = nullptr;
+    const GpsFix* gps;
     EncryptionManager encryptor;
-    Preferences prefs;
-    uint32_t messageCounter;
+    DhtCache dht;
+    MessageCounter* counter;
     bool mpuAvailable;
+    PayloadCodec codec = PAYLOAD_CODEC;
+    CompactEncoder compactEncoder;
 };
 
 #endif
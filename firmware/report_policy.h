@@ -0,0 +1,301 @@
+// report_policy.h - Motion-adaptive sampling and report-by-exception
+//
+// Instead of a frame every 30 s whatever the vehicle does, the sampling stage
+// evaluates a reading every evalIntervalMs() and ReportPolicy decides whether
+// it goes on air:
+//
+//   stationary  GPS speed below stillSpeed (or no GPS) and a quiet IMU for
+//               stillMs: evaluated every stationaryEvalMs, reported as a
+//               heartbeat every heartbeatMs
+//   moving      evaluated every movingEvalMs, reported at least every
+//               movingIntervalMs
+//
+// Between those, a reading that leaves a deadband around the last one
+// reported goes out at once (an exception): position, heading (only above
+// headingMinSpeed, where the GPS course means something) and temperature;
+// so does a peak |a| more than accel above the RMS of the last few readings
+// (a pothole, a kerb, a crash, on a road of any roughness), the start of
+// motion and the stop. Exceptions spend a token of a small bucket (burst,
+// one back every refillMs), so a noisy channel cannot flood the duty cycle;
+// one that finds the bucket empty is held and goes out with the next reading
+// that has a token. Heartbeats and periodic reports need no token.
+//
+// The IMU is quiet when, over the last REPORT_STILL_READINGS readings, the
+// RMS of |a| varies less than stillAccelVar, and every window's peak stays
+// within stillAccelSpread of its RMS with no gyro rate above stillGyro. The
+// single-reading path (no FIFO) has peak = RMS, so it relies on the variance.
+//
+// Skipped readings are not lost: their motion is folded into report() (peaks
+// and gyro extremes kept, RMS over the merged windows), so a frame still
+// describes everything since the previous frame and a pothole between two
+// heartbeats shows up in the next one. Readings that are not reported never
+// reach the transmit stage and take no message counter value.
+//
+// Everything runs on the sampling stage. Costs one reading's worth of state.
+#ifndef REPORT_POLICY_H
+#define REPORT_POLICY_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "frame_layout.h"
+#include "log_manager.h"
+#include "nmea_parser.h"
+
+// Readings the IMU variance is taken over
+#define REPORT_STILL_READINGS 4
+// A GPS speed older than this is not trusted
+#define REPORT_GPS_MAX_AGE_MS 5000
+
+enum class ReportReason : uint8_t {
+    None,          // not reported
+    Heartbeat,     // stationary, heartbeatMs since the last report
+    Periodic,      // moving, movingIntervalMs since the last report
+    Stopped,       // just became stationary: where it parked
+    MotionStart,   // was stationary, moves now
+    Position,      // deadbands
+    Heading,
+    Temperature,
+    Acceleration,
+    Count
+};
+
+inline const char* reportReasonName(ReportReason r) {
+    static const char* const names[] = {"none",      "heartbeat", "periodic",    "stopped",     "motion",
+                                        "position",  "heading",   "temperature", "acceleration"};
+    return (size_t)r < (size_t)ReportReason::Count ? names[(size_t)r] : "?";
+}
+
+// Exceptions skip the uplink batching and go on air as soon as the duty
+// cycle allows (LoRaWAN_send(..., urgent))
+inline bool reportUrgent(ReportReason r) { return r >= ReportReason::Stopped && r < ReportReason::Count; }
+
+struct ReportPolicyConfig {
+    uint32_t movingEvalMs = 5000;
+    uint32_t stationaryEvalMs = 30000;
+    uint32_t movingIntervalMs = 60000;
+    uint32_t heartbeatMs = 900000;
+    // Stationary detection
+    uint16_t stillSpeed = 100;       // cm/s
+    uint32_t stillMs = 120000;
+    uint32_t stillAccelVar = 400;    // (m/s^2 * 100)^2: 0.2 m/s^2 standard deviation
+    uint16_t stillAccelSpread = 50;  // m/s^2 * 100, window peak over RMS
+    uint8_t stillGyro = 1;           // rad/s * 10
+    // Deadbands around the last reading reported
+    uint32_t positionM = 250;
+    uint16_t headingCdeg = 3000;     // degrees * 100
+    uint16_t headingMinSpeed = 300;  // cm/s
+    uint8_t temperatureC = 2;
+    uint16_t accel = 300;            // m/s^2 * 100, peak |a| over the recent RMS
+    // Exception rate limit
+    uint8_t burst = 3;
+    uint32_t refillMs = 20000;
+};
+
+class ReportPolicy {
+public:
+    explicit ReportPolicy(const ReportPolicyConfig& config = ReportPolicyConfig()) : cfg(config) {}
+
+    // Judges the reading taken at nowMs with the GPS fix it came from. Not
+    // None: send report(), which also carries the motion of the readings
+    // skipped since the last report.
+    ReportReason evaluate(const SensorReading& r, const GpsFix& fix, uint32_t nowMs) {
+        merge(r);
+        evaluated++;
+        if (!started) {
+            started = true;
+            lastRefill = nowMs;
+            tokens = cfg.burst;
+            return commit(ReportReason::Periodic, r, fix, nowMs);
+        }
+        refill(nowMs);
+
+        // The typical |a| before this reading, for the acceleration deadband
+        const int32_t accelLevel = historyPos >= REPORT_STILL_READINGS ? (int32_t)rmsMean() : -1;
+        const bool gpsFresh = fix.locationValid && fix.motionValid && nowMs - fix.locationMillis <= REPORT_GPS_MAX_AGE_MS;
+        ReportReason exception = ReportReason::None;
+        if (observeStillness(r, gpsFresh, fix.speed, nowMs)) {
+            if (moving && nowMs - stillSince >= cfg.stillMs) {
+                moving = false;
+                exception = ReportReason::Stopped;
+            }
+        } else if (!moving) {
+            moving = true;
+            exception = ReportReason::MotionStart;
+        }
+        if (exception == ReportReason::None) exception = deadband(r, fix, gpsFresh, accelLevel);
+
+        if (exception == ReportReason::None && held != ReportReason::None) exception = held;
+        if (exception != ReportReason::None) {
+            if (tokens > 0) {
+                tokens--;
+                held = ReportReason::None;
+                return commit(exception, r, fix, nowMs);
+            }
+            if (held == ReportReason::None) {
+                held = exception;
+                rateLimited++;
+            }
+        }
+        if (nowMs - lastReportMs >= (moving ? cfg.movingIntervalMs : cfg.heartbeatMs)) {
+            // A held exception rides along and is counted as what it was
+            ReportReason reason = held != ReportReason::None ? held : moving ? ReportReason::Periodic
+                                                                            : ReportReason::Heartbeat;
+            held = ReportReason::None;
+            return commit(reason, r, fix, nowMs);
+        }
+        suppressed++;
+        return ReportReason::None;
+    }
+
+    // The reading to send after evaluate() returned a reason
+    const SensorReading& report() const { return sent; }
+
+    // When the sampling stage should take the next reading
+    uint32_t evalIntervalMs() const { return moving ? cfg.movingEvalMs : cfg.stationaryEvalMs; }
+    bool isMoving() const { return moving; }
+    const ReportPolicyConfig& config() const { return cfg; }
+
+    uint32_t readingsEvaluated() const { return evaluated; }
+    uint32_t readingsSuppressed() const { return suppressed; }
+    // Exceptions the bucket held back
+    uint32_t exceptionsRateLimited() const { return rateLimited; }
+    uint32_t reports(ReportReason r) const { return (size_t)r < (size_t)ReportReason::Count ? byReason[(size_t)r] : 0; }
+
+    void logStats() const {
+        LOG_DEBUG("📉 report: %s, %u evaluated, %u suppressed, %u rate-limited; hb %u, periodic %u, stop %u, "
+                  "start %u, pos %u, heading %u, temp %u, accel %u",
+                  moving ? "moving" : "stationary", (unsigned)evaluated, (unsigned)suppressed, (unsigned)rateLimited,
+                  (unsigned)reports(ReportReason::Heartbeat), (unsigned)reports(ReportReason::Periodic),
+                  (unsigned)reports(ReportReason::Stopped), (unsigned)reports(ReportReason::MotionStart),
+                  (unsigned)reports(ReportReason::Position), (unsigned)reports(ReportReason::Heading),
+                  (unsigned)reports(ReportReason::Temperature), (unsigned)reports(ReportReason::Acceleration));
+    }
+
+private:
+    // Folds r into the pending report: latest position and temperature,
+    // the worst motion since the last report
+    void merge(const SensorReading& r) {
+        if (mergedCount == 0) {
+            pending = r;
+            rmsSqSum = (uint64_t)r.accelRms * r.accelRms;
+            mergedCount = 1;
+            return;
+        }
+        pending.temperature = r.temperature;
+        pending.lat = r.lat;
+        pending.lon = r.lon;
+        if (r.accel > pending.accel) pending.accel = r.accel;
+        if (r.jerk > pending.jerk) pending.jerk = r.jerk;
+        for (int i = 0; i < 3; i++) {
+            if (abs(r.gyro[i]) > abs(pending.gyro[i])) pending.gyro[i] = r.gyro[i];
+        }
+        rmsSqSum += (uint64_t)r.accelRms * r.accelRms;
+        mergedCount++;
+        pending.accelRms = (uint16_t)lroundf(sqrtf((float)(rmsSqSum / mergedCount)));
+    }
+
+    void refill(uint32_t nowMs) {
+        if (cfg.refillMs == 0) {
+            tokens = cfg.burst;
+            return;
+        }
+        uint32_t gained = (nowMs - lastRefill) / cfg.refillMs;
+        if (gained == 0) return;
+        lastRefill += gained * cfg.refillMs;
+        tokens = tokens + gained >= cfg.burst ? cfg.burst : (uint8_t)(tokens + gained);
+    }
+
+    // True while the vehicle looks parked; tracks since when
+    bool observeStillness(const SensorReading& r, bool gpsFresh, uint16_t speed, uint32_t nowMs) {
+        rmsHistory[historyPos++ % REPORT_STILL_READINGS] = r.accelRms;
+        bool quiet = historyPos >= REPORT_STILL_READINGS && accelVariance() < cfg.stillAccelVar &&
+                     r.accel <= r.accelRms + cfg.stillAccelSpread;
+        for (int i = 0; i < 3; i++) quiet = quiet && abs(r.gyro[i]) <= cfg.stillGyro;
+        bool still = quiet && (!gpsFresh || speed < cfg.stillSpeed);
+        if (!still) {
+            stillValid = false;
+            return false;
+        }
+        if (!stillValid) {
+            stillValid = true;
+            stillSince = nowMs;
+        }
+        return true;
+    }
+
+    uint32_t rmsMean() const {
+        uint32_t sum = 0;
+        for (uint16_t v : rmsHistory) sum += v;
+        return sum / REPORT_STILL_READINGS;
+    }
+
+    uint32_t accelVariance() const {
+        int64_t sum = 0, sumSq = 0;
+        for (uint16_t v : rmsHistory) {
+            sum += v;
+            sumSq += (int64_t)v * v;
+        }
+        return (uint32_t)((sumSq * REPORT_STILL_READINGS - sum * sum) / (REPORT_STILL_READINGS * REPORT_STILL_READINGS));
+    }
+
+    ReportReason deadband(const SensorReading& r, const GpsFix& fix, bool gpsFresh, int32_t accelLevel) const {
+        if (fix.locationValid && refHasLocation) {
+            // Equirectangular: plenty at deadband distances
+            const float mPerUnit = 111319.5f / GPS_COORD_SCALE;
+            float dy = (float)(r.lat - refLat) * mPerUnit;
+            float dx = (float)(r.lon - refLon) * mPerUnit * cosf((float)r.lat / GPS_COORD_SCALE * 0.01745329f);
+            if (dx * dx + dy * dy > (float)cfg.positionM * cfg.positionM) return ReportReason::Position;
+        }
+        if (moving && gpsFresh && fix.speed >= cfg.headingMinSpeed && refCourseValid) {
+            uint32_t d = fix.course > refCourse ? fix.course - refCourse : refCourse - fix.course;
+            if (d > 18000) d = 36000 - d;
+            if (d > cfg.headingCdeg) return ReportReason::Heading;
+        }
+        if (abs(r.temperature - refTemperature) >= cfg.temperatureC) return ReportReason::Temperature;
+        if (accelLevel >= 0 && (int32_t)r.accel > accelLevel + cfg.accel) return ReportReason::Acceleration;
+        return ReportReason::None;
+    }
+
+    ReportReason commit(ReportReason reason, const SensorReading& r, const GpsFix& fix, uint32_t nowMs) {
+        sent = pending;
+        refLat = r.lat;
+        refLon = r.lon;
+        refHasLocation = fix.locationValid;
+        refTemperature = r.temperature;
+        refCourseValid = fix.motionValid && fix.speed >= cfg.headingMinSpeed;
+        refCourse = fix.course;
+        lastReportMs = nowMs;
+        mergedCount = 0;
+        byReason[(size_t)reason]++;
+        return reason;
+    }
+
+    ReportPolicyConfig cfg;
+    bool started = false;
+    bool moving = true;
+    SensorReading pending = {};
+    SensorReading sent = {};
+    uint64_t rmsSqSum = 0;
+    uint32_t mergedCount = 0;
+    // What the deadbands are around: the reading last reported
+    int32_t refLat = 0, refLon = 0;
+    bool refHasLocation = false;
+    int8_t refTemperature = 0;
+    bool refCourseValid = false;
+    uint16_t refCourse = 0;
+    uint32_t lastReportMs = 0;
+    uint16_t rmsHistory[REPORT_STILL_READINGS] = {};
+    uint32_t historyPos = 0;
+    bool stillValid = false;
+    uint32_t stillSince = 0;
+    uint8_t tokens = 0;
+    uint32_t lastRefill = 0;
+    ReportReason held = ReportReason::None;
+    uint32_t evaluated = 0;
+    uint32_t suppressed = 0;
+    uint32_t rateLimited = 0;
+    uint32_t byReason[(size_t)ReportReason::Count] = {};
+};
+
+#endif
@@ -0,0 +1,112 @@
+// sample_pipeline.h - Hand-off from the sampling stage to the transmit stage
+//
+// On the board two stages run concurrently on the two cores. The sampling
+// stage is the scheduler on the Arduino loop task (core 1): GPS, DHT11, IMU.
+// The transmit stage is a task pinned to core 0: counter, encoding,
+// EncryptionManager, LoRaWAN with its seconds-long RX windows. Readings cross
+// over in a fixed lock-free SpscRing of SampleRecords, so a blocking
+// sendReceive never stalls GPS ingestion or sampling and neither side takes a
+// lock. If the transmit stage falls PIPELINE_DEPTH readings behind, new
+// readings are dropped and counted rather than blocking the sampler.
+//
+// Each stage owns its state: sampling touches only the sensors and the GPS fix
+// (PayloadManager::sample()), transmitting only the counter, the daily key and
+// the radio (PayloadManager::encodePayload(), lora_manager.h). The GPS time
+// travels in the record so the key rollover happens on the transmit side.
+//
+// Light sleep stops both cores, so it must never start while the transmit
+// stage is inside sendReceive() or an RX window. The stages do a Dekker
+// handshake on two seq_cst flags. The transmit stage raises `transmitting`
+// and then looks at `sleeping`. The sampler raises `sleeping` and then
+// looks at `transmitting`. At least one side sees the other's flag, so
+// the sampler either stays awake or the transmit stage waits until the
+// sleep is over.
+#ifndef SAMPLE_PIPELINE_H
+#define SAMPLE_PIPELINE_H
+
+#include <atomic>
+#include "frame_layout.h"
+#include "hal/hal.h"
+#include "log_manager.h"
+#include "spsc_ring.h"
+
+// Readings the transmit stage may fall behind by (power of two); at one reading
+// per 30 s this rides out 4 minutes of retries
+#define PIPELINE_DEPTH 8
+
+struct SampleRecord {
+    SensorReading reading;
+    uint32_t epoch;      // GPS UTC seconds at sampling, 0 without a valid time
+    uint32_t sampledAt;  // hal::millis()
+    bool urgent;         // an exception (report_policy.h): not held back for a batch
+};
+
+class SamplePipeline {
+public:
+    // Sampling stage: false if the transmit stage is PIPELINE_DEPTH behind
+    bool submit(const SampleRecord& rec) {
+        if (!queue.push(rec)) return false;
+        uint32_t depth = (uint32_t)queue.size();
+        if (depth > highWater.load(std::memory_order_relaxed)) highWater.store(depth, std::memory_order_relaxed);
+        submittedCount.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Transmit stage: hands up to max queued records to sink, oldest first
+    template <typename Sink>
+    size_t drain(Sink&& sink, size_t max = PIPELINE_DEPTH) {
+        SampleRecord rec;
+        size_t n = 0;
+        while (n < max && queue.pop(rec)) {
+            sink(rec);
+            n++;
+        }
+        transmittedCount.fetch_add((uint32_t)n, std::memory_order_relaxed);
+        return n;
+    }
+
+    // Transmit stage, around its work (begin before draining): once
+    // beginTransmit() returns, the sampler will not light-sleep until
+    // endTransmit()
+    void beginTransmit() {
+        transmitting.store(true, std::memory_order_seq_cst);
+        // The sampler is entering light sleep: this core stops with it until it ends
+        while (sleeping.load(std::memory_order_seq_cst)) hal::yieldTick();
+    }
+    void endTransmit() { transmitting.store(false, std::memory_order_seq_cst); }
+
+    // Sampling stage, right before light sleep: false (stay awake) if the
+    // transmit stage is busy or has records queued. leaveSleep() after waking.
+    bool enterSleep() {
+        sleeping.store(true, std::memory_order_seq_cst);
+        if (!pending()) return true;
+        sleeping.store(false, std::memory_order_seq_cst);
+        return false;
+    }
+    void leaveSleep() { sleeping.store(false, std::memory_order_seq_cst); }
+
+    // Either side: records queued or being transmitted
+    bool pending() const { return transmitting.load(std::memory_order_seq_cst) || queue.size() > 0; }
+
+    uint32_t submitted() const { return submittedCount.load(std::memory_order_relaxed); }
+    uint32_t transmitted() const { return transmittedCount.load(std::memory_order_relaxed); }
+    uint32_t dropped() const { return queue.dropped(); }
+    uint32_t depth() const { return (uint32_t)queue.size(); }
+    uint32_t maxDepth() const { return highWater.load(std::memory_order_relaxed); }
+
+    void logStats() const {
+        LOG_DEBUG("🔀 pipeline: %u sampled, %u sent, %u dropped, depth %u (max %u of %u)", (unsigned)submitted(),
+                  (unsigned)transmitted(), (unsigned)dropped(), (unsigned)depth(), (unsigned)maxDepth(),
+                  (unsigned)PIPELINE_DEPTH);
+    }
+
+private:
+    SpscRing<SampleRecord, PIPELINE_DEPTH> queue;
+    std::atomic<uint32_t> submittedCount{0};
+    std::atomic<uint32_t> transmittedCount{0};
+    std::atomic<uint32_t> highWater{0};
+    std::atomic<bool> transmitting{false};
+    std::atomic<bool> sleeping{false};
+};
+
+#endif
@@ -0,0 +1,3 @@
+// Adafruit_MPU6050.h - Host stand-in: the Adafruit_MPU6050 double (sensors_host.h)
+#pragma once
+#include "hal/hal_sensors.h"
@@ -0,0 +1,3 @@
+// Wire.h - Host stand-in: the TwoWire double and the global Wire (sensors_host.h)
+#pragma once
+#include "hal/hal_sensors.h"
@@ -0,0 +1,8 @@
+// driver/uart.h - Host stand-in: UART wakeup configuration is accepted and ignored
+#pragma once
+#include <cstdint>
+
+typedef enum { UART_NUM_0, UART_NUM_1, UART_NUM_2 } uart_port_t;
+
+inline int uart_set_wakeup_threshold(uart_port_t, int) { return 0; }
+inline int esp_sleep_enable_uart_wakeup(int) { return 0; }
@@ -0,0 +1,97 @@
+// bbairtime - Goodput of the transmit scheduler against the fixed DR3 rules
+//
+//   bbairtime [-m mix] [-c good|edge] [-g duration] [-S seed] [-r datarate]
+//
+// Replays each traffic mix (tx_replay.h; -m picks one of periodic, policy,
+// events, outage, dense) through the fixed rules at DR3 (-r) and through
+// TxScheduler over the same channel, and prints delivered readings per
+// hour, time on air, the busiest hour against the 1 % allowance, the data
+// rates used and the delays of readings and event frames side by side.
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include "scenario.h"
+#include "tx_replay.h"
+
+namespace {
+
+void usage() { fprintf(stderr, "usage: bbairtime [-m mix] [-c good|edge] [-g duration] [-S seed] [-r datarate]\n"); }
+
+void printRow(const char* name, const TxReplayResult& r, double hours) {
+    char drs[64];
+    int at = 0;
+    for (uint8_t dr = 0; dr < TX_DATARATES; dr++) {
+        if (r.uplinksAt[dr] > 0) at += snprintf(drs + at, sizeof(drs) - at, "%sDR%u:%u", at ? "," : "", (unsigned)dr,
+                                                (unsigned)r.uplinksAt[dr]);
+    }
+    printf("%-9s %-9s %7llu %7llu %8.1f %7llu %8.1f %7.1f %5u/%-5u %-22s %7.1f %4u/%-4u %7.1f %7.1f %6llu\n",
+           "", name, (unsigned long long)r.readings, (unsigned long long)r.delivered, r.delivered / hours,
+           (unsigned long long)r.uplinks, r.airtimeMs / 1000.0 / hours, r.maxHourAirtimeMs / 1000.0,
+           (unsigned)r.byClass[(size_t)TxClass::Periodic], (unsigned)r.byClass[(size_t)TxClass::Backlog],
+           at ? drs : "-", r.readingDelayMeanS, (unsigned)r.eventsDelivered, (unsigned)r.eventFrames,
+           r.eventDelayMeanS, r.eventDelayMaxS, (unsigned long long)r.backlog);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    TxReplayOptions options;
+    bool allMixes = true;
+    uint64_t durationMs = 86400000;
+    std::string channel = "good";
+    int opt;
+    while ((opt = getopt(argc, argv, "m:c:g:S:r:h")) != -1) {
+        switch (opt) {
+            case 'm':
+                if (!parseTrafficMix(optarg, options.traffic)) {
+                    usage();
+                    return 2;
+                }
+                allMixes = false;
+                break;
+            case 'c': channel = optarg; break;
+            case 'g':
+                if (!parseDurationMs(optarg, durationMs) || durationMs < 60000) {
+                    usage();
+                    return 2;
+                }
+                break;
+            case 'S': options.seed = strtoull(optarg, nullptr, 10); break;
+            case 'r': options.fixedDatarate = (uint8_t)atoi(optarg); break;
+            default: usage(); return 2;
+        }
+    }
+    if (channel == "good") {
+        options.channel = goodChannel();
+    } else if (channel == "edge") {
+        options.channel = edgeChannel();
+    } else {
+        usage();
+        return 2;
+    }
+    if (options.fixedDatarate >= TX_DATARATES) {
+        usage();
+        return 2;
+    }
+    options.durationS = (uint32_t)(durationMs / 1000);
+    const double hours = options.durationS / 3600.0;
+
+    printf("%.1f h, %s channel, fixed DR%u, allowance %.1f s/h\n", hours, channel.c_str(),
+           (unsigned)options.fixedDatarate, DutyCycleBudget::allowanceMs(options.config.band) / 1000.0);
+    printf("%-9s %-9s %7s %7s %8s %7s %8s %7s %11s %-22s %7s %9s %7s %7s %6s\n", "mix", "sender", "readings",
+           "deliv", "deliv/h", "uplinks", "air s/h", "max s/h", "per/backlog", "datarates", "rd_avg", "events",
+           "ev_avg", "ev_max", "left");
+    for (size_t m = 0; m < (size_t)TrafficMix::Count; m++) {
+        if (!allMixes && (TrafficMix)m != options.traffic) continue;
+        options.traffic = (TrafficMix)m;
+        options.scheduler = false;
+        TxReplayResult fixed = replayTraffic(options);
+        options.scheduler = true;
+        TxReplayResult sched = replayTraffic(options);
+        printf("%s\n", trafficMixName(options.traffic));
+        printRow("fixed", fixed, hours);
+        printRow("scheduler", sched, hours);
+    }
+    return 0;
+}
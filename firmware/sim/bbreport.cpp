@@ -0,0 +1,103 @@
+// bbreport - What report-by-exception saves in airtime and costs in fidelity
+//
+//   bbreport [-g duration] [-S seed] [-w trace.csv] [-i intervalS] [-r datarate]
+//            [-p positionM] [-e eventAccel] [trace.csv]
+//
+// Replays a drive trace (report_replay.h) twice: with the sketch's
+// ReportPolicy and with a reading every intervalS (30 by default, what the
+// firmware sent before), and prints uplinks, time on air and the fidelity of
+// each side by side. Without a trace file it synthesises one (-g, a day by
+// default; -S picks the vehicle); -w writes the trace it used.
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include "report_replay.h"
+#include "scenario.h"
+
+namespace {
+
+void usage() {
+    fprintf(stderr,
+            "usage: bbreport [-g duration] [-S seed] [-w trace.csv] [-i intervalS] [-r datarate] [-p positionM] "
+            "[-e eventAccel] [trace.csv]\n");
+}
+
+void printRow(const char* name, const ReplayResult& r, double hours) {
+    printf("%-10s %8llu %8llu %9.1f %7.2f %8.1f %8.1f %7.2f %5d %4u/%-4u %7.1f %7.1f\n", name,
+           (unsigned long long)r.readings, (unsigned long long)r.uplinks, r.airtimeMs / 1000.0,
+           hours > 0 ? r.airtimeMs / 1000.0 / hours : 0.0, r.positionRmsM, r.positionMaxM, r.temperatureMeanErr,
+           r.temperatureMaxErr, (unsigned)r.eventsSeen, (unsigned)r.events, r.eventDelayMeanS, r.eventDelayMaxS);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    uint64_t durationMs = 86400000, seed = 1;
+    std::string tracePath, writePath;
+    ReplayOptions adaptive, fixed;
+    fixed.adaptive = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "g:S:w:i:r:p:e:h")) != -1) {
+        switch (opt) {
+            case 'g':
+                if (!parseDurationMs(optarg, durationMs) || durationMs < 1000) {
+                    usage();
+                    return 2;
+                }
+                break;
+            case 'S': seed = strtoull(optarg, nullptr, 10); break;
+            case 'w': writePath = optarg; break;
+            case 'i': fixed.fixedIntervalMs = (uint32_t)(atof(optarg) * 1000); break;
+            case 'r': adaptive.datarate = fixed.datarate = (uint8_t)atoi(optarg); break;
+            case 'p': adaptive.policy.positionM = (uint32_t)atoi(optarg); break;
+            case 'e': adaptive.eventAccel = fixed.eventAccel = (uint16_t)(atof(optarg) * 100); break;
+            default: usage(); return 2;
+        }
+    }
+    if (optind < argc) tracePath = argv[optind];
+    if (fixed.fixedIntervalMs == 0 || adaptive.datarate > 5) {
+        usage();
+        return 2;
+    }
+
+    std::vector<TracePoint> trace;
+    if (tracePath.empty()) {
+        trace = synthesizeDriveTrace(seed, (uint32_t)(durationMs / 1000));
+    } else {
+        std::string error;
+        if (!loadDriveTrace(tracePath, trace, error)) {
+            fprintf(stderr, "bbreport: %s\n", error.c_str());
+            return 1;
+        }
+    }
+    if (!writePath.empty() && !saveDriveTrace(writePath, trace)) {
+        fprintf(stderr, "bbreport: cannot write %s\n", writePath.c_str());
+        return 1;
+    }
+    if (trace.empty()) {
+        fprintf(stderr, "bbreport: empty trace\n");
+        return 1;
+    }
+
+    ReplayResult a = replayDriveTrace(trace, adaptive);
+    ReplayResult f = replayDriveTrace(trace, fixed);
+    double hours = (trace.back().tMs - trace.front().tMs) / 3600000.0;
+
+    printf("%.1f h at DR%u, events: peak |a| >= %.1f m/s^2\n", hours, (unsigned)adaptive.datarate,
+           adaptive.eventAccel / 100.0);
+    printf("%-10s %8s %8s %9s %7s %8s %8s %7s %5s %9s %7s %7s\n", "sender", "frames", "uplinks", "airtime_s",
+           "s/h", "pos_rms", "pos_max", "temp", "t_max", "events", "ev_avg", "ev_max");
+    char name[32];
+    snprintf(name, sizeof(name), "every-%us", (unsigned)(fixed.fixedIntervalMs / 1000));
+    printRow(name, f, hours);
+    printRow("policy", a, hours);
+    printf("airtime saved %.1f %%, %u exceptions rate-limited\n",
+           f.airtimeMs ? 100.0 * (1.0 - (double)a.airtimeMs / f.airtimeMs) : 0.0, (unsigned)a.rateLimited);
+    printf("policy reports:");
+    for (size_t i = 1; i < (size_t)ReportReason::Count; i++) {
+        printf(" %s %u", reportReasonName((ReportReason)i), (unsigned)a.byReason[i]);
+    }
+    printf("\n");
+    return 0;
+}
@@ -0,0 +1,358 @@
+// bbsim - Runs LoRaSender.ino on Linux against a virtual clock and a scripted world
+//
+//   bbsim [-s statedir] [-r] [-k masterKeyHex] [-v vehicleId] [-o target]
+//         [-f json|csv] [-d duration] [-l] [-T trace.json] scenario.txt
+//
+// The sketch is compiled unchanged (sketch_env.h stands in for the Arduino
+// core, FreeRTOS and ESP-IDF); the scenario (scenario.h) drives the GPS
+// UART, sensors, button, radio and power. Every boot runs in a forked child,
+// so a reboot starts from fresh RAM while NVS and flash persist in statedir
+// exactly as on the board (-r resumes from the state a previous run left
+// instead of starting with a wiped one). Uplinks go to target (uplink_writer.h) with the
+// receive time of the simulated day. -T writes the spans (trace_manager.h)
+// each boot left in its ring to a Chrome trace, one process per boot.
+#include "sketch_env.h"
+#include "gps_manager.h"
+#include "lora_manager.h"
+#include "sample_pipeline.h"
+
+// The prototypes the Arduino builder would generate for the sketch
+void sampleReading();
+void transmitStage(void*);
+void drainImu();
+void drainGPS();
+void checkDailyKey(time_t gpsEpoch);
+void printStats();
+void sendEncryptedPayload(const SampleRecord& rec);
+void handleButtonReset();
+void handleConsole();
+
+#include "LoRaSender.ino"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "scenario.h"
+#include "uplink_writer.h"
+
+namespace {
+
+constexpr const char* DEFAULT_MASTER_KEY = "e17c9d5c6c7bc84123c0a4caeef53d4f246fb8ce22f39aad71bc5dde2e982921";
+constexpr const char* TRACE_HEADER = "{\"traceEvents\":[\n";
+
+// The outside world at a point of the scenario
+struct World {
+    bool gpsOn = true;
+    bool fix = false;
+    double lat = 0, lon = 0;
+    double speed = 0, course = 0;  // m/s, degrees
+    uint64_t movedAtMs = 0;        // lat/lon are where the vehicle was then
+    int temperature = 22, humidity = 40;
+    sensors_vec_t accel = {0.0f, 0.0f, 9.81f};
+    bool radioUp = true;
+    std::string imuTrace;
+    uint64_t buttonUntilMs = 0;
+
+    // Dead-reckons the position forward to nowMs
+    void advance(uint64_t nowMs) {
+        double metres = speed * (double)(nowMs - movedAtMs) / 1000;
+        movedAtMs = nowMs;
+        if (metres == 0) return;
+        const double rad = course * M_PI / 180;
+        lat += metres * std::cos(rad) / 111319.5;
+        lon += metres * std::sin(rad) / (111319.5 * std::cos(lat * M_PI / 180));
+    }
+
+    // State commands change the world; the rest is for the boot loop
+    void apply(const ScenarioEvent& ev, uint64_t nowMs) {
+        const auto& a = ev.args;
+        advance(nowMs);
+        if (ev.command == "fix") {
+            fix = true;
+            lat = atof(a[0].c_str());
+            lon = atof(a[1].c_str());
+        } else if (ev.command == "nofix") {
+            fix = false;
+        } else if (ev.command == "drive") {
+            speed = atof(a[0].c_str());
+            course = atof(a[1].c_str());
+        } else if (ev.command == "gps") {
+            gpsOn = a[0] == "on";
+        } else if (ev.command == "dht") {
+            temperature = atoi(a[0].c_str());
+            humidity = atoi(a[1].c_str());
+        } else if (ev.command == "accel") {
+            accel = {(float)atof(a[0].c_str()), (float)atof(a[1].c_str()), (float)atof(a[2].c_str())};
+        } else if (ev.command == "imu") {
+            imuTrace = a[0];
+        } else if (ev.command == "radio") {
+            radioUp = a[0] == "on";
+        } else if (ev.command == "press") {
+            uint64_t ms = 0;
+            parseDurationMs(a[0], ms);
+            buttonUntilMs = nowMs + ms;
+        }
+    }
+};
+
+// Child -> parent at the end of a boot
+struct BootResult {
+    uint64_t nextBootMs;  // scenario time of the next power-on
+    size_t nextEvent;     // the first scenario event it has not seen
+    uint32_t fCnt;
+    uint32_t uplinks;
+    bool end;
+};
+
+struct Options {
+    std::string stateDir = "bbsim-state";
+    std::string masterKey = DEFAULT_MASTER_KEY;
+    std::string vehicleId = "veh-sim-01";
+    std::string target = "-";
+    UplinkFormat format = UplinkFormat::TtnJson;
+    bool log = false;
+    uint64_t durationMs = 0;
+    std::string traceFile;
+};
+
+std::string storedVehicleId() {
+    hal::Preferences p;
+    p.begin("dailykeys", true);
+    String id = p.getString("vehicle_id");
+    p.end();
+    return id.str();
+}
+
+// One power-on: setup(), then loop() until the scenario reboots, powers off
+// or ends the device. Runs in the child; never returns.
+// Appends the spans of boot number boot to the trace main() opened
+bool appendTrace(const std::string& path, uint32_t boot) {
+    FILE* f = fopen(path.c_str(), "a");
+    if (!f) return false;
+    fseek(f, 0, SEEK_END);
+    bool more = ftell(f) > (long)strlen(TRACE_HEADER);
+    traceWriteEvents(traceToFile, f, boot, more);
+    return fclose(f) == 0;
+}
+
+[[noreturn]] void runBoot(const Scenario& sc, const Options& opt, uint32_t boot, uint64_t bootMs, size_t firstEvent,
+                          uint32_t fCnt, int resultFd) {
+    // The world as it is at power-on. A reboot or power cut while the board
+    // was already down does nothing.
+    World world;
+    size_t cursor = 0;
+    for (; cursor < sc.events.size() && (cursor < firstEvent || sc.events[cursor].atMs < bootMs); cursor++) {
+        world.apply(sc.events[cursor], sc.events[cursor].atMs);
+    }
+    world.advance(bootMs);
+
+    hal::host::setMillis(0);
+    hal::host::radioSink().activated = world.radioUp;
+    dht.hostTemperature = world.temperature;
+    dht.hostHumidity = world.humidity;
+    mpu.hostAccel = world.accel;
+    std::unique_ptr<hal::host::Mpu6050Sim> imuSim;
+    if (!world.imuTrace.empty()) {
+        imuSim = std::make_unique<hal::host::Mpu6050Sim>(hal::host::loadImuTrace(world.imuTrace));
+        Wire.hostAttach(MPU6050_ADDR, imuSim.get());
+    }
+
+    UplinkWriter out;
+    if (!out.open(opt.target, opt.format, true)) _exit(3);
+    const std::string vehicleId = storedVehicleId();
+    const uint64_t endMs = opt.durationMs ? opt.durationMs : sc.endMs;
+    const uint64_t epochMs = sc.epoch * 1000;
+    size_t sent = 0;
+    BootResult result = {endMs, 0, fCnt, 0, true};
+    uint64_t nextNmeaMs = bootMs;
+
+    auto emit = [&] {
+        const auto& uplinks = hal::host::radioSink().uplinks;
+        for (; sent < uplinks.size(); sent++) {
+            const auto& u = uplinks[sent];
+            out.write({epochMs + bootMs + u.atMillis, vehicleId, result.fCnt++, u.port, u.datarate, u.data});
+            result.uplinks++;
+        }
+    };
+
+    try {
+        setup();
+        while (true) {
+            const uint64_t now = bootMs + hal::millis();
+            if (now >= endMs) break;
+            bool stop = false;
+            for (; cursor < sc.events.size() && sc.events[cursor].atMs <= now && !stop; cursor++) {
+                const ScenarioEvent& ev = sc.events[cursor];
+                if (ev.command == "reboot" || ev.command == "off") {
+                    uint64_t offMs = 0;
+                    if (ev.command == "off") parseDurationMs(ev.args[0], offMs);
+                    result.nextBootMs = now + offMs;
+                    result.end = false;
+                    stop = true;
+                } else if (ev.command == "end") {
+                    stop = true;
+                } else {
+                    world.apply(ev, now);
+                    if (ev.command == "radio") hal::host::radioSink().activated = world.radioUp;
+                    dht.hostTemperature = world.temperature;
+                    dht.hostHumidity = world.humidity;
+                    mpu.hostAccel = world.accel;
+                }
+            }
+            if (stop) break;
+
+            // The receiver talks once per second, at the top of the second
+            if (world.gpsOn && now >= nextNmeaMs) {
+                world.advance(now);
+                GPSserial.hostInject(nmeaSentences(sc.epoch + now / 1000, world.fix, world.lat, world.lon,
+                                                   world.speed, world.course));
+                nextNmeaMs = (now / 1000 + 1) * 1000;
+            }
+            sim::setPin(BUTTON_PIN, now < world.buttonUntilMs ? LOW : HIGH);
+
+            loop();
+            sim::runTasks();
+            emit();
+        }
+    } catch (const hal::host::RestartRequested&) {
+        // ESP.restart(): the device is back straight away
+        result.nextBootMs = bootMs + hal::millis();
+        result.end = false;
+    }
+    emit();
+    result.nextEvent = cursor;
+    logFlush();
+    out.close();
+    if (!opt.traceFile.empty() && !appendTrace(opt.traceFile, boot)) _exit(3);
+    fflush(nullptr);
+    if (write(resultFd, &result, sizeof(result)) != (ssize_t)sizeof(result)) _exit(4);
+    _exit(0);
+}
+
+// What the first-boot console prompts would store (again after a key reset)
+void provisionIfNeeded(const Options& opt) {
+    hal::host::setStorageDir(opt.stateDir);  // re-read what the last boot left
+    hal::Preferences p;
+    p.begin("dailykeys", false);
+    if (p.getString("master_key").isEmpty()) p.putString("master_key", opt.masterKey.c_str());
+    if (p.getString("vehicle_id").isEmpty()) p.putString("vehicle_id", opt.vehicleId.c_str());
+    p.end();
+}
+
+void usage() {
+    fprintf(stderr,
+            "usage: bbsim [-s statedir] [-r] [-k masterKeyHex] [-v vehicleId] [-o target] [-f json|csv] [-d duration] "
+            "[-l] [-T trace.json] scenario.txt\n"
+            "  target: file, - (stdout), unix:<path> or tcp:<host>:<port>; -l logs the device to stderr\n"
+            "  -T: Chrome trace of the spans each boot recorded last (needs BLACKBOX_TRACE)\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    // getInitialEpoch() uses mktime(): the board's RTC runs on UTC
+    setenv("TZ", "UTC", 1);
+    tzset();
+
+    Options opt;
+    bool keepState = false;
+    int c;
+    while ((c = getopt(argc, argv, "s:k:v:o:f:d:lrT:h")) != -1) {
+        switch (c) {
+            case 's': opt.stateDir = optarg; break;
+            case 'k': opt.masterKey = optarg; break;
+            case 'v': opt.vehicleId = optarg; break;
+            case 'o': opt.target = optarg; break;
+            case 'f': opt.format = std::string(optarg) == "csv" ? UplinkFormat::Csv : UplinkFormat::TtnJson; break;
+            case 'd':
+                if (!parseDurationMs(optarg, opt.durationMs)) {
+                    usage();
+                    return 2;
+                }
+                break;
+            case 'l': opt.log = true; break;
+            case 'r': keepState = true; break;
+            case 'T': opt.traceFile = optarg; break;
+            default: usage(); return 2;
+        }
+    }
+    if (optind >= argc) {
+        usage();
+        return 2;
+    }
+    Scenario sc;
+    std::string error;
+    if (!sc.load(argv[optind], error)) {
+        fprintf(stderr, "bbsim: %s: %s\n", argv[optind], error.c_str());
+        return 2;
+    }
+
+    hal::host::setLogEnabled(opt.log);
+    hal::host::setLogStream(stderr);
+    hal::host::setStorageDir(opt.stateDir);
+    if (!keepState) hal::host::wipeStorage();
+    // Each boot appends to the target
+    if (opt.target != "-" && opt.target.compare(0, 5, "unix:") != 0 && opt.target.compare(0, 4, "tcp:") != 0) {
+        FILE* f = fopen(opt.target.c_str(), "w");
+        if (!f) {
+            fprintf(stderr, "bbsim: cannot open %s\n", opt.target.c_str());
+            return 1;
+        }
+        fclose(f);
+    }
+    if (!opt.traceFile.empty()) {
+        FILE* f = fopen(opt.traceFile.c_str(), "w");
+        if (!f) {
+            fprintf(stderr, "bbsim: cannot open %s\n", opt.traceFile.c_str());
+            return 1;
+        }
+        fputs(TRACE_HEADER, f);
+        fclose(f);
+    }
+
+    const uint64_t endMs = opt.durationMs ? opt.durationMs : sc.endMs;
+    uint64_t bootMs = 0;
+    size_t nextEvent = 0;
+    uint32_t fCnt = 0, uplinks = 0, boots = 0;
+    while (bootMs < endMs) {
+        provisionIfNeeded(opt);
+        int fds[2];
+        if (pipe(fds) != 0) return 1;
+        fflush(nullptr);
+        pid_t pid = fork();
+        if (pid < 0) return 1;
+        if (pid == 0) {
+            close(fds[0]);
+            runBoot(sc, opt, boots + 1, bootMs, nextEvent, fCnt, fds[1]);
+        }
+        close(fds[1]);
+        BootResult r;
+        bool got = read(fds[0], &r, sizeof(r)) == (ssize_t)sizeof(r);
+        close(fds[0]);
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!got || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "bbsim: boot %u at %.3f s died (status %d)\n", boots + 1, bootMs / 1000.0, status);
+            return 1;
+        }
+        boots++;
+        fCnt = r.fCnt;
+        uplinks += r.uplinks;
+        if (r.end) break;
+        bootMs = r.nextBootMs;
+        nextEvent = r.nextEvent;
+    }
+    if (!opt.traceFile.empty()) {
+        FILE* f = fopen(opt.traceFile.c_str(), "a");
+        if (f) {
+            fputs("\n],\"displayTimeUnit\":\"ns\"}\n", f);
+            fclose(f);
+        }
+    }
+    fprintf(stderr, "bbsim: %.1f h simulated, %u boot(s), %u uplinks\n", endMs / 3600000.0, boots, uplinks);
+    return 0;
+}
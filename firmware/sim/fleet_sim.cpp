@@ -0,0 +1,329 @@
+// fleet_sim.cpp - Per-vehicle device state, the synthetic drive and the slice loop
+#include "fleet_sim.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <thread>
+#include "daily_key_manager.h"
+#include "lora_manager.h"
+#include "message_counter.h"
+#include "payload_manager.h"
+#include "report_policy.h"
+
+namespace {
+
+uint64_t splitmix64(uint64_t& x) {
+    uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Small explicit RNG so a seed gives the same fleet with any standard library
+struct Rng {
+    explicit Rng(uint64_t seed) : state(seed) {}
+    uint64_t next() { return splitmix64(state); }
+    double uniform() { return (double)(next() >> 11) * 0x1.0p-53; }  // [0, 1)
+    double uniform(double lo, double hi) { return lo + (hi - lo) * uniform(); }
+    uint64_t state;
+};
+
+constexpr double METERS_PER_DEGREE = 111320.0;
+constexpr double FLEET_CENTER_LAT = 45.4642, FLEET_CENTER_LON = 9.1900;
+// A stop of 1 to 30 minutes about every 20 minutes of driving
+constexpr double PARK_EVERY_S = 1200;
+// How often the sketch's transmit task calls LoRaWAN_poll()
+constexpr uint32_t RADIO_POLL_INTERVAL_MS = 1000;
+
+}  // namespace
+
+struct FleetSimulator::Vehicle {
+    Vehicle(const FleetConfig& cfg, size_t index, const std::string& id)
+        : cfg(cfg), id(id), device(cfg.stateDir.empty() ? "" : cfg.stateDir + "/" + id),
+          rng(cfg.seed * 0x100000001B3ull + index) {
+        uint8_t master[32];
+        for (uint8_t& b : master) b = (uint8_t)rng.next();
+        static const char digits[] = "0123456789abcdef";
+        for (uint8_t b : master) {
+            masterHex += digits[b >> 4];
+            masterHex += digits[b & 15];
+        }
+        lat = FLEET_CENTER_LAT + rng.uniform(-0.2, 0.2);
+        lon = FLEET_CENTER_LON + rng.uniform(-0.2, 0.2);
+        heading = rng.uniform(0, 2 * M_PI);
+        dht.hostTemperature = (int)rng.uniform(10, 30);
+        dht.hostHumidity = (int)rng.uniform(30, 70);
+    }
+
+    // Provisioning and the first boot, like the console prompts would store them
+    void provision(uint64_t wallMs) {
+        hal::host::DeviceScope scope(device);
+        hal::host::wipeStorage();
+        hal::host::setFlashPartitionSize(cfg.flashBytes);
+        hal::Preferences p;
+        p.begin("dailykeys", false);
+        p.putString("master_key", masterHex.c_str());
+        p.putString("vehicle_id", id.c_str());
+        p.end();
+        boot(wallMs);
+        p.begin("dailykeys", true);
+        startEpoch = p.getULong64("start_epoch", 0);
+        p.end();
+        scheduleReboot(wallMs);
+    }
+
+    // Runs everything due before endMs (the caller binds the device)
+    void runUntil(uint64_t endMs, std::vector<SimUplink>& out) {
+        while (true) {
+            const uint64_t pollMs = pollDue();
+            uint64_t next = std::min({nextReadingMs, nextRebootMs, nextBootMs, pollMs});
+            if (next >= endMs) return;
+            clock(next);
+            if (next == nextBootMs) {
+                powerOn(nextBootMs);
+            } else if (next == nextRebootMs) {
+                powerOff(nextRebootMs);
+            } else if (next == nextReadingMs) {
+                reading(nextReadingMs, out);
+            } else {
+                nextPollMs = pollMs + RADIO_POLL_INTERVAL_MS;
+                LoRaWAN_poll();
+            }
+            collect(out);
+        }
+    }
+
+    // Power lost: RAM (the LoRaWAN layer included) is gone, NVS and the
+    // flash queue are not
+    void powerOff(uint64_t wallMs) {
+        policy.reset();
+        payload.reset();
+        keys.reset();
+        counter.reset();
+        hal::host::dropDeviceLocal<LoRaWANState>();
+        reboots++;
+        nextReadingMs = nextRebootMs = UINT64_MAX;
+        nextBootMs = wallMs + (uint64_t)(rng.uniform() * cfg.maxOffS * 1000);
+    }
+
+    void powerOn(uint64_t wallMs) {
+        nextBootMs = UINT64_MAX;
+        boot(wallMs);
+        scheduleReboot(wallMs);
+    }
+
+    // setup(): the sketch's boot order
+    void boot(uint64_t wallMs) {
+        bootWallMs = wallMs;
+        hal::host::setMillis(0);
+        counter = std::make_unique<MessageCounter>();
+        keys = std::make_unique<DailyKeyManager>();
+        keys->setMessageCounter(counter.get());
+        keys->init();
+        keys->loadDailyKey();
+        payload = std::make_unique<PayloadManager>(&dht, &mpu, &fix, keys->getDailyKey(), counter.get(), true);
+        if (cfg.compact) payload->setCodec(PayloadCodec::Compact);
+        policy = std::make_unique<ReportPolicy>();
+        TxSchedulerConfig tx = lorawan().txScheduler.config();
+        tx.defaultDatarate = cfg.datarate;
+        lorawan().txScheduler = TxScheduler(tx);
+        LoRaWAN_setup();
+        lastDriveMs = wallMs;
+        nextReadingMs = wallMs + (cfg.readingIntervalMs ? cfg.readingIntervalMs : policy->evalIntervalMs());
+        nextPollMs = wallMs + RADIO_POLL_INTERVAL_MS;
+    }
+
+    void scheduleReboot(uint64_t fromMs) {
+        if (cfg.rebootsPerDay <= 0) {
+            nextRebootMs = UINT64_MAX;
+            return;
+        }
+        double meanMs = 86400000.0 / cfg.rebootsPerDay;
+        nextRebootMs = fromMs + 1 + (uint64_t)(-std::log(1 - rng.uniform()) * meanMs);
+    }
+
+    // The device's virtual clock at wallMs, for the firmware's millis()
+    void clock(uint64_t wallMs) {
+        if (payload) hal::host::device().micros = (wallMs - bootWallMs) * 1000;
+    }
+
+    // The transmit task polls the radio while readings are queued
+    uint64_t pollDue() const {
+        if (!payload || lorawan().uplinkQueue.size() == 0) return UINT64_MAX;
+        return nextPollMs;
+    }
+
+    // sampleReading() + sendEncryptedPayload()
+    void reading(uint64_t wallMs, std::vector<SimUplink>& out) {
+        drive((wallMs - lastDriveMs) / 1000.0, wallMs);
+        lastDriveMs = wallMs;
+        // The next tick of the transmit task, which polls from boot on
+        nextPollMs = bootWallMs + ((wallMs - bootWallMs) / RADIO_POLL_INTERVAL_MS + 1) * RADIO_POLL_INTERVAL_MS;
+
+        SensorReading r = payload->sample();
+        bool urgent = false;
+        if (cfg.readingIntervalMs) {
+            nextReadingMs = wallMs + cfg.readingIntervalMs;
+        } else {
+            ReportReason reason = policy->evaluate(r, fix, hal::millis());
+            nextReadingMs = wallMs + policy->evalIntervalMs();
+            if (reason == ReportReason::None) {
+                suppressed++;
+                return;
+            }
+            r = policy->report();
+            urgent = reportUrgent(reason);
+        }
+        if (keys->checkAndUpdateDailyKey((time_t)(wallMs / 1000))) rollovers++;
+        size_t cap = 0;
+        uint8_t* frame = LoRaWAN_txSlot(cap);
+        size_t len = payload->encodePayload(r, frame, cap);
+        if (len == 0) return;
+        frames++;
+        if (cfg.bypassRadio) {
+            out.push_back({wallMs, id, fCnt++, FPORT_FRAME, cfg.datarate, std::vector<uint8_t>(frame, frame + len)});
+            return;
+        }
+        LoRaWAN_send(frame, len, urgent);
+    }
+
+    // What the radio sent since the last call, on the wall clock
+    void collect(std::vector<SimUplink>& out) {
+        auto& sent = hal::host::radioSink().uplinks;
+        for (auto& up : sent) {
+            out.push_back({bootWallMs + up.atMillis, id, fCnt++, up.port, up.datarate, std::move(up.data)});
+        }
+        sent.clear();
+    }
+
+    // Wanders at town speeds, with a stop now and then; sensors follow the motion
+    void drive(double dt, uint64_t wallMs) {
+        if (wallMs >= parkedUntilMs && rng.uniform() < dt / PARK_EVERY_S) {
+            parkedUntilMs = wallMs + (uint64_t)(rng.uniform(60, 1800) * 1000);
+        }
+        const bool parked = wallMs < parkedUntilMs;
+        speed = parked ? 0 : std::clamp(speed + rng.uniform(-2, 2), 0.0, 25.0);
+        heading += parked ? 0 : rng.uniform(-0.3, 0.3);
+        lat += speed * dt * std::cos(heading) / METERS_PER_DEGREE;
+        lon += speed * dt * std::sin(heading) / (METERS_PER_DEGREE * std::cos(lat * M_PI / 180));
+        fix.locationValid = true;
+        fix.lat = (int32_t)std::lround(lat * GPS_COORD_SCALE);
+        fix.lon = (int32_t)std::lround(lon * GPS_COORD_SCALE);
+        fix.satellites = 8;
+        fix.motionValid = true;
+        fix.speed = (uint16_t)std::lround(speed * 100);
+        const double course = std::fmod(heading * 180 / M_PI, 360.0);
+        fix.course = (uint16_t)((int32_t)std::lround((course < 0 ? course + 360 : course) * 100) % 36000);
+        fix.locationMillis = hal::millis();
+        if (rng.uniform() < 0.02) dht.hostTemperature += rng.uniform() < 0.5 ? -1 : 1;
+        const double shake = parked ? 0.02 : 1.5;
+        mpu.hostAccel = {(float)rng.uniform(-shake, shake), (float)rng.uniform(-shake, shake),
+                         (float)(9.81 + rng.uniform(-shake, shake) * 2 / 3)};
+        mpu.hostGyro = {0, 0, 0};
+        if (!parked) {
+            mpu.hostGyro = {(float)rng.uniform(-0.2, 0.2), (float)rng.uniform(-0.2, 0.2),
+                            (float)rng.uniform(-0.5, 0.5)};
+        }
+    }
+
+    const FleetConfig& cfg;
+    std::string id, masterHex;
+    uint64_t startEpoch = 0;
+    hal::host::Device device;
+    Rng rng;
+
+    // Hardware: survives a power cycle, like the flash queue and the
+    // LoRaWAN session the device keeps
+    DHT11 dht{7};
+    Adafruit_MPU6050 mpu;
+    GpsFix fix;
+    double lat, lon, heading, speed = 0;
+    uint64_t lastDriveMs = 0, parkedUntilMs = 0;
+    uint32_t fCnt = 0;
+
+    // RAM: rebuilt by every boot
+    std::unique_ptr<MessageCounter> counter;
+    std::unique_ptr<DailyKeyManager> keys;
+    std::unique_ptr<PayloadManager> payload;
+    std::unique_ptr<ReportPolicy> policy;
+    uint64_t bootWallMs = 0, nextReadingMs = 0, nextRebootMs = UINT64_MAX, nextBootMs = UINT64_MAX;
+    uint64_t nextPollMs = UINT64_MAX;
+
+    uint64_t frames = 0, suppressed = 0, reboots = 0, rollovers = 0;
+};
+
+FleetSimulator::FleetSimulator(const FleetConfig& config) : cfg(config) {
+    workerCount = cfg.threads ? cfg.threads : std::max(1u, std::thread::hardware_concurrency());
+    if (workerCount > cfg.vehicles) workerCount = (unsigned)std::max<size_t>(1, cfg.vehicles);
+    if (cfg.sliceS == 0) cfg.sliceS = 1;
+
+    const int width = (int)std::to_string(cfg.vehicles).size() < 5 ? 5 : (int)std::to_string(cfg.vehicles).size();
+    fleet.reserve(cfg.vehicles);
+    for (size_t i = 0; i < cfg.vehicles; i++) {
+        char id[32];
+        snprintf(id, sizeof(id), "veh-%0*zu", width, i + 1);
+        fleet.push_back(std::make_unique<Vehicle>(cfg, i, id));
+    }
+
+    // First boots hash the key chain from its start date: spread them too
+    const uint64_t startMs = cfg.startEpoch * 1000;
+    std::vector<std::thread> workers;
+    for (unsigned w = 0; w < workerCount; w++) {
+        workers.emplace_back([&, w] {
+            for (size_t i = w; i < fleet.size(); i += workerCount) fleet[i]->provision(startMs);
+        });
+    }
+    for (auto& t : workers) t.join();
+
+    for (const auto& v : fleet) provisioned.push_back({v->id, v->masterHex, v->startEpoch});
+}
+
+FleetSimulator::~FleetSimulator() {
+    // Managers hold Preferences handles of their device: close them there
+    for (auto& v : fleet) {
+        hal::host::DeviceScope scope(v->device);
+        v.reset();
+    }
+}
+
+void FleetSimulator::run(const std::function<void(const SimUplink&)>& sink) {
+    const uint64_t endMs = (cfg.startEpoch + cfg.durationS) * 1000;
+    std::vector<std::vector<SimUplink>> outs(workerCount);
+    std::vector<SimUplink> slice;
+    for (uint64_t from = cfg.startEpoch * 1000; from < endMs; from += (uint64_t)cfg.sliceS * 1000) {
+        const uint64_t to = std::min(endMs, from + (uint64_t)cfg.sliceS * 1000);
+        std::vector<std::thread> workers;
+        for (unsigned w = 0; w < workerCount; w++) {
+            workers.emplace_back([&, w] {
+                for (size_t i = w; i < fleet.size(); i += workerCount) {
+                    hal::host::DeviceScope scope(fleet[i]->device);
+                    fleet[i]->runUntil(to, outs[w]);
+                }
+            });
+        }
+        for (auto& t : workers) t.join();
+
+        slice.clear();
+        for (auto& o : outs) {
+            std::move(o.begin(), o.end(), std::back_inserter(slice));
+            o.clear();
+        }
+        std::stable_sort(slice.begin(), slice.end(), [](const SimUplink& a, const SimUplink& b) {
+            return a.atMillis != b.atMillis ? a.atMillis < b.atMillis : a.deviceId < b.deviceId;
+        });
+        for (const SimUplink& up : slice) sink(up);
+    }
+}
+
+FleetStats FleetSimulator::stats() const {
+    FleetStats s;
+    for (const auto& v : fleet) {
+        s.uplinks += v->fCnt;
+        s.frames += v->frames;
+        s.suppressed += v->suppressed;
+        s.reboots += v->reboots;
+        s.keyRollovers += v->rollovers;
+    }
+    return s;
+}
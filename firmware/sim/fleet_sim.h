@@ -0,0 +1,86 @@
+// fleet_sim.h - Thousands of simulated vehicles on a few threads, for backend load tests
+//
+// Every vehicle runs the sketch's data path on its own hal::host::Device
+// (virtual clock, NVS, flash and radio): DailyKeyManager, MessageCounter,
+// PayloadManager, ReportPolicy and the LoRaWAN layer of lora_manager.h
+// exactly as on the board, fed a synthetic drive (GPS fix, DHT11,
+// accelerometer) from a per-vehicle RNG. Each evaluation it samples, lets the
+// report policy decide, rolls the daily key over when the GPS day changes and
+// hands the frame to LoRaWAN_send(); the flash queue, batching, confirmed
+// uplinks and the transmit scheduler decide what goes on air, and the uplinks
+// are taken from the device's fake radio. Vehicles lose power at random and
+// boot again from NVS and flash, so counter reservation, multi-day key
+// catch-up and the backlog drain run at fleet scale.
+//
+// Time advances in slices. Within a slice the vehicles run independently on
+// the worker threads; the slice's uplinks are then handed out sorted by time
+// and vehicle, so the output does not depend on the thread count.
+#ifndef SIM_FLEET_SIM_H
+#define SIM_FLEET_SIM_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "uplink_writer.h"
+
+struct FleetConfig {
+    size_t vehicles = 100;
+    unsigned threads = 0;              // 0: every hardware thread
+    uint64_t startEpoch = 1742860800;  // 2025-03-25 00:00:00 UTC
+    uint64_t durationS = 86400;
+    uint32_t readingIntervalMs = 0;  // 0: ReportPolicy decides; else every reading at this interval
+    uint64_t seed = 1;
+    double rebootsPerDay = 1;   // mean per vehicle
+    uint32_t maxOffS = 3600;    // power stays off up to this long
+    uint8_t datarate = 3;
+    bool compact = false;       // PayloadCodec::Compact instead of the fixed frame
+    // Every frame goes out as its own uplink the moment it is encoded, past
+    // the flash queue and the duty cycle: for frame rates no LoRa channel carries
+    bool bypassRadio = false;
+    std::string stateDir;       // NVS and flash under <stateDir>/<vehicle id>/; "" keeps them in RAM
+    size_t flashBytes = 32 * 1024;  // the flash queue's partition
+    uint32_t sliceS = 600;
+};
+
+// What the backend needs to know about a vehicle (a bbdecode vehicles.csv row)
+struct FleetVehicle {
+    std::string id;
+    std::string masterKeyHex;
+    uint64_t startEpoch;  // of its key chain, as stored by DailyKeyManager
+};
+
+struct FleetStats {
+    uint64_t uplinks = 0;
+    uint64_t frames = 0;
+    uint64_t suppressed = 0;  // readings the report policy kept off the air
+    uint64_t reboots = 0;
+    uint64_t keyRollovers = 0;
+};
+
+class FleetSimulator {
+public:
+    // Provisions every vehicle and runs its first boot at startEpoch
+    explicit FleetSimulator(const FleetConfig& config);
+    ~FleetSimulator();
+    FleetSimulator(const FleetSimulator&) = delete;
+    FleetSimulator& operator=(const FleetSimulator&) = delete;
+
+    // Runs the whole duration; sink is called on the calling thread, in order
+    void run(const std::function<void(const SimUplink&)>& sink);
+
+    const std::vector<FleetVehicle>& vehicles() const { return provisioned; }
+    FleetStats stats() const;
+    unsigned threads() const { return workerCount; }
+
+private:
+    struct Vehicle;
+
+    FleetConfig cfg;
+    unsigned workerCount;
+    std::vector<std::unique_ptr<Vehicle>> fleet;
+    std::vector<FleetVehicle> provisioned;
+};
+
+#endif
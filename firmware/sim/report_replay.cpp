@@ -0,0 +1,344 @@
+// report_replay.cpp - Drive traces, the synthetic day and the replay against the radio rules
+#include "report_replay.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include "lora_manager.h"
+
+namespace {
+
+constexpr const char* TRACE_HEADER = "t_ms,lat,lon,speed_cms,course_cdeg,temp_c,accel,accel_rms,jerk,gx,gy,gz";
+constexpr double METERS_PER_DEGREE = 111319.5;
+
+uint64_t splitmix64(uint64_t& x) {
+    uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+struct Rng {
+    explicit Rng(uint64_t seed) : state(seed) {}
+    uint64_t next() { return splitmix64(state); }
+    double uniform() { return (double)(next() >> 11) * 0x1.0p-53; }  // [0, 1)
+    double uniform(double lo, double hi) { return lo + (hi - lo) * uniform(); }
+    bool chance(double p) { return uniform() < p; }
+    uint64_t state;
+};
+
+double distanceM(int32_t lat1, int32_t lon1, int32_t lat2, int32_t lon2) {
+    const double k = METERS_PER_DEGREE / GPS_COORD_SCALE;
+    double dy = (double)(lat2 - lat1) * k;
+    double dx = (double)(lon2 - lon1) * k * std::cos((double)lat1 / GPS_COORD_SCALE * M_PI / 180);
+    return std::sqrt(dx * dx + dy * dy);
+}
+
+int8_t clampI8(long v) { return (int8_t)std::max(-128L, std::min(127L, v)); }
+uint16_t clampU16(long v) { return (uint16_t)std::max(0L, std::min(65535L, v)); }
+
+// The IMU windows since the last evaluation, as the sketch's ImuWindow would
+// have reported them over the longer span
+struct Window {
+    SensorReading r = {};
+    uint64_t rmsSq = 0;
+    uint32_t n = 0;
+
+    void add(const SensorReading& s) {
+        if (n == 0) {
+            r = s;
+        } else {
+            r.temperature = s.temperature;
+            r.lat = s.lat;
+            r.lon = s.lon;
+            r.accel = std::max(r.accel, s.accel);
+            r.jerk = std::max(r.jerk, s.jerk);
+            for (int i = 0; i < 3; i++) {
+                if (std::abs(s.gyro[i]) > std::abs(r.gyro[i])) r.gyro[i] = s.gyro[i];
+            }
+        }
+        rmsSq += (uint64_t)s.accelRms * s.accelRms;
+        n++;
+        r.accelRms = (uint16_t)std::lround(std::sqrt((double)rmsSq / n));
+    }
+    SensorReading take() {
+        SensorReading out = r;
+        *this = Window();
+        return out;
+    }
+};
+
+// A reported reading: in the backend's track, and waiting for an uplink
+struct Report {
+    uint32_t atMs;
+    int32_t lat, lon;
+    int8_t temperature;
+};
+struct Queued {
+    uint32_t sampledMs;
+    std::vector<size_t> events;  // indices into the trace's events it carries
+};
+
+}  // namespace
+
+bool loadDriveTrace(const std::string& path, std::vector<TracePoint>& out, std::string& error) {
+    std::ifstream in(path);
+    if (!in) {
+        error = "cannot open " + path;
+        return false;
+    }
+    out.clear();
+    std::string line;
+    for (int lineNo = 1; std::getline(in, line); lineNo++) {
+        if (line.empty() || line.compare(0, 4, "t_ms") == 0 || line[0] == '#') continue;
+        long v[12];
+        std::istringstream ss(line);
+        std::string cell;
+        int n = 0;
+        while (n < 12 && std::getline(ss, cell, ',')) {
+            char* end;
+            v[n] = strtol(cell.c_str(), &end, 10);
+            if (end == cell.c_str()) break;
+            n++;
+        }
+        if (n != 12 || (!out.empty() && (uint32_t)v[0] <= out.back().tMs)) {
+            error = path + ":" + std::to_string(lineNo) + ": expected 12 numbers, in time order";
+            return false;
+        }
+        TracePoint p = {};
+        p.tMs = (uint32_t)v[0];
+        p.reading.lat = (int32_t)v[1];
+        p.reading.lon = (int32_t)v[2];
+        p.speed = clampU16(v[3]);
+        p.course = clampU16(v[4]);
+        p.reading.temperature = clampI8(v[5]);
+        p.reading.accel = clampU16(v[6]);
+        p.reading.accelRms = clampU16(v[7]);
+        p.reading.jerk = clampU16(v[8]);
+        for (int i = 0; i < 3; i++) p.reading.gyro[i] = clampI8(v[9 + i]);
+        out.push_back(p);
+    }
+    return true;
+}
+
+bool saveDriveTrace(const std::string& path, const std::vector<TracePoint>& trace) {
+    FILE* f = path == "-" ? stdout : fopen(path.c_str(), "w");
+    if (!f) return false;
+    fprintf(f, "%s\n", TRACE_HEADER);
+    for (const TracePoint& p : trace) {
+        const SensorReading& r = p.reading;
+        fprintf(f, "%u,%d,%d,%u,%u,%d,%u,%u,%u,%d,%d,%d\n", (unsigned)p.tMs, (int)r.lat, (int)r.lon,
+                (unsigned)p.speed, (unsigned)p.course, (int)r.temperature, (unsigned)r.accel, (unsigned)r.accelRms,
+                (unsigned)r.jerk, (int)r.gyro[0], (int)r.gyro[1], (int)r.gyro[2]);
+    }
+    return f == stdout ? fflush(f) == 0 : fclose(f) == 0;
+}
+
+std::vector<TracePoint> synthesizeDriveTrace(uint64_t seed, uint32_t durationS) {
+    enum class Mode { Parked, Town, Motorway };
+    Rng rng(seed * 0x100000001B3ull + 17);
+    double lat = 45.4642 + rng.uniform(-0.05, 0.05), lon = 9.1900 + rng.uniform(-0.05, 0.05);
+    double speed = 0, course = rng.uniform(0, 360), cruise = 0, cabin = 0;
+    Mode mode = Mode::Parked;
+    uint32_t modeLeft = (uint32_t)rng.uniform(1200, 5400), stopLeft = 0;
+
+    std::vector<TracePoint> trace;
+    trace.reserve(durationS);
+    for (uint32_t s = 0; s < durationS; s++) {
+        if (--modeLeft == 0) {
+            if (mode == Mode::Parked) {
+                mode = Mode::Town;
+            } else if (mode == Mode::Town) {
+                mode = rng.chance(0.4) ? Mode::Motorway : Mode::Parked;
+            } else {
+                mode = Mode::Town;
+            }
+            modeLeft = (uint32_t)(mode == Mode::Parked ? rng.uniform(1800, 10800) : rng.uniform(300, 1800));
+            cruise = mode == Mode::Motorway ? rng.uniform(27, 35) : rng.uniform(8, 14);
+        }
+
+        // Speed and course: traffic lights and right-angle turns in town,
+        // long gentle bends on the motorway
+        double target = 0, yawDeg = 0;
+        bool hardStop = false;
+        if (mode == Mode::Town) {
+            if (stopLeft > 0) {
+                stopLeft--;
+            } else if (rng.chance(1.0 / 120)) {
+                stopLeft = (uint32_t)rng.uniform(15, 60);
+                hardStop = rng.chance(0.1);
+            }
+            target = stopLeft > 0 ? 0 : cruise;
+            if (speed > 3 && rng.chance(1.0 / 60)) yawDeg = rng.chance(0.5) ? 90 : -90;
+        } else if (mode == Mode::Motorway) {
+            target = cruise;
+            yawDeg = rng.uniform(-0.5, 0.5);
+        }
+        double dv = std::max(hardStop ? -8.0 : -3.0, std::min(2.0, target - speed));
+        speed = std::max(0.0, speed + dv);
+        course = std::fmod(course + yawDeg + 360, 360);
+        lat += speed * std::cos(course * M_PI / 180) / METERS_PER_DEGREE;
+        lon += speed * std::sin(course * M_PI / 180) / (METERS_PER_DEGREE * std::cos(lat * M_PI / 180));
+
+        // |a| in m/s^2 * 100: gravity plus the longitudinal and cornering
+        // load, with engine and road vibration on top
+        TracePoint p = {};
+        p.tMs = s * 1000;
+        SensorReading& r = p.reading;
+        double load = std::hypot(9.81, std::hypot(dv, speed * yawDeg * M_PI / 180 / 3)) * 100;
+        if (mode == Mode::Parked) {
+            r.accelRms = (uint16_t)std::lround(load + rng.uniform(-2, 2));
+            r.accel = (uint16_t)(r.accelRms + rng.uniform(0, 10));
+            r.jerk = (uint16_t)rng.uniform(0, 5);
+        } else {
+            double vibration = speed > 0.5 ? (mode == Mode::Motorway ? 30 : 50) : 15;
+            r.accelRms = (uint16_t)std::lround(load + rng.uniform(0.2, 0.6) * vibration);
+            r.accel = (uint16_t)(r.accelRms + rng.uniform(1, 3) * vibration);
+            r.jerk = (uint16_t)rng.uniform(2, 8) * (uint16_t)vibration;
+            if (speed > 5 && rng.chance(1.0 / 600)) {  // a pothole or a kerb
+                r.accel = (uint16_t)rng.uniform(1600, 2800);
+                r.jerk = (uint16_t)rng.uniform(3000, 9000);
+            }
+            r.gyro[0] = (int8_t)std::lround(rng.uniform(-0.4, 0.4) * vibration / 50);
+            r.gyro[2] = (int8_t)std::lround(yawDeg * M_PI / 180 * 10);
+        }
+
+        // Outside air through the day, the cabin warms up while driving
+        double ambient = 14 + 7 * std::sin(2 * M_PI * ((double)s - 9 * 3600) / 86400);
+        cabin += mode == Mode::Parked ? -cabin / 1800 : (5 - cabin) / 900;
+        r.temperature = (int8_t)std::lround(ambient + cabin);
+        r.lat = (int32_t)std::lround(lat * GPS_COORD_SCALE);
+        r.lon = (int32_t)std::lround(lon * GPS_COORD_SCALE);
+        p.speed = (uint16_t)std::lround(speed * 100);
+        p.course = (uint16_t)std::lround(course * 100) % 36000;
+        trace.push_back(p);
+    }
+    return trace;
+}
+
+ReplayResult replayDriveTrace(const std::vector<TracePoint>& trace, const ReplayOptions& options) {
+    ReplayResult res;
+    if (trace.empty()) return res;
+
+    LoRaWANNode radioLimits;
+    radioLimits.setDatarate(options.datarate);
+    const size_t maxUplink = std::min<size_t>(radioLimits.getMaxPayloadLen(), LORAWAN_MAX_UPLINK);
+    const size_t perUplink = (maxUplink - AGGREGATE_HEADER_LEN) / (AGGREGATE_ENTRY_OVERHEAD + MAX_PAYLOAD_SIZE);
+
+    ReportPolicy policy(options.policy);
+    Window window;
+    std::vector<Report> reports;
+    std::deque<Queued> queue;
+    std::vector<uint32_t> eventAt, eventDelivered;
+    std::vector<size_t> windowEvents, pendingEvents;
+    bool urgent = false;
+    uint32_t nextEvalMs = trace.front().tMs, nextUplinkMs = 0;
+
+    // lora_manager.h: a full batch, an overdue one or an urgent reading goes
+    // out when the duty cycle allows
+    auto serviceRadio = [&](uint32_t now) {
+        while (!queue.empty() && now >= nextUplinkMs &&
+               (urgent || queue.size() >= perUplink || now - queue.front().sampledMs >= LORAWAN_MAX_BATCH_DELAY_MS)) {
+            size_t n = std::min(perUplink, queue.size());
+            size_t len = n == 1 ? MAX_PAYLOAD_SIZE : AGGREGATE_HEADER_LEN + n * (AGGREGATE_ENTRY_OVERHEAD + MAX_PAYLOAD_SIZE);
+            uint32_t toa = hal::host::timeOnAirMillis(options.datarate, len);
+            res.uplinks++;
+            res.airtimeMs += toa;
+            nextUplinkMs = now + toa * 100;  // 1 %
+            for (size_t i = 0; i < n; i++) {
+                for (size_t e : queue.front().events) eventDelivered[e] = now;
+                queue.pop_front();
+            }
+            if (queue.empty()) urgent = false;
+        }
+    };
+
+    for (const TracePoint& p : trace) {
+        if (p.reading.accel >= options.eventAccel) {
+            windowEvents.push_back(eventAt.size());
+            eventAt.push_back(p.tMs);
+            eventDelivered.push_back(UINT32_MAX);
+        }
+        window.add(p.reading);
+        if (p.tMs >= nextEvalMs) {
+            SensorReading reading = window.take();
+            pendingEvents.insert(pendingEvents.end(), windowEvents.begin(), windowEvents.end());
+            windowEvents.clear();
+            ReportReason reason = ReportReason::Periodic;
+            const SensorReading* frame = &reading;
+            if (options.adaptive) {
+                GpsFix fix;
+                fix.locationValid = fix.motionValid = true;
+                fix.lat = reading.lat;
+                fix.lon = reading.lon;
+                fix.speed = p.speed;
+                fix.course = p.course;
+                fix.locationMillis = p.tMs;
+                reason = policy.evaluate(reading, fix, p.tMs);
+                frame = &policy.report();
+                nextEvalMs = p.tMs + policy.evalIntervalMs();
+            } else {
+                nextEvalMs = p.tMs + options.fixedIntervalMs;
+            }
+            if (reason != ReportReason::None) {
+                res.readings++;
+                res.byReason[(size_t)reason]++;
+                reports.push_back({p.tMs, frame->lat, frame->lon, frame->temperature});
+                Queued q{p.tMs, {}};
+                // The merged peak is what tells the backend about the event
+                if (frame->accel >= options.eventAccel) q.events.swap(pendingEvents);
+                pendingEvents.clear();
+                queue.push_back(std::move(q));
+                urgent = urgent || (options.adaptive && reportUrgent(reason));
+            }
+        }
+        serviceRadio(p.tMs);
+    }
+    for (uint32_t t = trace.back().tMs; !queue.empty(); t += 1000) serviceRadio(t);
+    res.rateLimited = policy.exceptionsRateLimited();
+
+    // Fidelity, over the span the reports cover: the track between them,
+    // the temperature since the last one
+    double sumSq = 0, tempSum = 0;
+    size_t k = 0, n = 0;
+    for (const TracePoint& p : trace) {
+        if (reports.empty() || p.tMs > reports.back().atMs) break;
+        while (k + 1 < reports.size() && reports[k + 1].atMs <= p.tMs) k++;
+        if (reports[k].atMs > p.tMs) continue;
+        const Report& a = reports[k];
+        int32_t lat = a.lat, lon = a.lon;
+        if (k + 1 < reports.size()) {
+            const Report& b = reports[k + 1];
+            double f = (double)(p.tMs - a.atMs) / (b.atMs - a.atMs);
+            lat = (int32_t)std::lround(a.lat + f * (b.lat - a.lat));
+            lon = (int32_t)std::lround(a.lon + f * (b.lon - a.lon));
+        }
+        double d = distanceM(p.reading.lat, p.reading.lon, lat, lon);
+        sumSq += d * d;
+        res.positionMaxM = std::max(res.positionMaxM, d);
+        int dt = std::abs(p.reading.temperature - a.temperature);
+        tempSum += dt;
+        res.temperatureMaxErr = std::max(res.temperatureMaxErr, dt);
+        n++;
+    }
+    if (n > 0) {
+        res.positionRmsM = std::sqrt(sumSq / n);
+        res.temperatureMeanErr = tempSum / n;
+    }
+
+    double delaySum = 0;
+    res.events = (uint32_t)eventAt.size();
+    for (size_t e = 0; e < eventAt.size(); e++) {
+        if (eventDelivered[e] == UINT32_MAX) continue;
+        double delay = (eventDelivered[e] - eventAt[e]) / 1000.0;
+        res.eventsSeen++;
+        delaySum += delay;
+        res.eventDelayMaxS = std::max(res.eventDelayMaxS, delay);
+    }
+    if (res.eventsSeen > 0) res.eventDelayMeanS = delaySum / res.eventsSeen;
+    return res;
+}
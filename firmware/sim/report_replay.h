@@ -0,0 +1,68 @@
+// report_replay.h - Airtime saved and fidelity lost by the report policy, on host traces
+//
+// A drive trace is what the sensors saw, one row per second: the on-air
+// values of a 1 s IMU window (frame_layout.h), the GPS position, speed and
+// course, the temperature. replayDriveTrace() runs it through a sender:
+// either the sketch's ReportPolicy (report_policy.h), evaluated at its own
+// pace on the windows merged since the last evaluation, or the fixed
+// interval the firmware used before. Reported frames are batched into
+// uplinks by the rules of lora_manager.h (full batch, LORAWAN_MAX_BATCH_DELAY_MS,
+// urgent readings at once) under the EU868 1 % duty cycle, and every uplink
+// is charged its time on air.
+//
+// Fidelity is measured against the trace itself, second by second up to the
+// last report: the backend's track interpolated between the reported
+// positions, the temperature held from the last report, and each
+// acceleration event (a second whose peak reaches eventAccel) found or not
+// in the frames, with the delay from the event to the uplink that delivered
+// it.
+//
+// CSV, with a header line:
+//   t_ms,lat,lon,speed_cms,course_cdeg,temp_c,accel,accel_rms,jerk,gx,gy,gz
+// lat/lon in degrees * 1e7 and the motion columns in on-air units.
+#ifndef SIM_REPORT_REPLAY_H
+#define SIM_REPORT_REPLAY_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "report_policy.h"
+
+struct TracePoint {
+    uint32_t tMs;
+    SensorReading reading;
+    uint16_t speed;   // cm/s
+    uint16_t course;  // degrees * 100
+};
+
+bool loadDriveTrace(const std::string& path, std::vector<TracePoint>& out, std::string& error);
+bool saveDriveTrace(const std::string& path, const std::vector<TracePoint>& trace);
+
+// A synthetic day of one vehicle from seed: parked spells, town driving with
+// stops and turns, motorway, potholes and hard stops
+std::vector<TracePoint> synthesizeDriveTrace(uint64_t seed, uint32_t durationS);
+
+struct ReplayOptions {
+    bool adaptive = true;              // ReportPolicy; false: every fixedIntervalMs
+    ReportPolicyConfig policy;
+    uint32_t fixedIntervalMs = 30000;
+    uint8_t datarate = 3;
+    uint16_t eventAccel = 1500;        // m/s^2 * 100
+};
+
+struct ReplayResult {
+    uint64_t readings = 0;  // frames sent
+    uint64_t uplinks = 0;
+    uint64_t airtimeMs = 0;
+    uint32_t byReason[(size_t)ReportReason::Count] = {};
+    uint32_t rateLimited = 0;
+    double positionRmsM = 0, positionMaxM = 0;
+    double temperatureMeanErr = 0;
+    int temperatureMaxErr = 0;
+    uint32_t events = 0, eventsSeen = 0;
+    double eventDelayMeanS = 0, eventDelayMaxS = 0;
+};
+
+ReplayResult replayDriveTrace(const std::vector<TracePoint>& trace, const ReplayOptions& options);
+
+#endif
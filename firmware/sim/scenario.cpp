@@ -0,0 +1,137 @@
+// scenario.cpp - Scenario script parsing and NMEA synthesis
+#include "scenario.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include "nmea_parser.h"
+
+bool parseDurationMs(const std::string& s, uint64_t& ms) {
+    if (s.empty()) return false;
+    char* end;
+    double v = strtod(s.c_str(), &end);
+    if (end == s.c_str() || v < 0) return false;
+    std::string unit(end);
+    double scale = unit.empty() || unit == "s" ? 1000 : unit == "m" ? 60000 : unit == "h" ? 3600000
+                 : unit == "d" ? 86400000 : unit == "ms" ? 1 : -1;
+    if (scale < 0) return false;
+    ms = (uint64_t)std::llround(v * scale);
+    return true;
+}
+
+bool parseEpoch(const std::string& s, uint64_t& epoch) {
+    int y, mo, d, h, mi, sec;
+    if (sscanf(s.c_str(), "%d-%d-%dT%d:%d:%dZ", &y, &mo, &d, &h, &mi, &sec) == 6) {
+        if (mo < 1 || mo > 12 || d < 1 || d > 31 || h > 23 || mi > 59 || sec > 60) return false;
+        epoch = (uint64_t)(GpsFix::daysFromCivil(y, (unsigned)mo, (unsigned)d) * 86400 + h * 3600 + mi * 60 + sec);
+        return true;
+    }
+    char* end;
+    epoch = strtoull(s.c_str(), &end, 10);
+    return end != s.c_str() && *end == '\0';
+}
+
+bool Scenario::parse(const std::string& text, std::string& error) {
+    static const std::set<std::string> known = {"epoch", "fix", "nofix", "drive", "gps", "dht", "accel",
+                                                "imu", "radio", "press", "reboot", "off", "end"};
+    std::istringstream in(text);
+    std::string line;
+    uint64_t last = 0;
+    events.clear();
+    for (int lineNo = 1; std::getline(in, line); lineNo++) {
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+        std::istringstream words(line);
+        std::string at, command, arg;
+        if (!(words >> at)) continue;
+        ScenarioEvent ev{0, "", {}, lineNo};
+        if (!(words >> ev.command) || !parseDurationMs(at, ev.atMs)) {
+            error = "line " + std::to_string(lineNo) + ": expected <time> <command>";
+            return false;
+        }
+        while (words >> arg) ev.args.push_back(arg);
+        if (!known.count(ev.command)) {
+            error = "line " + std::to_string(lineNo) + ": unknown command '" + ev.command + "'";
+            return false;
+        }
+        if (ev.atMs < last) {
+            error = "line " + std::to_string(lineNo) + ": events must be in time order";
+            return false;
+        }
+        last = ev.atMs;
+
+        const size_t want = ev.command == "fix" || ev.command == "drive" || ev.command == "dht" ? 2
+                          : ev.command == "accel" ? 3
+                          : ev.command == "nofix" || ev.command == "reboot" || ev.command == "end" ? 0 : 1;
+        uint64_t unused;
+        if (ev.args.size() != want ||
+            ((ev.command == "press" || ev.command == "off") && !parseDurationMs(ev.args[0], unused)) ||
+            ((ev.command == "gps" || ev.command == "radio") && ev.args[0] != "on" && ev.args[0] != "off")) {
+            error = "line " + std::to_string(lineNo) + ": bad arguments for '" + ev.command + "'";
+            return false;
+        }
+        if (ev.command == "epoch") {
+            if (ev.atMs != 0 || !parseEpoch(ev.args[0], epoch)) {
+                error = "line " + std::to_string(lineNo) + ": epoch needs time 0 and a UTC time";
+                return false;
+            }
+            continue;
+        }
+        if (ev.command == "end") endMs = ev.atMs;
+        events.push_back(ev);
+    }
+    return true;
+}
+
+bool Scenario::load(const std::string& path, std::string& error) {
+    std::ifstream in(path);
+    if (!in) {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return parse(ss.str(), error);
+}
+
+namespace {
+
+std::string withChecksum(const std::string& body) {
+    uint8_t sum = 0;
+    for (char c : body) sum ^= (uint8_t)c;
+    char tail[8];
+    snprintf(tail, sizeof(tail), "*%02X\r\n", sum);
+    return "$" + body + tail;
+}
+
+// "4527.85210,N" style: degrees and decimal minutes
+std::string coord(double deg, bool latitude) {
+    char hemi = latitude ? (deg < 0 ? 'S' : 'N') : (deg < 0 ? 'W' : 'E');
+    deg = std::fabs(deg);
+    int whole = (int)deg;
+    double minutes = (deg - whole) * 60;
+    char buf[32];
+    snprintf(buf, sizeof(buf), latitude ? "%02d%08.5f,%c" : "%03d%08.5f,%c", whole, minutes, hemi);
+    return buf;
+}
+
+}  // namespace
+
+std::string nmeaSentences(uint64_t epoch, bool fix, double lat, double lon, double speed, double course) {
+    time_t t = (time_t)epoch;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char hms[32], dmy[32];
+    snprintf(hms, sizeof(hms), "%02d%02d%02d.00", tm.tm_hour, tm.tm_min, tm.tm_sec);
+    snprintf(dmy, sizeof(dmy), "%02d%02d%02d", tm.tm_mday, tm.tm_mon + 1, tm.tm_year % 100);
+    std::string pos = fix ? coord(lat, true) + "," + coord(lon, false) : ",,,";
+    char motion[32];
+    snprintf(motion, sizeof(motion), ",%.1f,%.1f,", speed / 0.514444, course);
+    return withChecksum(std::string("GPRMC,") + hms + (fix ? ",A," : ",V,") + pos + motion + dmy + ",,,A") +
+           withChecksum(std::string("GPGGA,") + hms + "," + pos + (fix ? ",1,08,0.9,120.0,M,47.0,M,," :
+                                                                         ",0,00,99.9,,M,,M,,"));
+}
@@ -0,0 +1,54 @@
+// scenario.h - Scripted outside world for bbsim
+//
+// One event per line, "<time> <command> [args]", in time order; '#' starts a
+// comment. Times and durations are seconds or take one s/m/h/d suffix
+// ("90", "15m", "1.5d").
+//
+//   0     epoch 2025-03-25T23:50:00Z   UTC at time 0 (or epoch seconds); first line
+//   0     fix 45.4642 9.1900           GPS position (the module keeps sending time)
+//   0     drive 14 90                  move from there at 14 m/s, course 90 deg (0 parks)
+//   0     nofix                        no position, time only
+//   0     gps off|on                   module silent / talking
+//   0     dht 22 40                    temperature (C), humidity (%)
+//   0     accel 0.1 0.2 9.81           accelerometer (m/s^2), single-reading path
+//   0     imu trace.csv                replay an MPU6050 trace through the FIFO (from the next boot)
+//   0     radio off|on                 network reachable or not
+//   10m   press 4s                     hold the button for a while
+//   1h    reboot                       reset now
+//   2h    off 30m                      power off for a while, then boot
+//   2d    end                          stop the simulation
+#ifndef SIM_SCENARIO_H
+#define SIM_SCENARIO_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ScenarioEvent {
+    uint64_t atMs;  // since time 0
+    std::string command;
+    std::vector<std::string> args;
+    int line;
+};
+
+struct Scenario {
+    uint64_t epoch = 1742860800;  // 2025-03-25 00:00:00 UTC
+    uint64_t endMs = 86400000;    // without an "end" event: one day
+    std::vector<ScenarioEvent> events;
+
+    // False with a message in error on a malformed script
+    bool parse(const std::string& text, std::string& error);
+    bool load(const std::string& path, std::string& error);
+};
+
+// "30", "30s", "15m", "6h", "2d" -> milliseconds; false if malformed
+bool parseDurationMs(const std::string& s, uint64_t& ms);
+// Epoch seconds or "YYYY-MM-DDThh:mm:ssZ"
+bool parseEpoch(const std::string& s, uint64_t& epoch);
+
+// The RMC + GGA pair a 1 Hz receiver sends for that UTC second; without a
+// fix the RMC still carries the time from the receiver's RTC. Speed over
+// ground in m/s (sent in knots), course in degrees.
+std::string nmeaSentences(uint64_t epoch, bool fix, double lat, double lon, double speed = 0, double course = 0);
+
+#endif
@@ -0,0 +1,131 @@
+// sketch_env.cpp - Pins and lockstep FreeRTOS tasks for the host sketch
+#include "sketch_env.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct SimTask {
+    TaskFunction_t fn;
+    void* arg;
+    std::thread thread;
+    uint32_t notified = 0;
+    bool suspended = false;
+    bool started = false;
+    bool finished = false;
+    bool restart = false;
+    uint64_t wakeAtMicros = 0;
+};
+
+namespace {
+
+int pins[64];
+bool pinsReady = false;
+
+std::mutex mutex;
+std::condition_variable turnChanged;
+SimTask* running = nullptr;  // the task that has the CPU, if any
+thread_local SimTask* self = nullptr;
+std::vector<std::unique_ptr<SimTask>> tasks;
+
+// Hands the CPU to t and waits until it is given back
+void resume(SimTask& t) {
+    std::unique_lock<std::mutex> lock(mutex);
+    running = &t;
+    if (!t.started) {
+        t.started = true;
+        t.thread = std::thread([&t] {
+            self = &t;
+            {
+                std::unique_lock<std::mutex> wait(mutex);
+                turnChanged.wait(wait, [&t] { return running == &t; });
+            }
+            try {
+                t.fn(t.arg);
+            } catch (const hal::host::RestartRequested&) {
+                t.restart = true;
+            }
+            std::lock_guard<std::mutex> done(mutex);
+            t.finished = true;
+            running = nullptr;
+            turnChanged.notify_all();
+        });
+        // Never joined: the simulator ends a boot with _exit()
+        t.thread.detach();
+    }
+    turnChanged.notify_all();
+    turnChanged.wait(lock, [] { return running == nullptr; });
+}
+
+}  // namespace
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    if (!pinsReady) {
+        for (int& p : pins) p = HIGH;
+        pinsReady = true;
+    }
+    (void)pin;
+    (void)mode;
+}
+
+int digitalRead(uint8_t pin) { return pinsReady && pin < 64 ? pins[pin] : HIGH; }
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stack, void* arg,
+                                   UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+    (void)name; (void)stack; (void)priority; (void)core;
+    tasks.push_back(std::make_unique<SimTask>());
+    tasks.back()->fn = fn;
+    tasks.back()->arg = arg;
+    if (handle) *handle = tasks.back().get();
+    return pdPASS;
+}
+
+void xTaskNotifyGive(TaskHandle_t task) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (task) task->notified++;
+}
+
+// On a task: gives the CPU back until notified or ticks ms have passed
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+    SimTask* t = self;
+    if (!t) return 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    if (t->notified == 0) {
+        t->wakeAtMicros = hal::host::device().micros + (uint64_t)ticks * 1000;
+        running = nullptr;
+        turnChanged.notify_all();
+        turnChanged.wait(lock, [t] { return running == t; });
+    }
+    uint32_t value = t->notified;
+    if (value > 0) t->notified = clearOnExit ? 0 : value - 1;
+    return value;
+}
+
+void vTaskSuspend(TaskHandle_t task) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (task) task->suspended = true;
+}
+
+namespace sim {
+
+void setPin(uint8_t pin, int level) {
+    if (!pinsReady) pinMode(pin, INPUT);
+    if (pin < 64) pins[pin] = level;
+}
+
+void runTasks() {
+    for (auto& t : tasks) {
+        bool due;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            due = !t->suspended && !t->finished &&
+                  (!t->started || t->notified > 0 || hal::host::device().micros >= t->wakeAtMicros);
+        }
+        if (due) resume(*t);
+        if (t->restart) throw hal::host::RestartRequested();
+    }
+}
+
+}  // namespace sim
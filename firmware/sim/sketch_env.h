@@ -0,0 +1,57 @@
+// sketch_env.h - What the Arduino core, FreeRTOS and ESP-IDF give LoRaSender.ino
+//
+// Enough of those APIs for bbsim to compile the sketch unchanged against the
+// host HAL. Pins read what the simulator sets. The transmit task is a real
+// thread, but it runs in lockstep with loop(): it only gets the CPU from
+// sim::runTasks() and gives it back when it waits in ulTaskNotifyTake(), so
+// a run is deterministic on the virtual clock.
+#ifndef SIM_SKETCH_ENV_H
+#define SIM_SKETCH_ENV_H
+
+#include <cstdint>
+#include "hal/hal.h"
+
+// ----- Arduino core -----
+#define LOW 0
+#define HIGH 1
+#define INPUT 0x01
+#define INPUT_PULLUP 0x05
+
+struct SimSerial {
+    void begin(unsigned long baud) { (void)baud; }
+};
+inline SimSerial Serial;
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+
+// ----- FreeRTOS -----
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void (*TaskFunction_t)(void*);
+typedef struct SimTask* TaskHandle_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))  // 1 kHz tick
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stack, void* arg,
+                                   UBaseType_t priority, TaskHandle_t* handle, BaseType_t core);
+void xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks);
+void vTaskSuspend(TaskHandle_t task);
+
+namespace sim {
+
+// What the outside world drives
+void setPin(uint8_t pin, int level);
+
+// Gives the CPU to every task that was notified or whose wait timed out,
+// until each waits again. Rethrows a restart requested on a task.
+void runTasks();
+
+}  // namespace sim
+
+#endif
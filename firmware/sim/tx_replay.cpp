@@ -0,0 +1,176 @@
+// tx_replay.cpp - Traffic mixes through the transmit scheduler and a lossy channel
+#include "tx_replay.h"
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include "lora_manager.h"
+#include "report_replay.h"
+
+namespace {
+
+uint64_t splitmix64(uint64_t& x) {
+    uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+struct Rng {
+    explicit Rng(uint64_t seed) : state(seed) {}
+    double uniform() { return (double)(splitmix64(state) >> 11) * 0x1.0p-53; }  // [0, 1)
+    bool chance(double p) { return uniform() < p; }
+    uint64_t state;
+};
+
+struct Arrival {
+    uint32_t tMs;
+    bool urgent;
+};
+
+// The readings the mix produces, in time order
+std::vector<Arrival> readingArrivals(const TxReplayOptions& o) {
+    std::vector<Arrival> out;
+    const uint64_t endMs = (uint64_t)o.durationS * 1000;
+    if (o.traffic == TrafficMix::Policy) {
+        ReportPolicy policy;
+        uint32_t nextEvalMs = 0;
+        for (const TracePoint& p : synthesizeDriveTrace(o.seed, o.durationS)) {
+            if (p.tMs < nextEvalMs) continue;
+            GpsFix fix;
+            fix.locationValid = fix.motionValid = true;
+            fix.lat = p.reading.lat;
+            fix.lon = p.reading.lon;
+            fix.speed = p.speed;
+            fix.course = p.course;
+            fix.locationMillis = p.tMs;
+            ReportReason reason = policy.evaluate(p.reading, fix, p.tMs);
+            if (reason != ReportReason::None) out.push_back({p.tMs, reportUrgent(reason)});
+            nextEvalMs = p.tMs + policy.evalIntervalMs();
+        }
+        return out;
+    }
+    const uint32_t interval = o.traffic == TrafficMix::Dense ? o.denseIntervalMs : o.readingIntervalMs;
+    for (uint64_t t = 0; interval > 0 && t < endMs; t += interval) out.push_back({(uint32_t)t, false});
+    return out;
+}
+
+}  // namespace
+
+const char* trafficMixName(TrafficMix m) {
+    static const char* const names[] = {"periodic", "policy", "events", "outage", "dense"};
+    return (size_t)m < (size_t)TrafficMix::Count ? names[(size_t)m] : "?";
+}
+
+bool parseTrafficMix(const std::string& s, TrafficMix& out) {
+    for (size_t i = 0; i < (size_t)TrafficMix::Count; i++) {
+        if (s == trafficMixName((TrafficMix)i)) {
+            out = (TrafficMix)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+ChannelModel goodChannel() { return {{0.99, 0.99, 0.99, 0.98, 0.97, 0.95}}; }
+ChannelModel edgeChannel() { return {{0.97, 0.95, 0.90, 0.75, 0.45, 0.20}}; }
+
+TxReplayResult replayTraffic(const TxReplayOptions& o) {
+    TxReplayResult res;
+    Rng rng(o.seed ^ 0x7478u);
+    TxScheduler sched(o.config);
+    const std::vector<Arrival> arrivals = readingArrivals(o);
+    const uint64_t endMs = (uint64_t)o.durationS * 1000;
+    const uint32_t outageFromMs = o.outageFromS * 1000, outageToMs = (o.outageFromS + o.outageS) * 1000;
+
+    std::deque<uint32_t> queue, events;  // when each reading / event frame was queued
+    std::deque<std::pair<uint32_t, uint32_t>> lastHour;  // (start, airtime) of the uplinks in the last hour
+    uint64_t hourMs = 0;
+    double readingDelaySum = 0, eventDelaySum = 0;
+    uint32_t gateMs = 0, lastUplinkMs = 0, pendingSinceMs = 0;
+    bool urgent = false;
+    size_t next = 0;
+
+    // One uplink on air: the channel, the airtime; the fixed rules leave the
+    // duty cycle to RadioLib's off-time
+    auto transmit = [&](uint32_t now, uint8_t dr, size_t len, TxClass c, size_t readings) {
+        const uint32_t toa = lorawanAirtimeMs(dr, len);
+        const bool ok = !(o.traffic == TrafficMix::Outage && now >= outageFromMs && now < outageToMs) &&
+                        rng.chance(o.channel.delivery[dr]);
+        if (!o.scheduler) gateMs = now + toa * 100;
+        res.uplinks++;
+        res.uplinksAt[dr]++;
+        res.byClass[(size_t)c]++;
+        res.airtimeMs += toa;
+        lastHour.push_back({now, toa});
+        hourMs += toa;
+        while (lastHour.front().first + TX_WINDOW_MS <= now) {
+            hourMs -= lastHour.front().second;
+            lastHour.pop_front();
+        }
+        res.maxHourAirtimeMs = std::max(res.maxHourAirtimeMs, (uint32_t)hourMs);
+        if (o.scheduler) sched.onSent(c, dr, toa, readings, ok, true, now);
+        return ok;
+    };
+
+    for (uint64_t t = 0; t < endMs; t += 1000) {
+        const uint32_t now = (uint32_t)t;
+        bool fresh = false;
+        for (; next < arrivals.size() && arrivals[next].tMs <= now; next++) {
+            if (queue.empty()) pendingSinceMs = now;
+            queue.push_back(arrivals[next].tMs);
+            urgent = urgent || arrivals[next].urgent;
+            sched.onQueued(now);
+            res.readings++;
+            fresh = true;
+        }
+        if (o.traffic == TrafficMix::Events && o.eventEveryS > 0 && now > 0 && now % (o.eventEveryS * 1000) == 0) {
+            for (uint8_t i = 0; i < o.eventFrames; i++) events.push_back(now);
+            res.eventFrames += o.eventFrames;
+        }
+        if (now < gateMs) continue;
+
+        // LoRaWAN_sendEvent(): ahead of any reading
+        if (!events.empty()) {
+            uint8_t dr = o.scheduler ? sched.eventDatarate(o.eventLen) : o.fixedDatarate;
+            if (o.scheduler && !sched.admit(TxClass::Event, lorawanAirtimeMs(dr, o.eventLen), now)) continue;
+            if (transmit(now, dr, o.eventLen, TxClass::Event, 0)) {
+                double delay = (now - events.front()) / 1000.0;
+                eventDelaySum += delay;
+                res.eventDelayMaxS = std::max(res.eventDelayMaxS, delay);
+                res.eventsDelivered++;
+                events.pop_front();
+            }
+            continue;
+        }
+
+        // LoRaWAN_send() on a new reading, LoRaWAN_poll() in between
+        if (queue.empty()) continue;
+        if (!fresh && !urgent && now - lastUplinkMs < LORAWAN_DRAIN_INTERVAL_MS) continue;
+        const size_t perUplink = readingsPerUplink(o.scheduler ? sched.datarate() : o.fixedDatarate);
+        if (!urgent && queue.size() < perUplink && now - pendingSinceMs < LORAWAN_MAX_BATCH_DELAY_MS) continue;
+
+        TxClass c = TxClass::Periodic;
+        uint8_t dr = o.fixedDatarate;
+        if (o.scheduler) {
+            c = sched.readingClass(now, LORAWAN_MAX_BATCH_DELAY_MS, urgent, perUplink);
+            dr = sched.nextDatarate();
+        }
+        const size_t n = std::min<size_t>(queue.size(), readingsPerUplink(dr));
+        const size_t len = readingsUplinkLen(n);
+        if (o.scheduler && !sched.admit(c, lorawanAirtimeMs(dr, len), now)) continue;
+        lastUplinkMs = now;
+        if (!transmit(now, dr, len, c, n)) continue;
+        for (size_t i = 0; i < n; i++) {
+            readingDelaySum += (now - queue.front()) / 1000.0;
+            queue.pop_front();
+        }
+        res.delivered += n;
+        if (queue.empty()) urgent = false;
+    }
+
+    res.backlog = queue.size();
+    if (res.delivered > 0) res.readingDelayMeanS = readingDelaySum / res.delivered;
+    if (res.eventsDelivered > 0) res.eventDelayMeanS = eventDelaySum / res.eventsDelivered;
+    return res;
+}
@@ -0,0 +1,74 @@
+// tx_replay.h - Goodput of the transmit scheduler under traffic mixes, on the host
+//
+// replayTraffic() feeds a day of traffic to one vehicle's transmit stage and
+// counts what gets through a lossy EU868 channel. The sender is either the
+// firmware's TxScheduler (tx_scheduler.h: priority classes, duty-cycle
+// budget, data rate chosen from the ACKs) or the fixed rules it replaced:
+// DR3, events first, full or overdue batches, and RadioLib's off-time
+// after every uplink for the 1 % of the sub-band. Both batch by the rules
+// of lora_manager.h and pace the backlog by LORAWAN_DRAIN_INTERVAL_MS.
+//
+// The channel acknowledges an uplink at data rate dr with probability
+// delivery[dr], independently (a vehicle at the edge of coverage loses the
+// fast data rates first); during an outage nothing gets through, but the
+// airtime is spent all the same.
+//
+// Traffic mixes:
+//   periodic  a reading every readingIntervalMs
+//   policy    the readings ReportPolicy sends on a synthetic day
+//             (report_replay.h), exceptions urgent
+//   events    periodic plus a crash every eventEveryS, eventFrames frames
+//   outage    periodic, with no coverage for outageS from outageFromS
+//   dense     a reading every denseIntervalMs, more than DR3 can carry
+#ifndef SIM_TX_REPLAY_H
+#define SIM_TX_REPLAY_H
+
+#include <cstdint>
+#include <string>
+#include "tx_scheduler.h"
+
+enum class TrafficMix : uint8_t { Periodic, Policy, Events, Outage, Dense, Count };
+
+const char* trafficMixName(TrafficMix m);
+bool parseTrafficMix(const std::string& s, TrafficMix& out);
+
+struct ChannelModel {
+    double delivery[TX_DATARATES];
+};
+
+// Near a gateway, and at the edge of its coverage
+ChannelModel goodChannel();
+ChannelModel edgeChannel();
+
+struct TxReplayOptions {
+    TrafficMix traffic = TrafficMix::Periodic;
+    bool scheduler = true;  // false: the fixed rules at fixedDatarate
+    TxSchedulerConfig config;
+    ChannelModel channel = goodChannel();
+    uint64_t seed = 1;
+    uint32_t durationS = 86400;
+    uint8_t fixedDatarate = 3;
+    uint32_t readingIntervalMs = 30000;
+    uint32_t denseIntervalMs = 5000;
+    uint32_t eventEveryS = 1200;
+    uint8_t eventFrames = 6;
+    uint8_t eventLen = 102;  // a full crash record (crash_recorder.h) as an event frame
+    uint32_t outageFromS = 6 * 3600;
+    uint32_t outageS = 2 * 3600;
+};
+
+struct TxReplayResult {
+    uint64_t readings = 0, delivered = 0;
+    uint64_t uplinks = 0, airtimeMs = 0;
+    uint32_t uplinksAt[TX_DATARATES] = {};
+    uint32_t byClass[(size_t)TxClass::Count] = {};
+    uint32_t maxHourAirtimeMs = 0;  // the busiest sliding hour
+    uint32_t eventFrames = 0, eventsDelivered = 0;
+    double eventDelayMeanS = 0, eventDelayMaxS = 0;
+    double readingDelayMeanS = 0;
+    uint64_t backlog = 0;  // readings still queued at the end
+};
+
+TxReplayResult replayTraffic(const TxReplayOptions& options);
+
+#endif
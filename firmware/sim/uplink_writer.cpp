@@ -0,0 +1,163 @@
+// uplink_writer.cpp - TTN uplink JSON / CSV formatting and the output targets
+#include "uplink_writer.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+std::string base64(const std::vector<uint8_t>& data) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    out.reserve((data.size() + 2) / 3 * 4);
+    for (size_t i = 0; i < data.size(); i += 3) {
+        uint32_t v = (uint32_t)data[i] << 16;
+        if (i + 1 < data.size()) v |= (uint32_t)data[i + 1] << 8;
+        if (i + 2 < data.size()) v |= data[i + 2];
+        out += alphabet[(v >> 18) & 63];
+        out += alphabet[(v >> 12) & 63];
+        out += i + 1 < data.size() ? alphabet[(v >> 6) & 63] : '=';
+        out += i + 2 < data.size() ? alphabet[v & 63] : '=';
+    }
+    return out;
+}
+
+// "2025-03-25T00:00:30.000Z"
+std::string isoTime(uint64_t epochMillis) {
+    time_t secs = (time_t)(epochMillis / 1000);
+    struct tm t;
+    gmtime_r(&secs, &t);
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%04d-%02d-%02dT%02d:%02d:%02d.%03uZ", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
+             t.tm_hour, t.tm_min, t.tm_sec, (unsigned)(epochMillis % 1000));
+    return buf;
+}
+
+// A stable 64-bit DevEUI per device id (FNV-1a), as hex
+std::string devEui(const std::string& deviceId) {
+    uint64_t h = 1469598103934665603ull;
+    for (char c : deviceId) h = (h ^ (uint8_t)c) * 1099511628211ull;
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llX", (unsigned long long)h);
+    return buf;
+}
+
+int connectUnix(const std::string& path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (connect(fd, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int connectTcp(const std::string& hostPort) {
+    size_t colon = hostPort.rfind(':');
+    if (colon == std::string::npos) return -1;
+    std::string host = hostPort.substr(0, colon), port = hostPort.substr(colon + 1);
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0) return -1;
+    int fd = -1;
+    for (addrinfo* a = res; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+}  // namespace
+
+bool UplinkWriter::open(const std::string& target, UplinkFormat fmt, bool append) {
+    close();
+    format = fmt;
+    lines = 0;
+    if (target.empty() || target == "-") {
+        out = stdout;
+        ownsOut = false;
+        return true;
+    }
+    int fd = -1;
+    if (target.compare(0, 5, "unix:") == 0) {
+        fd = connectUnix(target.substr(5));
+    } else if (target.compare(0, 4, "tcp:") == 0) {
+        fd = connectTcp(target.substr(4));
+    } else {
+        out = fopen(target.c_str(), append ? "a" : "w");
+        ownsOut = out != nullptr;
+        if (!out) fprintf(stderr, "cannot open %s\n", target.c_str());
+        return out != nullptr;
+    }
+    if (fd < 0 || !(out = fdopen(fd, "w"))) {
+        if (fd >= 0) ::close(fd);
+        fprintf(stderr, "cannot connect to %s\n", target.c_str());
+        return false;
+    }
+    ownsOut = true;
+    return true;
+}
+
+bool UplinkWriter::write(const SimUplink& up) {
+    if (!out) return false;
+    std::string line = format == UplinkFormat::Csv ? toCsv(up) : toTtnJson(up);
+    line += '\n';
+    if (fwrite(line.data(), 1, line.size(), out) != line.size()) return false;
+    lines++;
+    return true;
+}
+
+void UplinkWriter::close() {
+    if (!out) return;
+    if (ownsOut) fclose(out);
+    else fflush(out);
+    out = nullptr;
+    ownsOut = false;
+}
+
+std::string UplinkWriter::toTtnJson(const SimUplink& up, const char* applicationId) {
+    const std::string at = isoTime(up.atMillis);
+    const int sf = 12 - (up.datarate > 5 ? 5 : up.datarate);
+    char buf[160];
+    std::string s;
+    s.reserve(512 + up.payload.size() * 2);
+    s += "{\"end_device_ids\":{\"device_id\":\"" + up.deviceId + "\",\"application_ids\":{\"application_id\":\"";
+    s += applicationId;
+    s += "\"},\"dev_eui\":\"" + devEui(up.deviceId) + "\"},\"received_at\":\"" + at + "\",";
+    snprintf(buf, sizeof(buf), "\"uplink_message\":{\"f_port\":%u,\"f_cnt\":%u,\"frm_payload\":\"", up.port,
+             (unsigned)up.fCnt);
+    s += buf;
+    s += base64(up.payload);
+    snprintf(buf, sizeof(buf),
+             "\",\"settings\":{\"data_rate\":{\"lora\":{\"bandwidth\":125000,\"spreading_factor\":%d}},"
+             "\"frequency\":\"868100000\"},",
+             sf);
+    s += buf;
+    s += "\"received_at\":\"" + at + "\"}}";
+    return s;
+}
+
+std::string UplinkWriter::toCsv(const SimUplink& up) {
+    static const char digits[] = "0123456789abcdef";
+    std::string s = up.deviceId + "," + std::to_string(up.atMillis / 1000) + ",";
+    for (uint8_t b : up.payload) {
+        s += digits[b >> 4];
+        s += digits[b & 15];
+    }
+    s += "," + std::to_string(up.port);
+    return s;
+}
@@ -0,0 +1,51 @@
+// uplink_writer.h - Simulated uplinks out in the formats the backend ingests
+//
+// One uplink per line, either as The Things Stack v3 uplink JSON (the
+// "as/up" message of the MQTT and webhook integrations, with the fields an
+// ingestion service reads) or as a bbdecode frames.csv row
+// (vehicleId,receiveEpoch,payloadHex,fPort). The target is a file, "-" for
+// stdout, or a local socket: "unix:<path>" or "tcp:<host>:<port>".
+#ifndef SIM_UPLINK_WRITER_H
+#define SIM_UPLINK_WRITER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+struct SimUplink {
+    uint64_t atMillis;  // UTC epoch milliseconds at the gateway
+    std::string deviceId;
+    uint32_t fCnt;
+    uint8_t port;
+    uint8_t datarate;  // EU868 DR0..DR5
+    std::vector<uint8_t> payload;
+};
+
+enum class UplinkFormat : uint8_t { TtnJson, Csv };
+
+class UplinkWriter {
+public:
+    UplinkWriter() = default;
+    ~UplinkWriter() { close(); }
+    UplinkWriter(const UplinkWriter&) = delete;
+    UplinkWriter& operator=(const UplinkWriter&) = delete;
+
+    // False (with a message on stderr) if the target cannot be opened. A file
+    // is truncated unless append is set.
+    bool open(const std::string& target, UplinkFormat format, bool append = false);
+    bool write(const SimUplink& up);
+    void close();
+    size_t written() const { return lines; }
+
+    static std::string toTtnJson(const SimUplink& up, const char* applicationId = "blackbox");
+    static std::string toCsv(const SimUplink& up);
+
+private:
+    FILE* out = nullptr;
+    bool ownsOut = false;
+    UplinkFormat format = UplinkFormat::TtnJson;
+    size_t lines = 0;
+};
+
+#endif
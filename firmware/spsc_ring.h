@@ -0,0 +1,59 @@
+// spsc_ring.h - Fixed-size lock-free single-producer/single-consumer ring
+//
+// One side pushes (e.g. the UART receive callback), the other pops (the main
+// loop). Each index is written by one side only, so no lock is needed; the
+// release/acquire pair on it publishes the slots. A push into a full ring
+// fails and is counted instead of overwriting unread data.
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+template <typename T, size_t N>
+class SpscRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "capacity must be a power of two");
+
+public:
+    // Producer side
+    bool push(const T& v) { return push(&v, 1) == 1; }
+
+    // Pushes as many of v as fit; the rest is counted as dropped
+    size_t push(const T* v, size_t n) {
+        uint32_t head = headIdx.load(std::memory_order_relaxed);
+        size_t room = N - (size_t)(head - tailIdx.load(std::memory_order_acquire));
+        size_t k = n < room ? n : room;
+        for (size_t i = 0; i < k; i++) slots[(head + i) & (N - 1)] = v[i];
+        headIdx.store(head + (uint32_t)k, std::memory_order_release);
+        if (k < n) droppedCount.fetch_add((uint32_t)(n - k), std::memory_order_relaxed);
+        return k;
+    }
+
+    // Consumer side
+    bool pop(T& v) { return pop(&v, 1) == 1; }
+
+    size_t pop(T* out, size_t max) {
+        uint32_t tail = tailIdx.load(std::memory_order_relaxed);
+        size_t avail = (size_t)(headIdx.load(std::memory_order_acquire) - tail);
+        size_t k = max < avail ? max : avail;
+        for (size_t i = 0; i < k; i++) out[i] = slots[(tail + i) & (N - 1)];
+        tailIdx.store(tail + (uint32_t)k, std::memory_order_release);
+        return k;
+    }
+
+    // Either side; a snapshot that may be stale by the time it is used
+    size_t size() const {
+        return (size_t)(headIdx.load(std::memory_order_acquire) - tailIdx.load(std::memory_order_acquire));
+    }
+    static constexpr size_t capacity() { return N; }
+    uint32_t dropped() const { return droppedCount.load(std::memory_order_relaxed); }
+
+private:
+    T slots[N];
+    std::atomic<uint32_t> headIdx{0};
+    std::atomic<uint32_t> tailIdx{0};
+    std::atomic<uint32_t> droppedCount{0};
+};
+
+#endif
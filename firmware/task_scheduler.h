@@ -0,0 +1,287 @@
+// task_scheduler.h - Cooperative deadline scheduler for the main loop
+//
+// Tasks are released periodically (or on trigger() for event tasks with period
+// 0) and kept in a min-heap on their next release time, so the time to the
+// next wakeup is always the heap top. runDue() runs every released task once,
+// highest priority first; idle() then sleeps until the next release: light
+// sleep when the gap is long enough and nobody asked to stay awake, a plain
+// delay (FreeRTOS idle, peripherals still clocked) otherwise. Light sleep
+// stops both cores, so work on the other core can veto it through a sleep
+// gate that is asked at the moment of entry.
+//
+// Each task has a relative deadline (default: its period) by which a release
+// must have finished. Per task the scheduler records start jitter (start -
+// release), the longest run, deadline overruns and releases skipped because
+// the task fell more than a whole period behind.
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include "hal/hal.h"
+#include "log_manager.h"
+
+#define SCHEDULER_MAX_TASKS 8
+// Gaps shorter than this are not worth the light-sleep entry/exit cost
+#define SCHEDULER_LIGHT_SLEEP_MIN_MS 20
+// Longest single idle() so the loop still looks at its event flags now and then
+#define SCHEDULER_MAX_IDLE_MS 1000
+
+typedef void (*TaskFn)(void* ctx);
+// Asked right before light sleep (entering = true; false vetoes it) and told
+// when it ends (entering = false)
+typedef bool (*SleepGateFn)(void* ctx, bool entering);
+typedef uint8_t TaskId;
+constexpr TaskId TASK_INVALID = 0xFF;
+
+struct TaskStats {
+    uint32_t runs = 0;
+    uint32_t jitterMaxMs = 0;
+    uint64_t jitterSumMs = 0;
+    uint32_t execMaxMs = 0;
+    uint32_t overruns = 0;  // releases that finished after their deadline
+    uint32_t skipped = 0;   // releases dropped while the task was behind
+
+    uint32_t jitterMeanMs() const { return runs ? (uint32_t)(jitterSumMs / runs) : 0; }
+};
+
+class TaskScheduler {
+public:
+    // Adds a task released every periodMs starting firstDelayMs from now; with
+    // periodMs 0 it only runs when trigger()ed. Larger priority runs first.
+    // Returns TASK_INVALID when the table is full.
+    TaskId add(const char* name, uint32_t periodMs, uint8_t priority, TaskFn fn, void* ctx = nullptr,
+               uint32_t deadlineMs = 0, uint32_t firstDelayMs = 0) {
+        if (count == SCHEDULER_MAX_TASKS) return TASK_INVALID;
+        TaskId id = count++;
+        Task& t = tasks[id];
+        t.name = name;
+        t.fn = fn;
+        t.ctx = ctx;
+        t.period = periodMs;
+        t.deadline = deadlineMs ? deadlineMs : periodMs;
+        t.priority = priority;
+        t.heapPos = NOT_QUEUED;
+        t.stats = TaskStats();
+        if (periodMs > 0) schedule(id, hal::millis() + firstDelayMs);
+        return id;
+    }
+
+    // Releases a task delayMs from now, or earlier if it was already due sooner
+    void trigger(TaskId id, uint32_t delayMs = 0) {
+        if (id >= count) return;
+        uint32_t at = hal::millis() + delayMs;
+        Task& t = tasks[id];
+        if (t.heapPos != NOT_QUEUED && before(t.release, at)) return;
+        schedule(id, at);
+    }
+
+    // Stops a task until the next trigger()
+    void cancel(TaskId id) {
+        if (id < count && tasks[id].heapPos != NOT_QUEUED) remove(tasks[id].heapPos);
+    }
+
+    // Runs each released task at most once, highest priority first; returns how many ran
+    size_t runDue() {
+        uint32_t ran = 0;  // bitmask: a task that is due again right away waits for the next call
+        size_t n = 0;
+        while (heapLen > 0) {
+            uint32_t now = hal::millis();
+            size_t best = NOT_QUEUED;
+            pickDue(0, now, ran, best);
+            if (best == NOT_QUEUED) break;
+            TaskId id = heap[best];
+            remove(best);
+            ran |= 1u << id;
+            run(id, now);
+            n++;
+        }
+        return n;
+    }
+
+    // Milliseconds until the next release: 0 if one is due, UINT32_MAX with nothing queued
+    uint32_t msUntilNext() const {
+        if (heapLen == 0) return UINT32_MAX;
+        int32_t d = (int32_t)(tasks[heap[0]].release - hal::millis());
+        return d > 0 ? (uint32_t)d : 0;
+    }
+
+    // Keeps the CPU out of light sleep for the next ms (e.g. while a UART burst arrives)
+    void keepAwake(uint32_t ms) {
+        uint32_t until = hal::millis() + ms;
+        if (!awake || before(awakeUntil, until)) awakeUntil = until;
+        awake = true;
+    }
+
+    // Lets another core hold off light sleep while it must not be stopped
+    void setSleepGate(SleepGateFn fn, void* ctx = nullptr) {
+        gate = fn;
+        gateCtx = ctx;
+    }
+
+    // Waits for the next release, or SCHEDULER_MAX_IDLE_MS at most
+    void idle() {
+        uint32_t ms = msUntilNext();
+        if (ms == 0) return;
+        if (ms > SCHEDULER_MAX_IDLE_MS) ms = SCHEDULER_MAX_IDLE_MS;
+        uint32_t start = hal::millis();
+        if (awake && !before(awakeUntil, start)) {
+            hal::delay(ms);
+        } else {
+            awake = false;
+            if (ms < SCHEDULER_LIGHT_SLEEP_MIN_MS || (gate && !gate(gateCtx, true))) {
+                hal::delay(ms);
+            } else {
+                // Woken early by the button or the GPS UART: the loop looks at its flags and comes back
+                hal::lightSleep(ms);
+                if (gate) gate(gateCtx, false);
+                sleeps++;
+                sleptMs += hal::millis() - start;
+            }
+        }
+    }
+
+    const TaskStats& stats(TaskId id) const { return tasks[id].stats; }
+    const char* name(TaskId id) const { return tasks[id].name; }
+    size_t size() const { return count; }
+    uint32_t lightSleeps() const { return sleeps; }
+    uint64_t lightSleptMillis() const { return sleptMs; }
+
+    void resetStats() {
+        for (size_t i = 0; i < count; i++) tasks[i].stats = TaskStats();
+        sleeps = 0;
+        sleptMs = 0;
+    }
+
+    void logStats() const {
+        for (size_t i = 0; i < count; i++) {
+            const TaskStats& s = tasks[i].stats;
+            LOG_DEBUG("⏲️ %-8s runs=%u jitter avg/max=%u/%u ms exec max=%u ms overruns=%u skipped=%u",
+                      tasks[i].name, (unsigned)s.runs, (unsigned)s.jitterMeanMs(), (unsigned)s.jitterMaxMs,
+                      (unsigned)s.execMaxMs, (unsigned)s.overruns, (unsigned)s.skipped);
+        }
+        LOG_DEBUG("💤 light sleep: %u times, %lu ms", (unsigned)sleeps, (unsigned long)sleptMs);
+    }
+
+private:
+    static constexpr size_t NOT_QUEUED = 0xFF;
+    static_assert(SCHEDULER_MAX_TASKS <= 32, "runDue() tracks tasks in a 32-bit mask");
+
+    struct Task {
+        const char* name;
+        TaskFn fn;
+        void* ctx;
+        uint32_t period;
+        uint32_t deadline;
+        uint32_t release;
+        uint8_t priority;
+        uint8_t heapPos;
+        TaskStats stats;
+    };
+
+    // Wrap-safe a < b on the millis() clock
+    static bool before(uint32_t a, uint32_t b) { return (int32_t)(a - b) < 0; }
+
+    bool earlier(size_t a, size_t b) const {
+        const Task& x = tasks[heap[a]];
+        const Task& y = tasks[heap[b]];
+        if (x.release != y.release) return before(x.release, y.release);
+        return x.priority > y.priority;
+    }
+
+    // Released tasks form a subtree at the root of the heap: walk only that
+    void pickDue(size_t pos, uint32_t now, uint32_t ran, size_t& best) const {
+        if (pos >= heapLen || before(now, tasks[heap[pos]].release)) return;
+        const Task& t = tasks[heap[pos]];
+        if (!(ran & (1u << heap[pos])) &&
+            (best == NOT_QUEUED || t.priority > tasks[heap[best]].priority ||
+             (t.priority == tasks[heap[best]].priority && before(t.release, tasks[heap[best]].release)))) {
+            best = pos;
+        }
+        pickDue(2 * pos + 1, now, ran, best);
+        pickDue(2 * pos + 2, now, ran, best);
+    }
+
+    void run(TaskId id, uint32_t start) {
+        Task& t = tasks[id];
+        uint32_t release = t.release;
+        t.fn(t.ctx);
+        uint32_t end = hal::millis();
+
+        TaskStats& s = t.stats;
+        uint32_t jitter = start - release;
+        uint32_t exec = end - start;
+        s.runs++;
+        s.jitterSumMs += jitter;
+        if (jitter > s.jitterMaxMs) s.jitterMaxMs = jitter;
+        if (exec > s.execMaxMs) s.execMaxMs = exec;
+        if (end - release > t.deadline) s.overruns++;
+
+        // The task may have re-triggered itself
+        if (t.period == 0 || t.heapPos != NOT_QUEUED) return;
+        uint32_t next = release + t.period;
+        if ((int32_t)(end - next) >= (int32_t)t.period) {
+            // More than a period behind: drop the missed releases instead of bursting
+            uint32_t missed = (end - next) / t.period;
+            s.skipped += missed;
+            next += missed * t.period;
+        }
+        schedule(id, next);
+    }
+
+    void schedule(TaskId id, uint32_t at) {
+        if (tasks[id].heapPos != NOT_QUEUED) remove(tasks[id].heapPos);
+        tasks[id].release = at;
+        size_t pos = heapLen++;
+        heap[pos] = id;
+        tasks[id].heapPos = (uint8_t)pos;
+        siftUp(pos);
+    }
+
+    void remove(size_t pos) {
+        TaskId id = heap[pos];
+        tasks[id].heapPos = NOT_QUEUED;
+        if (--heapLen == pos) return;
+        heap[pos] = heap[heapLen];
+        tasks[heap[pos]].heapPos = (uint8_t)pos;
+        siftUp(pos);
+        siftDown(tasks[heap[pos]].heapPos);
+    }
+
+    void swap(size_t a, size_t b) {
+        TaskId t = heap[a];
+        heap[a] = heap[b];
+        heap[b] = t;
+        tasks[heap[a]].heapPos = (uint8_t)a;
+        tasks[heap[b]].heapPos = (uint8_t)b;
+    }
+
+    void siftUp(size_t pos) {
+        while (pos > 0 && earlier(pos, (pos - 1) / 2)) {
+            swap(pos, (pos - 1) / 2);
+            pos = (pos - 1) / 2;
+        }
+    }
+
+    void siftDown(size_t pos) {
+        while (true) {
+            size_t l = 2 * pos + 1, r = l + 1, m = pos;
+            if (l < heapLen && earlier(l, m)) m = l;
+            if (r < heapLen && earlier(r, m)) m = r;
+            if (m == pos) return;
+            swap(pos, m);
+            pos = m;
+        }
+    }
+
+    Task tasks[SCHEDULER_MAX_TASKS];
+    TaskId heap[SCHEDULER_MAX_TASKS];
+    size_t count = 0;
+    size_t heapLen = 0;
+    uint32_t awakeUntil = 0;
+    bool awake = false;
+    uint32_t sleeps = 0;
+    uint64_t sleptMs = 0;
+    SleepGateFn gate = nullptr;
+    void* gateCtx = nullptr;
+};
+
+#endif
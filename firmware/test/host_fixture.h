@@ -0,0 +1,44 @@
+// host_fixture.h - Common setup for host tests: private NVS dir, silent log, t=0
+#ifndef TEST_HOST_FIXTURE_H
+#define TEST_HOST_FIXTURE_H
+
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <string>
+#include <unistd.h>
+#include "hal/hal.h"
+#include "hal/hal_radio.h"
+
+constexpr const char* TEST_MASTER_KEY = "e17c9d5c6c7bc84123c0a4caeef53d4f246fb8ce22f39aad71bc5dde2e982921";
+constexpr const char* TEST_VEHICLE_ID = "veh-test-01";
+
+class HostTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        const ::testing::TestInfo* info = ::testing::UnitTest::GetInstance()->current_test_info();
+        storage = (std::filesystem::temp_directory_path() /
+                   ("bbx-" + std::string(info->test_suite_name()) + "-" + info->name() + "-" +
+                    std::to_string(getpid()))).string();
+        hal::host::setStorageDir(storage);
+        hal::host::wipeStorage();
+        hal::host::resetNvsWriteCount();
+        hal::host::setMillis(0);
+        hal::host::setLogEnabled(false);
+        hal::host::radioSink().reset();
+    }
+
+    void TearDown() override { hal::host::wipeStorage(); }
+
+    // What the first-boot console prompts would store
+    static void provision(const char* masterKey = TEST_MASTER_KEY, const char* vehicleId = TEST_VEHICLE_ID) {
+        hal::Preferences p;
+        p.begin("dailykeys", false);
+        p.putString("master_key", masterKey);
+        p.putString("vehicle_id", vehicleId);
+        p.end();
+    }
+
+    std::string storage;
+};
+
+#endif
@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include "compact_codec.h"
+
+namespace {
+
+// Plain-text decode of a frame straight from the encoder (nothing encrypted)
+bool decode(const uint8_t* frame, size_t len, const SensorReading* prev, SensorReading& out) {
+    compact::Fields f;
+    size_t enc = compact::decodeClear(frame, len, f);
+    if (enc == 0 || !compact::decodeEncrypted(frame + enc, len - enc, f)) return false;
+    out = compact::apply(prev, f);
+    return true;
+}
+
+bool same(const SensorReading& a, const SensorReading& b) {
+    return a.temperature == b.temperature && memcmp(a.gyro, b.gyro, sizeof(a.gyro)) == 0 && a.accel == b.accel &&
+           a.accelRms == b.accelRms && a.jerk == b.jerk && a.lat == b.lat && a.lon == b.lon;
+}
+
+SensorReading parked() { return {21, {1, -2, 0}, 985, 454642035, 91899820, 981, 12}; }
+
+}  // namespace
+
+TEST(CompactCodecTest, ZigzagVarintRoundTrip) {
+    for (int32_t v : {0, 1, -1, 63, -64, 64, 1000, -123456, INT32_MAX, INT32_MIN}) {
+        uint8_t buf[5];
+        size_t n = compact::putVarint(buf, compact::zigzag(v));
+        uint32_t z;
+        ASSERT_EQ(compact::getVarint(buf, buf + n, z), n);
+        EXPECT_EQ(compact::unzigzag(z), v);
+        if (n > 1) {
+            EXPECT_EQ(compact::getVarint(buf, buf + n - 1, z), 0u);
+        }
+    }
+}
+
+TEST(CompactCodecTest, KeyframeThenSmallDeltas) {
+    CompactEncoder enc(10);
+    SensorReading r = parked(), prev{};
+    uint8_t frame[32];
+    size_t encOffset;
+
+    size_t len = enc.encode(r, 0, frame, sizeof(frame), encOffset);
+    ASSERT_EQ(len, (size_t)COMPACT_KEYFRAME_SIZE);
+    EXPECT_EQ(frame[FRAME_FORMAT_OFFSET], COMPACT_FORMAT | COMPACT_KEYFRAME);
+    EXPECT_EQ(frame[encOffset], COMPACT_CHECK);
+    ASSERT_TRUE(decode(frame, len, nullptr, prev));
+    EXPECT_TRUE(same(prev, r));
+
+    // Slow drive (~10 m per frame): 14 bytes instead of 26
+    for (uint32_t c = 1; c < 10; c++) {
+        r.temperature += (c % 3) - 1;
+        r.gyro[0] = (int8_t)(c * 3);
+        r.lat += 90;
+        r.lon -= 40;
+        len = enc.encode(r, c, frame, sizeof(frame), encOffset);
+        EXPECT_EQ(frame[FRAME_FORMAT_OFFSET], COMPACT_FORMAT) << c;
+        EXPECT_LE(len, 14u) << c;
+        SensorReading next;
+        ASSERT_TRUE(decode(frame, len, &prev, next)) << c;
+        EXPECT_TRUE(same(next, r)) << c;
+        prev = next;
+    }
+}
+
+TEST(CompactCodecTest, KeyframeEveryInterval) {
+    CompactEncoder enc(4);
+    uint8_t frame[32];
+    size_t encOffset;
+    for (uint32_t c = 0; c < 12; c++) {
+        enc.encode(parked(), c, frame, sizeof(frame), encOffset);
+        EXPECT_EQ((frame[FRAME_FORMAT_OFFSET] & COMPACT_KEYFRAME) != 0, c % 4 == 0) << c;
+    }
+}
+
+TEST(CompactCodecTest, GapOrResetForcesKeyframe) {
+    CompactEncoder enc;
+    uint8_t frame[32];
+    size_t encOffset;
+    enc.encode(parked(), 7, frame, sizeof(frame), encOffset);
+    enc.encode(parked(), 8, frame, sizeof(frame), encOffset);
+    EXPECT_EQ(frame[FRAME_FORMAT_OFFSET], COMPACT_FORMAT);
+
+    enc.encode(parked(), 10, frame, sizeof(frame), encOffset);  // frame 9 never built
+    EXPECT_EQ(frame[FRAME_FORMAT_OFFSET], COMPACT_FORMAT | COMPACT_KEYFRAME);
+
+    enc.encode(parked(), 11, frame, sizeof(frame), encOffset);
+    EXPECT_EQ(frame[FRAME_FORMAT_OFFSET], COMPACT_FORMAT);
+    enc.reset();
+    enc.encode(parked(), 12, frame, sizeof(frame), encOffset);
+    EXPECT_EQ(frame[FRAME_FORMAT_OFFSET], COMPACT_FORMAT | COMPACT_KEYFRAME);
+}
+
+TEST(CompactCodecTest, LargeJumpsWrapAndNeverExceedKeyframe) {
+    CompactEncoder enc(1000);
+    SensorReading a = {127, {-128, 127, 0}, 0, INT32_MAX, INT32_MIN, UINT16_MAX, 0};
+    SensorReading b = {-128, {127, -128, 5}, UINT16_MAX, INT32_MIN, INT32_MAX, 0, UINT16_MAX};
+    SensorReading prev{}, next;
+    uint8_t frame[32];
+    size_t encOffset;
+    for (uint32_t c = 0; c < 6; c++) {
+        const SensorReading& r = c % 2 ? b : a;
+        size_t len = enc.encode(r, c, frame, sizeof(frame), encOffset);
+        ASSERT_LE(len, (size_t)COMPACT_KEYFRAME_SIZE);
+        ASSERT_TRUE(decode(frame, len, c ? &prev : nullptr, next)) << c;
+        EXPECT_TRUE(same(next, r)) << c;
+        prev = next;
+    }
+}
+
+TEST(CompactCodecTest, RejectsMalformedFrames) {
+    CompactEncoder enc;
+    uint8_t frame[32];
+    size_t encOffset;
+    size_t len = enc.encode(parked(), 0, frame, sizeof(frame), encOffset);
+    SensorReading out;
+    EXPECT_FALSE(decode(frame, len - 1, nullptr, out));
+    EXPECT_EQ(enc.encode(parked(), 1, frame, COMPACT_KEYFRAME_SIZE - 1, encOffset), 0u);
+
+    len = enc.encode(parked(), 1, frame, sizeof(frame), encOffset);
+    frame[encOffset] ^= 0xFF;  // what a wrong key looks like
+    EXPECT_FALSE(decode(frame, len, &out, out));
+
+    frame[FRAME_FORMAT_OFFSET] = CLEAR_BLOCK_LEN;
+    EXPECT_FALSE(compact::isCompact(frame, len));
+}
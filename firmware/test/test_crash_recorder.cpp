@@ -0,0 +1,253 @@
+#include "host_fixture.h"
+#include "crash_recorder.h"
+#include "lora_manager.h"
+#include "mpu6050_fifo.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+using TestRecorder = CrashRecorder<16, 16, 4>;
+
+// 3 g catches the pothole in the trace (3.5 g); jerk alone never triggers
+constexpr CrashThresholds POTHOLE = {2942, UINT16_MAX};
+
+uint16_t get16(const uint8_t* p) { return (uint16_t)(p[0] | p[1] << 8); }
+uint32_t get32(const uint8_t* p) { return get16(p) | (uint32_t)get16(p + 2) << 16; }
+
+}  // namespace
+
+class CrashRecorderTest : public HostTest {
+protected:
+    void SetUp() override {
+        HostTest::SetUp();
+        sim = std::make_unique<hal::host::Mpu6050Sim>(
+            hal::host::loadImuTrace(std::string(IMU_TRACE_DIR) + "/imu_pothole_1khz.csv"));
+        bus.hostAttach(MPU6050_ADDR, sim.get());
+        ASSERT_TRUE(imu.begin(1000));
+        for (int i = 0; i < 16; i++) key[i] = (uint8_t)(0x30 + i);
+    }
+
+    void TearDown() override {
+        hal::host::dropDeviceLocal<LoRaWANState>();
+        HostTest::TearDown();
+    }
+
+    // The sampling stage: drains the FIFO every 40 ms for ms
+    void run(TestRecorder& rec, uint32_t ms) {
+        for (uint32_t t = 0; t < ms; t += 40) {
+            hal::host::advanceMillis(40);
+            imu.drain(window);
+            rec.service();
+        }
+    }
+
+    std::unique_ptr<hal::host::Mpu6050Sim> sim;
+    TwoWire bus;
+    Mpu6050Fifo imu{bus};
+    ImuWindow window;
+    uint8_t key[16];
+};
+
+TEST_F(CrashRecorderTest, TriggerFreezesPreWindowToFlash) {
+    TestRecorder rec(POTHOLE);
+    ASSERT_TRUE(rec.begin(imu.scale()));
+    imu.setTap(TestRecorder::tap, &rec);
+
+    run(rec, 400);
+    EXPECT_EQ(rec.events(), 0u);
+    EXPECT_EQ(rec.storedRecords(), 0u);
+
+    // The pothole starts at 400 ms; the drain at 440 ms sees it. Summary and
+    // two chunks of pre-trigger samples are in flash before drain() returns.
+    run(rec, 40);
+    EXPECT_EQ(rec.events(), 1u);
+    EXPECT_TRUE(rec.capturing());
+    EXPECT_EQ(rec.storedRecords(), 3u);
+    EXPECT_GT(rec.lastLatencyUs(), 0u);
+    EXPECT_LE(rec.lastLatencyUs(), 40000u);
+
+    // 16 post-trigger samples at 50 Hz take 320 ms, then the recorder re-arms
+    run(rec, 320);
+    EXPECT_FALSE(rec.capturing());
+    EXPECT_EQ(rec.storedRecords(), 5u);
+    EXPECT_EQ(rec.lostRecords(), 0u);
+
+    // The calm rest of the trace does not trigger, nor does 3.5 g at the default 4 g
+    run(rec, 240);
+    EXPECT_EQ(rec.events(), 1u);
+    TestRecorder defaults;
+    ASSERT_TRUE(defaults.begin(imu.scale()));
+    imu.setTap(TestRecorder::tap, &defaults);
+    run(defaults, 1000);
+    EXPECT_EQ(defaults.events(), 0u);
+}
+
+TEST_F(CrashRecorderTest, EventGoesOutAheadOfReadingsWithinDutyCycle) {
+    LoRaWAN_setup();
+    lorawan().node->setDutyCycle(true);
+    MessageCounter counter;
+    GpsFix gps;
+    PayloadManager pm(nullptr, nullptr, &gps, key, &counter, false);
+
+    TestRecorder rec(POTHOLE);
+    ASSERT_TRUE(rec.begin(imu.scale()));
+    rec.setEncoder(&pm);
+    imu.setTap(TestRecorder::tap, &rec);
+    LoRaWAN_setEventSource(&rec);
+
+    gps.locationValid = true;
+    gps.lat = 454642035;
+    gps.lon = 91899820;
+    gps.locationMillis = 100;
+    rec.observeGps(gps);
+
+    // A reading is waiting for its batch when the crash happens
+    uint8_t reading[PAYLOAD_SIZE] = {0};
+    EXPECT_FALSE(LoRaWAN_send(reading, sizeof(reading)));
+    run(rec, 760);
+    ASSERT_EQ(rec.storedRecords(), 6u);  // summary, GPS, 2 pre, 2 post
+
+    // One event frame per uplink, each as soon as the duty cycle allows
+    const auto& uplinks = hal::host::radioSink().uplinks;
+    std::vector<std::vector<uint8_t>> frames;
+    for (int i = 0; i < 200 && frames.size() < 6; i++) {
+        uint32_t wait = lorawan().node->timeUntilUplink();
+        hal::host::advanceMillis(wait);
+        size_t before = uplinks.size();
+        EXPECT_EQ(LoRaWAN_poll(), 0);
+        if (uplinks.size() == before) {
+            ADD_FAILURE() << "no uplink although the duty cycle allowed one";
+            break;
+        }
+        const auto& up = uplinks.back();
+        EXPECT_EQ(up.port, FPORT_EVENT);
+        EXPECT_EQ(up.atMillis - (before ? uplinks[before - 1].atMillis : up.atMillis), before ? wait : 0u);
+        frames.push_back(up.data);
+        rec.service();
+    }
+    ASSERT_EQ(frames.size(), 6u);
+    EXPECT_FALSE(rec.pending());
+    EXPECT_EQ(rec.storedRecords(), 0u);
+    EXPECT_EQ(lorawan().uplinkQueue.size(), 1u);  // the reading waits behind the event
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        auto& f = frames[i];
+        ASSERT_GE(f.size(), (size_t)EVENT_HEADER_LEN);
+        EXPECT_EQ(f[FRAME_FORMAT_OFFSET], EVENT_FORMAT);
+        EXPECT_EQ(f[FRAME_FORMAT_OFFSET + 1], 0);  // event id
+        EXPECT_EQ(f[FRAME_FORMAT_OFFSET + 2], i);
+        EXPECT_EQ(f[FRAME_FORMAT_OFFSET + 3], 6);
+        uint8_t iv[16] = {f[0], f[1]};
+        hal::aes128Ctr(key, iv, f.data() + EVENT_HEADER_LEN, f.size() - EVENT_HEADER_LEN);
+    }
+
+    const uint8_t* summary = frames[0].data() + EVENT_HEADER_LEN;
+    ASSERT_EQ(frames[0].size(), (size_t)EVENT_HEADER_LEN + CRASH_SUMMARY_BYTES);
+    EXPECT_EQ((int32_t)get32(summary + 4), 454642035);
+    EXPECT_EQ((int32_t)get32(summary + 8), 91899820);
+    EXPECT_GT(get16(summary + 12), 2942);  // |a| of the triggering sample
+    EXPECT_EQ(get16(summary + 16), 50);    // Hz
+    EXPECT_EQ(get16(summary + 18), 4096);  // LSB per g
+    EXPECT_EQ(get16(summary + 22), 16);    // pre
+    EXPECT_EQ(get16(summary + 24), 16);    // post
+    EXPECT_EQ(summary[26], 1);             // GPS points
+
+    // GPS point, relative to the trigger around 415 ms
+    const uint8_t* point = frames[1].data() + EVENT_HEADER_LEN;
+    int32_t dt = (int32_t)get32(point);
+    EXPECT_LT(dt, -250);
+    EXPECT_GT(dt, -400);
+
+    // Sample 16 is the 50 Hz slot holding the trigger: well above 3 g
+    const uint8_t* s = frames[4].data() + EVENT_HEADER_LEN;
+    double g = std::sqrt(std::pow((int16_t)get16(s), 2) + std::pow((int16_t)get16(s + 2), 2) +
+                         std::pow((int16_t)get16(s + 4), 2)) / 4096;
+    EXPECT_GT(g, 3.0);
+
+    // With the event delivered the batch goes out again
+    hal::host::advanceMillis(lorawan().node->timeUntilUplink());
+    EXPECT_EQ(LoRaWAN_flush(true), 1);
+}
+
+TEST_F(CrashRecorderTest, EventDeferredByTheBudgetTakesNoCounter) {
+    LoRaWAN_setup();
+    MessageCounter counter;
+    GpsFix gps;
+    PayloadManager pm(nullptr, nullptr, &gps, key, &counter, false);
+
+    TestRecorder rec(POTHOLE);
+    ASSERT_TRUE(rec.begin(imu.scale()));
+    rec.setEncoder(&pm);
+    imu.setTap(TestRecorder::tap, &rec);
+    LoRaWAN_setEventSource(&rec);
+    run(rec, 760);
+    ASSERT_TRUE(rec.pending());
+
+    // The hour's airtime is gone: every poll defers the event
+    lorawan().txScheduler.onSent(TxClass::Event, 3, DutyCycleBudget::allowanceMs(SubBand::G1), 0, true, true,
+                                 hal::millis());
+    const auto& uplinks = hal::host::radioSink().uplinks;
+    const size_t before = uplinks.size();
+    for (int i = 0; i < 30; i++) {
+        hal::host::advanceMillis(1000);
+        EXPECT_EQ(LoRaWAN_poll(), 0);
+    }
+    EXPECT_EQ(uplinks.size(), before);
+    EXPECT_GT(lorawan().txScheduler.deferred(TxClass::Event), 0u);
+    EXPECT_EQ(counter.peek(), 0u);
+
+    // Once the budget is back it goes out with the first counter value
+    hal::host::advanceMillis(TX_WINDOW_BINS * TX_BIN_MS);
+    LoRaWAN_poll();
+    ASSERT_EQ(uplinks.size(), before + 1);
+    EXPECT_EQ(uplinks.back().data[0], 0);
+    EXPECT_EQ(uplinks.back().data[1], 0);
+    EXPECT_EQ(counter.peek(), 1u);
+}
+
+TEST_F(CrashRecorderTest, FrozenEventSurvivesReboot) {
+    {
+        TestRecorder rec(POTHOLE);
+        ASSERT_TRUE(rec.begin(imu.scale()));
+        imu.setTap(TestRecorder::tap, &rec);
+        run(rec, 440);
+        ASSERT_EQ(rec.events(), 1u);
+        ASSERT_EQ(rec.storedRecords(), 3u);
+        imu.setTap(nullptr);
+    }
+    // Power lost mid-capture: what was frozen is sent after the reboot, and
+    // the next event gets a new id
+    TestRecorder rec(POTHOLE);
+    ASSERT_TRUE(rec.begin(imu.scale()));
+    EXPECT_EQ(rec.storedRecords(), 3u);
+    rec.service();
+    EXPECT_TRUE(rec.pending());
+
+    MessageCounter counter;
+    GpsFix gps;
+    PayloadManager pm(nullptr, nullptr, &gps, key, &counter, false);
+    rec.setEncoder(&pm);
+    uint8_t frame[LORAWAN_MAX_UPLINK];
+    ASSERT_GT(rec.next(frame, sizeof(frame)), 0u);
+    EXPECT_EQ(frame[FRAME_FORMAT_OFFSET + 1], 0);
+
+    imu.setTap(TestRecorder::tap, &rec);
+    hal::host::advanceMillis(520);
+    imu.drain(window);  // overflowed meanwhile
+    run(rec, 480);      // the trace loops: the pothole again at 1400 ms
+    EXPECT_EQ(rec.events(), 1u);
+    EXPECT_EQ(rec.storedRecords(), 6u);
+
+    for (int i = 0; i < 3; i++) {
+        ASSERT_GT(rec.next(frame, sizeof(frame)), 0u);
+        EXPECT_EQ(frame[FRAME_FORMAT_OFFSET + 1], 0);
+        EXPECT_EQ(frame[FRAME_FORMAT_OFFSET + 2], i);
+        rec.delivered();
+        rec.service();
+    }
+    ASSERT_GT(rec.next(frame, sizeof(frame)), 0u);
+    EXPECT_EQ(frame[FRAME_FORMAT_OFFSET + 1], 1);
+    EXPECT_EQ(rec.storedRecords(), 3u);
+}
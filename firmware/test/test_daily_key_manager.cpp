@@ -0,0 +1,142 @@
+#include "host_fixture.h"
+#include "daily_key_manager.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr time_t START_EPOCH = 1742860800;  // 2025-03-25 00:00:00 UTC
+
+void hexToBytes(const char* hex, std::vector<uint8_t>& out) {
+    for (size_t i = 0; hex[i] && hex[i + 1]; i += 2) {
+        char byte[3] = {hex[i], hex[i + 1], 0};
+        out.push_back((uint8_t)strtol(byte, nullptr, 16));
+    }
+}
+
+void appendEpochBE(std::vector<uint8_t>& data, uint64_t epoch) {
+    for (int i = 7; i >= 0; i--) data.push_back((uint8_t)(epoch >> (8 * i)));
+}
+
+// Same derivation as frontend/src/utils/crypto.js generateDailyKeySHA256
+void referenceKey(int day, uint8_t out[DAILY_KEY_SIZE], const char* vehicleId = TEST_VEHICLE_ID) {
+    std::vector<uint8_t> data;
+    hexToBytes(TEST_MASTER_KEY, data);
+    data.insert(data.end(), vehicleId, vehicleId + strlen(vehicleId));
+    appendEpochBE(data, START_EPOCH);
+    uint8_t hash[32];
+    hal::sha256(data.data(), data.size(), hash);
+    memcpy(out, hash, DAILY_KEY_SIZE);
+
+    for (int i = 1; i <= day; i++) {
+        data.assign(out, out + DAILY_KEY_SIZE);
+        data.insert(data.end(), vehicleId, vehicleId + strlen(vehicleId));
+        appendEpochBE(data, START_EPOCH + (time_t)i * SECONDS_PER_DAY);
+        hal::sha256(data.data(), data.size(), hash);
+        memcpy(out, hash, DAILY_KEY_SIZE);
+    }
+}
+
+}  // namespace
+
+using DailyKeyManagerTest = HostTest;
+
+TEST_F(DailyKeyManagerTest, FirstBootDerivesFromMasterKey) {
+    provision();
+    DailyKeyManager km;
+    km.init();
+
+    uint8_t expected[DAILY_KEY_SIZE];
+    referenceKey(0, expected);
+    EXPECT_EQ(memcmp(km.getDailyKey(), expected, DAILY_KEY_SIZE), 0);
+}
+
+TEST_F(DailyKeyManagerTest, DayRolloverChainsAndResetsCounter) {
+    provision();
+    DailyKeyManager km;
+    km.init();
+
+    {
+        hal::Preferences counter;
+        counter.begin("payload", false);
+        counter.putUInt("counter", 123);
+    }
+
+    EXPECT_FALSE(km.checkAndUpdateDailyKey(START_EPOCH + 3600));
+    EXPECT_TRUE(km.checkAndUpdateDailyKey(START_EPOCH + SECONDS_PER_DAY + 3600));
+
+    uint8_t expected[DAILY_KEY_SIZE];
+    referenceKey(1, expected);
+    EXPECT_EQ(memcmp(km.getDailyKey(), expected, DAILY_KEY_SIZE), 0);
+
+    hal::Preferences counter;
+    counter.begin("payload", true);
+    EXPECT_EQ(counter.getUInt("counter", 99), 0u);
+}
+
+TEST_F(DailyKeyManagerTest, RolloverRestartsLiveCounter) {
+    provision();
+    MessageCounter counter;
+    DailyKeyManager km;
+    km.setMessageCounter(&counter);
+    km.init();
+    for (int i = 0; i < 10; i++) counter.next();
+
+    hal::host::resetNvsWriteCount();
+    EXPECT_TRUE(km.checkAndUpdateDailyKey(START_EPOCH + SECONDS_PER_DAY));
+    EXPECT_EQ(counter.next(), 0u);
+    EXPECT_EQ(counter.next(), 1u);
+}
+
+TEST_F(DailyKeyManagerTest, KeySurvivesReboot) {
+    provision();
+    uint8_t before[DAILY_KEY_SIZE];
+    {
+        DailyKeyManager km;
+        km.init();
+        memcpy(before, km.getDailyKey(), DAILY_KEY_SIZE);
+    }
+    hal::host::setStorageDir(storage);
+    DailyKeyManager km;
+    km.init();
+    EXPECT_EQ(memcmp(km.getDailyKey(), before, DAILY_KEY_SIZE), 0);
+}
+
+TEST_F(DailyKeyManagerTest, ResetMasterKeyRestarts) {
+    provision();
+    DailyKeyManager km;
+    km.init();
+    EXPECT_THROW(km.resetMasterKey(), hal::host::RestartRequested);
+}
+
+TEST_F(DailyKeyManagerTest, CatchesUpEveryMissedDay) {
+    provision();
+    DailyKeyManager km;
+    km.init();
+
+    // Switched off for three weeks: the key must be the chain's day-21 key, not one step
+    EXPECT_TRUE(km.checkAndUpdateDailyKey(START_EPOCH + 21 * SECONDS_PER_DAY + 600));
+    uint8_t expected[DAILY_KEY_SIZE];
+    referenceKey(21, expected);
+    EXPECT_EQ(memcmp(km.getDailyKey(), expected, DAILY_KEY_SIZE), 0);
+
+    EXPECT_TRUE(km.checkAndUpdateDailyKey(START_EPOCH + 22 * SECONDS_PER_DAY));
+    referenceKey(22, expected);
+    EXPECT_EQ(memcmp(km.getDailyKey(), expected, DAILY_KEY_SIZE), 0);
+}
+
+TEST_F(DailyKeyManagerTest, LongVehicleIdsChainLikeShortOnes) {
+    const std::string vid = "fleet-" + std::string(120, 'x');
+    provision(TEST_MASTER_KEY, vid.c_str());
+    DailyKeyManager km;
+    km.init();
+    uint8_t expected[DAILY_KEY_SIZE];
+    referenceKey(0, expected, vid.c_str());
+    EXPECT_EQ(memcmp(km.getDailyKey(), expected, DAILY_KEY_SIZE), 0);
+
+    EXPECT_TRUE(km.checkAndUpdateDailyKey(START_EPOCH + 3 * SECONDS_PER_DAY));
+    referenceKey(3, expected, vid.c_str());
+    EXPECT_EQ(memcmp(km.getDailyKey(), expected, DAILY_KEY_SIZE), 0);
+}
@@ -0,0 +1,130 @@
+#include "host_fixture.h"
+#include "flash_queue.h"
+
+#include <algorithm>
+
+class FlashQueueTest : public HostTest {
+protected:
+    void SetUp() override {
+        HostTest::SetUp();
+        hal::host::resetFlashStats();
+        hal::host::setFlashPartitionSize(8 * hal::FlashPartition::SECTOR_SIZE);
+    }
+    void TearDown() override {
+        queue.end();
+        hal::host::setFlashPartitionSize(256 * 1024);
+        HostTest::TearDown();
+    }
+
+    void reboot() {
+        queue.end();
+        ASSERT_TRUE(queue.begin("test"));
+    }
+
+    static std::vector<uint8_t> record(uint32_t seq, size_t len = 21) {
+        std::vector<uint8_t> r(len, (uint8_t)(seq * 7));
+        memcpy(r.data(), &seq, sizeof(seq));
+        return r;
+    }
+
+    // Sequence numbers of every pending record, oldest first
+    std::vector<uint32_t> pendingSeqs() {
+        std::vector<uint32_t> seqs;
+        uint8_t buf[FLASH_QUEUE_MAX_RECORD];
+        size_t len;
+        for (FlashQueue::Cursor c = queue.front(); queue.read(c, buf, sizeof(buf), len);) {
+            uint32_t seq;
+            memcpy(&seq, buf, sizeof(seq));
+            EXPECT_EQ(std::vector<uint8_t>(buf, buf + len), record(seq, len));
+            seqs.push_back(seq);
+        }
+        return seqs;
+    }
+
+    static std::vector<uint32_t> range(uint32_t from, uint32_t to) {
+        std::vector<uint32_t> v;
+        for (uint32_t i = from; i < to; i++) v.push_back(i);
+        return v;
+    }
+
+    FlashQueue queue;
+};
+
+TEST_F(FlashQueueTest, AppendsAndReadsInOrderAcrossSectors) {
+    reboot();
+    for (uint32_t i = 0; i < 400; i++) ASSERT_TRUE(queue.append(record(i).data(), 21));
+    EXPECT_EQ(queue.size(), 400u);
+    EXPECT_EQ(pendingSeqs(), range(0, 400));
+}
+
+TEST_F(FlashQueueTest, ReadStopsAtRecordsLongerThanCap) {
+    reboot();
+    queue.append(record(1, 40).data(), 40);
+    uint8_t buf[64];
+    size_t len;
+    FlashQueue::Cursor c = queue.front();
+    EXPECT_FALSE(queue.read(c, buf, 39, len));
+    EXPECT_EQ(len, 40u);
+    EXPECT_TRUE(queue.read(c, buf, sizeof(buf), len));
+}
+
+TEST_F(FlashQueueTest, HeadAndTailSurviveReboot) {
+    reboot();
+    for (uint32_t i = 0; i < 300; i++) queue.append(record(i).data(), 21);
+    EXPECT_EQ(queue.consume(180), 180u);
+
+    reboot();
+    EXPECT_EQ(queue.size(), 120u);
+    EXPECT_EQ(pendingSeqs(), range(180, 300));
+
+    for (uint32_t i = 300; i < 310; i++) queue.append(record(i).data(), 21);
+    reboot();
+    EXPECT_EQ(pendingSeqs(), range(180, 310));
+}
+
+TEST_F(FlashQueueTest, AppendAndConsumeNeverErase) {
+    reboot();
+    uint32_t erases = queue.erases();
+    for (uint32_t i = 0; i < 150; i++) queue.append(record(i).data(), 21);
+    queue.consume(150);
+    EXPECT_EQ(queue.erases(), erases);
+}
+
+TEST_F(FlashQueueTest, FullPartitionDropsOldestSector) {
+    reboot();
+    // 170 records per sector, 8 sectors
+    const uint32_t total = 8 * 170 + 10;
+    for (uint32_t i = 0; i < total; i++) ASSERT_TRUE(queue.append(record(i).data(), 21));
+    EXPECT_EQ(queue.dropped(), 170u);
+    EXPECT_EQ(pendingSeqs(), range(170, total));
+
+    reboot();
+    EXPECT_EQ(pendingSeqs(), range(170, total));
+}
+
+TEST_F(FlashQueueTest, TornAppendIsSkippedAfterReboot) {
+    reboot();
+    for (uint32_t i = 0; i < 5; i++) queue.append(record(i).data(), 21);
+    hal::host::tearNextFlashWrite(10);
+    EXPECT_FALSE(queue.append(record(5).data(), 21));
+
+    reboot();
+    EXPECT_EQ(queue.size(), 5u);
+    ASSERT_TRUE(queue.append(record(6).data(), 21));
+    reboot();
+    EXPECT_EQ(pendingSeqs(), (std::vector<uint32_t>{0, 1, 2, 3, 4, 6}));
+}
+
+TEST_F(FlashQueueTest, WearIsSpreadOverAllSectors) {
+    reboot();
+    uint32_t seq = 0;
+    for (int lap = 0; lap < 20 * 8; lap++) {
+        for (int i = 0; i < 170; i++, seq++) queue.append(record(seq).data(), 21);
+        queue.consume(170);
+    }
+    const std::vector<uint32_t>& erases = hal::host::flashSectorErases("test");
+    ASSERT_EQ(erases.size(), 8u);
+    auto [lo, hi] = std::minmax_element(erases.begin(), erases.end());
+    EXPECT_GE(*lo, 19u);
+    EXPECT_LE(*hi - *lo, 1u);
+}
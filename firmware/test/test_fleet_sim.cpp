@@ -0,0 +1,146 @@
+#include "host_fixture.h"
+#include "fleet_sim.h"
+#include "frame_layout.h"
+#include "gps_manager.h"
+#include "scenario.h"
+#include "uplink_writer.h"
+
+#include <map>
+
+namespace {
+
+FleetConfig smallFleet(unsigned threads) {
+    FleetConfig cfg;
+    cfg.vehicles = 12;
+    cfg.threads = threads;
+    cfg.durationS = 2 * 86400;
+    cfg.rebootsPerDay = 4;
+    cfg.sliceS = 3600;
+    return cfg;
+}
+
+std::vector<SimUplink> runFleet(FleetSimulator& fleet) {
+    std::vector<SimUplink> out;
+    fleet.run([&](const SimUplink& up) { out.push_back(up); });
+    return out;
+}
+
+}  // namespace
+
+using FleetSimTest = HostTest;
+
+TEST_F(FleetSimTest, OutputDoesNotDependOnThreads) {
+    FleetSimulator one(smallFleet(1)), four(smallFleet(4));
+    EXPECT_EQ(four.threads(), 4u);
+    auto a = runFleet(one), b = runFleet(four);
+    ASSERT_EQ(a.size(), b.size());
+    ASSERT_GT(a.size(), 0u);
+    for (size_t i = 0; i < a.size(); i++) {
+        EXPECT_EQ(a[i].atMillis, b[i].atMillis) << i;
+        EXPECT_EQ(a[i].deviceId, b[i].deviceId) << i;
+        EXPECT_EQ(a[i].payload, b[i].payload) << i;
+        if (i > 0) {
+            EXPECT_LE(a[i - 1].atMillis, a[i].atMillis);
+        }
+    }
+    ASSERT_EQ(one.vehicles().size(), 12u);
+    EXPECT_EQ(one.vehicles()[3].masterKeyHex, four.vehicles()[3].masterKeyHex);
+    EXPECT_EQ(one.vehicles()[3].startEpoch, 1742860800u);
+
+    FleetStats st = one.stats();
+    EXPECT_EQ(st.uplinks, a.size());
+    EXPECT_GT(st.reboots, 12u);
+    EXPECT_EQ(st.keyRollovers, 12u);  // one midnight each
+    // The report policy kept most readings off the air, and the flash queue
+    // batched the rest: every uplink took at least one frame
+    EXPECT_GT(st.suppressed, st.frames);
+    EXPECT_LT(st.uplinks, st.frames);
+    // The simulation ran on the vehicles' own devices
+    EXPECT_EQ(hal::millis(), 0u);
+    EXPECT_EQ(hal::host::nvsWriteCount(), 0u);
+}
+
+TEST_F(FleetSimTest, RebootsNeverReuseACounter) {
+    FleetSimulator fleet(smallFleet(2));
+    auto uplinks = runFleet(fleet);
+
+    // Within a day the frame counters only go up, across every reboot; they
+    // start again once, at midnight
+    std::map<std::string, std::pair<int, uint32_t>> seen;  // resets, last counter
+    std::map<std::string, uint32_t> fCnt;
+    for (const SimUplink& up : uplinks) {
+        auto f = fCnt.find(up.deviceId);
+        EXPECT_EQ(up.fCnt, f == fCnt.end() ? 0u : f->second + 1);
+        fCnt[up.deviceId] = up.fCnt;
+
+        std::vector<const uint8_t*> frames;
+        if (up.port == FPORT_FRAME) {
+            frames.push_back(up.payload.data());
+        } else {
+            ASSERT_EQ(up.port, FPORT_AGGREGATE);
+            const uint8_t* p = up.payload.data() + AGGREGATE_HEADER_LEN;
+            for (uint8_t i = 0; i < up.payload[0]; i++, p += AGGREGATE_ENTRY_OVERHEAD + p[0]) frames.push_back(p + 1);
+        }
+        for (const uint8_t* frame : frames) {
+            uint32_t counter = frame[0] | frame[1] << 8;
+            auto it = seen.find(up.deviceId);
+            if (it != seen.end() && counter <= it->second.second) it->second.first++;
+            seen[up.deviceId] = {it != seen.end() ? it->second.first : 0, counter};
+        }
+    }
+    EXPECT_EQ(seen.size(), 12u);
+    for (const auto& [id, s] : seen) EXPECT_EQ(s.first, 1) << id;
+}
+
+TEST(UplinkWriterTest, FormatsTtnJsonAndCsv) {
+    SimUplink up = {1742947230500, "veh-00007", 41, FPORT_AGGREGATE, 3, {0x01, 0xfe, 0x10}};
+    EXPECT_EQ(UplinkWriter::toCsv(up), "veh-00007,1742947230,01fe10,2");
+
+    std::string json = UplinkWriter::toTtnJson(up);
+    EXPECT_NE(json.find("\"device_id\":\"veh-00007\""), std::string::npos);
+    EXPECT_NE(json.find("\"received_at\":\"2025-03-26T00:00:30.500Z\""), std::string::npos);
+    EXPECT_NE(json.find("\"f_port\":2,\"f_cnt\":41,\"frm_payload\":\"Af4Q\""), std::string::npos);
+    EXPECT_NE(json.find("\"spreading_factor\":9"), std::string::npos);
+    EXPECT_EQ(json.find('\n'), std::string::npos);
+}
+
+TEST(ScenarioTest, ParsesScriptAndRejectsMistakes) {
+    Scenario sc;
+    std::string error;
+    ASSERT_TRUE(sc.parse("# drive\n"
+                         "0 epoch 2025-03-25T23:50:00Z\n"
+                         "0 fix 45.4642 9.19\n"
+                         "90 radio off\n"
+                         "15m press 4s\n"
+                         "1.5h off 30m\n"
+                         "2d end\n",
+                         error))
+        << error;
+    EXPECT_EQ(sc.epoch, 1742946600u);
+    EXPECT_EQ(sc.endMs, 2 * 86400000u);
+    ASSERT_EQ(sc.events.size(), 5u);
+    EXPECT_EQ(sc.events[1].atMs, 90000u);
+    EXPECT_EQ(sc.events[3].atMs, 5400000u);
+    EXPECT_EQ(sc.events[3].args[0], "30m");
+
+    EXPECT_FALSE(Scenario().parse("0 warp 9\n", error));
+    EXPECT_NE(error.find("line 1"), std::string::npos);
+    EXPECT_FALSE(Scenario().parse("10m fix 45\n", error));
+    EXPECT_FALSE(Scenario().parse("10m radio off\n5m radio on\n", error));
+    EXPECT_FALSE(Scenario().parse("10m epoch 0\n", error));
+}
+
+TEST(ScenarioTest, NmeaReachesTheParser) {
+    NmeaParser p;
+    for (char c : nmeaSentences(1742947230, true, 45.4642035, -9.189982)) p.encode(c);
+    ASSERT_TRUE(p.fix().locationValid);
+    EXPECT_NEAR(p.fix().lat, 454642035, 2);
+    EXPECT_NEAR(p.fix().lon, -91899820, 2);
+    EXPECT_EQ(p.fix().epoch(), 1742947230u);
+
+    NmeaParser q;
+    for (char c : nmeaSentences(1742947231, false, 0, 0)) q.encode(c);
+    EXPECT_FALSE(q.fix().locationValid);
+    ASSERT_TRUE(q.fix().timeValid);
+    EXPECT_EQ(q.fix().epoch(), 1742947231u);
+}
@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include "frame_layout.h"
+
+namespace {
+
+// A schema with channels TelemetryFrame does not have, clear and encrypted interleaved
+struct ExtendedReading {
+    int8_t temperature;
+    uint8_t humidity;
+    int16_t pressure[2];
+    int32_t lat;
+};
+
+using ExtendedFrame = schema::Frame<
+    FRAME_IV_LEN, schema::Field<0x01, schema::Block::Clear, 1, &ExtendedReading::temperature>,
+    schema::Field<0x07, schema::Block::Encrypted, 1, &ExtendedReading::pressure>,
+    schema::Field<0x06, schema::Block::Clear, 1, &ExtendedReading::humidity>,
+    schema::Field<0x05, schema::Block::Encrypted, 10000000, &ExtendedReading::lat>>;
+
+static_assert(ExtendedFrame::clearLen == 4);
+static_assert(ExtendedFrame::encryptedLen == 5 + 5);
+static_assert(ExtendedFrame::offsetOf<2>() == FRAME_IV_LEN + 1 + 2);
+static_assert(ExtendedFrame::offsetOf<3>() == ExtendedFrame::encryptedOffset + 5);
+static_assert(ExtendedFrame::values == 5 && ExtendedFrame::clearValues == 2);
+
+}  // namespace
+
+TEST(FrameSchemaTest, TelemetryFrameMatchesDocumentedLayout) {
+    EXPECT_EQ(TelemetryFrame::offsetOf<0>(), 3u);
+    EXPECT_EQ(TelemetryFrame::offsetOf<1>(), 5u);
+    EXPECT_EQ(TelemetryFrame::offsetOf<2>(), 10u);
+    EXPECT_EQ(TelemetryFrame::offsetOf<3>(), 17u);
+
+    SensorReading r = {-4, {12, -5, 30}, 981, 454642035, -91899820, 300, 1234};
+    uint8_t frame[PAYLOAD_SIZE] = {0};
+    TelemetryFrame::write(r, frame);
+    const uint8_t expected[] = {0, 0, 6, 0x01, 0xFC, 0x03, 12, 0xFB, 30, 16, 0x04, 0xD5, 0x03, 0x2C, 0x01, 0xD2, 0x04, 0x05};
+    EXPECT_EQ(memcmp(frame, expected, sizeof(expected)), 0);
+    int32_t lon;
+    memcpy(&lon, frame + 22, 4);
+    EXPECT_EQ(lon, -91899820);
+
+    SensorReading back{};
+    ASSERT_TRUE(TelemetryFrame::readClear(frame, back));
+    ASSERT_TRUE(TelemetryFrame::readEncrypted(frame + FRAME_ENCRYPTED_OFFSET, back));
+    EXPECT_EQ(back.accelRms, 300);
+    EXPECT_EQ(back.jerk, 1234);
+}
+
+TEST(FrameSchemaTest, ReadsBackWhatItWrites) {
+    ExtendedReading in = {-12, 80, {1013, -2}, 454642035}, out{};
+    uint8_t frame[ExtendedFrame::size];
+    ExtendedFrame::write(in, frame);
+    ASSERT_TRUE(ExtendedFrame::readClear(frame, out));
+    ASSERT_TRUE(ExtendedFrame::readEncrypted(frame + ExtendedFrame::encryptedOffset, out));
+    EXPECT_EQ(out.temperature, -12);
+    EXPECT_EQ(out.humidity, 80);
+    EXPECT_EQ(out.pressure[0], 1013);
+    EXPECT_EQ(out.pressure[1], -2);
+    EXPECT_EQ(out.lat, 454642035);
+
+    int32_t v[ExtendedFrame::values];
+    ExtendedFrame::toValues(in, v);
+    const int32_t order[] = {-12, 80, 1013, -2, 454642035};  // clear block first
+    EXPECT_EQ(memcmp(v, order, sizeof(v)), 0);
+    ExtendedReading back{};
+    ExtendedFrame::fromValues(v, back);
+    EXPECT_EQ(back.pressure[1], -2);
+}
+
+TEST(FrameSchemaTest, RejectsWrongLengthsAndMarkers) {
+    SensorReading r = {20, {0, 0, 0}, 9, 1, 2, 9, 0}, out{};
+    uint8_t frame[PAYLOAD_SIZE];
+    TelemetryFrame::write(r, frame);
+
+    frame[TelemetryFrame::offsetOf<1>()] = 0x02;
+    EXPECT_FALSE(TelemetryFrame::readClear(frame, out));
+    TelemetryFrame::write(r, frame);
+    frame[FRAME_ENCRYPTED_LEN_OFFSET] = 12;
+    EXPECT_FALSE(TelemetryFrame::readClear(frame, out));
+
+    TelemetryFrame::write(r, frame);
+    frame[TelemetryFrame::offsetOf<3>()] ^= 0x40;
+    EXPECT_FALSE(TelemetryFrame::readEncrypted(frame + FRAME_ENCRYPTED_OFFSET, out));
+}
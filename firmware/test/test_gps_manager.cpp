@@ -0,0 +1,138 @@
+#include "host_fixture.h"
+#include "gps_manager.h"
+
+#include <string>
+
+namespace {
+
+// Wraps a sentence body in '$', checksum and CR LF
+std::string nmea(const std::string& body) {
+    uint8_t sum = 0;
+    for (char c : body) sum ^= (uint8_t)c;
+    char tail[8];
+    snprintf(tail, sizeof(tail), "*%02X\r\n", sum);
+    return "$" + body + tail;
+}
+
+const std::string RMC_MILAN = "GPRMC,101530.00,A,4527.85221,N,00911.39892,E,0.02,,170326,,,A";
+const std::string GGA_MILAN = "GNGGA,101530.00,4527.85221,N,00911.39892,E,1,09,0.9,120.0,M,47.0,M,,";
+
+}  // namespace
+
+TEST(NmeaParserTest, ParsesRmcPositionAndTime) {
+    NmeaParser p;
+    std::string s = nmea(RMC_MILAN);
+    for (char c : s) p.encode(c);
+    const GpsFix& fix = p.fix();
+    ASSERT_TRUE(fix.locationValid);
+    EXPECT_EQ(fix.lat, 454642035);
+    EXPECT_EQ(fix.lon, 91899820);
+    ASSERT_TRUE(fix.timeValid);
+    EXPECT_EQ(fix.epoch(), 1773742530u);  // 2026-03-17 10:15:30 UTC
+}
+
+TEST(NmeaParserTest, ParsesRmcSpeedAndCourse) {
+    NmeaParser p;
+    for (char c : nmea(RMC_MILAN)) p.encode(c);
+    ASSERT_TRUE(p.fix().motionValid);
+    EXPECT_EQ(p.fix().speed, 1);  // 0.02 kn, no course while standing still
+    EXPECT_EQ(p.fix().course, 0);
+    for (char c : nmea("GPRMC,101531.00,A,4527.85221,N,00911.39892,E,25.3,271.45,170326,,,A")) p.encode(c);
+    EXPECT_EQ(p.fix().speed, 1302);
+    EXPECT_EQ(p.fix().course, 27145);
+    // The course survives a sentence without one, the speed needs a fix
+    for (char c : nmea("GPRMC,101532.00,A,4527.85221,N,00911.39892,E,0.1,,170326,,,A")) p.encode(c);
+    EXPECT_EQ(p.fix().speed, 5);
+    EXPECT_EQ(p.fix().course, 27145);
+    for (char c : nmea("GPRMC,101533.00,V,,,,,,,170326,,,N")) p.encode(c);
+    EXPECT_FALSE(p.fix().motionValid);
+}
+
+TEST(NmeaParserTest, ParsesGgaAndSouthWest) {
+    NmeaParser p;
+    std::string s = nmea("GPGGA,000001.00,3351.12345,S,15112.54321,W,2,12,0.7,10.0,M,0.0,M,,");
+    for (char c : s) p.encode(c);
+    ASSERT_TRUE(p.fix().locationValid);
+    EXPECT_EQ(p.fix().lat, -338520575);
+    EXPECT_EQ(p.fix().lon, -1512090535);
+    EXPECT_EQ(p.fix().satellites, 12);
+    EXPECT_FALSE(p.fix().timeValid);  // GGA has no date
+}
+
+TEST(NmeaParserTest, DropsBadChecksumsAndResyncsOnDollar) {
+    NmeaParser p;
+    std::string bad = nmea(RMC_MILAN);
+    bad[10] = '9';
+    std::string noise(300, 'x');
+    std::string stream = bad + noise + "$GPRMC,12" + nmea(GGA_MILAN);
+    for (char c : stream) p.encode(c);
+    EXPECT_EQ(p.checksumErrors(), 1u);
+    EXPECT_EQ(p.sentences(), 1u);
+    EXPECT_TRUE(p.fix().locationValid);
+    EXPECT_EQ(p.fix().satellites, 9);
+}
+
+TEST(NmeaParserTest, LosingTheFixClearsLocationButKeepsTime) {
+    NmeaParser p;
+    std::string s = nmea(RMC_MILAN) + nmea("GPRMC,101531.00,V,,,,,,,170326,,,N");
+    for (char c : s) p.encode(c);
+    EXPECT_FALSE(p.fix().locationValid);
+    EXPECT_TRUE(p.fix().timeValid);
+    EXPECT_EQ(p.fix().second, 31);
+}
+
+TEST(NmeaParserTest, CivilDays) {
+    EXPECT_EQ(GpsFix::daysFromCivil(1970, 1, 1), 0);
+    EXPECT_EQ(GpsFix::daysFromCivil(2000, 3, 1), 11017);
+    EXPECT_EQ(GpsFix::daysFromCivil(2024, 12, 31), 20088);
+}
+
+class GpsMonitorTest : public HostTest {
+protected:
+    HardwareSerial serial{2};
+    GPSMonitor gps{serial};
+};
+
+TEST_F(GpsMonitorTest, KeepsUpdatingAfterTheFix) {
+    gps.begin(9600, 46, 45);
+    serial.hostInject(nmea(RMC_MILAN));
+    gps.update();
+    gps.monitorGPS();
+    ASSERT_TRUE(gps.isFixAcquired());
+    EXPECT_EQ(gps.getGPSEpoch(), (time_t)1773742530);
+
+    // The vehicle moves on and time goes on: both must follow
+    hal::host::advanceMillis(60000);
+    serial.hostInject(nmea("GPRMC,101630.00,A,4528.00000,N,00911.39892,E,25.0,,170326,,,A"));
+    gps.update();
+    EXPECT_EQ(gps.getFix().lat, 454666667);
+    EXPECT_EQ(gps.getGPSEpoch(), (time_t)1773742590);
+}
+
+TEST_F(GpsMonitorTest, TimeGoesStaleWhenTheGpsIsQuiet) {
+    gps.begin(9600, 46, 45);
+    serial.hostInject(nmea(RMC_MILAN));
+    gps.update();
+    hal::host::advanceMillis(3500);
+    EXPECT_EQ(gps.getGPSEpoch(), (time_t)1773742533);
+    hal::host::advanceMillis(GPS_TIME_STALE_MS);
+    EXPECT_EQ(gps.getGPSEpoch(), 0);
+}
+
+TEST_F(GpsMonitorTest, BoundedWorkAndMemoryUnderABurst) {
+    gps.begin(9600, 46, 45);
+    // More than the ring holds arrives before the loop runs: the excess is
+    // dropped, the parser recovers on the next sentence
+    std::string burst;
+    while (burst.size() < GPS_RING_SIZE + 500) burst += nmea(GGA_MILAN);
+    for (size_t i = 0; i < burst.size(); i += 200) serial.hostInject(burst.substr(i, 200));
+    serial.hostInject(nmea(RMC_MILAN));
+
+    for (int i = 0; i < 20; i++) gps.update();  // GPS_PARSE_BUDGET bytes per call
+    EXPECT_TRUE(gps.isFixAcquired());
+    EXPECT_EQ(gps.getFix().satellites, 9);
+
+    serial.hostInject(nmea(RMC_MILAN));
+    gps.update();
+    EXPECT_TRUE(gps.getFix().timeValid);
+}
@@ -0,0 +1,187 @@
+#include "host_fixture.h"
+
+#include <cstring>
+#include <thread>
+
+using HalHostTest = HostTest;
+
+TEST_F(HalHostTest, PreferencesPersistAcrossReload) {
+    {
+        hal::Preferences p;
+        p.begin("payload", false);
+        p.putUInt("counter", 42);
+        p.putULong64("epoch", 1742860800ULL);
+        p.putString("name", "abc");
+        uint8_t blob[3] = {1, 2, 3};
+        p.putBytes("blob", blob, sizeof(blob));
+    }
+
+    // Forget the in-memory image; everything must come back from disk
+    hal::host::setStorageDir(storage);
+
+    hal::Preferences p;
+    p.begin("payload", true);
+    EXPECT_EQ(p.getUInt("counter"), 42u);
+    EXPECT_EQ(p.getULong64("epoch"), 1742860800ULL);
+    EXPECT_EQ(p.getString("name"), String("abc"));
+    uint8_t blob[8] = {0};
+    EXPECT_EQ(p.getBytes("blob", blob, sizeof(blob)), 3u);
+    EXPECT_EQ(blob[2], 3);
+    EXPECT_EQ(p.getUInt("missing", 7), 7u);
+    EXPECT_EQ(p.putUInt("counter", 1), 0u) << "read-only handle must not write";
+}
+
+TEST_F(HalHostTest, PreferencesHandlesShareNamespace) {
+    hal::Preferences a, b;
+    a.begin("payload", false);
+    b.begin("payload", false);
+    a.putUInt("counter", 5);
+    EXPECT_EQ(b.getUInt("counter"), 5u);
+    EXPECT_EQ(hal::host::nvsWriteCount(), 1u);
+    b.clear();
+    EXPECT_FALSE(a.isKey("counter"));
+}
+
+TEST_F(HalHostTest, VirtualClock) {
+    EXPECT_EQ(hal::millis(), 0u);
+    hal::delay(250);
+    hal::host::advanceMillis(750);
+    EXPECT_EQ(hal::millis(), 1000u);
+}
+
+TEST_F(HalHostTest, DeviceScopeGivesEachThreadItsOwnBoard) {
+    hal::host::advanceMillis(5);
+    auto board = [](uint32_t ms, uint32_t value, uint32_t& seen, uint32_t& clock) {
+        hal::host::Device dev;  // no storage dir: NVS in RAM only
+        hal::host::DeviceScope scope(dev);
+        hal::Preferences p;
+        p.begin("payload", false);
+        p.putUInt("counter", value);
+        hal::host::advanceMillis(ms);
+        seen = p.getUInt("counter");
+        clock = hal::millis();
+    };
+    uint32_t seen[2], clock[2];
+    std::thread a(board, 100, 1, std::ref(seen[0]), std::ref(clock[0]));
+    std::thread b(board, 200, 2, std::ref(seen[1]), std::ref(clock[1]));
+    a.join();
+    b.join();
+    EXPECT_EQ(seen[0], 1u);
+    EXPECT_EQ(seen[1], 2u);
+    EXPECT_EQ(clock[0], 100u);
+    EXPECT_EQ(clock[1], 200u);
+
+    // The default device was left alone
+    EXPECT_EQ(hal::millis(), 5u);
+    EXPECT_EQ(hal::host::nvsWriteCount(), 0u);
+    hal::Preferences p;
+    p.begin("payload", true);
+    EXPECT_FALSE(p.isKey("counter"));
+
+    // Scopes nest and restore what was bound before
+    hal::host::Device outer, inner;
+    hal::host::DeviceScope o(outer);
+    hal::host::advanceMillis(7);
+    {
+        hal::host::DeviceScope i(inner);
+        EXPECT_EQ(hal::millis(), 0u);
+    }
+    EXPECT_EQ(hal::millis(), 7u);
+}
+
+TEST_F(HalHostTest, RestartThrows) {
+    EXPECT_THROW(hal::restart(), hal::host::RestartRequested);
+}
+
+TEST_F(HalHostTest, Sha256KnownAnswer) {
+    uint8_t out[32];
+    hal::sha256(reinterpret_cast<const uint8_t*>("abc"), 3, out);
+    const uint8_t expected[32] = {0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40,
+                                  0xde, 0x5d, 0xae, 0x22, 0x23, 0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17,
+                                  0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad};
+    EXPECT_EQ(memcmp(out, expected, 32), 0);
+
+    // Two-block padding path (56..63 byte tail)
+    const char* msg = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    hal::sha256(reinterpret_cast<const uint8_t*>(msg), strlen(msg), out);
+    EXPECT_EQ(out[0], 0x24);
+    EXPECT_EQ(out[31], 0xc1);
+}
+
+TEST_F(HalHostTest, Aes128CtrKnownAnswer) {
+    // FIPS-197 C.1: CTR over zeros with IV = plaintext yields the block cipher output
+    uint8_t key[16], iv[16], data[16] = {0};
+    for (int i = 0; i < 16; i++) {
+        key[i] = (uint8_t)i;
+        iv[i] = (uint8_t)(i * 0x11);
+    }
+    hal::aes128Ctr(key, iv, data, 16);
+    const uint8_t expected[16] = {0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+                                  0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a};
+    EXPECT_EQ(memcmp(data, expected, 16), 0);
+
+    // CTR is an involution
+    uint8_t text[40];
+    for (int i = 0; i < 40; i++) text[i] = (uint8_t)(i * 7);
+    uint8_t copy[40];
+    memcpy(copy, text, 40);
+    hal::aes128Ctr(key, iv, text, 40);
+    EXPECT_NE(memcmp(text, copy, 40), 0);
+    hal::aes128Ctr(key, iv, text, 40);
+    EXPECT_EQ(memcmp(text, copy, 40), 0);
+}
+
+TEST_F(HalHostTest, Sha256StreamsAcrossBlocks) {
+    uint8_t msg[200];
+    for (int i = 0; i < 200; i++) msg[i] = (uint8_t)(i * 13 + 1);
+    // Tails either side of the padding boundary, and pieces straddling blocks
+    for (size_t len : {0u, 1u, 55u, 56u, 63u, 64u, 65u, 119u, 120u, 200u}) {
+        uint8_t oneShot[32], streamed[32];
+        hal::sha256(msg, len, oneShot);
+        hal::Sha256 sha;
+        sha.begin();
+        for (size_t off = 0, piece = 1; off < len; off += piece, piece = piece * 3 % 70 + 1) {
+            sha.update(msg + off, piece < len - off ? piece : len - off);
+        }
+        sha.finish(streamed);
+        EXPECT_EQ(memcmp(oneShot, streamed, 32), 0) << len << " bytes";
+    }
+}
+
+TEST_F(HalHostTest, Aes128CtrContextKeepsItsSchedule) {
+    uint8_t key[16], other[16], iv[16] = {0x12, 0x34};
+    for (int i = 0; i < 16; i++) {
+        key[i] = (uint8_t)(i * 3);
+        other[i] = (uint8_t)~key[i];
+    }
+    hal::Aes128Ctr ctr;
+    ctr.setKey(key);
+    for (size_t len : {1u, 16u, 26u, 51u}) {
+        uint8_t a[51] = {0}, b[51] = {0};
+        iv[15] = (uint8_t)len;
+        ctr.crypt(iv, a, len);
+        hal::aes128Ctr(key, iv, b, len);
+        EXPECT_EQ(memcmp(a, b, len), 0) << len << " bytes";
+    }
+
+    // Re-keyed, it follows the new key
+    uint8_t a[16] = {0}, b[16] = {0};
+    ctr.setKey(other);
+    ctr.crypt(iv, a, 16);
+    hal::aes128Ctr(other, iv, b, 16);
+    EXPECT_EQ(memcmp(a, b, 16), 0);
+}
+
+TEST_F(HalHostTest, FakeRadioRecordsUplinks) {
+    SX1262 r = new Module(8, 14, 12, 13);
+    ASSERT_EQ(r.begin(), RADIOLIB_ERR_NONE);
+    LoRaWANNode* n = persist.manage(&r);
+    n->setDatarate(3);
+    uint8_t frame[4] = {1, 2, 3, 4};
+    hal::host::radioSink().failNext = 1;
+    EXPECT_NE(n->sendReceive(frame, 4, 1), RADIOLIB_ERR_NONE);
+    EXPECT_EQ(n->sendReceive(frame, 4, 1), RADIOLIB_ERR_NONE);
+    ASSERT_EQ(hal::host::radioSink().uplinks.size(), 1u);
+    EXPECT_EQ(hal::host::radioSink().uplinks[0].datarate, 3);
+    EXPECT_EQ(hal::host::radioSink().uplinks[0].data.size(), 4u);
+}
@@ -0,0 +1,174 @@
+#include "host_fixture.h"
+#include "imu_features.h"
+#include "mpu6050_fifo.h"
+#include "payload_manager.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const ImuScale SCALE_1KHZ = {1000, 4096, 655};
+
+std::vector<hal::host::ImuTraceSample> pothole() {
+    return hal::host::loadImuTrace(std::string(IMU_TRACE_DIR) + "/imu_pothole_1khz.csv");
+}
+
+// The same features in double precision, straight from the definitions
+struct Reference {
+    double peak = 0, sumSq = 0, jerk = 0, gyro[3] = {0, 0, 0};
+};
+
+Reference reference(const std::vector<hal::host::ImuTraceSample>& t, size_t from, size_t to, double rateHz) {
+    Reference ref;
+    const double lsbToMs2 = 9.80665 / 4096;
+    for (size_t i = from; i < to; i++) {
+        double m = std::sqrt((double)t[i][0] * t[i][0] + (double)t[i][1] * t[i][1] + (double)t[i][2] * t[i][2]);
+        ref.peak = std::max(ref.peak, m * lsbToMs2);
+        ref.sumSq += m * m * lsbToMs2 * lsbToMs2;
+        if (i > from) {
+            double dx = t[i][0] - t[i - 1][0], dy = t[i][1] - t[i - 1][1], dz = t[i][2] - t[i - 1][2];
+            ref.jerk = std::max(ref.jerk, std::sqrt(dx * dx + dy * dy + dz * dz) * lsbToMs2 * rateHz / 1000);
+        }
+        for (int k = 0; k < 3; k++) {
+            double rad = t[i][3 + k] / 65.5 * M_PI / 180;
+            if (std::fabs(rad) > std::fabs(ref.gyro[k])) ref.gyro[k] = rad;
+        }
+    }
+    return ref;
+}
+
+}  // namespace
+
+using ImuFeaturesTest = HostTest;
+
+TEST_F(ImuFeaturesTest, KernelMatchesReferenceAcrossBlockBoundaries) {
+    auto trace = pothole();
+    ASSERT_EQ(trace.size(), 1000u);
+
+    // Uneven block sizes so the jerk between blocks is exercised too
+    ImuWindow window;
+    size_t i = 0, size = 1;
+    while (i < trace.size()) {
+        ImuBlock b;
+        for (; b.n < size && i < trace.size(); i++, b.n++) {
+            b.ax[b.n] = trace[i][0];
+            b.ay[b.n] = trace[i][1];
+            b.az[b.n] = trace[i][2];
+            b.gx[b.n] = trace[i][3];
+            b.gy[b.n] = trace[i][4];
+            b.gz[b.n] = trace[i][5];
+        }
+        window.add(b);
+        size = (size * 5 + 3) % IMU_BLOCK_MAX + 1;  // 1..IMU_BLOCK_MAX
+    }
+    ASSERT_EQ(window.samples(), 1000u);
+
+    SensorReading r{};
+    window.take(SCALE_1KHZ, r);
+    Reference ref = reference(trace, 0, trace.size(), 1000);
+    EXPECT_NEAR(r.accel, ref.peak * 100, 1);
+    EXPECT_NEAR(r.accelRms, std::sqrt(ref.sumSq / 1000) * 100, 1);
+    EXPECT_NEAR(r.jerk, ref.jerk * 100, 1);
+    for (int k = 0; k < 3; k++) EXPECT_NEAR(r.gyro[k], ref.gyro[k] * 10, 0.5) << k;
+
+    // The pothole: ~3.5 g peak, a sharp jerk and a roll rate far above the noise
+    EXPECT_GT(r.accel, 3300);
+    EXPECT_GT(r.jerk, 200);
+    EXPECT_EQ(r.gyro[0], 14);
+    EXPECT_EQ(window.samples(), 0u);
+}
+
+TEST_F(ImuFeaturesTest, DrainsFifoInBurstsAndRecoversFromOverflow) {
+    hal::host::Mpu6050Sim sim(pothole());
+    TwoWire bus;
+    bus.hostAttach(MPU6050_ADDR, &sim);
+    Mpu6050Fifo imu(bus);
+    ASSERT_TRUE(imu.begin(1000));
+    EXPECT_EQ(imu.scale().rateHz, 1000u);
+
+    ImuWindow window;
+    for (int t = 0; t < 25; t++) {
+        hal::host::advanceMillis(40);
+        EXPECT_EQ(imu.drain(window), 40u) << t;
+    }
+    EXPECT_EQ(window.samples(), 1000u);
+    EXPECT_EQ(imu.overflows(), 0u);
+    EXPECT_LE(bus.hostLargestRead, (size_t)IMU_BURST_BYTES);
+
+    SensorReading r{};
+    window.take(imu.scale(), r);
+    Reference ref = reference(pothole(), 0, 1000, 1000);
+    EXPECT_NEAR(r.accel, ref.peak * 100, 1);
+    EXPECT_NEAR(r.jerk, ref.jerk * 100, 1);
+
+    // 85 ms fill the FIFO; past that records are lost and the FIFO restarts
+    hal::host::advanceMillis(100);
+    EXPECT_EQ(imu.drain(window), 0u);
+    EXPECT_EQ(imu.overflows(), 1u);
+    EXPECT_GT(sim.bytesLost, 0u);
+    hal::host::advanceMillis(40);
+    EXPECT_EQ(imu.drain(window), 40u);
+
+    // Slower rates are rounded to 1 kHz / n
+    EXPECT_TRUE(imu.begin(300));
+    EXPECT_EQ(imu.scale().rateHz, 333u);
+    EXPECT_EQ(sim.rateHz(), 333u);
+}
+
+TEST_F(ImuFeaturesTest, MissingSensorIsReported) {
+    TwoWire bus;
+    Mpu6050Fifo imu(bus);
+    EXPECT_FALSE(imu.begin());
+    ImuWindow window;
+    EXPECT_EQ(imu.drain(window), 0u);
+}
+
+TEST_F(ImuFeaturesTest, PayloadCarriesWindowFeatures) {
+    hal::host::Mpu6050Sim sim(pothole());
+    TwoWire bus;
+    bus.hostAttach(MPU6050_ADDR, &sim);
+    Mpu6050Fifo imu(bus);
+    ASSERT_TRUE(imu.begin(1000));
+    ImuWindow window;
+
+    uint8_t key[16] = {1};
+    MessageCounter counter;
+    DHT11 dht(7);
+    GpsFix gps;
+    PayloadManager pm(&dht, nullptr, &gps, key, &counter, false);
+    pm.setMotionSource(&imu, &window);
+
+    // The scheduler drains every 40 ms; sample() picks up the remainder
+    for (int t = 0; t < 12; t++) {
+        hal::host::advanceMillis(40);
+        imu.drain(window);
+    }
+    hal::host::advanceMillis(20);
+    SensorReading r = pm.sample();
+    EXPECT_EQ(window.samples(), 0u);
+    Reference ref = reference(pothole(), 0, 500, 1000);
+    EXPECT_NEAR(r.accel, ref.peak * 100, 1);
+    EXPECT_NEAR(r.accelRms, std::sqrt(ref.sumSq / 500) * 100, 1);
+    EXPECT_GT(r.jerk, 200);
+    EXPECT_EQ(r.gyro[0], 14);
+
+    // Calm second half: about 1 g, little jerk
+    for (int t = 0; t < 12; t++) {
+        hal::host::advanceMillis(40);
+        imu.drain(window);
+    }
+    hal::host::advanceMillis(20);
+    r = pm.sample();
+    EXPECT_NEAR(r.accel, 981, 10);
+    EXPECT_NEAR(r.accelRms, 981, 5);
+    EXPECT_LT(r.jerk, 10);
+    EXPECT_EQ(r.gyro[0], 0);
+
+    // Nothing drained in time (FIFO overflowed): no motion rather than stale values
+    hal::host::advanceMillis(200);
+    r = pm.sample();
+    EXPECT_EQ(imu.overflows(), 1u);
+    EXPECT_EQ(r.accel, 0);
+    EXPECT_EQ(r.jerk, 0);
+}
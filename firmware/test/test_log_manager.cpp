@@ -0,0 +1,93 @@
+#include "host_fixture.h"
+#include "log_manager.h"
+
+#include <atomic>
+#include <thread>
+
+using LogManagerTest = HostTest;
+
+namespace {
+
+int sideEffects = 0;
+int touch() { return ++sideEffects; }
+
+void resetLog() {
+    logFlush();
+    logStats = LogStats();
+}
+
+}  // namespace
+
+TEST_F(LogManagerTest, DisabledLevelsDoNotEvaluateArguments) {
+    static_assert(logEnabled(LogLevel::Info), "default build logs INFO");
+    static_assert(!logEnabled(LogLevel::Trace), "default build drops TRACE");
+    resetLog();
+    sideEffects = 0;
+    LOG_TRACE("%d", touch());
+    EXPECT_EQ(sideEffects, 0);
+    EXPECT_EQ(logRing.size(), 0u);
+    LOG_INFO("%d", touch());
+    EXPECT_EQ(sideEffects, 1);
+    EXPECT_EQ(logRing.size(), 1u);
+}
+
+TEST_F(LogManagerTest, DeferredUntilDrained) {
+    resetLog();
+    LOG_INFO("first %d", 1);
+    LOG_WARN("second");
+    EXPECT_EQ(logRing.size(), 2u);
+    EXPECT_STREQ(logRing.peek()->text, "first 1");
+    EXPECT_EQ(logDrain(1), 1u);
+    EXPECT_STREQ(logRing.peek()->text, "second");
+    EXPECT_EQ(logDrain(), 1u);
+    EXPECT_EQ(logRing.size(), 0u);
+    EXPECT_EQ(logStats.drained, 2u);
+}
+
+TEST_F(LogManagerTest, FullRingDropsInsteadOfBlocking) {
+    resetLog();
+    for (int i = 0; i < LOG_RING_SLOTS + 5; i++) LOG_INFO("line %d", i);
+    EXPECT_EQ(logRing.size(), (size_t)LOG_RING_SLOTS);
+    EXPECT_EQ(logStats.dropped, 5u);
+    EXPECT_EQ(logStats.records[(int)LogLevel::Info], (uint32_t)LOG_RING_SLOTS);
+}
+
+TEST_F(LogManagerTest, HexRecordsAreTruncatedToTheSlot) {
+    resetLog();
+    uint8_t data[100];
+    for (int i = 0; i < 100; i++) data[i] = (uint8_t)i;
+    LOG_HEX(LogLevel::Info, "hex: ", data, 3);
+    EXPECT_STREQ(logRing.peek()->text, "hex: 00 01 02 ");
+    logDrain();
+    LOG_HEX(LogLevel::Info, "hex: ", data, sizeof(data));
+    EXPECT_LT(strlen(logRing.peek()->text), (size_t)LOG_RECORD_SIZE);
+}
+
+TEST_F(LogManagerTest, BothCoresLogWhileTheLoopDrains) {
+    resetLog();
+    constexpr int PER_PRODUCER = 2000;
+    std::atomic<int> running{2};
+    auto producer = [&](int core) {
+        for (int i = 0; i < PER_PRODUCER; i++) LOG_INFO("core%d %d", core, i);
+        running--;
+    };
+    std::thread a(producer, 0), b(producer, 1);
+
+    // Lines arrive whole and, per producer, in order
+    int next[2] = {0, 0}, lines = 0;
+    while (running > 0 || logRing.peek()) {
+        const auto* rec = logRing.peek();
+        if (!rec) continue;
+        int core = -1, seq = -1;
+        ASSERT_EQ(sscanf(rec->text, "core%d %d", &core, &seq), 2);
+        ASSERT_TRUE(core == 0 || core == 1);
+        EXPECT_GE(seq, next[core]);
+        next[core] = seq + 1;
+        logRing.release();
+        lines++;
+    }
+    a.join();
+    b.join();
+    EXPECT_EQ((uint32_t)lines + logStats.dropped, 2u * PER_PRODUCER);
+    EXPECT_EQ(logStats.records[(int)LogLevel::Info], (uint32_t)lines);
+}
@@ -0,0 +1,174 @@
+#include "host_fixture.h"
+#include "lora_manager.h"
+
+class LoRaManagerTest : public HostTest {
+protected:
+    void SetUp() override {
+        HostTest::SetUp();
+        hal::host::setFlashPartitionSize(256 * 1024);
+        reboot();
+    }
+
+    // Drops everything held in RAM; the flash partition stays
+    static void reboot() {
+        hal::host::dropDeviceLocal<LoRaWANState>();
+        LoRaWAN_setup();
+        lorawan().node->setDutyCycle(false);
+    }
+
+    // A PAYLOAD_SIZE reading whose first byte is its sequence number
+    static bool sendReading(uint8_t seq, bool urgent = false) {
+        size_t cap;
+        uint8_t* slot = LoRaWAN_txSlot(cap);
+        memset(slot, 0xEE, PAYLOAD_SIZE);
+        slot[0] = seq;
+        return LoRaWAN_send(slot, PAYLOAD_SIZE, urgent);
+    }
+
+    // Sequence numbers carried by an aggregated uplink
+    static std::vector<uint8_t> readingsIn(const hal::host::Uplink& up) {
+        std::vector<uint8_t> seqs;
+        EXPECT_EQ(up.port, FPORT_AGGREGATE);
+        size_t offset = AGGREGATE_HEADER_LEN;
+        for (int i = 0; i < up.data[0]; i++) {
+            EXPECT_EQ(up.data[offset], PAYLOAD_SIZE);
+            seqs.push_back(up.data[offset + 1]);
+            offset += AGGREGATE_ENTRY_OVERHEAD + PAYLOAD_SIZE;
+        }
+        EXPECT_EQ(offset, up.data.size());
+        return seqs;
+    }
+
+    const std::vector<hal::host::Uplink>& uplinks() { return hal::host::radioSink().uplinks; }
+};
+
+TEST_F(LoRaManagerTest, PacksReadingsUpToDatarateLimit) {
+    // DR3: 115 bytes = header + 4 x (len + 26)
+    for (uint8_t i = 0; i < 3; i++) {
+        EXPECT_FALSE(sendReading(i));
+        hal::host::advanceMillis(30000);
+    }
+    EXPECT_TRUE(uplinks().empty());
+    EXPECT_TRUE(sendReading(3));
+
+    ASSERT_EQ(uplinks().size(), 1u);
+    EXPECT_TRUE(uplinks()[0].confirmed);
+    EXPECT_LE(uplinks()[0].data.size(), 115u);
+    EXPECT_EQ(readingsIn(uplinks()[0]), (std::vector<uint8_t>{0, 1, 2, 3}));
+    EXPECT_EQ(lorawan().uplinkQueue.size(), (size_t)0);
+}
+
+TEST_F(LoRaManagerTest, HigherDatarateCarriesMoreReadings) {
+    lorawan().node->setDatarate(5);
+    for (uint8_t i = 0; i < 12; i++) sendReading(i);
+    ASSERT_EQ(uplinks().size(), 1u);
+    EXPECT_EQ(uplinks()[0].data[0], 8);  // 1 + 8 x 27 = 217; a 9th would need 244
+    EXPECT_EQ(lorawan().uplinkQueue.size(), (size_t)4);
+}
+
+TEST_F(LoRaManagerTest, PartialBatchGoesOutWhenDue) {
+    sendReading(7);
+    hal::host::advanceMillis(LORAWAN_MAX_BATCH_DELAY_MS - 1);
+    EXPECT_EQ(LoRaWAN_flush(false), 0);
+    hal::host::advanceMillis(1);
+    EXPECT_EQ(LoRaWAN_flush(false), 1);
+
+    // A lone reading is sent as a plain frame
+    ASSERT_EQ(uplinks().size(), 1u);
+    EXPECT_EQ(uplinks()[0].port, FPORT_FRAME);
+    EXPECT_EQ(uplinks()[0].data.size(), (size_t)PAYLOAD_SIZE);
+    EXPECT_EQ(uplinks()[0].data[0], 7);
+}
+
+TEST_F(LoRaManagerTest, UrgentReadingGoesOutWithoutWaitingForTheBatch) {
+    EXPECT_FALSE(sendReading(0));
+    hal::host::advanceMillis(5000);
+    EXPECT_TRUE(sendReading(1, true));
+    ASSERT_EQ(uplinks().size(), 1u);
+    EXPECT_EQ(readingsIn(uplinks()[0]), (std::vector<uint8_t>{0, 1}));
+
+    // Inside the duty cycle it waits for the radio instead of failing the uplink
+    lorawan().node->setDutyCycle(true);
+    EXPECT_FALSE(sendReading(2, true));
+    EXPECT_EQ(uplinks().size(), 1u);
+    EXPECT_EQ(LoRaWAN_poll(), 0);
+    hal::host::advanceMillis(lorawan().node->timeUntilUplink());
+    EXPECT_EQ(LoRaWAN_poll(), 1);
+    ASSERT_EQ(uplinks().size(), 2u);
+    EXPECT_EQ(uplinks()[1].port, FPORT_FRAME);
+    EXPECT_EQ(uplinks()[1].data[0], 2);
+
+    // Ordinary readings batch again
+    EXPECT_FALSE(sendReading(3));
+    EXPECT_EQ(LoRaWAN_poll(), 0);
+    EXPECT_EQ(uplinks().size(), 2u);
+}
+
+TEST_F(LoRaManagerTest, KeepsReadingsUntilAcknowledged) {
+    hal::host::radioSink().dropAcks = 1;
+    for (uint8_t i = 0; i < 4; i++) sendReading(i);
+    ASSERT_EQ(uplinks().size(), 1u);
+    EXPECT_EQ(lorawan().uplinkQueue.size(), (size_t)4);
+
+    // Next attempt resends the same readings, then they are gone
+    EXPECT_EQ(LoRaWAN_flush(true), 4);
+    ASSERT_EQ(uplinks().size(), 2u);
+    EXPECT_EQ(readingsIn(uplinks()[1]), (std::vector<uint8_t>{0, 1, 2, 3}));
+    EXPECT_EQ(lorawan().uplinkQueue.size(), (size_t)0);
+}
+
+TEST_F(LoRaManagerTest, FailedSendKeepsReadingsInOrder) {
+    hal::host::radioSink().failNext = 2;
+    for (uint8_t i = 0; i < 5; i++) sendReading(i);
+    EXPECT_TRUE(uplinks().empty());
+    EXPECT_EQ(lorawan().uplinkQueue.size(), (size_t)5);
+
+    EXPECT_EQ(LoRaWAN_flush(true), 4);
+    EXPECT_EQ(LoRaWAN_flush(true), 1);
+    ASSERT_EQ(uplinks().size(), 2u);
+    EXPECT_EQ(readingsIn(uplinks()[0]), (std::vector<uint8_t>{0, 1, 2, 3}));
+    EXPECT_EQ(uplinks()[1].data[0], 4);
+}
+
+TEST_F(LoRaManagerTest, BacklogSurvivesRebootAndDrains) {
+    hal::host::radioSink().activated = false;
+    for (uint8_t i = 0; i < 10; i++) sendReading(i);
+    EXPECT_EQ(lorawan().uplinkQueue.size(), 10u);
+
+    reboot();
+    EXPECT_EQ(lorawan().uplinkQueue.size(), 10u);
+    hal::host::radioSink().activated = true;
+
+    // Link back: full batches drain on poll() without new readings
+    hal::host::advanceMillis(LORAWAN_DRAIN_INTERVAL_MS);
+    EXPECT_EQ(LoRaWAN_poll(), 4);
+    EXPECT_EQ(LoRaWAN_poll(), 0);  // paced
+    hal::host::advanceMillis(LORAWAN_DRAIN_INTERVAL_MS);
+    EXPECT_EQ(LoRaWAN_poll(), 4);
+    hal::host::advanceMillis(LORAWAN_DRAIN_INTERVAL_MS);
+    EXPECT_EQ(LoRaWAN_poll(), 2);  // remainder was queued before the reboot, so it is overdue
+
+    ASSERT_EQ(uplinks().size(), 3u);
+    EXPECT_EQ(readingsIn(uplinks()[0]), (std::vector<uint8_t>{0, 1, 2, 3}));
+    EXPECT_EQ(readingsIn(uplinks()[2]), (std::vector<uint8_t>{8, 9}));
+
+    // Delivered readings stay delivered after another reboot
+    reboot();
+    EXPECT_EQ(lorawan().uplinkQueue.size(), 0u);
+}
+
+TEST_F(LoRaManagerTest, FullQueueDropsOldestReadings) {
+    // Two sectors of 140 records: opening a third lap drops the oldest sector
+    hal::host::wipeStorage();
+    hal::host::setFlashPartitionSize(2 * hal::FlashPartition::SECTOR_SIZE);
+    reboot();
+    hal::host::radioSink().activated = false;
+    for (int i = 0; i < 2 * 140 + 5; i++) sendReading((uint8_t)i);
+    EXPECT_EQ(lorawan().uplinkQueue.size(), 145u);
+    EXPECT_EQ(lorawan().uplinkQueue.dropped(), 140u);
+
+    hal::host::radioSink().activated = true;
+    LoRaWAN_flush(true);
+    ASSERT_EQ(uplinks().size(), 1u);
+    EXPECT_EQ(readingsIn(uplinks()[0]).front(), 140);
+}
@@ -0,0 +1,52 @@
+#include "host_fixture.h"
+#include "message_counter.h"
+
+#include <set>
+
+using MessageCounterTest = HostTest;
+
+TEST_F(MessageCounterTest, WritesNvsOncePerBlock) {
+    MessageCounter counter(16);
+    counter.begin();
+    hal::host::resetNvsWriteCount();
+    for (uint32_t i = 0; i < 64; i++) EXPECT_EQ(counter.next(), i);
+    EXPECT_EQ(hal::host::nvsWriteCount(), 4u);
+    EXPECT_EQ(counter.getNvsWrites(), 4u);
+}
+
+TEST_F(MessageCounterTest, RebootNeverReusesAValue) {
+    std::set<uint32_t> seen;
+    for (int boot = 0; boot < 5; boot++) {
+        hal::host::setStorageDir(storage);  // drop RAM state, keep "flash"
+        MessageCounter counter(8);
+        for (int i = 0; i < 3 + boot * 5; i++) {
+            EXPECT_TRUE(seen.insert(counter.next()).second);
+        }
+    }
+}
+
+TEST_F(MessageCounterTest, ResumesFromLegacyCounterValue) {
+    MessageCounter::resetPersisted();
+    {
+        hal::Preferences p;
+        p.begin("payload", false);
+        p.putUInt("counter", 1234);  // next-counter value stored by older firmware
+    }
+    hal::host::setStorageDir(storage);
+    MessageCounter counter;
+    EXPECT_EQ(counter.next(), 1234u);
+}
+
+TEST_F(MessageCounterTest, ResetStartsOverWithOneWrite) {
+    MessageCounter counter(32);
+    for (int i = 0; i < 40; i++) counter.next();
+    hal::host::resetNvsWriteCount();
+    counter.reset();
+    EXPECT_EQ(hal::host::nvsWriteCount(), 1u);
+    EXPECT_EQ(counter.next(), 0u);
+    EXPECT_EQ(hal::host::nvsWriteCount(), 1u);
+
+    hal::host::setStorageDir(storage);
+    MessageCounter rebooted(32);
+    EXPECT_EQ(rebooted.next(), 32u);
+}
@@ -0,0 +1,192 @@
+#include "host_fixture.h"
+#include "payload_manager.h"
+#include "lora_manager.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+// Counts this thread's heap allocations, for the per-frame path checks below
+namespace {
+thread_local size_t heapAllocations = 0;
+}
+
+void* operator new(size_t size) {
+    heapAllocations++;
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+class PayloadManagerTest : public HostTest {
+protected:
+    void SetUp() override {
+        HostTest::SetUp();
+        for (int i = 0; i < 16; i++) key[i] = (uint8_t)(0xA0 + i);
+        dht.hostTemperature = 21;
+        mpu.hostGyro = {0.12f, -0.05f, 0.30f};
+        mpu.hostAccel = {0.0f, 3.0f, 4.0f};
+        gps.locationValid = true;
+        gps.lat = 454642035;
+        gps.lon = 91899820;
+    }
+
+    uint8_t key[16];
+    MessageCounter counter;
+    DHT11 dht{7};
+    Adafruit_MPU6050 mpu;
+    GpsFix gps;
+};
+
+TEST_F(PayloadManagerTest, FrameLayout) {
+    PayloadManager pm(&dht, &mpu, &gps, key, &counter, true);
+    uint8_t frame[64];
+    ASSERT_EQ(pm.createPayload(frame, sizeof(frame)), (size_t)PAYLOAD_SIZE);
+
+    // 2-byte little-endian counter IV
+    EXPECT_EQ(frame[0], 0);
+    EXPECT_EQ(frame[1], 0);
+
+    // Clear block: len, temp marker, temp, gyro marker, gx, gy, gz
+    EXPECT_EQ(frame[2], CLEAR_BLOCK_LEN);
+    EXPECT_EQ(frame[3], 0x01);
+    EXPECT_EQ(frame[4], 21);
+    EXPECT_EQ(frame[5], 0x03);
+    EXPECT_EQ((int8_t)frame[6], 1);
+    EXPECT_EQ((int8_t)frame[7], -1);
+    EXPECT_EQ((int8_t)frame[8], 3);
+
+    // Clear length, then the block under CTR with IV = counter || 0^14
+    EXPECT_EQ(frame[9], ENCRYPTED_BLOCK_LEN);
+    uint8_t iv[16] = {frame[0], frame[1]};
+    uint8_t block[ENCRYPTED_BLOCK_LEN];
+    memcpy(block, &frame[10], ENCRYPTED_BLOCK_LEN);
+    hal::aes128Ctr(key, iv, block, ENCRYPTED_BLOCK_LEN);
+    EXPECT_EQ(block[0], 0x04);
+    uint16_t accel[3];
+    memcpy(accel, block + 1, sizeof(accel));
+    EXPECT_EQ(accel[0], 500);  // |(0,3,4)|, one reading: peak = RMS, no jerk
+    EXPECT_EQ(accel[1], 500);
+    EXPECT_EQ(accel[2], 0);
+    EXPECT_EQ(block[7], 0x05);
+    int32_t lat, lon;
+    memcpy(&lat, block + 8, 4);
+    memcpy(&lon, block + 12, 4);
+    EXPECT_EQ(lat, 454642035);
+    EXPECT_EQ(lon, 91899820);
+}
+
+TEST_F(PayloadManagerTest, RejectsShortBuffer) {
+    PayloadManager pm(&dht, &mpu, &gps, key, &counter, true);
+    uint8_t frame[PAYLOAD_SIZE - 1];
+    EXPECT_EQ(pm.createPayload(frame, sizeof(frame)), 0u);
+}
+
+TEST_F(PayloadManagerTest, CounterAdvancesAndSkipsReservedBlockOnReboot) {
+    uint8_t frame[PAYLOAD_SIZE];
+    {
+        PayloadManager pm(&dht, &mpu, &gps, key, &counter, true);
+        pm.createPayload(frame, sizeof(frame));
+        pm.createPayload(frame, sizeof(frame));
+        EXPECT_EQ(frame[0], 1);
+    }
+    hal::host::setStorageDir(storage);
+    MessageCounter rebooted;
+    PayloadManager pm(&dht, &mpu, &gps, key, &rebooted, true);
+    pm.createPayload(frame, sizeof(frame));
+    EXPECT_EQ(frame[0], COUNTER_BLOCK_SIZE);
+    EXPECT_EQ(frame[1], 0);
+}
+
+TEST_F(PayloadManagerTest, MissingMpuSendsZeros) {
+    PayloadManager pm(&dht, &mpu, &gps, key, &counter, false);
+    uint8_t frame[PAYLOAD_SIZE];
+    pm.createPayload(frame, sizeof(frame));
+    EXPECT_EQ(frame[6], 0);
+    EXPECT_EQ(frame[7], 0);
+    EXPECT_EQ(frame[8], 0);
+}
+
+TEST_F(PayloadManagerTest, BuildsInRadioTxBuffer) {
+    lorawan().uplinkQueue.end();
+    LoRaWAN_setup();
+    PayloadManager pm(&dht, &mpu, &gps, key, &counter, true);
+
+    size_t cap = 0;
+    uint8_t* slot = LoRaWAN_txSlot(cap);
+    size_t len = pm.createPayload(slot, cap);
+    ASSERT_EQ(len, (size_t)PAYLOAD_SIZE);
+    std::vector<uint8_t> frame(slot, slot + len);
+    EXPECT_FALSE(LoRaWAN_send(slot, len));  // queued until the batch is due
+    ASSERT_EQ(LoRaWAN_flush(true), 1);
+
+    const auto& uplinks = hal::host::radioSink().uplinks;
+    ASSERT_EQ(uplinks.size(), 1u);
+    EXPECT_EQ(uplinks[0].port, FPORT_FRAME);
+    EXPECT_EQ(uplinks[0].data, frame);
+}
+
+TEST_F(PayloadManagerTest, CompactCodecSendsKeyframeThenDeltas) {
+    PayloadManager pm(&dht, &mpu, &gps, key, &counter, true);
+    pm.setCodec(PayloadCodec::Compact);
+    uint8_t frame[64];
+    size_t len = pm.createPayload(frame, sizeof(frame));
+    ASSERT_EQ(len, (size_t)COMPACT_KEYFRAME_SIZE);
+    EXPECT_EQ(frame[FRAME_FORMAT_OFFSET], COMPACT_FORMAT | COMPACT_KEYFRAME);
+
+    compact::Fields f;
+    size_t enc = compact::decodeClear(frame, len, f);
+    ASSERT_GT(enc, 0u);
+    uint8_t iv[16] = {frame[0], frame[1]};
+    hal::aes128Ctr(key, iv, frame + enc, len - enc);
+    ASSERT_TRUE(compact::decodeEncrypted(frame + enc, len - enc, f));
+    SensorReading r = compact::apply(nullptr, f);
+    EXPECT_EQ(r.temperature, 21);
+    EXPECT_EQ(r.gyro[0], 1);
+    EXPECT_EQ(r.accel, 500);
+    EXPECT_EQ(r.lat, 454642035);
+
+    // Parked: nothing changed, so the delta is the header plus one byte per field
+    len = pm.createPayload(frame, sizeof(frame));
+    EXPECT_EQ(frame[FRAME_FORMAT_OFFSET], COMPACT_FORMAT);
+    EXPECT_EQ(len, (size_t)COMPACT_HEADER_LEN + 1 + compact::FIELDS);
+
+    // A new daily key restarts the chain
+    pm.resetMessageCounter();
+    pm.createPayload(frame, sizeof(frame));
+    EXPECT_EQ(frame[FRAME_FORMAT_OFFSET], COMPACT_FORMAT | COMPACT_KEYFRAME);
+}
+
+TEST_F(PayloadManagerTest, FramePathDoesNotAllocate) {
+    PayloadManager pm(&dht, &mpu, &gps, key, &counter, true);
+    uint8_t frame[PAYLOAD_SIZE];
+    ASSERT_EQ(pm.createPayload(frame, sizeof(frame)), (size_t)PAYLOAD_SIZE);  // reserves the counter block
+
+    // The rest of the block: sampling, encoding and encryption only
+    size_t before = heapAllocations;
+    for (int i = 1; i < COUNTER_BLOCK_SIZE; i++) {
+        ASSERT_EQ(pm.createPayload(frame, sizeof(frame)), (size_t)PAYLOAD_SIZE);
+    }
+    EXPECT_EQ(heapAllocations - before, 0u);
+}
+
+TEST_F(PayloadManagerTest, KeyScheduleFollowsTheDailyKey) {
+    PayloadManager pm(nullptr, nullptr, &gps, key, &counter, false);
+    const EncryptionManager& enc = pm.encryption();
+    uint8_t frame[PAYLOAD_SIZE];
+    SensorReading r;
+    r.lat = 454642035;
+    for (int i = 0; i < 3; i++) pm.encodePayload(r, frame, sizeof(frame));
+    EXPECT_EQ(enc.getRekeys(), 1u);
+
+    // The daily key rolls over in place: the next frame is under the new key
+    key[0] ^= 0xFF;
+    ASSERT_EQ(pm.encodePayload(r, frame, sizeof(frame)), (size_t)PAYLOAD_SIZE);
+    EXPECT_EQ(enc.getRekeys(), 2u);
+    uint8_t iv[16] = {frame[0], frame[1]};
+    hal::aes128Ctr(key, iv, frame + FRAME_ENCRYPTED_OFFSET, ENCRYPTED_BLOCK_LEN);
+    int32_t lat;
+    memcpy(&lat, frame + FRAME_ENCRYPTED_OFFSET + 8, 4);
+    EXPECT_EQ(lat, 454642035);
+}
@@ -0,0 +1,178 @@
+#include "host_fixture.h"
+#include "report_policy.h"
+#include "report_replay.h"
+
+namespace {
+
+constexpr int32_t MILAN_LAT = 454642035, MILAN_LON = 91899820;
+
+SensorReading reading(int8_t temperature = 20, uint16_t accel = 985, uint16_t accelRms = 981) {
+    SensorReading r = {};
+    r.temperature = temperature;
+    r.accel = accel;
+    r.accelRms = accelRms;
+    r.lat = MILAN_LAT;
+    r.lon = MILAN_LON;
+    return r;
+}
+
+GpsFix fixAt(uint32_t nowMs, uint16_t speed, uint16_t course = 9000) {
+    GpsFix fix;
+    fix.locationValid = fix.motionValid = true;
+    fix.lat = MILAN_LAT;
+    fix.lon = MILAN_LON;
+    fix.speed = speed;
+    fix.course = course;
+    fix.locationMillis = nowMs;
+    return fix;
+}
+
+// Drives the policy at its own pace until untilMs; returns what it reported
+std::vector<ReportReason> run(ReportPolicy& policy, uint32_t& now, uint32_t untilMs, const SensorReading& r,
+                              uint16_t speed) {
+    std::vector<ReportReason> out;
+    while (now < untilMs) {
+        GpsFix fix = fixAt(now, speed);
+        ReportReason reason = policy.evaluate(r, fix, now);
+        if (reason != ReportReason::None) out.push_back(reason);
+        now += policy.evalIntervalMs();
+    }
+    return out;
+}
+
+}  // namespace
+
+TEST(ReportPolicyTest, ParkedVehicleSendsHeartbeats) {
+    ReportPolicy policy;
+    uint32_t now = 0;
+    std::vector<ReportReason> sent = run(policy, now, 3600000, reading(), 0);
+    EXPECT_FALSE(policy.isMoving());
+    EXPECT_EQ(policy.evalIntervalMs(), policy.config().stationaryEvalMs);
+    // Moving until it has been still for stillMs, where it stopped, then one per heartbeatMs
+    ASSERT_EQ(sent.size(), 7u);
+    EXPECT_EQ(sent[0], ReportReason::Periodic);
+    EXPECT_EQ(policy.reports(ReportReason::Periodic), 3u);
+    EXPECT_EQ(sent[3], ReportReason::Stopped);
+    EXPECT_EQ(policy.reports(ReportReason::Heartbeat), 3u);
+    EXPECT_EQ(policy.readingsEvaluated(), policy.readingsSuppressed() + 7);
+}
+
+TEST(ReportPolicyTest, MovingVehicleReportsPeriodicallyAndOnMotionStart) {
+    ReportPolicy policy;
+    uint32_t now = 0;
+    run(policy, now, 600000, reading(), 0);
+    ASSERT_FALSE(policy.isMoving());
+
+    // GPS speed alone is enough to leave the stationary state
+    std::vector<ReportReason> sent = run(policy, now, now + 1, reading(), 1500);
+    ASSERT_EQ(sent.size(), 1u);
+    EXPECT_EQ(sent[0], ReportReason::MotionStart);
+    EXPECT_TRUE(policy.isMoving());
+    EXPECT_EQ(policy.evalIntervalMs(), policy.config().movingEvalMs);
+
+    // Same position (a fix that does not move), so only the periodic floor
+    sent = run(policy, now, now + 600000, reading(), 1500);
+    EXPECT_EQ(sent.size(), 10u);
+    for (ReportReason r : sent) EXPECT_EQ(r, ReportReason::Periodic);
+
+    // A vibrating IMU without GPS speed is moving too
+    ReportPolicy imuOnly;
+    now = 0;
+    SensorReading shaky = reading(20, 1150, 1000);
+    run(imuOnly, now, 600000, shaky, 0);
+    EXPECT_TRUE(imuOnly.isMoving());
+}
+
+TEST(ReportPolicyTest, DeadbandsSendExceptions) {
+    ReportPolicyConfig cfg;
+    cfg.refillMs = 100000;
+    ReportPolicy policy(cfg);
+    uint32_t now = 0;
+    run(policy, now, 30000, reading(), 1500);
+
+    SensorReading r = reading();
+    r.lat += 2000;  // 22 m
+    EXPECT_EQ(policy.evaluate(r, fixAt(now, 1500), now), ReportReason::None);
+    now += 5000;
+    r.lat += 25000;  // 300 m from the last report
+    EXPECT_EQ(policy.evaluate(r, fixAt(now, 1500), now), ReportReason::Position);
+    now += 5000;
+    EXPECT_EQ(policy.evaluate(r, fixAt(now, 1500, 11000), now), ReportReason::None);  // 20 deg
+    now += 5000;
+    EXPECT_EQ(policy.evaluate(r, fixAt(now, 1500, 13000), now), ReportReason::Heading);
+    now += 5000;
+    // Below headingMinSpeed the course is noise
+    EXPECT_EQ(policy.evaluate(r, fixAt(now, 200, 30000), now), ReportReason::None);
+    now += 5000;
+    r.temperature = 22;
+    EXPECT_EQ(policy.evaluate(r, fixAt(now, 1500, 13000), now), ReportReason::Temperature);
+    now += 5000;
+
+    // The bucket is empty: acceleration waits for a token, held, not lost
+    SensorReading bump = r;
+    bump.accel = 2400;
+    bump.jerk = 5000;
+    EXPECT_EQ(policy.evaluate(bump, fixAt(now, 1500, 13000), now), ReportReason::None);
+    EXPECT_EQ(policy.exceptionsRateLimited(), 1u);
+    now += cfg.refillMs;
+    EXPECT_EQ(policy.evaluate(r, fixAt(now, 1500, 13000), now), ReportReason::Acceleration);
+    // The bump rides in the report although this reading was calm
+    EXPECT_EQ(policy.report().accel, 2400);
+    EXPECT_EQ(policy.report().jerk, 5000);
+    EXPECT_EQ(policy.reports(ReportReason::Acceleration), 1u);
+}
+
+TEST(ReportPolicyTest, RateLimitBoundsExceptionBursts) {
+    ReportPolicyConfig cfg;
+    cfg.burst = 2;
+    cfg.refillMs = 30000;
+    ReportPolicy policy(cfg);
+    uint32_t now = 0;
+    run(policy, now, 10000, reading(), 1500);
+
+    // The temperature flips every reading
+    int sent = 0;
+    for (int i = 0; i < 12; i++, now += 5000) {
+        SensorReading r = reading(i % 2 ? 20 : 25);
+        if (reportUrgent(policy.evaluate(r, fixAt(now, 1500), now))) sent++;
+    }
+    // Two from the bucket, then one per refill
+    EXPECT_EQ(sent, 2 + 2);
+    EXPECT_GT(policy.exceptionsRateLimited(), 0u);
+}
+
+TEST(ReportPolicyTest, ReportMergesSkippedWindows) {
+    ReportPolicy policy;
+    uint32_t now = 0;
+    run(policy, now, 30000, reading(), 1500);
+    SensorReading r = reading(20, 1100, 1000);
+    r.gyro[2] = -7;
+    EXPECT_EQ(policy.evaluate(r, fixAt(now, 1500), now), ReportReason::None);
+    now += 5000;
+    SensorReading calm = reading(20, 1000, 990);
+    calm.gyro[2] = 3;
+    std::vector<ReportReason> sent = run(policy, now, 60001, calm, 1500);
+    ASSERT_EQ(sent.size(), 1u);
+    EXPECT_EQ(sent[0], ReportReason::Periodic);
+    EXPECT_EQ(policy.report().accel, 1100);
+    EXPECT_EQ(policy.report().gyro[2], -7);
+    EXPECT_GT(policy.report().accelRms, 981);  // RMS over every window since the first report
+    EXPECT_LT(policy.report().accelRms, 1000);
+}
+
+TEST(ReportPolicyTest, ReplaySavesAirtimeAndKeepsEvents) {
+    std::vector<TracePoint> trace = synthesizeDriveTrace(3, 86400);
+    ReplayOptions adaptive, fixed;
+    fixed.adaptive = false;
+    ReplayResult a = replayDriveTrace(trace, adaptive);
+    ReplayResult f = replayDriveTrace(trace, fixed);
+    EXPECT_EQ(f.readings, 86400u / 30);
+    EXPECT_LT(a.airtimeMs * 2, f.airtimeMs);
+    ASSERT_GT(f.events, 0u);
+    EXPECT_EQ(a.eventsSeen, a.events);
+    EXPECT_EQ(f.eventsSeen, f.events);
+    // Events go out as soon as the duty cycle allows instead of with the next full batch
+    EXPECT_LT(a.eventDelayMeanS * 2, f.eventDelayMeanS);
+    EXPECT_LT(a.positionMaxM, 2.0 * adaptive.policy.positionM);
+    EXPECT_LE(a.temperatureMaxErr, 2);
+}
@@ -0,0 +1,150 @@
+// Cross-thread tests stand in for the two cores; build with
+// -DBLACKBOX_SANITIZER=thread to run them under ThreadSanitizer
+#include "host_fixture.h"
+#include "sample_pipeline.h"
+#include "payload_manager.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+
+SampleRecord record(int32_t seq) {
+    SampleRecord rec{};
+    rec.reading.lat = seq;
+    rec.epoch = 1773742530u + (uint32_t)seq;
+    return rec;
+}
+
+}  // namespace
+
+using SamplePipelineTest = HostTest;
+
+TEST_F(SamplePipelineTest, FullQueueDropsAndCounts) {
+    SamplePipeline pipeline;
+    EXPECT_FALSE(pipeline.pending());
+    for (int i = 0; i < PIPELINE_DEPTH + 3; i++) pipeline.submit(record(i));
+    EXPECT_TRUE(pipeline.pending());
+    EXPECT_EQ(pipeline.submitted(), (uint32_t)PIPELINE_DEPTH);
+    EXPECT_EQ(pipeline.dropped(), 3u);
+    EXPECT_EQ(pipeline.maxDepth(), (uint32_t)PIPELINE_DEPTH);
+
+    // The oldest readings go out first; the newest were the ones dropped
+    std::vector<int32_t> seen;
+    EXPECT_EQ(pipeline.drain([&](const SampleRecord& r) { seen.push_back(r.reading.lat); }, 2), 2u);
+    EXPECT_EQ(seen, (std::vector<int32_t>{0, 1}));
+    pipeline.drain([&](const SampleRecord& r) { seen.push_back(r.reading.lat); });
+    EXPECT_EQ(seen.back(), PIPELINE_DEPTH - 1);
+    EXPECT_EQ(pipeline.transmitted(), (uint32_t)PIPELINE_DEPTH);
+    EXPECT_FALSE(pipeline.pending());
+}
+
+TEST_F(SamplePipelineTest, RingStressAcrossThreads) {
+    constexpr uint32_t N = 1 << 20;
+    SpscRing<uint32_t, 64> ring;
+    std::thread producer([&] {
+        uint32_t next = 0, chunk[7];
+        while (next < N) {
+            size_t n = 1 + next % 7;
+            if (n > N - next) n = N - next;
+            for (size_t i = 0; i < n; i++) chunk[i] = next + (uint32_t)i;
+            size_t pushed = 0;
+            // Unlike the pipeline, retry on full so every value must arrive
+            while (pushed < n) {
+                size_t room = ring.capacity() - ring.size();
+                size_t k = n - pushed < room ? n - pushed : room;
+                if (k == 0) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                pushed += ring.push(chunk + pushed, k);
+            }
+            next += (uint32_t)n;
+        }
+    });
+
+    uint32_t expected = 0, buf[16];
+    while (expected < N) {
+        size_t n = ring.pop(buf, 1 + expected % 16);
+        for (size_t i = 0; i < n; i++) ASSERT_EQ(buf[i], expected++);
+        if (n == 0) std::this_thread::yield();
+    }
+    producer.join();
+    EXPECT_EQ(ring.dropped(), 0u);
+    EXPECT_EQ(ring.size(), 0u);
+}
+
+TEST_F(SamplePipelineTest, SamplerAndTransmitterOnSeparateThreads) {
+    constexpr int32_t READINGS = 20000;
+    uint8_t key[16] = {1, 2, 3};
+    MessageCounter counter;
+    PayloadManager pm(nullptr, nullptr, nullptr, key, &counter, false);
+    SamplePipeline pipeline;
+    std::atomic<bool> done{false};
+
+    // Transmit stage: counter, encoding and encryption only ever on this thread
+    std::vector<int32_t> sent;
+    size_t bytes = 0;
+    std::thread tx([&] {
+        uint8_t frame[PAYLOAD_SIZE];
+        auto send = [&](const SampleRecord& r) {
+            bytes += pm.encodePayload(r.reading, frame, sizeof(frame));
+            sent.push_back(r.reading.lat);
+        };
+        while (!done.load()) {
+            pipeline.beginTransmit();
+            if (pipeline.drain(send) == 0) std::this_thread::yield();
+            pipeline.endTransmit();
+        }
+        pipeline.drain(send);
+    });
+
+    for (int32_t i = 0; i < READINGS; i++) {
+        pipeline.submit(record(i));
+        if (i % 64 == 0) std::this_thread::yield();
+    }
+    done = true;
+    tx.join();
+
+    EXPECT_EQ(pipeline.submitted() + pipeline.dropped(), (uint32_t)READINGS);
+    EXPECT_EQ(pipeline.transmitted(), pipeline.submitted());
+    ASSERT_EQ(sent.size(), (size_t)pipeline.submitted());
+    for (size_t i = 1; i < sent.size(); i++) ASSERT_LT(sent[i - 1], sent[i]);
+    EXPECT_EQ(bytes, sent.size() * PAYLOAD_SIZE);
+    EXPECT_LE(pipeline.maxDepth(), (uint32_t)PIPELINE_DEPTH);
+}
+
+TEST_F(SamplePipelineTest, NoLightSleepWhileTransmitting) {
+    SamplePipeline pipeline;
+    ASSERT_TRUE(pipeline.enterSleep());
+    pipeline.leaveSleep();
+    pipeline.beginTransmit();
+    EXPECT_FALSE(pipeline.enterSleep());
+    pipeline.endTransmit();
+
+    // The two cores race for it: the sampler never sleeps with the radio in use
+    constexpr int ROUNDS = 2000;
+    std::atomic<bool> onAir{false}, done{false};
+    std::atomic<uint32_t> overlaps{0};
+    std::thread tx([&] {
+        for (int i = 0; i < ROUNDS; i++) {
+            pipeline.beginTransmit();
+            onAir.store(true);
+            std::this_thread::yield();
+            onAir.store(false);
+            pipeline.endTransmit();
+        }
+        done = true;
+    });
+    while (!done.load()) {
+        if (pipeline.enterSleep()) {
+            for (int k = 0; k < 8; k++) overlaps += onAir.load();
+            pipeline.leaveSleep();
+        }
+        std::this_thread::yield();  // the loop runs its tasks between two sleeps
+    }
+    tx.join();
+    EXPECT_EQ(overlaps.load(), 0u);
+    EXPECT_TRUE(pipeline.enterSleep());  // idle again
+}
@@ -0,0 +1,167 @@
+#include "host_fixture.h"
+#include "task_scheduler.h"
+#include "payload_manager.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Probe {
+    std::vector<std::string>* log;
+    const char* name;
+    uint32_t workMs;
+};
+
+void record(void* ctx) {
+    Probe* p = static_cast<Probe*>(ctx);
+    p->log->push_back(p->name);
+    hal::delay(p->workMs);
+}
+
+}  // namespace
+
+class TaskSchedulerTest : public HostTest {
+protected:
+    TaskScheduler sched;
+    std::vector<std::string> ran;
+};
+
+TEST_F(TaskSchedulerTest, RunsDueTasksByPriorityThenSleepsToTheNextRelease) {
+    Probe low{&ran, "low", 0}, high{&ran, "high", 0}, slow{&ran, "slow", 0};
+    sched.add("low", 100, 1, record, &low);
+    sched.add("high", 100, 3, record, &high);
+    sched.add("slow", 250, 2, record, &slow, 0, 50);
+
+    EXPECT_EQ(sched.runDue(), 2u);
+    EXPECT_EQ(ran, (std::vector<std::string>{"high", "low"}));
+    EXPECT_EQ(sched.msUntilNext(), 50u);
+
+    sched.idle();
+    EXPECT_EQ(hal::millis(), 50u);
+    EXPECT_EQ(sched.lightSleeps(), 1u);
+    EXPECT_EQ(hal::host::lightSleptMillis(), 50u);
+
+    // One second of virtual time: the loop only wakes for releases
+    ran.clear();
+    while (hal::millis() < 1050) {
+        sched.runDue();
+        sched.idle();
+    }
+    EXPECT_EQ(std::count(ran.begin(), ran.end(), "high"), 10);
+    EXPECT_EQ(std::count(ran.begin(), ran.end(), "slow"), 4);
+    EXPECT_EQ(sched.stats(0).jitterMaxMs, 0u);
+    EXPECT_EQ(hal::host::lightSleptMillis(), 1050u);
+}
+
+TEST_F(TaskSchedulerTest, RecordsJitterOverrunsAndSkippedReleases) {
+    Probe blocker{&ran, "blocker", 30}, tick{&ran, "tick", 0};
+    TaskId b = sched.add("blocker", 1000, 5, record, &blocker, 20);
+    TaskId t = sched.add("tick", 10, 1, record, &tick);
+
+    sched.runDue();  // blocker runs 30 ms past its 20 ms deadline, tick starts 30 ms late
+    EXPECT_EQ(sched.stats(b).overruns, 1u);
+    EXPECT_EQ(sched.stats(b).execMaxMs, 30u);
+    EXPECT_EQ(sched.stats(t).jitterMaxMs, 30u);
+    // Releases at 10 and 20 were missed entirely; the one at 30 is due now, no burst
+    EXPECT_EQ(sched.stats(t).skipped, 2u);
+    EXPECT_EQ(sched.msUntilNext(), 0u);
+    EXPECT_EQ(sched.runDue(), 1u);
+
+    hal::host::advanceMillis(13);
+    sched.runDue();
+    EXPECT_EQ(sched.stats(t).runs, 3u);
+    EXPECT_EQ(sched.stats(t).jitterMeanMs(), (30u + 0u + 3u) / 3);
+    EXPECT_EQ(sched.stats(t).overruns, 1u);  // only the first finished past its 10 ms deadline
+}
+
+TEST_F(TaskSchedulerTest, EventTasksAndKeepAwake) {
+    Probe button{&ran, "button", 0};
+    TaskId id = sched.add("button", 0, 4, record, &button, 50);
+    EXPECT_EQ(sched.msUntilNext(), UINT32_MAX);
+    EXPECT_EQ(sched.runDue(), 0u);
+
+    sched.trigger(id, 40);
+    sched.trigger(id, 500);  // later trigger does not postpone the pending one
+    EXPECT_EQ(sched.msUntilNext(), 40u);
+
+    // A burst in progress: plain delay instead of light sleep
+    sched.keepAwake(100);
+    sched.idle();
+    EXPECT_EQ(hal::millis(), 40u);
+    EXPECT_EQ(sched.lightSleeps(), 0u);
+    EXPECT_EQ(sched.runDue(), 1u);
+    EXPECT_EQ(sched.msUntilNext(), UINT32_MAX);  // one-shot
+
+    // Nothing queued: idle() is capped so the loop still checks its flags
+    hal::host::advanceMillis(100);
+    sched.idle();
+    EXPECT_EQ(hal::millis(), 140u + SCHEDULER_MAX_IDLE_MS);
+    EXPECT_EQ(sched.lightSleeps(), 1u);
+
+    sched.trigger(id, 5);
+    sched.cancel(id);
+    hal::host::advanceMillis(10);
+    EXPECT_EQ(sched.runDue(), 0u);
+}
+
+TEST_F(TaskSchedulerTest, SleepGateCanVetoLightSleep) {
+    bool busy = true;
+    int woke = 0;
+    struct Gate {
+        bool* busy;
+        int* woke;
+    } gate{&busy, &woke};
+    sched.setSleepGate(
+        [](void* ctx, bool entering) {
+            Gate* g = static_cast<Gate*>(ctx);
+            if (!entering) (*g->woke)++;
+            return !entering || !*g->busy;
+        },
+        &gate);
+    Probe tick{&ran, "tick", 0};
+    sched.add("tick", 200, 1, record, &tick, 0, 200);
+
+    // The other core is on air: a plain delay instead
+    sched.idle();
+    EXPECT_EQ(hal::millis(), 200u);
+    EXPECT_EQ(sched.lightSleeps(), 0u);
+    EXPECT_EQ(woke, 0);
+
+    EXPECT_EQ(sched.runDue(), 1u);
+    busy = false;
+    sched.idle();
+    EXPECT_EQ(sched.lightSleeps(), 1u);
+    EXPECT_EQ(woke, 1);
+}
+
+TEST_F(TaskSchedulerTest, PayloadUsesTheCachedDhtReading) {
+    DHT11 dht(7);
+    dht.hostReadMs = 25;  // the one-wire exchange
+    Adafruit_MPU6050 mpu;
+    GpsFix gps;
+    MessageCounter counter;
+    uint8_t key[16] = {0};
+    PayloadManager pm(&dht, &mpu, &gps, key, &counter, true);
+
+    ASSERT_TRUE(pm.sampleEnvironment());
+    uint32_t before = hal::millis();
+    uint8_t frame[PAYLOAD_SIZE];
+    dht.hostTemperature = 30;
+    ASSERT_EQ(pm.createPayload(frame, sizeof(frame)), (size_t)PAYLOAD_SIZE);
+    EXPECT_EQ(hal::millis(), before);  // no sensor wait on the transmit path
+    EXPECT_EQ((int8_t)frame[TelemetryFrame::offsetOf<0>() + 1], 22);
+
+    // Past the staleness bound the payload reads through rather than send old data
+    hal::host::advanceMillis(DHT_MAX_AGE_MS + 1);
+    ASSERT_EQ(pm.createPayload(frame, sizeof(frame)), (size_t)PAYLOAD_SIZE);
+    EXPECT_EQ((int8_t)frame[TelemetryFrame::offsetOf<0>() + 1], 30);
+    EXPECT_EQ(pm.environment().blockingReads(), 1u);
+
+    // A failed refresh keeps the last good value
+    dht.hostError = -1;
+    EXPECT_FALSE(pm.sampleEnvironment());
+    EXPECT_EQ(pm.environment().failedReads(), 1u);
+    EXPECT_TRUE(pm.environment().fresh());
+}
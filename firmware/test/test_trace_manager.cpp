@@ -0,0 +1,155 @@
+#include "host_fixture.h"
+#include "lora_manager.h"
+#include "payload_manager.h"
+#include "trace_manager.h"
+
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TraceManagerTest : public HostTest {
+protected:
+    void SetUp() override {
+        HostTest::SetUp();
+        traceRing.clear();
+        traceRing.setEnabled(true);
+    }
+
+    void TearDown() override {
+        traceRing.clear();
+        HostTest::TearDown();
+    }
+
+    static std::string dump() {
+        std::string out;
+        traceDump([](const char* text, void* ctx) { *static_cast<std::string*>(ctx) += text; }, &out);
+        return out;
+    }
+
+    static size_t count(const std::string& text, const std::string& what) {
+        size_t n = 0;
+        for (size_t at = text.find(what); at != std::string::npos; at = text.find(what, at + 1)) n++;
+        return n;
+    }
+};
+
+TEST_F(TraceManagerTest, ScopeRecordsWhenItCloses) {
+    {
+        TraceScope outer("outer");
+        TraceScope inner("inner");
+        volatile uint32_t spin = 0;
+        while (spin < 10000) spin = spin + 1;
+    }
+    ASSERT_EQ(traceRing.recorded(), 2u);
+    decltype(traceRing)::Span inner, outer;
+    ASSERT_TRUE(traceRing.read(0, inner));
+    ASSERT_TRUE(traceRing.read(1, outer));
+    EXPECT_STREQ(inner.name, "inner");
+    EXPECT_STREQ(outer.name, "outer");
+    EXPECT_GT(inner.cycles, 0u);
+    EXPECT_GE(outer.cycles, inner.cycles);
+    EXPECT_GE((int32_t)(inner.start - outer.start), 0);
+    EXPECT_EQ(inner.core, outer.core);
+}
+
+TEST_F(TraceManagerTest, RingKeepsTheNewestSpans) {
+    const uint32_t total = TRACE_RING_SLOTS + 5;
+    for (uint32_t i = 0; i < total; i++) traceRing.record("span", i, 1);
+    EXPECT_EQ(traceRing.recorded(), total);
+    EXPECT_EQ(traceRing.oldest(), 5u);
+    decltype(traceRing)::Span span;
+    EXPECT_FALSE(traceRing.read(4, span));
+    ASSERT_TRUE(traceRing.read(5, span));
+    EXPECT_EQ(span.start, 5u);
+    ASSERT_TRUE(traceRing.read(total - 1, span));
+    EXPECT_EQ(span.start, total - 1);
+    EXPECT_EQ(count(dump(), "\"ph\":\"X\""), (size_t)TRACE_RING_SLOTS);
+}
+
+TEST_F(TraceManagerTest, DumpUnwrapsTheCounter) {
+    // Two children either side of the 32-bit wrap, then their parent. The
+    // host counts nanoseconds, so 1000 cycles are 1 us.
+    traceRing.record("a", 0xFFFFFC18u, 500);  // -1000
+    traceRing.record("b", 1000, 500);
+    traceRing.record("parent", 0xFFFFF830u, 4000);  // -2000
+    std::string json = dump();
+
+    EXPECT_EQ(json.rfind("{\"traceEvents\":[\n", 0), 0u);
+    EXPECT_NE(json.find("],\"displayTimeUnit\":\"ns\"}"), std::string::npos);
+    EXPECT_EQ(count(json, "\"ph\":\"X\""), 3u);
+    EXPECT_NE(json.find("\"name\":\"parent\",\"cat\":\"blackbox\",\"ph\":\"X\",\"ts\":0.000,\"dur\":4.000"),
+              std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"a\",\"cat\":\"blackbox\",\"ph\":\"X\",\"ts\":1.000,\"dur\":0.500"),
+              std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"b\",\"cat\":\"blackbox\",\"ph\":\"X\",\"ts\":3.000,\"dur\":0.500"),
+              std::string::npos);
+    // Events are separated, not terminated, by commas
+    EXPECT_EQ(count(json, "},\n{"), 2u);
+    EXPECT_EQ(count(json, "},\n]"), 0u);
+}
+
+TEST_F(TraceManagerTest, PausedRingDropsSpans) {
+    traceRing.setEnabled(false);
+    { TraceScope s("paused"); }
+    EXPECT_EQ(traceRing.recorded(), 0u);
+    EXPECT_EQ(traceRing.dropped(), 1u);
+
+    // A dump pauses recording only while it runs
+    traceRing.setEnabled(true);
+    dump();
+    EXPECT_TRUE(traceRing.enabled());
+    { TraceScope s("running"); }
+    EXPECT_EQ(traceRing.recorded(), 1u);
+}
+
+TEST_F(TraceManagerTest, EveryCoreKeepsItsSpans) {
+    constexpr int THREADS = 4, SPANS = 50;
+    static_assert(THREADS * SPANS <= TRACE_RING_SLOTS, "all spans fit");
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([] {
+            for (int i = 0; i < SPANS; i++) TraceScope s("worker");
+        });
+    }
+    for (auto& t : threads) t.join();
+
+    ASSERT_EQ(traceRing.recorded(), (uint32_t)(THREADS * SPANS));
+    std::map<uint8_t, int> perCore;
+    decltype(traceRing)::Span span;
+    for (uint32_t n = 0; n < traceRing.recorded(); n++) {
+        ASSERT_TRUE(traceRing.read(n, span));
+        perCore[span.core]++;
+    }
+    ASSERT_EQ(perCore.size(), (size_t)THREADS);
+    for (const auto& c : perCore) EXPECT_EQ(c.second, SPANS);
+}
+
+#if TRACE_SPANS
+TEST_F(TraceManagerTest, EncodeRecordsItsStages) {
+    uint8_t key[16] = {0};
+    MessageCounter counter;
+    GpsFix gps;
+    PayloadManager pm(nullptr, nullptr, &gps, key, &counter, false);
+    uint8_t frame[MAX_PAYLOAD_SIZE];
+    traceRing.clear();
+
+    ASSERT_GT(pm.encodePayload(SensorReading(), frame, sizeof(frame)), 0u);
+    // Inner spans close first: the counter commit, the key schedule of the
+    // first frame, the cipher, the encoder
+    const char* expected[] = {"nvs.counter", "aesKeySchedule", "encryptAESCTR", "encodePayload"};
+    ASSERT_EQ(traceRing.recorded(), 4u);
+    decltype(traceRing)::Span span;
+    for (uint32_t n = 0; n < 4; n++) {
+        ASSERT_TRUE(traceRing.read(n, span));
+        EXPECT_STREQ(span.name, expected[n]);
+    }
+
+    // The next frames come from the reserved counter block and the same key
+    ASSERT_GT(pm.encodePayload(SensorReading(), frame, sizeof(frame)), 0u);
+    std::string json = dump();
+    EXPECT_EQ(count(json, "\"name\":\"nvs.counter\""), 1u);
+    EXPECT_EQ(count(json, "\"name\":\"aesKeySchedule\""), 1u);
+    EXPECT_EQ(count(json, "\"name\":\"encodePayload\""), 2u);
+}
+#endif
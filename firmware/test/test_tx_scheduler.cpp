@@ -0,0 +1,180 @@
+#include "host_fixture.h"
+#include "tx_scheduler.h"
+#include "tx_replay.h"
+
+namespace {
+
+// Reports n reading uplinks at whatever data rate the scheduler picks; the
+// channel delivers at delivered(dr)
+template <typename Channel>
+void drive(TxScheduler& s, uint32_t& now, int n, Channel delivered) {
+    for (int i = 0; i < n; i++, now += 60000) {
+        uint8_t dr = s.nextDatarate();
+        size_t len = readingsUplinkLen(readingsPerUplink(dr));
+        s.onSent(TxClass::Periodic, dr, lorawanAirtimeMs(dr, len), readingsPerUplink(dr), delivered(dr), true, now);
+    }
+}
+
+}  // namespace
+
+TEST(TxSchedulerTest, AirtimeMatchesTheRadioModel) {
+    // SF12, 51 application bytes: the figure of every LoRaWAN airtime calculator
+    EXPECT_EQ(lorawanAirtimeUs(0, 51), 2793472u);
+    EXPECT_EQ(lorawanAirtimeUs(5, 0), 46336u);
+    for (uint8_t dr = 0; dr < TX_DATARATES; dr++) {
+        for (size_t len = 0; len <= EU868_DATARATES[dr].maxPayload; len++) {
+            ASSERT_EQ(lorawanAirtimeMs(dr, len), hal::host::timeOnAirMillis(dr, len)) << "DR" << (int)dr << " " << len;
+        }
+    }
+}
+
+TEST(TxSchedulerTest, FullUplinksPerDatarate) {
+    const uint8_t expected[TX_DATARATES] = {1, 1, 1, 4, 8, 8};
+    for (uint8_t dr = 0; dr < TX_DATARATES; dr++) {
+        EXPECT_EQ(readingsPerUplink(dr), expected[dr]);
+        EXPECT_LE(readingsUplinkLen(readingsPerUplink(dr)), EU868_DATARATES[dr].maxPayload);
+    }
+    EXPECT_EQ(readingsUplinkLen(1), (size_t)PAYLOAD_SIZE);
+}
+
+TEST(TxSchedulerTest, SubBandsOfEu868) {
+    EXPECT_EQ(eu868SubBand(867100000), SubBand::G);
+    EXPECT_EQ(eu868SubBand(868100000), SubBand::G1);
+    EXPECT_EQ(eu868SubBand(868500000), SubBand::G1);
+    EXPECT_EQ(eu868SubBand(868800000), SubBand::G2);
+    EXPECT_EQ(eu868SubBand(869525000), SubBand::G3);
+    EXPECT_EQ(eu868SubBand(868650000), SubBand::Count);  // between bands
+    EXPECT_EQ(eu868SubBand(915000000), SubBand::Count);
+    EXPECT_EQ(DutyCycleBudget::allowanceMs(SubBand::G1), 36000u);
+    EXPECT_EQ(DutyCycleBudget::allowanceMs(SubBand::G2), 3600u);
+    EXPECT_EQ(DutyCycleBudget::allowanceMs(SubBand::G3), 360000u);
+}
+
+TEST(TxSchedulerTest, BudgetIsASlidingHourPerSubBand) {
+    DutyCycleBudget budget;
+    const uint32_t start = 5 * TX_WINDOW_MS;
+    budget.spend(SubBand::G1, 20000, start);
+    budget.spend(SubBand::G1, 10000, start + 30 * TX_BIN_MS);
+    EXPECT_EQ(budget.usedMs(SubBand::G1, start + 30 * TX_BIN_MS), 30000u);
+    EXPECT_EQ(budget.remainingMs(SubBand::G1, start + 30 * TX_BIN_MS), 6000u);
+    EXPECT_EQ(budget.usedMs(SubBand::G, start), 0u);  // bands are separate
+    EXPECT_EQ(budget.waitMs(SubBand::G, 30000, 0, start), 0u);
+
+    // 6 s fit now; 10 s once the first minute has left the window
+    const uint32_t now = start + 40 * TX_BIN_MS + 500;
+    EXPECT_EQ(budget.waitMs(SubBand::G1, 6000, 0, now), 0u);
+    EXPECT_EQ(budget.waitMs(SubBand::G1, 10000, 0, now), start + TX_WINDOW_BINS * TX_BIN_MS - now);
+    EXPECT_EQ(budget.waitMs(SubBand::G1, 37000, 0, now), UINT32_MAX);
+    EXPECT_EQ(budget.usedMs(SubBand::G1, start + TX_WINDOW_BINS * TX_BIN_MS), 10000u);
+    EXPECT_EQ(budget.usedMs(SubBand::G1, start + 2 * TX_WINDOW_MS), 0u);
+}
+
+TEST(TxSchedulerTest, ReservesPutEventsFirst) {
+    TxScheduler s;
+    uint32_t now = TX_WINDOW_MS;
+    s.onSent(TxClass::Periodic, 3, 32000, 4, true, true, now);
+    // 32 of 36 s spent: the backlog leaves 10 %, periodic uplinks 5 %
+    EXPECT_EQ(s.waitMs(TxClass::Event, 1000, now), 0u);
+    EXPECT_EQ(s.waitMs(TxClass::Periodic, 1000, now), 0u);
+    EXPECT_FALSE(s.admit(TxClass::Backlog, 1000, now));
+    EXPECT_EQ(s.deferred(TxClass::Backlog), 1u);
+    s.onSent(TxClass::Periodic, 3, 2000, 4, true, true, now);
+    EXPECT_FALSE(s.admit(TxClass::Periodic, 1000, now));
+    EXPECT_TRUE(s.admit(TxClass::Event, 1000, now));
+    EXPECT_GT(s.waitMs(TxClass::Backlog, 1000, now), 0u);
+    EXPECT_EQ(s.waitMs(TxClass::Backlog, 1000, now + TX_WINDOW_BINS * TX_BIN_MS), 0u);
+}
+
+TEST(TxSchedulerTest, FreshReadingsArePeriodicTheRestBacklog) {
+    TxScheduler s;
+    uint32_t now = 1000;
+    EXPECT_EQ(s.readingClass(now, 150000, false, 4), TxClass::Backlog);
+    for (int i = 0; i < 3; i++) s.onQueued(now += 30000);
+    EXPECT_EQ(s.readingClass(now, 150000, false, 4), TxClass::Backlog);
+    EXPECT_EQ(s.readingClass(now, 150000, true, 4), TxClass::Periodic);      // urgent
+    EXPECT_EQ(s.readingClass(now + 90000, 150000, false, 4), TxClass::Periodic);  // overdue
+    s.onQueued(now += 30000);
+    EXPECT_EQ(s.readingClass(now, 150000, false, 4), TxClass::Periodic);
+
+    // A failed periodic uplink leaves its readings to the backlog
+    s.onSent(TxClass::Periodic, 3, 700, 4, false, true, now);
+    EXPECT_EQ(s.readingClass(now, 150000, false, 4), TxClass::Backlog);
+    EXPECT_EQ(s.delivered(TxClass::Periodic), 0u);
+    EXPECT_EQ(s.uplinks(TxClass::Periodic), 1u);
+}
+
+TEST(TxSchedulerTest, DatarateFollowsTheAcks) {
+    TxScheduler s;
+    uint32_t now = 0;
+    EXPECT_EQ(s.datarate(), TX_DEFAULT_DATARATE);
+    // Up to DR4 everything gets through, DR5 never
+    drive(s, now, 200, [](uint8_t dr) { return dr <= 4; });
+    EXPECT_EQ(s.datarate(), 4);
+    EXPECT_GT(s.uplinksAt(5), 0u);  // tried
+    EXPECT_LT(s.deliveryRatio(5), 256);
+
+    // The vehicle drives off: DR3 and up are lost, DR2 is the fastest that works
+    drive(s, now, 200, [](uint8_t dr) { return dr <= 2; });
+    EXPECT_EQ(s.datarate(), 2);
+
+    // Back in coverage: probes find the way up again
+    drive(s, now, 400, [](uint8_t dr) { return dr <= 4; });
+    EXPECT_EQ(s.datarate(), 4);
+}
+
+TEST(TxSchedulerTest, OneLostAckDoesNotMoveTheDatarate) {
+    TxScheduler s;
+    s.onSent(TxClass::Periodic, 3, 700, 4, false, true, 0);
+    EXPECT_EQ(s.datarate(), 3);
+}
+
+TEST(TxSchedulerTest, WithoutAcksStaysAtTheDefault) {
+    TxSchedulerConfig cfg;
+    cfg.adaptiveDatarate = false;
+    TxScheduler s(cfg);
+    uint32_t now = 0;
+    drive(s, now, 100, [](uint8_t) { return true; });
+    EXPECT_EQ(s.datarate(), TX_DEFAULT_DATARATE);
+    EXPECT_EQ(s.uplinksAt(TX_DEFAULT_DATARATE), 100u);
+
+    // Unconfirmed uplinks: nothing to learn from
+    TxScheduler unconfirmed;
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(unconfirmed.nextDatarate(), TX_DEFAULT_DATARATE);
+        unconfirmed.onSent(TxClass::Periodic, TX_DEFAULT_DATARATE, 700, 4, true, false, i * 60000u);
+    }
+    EXPECT_EQ(unconfirmed.readingsDelivered(), 400u);
+}
+
+TEST(TxSchedulerTest, EventFramesGetADatarateTheyFit) {
+    TxScheduler s;
+    uint32_t now = 0;
+    drive(s, now, 100, [](uint8_t dr) { return dr <= 1; });
+    ASSERT_LE(s.datarate(), 1);
+    EXPECT_EQ(s.eventDatarate(40), s.datarate());
+    EXPECT_EQ(s.eventDatarate(102), 3);
+}
+
+TEST(TxSchedulerTest, ReplayDeliversMoreWithinTheDutyCycle) {
+    TxReplayOptions o;
+    o.durationS = 6 * 3600;
+    o.traffic = TrafficMix::Dense;
+    o.scheduler = false;
+    TxReplayResult fixed = replayTraffic(o);
+    o.scheduler = true;
+    TxReplayResult sched = replayTraffic(o);
+    EXPECT_GT(sched.delivered, 2 * fixed.delivered);
+    EXPECT_LE(sched.maxHourAirtimeMs, DutyCycleBudget::allowanceMs(SubBand::G1));
+
+    // Crash frames go out back to back instead of one per off-time
+    o.traffic = TrafficMix::Events;
+    o.scheduler = false;
+    fixed = replayTraffic(o);
+    o.scheduler = true;
+    sched = replayTraffic(o);
+    ASSERT_GT(sched.eventFrames, 0u);
+    EXPECT_EQ(sched.eventsDelivered, sched.eventFrames);
+    EXPECT_LT(sched.eventDelayMeanS * 10, fixed.eventDelayMeanS);
+    EXPECT_GE(sched.delivered, fixed.delivered);
+    EXPECT_LT(sched.airtimeMs, fixed.airtimeMs);
+}
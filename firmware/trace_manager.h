@@ -0,0 +1,201 @@
+// trace_manager.h - Scoped-span tracing of the firmware stages
+//
+// TRACE_SPAN("name") times the rest of the enclosing scope with hal::cycles()
+// (the CPU cycle counter on the board, steady_clock nanoseconds on the host)
+// and records {name, start, duration, core} into a fixed ring in RAM that
+// keeps the newest TRACE_RING_SLOTS spans. Recording a span costs two counter
+// reads and a handful of stores; nothing is formatted until traceDump()
+// writes the ring as Chrome trace JSON, which chrome://tracing and
+// ui.perfetto.dev open as a timeline with one track per core.
+//
+// Spans are compiled in only with TRACE_SPANS=1 (the host build turns it on
+// with BLACKBOX_TRACE); otherwise TRACE_SPAN expands to nothing. Names must
+// be string literals: the ring keeps the pointer and the dump does not escape.
+#ifndef TRACE_MANAGER_H
+#define TRACE_MANAGER_H
+
+#include <atomic>
+#include <stdio.h>
+#include "hal/hal.h"
+
+#ifndef TRACE_SPANS
+#define TRACE_SPANS 0
+#endif
+
+#ifndef TRACE_RING_SLOTS
+#define TRACE_RING_SLOTS 256  // power of two
+#endif
+
+static_assert((TRACE_RING_SLOTS & (TRACE_RING_SLOTS - 1)) == 0, "TRACE_RING_SLOTS must be a power of two");
+
+// Overwriting multi-producer ring of finished spans. Both cores record, so a
+// producer claims the next slot with a fetch-add on head and publishes it as a
+// seqlock: the slot's sequence is odd while it is written and 2n + 2 once it
+// holds span n. A reader copies a span and re-checks the sequence, so a slot
+// overwritten meanwhile is skipped instead of read torn.
+template <size_t Slots>
+class TraceRing {
+public:
+    struct Span {
+        const char* name;
+        uint32_t start;   // hal::cycles() when the span opened
+        uint32_t cycles;  // duration
+        uint8_t core;
+    };
+
+    void record(const char* name, uint32_t start, uint32_t cycles) {
+        if (!on.load(std::memory_order_relaxed)) {
+            skipped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        uint32_t n = head.fetch_add(1, std::memory_order_relaxed);
+        Slot& s = slots[n & (Slots - 1)];
+        s.seq.store(2 * n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        s.name.store(name, std::memory_order_relaxed);
+        s.start.store(start, std::memory_order_relaxed);
+        s.cycles.store(cycles, std::memory_order_relaxed);
+        s.core.store(hal::coreId(), std::memory_order_relaxed);
+        s.seq.store(2 * n + 2, std::memory_order_release);
+    }
+
+    // Span n (counted since the last clear()); false if it was overwritten or
+    // is still being written
+    bool read(uint32_t n, Span& out) const {
+        const Slot& s = slots[n & (Slots - 1)];
+        uint32_t seq = s.seq.load(std::memory_order_acquire);
+        if (seq != 2 * n + 2) return false;
+        out.name = s.name.load(std::memory_order_relaxed);
+        out.start = s.start.load(std::memory_order_relaxed);
+        out.cycles = s.cycles.load(std::memory_order_relaxed);
+        out.core = s.core.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return s.seq.load(std::memory_order_relaxed) == seq;
+    }
+
+    // Spans recorded so far; the ring holds the last Slots of them
+    uint32_t recorded() const { return head.load(std::memory_order_acquire); }
+    uint32_t oldest() const {
+        uint32_t h = recorded();
+        return h > Slots ? h - (uint32_t)Slots : 0;
+    }
+    // Spans that ended while recording was off
+    uint32_t dropped() const { return skipped.load(std::memory_order_relaxed); }
+
+    void setEnabled(bool enabled) { on.store(enabled, std::memory_order_relaxed); }
+    bool enabled() const { return on.load(std::memory_order_relaxed); }
+
+    // Not safe against concurrent record()
+    void clear() {
+        for (size_t i = 0; i < Slots; i++) slots[i].seq.store(0, std::memory_order_relaxed);
+        head.store(0, std::memory_order_relaxed);
+        skipped.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> seq{0};
+        std::atomic<const char*> name{nullptr};
+        std::atomic<uint32_t> start{0};
+        std::atomic<uint32_t> cycles{0};
+        std::atomic<uint8_t> core{0};
+    };
+
+    Slot slots[Slots];
+    std::atomic<uint32_t> head{0};
+    std::atomic<uint32_t> skipped{0};
+    std::atomic<bool> on{true};
+};
+
+inline TraceRing<TRACE_RING_SLOTS> traceRing;
+
+class TraceScope {
+public:
+    explicit TraceScope(const char* name) : name(name), start(hal::cycles()) {}
+    ~TraceScope() { traceRing.record(name, start, hal::cycles() - start); }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name;
+    uint32_t start;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#if TRACE_SPANS
+#define TRACE_SPAN(name) TraceScope TRACE_CONCAT(traceSpan_, __LINE__)(name)
+#else
+#define TRACE_SPAN(name) do {} while (0)
+#endif
+
+// Receives the dump piece by piece
+using TraceWrite = void (*)(const char* text, void* ctx);
+
+inline void traceToConsole(const char* text, void* ctx) {
+    (void)ctx;
+    hal::log(text);
+}
+
+inline void traceToFile(const char* text, void* ctx) { fputs(text, static_cast<FILE*>(ctx)); }
+
+// Writes the spans in the ring as comma-separated Chrome trace "complete"
+// events of process pid, one per line, without the enclosing array; with
+// leadingComma the first event is preceded by one, for appending to events
+// already written. Returns the number of events.
+//
+// Recording pauses meanwhile. Timestamps are 32-bit counter values, unwrapped
+// by walking the spans in the order they ended: that holds as long as two
+// consecutive spans are less than half a wrap apart (9 s at 240 MHz, 2 s on
+// the host). The board's counters stop in light sleep and the two cores'
+// differ by a constant, so compare the cores' tracks by duration only. Times
+// start at 0 with the earliest span in the ring.
+inline size_t traceWriteEvents(TraceWrite write, void* ctx, uint32_t pid = 1, bool leadingComma = false) {
+    const bool wasEnabled = traceRing.enabled();
+    traceRing.setEnabled(false);
+    const uint32_t first = traceRing.oldest(), end = traceRing.recorded();
+    const double perMicro = (double)hal::cyclesPerMicro();
+
+    // Pass 1: the earliest start, relative to the oldest span
+    decltype(traceRing)::Span span;
+    int64_t at = 0, earliest = 0;
+    uint32_t previous = 0;
+    bool any = false;
+    for (uint32_t n = first; n != end; n++) {
+        if (!traceRing.read(n, span)) continue;
+        at = any ? at + (int32_t)(span.start - previous) : 0;
+        previous = span.start;
+        if (!any || at < earliest) earliest = at;
+        any = true;
+    }
+
+    // Pass 2: the events
+    size_t count = 0;
+    char line[192];
+    at = 0;
+    any = false;
+    for (uint32_t n = first; n != end; n++) {
+        if (!traceRing.read(n, span)) continue;
+        at = any ? at + (int32_t)(span.start - previous) : 0;
+        previous = span.start;
+        any = true;
+        snprintf(line, sizeof(line),
+                 "%s{\"name\":\"%s\",\"cat\":\"blackbox\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%lu,\"tid\":%u}",
+                 count || leadingComma ? ",\n" : "", span.name ? span.name : "?", (double)(at - earliest) / perMicro,
+                 span.cycles / perMicro, (unsigned long)pid, (unsigned)span.core);
+        write(line, ctx);
+        count++;
+    }
+    traceRing.setEnabled(wasEnabled);
+    return count;
+}
+
+// The whole ring as a Chrome trace JSON document (the console "trace" command)
+inline size_t traceDump(TraceWrite write = traceToConsole, void* ctx = nullptr) {
+    write("{\"traceEvents\":[\n", ctx);
+    size_t n = traceWriteEvents(write, ctx);
+    write("\n],\"displayTimeUnit\":\"ns\"}\n", ctx);
+    return n;
+}
+
+#endif
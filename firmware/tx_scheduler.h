@@ -0,0 +1,405 @@
+// tx_scheduler.h - Airtime and duty-cycle aware choice of what goes on air, when and how fast
+//
+// Three kinds of uplink compete for the radio, in priority order:
+//
+//   Event     crash records (crash_recorder.h), one frame per uplink
+//   Periodic  readings at the pace they are produced: the readings queued
+//             since the last periodic uplink fill one, or the oldest of them
+//             is overdue, or one is urgent (report_policy.h)
+//   Backlog   catch-up uplinks for what an outage left in the flash queue
+//
+// The flash queue stays FIFO (the readings must reach the backend in order,
+// and every uplink is acknowledged before its readings leave flash), so a
+// periodic uplink carries the oldest readings: what makes it periodic is
+// that new readings filled it, not which readings it holds.
+//
+// Time on air is the LoRa modem formula (Semtech AN1200.13) for the EU868
+// data rates with LoRaWAN's 13 bytes of MAC overhead. ETSI EN 300 220 limits
+// each EU868 sub-band to a share of every hour (1 %, 0.1 % or 10 %);
+// DutyCycleBudget sums the airtime spent per sub-band over a sliding hour in
+// one-minute bins. Events may use the whole allowance, periodic uplinks
+// leave eventReservePct of it, the backlog drains only while more than
+// backlogReservePct is left. That replaces RadioLib's off-time of 99 times
+// the airtime after every uplink (LoRaWAN_setup() turns it off): same
+// hourly limit, but a crash's frames go out back to back instead of one
+// every minute or two.
+//
+// The data rate: with confirmed uplinks every uplink says whether it got
+// through. The scheduler keeps a delivery ratio per data rate (a moving
+// average of the ACKs) and picks the one that delivers the most readings per
+// second of airtime, p(dr) * n(dr) / toa(dr, n(dr)) with n(dr) the readings
+// a full uplink carries there. That is also the data rate with the most
+// readings per hour once the duty cycle is the limit. Aggregation follows
+// from it: a full uplink always delivers more readings per second of air
+// than a partial one (the aggregate header and the MAC overhead are paid
+// once), so batches stay full (or overdue) and the data rate sets their
+// size. The default data rate and the slower ones start out as delivering
+// everything, a faster one as delivering half, and that prior weighs as one
+// ACK; a faster one is only chosen once it has been tried. One reading
+// uplink in probeEvery tries a neighbour of the chosen data rate, the
+// faster and the slower one in turn, so an estimate that an outage wrecked
+// does not stay wrong. The average is slow on purpose, so
+// TX_LOSS_STREAK lost ACKs in a row at the chosen data rate halve its
+// estimate at once (a fade); below the default data rate the probes go up,
+// four times as often. Without ACKs (unconfirmed uplinks) it stays at
+// defaultDatarate.
+//
+// Runs on the transmit stage. Costs about 1 KB of RAM, most of it the minute bins.
+#ifndef TX_SCHEDULER_H
+#define TX_SCHEDULER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "frame_layout.h"
+#include "log_manager.h"
+
+// EU868 DR0..DR5: SF12..SF7 at 125 kHz
+#define TX_DATARATES 6
+#ifndef TX_DEFAULT_DATARATE
+#define TX_DEFAULT_DATARATE 3
+#endif
+// MHDR, FHDR without options, FPort and MIC
+#define LORAWAN_MAC_OVERHEAD 13
+// The duty-cycle window: the current minute and the hour before it
+#define TX_BIN_MS 60000
+#define TX_WINDOW_BINS 61
+#define TX_WINDOW_MS 3600000
+// Uplinks the delivery ratio is averaged over, and how much better (%) another
+// data rate must look before the scheduler leaves the current one
+#define TX_ACK_WINDOW 32
+#define TX_DR_HYSTERESIS_PCT 25
+#define TX_LOSS_STREAK 8
+
+struct Eu868DataRate {
+    uint8_t sf;
+    uint8_t maxPayload;  // application bytes, no FOpts
+};
+
+inline constexpr Eu868DataRate EU868_DATARATES[TX_DATARATES] = {{12, 51}, {11, 51}, {10, 51},
+                                                                {9, 115}, {8, 242}, {7, 242}};
+
+// Time on air in microseconds of an uplink with appLen application bytes at
+// EU868 data rate dr: 125 kHz, CR 4/5, explicit header, CRC, 8-symbol
+// preamble, low data rate optimisation at SF11 and SF12
+inline uint32_t lorawanAirtimeUs(uint8_t dr, size_t appLen) {
+    const int32_t sf = EU868_DATARATES[dr < TX_DATARATES ? dr : TX_DATARATES - 1].sf;
+    const int32_t de = sf >= 11 ? 1 : 0;
+    const uint32_t symbolUs = (1u << sf) * 8;  // 2^SF / 125 kHz
+    const int32_t bits = 8 * (int32_t)(appLen + LORAWAN_MAC_OVERHEAD) - 4 * sf + 28 + 16;
+    const int32_t perBlock = 4 * (sf - 2 * de);
+    const uint32_t symbols = 8 + (bits > 0 ? (uint32_t)((bits + perBlock - 1) / perBlock) * 5 : 0);
+    return 49 * symbolUs / 4 + symbols * symbolUs;  // preamble + 4.25 symbols, then the payload
+}
+
+inline uint32_t lorawanAirtimeMs(uint8_t dr, size_t appLen) { return (lorawanAirtimeUs(dr, appLen) + 999) / 1000; }
+
+// Readings a full uplink carries at dr (LoRaWAN_pack(): a lone one as a plain frame)
+inline uint8_t readingsPerUplink(uint8_t dr) {
+    size_t n = (EU868_DATARATES[dr < TX_DATARATES ? dr : TX_DATARATES - 1].maxPayload - AGGREGATE_HEADER_LEN) /
+               (AGGREGATE_ENTRY_OVERHEAD + PAYLOAD_SIZE);
+    return n > 0 ? (uint8_t)n : 1;
+}
+
+// Uplink length of n readings
+inline size_t readingsUplinkLen(size_t n) {
+    return n <= 1 ? PAYLOAD_SIZE : AGGREGATE_HEADER_LEN + n * (AGGREGATE_ENTRY_OVERHEAD + PAYLOAD_SIZE);
+}
+
+// EU868 sub-bands with their own duty cycle (LoRaWAN Regional Parameters, ETSI EN 300 220)
+enum class SubBand : uint8_t {
+    G,   // 863.0 - 868.0 MHz, 1 %
+    G1,  // 868.0 - 868.6 MHz, 1 %: the default channels 868.1, 868.3, 868.5
+    G2,  // 868.7 - 869.2 MHz, 0.1 %
+    G3,  // 869.4 - 869.65 MHz, 10 %: RX2
+    G4,  // 869.7 - 870.0 MHz, 1 %
+    Count
+};
+
+struct SubBandLimit {
+    uint32_t fromHz, toHz;
+    uint16_t dutyBp;  // basis points: 100 = 1 %
+};
+
+inline constexpr SubBandLimit EU868_SUBBANDS[(size_t)SubBand::Count] = {{863000000, 868000000, 100},
+                                                                       {868000000, 868600000, 100},
+                                                                       {868700000, 869200000, 10},
+                                                                       {869400000, 869650000, 1000},
+                                                                       {869700000, 870000000, 100}};
+
+// The sub-band of a channel, Count if it is outside EU868
+inline SubBand eu868SubBand(uint32_t freqHz) {
+    for (size_t i = 0; i < (size_t)SubBand::Count; i++) {
+        if (freqHz >= EU868_SUBBANDS[i].fromHz && freqHz < EU868_SUBBANDS[i].toHz) return (SubBand)i;
+    }
+    return SubBand::Count;
+}
+
+// Airtime spent per sub-band over the last hour. Conservative: a bin counts
+// for its whole minute, so the window is up to a minute longer than an hour.
+class DutyCycleBudget {
+public:
+    // Milliseconds of airtime the sub-band allows per hour
+    static uint32_t allowanceMs(SubBand b) {
+        return b < SubBand::Count ? (uint32_t)EU868_SUBBANDS[(size_t)b].dutyBp * (TX_WINDOW_MS / 10000) : 0;
+    }
+
+    uint32_t usedMs(SubBand b, uint32_t nowMs) const {
+        if (b >= SubBand::Count) return 0;
+        const uint32_t minute = nowMs / TX_BIN_MS;
+        uint32_t used = 0;
+        for (size_t i = 0; i < TX_WINDOW_BINS; i++) {
+            if (minute - binMinute[i] < TX_WINDOW_BINS) used += binMs[(size_t)b][i];
+        }
+        return used;
+    }
+
+    uint32_t remainingMs(SubBand b, uint32_t nowMs) const {
+        uint32_t used = usedMs(b, nowMs), allowance = allowanceMs(b);
+        return used < allowance ? allowance - used : 0;
+    }
+
+    // Milliseconds until an uplink of airtimeMs fits with reserveMs still
+    // left afterwards: 0 now, UINT32_MAX never
+    uint32_t waitMs(SubBand b, uint32_t airtimeMs, uint32_t reserveMs, uint32_t nowMs) const {
+        const uint32_t allowance = allowanceMs(b);
+        if ((uint64_t)airtimeMs + reserveMs > allowance) return UINT32_MAX;
+        const uint32_t limit = allowance - airtimeMs - reserveMs;
+        uint32_t used = usedMs(b, nowMs);
+        if (used <= limit) return 0;
+        // Oldest minute first: wait until enough of them have left the window
+        const uint32_t minute = nowMs / TX_BIN_MS;
+        for (uint32_t age = TX_WINDOW_BINS - 1; age > 0; age--) {
+            if (age > minute) continue;
+            const uint32_t m = minute - age;
+            const size_t i = m % TX_WINDOW_BINS;
+            if (binMinute[i] != m) continue;
+            used -= binMs[(size_t)b][i];
+            if (used <= limit) return (m + TX_WINDOW_BINS) * TX_BIN_MS - nowMs;
+        }
+        return (minute + TX_WINDOW_BINS) * TX_BIN_MS - nowMs;
+    }
+
+    void spend(SubBand b, uint32_t airtimeMs, uint32_t nowMs) {
+        if (b >= SubBand::Count) return;
+        const uint32_t minute = nowMs / TX_BIN_MS;
+        const size_t i = minute % TX_WINDOW_BINS;
+        if (binMinute[i] != minute) {
+            for (size_t band = 0; band < (size_t)SubBand::Count; band++) binMs[band][i] = 0;
+            binMinute[i] = minute;
+        }
+        uint32_t ms = binMs[(size_t)b][i] + airtimeMs;
+        binMs[(size_t)b][i] = ms > UINT16_MAX ? UINT16_MAX : (uint16_t)ms;
+    }
+
+private:
+    uint32_t binMinute[TX_WINDOW_BINS] = {};
+    uint16_t binMs[(size_t)SubBand::Count][TX_WINDOW_BINS] = {};
+};
+
+enum class TxClass : uint8_t { Event, Periodic, Backlog, Count };
+
+inline const char* txClassName(TxClass c) {
+    static const char* const names[] = {"event", "periodic", "backlog"};
+    return (size_t)c < (size_t)TxClass::Count ? names[(size_t)c] : "?";
+}
+
+struct TxSchedulerConfig {
+    SubBand band = SubBand::G1;  // where the uplinks go: the EU868 default channels
+    uint8_t defaultDatarate = TX_DEFAULT_DATARATE;
+    uint8_t minDatarate = 0;
+    uint8_t maxDatarate = TX_DATARATES - 1;
+    bool adaptiveDatarate = true;    // needs confirmed uplinks; off: always defaultDatarate
+    uint8_t eventReservePct = 5;    // of the hourly allowance, left to events by periodic uplinks
+    uint8_t backlogReservePct = 10;  // the backlog drains only while more than this is left
+    uint16_t probeEvery = 16;        // reading uplinks between tries of a neighbouring data rate
+};
+
+class TxScheduler {
+public:
+    explicit TxScheduler(const TxSchedulerConfig& cfg = TxSchedulerConfig()) : cfg(cfg) {
+        current = clampDatarate(cfg.defaultDatarate);
+        for (uint8_t dr = 0; dr < TX_DATARATES; dr++) deliveryQ[dr] = dr <= cfg.defaultDatarate ? 1024 : 512;
+    }
+
+    const TxSchedulerConfig& config() const { return cfg; }
+    // The data rate reading uplinks use (but for probes)
+    uint8_t datarate() const { return current; }
+
+    // A reading was queued: periodic traffic until a periodic uplink goes out for it
+    void onQueued(uint32_t nowMs) {
+        if (fresh == 0) freshSinceMs = nowMs;
+        fresh++;
+    }
+
+    // What the next reading uplink is, perUplink being what it can carry
+    TxClass readingClass(uint32_t nowMs, uint32_t maxDelayMs, bool urgent, size_t perUplink) const {
+        if (urgent || fresh >= perUplink) return TxClass::Periodic;
+        if (fresh > 0 && nowMs - freshSinceMs >= maxDelayMs) return TxClass::Periodic;
+        return TxClass::Backlog;
+    }
+
+    // Data rate for the next reading uplink: the chosen one, or a neighbour
+    // when a probe is due
+    uint8_t nextDatarate() {
+        probeDr = TX_DATARATES;
+        if (!cfg.adaptiveDatarate || !feedback) return current;
+        if (current < cfg.defaultDatarate) {
+            if (sinceProbe < cfg.probeEvery / 4) return current;
+            probeFaster = false;  // up, next
+        } else if (sinceProbe < cfg.probeEvery) {
+            return current;
+        }
+        for (int i = 0; i < 2 && probeDr == TX_DATARATES; i++) {
+            probeFaster = !probeFaster;
+            if (probeFaster && current < clampDatarate(UINT8_MAX)) probeDr = current + 1;
+            if (!probeFaster && current > clampDatarate(0)) probeDr = current - 1;
+        }
+        return probeDr < TX_DATARATES ? probeDr : current;
+    }
+
+    // Data rate for an event frame of len bytes: the chosen one if the frame
+    // fits, else the slowest one it fits
+    uint8_t eventDatarate(size_t len) const {
+        uint8_t dr = current;
+        while (dr + 1 < TX_DATARATES && EU868_DATARATES[dr].maxPayload < len) dr++;
+        return dr;
+    }
+
+    // Milliseconds until the budget has room for an uplink of class c and
+    // airtimeMs (0 now)
+    uint32_t waitMs(TxClass c, uint32_t airtimeMs, uint32_t nowMs) const {
+        return budget.waitMs(cfg.band, airtimeMs, reserveMs(c), nowMs);
+    }
+
+    // Whether the uplink may go now; counts the ones that may not
+    bool admit(TxClass c, uint32_t airtimeMs, uint32_t nowMs) {
+        if (waitMs(c, airtimeMs, nowMs) == 0) return true;
+        deferredCount[(size_t)c]++;
+        return false;
+    }
+
+    // An uplink went on air at dr for airtimeMs carrying readings readings
+    // (0 for an event frame). With ack feedback, delivered is whether it was
+    // acknowledged; the airtime is spent either way.
+    void onSent(TxClass c, uint8_t dr, uint32_t airtimeMs, size_t readings, bool delivered, bool ackFeedback,
+                uint32_t nowMs) {
+        if (dr >= TX_DATARATES) dr = TX_DATARATES - 1;
+        budget.spend(cfg.band, airtimeMs, nowMs);
+        airtimeTotalMs += airtimeMs;
+        uplinkCount[(size_t)c]++;
+        datarateUplinks[dr]++;
+
+        if (ackFeedback) {
+            feedback = true;
+            // The mean of the prior and the first ACKs, then a moving average
+            // over the last TX_ACK_WINDOW
+            int32_t q = deliveryQ[dr], target = delivered ? 1024 : 0;
+            deliveryQ[dr] =
+                (uint16_t)(q + (target - q) / (samples[dr] < TX_ACK_WINDOW - 2 ? samples[dr] + 2 : TX_ACK_WINDOW));
+            if (samples[dr] < UINT16_MAX) samples[dr]++;
+            if (dr == current) {
+                lossStreak = delivered ? 0 : lossStreak + 1;
+                if (lossStreak >= TX_LOSS_STREAK) {
+                    deliveryQ[dr] /= 2;
+                    samples[dr] = 1;  // and the next ACKs weigh in fully again
+                    lossStreak = 0;
+                }
+            }
+        }
+        if (dr == probeDr) {
+            sinceProbe = 0;
+            probeDr = TX_DATARATES;
+        } else if (c != TxClass::Event) {
+            sinceProbe++;
+        }
+        choose();
+
+        if (c == TxClass::Periodic) {
+            // Delivered or not, the uplink was the turn of the readings produced
+            // since the last one; if it failed they are backlog now
+            fresh = readings < fresh ? fresh - (uint32_t)readings : 0;
+            freshSinceMs = nowMs;
+        }
+        if (!delivered) return;
+        deliveredCount[(size_t)c]++;
+        readingsDeliveredCount += readings;
+    }
+
+    // Estimated delivery ratio at dr, 0..1024
+    uint16_t deliveryRatio(uint8_t dr) const { return dr < TX_DATARATES ? deliveryQ[dr] : 0; }
+    uint16_t ackSamples(uint8_t dr) const { return dr < TX_DATARATES ? samples[dr] : 0; }
+
+    uint32_t budgetUsedMs(uint32_t nowMs) const { return budget.usedMs(cfg.band, nowMs); }
+    uint32_t budgetRemainingMs(uint32_t nowMs) const { return budget.remainingMs(cfg.band, nowMs); }
+    uint32_t uplinks(TxClass c) const { return uplinkCount[(size_t)c]; }
+    uint32_t delivered(TxClass c) const { return deliveredCount[(size_t)c]; }
+    uint32_t deferred(TxClass c) const { return deferredCount[(size_t)c]; }
+    uint32_t uplinksAt(uint8_t dr) const { return dr < TX_DATARATES ? datarateUplinks[dr] : 0; }
+    uint32_t readingsDelivered() const { return readingsDeliveredCount; }
+    uint32_t airtimeMs() const { return airtimeTotalMs; }
+
+    void logStats(uint32_t nowMs) const {
+        LOG_DEBUG("📶 tx: DR%u, uplinks event %u periodic %u backlog %u, deferred %u/%u/%u, %u readings delivered, "
+                  "airtime %u ms, %u of %u ms in the last hour",
+                  (unsigned)current, (unsigned)uplinks(TxClass::Event), (unsigned)uplinks(TxClass::Periodic),
+                  (unsigned)uplinks(TxClass::Backlog), (unsigned)deferred(TxClass::Event),
+                  (unsigned)deferred(TxClass::Periodic), (unsigned)deferred(TxClass::Backlog),
+                  (unsigned)readingsDeliveredCount, (unsigned)airtimeTotalMs, (unsigned)budgetUsedMs(nowMs),
+                  (unsigned)DutyCycleBudget::allowanceMs(cfg.band));
+    }
+
+private:
+    uint8_t clampDatarate(uint8_t dr) const {
+        uint8_t hi = cfg.maxDatarate < TX_DATARATES ? cfg.maxDatarate : TX_DATARATES - 1;
+        if (dr > hi) dr = hi;
+        return dr < cfg.minDatarate ? cfg.minDatarate : dr;
+    }
+
+    uint32_t reserveMs(TxClass c) const {
+        const uint32_t allowance = DutyCycleBudget::allowanceMs(cfg.band);
+        if (c == TxClass::Periodic) return allowance / 100 * cfg.eventReservePct;
+        if (c == TxClass::Backlog) return allowance / 100 * cfg.backlogReservePct;
+        return 0;
+    }
+
+    // The data rate with the most delivered readings per second of airtime
+    uint64_t score(uint8_t dr) const {
+        const uint8_t n = readingsPerUplink(dr);
+        return (uint64_t)deliveryQ[dr] * n * 1000000 / lorawanAirtimeUs(dr, readingsUplinkLen(n));
+    }
+
+    // The data rate with the most delivered readings per second of airtime;
+    // another one has to beat the current one by TX_DR_HYSTERESIS_PCT
+    void choose() {
+        if (!cfg.adaptiveDatarate) return;
+        uint8_t bestDr = current;
+        uint64_t best = score(current) * (100 + TX_DR_HYSTERESIS_PCT) / 100;
+        for (uint8_t dr = clampDatarate(0); dr <= clampDatarate(UINT8_MAX); dr++) {
+            if (dr > cfg.defaultDatarate && samples[dr] == 0) continue;  // not tried yet
+            if (score(dr) > best) {
+                best = score(dr);
+                bestDr = dr;
+            }
+        }
+        current = bestDr;
+    }
+
+    TxSchedulerConfig cfg;
+    DutyCycleBudget budget;
+    uint8_t current;
+    uint8_t probeDr = TX_DATARATES;  // the data rate being probed, TX_DATARATES for none
+    bool probeFaster = false;        // direction of the last probe
+    uint8_t lossStreak = 0;          // lost ACKs in a row at the chosen data rate
+    bool feedback = false;           // an ACK result has been seen
+    uint16_t sinceProbe = 0;
+    uint16_t deliveryQ[TX_DATARATES] = {};
+    uint16_t samples[TX_DATARATES] = {};
+    uint32_t fresh = 0, freshSinceMs = 0;
+    uint32_t uplinkCount[(size_t)TxClass::Count] = {};
+    uint32_t deliveredCount[(size_t)TxClass::Count] = {};
+    uint32_t deferredCount[(size_t)TxClass::Count] = {};
+    uint32_t datarateUplinks[TX_DATARATES] = {};
+    uint32_t readingsDeliveredCount = 0, airtimeTotalMs = 0;
+};
+
+#endif
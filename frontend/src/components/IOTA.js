@@ -36,7 +36,17 @@ import GPSChart from "./charts/GPSChart"
 import { GlassCard, StyledButton, StyledTextField, DataCard } from "./ui/StyledComponents"
 
 // Utilità di crittografia
-import { generateDailyKeySHA256, getEpochUTC, hexStringToBytes, decryptWithAES } from "../utils/crypto"
+import {
+  generateDailyKeySHA256,
+  getEpochUTC,
+  hexStringToBytes,
+  decryptFrameBlock,
+  toSigned8Bit,
+  CLEAR_BLOCK_LENGTH,
+  ENCRYPTED_BLOCK_LENGTH,
+  ENCRYPTED_BLOCK_OFFSET,
+  GYRO_SCALE,
+} from "../utils/crypto"
 
 const IOTA = () => {
   const navigate = useNavigate()
@@ -110,9 +120,9 @@ const decodePayload = async (hex, dailyKeyHex, isClear = false) => {
   const clearBlockLength = bytes[16]
   console.log("Clear block length:", clearBlockLength)
   
-  // CORREZIONE: Verificare che clearBlockLength sia un valore ragionevole (ad es. 6)
-  if (clearBlockLength !== 6) {
-    console.warn(`Valore clearBlockLength (${clearBlockLength}) non corrisponde al valore atteso (6)`)
+  // CORREZIONE: Verificare che clearBlockLength sia un valore ragionevole
+  if (clearBlockLength !== CLEAR_BLOCK_LENGTH) {
+    console.warn(`Valore clearBlockLength (${clearBlockLength}) non corrisponde al valore atteso (${CLEAR_BLOCK_LENGTH})`)
   }
   
   const sensorMarker = bytes[17]
@@ -130,24 +140,21 @@ const decodePayload = async (hex, dailyKeyHex, isClear = false) => {
   const gyroRawZ = bytes[22]
   console.log("Gyro raw values - X:", gyroRawX, "Y:", gyroRawY, "Z:", gyroRawZ)
   
-  const toSigned8Bit = (byte) => (byte > 127 ? byte - 256 : byte)
-  const gx = toSigned8Bit(gyroRawX) / 100
-  const gy = toSigned8Bit(gyroRawY) / 100
-  const gz = toSigned8Bit(gyroRawZ) / 100
-  console.log("Gyro converted values - X:", gx.toFixed(2), "Y:", gy.toFixed(2), "Z:", gz.toFixed(2))
-
-  // CORREZIONE: Posizione corretta per encryptedBlockLength
-  const encryptedBlockLength = bytes[23]
+  const gx = toSigned8Bit(gyroRawX) / GYRO_SCALE
+  const gy = toSigned8Bit(gyroRawY) / GYRO_SCALE
+  const gz = toSigned8Bit(gyroRawZ) / GYRO_SCALE
+  console.log("Gyro converted values - X:", gx.toFixed(1), "Y:", gy.toFixed(1), "Z:", gz.toFixed(1))
+
+  const encryptedBlockLength = bytes[ENCRYPTED_BLOCK_OFFSET - 1]
   console.log("Encrypted block length:", encryptedBlockLength)
   
-  // CORREZIONE: Verificare che encryptedBlockLength sia un valore ragionevole (ad es. 11)
-  if (encryptedBlockLength !== 11 && !isClear) {
-    console.warn(`Valore encryptedBlockLength (${encryptedBlockLength}) non corrisponde al valore atteso (11)`)
+  if (encryptedBlockLength !== ENCRYPTED_BLOCK_LENGTH && !isClear) {
+    console.warn(`Valore encryptedBlockLength (${encryptedBlockLength}) non corrisponde al valore atteso (${ENCRYPTED_BLOCK_LENGTH})`)
   }
   
   // Estrai i dati crittografati solo se encryptedBlockLength > 0
   const encryptedData = encryptedBlockLength > 0 
-    ? bytes.slice(24, 24 + encryptedBlockLength) 
+    ? bytes.slice(ENCRYPTED_BLOCK_OFFSET, ENCRYPTED_BLOCK_OFFSET + encryptedBlockLength) 
     : new Uint8Array(0)
   console.log("Encrypted data (hex):", Array.from(encryptedData).map(b => b.toString(16).padStart(2, '0')).join(' '))
   
@@ -157,78 +164,26 @@ const decodePayload = async (hex, dailyKeyHex, isClear = false) => {
     console.log("Attempting decryption with daily key:", dailyKeyHex)
     
     try {
-      const decryptedRaw = await decryptWithAES(encryptedData, effectiveIV, dailyKeyHex)
+      // Prova le meta' alte del contatore finche' i marker 0x04/0x05 tornano
+      const decrypted = await decryptFrameBlock(encryptedData, effectiveIV, dailyKeyHex)
       
-      if (decryptedRaw) {
-        console.log("Decryption successful!")
+      if (decrypted) {
+        const { decryptedRaw } = decrypted
+        console.log("Decryption successful! Counter:", decrypted.counter)
         console.log("Decrypted raw data:", Array.from(decryptedRaw).map(b => b.toString(16).padStart(2, '0')).join(' '))
         
-        // Struttura aggiornata per i dati cifrati
-        const accelMarker = decryptedRaw[0]
-        console.log("Accelerometer marker:", "0x" + accelMarker.toString(16))
-        
-        const acceleration = decryptedRaw[1]
-        console.log("Acceleration value:", acceleration)
-        
-        const gpsMarker = decryptedRaw[2]
-        console.log("GPS marker:", "0x" + gpsMarker.toString(16))
-        
-        // Log dei bytes della latitudine
-        console.log("Latitude bytes:", 
-          decryptedRaw[3].toString(16).padStart(2, '0'), 
-          decryptedRaw[4].toString(16).padStart(2, '0'), 
-          decryptedRaw[5].toString(16).padStart(2, '0'), 
-          decryptedRaw[6].toString(16).padStart(2, '0')
-        )
-        
-        // Estrae latitudine (4 bytes, int32_t)
-        const latBytes = new Uint8Array([
-          decryptedRaw[3], 
-          decryptedRaw[4], 
-          decryptedRaw[5], 
-          decryptedRaw[6]
-        ])
-        
-        const latView = new DataView(latBytes.buffer)
-        const latScaled = latView.getInt32(0, true) // true per little-endian
-        console.log("Latitude raw int32:", latScaled)
-        
-        // Log dei bytes della longitudine
-        console.log("Longitude bytes:", 
-          decryptedRaw[7].toString(16).padStart(2, '0'), 
-          decryptedRaw[8].toString(16).padStart(2, '0'), 
-          decryptedRaw[9].toString(16).padStart(2, '0'), 
-          decryptedRaw[10].toString(16).padStart(2, '0')
-        )
-        
-        // Estrae longitudine (4 bytes, int32_t)
-        const lonBytes = new Uint8Array([
-          decryptedRaw[7], 
-          decryptedRaw[8], 
-          decryptedRaw[9], 
-          decryptedRaw[10]
-        ])
-        
-        const lonView = new DataView(lonBytes.buffer)
-        const lonScaled = lonView.getInt32(0, true) // true per little-endian
-        console.log("Longitude raw int32:", lonScaled)
-        
-        // Converte i valori scalati in gradi decimali (divisione per 1e7)
-        const latitude = latScaled / 10000000
-        const longitude = lonScaled / 10000000
-        console.log("Converted coordinates - Lat:", latitude.toFixed(7), "Lon:", longitude.toFixed(7))
-        
-        decryptedData = {
-          acceleration,
-          latitude,
-          longitude,
-          latRaw: latScaled,
-          lonRaw: lonScaled
+        // 0x04 picco |a|, RMS |a|, jerk (uint16) | 0x05 lat lon (int32)
+        decryptedData = decrypted.decryptedData
+        if (decryptedData) {
+          console.log("Accelerometer marker:", "0x" + decryptedData.accelMarker.toString(16))
+          console.log("Acceleration peak/RMS/jerk:", decryptedData.acceleration, decryptedData.accelRms, decryptedData.jerk)
+          console.log("GPS marker:", "0x" + decryptedData.gpsMarker.toString(16))
+          console.log("Converted coordinates - Lat:", decryptedData.latitude.toFixed(7), "Lon:", decryptedData.longitude.toFixed(7))
         }
         
         console.log("Final decrypted data object:", decryptedData)
       } else {
-        console.error("Decryption failed!")
+        console.error("Decryption failed: markers 0x04/0x05 not found (wrong key or counter)")
       }
     } catch (error) {
       console.error("Error during decryption:", error)
@@ -845,7 +800,9 @@ const decodePayload = async (hex, dailyKeyHex, isClear = false) => {
                                     variant="body2"
                                     sx={{ color: darkMode ? "rgba(255,255,255,0.7)" : "rgba(0,0,0,0.7)" }}
                                   >
-                                    Accelerometro: {item.encryptedBlock.decryptedData.acceleration}
+                                    Accelerometro: {item.encryptedBlock.decryptedData.acceleration.toFixed(2)} m/s² (RMS{" "}
+                                    {item.encryptedBlock.decryptedData.accelRms.toFixed(2)}, jerk{" "}
+                                    {item.encryptedBlock.decryptedData.jerk.toFixed(2)})
                                   </Typography>
                                   <Typography
                                     variant="body2"
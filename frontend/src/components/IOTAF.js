@@ -37,7 +37,16 @@ import GPSChart from "./charts/GPSChart"
 import { GlassCard, StyledButton, StyledTextField, DataCard } from "./ui/StyledComponents"
 
 // Utilità di crittografia
-import { generateDailyKeySHA256, hexStringToBytes, decryptWithAES,hexToUtf8 } from "../utils/crypto"
+import {
+  generateDailyKeySHA256,
+  hexStringToBytes,
+  decryptFrameBlock,
+  hexToUtf8,
+  toSigned8Bit,
+  ENCRYPTED_BLOCK_LENGTH,
+  ENCRYPTED_BLOCK_OFFSET,
+  GYRO_SCALE,
+} from "../utils/crypto"
 
 const IOTAF = () => {
   const navigate = useNavigate()
@@ -130,18 +139,22 @@ const IOTAF = () => {
     const gyroRawZ = bytes[22]
     console.log("Gyro raw:", gyroRawX, gyroRawY, gyroRawZ)
 
-    // Convert signed
-    const toSigned8Bit = (byte) => (byte > 127 ? byte - 256 : byte)
-    const gx = toSigned8Bit(gyroRawX) / 100
-    const gy = toSigned8Bit(gyroRawY) / 100
-    const gz = toSigned8Bit(gyroRawZ) / 100
-    console.log("Gyro converted:", gx.toFixed(2), gy.toFixed(2), gz.toFixed(2))
+    const gx = toSigned8Bit(gyroRawX) / GYRO_SCALE
+    const gy = toSigned8Bit(gyroRawY) / GYRO_SCALE
+    const gz = toSigned8Bit(gyroRawZ) / GYRO_SCALE
+    console.log("Gyro converted:", gx.toFixed(1), gy.toFixed(1), gz.toFixed(1))
 
     // Byte 23 -> encryptedBlockLength
-    const encryptedBlockLength = bytes[23]
+    const encryptedBlockLength = bytes[ENCRYPTED_BLOCK_OFFSET - 1]
     console.log("Encrypted block length:", encryptedBlockLength)
+    if (encryptedBlockLength !== ENCRYPTED_BLOCK_LENGTH && !isClear) {
+      console.warn(`Encrypted block length ${encryptedBlockLength}, expected ${ENCRYPTED_BLOCK_LENGTH}`)
+    }
 
-    const encryptedData = encryptedBlockLength > 0 ? bytes.slice(24, 24 + encryptedBlockLength) : new Uint8Array(0)
+    const encryptedData =
+      encryptedBlockLength > 0
+        ? bytes.slice(ENCRYPTED_BLOCK_OFFSET, ENCRYPTED_BLOCK_OFFSET + encryptedBlockLength)
+        : new Uint8Array(0)
 
     console.log(
       "Encrypted data (hex):",
@@ -154,8 +167,11 @@ const IOTAF = () => {
     if (!isClear && dailyKeyHex && encryptedBlockLength > 0) {
       console.log("Attempting decryption with daily key:", dailyKeyHex)
       try {
-        const decryptedRaw = await decryptWithAES(encryptedData, effectiveIV, dailyKeyHex)
-        if (decryptedRaw) {
+        // Prova le meta' alte del contatore finche' i marker 0x04/0x05 tornano
+        const decrypted = await decryptFrameBlock(encryptedData, effectiveIV, dailyKeyHex)
+        if (decrypted) {
+          const { decryptedRaw } = decrypted
+          console.log("Counter:", decrypted.counter)
           console.log(
             "Decrypted raw (hex):",
             Array.from(decryptedRaw)
@@ -163,33 +179,11 @@ const IOTAF = () => {
               .join(" "),
           )
 
-          // Example structure from your EVM logic:
-          const accelMarker = decryptedRaw[0]
-          const acceleration = decryptedRaw[1]
-          const gpsMarker = decryptedRaw[2]
-
-          // Next 4 bytes -> lat, next 4 bytes -> lon
-          const latBytes = decryptedRaw.slice(3, 7)
-          const lonBytes = decryptedRaw.slice(7, 11)
-
-          const latView = new DataView(latBytes.buffer)
-          const lonView = new DataView(lonBytes.buffer)
-          const latScaled = latView.getInt32(0, true)
-          const lonScaled = lonView.getInt32(0, true)
-
-          const latitude = latScaled / 1e7
-          const longitude = lonScaled / 1e7
-
-          decryptedData = {
-            acceleration,
-            latitude,
-            longitude,
-            latRaw: latScaled,
-            lonRaw: lonScaled,
-          }
+          // 0x04 peak |a|, RMS |a|, jerk (uint16) | 0x05 lat lon (int32)
+          decryptedData = decrypted.decryptedData
           console.log("Decrypted data object:", decryptedData)
         } else {
-          console.error("Decryption failed!")
+          console.error("Decryption failed: markers 0x04/0x05 not found (wrong key or counter)")
         }
       } catch (err) {
         console.error("Error during decryption:", err)
@@ -924,7 +918,9 @@ const IOTAF = () => {
                                     variant="body2"
                                     sx={{ color: darkMode ? "rgba(255,255,255,0.7)" : "rgba(0,0,0,0.7)" }}
                                   >
-                                    Accelerometro: {item.encryptedBlock.decryptedData.acceleration}
+                                    Accelerometro: {item.encryptedBlock.decryptedData.acceleration.toFixed(2)} m/s² (RMS{" "}
+                                    {item.encryptedBlock.decryptedData.accelRms.toFixed(2)}, jerk{" "}
+                                    {item.encryptedBlock.decryptedData.jerk.toFixed(2)})
                                   </Typography>
                                   <Typography
                                     variant="body2"
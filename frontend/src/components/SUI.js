@@ -34,7 +34,15 @@ import GPSChart from "./charts/GPSChart"
 import { GlassCard, StyledButton, StyledTextField, DataCard } from "./ui/StyledComponents"
 
 // Utilità di crittografia
-import { hexStringToBytes, generateDailyKeySHA256, decryptWithAES } from "../utils/crypto"
+import {
+  hexStringToBytes,
+  generateDailyKeySHA256,
+  decryptFrameBlock,
+  toSigned8Bit,
+  ENCRYPTED_BLOCK_LENGTH,
+  ENCRYPTED_BLOCK_OFFSET,
+  GYRO_SCALE,
+} from "../utils/crypto"
 
 const SUI = () => {
   const navigate = useNavigate()
@@ -130,8 +138,8 @@ const SUI = () => {
           const hexData = typeof rawValue === 'string' ? rawValue : String(rawValue);
           const rawBytes = hexStringToBytes(hexData);
 
-          // Verifica che il payload sia valido: IV (16) + clear block (7) + encrypted block (minimo 11) = almeno 35 byte
-          if (rawBytes.length < 35) return null
+          // Verifica che il payload sia valido: IV (16) + clear block (7) + encrypted block (17) = almeno 40 byte
+          if (rawBytes.length < ENCRYPTED_BLOCK_OFFSET + ENCRYPTED_BLOCK_LENGTH) return null
 
           const effectiveIV = rawBytes.slice(0, 16)
           const clearBlockLength = rawBytes[16]
@@ -140,21 +148,21 @@ const SUI = () => {
           // byte 17: marker temperatura (0x01)
           // byte 18: temperatura
           // byte 19: marker giroscopio (0x03)
-          // byte 20: gx, byte 21: gy, byte 22: gz
+          // byte 20: gx, byte 21: gy, byte 22: gz (rad/s * 10)
           const temperature = rawBytes[18]
-          const gyroX = (rawBytes[20] > 127 ? rawBytes[20] - 256 : rawBytes[20]) / 100
-          const gyroY = (rawBytes[21] > 127 ? rawBytes[21] - 256 : rawBytes[21]) / 100
-          const gyroZ = (rawBytes[22] > 127 ? rawBytes[22] - 256 : rawBytes[22]) / 100
+          const gyroX = toSigned8Bit(rawBytes[20]) / GYRO_SCALE
+          const gyroY = toSigned8Bit(rawBytes[21]) / GYRO_SCALE
+          const gyroZ = toSigned8Bit(rawBytes[22]) / GYRO_SCALE
 
           // Blocco cifrato:
-          // byte 23: lunghezza blocco cifrato (ad es. 11)
+          // byte 23: lunghezza blocco cifrato (16)
           // byte 24: marker accelerometro (0x04)
-          // byte 25: dato accelerometro
-          // byte 26: marker GPS (0x05)
-          // byte 27-30: latitudine (int32 little-endian)
-          // byte 31-34: longitudine (int32 little-endian)
-          const encryptedBlockLength = rawBytes[23]
-          const encryptedData = rawBytes.slice(24, 24 + encryptedBlockLength)
+          // byte 25-30: picco |a|, RMS |a|, jerk (uint16 little-endian, * 100)
+          // byte 31: marker GPS (0x05)
+          // byte 32-35: latitudine (int32 little-endian)
+          // byte 36-39: longitudine (int32 little-endian)
+          const encryptedBlockLength = rawBytes[ENCRYPTED_BLOCK_OFFSET - 1]
+          const encryptedData = rawBytes.slice(ENCRYPTED_BLOCK_OFFSET, ENCRYPTED_BLOCK_OFFSET + encryptedBlockLength)
 
           return {
             time: new Date(Number(tx.timestampMs)).toLocaleTimeString(),
@@ -218,35 +226,14 @@ const SUI = () => {
       const decryptedSensorData = await Promise.all(
         sensorData.map(async (record) => {
           try {
-            const decryptedBytes = await decryptWithAES(
+            // Prova le meta' alte del contatore finche' i marker 0x04/0x05 tornano
+            const decrypted = await decryptFrameBlock(
               record.rawData.encryptedBlock.encryptedData,
               record.rawData.effectiveIV,
               keyToUse,
             )
-
-            if (!decryptedBytes) throw new Error("Decryption failed")
-
-            // Analisi del payload decifrato
-            let acceleration = null
-            let latitude = null
-            let longitude = null
-
-            // Scansione dei byte decifrati per individuare i marker
-            for (let i = 0; i < decryptedBytes.length; i++) {
-              if (decryptedBytes[i] === 0x04 && i + 1 < decryptedBytes.length) {
-                acceleration = decryptedBytes[i + 1]
-              }
-              if (decryptedBytes[i] === 0x05 && i + 8 <= decryptedBytes.length) {
-                const latBytes = decryptedBytes.slice(i + 1, i + 5)
-                const lonBytes = decryptedBytes.slice(i + 5, i + 9)
-                // Conversione da little-endian a int32
-                latitude = latBytes[0] | (latBytes[1] << 8) | (latBytes[2] << 16) | (latBytes[3] << 24)
-                longitude = lonBytes[0] | (lonBytes[1] << 8) | (lonBytes[2] << 16) | (lonBytes[3] << 24)
-                // Normalizzazione in float (lat/lon = valore intero / 1e7)
-                latitude = latitude / 1e7
-                longitude = longitude / 1e7
-              }
-            }
+            if (!decrypted) throw new Error("Wrong key, counter or block: markers 0x04/0x05 not found")
+            const { decryptedData } = decrypted
 
             return {
               ...record,
@@ -254,11 +241,7 @@ const SUI = () => {
                 ...record.rawData,
                 encryptedBlock: {
                   ...record.rawData.encryptedBlock,
-                  decryptedData: {
-                    acceleration,
-                    latitude,
-                    longitude,
-                  },
+                  decryptedData,
                 },
               },
             }
@@ -111,6 +111,94 @@ export const getEpochUTC = (dateStr) => {
       return null
     }
   }
+  // Layout del frame salvato on-chain (firmware/frame_layout.h): IV esteso a 16 byte,
+  // | 6 | 0x01 T | 0x03 gx gy gz | 16 | AES-CTR(0x04 Apk Arms J | 0x05 lat lon) |
+  export const FRAME_IV_LENGTH = 16
+  export const CLEAR_BLOCK_LENGTH = 6
+  export const ENCRYPTED_BLOCK_LENGTH = 16
+  export const ENCRYPTED_BLOCK_OFFSET = FRAME_IV_LENGTH + 1 + CLEAR_BLOCK_LENGTH + 1
+  export const GYRO_SCALE = 10        // rad/s * 10
+  export const ACCEL_SCALE = 100      // m/s^2 * 100
+  export const GPS_SCALE = 10000000   // gradi * 1e7
+
+  export const ACCEL_MARKER = 0x04
+  export const GPS_MARKER = 0x05
+
+  // Il blocco contatore AES-CTR e' il contatore di messaggi a 32 bit del
+  // dispositivo (little-endian) seguito da 12 byte a zero (frameCounterBlock in
+  // firmware/frame_layout.h), ma in onda e on-chain ci sono solo i 16 bit bassi.
+  // La meta' alta si cerca tra quelle raggiungibili in un giorno, al massimo
+  // MAX_FRAME_RATE frame al secondo (FrameDecoder::MAX_FRAME_RATE nel backend).
+  export const MAX_FRAME_RATE = 128
+  export const MAX_COUNTER_HIGH = Math.ceil((MAX_FRAME_RATE * 86400) / 65536)
+
+  export const toSigned8Bit = (byte) => (byte > 127 ? byte - 256 : byte)
+
+  // Decodifica il blocco cifrato dopo la decrittazione:
+  // byte 0: marker accelerometro (0x04)
+  // byte 1-2: picco |a|, byte 3-4: RMS |a|, byte 5-6: jerk (uint16 little-endian, * 100)
+  // byte 7: marker GPS (0x05)
+  // byte 8-11: latitudine, byte 12-15: longitudine (int32 little-endian, * 1e7)
+  // Restituisce null se i marker non tornano (chiave o contatore sbagliati)
+  export const parseDecryptedBlock = (decryptedRaw) => {
+    if (!decryptedRaw || decryptedRaw.length < ENCRYPTED_BLOCK_LENGTH) return null
+    if (decryptedRaw[0] !== ACCEL_MARKER || decryptedRaw[7] !== GPS_MARKER) return null
+    const view = new DataView(decryptedRaw.buffer, decryptedRaw.byteOffset, decryptedRaw.byteLength)
+    const latRaw = view.getInt32(8, true)
+    const lonRaw = view.getInt32(12, true)
+    if (Math.abs(latRaw) > 90 * GPS_SCALE || Math.abs(lonRaw) > 180 * GPS_SCALE) return null
+    return {
+      accelMarker: decryptedRaw[0],
+      acceleration: view.getUint16(1, true) / ACCEL_SCALE,
+      accelRms: view.getUint16(3, true) / ACCEL_SCALE,
+      jerk: view.getUint16(5, true) / ACCEL_SCALE,
+      gpsMarker: decryptedRaw[7],
+      latitude: latRaw / GPS_SCALE,
+      longitude: lonRaw / GPS_SCALE,
+      latRaw,
+      lonRaw,
+    }
+  }
+
+  // Decritta il blocco cifrato di un frame salvato on-chain. L'IV esteso porta
+  // i 16 bit bassi del contatore (byte 0-1) e, se noti, quelli alti (byte 2-3):
+  // si prova prima quello, poi ogni meta' alta fino a MAX_COUNTER_HIGH, finche'
+  // i marker 0x04/0x05 tornano. Restituisce { decryptedRaw, decryptedData,
+  // counter } oppure null.
+  export const decryptFrameBlock = async (encryptedBytes, effectiveIV, dailyKeyHex) => {
+    const keyBuffer = hexStringToBytes(dailyKeyHex)
+    const cryptoKey = await crypto.subtle.importKey("raw", keyBuffer, { name: "AES-CTR" }, false, ["decrypt"])
+    const storedHigh = effectiveIV[2] | (effectiveIV[3] << 8)
+    const candidates = [storedHigh]
+    for (let high = 0; high <= MAX_COUNTER_HIGH; high++) {
+      if (high !== storedHigh) candidates.push(high)
+    }
+    for (const high of candidates) {
+      const counterBlock = new Uint8Array(16)
+      counterBlock[0] = effectiveIV[0]
+      counterBlock[1] = effectiveIV[1]
+      counterBlock[2] = high & 0xff
+      counterBlock[3] = high >> 8
+      let decryptedRaw
+      try {
+        const decryptedBuffer = await crypto.subtle.decrypt(
+          { name: "AES-CTR", counter: counterBlock, length: 128 },
+          cryptoKey,
+          encryptedBytes
+        )
+        decryptedRaw = new Uint8Array(decryptedBuffer)
+      } catch (error) {
+        console.error("Decryption error:", error)
+        return null
+      }
+      const decryptedData = parseDecryptedBlock(decryptedRaw)
+      if (decryptedData) {
+        return { decryptedRaw, decryptedData, counter: high * 65536 + (effectiveIV[0] | (effectiveIV[1] << 8)) }
+      }
+    }
+    return null
+  }
+
   export const fetchAndDecryptIotaBlock = async (blockId, masterKeyHex, vehicleId, initDate, fetchDate) => {
   try {
     console.log(`🔍 Fetching IOTA block: ${blockId}`);
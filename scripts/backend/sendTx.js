@@ -132,14 +132,16 @@ app.post('/sendTx', async (req, res) => {
     console.log(`\n📥 Received Payload HEX: ${payload}`);
     console.log(`🔎 Raw Payload Buffer: ${payloadBuffer.toString('hex')}`);
 
-    const BLOCK_SIZE = 20;
+    const BLOCK_SIZE = 26; // PAYLOAD_SIZE in firmware/frame_layout.h
     const blocks = [];
 
-    // ✅ Split il payload ogni 20 bytes
+    // ✅ Split il payload ogni BLOCK_SIZE bytes
     for (let i = 0; i < payloadBuffer.length; i += BLOCK_SIZE) {
       const block = payloadBuffer.subarray(i, i + BLOCK_SIZE);
       if (block.length === BLOCK_SIZE) {
-        // 🔄 Ricostruisci il full IV per ogni blocco
+        // 🔄 Ricostruisci il full IV per ogni blocco: qui si conoscono solo i 16 bit
+        // bassi del contatore, i byte 2-3 (meta' alta) restano a zero e le dashboard
+        // la cercano (decryptFrameBlock in frontend/src/utils/crypto.js)
         const iv2Bytes = block.subarray(0, 2);
         const fullIV = Buffer.concat([iv2Bytes, Buffer.alloc(14, 0)]);
         const encryptedPart = block.subarray(2);
@@ -153,7 +155,7 @@ app.post('/sendTx', async (req, res) => {
         console.log(`    Encrypted: ${encryptedPart.toString('hex')}`);
         console.log(`    Final Payload to Send: ${finalPayload.toString('hex')}`);
       } else {
-        console.warn(`⚠️ Block size mismatch: expected 20 bytes, got ${block.length} bytes. Skipping.`);
+        console.warn(`⚠️ Block size mismatch: expected ${BLOCK_SIZE} bytes, got ${block.length} bytes. Skipping.`);
       }
     }
 
@@ -46,14 +46,66 @@ client.on('close', () => {
   console.log('MQTT connection closed.');
 });
 
-// Process uplink: decode the frm_payload and forward data to blockchain service
+// LoRaWAN ports and frame formats used by the firmware (see firmware/frame_layout.h)
+const FPORT_FRAME = 1;
+const FPORT_AGGREGATE = 2;
+const FPORT_EVENT = 3;
+const FRAME_FORMAT_OFFSET = 2;
+const COMPACT_FORMAT = 0x80;
+
+// Frames already forwarded: a batch whose ACK got lost is sent again
+const recentFrames = new Set();
+const RECENT_FRAMES_MAX = 4096;
+
+// Splits an aggregated uplink | count | len0 | frame0 | len1 | frame1 | ... into frames
+function splitAggregate(buffer) {
+  const frames = [];
+  let offset = 1;
+  for (let i = 0; i < buffer[0]; i++) {
+    const len = buffer[offset];
+    if (len === undefined || offset + 1 + len > buffer.length) return null;
+    frames.push(buffer.subarray(offset + 1, offset + 1 + len));
+    offset += 1 + len;
+  }
+  return offset === buffer.length ? frames : null;
+}
+
+// Process uplink: decode the frm_payload and forward each frame to blockchain service
 function processUplink(deviceId, payload) {
   const timestamp = payload.received_at || new Date().toISOString();
   if (payload.uplink_message && payload.uplink_message.frm_payload) {
+    const port = payload.uplink_message.f_port;
+    if (port === FPORT_EVENT) {
+      // Crash event chunks are reassembled by the C++ backend (bbingest), not anchored as readings
+      console.log(`Crash event chunk from ${deviceId} not forwarded (decode it with bbingest)`);
+      return;
+    }
+    if (port !== FPORT_FRAME && port !== FPORT_AGGREGATE) {
+      console.warn(`Uplink from ${deviceId} on unknown port ${port} not forwarded`);
+      return;
+    }
     const base64Payload = payload.uplink_message.frm_payload;
     const decodedBuffer = Buffer.from(base64Payload, 'base64');
-    const decodedHex = decodedBuffer.toString('hex');
-    sendToBlockchain(decodedHex, timestamp, deviceId);
+    const frames = port === FPORT_AGGREGATE
+      ? splitAggregate(decodedBuffer)
+      : [decodedBuffer];
+    if (!frames) {
+      console.error(`Malformed aggregated uplink from ${deviceId}`);
+      return;
+    }
+    for (const frame of frames) {
+      if (frame.length > FRAME_FORMAT_OFFSET && (frame[FRAME_FORMAT_OFFSET] & COMPACT_FORMAT)) {
+        // sendTx anchors only the default 26-byte frame; compact frames are decoded by the backend
+        console.log(`Compact frame from ${deviceId} not forwarded (decode it with bbingest)`);
+        continue;
+      }
+      const decodedHex = frame.toString('hex');
+      const frameId = `${deviceId}:${decodedHex}`;
+      if (recentFrames.has(frameId)) continue;
+      if (recentFrames.size >= RECENT_FRAMES_MAX) recentFrames.clear();
+      recentFrames.add(frameId);
+      sendToBlockchain(decodedHex, timestamp, deviceId);
+    }
   }
 }
 